@@ -45,6 +45,7 @@ static DRAM_ATTR i2c_dev_t* const I2C[I2C_NUM_MAX] = { &I2C0, &I2C1 };
 #define I2C_EXIT_CRITICAL_ISR(mux)     portEXIT_CRITICAL_ISR(mux)
 #define I2C_ENTER_CRITICAL(mux)    portENTER_CRITICAL(mux)
 #define I2C_EXIT_CRITICAL(mux)     portEXIT_CRITICAL(mux)
+#define I2C_TRANS_TICKS(trans)     ((trans)->timeout ? (trans)->timeout : I2C_TRANS_TIMEOUT_DEFAULT)
 
 #define I2C_DRIVER_ERR_STR             "i2c driver install error"
 #define I2C_DRIVER_MALLOC_ERR_STR      "i2c driver malloc error"
@@ -63,6 +64,11 @@ static DRAM_ATTR i2c_dev_t* const I2C[I2C_NUM_MAX] = { &I2C0, &I2C1 };
 #define I2C_SDA_IO_ERR_STR              "sda gpio number error"
 #define I2C_SCL_IO_ERR_STR              "scl gpio number error"
 #define I2C_CMD_LINK_INIT_ERR_STR       "i2c command link error"
+#define I2C_CMD_LINK_BUF_ERR_STR        "i2c command link buffer too small"
+#define I2C_CMD_LINK_FULL_ERR_STR       "i2c static command link full"
+#define I2C_DATA_LEN_ERR_STR            "i2c data length error"
+#define I2C_TRANS_QUEUE_ERR_STR         "i2c transaction queue error"
+#define I2C_QUEUE_SIZE_ERR_STR          "i2c transaction queue size error"
 #define I2C_GPIO_PULLUP_ERR_STR         "this i2c pin do not support internal pull-up"
 #define I2C_FIFO_FULL_THRESH_VAL   (28)
 #define I2C_FIFO_EMPTY_THRESH_VAL  (5)
@@ -87,13 +93,19 @@ typedef struct {
     i2c_cmd_link_t* head;     /*!< head of the command link */
     i2c_cmd_link_t* cur;      /*!< last node of the command link */
     i2c_cmd_link_t* free;     /*!< the first node to free of the command link */
+    i2c_cmd_link_t* pool;     /*!< next unused node of a static command link */
+    i2c_cmd_link_t* pool_end; /*!< end of the static command link buffer, NULL if nodes come from the heap */
 } i2c_cmd_desc_t;
 
+_Static_assert(sizeof(i2c_cmd_link_t) <= I2C_CMD_LINK_ITEM_SIZE, "I2C_CMD_LINK_ITEM_SIZE too small for i2c_cmd_link_t");
+_Static_assert(sizeof(i2c_cmd_desc_t) <= I2C_CMD_LINK_ITEM_SIZE, "I2C_CMD_LINK_ITEM_SIZE too small for i2c_cmd_desc_t");
+
 typedef enum {
     I2C_STATUS_READ,      /*!< read status for current master command */
     I2C_STATUS_WRITE,     /*!< write status for current master command */
     I2C_STATUS_IDLE,      /*!< idle status for current master command */
     I2C_STATUS_ACK_ERROR, /*!< ack error status for current master command */
+    I2C_STATUS_TIMEOUT,   /*!< current master command stalled on the bus */
     I2C_STATUS_DONE,      /*!< I2C command done */
 } i2c_status_t;
 
@@ -107,10 +119,18 @@ typedef struct {
     int rx_cnt;                      /*!< record current read index, for master mode */
     uint8_t data_buf[I2C_FIFO_LEN];  /*!< a buffer to store i2c fifo data */
     i2c_cmd_desc_t cmd_link;         /*!< I2C command link */
+    uint8_t* cmd_data;               /*!< next data byte of the current command, for master mode */
+    size_t cmd_remain;               /*!< bytes left in the current command, for master mode */
     xSemaphoreHandle cmd_sem;        /*!< semaphore to sync command status */
     xSemaphoreHandle cmd_mux;        /*!< semaphore to lock command process */
     size_t tx_fifo_remain;           /*!< tx fifo remain length, for master mode */
     size_t rx_fifo_remain;           /*!< rx fifo remain length, for master mode */
+    QueueHandle_t trans_queue;       /*!< transactions waiting for the bus, for master mode */
+    QueueHandle_t ret_queue;         /*!< finished transactions without done callback, for master mode */
+    i2c_trans_t* cur_trans;          /*!< queued transaction on the bus, NULL for i2c_master_cmd_begin() */
+    TickType_t trans_deadline;       /*!< tick by which cur_trans has to be done, for master mode */
+    bool queue_busy;                 /*!< the isr is sending queued transactions, for master mode */
+    bool sync_busy;                  /*!< i2c_master_cmd_begin() owns the bus, for master mode */
 
     xSemaphoreHandle slv_rx_mux;     /*!< slave rx buffer mux */
     xSemaphoreHandle slv_tx_mux;     /*!< slave tx buffer mux */
@@ -123,6 +143,10 @@ typedef struct {
 static i2c_obj_t *p_i2c_obj[I2C_NUM_MAX] = {0};
 static void i2c_isr_handler_default(void* arg);
 static void IRAM_ATTR i2c_master_cmd_begin_static(i2c_port_t i2c_num);
+static void IRAM_ATTR i2c_master_cmd_next(i2c_obj_t* p_i2c, i2c_cmd_link_t* link);
+static void IRAM_ATTR i2c_master_cmd_start(i2c_port_t i2c_num, i2c_cmd_desc_t* cmd);
+static void IRAM_ATTR i2c_master_cmd_done(i2c_port_t i2c_num, portBASE_TYPE* HPTaskAwoken);
+static void i2c_master_hw_reset(i2c_port_t i2c_num);
 
 /*
     For i2c master mode, we don't need to use a buffer for the data, the APIs will execute the master commands
@@ -268,6 +292,12 @@ esp_err_t i2c_driver_delete(i2c_port_t i2c_num)
     if (p_i2c->slv_tx_mux) {
         vSemaphoreDelete(p_i2c->slv_tx_mux);
     }
+    if (p_i2c->trans_queue) {
+        vQueueDelete(p_i2c->trans_queue);
+    }
+    if (p_i2c->ret_queue) {
+        vQueueDelete(p_i2c->ret_queue);
+    }
 
     if (p_i2c->rx_ring_buf) {
         vRingbufferDelete(p_i2c->rx_ring_buf);
@@ -320,7 +350,7 @@ esp_err_t i2c_reset_rx_fifo(i2c_port_t i2c_num)
 static void i2c_isr_handler_default(void* arg)
 {
     i2c_obj_t* p_i2c = (i2c_obj_t*) arg;
-    int i2c_num = p_i2c->i2c_num;
+    i2c_port_t i2c_num = (i2c_port_t) p_i2c->i2c_num;
     uint32_t status = I2C[i2c_num]->int_status.val;
     int idx = 0;
     portBASE_TYPE HPTaskAwoken = pdFALSE;
@@ -342,6 +372,11 @@ static void i2c_isr_handler_default(void* arg)
             I2C[i2c_num]->int_clr.trans_start = 1;
         } else if (status & I2C_TIME_OUT_INT_ST_M) {
             I2C[i2c_num]->int_clr.time_out = 1;
+            if (p_i2c->mode == I2C_MODE_MASTER && p_i2c->status != I2C_STATUS_DONE) {
+                //SCL held low or the bus stuck, the command will not end by itself
+                p_i2c->status = I2C_STATUS_TIMEOUT;
+                i2c_master_cmd_begin_static(i2c_num);
+            }
         } else if (status & I2C_TRANS_COMPLETE_INT_ST_M) {
             I2C[i2c_num]->int_clr.trans_complete = 1;
             if (p_i2c->mode == I2C_MODE_SLAVE) {
@@ -355,7 +390,7 @@ static void i2c_isr_handler_default(void* arg)
                 }
                 I2C[i2c_num]->int_clr.rx_fifo_full = 1;
             } else {
-                if (p_i2c->status != I2C_STATUS_ACK_ERROR) {
+                if (p_i2c->status != I2C_STATUS_ACK_ERROR && p_i2c->status != I2C_STATUS_TIMEOUT) {
                     i2c_master_cmd_begin_static(i2c_num);
                 }
             }
@@ -421,10 +456,10 @@ esp_err_t i2c_get_data_mode(i2c_port_t i2c_num, i2c_trans_mode_t *tx_trans_mode,
 {
     I2C_CHECK(i2c_num < I2C_NUM_MAX, I2C_NUM_ERROR_STR, ESP_ERR_INVALID_ARG);
     if (tx_trans_mode) {
-        *tx_trans_mode = I2C[i2c_num]->ctr.tx_lsb_first;
+        *tx_trans_mode = I2C[i2c_num]->ctr.tx_lsb_first ? I2C_DATA_MODE_LSB_FIRST : I2C_DATA_MODE_MSB_FIRST;
     }
     if (rx_trans_mode) {
-        *rx_trans_mode = I2C[i2c_num]->ctr.rx_lsb_first;
+        *rx_trans_mode = I2C[i2c_num]->ctr.rx_lsb_first ? I2C_DATA_MODE_LSB_FIRST : I2C_DATA_MODE_MSB_FIRST;
     }
     return ESP_OK;
 }
@@ -664,12 +699,38 @@ i2c_cmd_handle_t i2c_cmd_link_create()
     return (i2c_cmd_handle_t) cmd_desc;
 }
 
+i2c_cmd_handle_t i2c_cmd_link_create_static(uint8_t* buffer, size_t size)
+{
+    I2C_CHECK(buffer != NULL, I2C_ADDR_ERROR_STR, NULL);
+    uintptr_t start = ((uintptr_t) buffer + sizeof(void*) - 1) & ~(uintptr_t) (sizeof(void*) - 1);
+    uintptr_t end = (uintptr_t) buffer + size;
+    I2C_CHECK(end >= start + sizeof(i2c_cmd_desc_t) + sizeof(i2c_cmd_link_t), I2C_CMD_LINK_BUF_ERR_STR, NULL);
+
+    i2c_cmd_desc_t* cmd_desc = (i2c_cmd_desc_t*) start;
+    memset(cmd_desc, 0, sizeof(i2c_cmd_desc_t));
+    cmd_desc->pool = (i2c_cmd_link_t*) (cmd_desc + 1);
+    cmd_desc->pool_end = cmd_desc->pool + (end - (uintptr_t) cmd_desc->pool) / sizeof(i2c_cmd_link_t);
+    return (i2c_cmd_handle_t) cmd_desc;
+}
+
+void i2c_cmd_link_delete_static(i2c_cmd_handle_t cmd_handle)
+{
+    if (cmd_handle == NULL) {
+        return;
+    }
+    memset(cmd_handle, 0, sizeof(i2c_cmd_desc_t));
+}
+
 void i2c_cmd_link_delete(i2c_cmd_handle_t cmd_handle)
 {
     if (cmd_handle == NULL) {
         return;
     }
     i2c_cmd_desc_t* cmd = (i2c_cmd_desc_t*) cmd_handle;
+    if (cmd->pool_end) {
+        i2c_cmd_link_delete_static(cmd_handle);
+        return;
+    }
     while (cmd->free) {
         i2c_cmd_link_t* ptmp = cmd->free;
         cmd->free = cmd->free->next;
@@ -685,28 +746,33 @@ void i2c_cmd_link_delete(i2c_cmd_handle_t cmd_handle)
 static esp_err_t i2c_cmd_link_append(i2c_cmd_handle_t cmd_handle, i2c_cmd_t* cmd)
 {
     i2c_cmd_desc_t* cmd_desc = (i2c_cmd_desc_t*) cmd_handle;
-    if (cmd_desc->head == NULL) {
-        cmd_desc->head = (i2c_cmd_link_t*) malloc(sizeof(i2c_cmd_link_t));
-        if (cmd_desc->head == NULL) {
-            ESP_LOGE(I2C_TAG, I2C_CMD_MALLOC_ERR_STR);
-            goto err;
+    i2c_cmd_link_t* link;
+    if (cmd_desc->pool_end) {
+        //static command link, take the next node from the caller's buffer
+        if (cmd_desc->pool == cmd_desc->pool_end) {
+            ESP_LOGE(I2C_TAG, I2C_CMD_LINK_FULL_ERR_STR);
+            return ESP_ERR_NO_MEM;
         }
-        cmd_desc->cur = cmd_desc->head;
-        cmd_desc->free = cmd_desc->head;
+        link = cmd_desc->pool++;
     } else {
-        cmd_desc->cur->next = (i2c_cmd_link_t*) malloc(sizeof(i2c_cmd_link_t));
-        if (cmd_desc->cur->next == NULL) {
+        link = (i2c_cmd_link_t*) malloc(sizeof(i2c_cmd_link_t));
+        if (link == NULL) {
             ESP_LOGE(I2C_TAG, I2C_CMD_MALLOC_ERR_STR);
-            goto err;
+            return ESP_FAIL;
         }
-        cmd_desc->cur = cmd_desc->cur->next;
     }
-    memcpy((uint8_t*) &cmd_desc->cur->cmd, (uint8_t*) cmd, sizeof(i2c_cmd_t));
-    cmd_desc->cur->next = NULL;
+    memcpy((uint8_t*) &link->cmd, (uint8_t*) cmd, sizeof(i2c_cmd_t));
+    link->next = NULL;
+    if (cmd_desc->head == NULL) {
+        cmd_desc->head = link;
+        if (cmd_desc->pool_end == NULL) {
+            cmd_desc->free = link;
+        }
+    } else {
+        cmd_desc->cur->next = link;
+    }
+    cmd_desc->cur = link;
     return ESP_OK;
-
-    err:
-    return ESP_FAIL;
 }
 
 esp_err_t i2c_master_start(i2c_cmd_handle_t cmd_handle)
@@ -817,6 +883,273 @@ esp_err_t i2c_master_read_byte(i2c_cmd_handle_t cmd_handle, uint8_t* data, int a
     return i2c_cmd_link_append(cmd_handle, &cmd);
 }
 
+esp_err_t i2c_master_read_reg(i2c_cmd_handle_t cmd_handle, uint8_t slave_addr, uint8_t reg_addr, uint8_t* data, size_t data_len)
+{
+    I2C_CHECK((data != NULL), I2C_ADDR_ERROR_STR, ESP_ERR_INVALID_ARG);
+    I2C_CHECK(cmd_handle != NULL, I2C_CMD_LINK_INIT_ERR_STR, ESP_ERR_INVALID_ARG);
+    I2C_CHECK(data_len > 0, I2C_DATA_LEN_ERR_STR, ESP_ERR_INVALID_ARG);
+
+    esp_err_t ret = i2c_master_start(cmd_handle);
+    if (ret == ESP_OK) {
+        ret = i2c_master_write_byte(cmd_handle, (slave_addr << 1) | I2C_MASTER_WRITE, true);
+    }
+    if (ret == ESP_OK) {
+        ret = i2c_master_write_byte(cmd_handle, reg_addr, true);
+    }
+    if (ret == ESP_OK) {
+        ret = i2c_master_start(cmd_handle);
+    }
+    if (ret == ESP_OK) {
+        ret = i2c_master_write_byte(cmd_handle, (slave_addr << 1) | I2C_MASTER_READ, true);
+    }
+    if (ret == ESP_OK && data_len > 1) {
+        ret = i2c_master_read(cmd_handle, data, data_len - 1, 0);
+    }
+    if (ret == ESP_OK) {
+        //NACK the last byte to end the read
+        ret = i2c_master_read_byte(cmd_handle, data + data_len - 1, 1);
+    }
+    if (ret == ESP_OK) {
+        ret = i2c_master_stop(cmd_handle);
+    }
+    return ret;
+}
+
+/*
+ * Make 'link' the current master command. Progress through its data is kept
+ * here rather than in the command itself, so command links stay reusable.
+ */
+static void IRAM_ATTR i2c_master_cmd_next(i2c_obj_t* p_i2c, i2c_cmd_link_t* link)
+{
+    p_i2c->cmd_link.head = link;
+    if (link) {
+        p_i2c->cmd_data = link->cmd.data;
+        p_i2c->cmd_remain = link->cmd.byte_num;
+    }
+}
+
+/*
+ * Load a command link and start sending it. Called by the task or the isr that owns the bus.
+ */
+static void IRAM_ATTR i2c_master_cmd_start(i2c_port_t i2c_num, i2c_cmd_desc_t* cmd)
+{
+    i2c_obj_t* p_i2c = p_i2c_obj[i2c_num];
+    I2C[i2c_num]->fifo_conf.tx_fifo_rst = 1;
+    I2C[i2c_num]->fifo_conf.tx_fifo_rst = 0;
+    I2C[i2c_num]->fifo_conf.rx_fifo_rst = 1;
+    I2C[i2c_num]->fifo_conf.rx_fifo_rst = 0;
+    p_i2c->cmd_link.free = cmd->free;
+    p_i2c->cmd_link.cur = cmd->cur;
+    i2c_master_cmd_next(p_i2c, cmd->head);
+    p_i2c->status = I2C_STATUS_IDLE;
+    p_i2c->cmd_idx = 0;
+    p_i2c->rx_cnt = 0;
+    p_i2c->tx_fifo_remain = I2C_FIFO_LEN;
+    p_i2c->rx_fifo_remain = I2C_FIFO_LEN;
+    i2c_master_cmd_begin_static(i2c_num);
+}
+
+/*
+ * The command link on the bus is done. Wake up i2c_master_cmd_begin(), or return the queued
+ * transaction and chain the next one straight away, so the bus does not wait for a task.
+ */
+static void IRAM_ATTR i2c_master_cmd_done(i2c_port_t i2c_num, portBASE_TYPE* HPTaskAwoken)
+{
+    i2c_obj_t* p_i2c = p_i2c_obj[i2c_num];
+    i2c_trans_t* trans = p_i2c->cur_trans;
+    //SCL stays put while the bus is idle, that is no timeout
+    I2C[i2c_num]->int_ena.time_out = 0;
+    if (trans == NULL) {
+        xSemaphoreGiveFromISR(p_i2c->cmd_sem, HPTaskAwoken);
+        return;
+    }
+    if (p_i2c->status == I2C_STATUS_ACK_ERROR) {
+        trans->result = ESP_FAIL;
+    } else if (p_i2c->status == I2C_STATUS_TIMEOUT) {
+        trans->result = ESP_ERR_TIMEOUT;
+    } else {
+        trans->result = ESP_OK;
+    }
+    p_i2c->status = I2C_STATUS_DONE;
+    if (trans->done_cb) {
+        trans->done_cb(trans);
+    } else {
+        xQueueSendFromISR(p_i2c->ret_queue, &trans, HPTaskAwoken);
+    }
+    trans = NULL;
+    I2C_ENTER_CRITICAL_ISR(&i2c_spinlock[i2c_num]);
+    if (p_i2c->sync_busy || xQueueReceiveFromISR(p_i2c->trans_queue, &trans, HPTaskAwoken) != pdTRUE) {
+        p_i2c->queue_busy = false;
+    }
+    p_i2c->cur_trans = trans;
+    if (trans) {
+        p_i2c->trans_deadline = xTaskGetTickCountFromISR() + I2C_TRANS_TICKS(trans);
+    }
+    I2C_EXIT_CRITICAL_ISR(&i2c_spinlock[i2c_num]);
+    if (trans) {
+        i2c_master_cmd_start(i2c_num, (i2c_cmd_desc_t*) trans->cmd);
+    } else if (p_i2c->sync_busy) {
+        //i2c_master_cmd_begin() is waiting for the bus
+        xSemaphoreGiveFromISR(p_i2c->cmd_sem, HPTaskAwoken);
+    }
+}
+
+/*
+ * Start sending queued transactions if nobody owns the bus; the isr chains the rest.
+ */
+static void i2c_master_queue_resume(i2c_port_t i2c_num)
+{
+    i2c_obj_t* p_i2c = p_i2c_obj[i2c_num];
+    i2c_trans_t* trans;
+    if (p_i2c->trans_queue == NULL) {
+        return;
+    }
+    do {
+        I2C_ENTER_CRITICAL(&i2c_spinlock[i2c_num]);
+        bool claimed = !p_i2c->queue_busy && !p_i2c->sync_busy;
+        if (claimed) {
+            p_i2c->queue_busy = true;
+        }
+        I2C_EXIT_CRITICAL(&i2c_spinlock[i2c_num]);
+        if (!claimed) {
+            return;
+        }
+        if (xQueueReceive(p_i2c->trans_queue, &trans, 0) == pdTRUE) {
+            I2C_ENTER_CRITICAL(&i2c_spinlock[i2c_num]);
+            p_i2c->cur_trans = trans;
+            p_i2c->trans_deadline = xTaskGetTickCount() + I2C_TRANS_TICKS(trans);
+            I2C_EXIT_CRITICAL(&i2c_spinlock[i2c_num]);
+            i2c_master_cmd_start(i2c_num, (i2c_cmd_desc_t*) trans->cmd);
+            return;
+        }
+        I2C_ENTER_CRITICAL(&i2c_spinlock[i2c_num]);
+        p_i2c->queue_busy = false;
+        I2C_EXIT_CRITICAL(&i2c_spinlock[i2c_num]);
+        //a transaction queued while the bus was claimed here may have found it busy
+    } while (uxQueueMessagesWaiting(p_i2c->trans_queue) > 0);
+}
+
+/*
+ * End of i2c_master_cmd_begin(): give the bus back to queued transactions.
+ */
+static void i2c_master_cmd_release(i2c_port_t i2c_num)
+{
+    i2c_obj_t* p_i2c = p_i2c_obj[i2c_num];
+    I2C_ENTER_CRITICAL(&i2c_spinlock[i2c_num]);
+    p_i2c->sync_busy = false;
+    I2C_EXIT_CRITICAL(&i2c_spinlock[i2c_num]);
+    i2c_master_queue_resume(i2c_num);
+    xSemaphoreGive(p_i2c->cmd_mux);
+}
+
+/*
+ * Shorten a wait on the transaction queue to the deadline of the transaction on the bus,
+ * so the waiting task gets to fail it if it stalls.
+ */
+static TickType_t i2c_master_queue_wait(i2c_port_t i2c_num, TickType_t ticks_to_wait)
+{
+    i2c_obj_t* p_i2c = p_i2c_obj[i2c_num];
+    TickType_t left = ticks_to_wait;
+    I2C_ENTER_CRITICAL(&i2c_spinlock[i2c_num]);
+    if (p_i2c->cur_trans) {
+        int32_t deadline = (int32_t) (p_i2c->trans_deadline - xTaskGetTickCount());
+        left = deadline > 0 ? (TickType_t) deadline : 0;
+    }
+    I2C_EXIT_CRITICAL(&i2c_spinlock[i2c_num]);
+    return left < ticks_to_wait ? left : ticks_to_wait;
+}
+
+/*
+ * Fail the transaction on the bus with ESP_ERR_TIMEOUT once it is past its deadline without
+ * an interrupt that ends it. Runs in the calling task: the transaction is taken off the bus and
+ * the controller reset under the spinlock, so the isr has nothing left to finish; done_cb, the
+ * result queue and the next transaction are then handled outside of it with task-level calls.
+ * Returns whether there was one to fail.
+ */
+static bool i2c_master_queue_expire(i2c_port_t i2c_num)
+{
+    i2c_obj_t* p_i2c = p_i2c_obj[i2c_num];
+    i2c_trans_t* trans = NULL;
+    I2C_ENTER_CRITICAL(&i2c_spinlock[i2c_num]);
+    if (p_i2c->cur_trans != NULL && (int32_t) (xTaskGetTickCount() - p_i2c->trans_deadline) >= 0) {
+        trans = p_i2c->cur_trans;
+        p_i2c->cur_trans = NULL;
+        i2c_master_hw_reset(i2c_num);
+        p_i2c->status = I2C_STATUS_DONE;
+    }
+    I2C_EXIT_CRITICAL(&i2c_spinlock[i2c_num]);
+    if (trans == NULL) {
+        return false;
+    }
+    ESP_LOGW(I2C_TAG, "queued transaction timed out, controller reset");
+    trans->result = ESP_ERR_TIMEOUT;
+    if (trans->done_cb) {
+        trans->done_cb(trans);
+    } else {
+        xQueueSend(p_i2c->ret_queue, &trans, 0);
+    }
+    //The bus is still claimed for the queue; hand it on as i2c_master_cmd_done() does
+    I2C_ENTER_CRITICAL(&i2c_spinlock[i2c_num]);
+    bool sync_waiting = p_i2c->sync_busy;
+    p_i2c->queue_busy = false;
+    I2C_EXIT_CRITICAL(&i2c_spinlock[i2c_num]);
+    if (sync_waiting) {
+        //i2c_master_cmd_begin() is waiting for the bus
+        xSemaphoreGive(p_i2c->cmd_sem);
+    } else {
+        i2c_master_queue_resume(i2c_num);
+    }
+    return true;
+}
+
+/*
+ * Stop the command on the bus after an ACK error or a timeout. Only a reset of the module
+ * brings its state machines back to idle; that clears the configuration as well, so the
+ * registers set up by i2c_param_config() and the timing functions are written back.
+ * Not in IRAM: periph_module_disable/enable are not either, and the isr runs from flash anyway.
+ */
+static void i2c_master_hw_reset(i2c_port_t i2c_num)
+{
+    periph_module_t module = (i2c_num == I2C_NUM_0) ? PERIPH_I2C0_MODULE : PERIPH_I2C1_MODULE;
+    uint32_t ctr = I2C[i2c_num]->ctr.val & ~I2C_TRANS_START_M;
+    uint32_t fifo_conf = I2C[i2c_num]->fifo_conf.val & ~(I2C_TX_FIFO_RST_M | I2C_RX_FIFO_RST_M);
+    uint32_t int_ena = I2C[i2c_num]->int_ena.val &
+                       ~(I2C_END_DETECT_INT_ENA_M | I2C_MASTER_TRAN_COMP_INT_ENA_M | I2C_TIME_OUT_INT_ENA_M);
+    uint32_t timeout = I2C[i2c_num]->timeout.val;
+    uint32_t slave_addr = I2C[i2c_num]->slave_addr.val;
+    uint32_t scl_low_period = I2C[i2c_num]->scl_low_period.val;
+    uint32_t scl_high_period = I2C[i2c_num]->scl_high_period.val;
+    uint32_t scl_start_hold = I2C[i2c_num]->scl_start_hold.val;
+    uint32_t scl_rstart_setup = I2C[i2c_num]->scl_rstart_setup.val;
+    uint32_t scl_stop_hold = I2C[i2c_num]->scl_stop_hold.val;
+    uint32_t scl_stop_setup = I2C[i2c_num]->scl_stop_setup.val;
+    uint32_t sda_hold = I2C[i2c_num]->sda_hold.val;
+    uint32_t sda_sample = I2C[i2c_num]->sda_sample.val;
+    uint32_t scl_filter_cfg = I2C[i2c_num]->scl_filter_cfg.val;
+    uint32_t sda_filter_cfg = I2C[i2c_num]->sda_filter_cfg.val;
+
+    I2C[i2c_num]->int_ena.val = 0;
+    periph_module_disable(module);
+    periph_module_enable(module);
+
+    I2C[i2c_num]->scl_low_period.val = scl_low_period;
+    I2C[i2c_num]->scl_high_period.val = scl_high_period;
+    I2C[i2c_num]->scl_start_hold.val = scl_start_hold;
+    I2C[i2c_num]->scl_rstart_setup.val = scl_rstart_setup;
+    I2C[i2c_num]->scl_stop_hold.val = scl_stop_hold;
+    I2C[i2c_num]->scl_stop_setup.val = scl_stop_setup;
+    I2C[i2c_num]->sda_hold.val = sda_hold;
+    I2C[i2c_num]->sda_sample.val = sda_sample;
+    I2C[i2c_num]->scl_filter_cfg.val = scl_filter_cfg;
+    I2C[i2c_num]->sda_filter_cfg.val = sda_filter_cfg;
+    I2C[i2c_num]->timeout.val = timeout;
+    I2C[i2c_num]->slave_addr.val = slave_addr;
+    I2C[i2c_num]->fifo_conf.val = fifo_conf;
+    I2C[i2c_num]->ctr.val = ctr;
+    I2C[i2c_num]->int_clr.val = ~0;
+    I2C[i2c_num]->int_ena.val = int_ena;
+}
+
 static void IRAM_ATTR i2c_master_cmd_begin_static(i2c_port_t i2c_num)
 {
     i2c_obj_t* p_i2c = p_i2c_obj[i2c_num];
@@ -827,30 +1160,28 @@ static void IRAM_ATTR i2c_master_cmd_begin_static(i2c_port_t i2c_num)
     }
     if (p_i2c->status == I2C_STATUS_DONE) {
         return;
-    } else if (p_i2c->status == I2C_STATUS_ACK_ERROR) {
-        I2C[i2c_num]->int_ena.end_detect = 0;
-        I2C[i2c_num]->int_clr.end_detect = 1;
-        I2C[i2c_num]->int_ena.master_tran_comp = 0;
-        xSemaphoreGiveFromISR(p_i2c->cmd_sem, &HPTaskAwoken);
+    } else if (p_i2c->status == I2C_STATUS_ACK_ERROR || p_i2c->status == I2C_STATUS_TIMEOUT) {
+        //drop the rest of the command, the next one has to start from an idle controller
+        i2c_master_hw_reset(i2c_num);
+        i2c_master_cmd_done(i2c_num, &HPTaskAwoken);
         if (HPTaskAwoken == pdTRUE) {
             portYIELD_FROM_ISR();
         }
         return;
     } else if (p_i2c->status == I2C_STATUS_READ) {
-        i2c_cmd_t *cmd = &p_i2c->cmd_link.head->cmd;
         while (p_i2c->rx_cnt-- > 0) {
-            *cmd->data++ = READ_PERI_REG(I2C_DATA_APB_REG(i2c_num));
+            *p_i2c->cmd_data++ = READ_PERI_REG(I2C_DATA_APB_REG(i2c_num));
         }
-        if (cmd->byte_num > 0) {
+        if (p_i2c->cmd_remain > 0) {
             p_i2c->rx_fifo_remain = I2C_FIFO_LEN;
             p_i2c->cmd_idx = 0;
         } else {
-            p_i2c->cmd_link.head = p_i2c->cmd_link.head->next;
+            i2c_master_cmd_next(p_i2c, p_i2c->cmd_link.head->next);
         }
     }
     if (p_i2c->cmd_link.head == NULL) {
         p_i2c->cmd_link.cur = NULL;
-        xSemaphoreGiveFromISR(p_i2c->cmd_sem, &HPTaskAwoken);
+        i2c_master_cmd_done(i2c_num, &HPTaskAwoken);
         if (HPTaskAwoken == pdTRUE) {
             portYIELD_FROM_ISR();
         }
@@ -868,16 +1199,16 @@ static void IRAM_ATTR i2c_master_cmd_begin_static(i2c_port_t i2c_num)
             uint32_t wr_filled = 0;
             //TODO: to reduce interrupt number
             if (cmd->data) {
-                while (p_i2c->tx_fifo_remain > 0 && cmd->byte_num > 0) {
-                    WRITE_PERI_REG(I2C_DATA_APB_REG(i2c_num), *cmd->data++);
+                while (p_i2c->tx_fifo_remain > 0 && p_i2c->cmd_remain > 0) {
+                    WRITE_PERI_REG(I2C_DATA_APB_REG(i2c_num), *p_i2c->cmd_data++);
                     p_i2c->tx_fifo_remain--;
-                    cmd->byte_num--;
+                    p_i2c->cmd_remain--;
                     wr_filled++;
                 }
             } else {
                 WRITE_PERI_REG(I2C_DATA_APB_REG(i2c_num), cmd->byte_cmd);
                 p_i2c->tx_fifo_remain--;
-                cmd->byte_num--;
+                p_i2c->cmd_remain--;
                 wr_filled ++;
             }
             //Workaround for register field operation.
@@ -886,16 +1217,16 @@ static void IRAM_ATTR i2c_master_cmd_begin_static(i2c_port_t i2c_num)
             I2C[i2c_num]->command[p_i2c->cmd_idx + 1].op_code = I2C_CMD_END;
             p_i2c->tx_fifo_remain = I2C_FIFO_LEN;
             p_i2c->cmd_idx = 0;
-            if (cmd->byte_num > 0) {
+            if (p_i2c->cmd_remain > 0) {
             } else {
-                p_i2c->cmd_link.head = p_i2c->cmd_link.head->next;
+                i2c_master_cmd_next(p_i2c, p_i2c->cmd_link.head->next);
             }
             p_i2c->status = I2C_STATUS_WRITE;
             break;
         } else if(cmd->op_code == I2C_CMD_READ) {
             //TODO: to reduce interrupt number
-            p_i2c->rx_cnt = cmd->byte_num > p_i2c->rx_fifo_remain ? p_i2c->rx_fifo_remain : cmd->byte_num;
-            cmd->byte_num -= p_i2c->rx_cnt;
+            p_i2c->rx_cnt = p_i2c->cmd_remain > p_i2c->rx_fifo_remain ? p_i2c->rx_fifo_remain : p_i2c->cmd_remain;
+            p_i2c->cmd_remain -= p_i2c->rx_cnt;
             I2C[i2c_num]->command[p_i2c->cmd_idx].byte_num = p_i2c->rx_cnt;
             I2C[i2c_num]->command[p_i2c->cmd_idx].ack_val = cmd->ack_val;
             I2C[i2c_num]->command[p_i2c->cmd_idx + 1].val = 0;
@@ -905,7 +1236,7 @@ static void IRAM_ATTR i2c_master_cmd_begin_static(i2c_port_t i2c_num)
         } else {
         }
         p_i2c->cmd_idx++;
-        p_i2c->cmd_link.head = p_i2c->cmd_link.head->next;
+        i2c_master_cmd_next(p_i2c, p_i2c->cmd_link.head->next);
         if (p_i2c->cmd_link.head == NULL || p_i2c->cmd_idx >= 15) {
             p_i2c->tx_fifo_remain = I2C_FIFO_LEN;
             p_i2c->cmd_idx = 0;
@@ -915,8 +1246,10 @@ static void IRAM_ATTR i2c_master_cmd_begin_static(i2c_port_t i2c_num)
     }
     I2C[i2c_num]->int_clr.end_detect = 1;
     I2C[i2c_num]->int_clr.master_tran_comp = 1;
+    I2C[i2c_num]->int_clr.time_out = 1;
     I2C[i2c_num]->int_ena.end_detect = 1;
     I2C[i2c_num]->int_ena.master_tran_comp = 1;
+    I2C[i2c_num]->int_ena.time_out = 1;
     I2C[i2c_num]->ctr.trans_start = 0;
     I2C[i2c_num]->ctr.trans_start = 1;
     return;
@@ -937,36 +1270,118 @@ esp_err_t i2c_master_cmd_begin(i2c_port_t i2c_num, i2c_cmd_handle_t cmd_handle,
         return ESP_ERR_TIMEOUT;
     }
     xSemaphoreTake(p_i2c->cmd_sem, 0);
-    i2c_reset_tx_fifo(i2c_num);
-    i2c_reset_rx_fifo(i2c_num);
-    i2c_cmd_desc_t* cmd = (i2c_cmd_desc_t*) cmd_handle;
-    p_i2c->cmd_link.free = cmd->free;
-    p_i2c->cmd_link.cur = cmd->cur;
-    p_i2c->cmd_link.head = cmd->head;
-    p_i2c->status = I2C_STATUS_IDLE;
-    p_i2c->cmd_idx = 0;
-    p_i2c->rx_cnt = 0;
-    p_i2c->tx_fifo_remain = I2C_FIFO_LEN;
-    p_i2c->rx_fifo_remain = I2C_FIFO_LEN;
-    i2c_reset_tx_fifo(i2c_num);
-    i2c_reset_rx_fifo(i2c_num);
+    //take the bus from queued transactions, the isr hands it over when the one being sent is done
+    I2C_ENTER_CRITICAL(&i2c_spinlock[i2c_num]);
+    p_i2c->sync_busy = true;
+    bool queue_busy = p_i2c->queue_busy;
+    I2C_EXIT_CRITICAL(&i2c_spinlock[i2c_num]);
+    while (queue_busy) {
+        TickType_t wait = i2c_master_queue_wait(i2c_num, ticks_to_wait);
+        if (xSemaphoreTake(p_i2c->cmd_sem, wait) == pdTRUE) {
+            break;
+        }
+        //a stalled transaction is failed, which hands the bus over
+        if (!i2c_master_queue_expire(i2c_num) && wait == ticks_to_wait) {
+            i2c_master_cmd_release(i2c_num);
+            return ESP_ERR_TIMEOUT;
+        }
+        if (ticks_to_wait != portMAX_DELAY) {
+            int32_t left = (int32_t) (ticks_end - xTaskGetTickCount());
+            ticks_to_wait = left > 0 ? (TickType_t) left : 0;
+        }
+    }
 
     //start send commands, at most 32 bytes one time, isr handler will process the remaining commands.
-    i2c_master_cmd_begin_static(i2c_num);
+    i2c_master_cmd_start(i2c_num, (i2c_cmd_desc_t*) cmd_handle);
     ticks_to_wait = ticks_end - xTaskGetTickCount();
     res = xSemaphoreTake(p_i2c->cmd_sem, ticks_to_wait);
     if (res == pdFALSE) {
+        //the command may still be on the bus, stop it before the queue gets the bus back
+        I2C_ENTER_CRITICAL(&i2c_spinlock[i2c_num]);
+        p_i2c->status = I2C_STATUS_DONE;
+        i2c_master_hw_reset(i2c_num);
+        I2C_EXIT_CRITICAL(&i2c_spinlock[i2c_num]);
         ret = ESP_ERR_TIMEOUT;
     } else if (p_i2c->status == I2C_STATUS_ACK_ERROR) {
         ret = ESP_FAIL;
+    } else if (p_i2c->status == I2C_STATUS_TIMEOUT) {
+        ret = ESP_ERR_TIMEOUT;
     } else {
         ret = ESP_OK;
     }
     p_i2c->status = I2C_STATUS_DONE;
-    xSemaphoreGive(p_i2c->cmd_mux);
+    i2c_master_cmd_release(i2c_num);
     return ret;
 }
 
+esp_err_t i2c_master_queue_init(i2c_port_t i2c_num, int queue_size)
+{
+    I2C_CHECK(( i2c_num < I2C_NUM_MAX ), I2C_NUM_ERROR_STR, ESP_ERR_INVALID_ARG);
+    I2C_CHECK(queue_size > 0, I2C_QUEUE_SIZE_ERR_STR, ESP_ERR_INVALID_ARG);
+    I2C_CHECK(p_i2c_obj[i2c_num] != NULL, I2C_DRIVER_NOT_INSTALL_ERR_STR, ESP_ERR_INVALID_STATE);
+    I2C_CHECK(p_i2c_obj[i2c_num]->mode == I2C_MODE_MASTER, I2C_MASTER_MODE_ERR_STR, ESP_ERR_INVALID_STATE);
+    I2C_CHECK(p_i2c_obj[i2c_num]->trans_queue == NULL, I2C_TRANS_QUEUE_ERR_STR, ESP_ERR_INVALID_STATE);
+
+    i2c_obj_t* p_i2c = p_i2c_obj[i2c_num];
+    p_i2c->trans_queue = xQueueCreate(queue_size, sizeof(i2c_trans_t*));
+    //one more result than queued transactions, for the transaction on the bus
+    p_i2c->ret_queue = xQueueCreate(queue_size + 1, sizeof(i2c_trans_t*));
+    if (p_i2c->trans_queue == NULL || p_i2c->ret_queue == NULL) {
+        ESP_LOGE(I2C_TAG, I2C_TRANS_QUEUE_ERR_STR);
+        if (p_i2c->trans_queue) {
+            vQueueDelete(p_i2c->trans_queue);
+            p_i2c->trans_queue = NULL;
+        }
+        if (p_i2c->ret_queue) {
+            vQueueDelete(p_i2c->ret_queue);
+            p_i2c->ret_queue = NULL;
+        }
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_queue_trans(i2c_port_t i2c_num, i2c_trans_t* trans, TickType_t ticks_to_wait)
+{
+    I2C_CHECK(( i2c_num < I2C_NUM_MAX ), I2C_NUM_ERROR_STR, ESP_ERR_INVALID_ARG);
+    I2C_CHECK(trans != NULL && trans->cmd != NULL, I2C_CMD_LINK_INIT_ERR_STR, ESP_ERR_INVALID_ARG);
+    I2C_CHECK(p_i2c_obj[i2c_num] != NULL && p_i2c_obj[i2c_num]->trans_queue != NULL, I2C_TRANS_QUEUE_ERR_STR,
+              ESP_ERR_INVALID_STATE);
+
+    //a stalled transaction would keep the queue full
+    i2c_master_queue_expire(i2c_num);
+    if (xQueueSend(p_i2c_obj[i2c_num]->trans_queue, &trans, ticks_to_wait) != pdTRUE) {
+        return ESP_ERR_TIMEOUT;
+    }
+    i2c_master_queue_resume(i2c_num);
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_get_trans_result(i2c_port_t i2c_num, i2c_trans_t** trans, TickType_t ticks_to_wait)
+{
+    I2C_CHECK(( i2c_num < I2C_NUM_MAX ), I2C_NUM_ERROR_STR, ESP_ERR_INVALID_ARG);
+    I2C_CHECK(trans != NULL, I2C_ADDR_ERROR_STR, ESP_ERR_INVALID_ARG);
+    I2C_CHECK(p_i2c_obj[i2c_num] != NULL && p_i2c_obj[i2c_num]->ret_queue != NULL, I2C_TRANS_QUEUE_ERR_STR,
+              ESP_ERR_INVALID_STATE);
+
+    i2c_obj_t* p_i2c = p_i2c_obj[i2c_num];
+    portTickType ticks_end = xTaskGetTickCount() + ticks_to_wait;
+    for (;;) {
+        TickType_t wait = i2c_master_queue_wait(i2c_num, ticks_to_wait);
+        if (xQueueReceive(p_i2c->ret_queue, trans, wait) == pdTRUE) {
+            return ESP_OK;
+        }
+        //a stalled transaction is failed and returned, the wait goes on for it
+        if (!i2c_master_queue_expire(i2c_num) && wait == ticks_to_wait) {
+            return ESP_ERR_TIMEOUT;
+        }
+        if (ticks_to_wait != portMAX_DELAY) {
+            int32_t left = (int32_t) (ticks_end - xTaskGetTickCount());
+            ticks_to_wait = left > 0 ? (TickType_t) left : 0;
+        }
+    }
+}
+
 int i2c_slave_write_buffer(i2c_port_t i2c_num, uint8_t* data, int size, portBASE_TYPE ticks_to_wait)
 {
     I2C_CHECK(( i2c_num < I2C_NUM_MAX ), I2C_NUM_ERROR_STR, ESP_FAIL);
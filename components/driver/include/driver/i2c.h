@@ -93,6 +93,28 @@ typedef struct{
 
 typedef void* i2c_cmd_handle_t;    /*!< I2C command handle  */
 
+#define I2C_CMD_LINK_ITEM_SIZE       (5 * sizeof(void*))  /*!< Buffer space taken by one queued command in a static command link */
+#define I2C_CMD_LINK_STATIC_SIZE(n)  (((n) + 2) * I2C_CMD_LINK_ITEM_SIZE)  /*!< Buffer size for a static command link of n commands */
+#define I2C_READ_REG_CMD_NUM         (8)  /*!< Commands queued by i2c_master_read_reg() for up to 255 data bytes */
+#define I2C_TRANS_TIMEOUT_DEFAULT    (1000 / portTICK_PERIOD_MS)  /*!< Ticks a queued transaction may take on the bus, if its timeout is 0 */
+
+typedef struct i2c_trans_t i2c_trans_t;
+typedef void (*i2c_trans_cb_t)(i2c_trans_t* trans);    /*!< I2C transaction callback, see i2c_trans_t::done_cb */
+
+/**
+ * @brief I2C master transaction for i2c_master_queue_trans()
+ */
+struct i2c_trans_t {
+    i2c_cmd_handle_t cmd;      /*!< command link to send, it is left unchanged and can be queued again */
+    i2c_trans_cb_t done_cb;    /*!< called when the transaction is done, in interrupt context, or in the task that fails
+                                    it after trans->timeout (see i2c_master_queue_trans()); it must not block either way.
+                                    If NULL the transaction is returned by i2c_master_get_trans_result() instead */
+    void* user;                /*!< user-defined variable, e.g. a transaction ID */
+    TickType_t timeout;        /*!< ticks the transaction may take once on the bus, 0 for I2C_TRANS_TIMEOUT_DEFAULT */
+    esp_err_t result;          /*!< set by the driver: ESP_OK, ESP_FAIL if the slave did not ACK, or ESP_ERR_TIMEOUT
+                                    if the transaction stalled on the bus */
+};
+
 /**
  * @brief I2C driver install
  *
@@ -227,6 +249,31 @@ i2c_cmd_handle_t i2c_cmd_link_create();
  */
 void i2c_cmd_link_delete(i2c_cmd_handle_t cmd_handle);
 
+/**
+ * @brief Create I2C command link in a caller-provided buffer
+ *        @note
+ *        Commands queued on this link take their storage from the buffer instead of the heap,
+ *        so building and sending the link never allocates memory. Size the buffer with
+ *        I2C_CMD_LINK_STATIC_SIZE() for the number of commands to queue; a data buffer longer
+ *        than 255 bytes counts as one command per 255 bytes.
+ *        The buffer must stay valid until i2c_cmd_link_delete_static() is called.
+ *
+ * @param buffer buffer to hold the command link
+ * @param size buffer size in bytes
+ *
+ * @return i2c command link handler, or NULL if the buffer is too small for even one command
+ */
+i2c_cmd_handle_t i2c_cmd_link_create_static(uint8_t* buffer, size_t size);
+
+/**
+ * @brief Release I2C command link created by i2c_cmd_link_create_static()
+ *        @note
+ *        Nothing is freed; after this call the buffer can be reused or used to create a new link.
+ *
+ * @param cmd_handle I2C command handle
+ */
+void i2c_cmd_link_delete_static(i2c_cmd_handle_t cmd_handle);
+
 /**
  * @brief Queue command for I2C master to generate a start signal
  *        @note
@@ -321,10 +368,98 @@ esp_err_t i2c_master_read(i2c_cmd_handle_t cmd_handle, uint8_t* data, size_t dat
  */
 esp_err_t i2c_master_stop(i2c_cmd_handle_t cmd_handle);
 
+/**
+ * @brief Queue a complete register read for I2C master
+ *
+ * _____________________________________________________________________________________________________________________
+ * | start | slave_addr + wr_bit + ack | reg_addr + ack | start | slave_addr + rd_bit + ack | read n-1 bytes + ack | read 1 byte + nack | stop |
+ * |-------|---------------------------|----------------|-------|---------------------------|----------------------|--------------------|------|
+ *
+ *        @note
+ *        Only call this function in I2C master mode.
+ *        Command links are not consumed by i2c_master_cmd_begin(), so a link holding a register read
+ *        is a template that can be sent again and again without rebuilding; each send refills data.
+ *        Up to 255 data bytes take I2C_READ_REG_CMD_NUM commands.
+ *
+ * @param cmd_handle I2C cmd link
+ * @param slave_addr 7-bit slave address
+ * @param reg_addr register address to write before reading
+ * @param data buffer to accept the register contents
+ * @param data_len number of bytes to read
+ *
+ * @return
+ *     - ESP_OK Success
+ *     - ESP_ERR_INVALID_ARG Parameter error
+ *     - ESP_ERR_NO_MEM The command link has no room for the commands
+ */
+esp_err_t i2c_master_read_reg(i2c_cmd_handle_t cmd_handle, uint8_t slave_addr, uint8_t reg_addr, uint8_t* data, size_t data_len);
+
+/**
+ * @brief Create the transaction queue of I2C master
+ *        @note
+ *        Only call this function in I2C master mode, after i2c_driver_install().
+ *        The queue is deleted with the driver.
+ *
+ * @param i2c_num I2C port number
+ * @param queue_size how many transactions can be queued using i2c_master_queue_trans() and not yet be finished
+ *
+ * @return
+ *     - ESP_OK Success
+ *     - ESP_ERR_INVALID_ARG Parameter error
+ *     - ESP_ERR_INVALID_STATE I2C driver not installed, not in master mode, or the queue already exists
+ *     - ESP_ERR_NO_MEM Queue allocation failed
+ */
+esp_err_t i2c_master_queue_init(i2c_port_t i2c_num, int queue_size);
+
+/**
+ * @brief Queue an I2C master transaction for execution
+ *        @note
+ *        Transactions are sent in order. When one is done the interrupt handler starts the next one
+ *        right away, so queued transactions follow each other without waiting for a task.
+ *        The finished transaction is handed to trans->done_cb, or if that is NULL, returned by
+ *        i2c_master_get_trans_result(). The transaction and its command link must stay valid until then.
+ *        A call to i2c_master_cmd_begin() waits until the transaction being sent is done, then takes
+ *        the bus before the remaining queued transactions.
+ *        A transaction that stalls on the bus, e.g. a slave holding SCL low, is failed with ESP_ERR_TIMEOUT
+ *        by the controller's timeout interrupt, or at the latest once trans->timeout is over and a task waits
+ *        in i2c_master_get_trans_result(), i2c_master_cmd_begin() or this function. The controller is reset
+ *        before the next transaction starts, as it is after an ACK error. In the latter case, trans->done_cb
+ *        runs in that waiting task rather than in the interrupt handler.
+ *
+ * @param i2c_num I2C port number
+ * @param trans transaction to send
+ * @param ticks_to_wait ticks to wait until there's room in the queue; use portMAX_DELAY to never time out.
+ *
+ * @return
+ *     - ESP_OK Success
+ *     - ESP_ERR_INVALID_ARG Parameter error
+ *     - ESP_ERR_INVALID_STATE No transaction queue, see i2c_master_queue_init()
+ *     - ESP_ERR_TIMEOUT The queue stayed full
+ */
+esp_err_t i2c_master_queue_trans(i2c_port_t i2c_num, i2c_trans_t* trans, TickType_t ticks_to_wait);
+
+/**
+ * @brief Get the result of an I2C master transaction queued earlier
+ *        @note
+ *        Only transactions queued without a done_cb are returned here, in the order they finish.
+ *
+ * @param i2c_num I2C port number
+ * @param trans pointer to a variable to hold the finished transaction; check its result member
+ * @param ticks_to_wait ticks to wait for a finished transaction; use portMAX_DELAY to never time out.
+ *
+ * @return
+ *     - ESP_OK Success
+ *     - ESP_ERR_INVALID_ARG Parameter error
+ *     - ESP_ERR_INVALID_STATE No transaction queue, see i2c_master_queue_init()
+ *     - ESP_ERR_TIMEOUT No transaction finished in time
+ */
+esp_err_t i2c_master_get_trans_result(i2c_port_t i2c_num, i2c_trans_t** trans, TickType_t ticks_to_wait);
+
 /**
  * @brief I2C master send queued commands.
  *        This function will trigger sending all queued commands.
  *        The task will be blocked until all the commands have been sent out.
+ *        The command link is left unchanged and can be sent again.
  *        The I2C APIs are not thread-safe, if you want to use one I2C port in different tasks,
  *        you need to take care of the multi-thread issue.
  *        @note
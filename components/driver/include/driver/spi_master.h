@@ -66,6 +66,18 @@ typedef struct {
 typedef struct spi_transaction_t spi_transaction_t;
 typedef void(*transaction_cb_t)(spi_transaction_t *trans);
 
+/**
+ * @brief How the driver picks the next device to talk to when several devices on a bus have transactions queued
+ *
+ * A device with a higher ``priority`` always goes first. The policy only decides between devices of equal priority.
+ */
+typedef enum {
+    SPI_SCHED_LOW_CS_FIRST=0,       ///< The device on the lowest CS goes first
+    SPI_SCHED_ROUND_ROBIN,          ///< Devices take turns, one transaction each
+    SPI_SCHED_DEADLINE,             ///< The device whose waiting transaction is closest to (or furthest past) its ``deadline_us`` goes first
+} spi_sched_policy_t;
+
+
 /**
  * @brief This is a configuration for a SPI slave device that is connected to one of the SPI buses.
  */
@@ -83,8 +95,25 @@ typedef struct {
     int queue_size;                 ///< Transaction queue size. This sets how many transactions can be 'in the air' (queued using spi_device_queue_trans but not yet finished using spi_device_get_trans_result) at the same time
     transaction_cb_t pre_cb;        ///< Callback to be called before a transmission is started. This callback is called within interrupt context.
     transaction_cb_t post_cb;       ///< Callback to be called after a transmission has completed. This callback is called within interrupt context.
+    uint8_t priority;               ///< Transactions of a device with a higher priority are sent before those of lower priority devices (0 = lowest)
+    spi_sched_policy_t sched_policy;///< Policy between devices of equal priority. Devices on the same bus that set a policy other than SPI_SCHED_LOW_CS_FIRST must all set the same one.
+    uint32_t deadline_us;           ///< Time in us a transaction may wait in the queue before it is late. Used by SPI_SCHED_DEADLINE and counted in spi_device_stats_t. 0 means no deadline.
 } spi_device_interface_config_t;
 
+/**
+ * @brief Queueing statistics of a SPI device
+ *
+ * Times are taken from timer 0 of timer group 1, which spi_bus_initialize starts as a 1MHz counter shared by both
+ * cores. Applications using the SPI master driver must leave that timer alone.
+ */
+typedef struct {
+    uint32_t trans_count;           ///< Transactions sent
+    uint32_t max_queue_depth;       ///< Most transactions seen waiting in the queue of the device, including the one being sent
+    uint32_t max_latency_us;        ///< Longest time from spi_device_queue_trans to the start of the transfer
+    uint64_t total_latency_us;      ///< Sum of those times; divide by ``trans_count`` for the average
+    uint32_t deadline_misses;       ///< Transactions that started more than ``deadline_us`` after they were queued
+} spi_device_stats_t;
+
 
 #define SPI_TRANS_MODE_DIO            (1<<0)  ///< Transmit/receive data in 2-bit mode
 #define SPI_TRANS_MODE_QIO            (1<<1)  ///< Transmit/receive data in 4-bit mode
@@ -120,6 +149,9 @@ typedef struct spi_device_t* spi_device_handle_t;  ///< Handle for a device on a
  *
  * @warning For now, only supports HSPI and VSPI.
  *
+ * @note The first call also starts timer 0 of timer group 1, the clock of the queueing statistics and of
+ *       SPI_SCHED_DEADLINE. It keeps running after spi_bus_free.
+ *
  * @param host SPI peripheral that controls this bus
  * @param bus_config Pointer to a spi_bus_config_t struct specifying how the host should be initialized
  * @param dma_chan Either 1 or 2. A SPI bus used by this driver must have a DMA channel associated with
@@ -157,10 +189,15 @@ esp_err_t spi_bus_free(spi_host_device_t host);
  *       supported, full-duplex transfers routed over the GPIO matrix only support speeds up to 26MHz.
  *
  * @param host SPI peripheral to allocate device on
+ * @note When several devices have transactions queued, the device with the highest ``priority`` is served first. Between
+ *       devices of equal priority, ``sched_policy`` decides; the default serves the lowest CS first, which lets a busy
+ *       device on a low CS hold off the others for as long as it keeps its queue filled.
+ *
  * @param dev_config SPI interface protocol config for the device
  * @param handle Pointer to variable to hold the device handle
  * @return 
  *         - ESP_ERR_INVALID_ARG   if parameter is invalid
+ *         - ESP_ERR_INVALID_STATE if another device on the bus uses a different scheduling policy
  *         - ESP_ERR_NOT_FOUND     if host doesn't have any free CS slots
  *         - ESP_ERR_NO_MEM        if out of memory
  *         - ESP_OK                on success
@@ -194,6 +231,32 @@ esp_err_t spi_bus_remove_device(spi_device_handle_t handle);
 esp_err_t spi_device_queue_trans(spi_device_handle_t handle, spi_transaction_t *trans_desc, TickType_t ticks_to_wait);
 
 
+/**
+ * @brief Queue a batch of SPI transactions to one device, sent back to back
+ *
+ * The transactions in the array are sent in order without any other device getting the bus in
+ * between. Once the first one has been started, the interrupt handler moves on to the next one
+ * as soon as the previous one is done, without going through the transaction queue; transfers
+ * too short to be worth an interrupt (a few bytes at the clock speed of the device) are even
+ * waited for inside the interrupt handler. ``pre_cb`` and ``post_cb`` are called for every
+ * transaction of the batch, so they can e.g. drive a D/C line from the ``user`` member.
+ *
+ * The whole batch takes one place in the transaction queue and is returned once, when its last
+ * transaction is done: spi_device_get_trans_result returns a pointer to the first transaction
+ * of the array.
+ *
+ * @param handle Device handle obtained using spi_host_add_dev
+ * @param trans_desc Array of transactions to execute, which has to stay valid until the batch is returned
+ * @param count Number of transactions in the array
+ * @param ticks_to_wait Ticks to wait until there's room in the queue; use portMAX_DELAY to
+ *                      never time out.
+ * @return 
+ *         - ESP_ERR_INVALID_ARG   if parameter is invalid
+ *         - ESP_ERR_TIMEOUT       if there was no room in the queue before ticks_to_wait expired
+ *         - ESP_OK                on success
+ */
+esp_err_t spi_device_queue_trans_batch(spi_device_handle_t handle, spi_transaction_t *trans_desc, int count, TickType_t ticks_to_wait);
+
 /**
  * @brief Get the result of a SPI transaction queued earlier
  *
@@ -230,6 +293,33 @@ esp_err_t spi_device_get_trans_result(spi_device_handle_t handle, spi_transactio
  */
 esp_err_t spi_device_transmit(spi_device_handle_t handle, spi_transaction_t *trans_desc);
 
+/**
+ * @brief Do a batch of SPI transactions
+ *
+ * Essentially does the same as spi_device_queue_trans_batch followed by spi_device_get_trans_result.
+ * The same restriction as for spi_device_transmit applies.
+ *
+ * @param handle Device handle obtained using spi_host_add_dev
+ * @param trans_desc Array of transactions to execute
+ * @param count Number of transactions in the array
+ * @return 
+ *         - ESP_ERR_INVALID_ARG   if parameter is invalid
+ *         - ESP_OK                on success
+ */
+esp_err_t spi_device_transmit_batch(spi_device_handle_t handle, spi_transaction_t *trans_desc, int count);
+
+/**
+ * @brief Get the queueing statistics of a device
+ *
+ * @param handle Device handle obtained using spi_host_add_dev
+ * @param stats Pointer to the structure to fill in
+ * @param reset Start counting from zero again after reading the statistics
+ * @return 
+ *         - ESP_ERR_INVALID_ARG   if parameter is invalid
+ *         - ESP_OK                on success
+ */
+esp_err_t spi_device_get_stats(spi_device_handle_t handle, spi_device_stats_t *stats, bool reset);
+
 
 #ifdef __cplusplus
 }
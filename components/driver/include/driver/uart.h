@@ -583,6 +583,40 @@ int uart_write_bytes_with_break(uart_port_t uart_num, const char* src, size_t si
  */
 int uart_read_bytes(uart_port_t uart_num, uint8_t* buf, uint32_t length, TickType_t ticks_to_wait);
 
+/**
+ * @brief UART get received data in place, without copying it
+ *
+ * Returns the contiguous run of received data at the head of the RX ring buffer. The data stays in the
+ * ring buffer and is consumed with uart_read_bytes_release, which must follow every call that returns
+ * a positive length. Until then, the RX side of the driver belongs to the calling task: uart_read_bytes
+ * and uart_flush from other tasks block.
+ *
+ * @note Data that wraps around the end of the ring buffer comes out in two slices.
+ *
+ * @param uart_num UART_NUM_0, UART_NUM_1 or UART_NUM_2
+ * @param data  pointer set to the first byte of the slice
+ * @param ticks_to_wait Timeout, count in RTOS ticks
+ *
+ * @return
+ *     - (-1) Error
+ *     - 0 Timeout, nothing to release
+ *     - Others The length of the slice
+ */
+int uart_read_bytes_peek(uart_port_t uart_num, const uint8_t** data, TickType_t ticks_to_wait);
+
+/**
+ * @brief UART consume data obtained with uart_read_bytes_peek
+ *
+ * @param uart_num UART_NUM_0, UART_NUM_1 or UART_NUM_2
+ * @param length  number of bytes consumed, up to the length of the slice. The rest is returned again
+ *                by the next read.
+ *
+ * @return
+ *     - ESP_OK Success
+ *     - ESP_FAIL Parameter error, or no slice was handed out
+ */
+esp_err_t uart_read_bytes_release(uart_port_t uart_num, size_t length);
+
 /**
  * @brief UART ring buffer flush
  *
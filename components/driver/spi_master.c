@@ -29,6 +29,11 @@ queue, where whatever software initiated the transaction can retrieve it.
 The entire thing is run from the SPI interrupt handler. If SPI is done transmitting/receiving but nothing is in the queue, 
 it will not clear the SPI interrupt but just disable it. This way, when a new thing is sent, pushing the packet into the send 
 queue and re-enabling the interrupt will trigger the interrupt again, which can then take care of the sending.
+
+When several devices have transactions waiting, the interrupt handler asks spi_sched_pick (spi_master_sched.h) which one
+goes next, based on the priority of the devices and the scheduling policy of the bus. Every queued transaction carries
+the time it was queued at, for the deadline policy and the per-device latency statistics. That time comes from
+timer 0 of timer group 1, which the driver runs as a 1MHz clock both cores can read.
 */
 
 
@@ -59,7 +64,10 @@ queue and re-enabling the interrupt will trigger the interrupt again, which can
 #include "driver/uart.h"
 #include "driver/gpio.h"
 #include "driver/periph_ctrl.h"
+#include "driver/timer.h"
+#include "soc/timer_group_struct.h"
 #include "esp_heap_alloc_caps.h"
+#include "spi_master_sched.h"
 
 typedef struct spi_device_t spi_device_t;
 
@@ -73,16 +81,43 @@ typedef struct {
     int cur_cs;
     lldesc_t dmadesc_tx, dmadesc_rx;
     bool no_gpio_matrix;
+    spi_sched_policy_t sched_policy;
+    spi_transaction_t *batch_first;     //first transaction of the batch being sent (cur_trans if not a batch)
+    int batch_remain;                   //transactions of that batch still to send after cur_trans
 } spi_host_t;
 
+//What goes into the transaction queue of a device
+typedef struct {
+    spi_transaction_t *trans;
+    int batch;                      //number of transactions in the array at trans, sent back to back
+    uint32_t queued_at;             //spi_now_us() when the transaction was queued
+} spi_trans_priv_t;
+
 struct spi_device_t {
     QueueHandle_t trans_queue;
     QueueHandle_t ret_queue;
     spi_device_interface_config_t cfg;
     spi_host_t *host;
+    uint32_t deadline;              //cfg.deadline_us, or SPI_NO_DEADLINE
+    int spin_bits;                  //batch transfers up to this many bits are waited for in the ISR
+    spi_device_stats_t stats;
 };
 
+//Timestamps of the scheduler and the statistics are in us, from a timer group counter. Transactions are queued
+//from any task while the interrupt handler runs on one core; the cycle counters of the two cores are not in sync,
+//so a timestamp has to come from a clock both cores read.
+#define SPI_CLOCK_GROUP   TIMER_GROUP_1
+#define SPI_CLOCK_TIMER   TIMER_0
+#define SPI_CLOCK_DEV     TIMERG1
+//Stands in for "no deadline"; still far enough from the wrap-around of the 32-bit timestamps
+#define SPI_NO_DEADLINE   (1U<<30)
+//Transfers of a batch shorter than this are waited for in the interrupt handler: that is quicker than leaving
+//it and coming back in with the next trans_done interrupt.
+#define SPI_BATCH_SPIN_US 2
+
 static spi_host_t *spihost[3];
+static portMUX_TYPE spi_stats_spinlock = portMUX_INITIALIZER_UNLOCKED;
+static bool spi_clock_started = false;
 
 
 static const char *SPI_TAG = "spi_master";
@@ -92,6 +127,42 @@ static const char *SPI_TAG = "spi_master";
         return (ret_val); \
     }
 
+//Start the 1MHz counter behind spi_now_us, once for all buses. It is never stopped: spi_bus_free of one bus can
+//come while the other is still using it.
+static esp_err_t spi_clock_start(void)
+{
+    timer_config_t config;
+    bool started;
+    portENTER_CRITICAL(&spi_stats_spinlock);
+    started=spi_clock_started;
+    spi_clock_started=true;
+    portEXIT_CRITICAL(&spi_stats_spinlock);
+    if (started) return ESP_OK;
+
+    config.alarm_en=TIMER_ALARM_DIS;
+    config.auto_reload=TIMER_AUTORELOAD_DIS;
+    config.counter_dir=TIMER_COUNT_UP;
+    config.divider=TIMER_BASE_CLK/1000000;
+    config.intr_type=TIMER_INTR_LEVEL;
+    config.counter_en=TIMER_PAUSE;
+    esp_err_t ret=timer_init(SPI_CLOCK_GROUP, SPI_CLOCK_TIMER, &config);
+    if (ret!=ESP_OK) {
+        spi_clock_started=false;
+        return ret;
+    }
+    timer_set_counter_value(SPI_CLOCK_GROUP, SPI_CLOCK_TIMER, 0);
+    timer_start(SPI_CLOCK_GROUP, SPI_CLOCK_TIMER);
+    return ESP_OK;
+}
+
+//Current time in us. Only the low word of the counter is latched and read: that wraps like the timestamps do,
+//needs no lock and is safe to call from the (IRAM) interrupt handler, where timer_get_counter_value is not.
+static inline uint32_t IRAM_ATTR spi_now_us(void)
+{
+    SPI_CLOCK_DEV.hw_timer[SPI_CLOCK_TIMER].update=1;
+    return SPI_CLOCK_DEV.hw_timer[SPI_CLOCK_TIMER].cnt_low;
+}
+
 /*
  Stores a bunch of per-spi-peripheral data.
 */
@@ -199,6 +270,7 @@ esp_err_t spi_bus_initialize(spi_host_device_t host, spi_bus_config_t *bus_confi
 
     SPI_CHECK(host>=SPI_HOST && host<=VSPI_HOST, "invalid host", ESP_ERR_INVALID_ARG);
     SPI_CHECK(spihost[host]==NULL, "host already in use", ESP_ERR_INVALID_STATE);
+    SPI_CHECK(spi_clock_start()==ESP_OK, "cannot start the timestamp timer", ESP_ERR_INVALID_STATE);
     
     SPI_CHECK(bus_config->mosi_io_num<0 || GPIO_IS_VALID_OUTPUT_GPIO(bus_config->mosi_io_num), "spid pin invalid", ESP_ERR_INVALID_ARG);
     SPI_CHECK(bus_config->sclk_io_num<0 || GPIO_IS_VALID_OUTPUT_GPIO(bus_config->sclk_io_num), "spiclk pin invalid", ESP_ERR_INVALID_ARG);
@@ -322,6 +394,9 @@ esp_err_t spi_bus_add_device(spi_host_device_t host, spi_device_interface_config
     SPI_CHECK(spihost[host]!=NULL, "host not initialized", ESP_ERR_INVALID_STATE);
     SPI_CHECK(dev_config->spics_io_num < 0 || GPIO_IS_VALID_OUTPUT_GPIO(dev_config->spics_io_num), "spics pin invalid", ESP_ERR_INVALID_ARG);
     SPI_CHECK(dev_config->clock_speed_hz > 0, "invalid sclk speed", ESP_ERR_INVALID_ARG);
+    SPI_CHECK(dev_config->sched_policy>=SPI_SCHED_LOW_CS_FIRST && dev_config->sched_policy<=SPI_SCHED_DEADLINE, "invalid scheduling policy", ESP_ERR_INVALID_ARG);
+    SPI_CHECK(dev_config->sched_policy==SPI_SCHED_LOW_CS_FIRST || spihost[host]->sched_policy==SPI_SCHED_LOW_CS_FIRST ||
+            dev_config->sched_policy==spihost[host]->sched_policy, "scheduling policy differs from other devices on the bus", ESP_ERR_INVALID_STATE);
     for (freecs=0; freecs<NO_CS; freecs++) {
         //See if this slot is free; reserve if it is by putting a dummy pointer in the slot. We use an atomic compare&swap to make this thread-safe.
         if (__sync_bool_compare_and_swap(&spihost[host]->device[freecs], NULL, (spi_device_t *)1)) break;
@@ -341,10 +416,17 @@ esp_err_t spi_bus_add_device(spi_host_device_t host, spi_device_interface_config
     spihost[host]->device[freecs]=dev;
 
     //Allocate queues, set defaults
-    dev->trans_queue=xQueueCreate(dev_config->queue_size, sizeof(spi_transaction_t *));
+    dev->trans_queue=xQueueCreate(dev_config->queue_size, sizeof(spi_trans_priv_t));
     dev->ret_queue=xQueueCreate(dev_config->queue_size, sizeof(spi_transaction_t *));
     if (dev_config->duty_cycle_pos==0) dev_config->duty_cycle_pos=128;
     dev->host=spihost[host];
+    if (dev_config->deadline_us && dev_config->deadline_us < SPI_NO_DEADLINE) {
+        dev->deadline=dev_config->deadline_us;
+    } else {
+        dev->deadline=SPI_NO_DEADLINE;
+    }
+    if (dev_config->sched_policy!=SPI_SCHED_LOW_CS_FIRST) spihost[host]->sched_policy=dev_config->sched_policy;
+    dev->spin_bits=(dev_config->clock_speed_hz/1000000)*SPI_BATCH_SPIN_US;
 
     //We want to save a copy of the dev config in the dev struct.
     memcpy(&dev->cfg, dev_config, sizeof(spi_device_interface_config_t));
@@ -392,6 +474,16 @@ esp_err_t spi_bus_remove_device(spi_device_handle_t handle)
     for (x=0; x<NO_CS; x++) {
         if (handle->host->device[x] == handle) handle->host->device[x]=NULL;
     }
+    //The bus keeps its scheduling policy as long as a device asks for it
+    if (handle->cfg.sched_policy!=SPI_SCHED_LOW_CS_FIRST) {
+        handle->host->sched_policy=SPI_SCHED_LOW_CS_FIRST;
+        for (x=0; x<NO_CS; x++) {
+            spi_device_t *dev=handle->host->device[x];
+            if (dev && dev!=(spi_device_t *)1 && dev->cfg.sched_policy!=SPI_SCHED_LOW_CS_FIRST) {
+                handle->host->sched_policy=dev->cfg.sched_policy;
+            }
+        }
+    }
     free(handle);
     return ESP_OK;
 }
@@ -461,6 +553,217 @@ static int spi_set_clock(spi_dev_t *hw, int fapb, int hz, int duty_cycle) {
 //bits from/to the work registers. Keep between 32 and (8*32) please.
 #define THRESH_DMA_TRANS (8*32)
 
+//Transaction on the bus is done: copy the received data out of the work registers and call post_cb.
+static void IRAM_ATTR spi_intr_finish(spi_host_t *host)
+{
+    if ((host->cur_trans->rx_buffer || (host->cur_trans->flags & SPI_TRANS_USE_RXDATA)) && host->cur_trans->rxlength<=THRESH_DMA_TRANS) {
+        //Need to copy from SPI regs to result buffer.
+        uint32_t *data;
+        if (host->cur_trans->flags & SPI_TRANS_USE_RXDATA) {
+            data=(uint32_t*)&host->cur_trans->rx_data[0];
+        } else {
+            data=(uint32_t*)host->cur_trans->rx_buffer;
+        }
+        for (int x=0; x < host->cur_trans->rxlength; x+=32) {
+            //Do a memcpy to get around possible alignment issues in rx_buffer
+            uint32_t word=host->hw->data_buf[x/32];
+            memcpy(&data[x/32], &word, 4);
+        }
+    }
+    //Call post-transaction callback, if any
+    if (host->device[host->cur_cs]->cfg.post_cb) host->device[host->cur_cs]->cfg.post_cb(host->cur_trans);
+}
+
+//Program the registers for a transaction of the device on the given CS and start it.
+static void IRAM_ATTR spi_intr_start(spi_host_t *host, int cs, spi_transaction_t *trans, bool reconfigure)
+{
+    host->hw->slave.trans_done=0; //clear int bit
+    //We have a transaction. Send it.
+    spi_device_t *dev=host->device[cs];
+    host->cur_trans=trans;
+    host->cur_cs=cs;
+    //We should be done with the transmission.
+    assert(host->hw->cmd.usr == 0);
+    
+    //Default rxlength to be the same as length, if not filled in.
+    if (trans->rxlength==0) {
+        trans->rxlength=trans->length;
+    }
+    
+    //Reconfigure according to device settings, but only if we change CSses.
+    if (reconfigure) {
+        //Assumes a hardcoded 80MHz Fapb for now. ToDo: figure out something better once we have
+        //clock scaling working.
+        int apbclk=APB_CLK_FREQ;
+        int effclk=spi_set_clock(host->hw, apbclk, dev->cfg.clock_speed_hz, dev->cfg.duty_cycle_pos);
+        //Configure bit order
+        host->hw->ctrl.rd_bit_order=(dev->cfg.flags & SPI_DEVICE_RXBIT_LSBFIRST)?1:0;
+        host->hw->ctrl.wr_bit_order=(dev->cfg.flags & SPI_DEVICE_TXBIT_LSBFIRST)?1:0;
+        
+        //Configure polarity
+        //SPI iface needs to be configured for a delay in some cases.
+        int nodelay=0;
+        int extra_dummy=0;
+        if (host->no_gpio_matrix) {
+            if (effclk >= apbclk/2) {
+                nodelay=1;
+            }
+        } else {
+            if (effclk >= apbclk/2) {
+                nodelay=1;
+                extra_dummy=1;          //Note: This only works on half-duplex connections. spi_bus_add_device checks for this.
+            } else if (effclk >= apbclk/4) {
+                nodelay=1;
+            }
+        }
+
+        if (dev->cfg.mode==0) {
+            host->hw->pin.ck_idle_edge=0;
+            host->hw->user.ck_out_edge=0;
+            host->hw->ctrl2.miso_delay_mode=nodelay?0:2;
+        } else if (dev->cfg.mode==1) {
+            host->hw->pin.ck_idle_edge=0;
+            host->hw->user.ck_out_edge=1;
+            host->hw->ctrl2.miso_delay_mode=nodelay?0:1;
+        } else if (dev->cfg.mode==2) {
+            host->hw->pin.ck_idle_edge=1;
+            host->hw->user.ck_out_edge=1;
+            host->hw->ctrl2.miso_delay_mode=nodelay?0:1;
+        } else if (dev->cfg.mode==3) {
+            host->hw->pin.ck_idle_edge=1;
+            host->hw->user.ck_out_edge=0;
+            host->hw->ctrl2.miso_delay_mode=nodelay?0:2;
+        }
+
+        //Configure bit sizes, load addr and command
+        host->hw->user.usr_dummy=(dev->cfg.dummy_bits+extra_dummy)?1:0;
+        host->hw->user.usr_addr=(dev->cfg.address_bits)?1:0;
+        host->hw->user.usr_command=(dev->cfg.command_bits)?1:0;
+        host->hw->user1.usr_addr_bitlen=dev->cfg.address_bits-1;
+        host->hw->user1.usr_dummy_cyclelen=dev->cfg.dummy_bits+extra_dummy-1;
+        host->hw->user2.usr_command_bitlen=dev->cfg.command_bits-1;
+        //Configure misc stuff
+        host->hw->user.doutdin=(dev->cfg.flags & SPI_DEVICE_HALFDUPLEX)?0:1;
+        host->hw->user.sio=(dev->cfg.flags & SPI_DEVICE_3WIRE)?1:0;
+
+        host->hw->ctrl2.setup_time=dev->cfg.cs_ena_pretrans-1;
+        host->hw->user.cs_setup=dev->cfg.cs_ena_pretrans?1:0;
+        host->hw->ctrl2.hold_time=dev->cfg.cs_ena_posttrans-1;
+        host->hw->user.cs_hold=(dev->cfg.cs_ena_posttrans)?1:0;
+
+        //Configure CS pin
+        host->hw->pin.cs0_dis=(cs==0)?0:1;
+        host->hw->pin.cs1_dis=(cs==1)?0:1;
+        host->hw->pin.cs2_dis=(cs==2)?0:1;
+    }
+    //Reset DMA
+    host->hw->dma_conf.val |= SPI_OUT_RST|SPI_AHBM_RST|SPI_AHBM_FIFO_RST;
+    host->hw->dma_out_link.start=0;
+    host->hw->dma_in_link.start=0;
+    host->hw->dma_conf.val &= ~(SPI_OUT_RST|SPI_AHBM_RST|SPI_AHBM_FIFO_RST);
+    //QIO/DIO
+    host->hw->ctrl.val &= ~(SPI_FREAD_DUAL|SPI_FREAD_QUAD|SPI_FREAD_DIO|SPI_FREAD_QIO);
+    host->hw->user.val &= ~(SPI_FWRITE_DUAL|SPI_FWRITE_QUAD|SPI_FWRITE_DIO|SPI_FWRITE_QIO);
+    if (trans->flags & SPI_TRANS_MODE_DIO) {
+        if (trans->flags & SPI_TRANS_MODE_DIOQIO_ADDR) {
+            host->hw->ctrl.fread_dio=1;
+            host->hw->user.fwrite_dio=1;
+        } else {
+            host->hw->ctrl.fread_dual=1;
+            host->hw->user.fwrite_dual=1;
+        }
+        host->hw->ctrl.fastrd_mode=1;
+    } else if (trans->flags & SPI_TRANS_MODE_QIO) {
+        if (trans->flags & SPI_TRANS_MODE_DIOQIO_ADDR) {
+            host->hw->ctrl.fread_qio=1;
+            host->hw->user.fwrite_qio=1;
+        } else {
+            host->hw->ctrl.fread_quad=1;
+            host->hw->user.fwrite_quad=1;
+        }
+        host->hw->ctrl.fastrd_mode=1;
+    }
+
+
+    //Fill DMA descriptors
+    if (trans->rx_buffer || (trans->flags & SPI_TRANS_USE_RXDATA)) {
+        uint32_t *data;
+        if (trans->flags & SPI_TRANS_USE_RXDATA) {
+            data=(uint32_t *)&trans->rx_data[0];
+        } else {
+            data=trans->rx_buffer;
+        }
+        if (trans->rxlength <= THRESH_DMA_TRANS) {
+            //No need for DMA; we'll copy the result out of the work registers directly later.
+        } else {
+            host->hw->user.usr_miso_highpart=0;
+            host->dmadesc_rx.size=(trans->rxlength+7)/8;
+            host->dmadesc_rx.length=(trans->rxlength+7)/8;
+            host->dmadesc_rx.buf=(uint8_t*)data;
+            host->dmadesc_rx.eof=1;
+            host->dmadesc_rx.sosf=0;
+            host->dmadesc_rx.owner=1;
+            host->hw->dma_in_link.addr=(int)(&host->dmadesc_rx)&0xFFFFF;
+            host->hw->dma_in_link.start=1;
+        }
+        host->hw->user.usr_miso=1;
+    } else {
+        host->hw->user.usr_miso=0;
+    }
+
+    if (trans->tx_buffer || (trans->flags & SPI_TRANS_USE_TXDATA)) {
+        uint32_t *data;
+        if (trans->flags & SPI_TRANS_USE_TXDATA) {
+            data=(uint32_t *)&trans->tx_data[0];
+        } else {
+            data=(uint32_t *)trans->tx_buffer;
+        }
+        if (trans->length <= THRESH_DMA_TRANS) {
+            //No need for DMA.
+            for (int x=0; x < trans->length; x+=32) {
+                //Use memcpy to get around alignment issues for txdata
+                uint32_t word;
+                memcpy(&word, &data[x/32], 4);
+                host->hw->data_buf[(x/32)+8]=word;
+            }
+            host->hw->user.usr_mosi_highpart=1;
+        } else {
+            host->hw->user.usr_mosi_highpart=0;
+            host->dmadesc_tx.size=(trans->length+7)/8;
+            host->dmadesc_tx.length=(trans->length+7)/8;
+            host->dmadesc_tx.buf=(uint8_t*)data;
+            host->dmadesc_tx.eof=1;
+            host->dmadesc_tx.sosf=0;
+            host->dmadesc_tx.owner=1;
+            host->hw->dma_out_link.addr=(int)(&host->dmadesc_tx) & 0xFFFFF;
+            host->hw->dma_out_link.start=1;
+        }
+    }
+    host->hw->mosi_dlen.usr_mosi_dbitlen=trans->length-1;
+    host->hw->miso_dlen.usr_miso_dbitlen=trans->rxlength-1;
+    host->hw->user2.usr_command_value=trans->command;
+    if (dev->cfg.address_bits>32) {
+        host->hw->addr=trans->address >> 32;
+        host->hw->slv_wr_status=trans->address & 0xffffffff;
+    } else {
+        host->hw->addr=trans->address & 0xffffffff;
+    }
+    host->hw->user.usr_mosi=(trans->tx_buffer==NULL)?0:1;
+    host->hw->user.usr_miso=(trans->rx_buffer==NULL)?0:1;
+
+    //Call pre-transmission callback, if any
+    if (dev->cfg.pre_cb) dev->cfg.pre_cb(trans);
+    //Kick off transfer
+    host->hw->cmd.usr=1;
+}
+
+static inline bool IRAM_ATTR spi_trans_bits_fit(spi_device_t *dev, spi_transaction_t *trans)
+{
+    int bits=dev->cfg.command_bits+dev->cfg.address_bits+dev->cfg.dummy_bits;
+    bits+=(trans->rxlength>trans->length)?trans->rxlength:trans->length;
+    return bits<=dev->spin_bits;
+}
+
 //This is run in interrupt context and apart from initialization and destruction, this is the only code
 //touching the host (=spihost[x]) variable. The rest of the data arrives in queues. That is why there are
 //no muxes in this code.
@@ -468,9 +771,10 @@ static void IRAM_ATTR spi_intr(void *arg)
 {
     int i;
     int prevCs=-1;
-    BaseType_t r;
     BaseType_t do_yield=pdFALSE;
     spi_transaction_t *trans=NULL;
+    spi_trans_priv_t trans_buf;
+    spi_sched_slot_t slot[NO_CS];
     spi_host_t *host=(spi_host_t*)arg;
 
     //Ignore all but the trans_done int.
@@ -478,231 +782,93 @@ static void IRAM_ATTR spi_intr(void *arg)
 
     if (host->cur_trans) {
         //Okay, transaction is done. 
-        if ((host->cur_trans->rx_buffer || (host->cur_trans->flags & SPI_TRANS_USE_RXDATA)) && host->cur_trans->rxlength<=THRESH_DMA_TRANS) {
-            //Need to copy from SPI regs to result buffer.
-            uint32_t *data;
-            if (host->cur_trans->flags & SPI_TRANS_USE_RXDATA) {
-                data=(uint32_t*)&host->cur_trans->rx_data[0];
-            } else {
-                data=(uint32_t*)host->cur_trans->rx_buffer;
-            }
-            for (int x=0; x < host->cur_trans->rxlength; x+=32) {
-                //Do a memcpy to get around possible alignment issues in rx_buffer
-                uint32_t word=host->hw->data_buf[x/32];
-                memcpy(&data[x/32], &word, 4);
+        spi_intr_finish(host);
+        //The rest of a batch goes out straight away, without going through the queues and the scheduler.
+        while (host->batch_remain) {
+            spi_device_t *dev=host->device[host->cur_cs];
+            host->batch_remain--;
+            spi_intr_start(host, host->cur_cs, host->cur_trans+1, false);
+            if (!spi_trans_bits_fit(dev, host->cur_trans)) {
+                //Long transfer; the trans_done interrupt brings us back here.
+                return;
             }
+            while (host->hw->cmd.usr) ;
+            spi_intr_finish(host);
         }
-        //Call post-transaction callback, if any
-        if (host->device[host->cur_cs]->cfg.post_cb) host->device[host->cur_cs]->cfg.post_cb(host->cur_trans);
-        //Return transaction descriptor.
-        xQueueSendFromISR(host->device[host->cur_cs]->ret_queue, &host->cur_trans, &do_yield);
+        //Return transaction descriptor; for a batch, that is the first one of the array.
+        xQueueSendFromISR(host->device[host->cur_cs]->ret_queue, &host->batch_first, &do_yield);
         host->cur_trans=NULL;
         prevCs=host->cur_cs;
     }
-    //ToDo: This is a stupidly simple low-cs-first priority scheme. Make this configurable somehow. - JD
+    //Look at the oldest transaction every device has waiting and let the scheduler pick the device to serve.
+    uint32_t now=spi_now_us();
     for (i=0; i<NO_CS; i++) {
-        if (host->device[i]) {
-            r=xQueueReceiveFromISR(host->device[i]->trans_queue, &trans, &do_yield);
-            //Stop looking if we have a transaction to send.
-            if (r) break;
+        spi_device_t *dev=host->device[i];
+        slot[i].pending=false;
+        if (dev && xQueuePeekFromISR(dev->trans_queue, &trans_buf)) {
+            slot[i].pending=true;
+            slot[i].priority=dev->cfg.priority;
+            slot[i].queued_at=trans_buf.queued_at;
+            slot[i].deadline=dev->deadline;
         }
     }
-    if (i==NO_CS) {
+    i=spi_sched_pick(host->sched_policy, slot, NO_CS, host->cur_cs, now);
+    if (i>=0) {
+        spi_device_t *dev=host->device[i];
+        uint32_t depth=uxQueueMessagesWaitingFromISR(dev->trans_queue);
+        xQueueReceiveFromISR(dev->trans_queue, &trans_buf, &do_yield);
+        trans=trans_buf.trans;
+        uint32_t waited=now-trans_buf.queued_at;
+        portENTER_CRITICAL_ISR(&spi_stats_spinlock);
+        dev->stats.trans_count+=trans_buf.batch;
+        dev->stats.total_latency_us+=waited;
+        if (waited>dev->stats.max_latency_us) dev->stats.max_latency_us=waited;
+        if (depth>dev->stats.max_queue_depth) dev->stats.max_queue_depth=depth;
+        if (dev->cfg.deadline_us && waited>dev->deadline) dev->stats.deadline_misses++;
+        portEXIT_CRITICAL_ISR(&spi_stats_spinlock);
+    }
+    if (i<0) {
         //No packet waiting. Disable interrupt.
         esp_intr_disable(host->intr);
     } else {
-        host->hw->slave.trans_done=0; //clear int bit
-        //We have a transaction. Send it.
-        spi_device_t *dev=host->device[i];
-        host->cur_trans=trans;
-        host->cur_cs=i;
-        //We should be done with the transmission.
-        assert(host->hw->cmd.usr == 0);
-        
-        //Default rxlength to be the same as length, if not filled in.
-        if (trans->rxlength==0) {
-            trans->rxlength=trans->length;
-        }
-        
-        //Reconfigure according to device settings, but only if we change CSses.
-        if (i!=prevCs) {
-            //Assumes a hardcoded 80MHz Fapb for now. ToDo: figure out something better once we have
-            //clock scaling working.
-            int apbclk=APB_CLK_FREQ;
-            int effclk=spi_set_clock(host->hw, apbclk, dev->cfg.clock_speed_hz, dev->cfg.duty_cycle_pos);
-            //Configure bit order
-            host->hw->ctrl.rd_bit_order=(dev->cfg.flags & SPI_DEVICE_RXBIT_LSBFIRST)?1:0;
-            host->hw->ctrl.wr_bit_order=(dev->cfg.flags & SPI_DEVICE_TXBIT_LSBFIRST)?1:0;
-            
-            //Configure polarity
-            //SPI iface needs to be configured for a delay in some cases.
-            int nodelay=0;
-            int extra_dummy=0;
-            if (host->no_gpio_matrix) {
-                if (effclk >= apbclk/2) {
-                    nodelay=1;
-                }
-            } else {
-                if (effclk >= apbclk/2) {
-                    nodelay=1;
-                    extra_dummy=1;          //Note: This only works on half-duplex connections. spi_bus_add_device checks for this.
-                } else if (effclk >= apbclk/4) {
-                    nodelay=1;
-                }
-            }
-
-            if (dev->cfg.mode==0) {
-                host->hw->pin.ck_idle_edge=0;
-                host->hw->user.ck_out_edge=0;
-                host->hw->ctrl2.miso_delay_mode=nodelay?0:2;
-            } else if (dev->cfg.mode==1) {
-                host->hw->pin.ck_idle_edge=0;
-                host->hw->user.ck_out_edge=1;
-                host->hw->ctrl2.miso_delay_mode=nodelay?0:1;
-            } else if (dev->cfg.mode==2) {
-                host->hw->pin.ck_idle_edge=1;
-                host->hw->user.ck_out_edge=1;
-                host->hw->ctrl2.miso_delay_mode=nodelay?0:1;
-            } else if (dev->cfg.mode==3) {
-                host->hw->pin.ck_idle_edge=1;
-                host->hw->user.ck_out_edge=0;
-                host->hw->ctrl2.miso_delay_mode=nodelay?0:2;
-            }
-
-            //Configure bit sizes, load addr and command
-            host->hw->user.usr_dummy=(dev->cfg.dummy_bits+extra_dummy)?1:0;
-            host->hw->user.usr_addr=(dev->cfg.address_bits)?1:0;
-            host->hw->user.usr_command=(dev->cfg.command_bits)?1:0;
-            host->hw->user1.usr_addr_bitlen=dev->cfg.address_bits-1;
-            host->hw->user1.usr_dummy_cyclelen=dev->cfg.dummy_bits+extra_dummy-1;
-            host->hw->user2.usr_command_bitlen=dev->cfg.command_bits-1;
-            //Configure misc stuff
-            host->hw->user.doutdin=(dev->cfg.flags & SPI_DEVICE_HALFDUPLEX)?0:1;
-            host->hw->user.sio=(dev->cfg.flags & SPI_DEVICE_3WIRE)?1:0;
-
-            host->hw->ctrl2.setup_time=dev->cfg.cs_ena_pretrans-1;
-            host->hw->user.cs_setup=dev->cfg.cs_ena_pretrans?1:0;
-            host->hw->ctrl2.hold_time=dev->cfg.cs_ena_posttrans-1;
-            host->hw->user.cs_hold=(dev->cfg.cs_ena_posttrans)?1:0;
-
-            //Configure CS pin
-            host->hw->pin.cs0_dis=(i==0)?0:1;
-            host->hw->pin.cs1_dis=(i==1)?0:1;
-            host->hw->pin.cs2_dis=(i==2)?0:1;
-        }
-        //Reset DMA
-        host->hw->dma_conf.val |= SPI_OUT_RST|SPI_AHBM_RST|SPI_AHBM_FIFO_RST;
-        host->hw->dma_out_link.start=0;
-        host->hw->dma_in_link.start=0;
-        host->hw->dma_conf.val &= ~(SPI_OUT_RST|SPI_AHBM_RST|SPI_AHBM_FIFO_RST);
-        //QIO/DIO
-        host->hw->ctrl.val &= ~(SPI_FREAD_DUAL|SPI_FREAD_QUAD|SPI_FREAD_DIO|SPI_FREAD_QIO);
-        host->hw->user.val &= ~(SPI_FWRITE_DUAL|SPI_FWRITE_QUAD|SPI_FWRITE_DIO|SPI_FWRITE_QIO);
-        if (trans->flags & SPI_TRANS_MODE_DIO) {
-            if (trans->flags & SPI_TRANS_MODE_DIOQIO_ADDR) {
-                host->hw->ctrl.fread_dio=1;
-                host->hw->user.fwrite_dio=1;
-            } else {
-                host->hw->ctrl.fread_dual=1;
-                host->hw->user.fwrite_dual=1;
-            }
-            host->hw->ctrl.fastrd_mode=1;
-        } else if (trans->flags & SPI_TRANS_MODE_QIO) {
-            if (trans->flags & SPI_TRANS_MODE_DIOQIO_ADDR) {
-                host->hw->ctrl.fread_qio=1;
-                host->hw->user.fwrite_qio=1;
-            } else {
-                host->hw->ctrl.fread_quad=1;
-                host->hw->user.fwrite_quad=1;
-            }
-            host->hw->ctrl.fastrd_mode=1;
-        }
-
-
-        //Fill DMA descriptors
-        if (trans->rx_buffer || (trans->flags & SPI_TRANS_USE_RXDATA)) {
-            uint32_t *data;
-            if (trans->flags & SPI_TRANS_USE_RXDATA) {
-                data=(uint32_t *)&trans->rx_data[0];
-            } else {
-                data=trans->rx_buffer;
-            }
-            if (trans->rxlength <= THRESH_DMA_TRANS) {
-                //No need for DMA; we'll copy the result out of the work registers directly later.
-            } else {
-                host->hw->user.usr_miso_highpart=0;
-                host->dmadesc_rx.size=(trans->rxlength+7)/8;
-                host->dmadesc_rx.length=(trans->rxlength+7)/8;
-                host->dmadesc_rx.buf=(uint8_t*)data;
-                host->dmadesc_rx.eof=1;
-                host->dmadesc_rx.sosf=0;
-                host->dmadesc_rx.owner=1;
-                host->hw->dma_in_link.addr=(int)(&host->dmadesc_rx)&0xFFFFF;
-                host->hw->dma_in_link.start=1;
-            }
-            host->hw->user.usr_miso=1;
-        } else {
-            host->hw->user.usr_miso=0;
-        }
-
-        if (trans->tx_buffer || (trans->flags & SPI_TRANS_USE_TXDATA)) {
-            uint32_t *data;
-            if (trans->flags & SPI_TRANS_USE_TXDATA) {
-                data=(uint32_t *)&trans->tx_data[0];
-            } else {
-                data=(uint32_t *)trans->tx_buffer;
-            }
-            if (trans->length <= THRESH_DMA_TRANS) {
-                //No need for DMA.
-                for (int x=0; x < trans->length; x+=32) {
-                    //Use memcpy to get around alignment issues for txdata
-                    uint32_t word;
-                    memcpy(&word, &data[x/32], 4);
-                    host->hw->data_buf[(x/32)+8]=word;
-                }
-                host->hw->user.usr_mosi_highpart=1;
-            } else {
-                host->hw->user.usr_mosi_highpart=0;
-                host->dmadesc_tx.size=(trans->length+7)/8;
-                host->dmadesc_tx.length=(trans->length+7)/8;
-                host->dmadesc_tx.buf=(uint8_t*)data;
-                host->dmadesc_tx.eof=1;
-                host->dmadesc_tx.sosf=0;
-                host->dmadesc_tx.owner=1;
-                host->hw->dma_out_link.addr=(int)(&host->dmadesc_tx) & 0xFFFFF;
-                host->hw->dma_out_link.start=1;
-            }
-        }
-        host->hw->mosi_dlen.usr_mosi_dbitlen=trans->length-1;
-        host->hw->miso_dlen.usr_miso_dbitlen=trans->rxlength-1;
-        host->hw->user2.usr_command_value=trans->command;
-        if (dev->cfg.address_bits>32) {
-            host->hw->addr=trans->address >> 32;
-            host->hw->slv_wr_status=trans->address & 0xffffffff;
-        } else {
-            host->hw->addr=trans->address & 0xffffffff;
-        }
-        host->hw->user.usr_mosi=(trans->tx_buffer==NULL)?0:1;
-        host->hw->user.usr_miso=(trans->rx_buffer==NULL)?0:1;
-
-        //Call pre-transmission callback, if any
-        if (dev->cfg.pre_cb) dev->cfg.pre_cb(trans);
-        //Kick off transfer
-        host->hw->cmd.usr=1;
+        host->batch_first=trans;
+        host->batch_remain=trans_buf.batch-1;
+        spi_intr_start(host, i, trans, i!=prevCs);
     }
     if (do_yield) portYIELD_FROM_ISR();
 }
 
 
-esp_err_t spi_device_queue_trans(spi_device_handle_t handle, spi_transaction_t *trans_desc,  TickType_t ticks_to_wait)
+static esp_err_t spi_check_trans(spi_device_handle_t handle, spi_transaction_t *trans_desc)
 {
-    BaseType_t r;
-    SPI_CHECK(handle!=NULL, "invalid dev handle", ESP_ERR_INVALID_ARG);
+    SPI_CHECK(trans_desc!=NULL, "invalid transaction", ESP_ERR_INVALID_ARG);
     SPI_CHECK((trans_desc->flags & SPI_TRANS_USE_RXDATA)==0 ||trans_desc->length <= 32, "rxdata transfer > 32bytes", ESP_ERR_INVALID_ARG);
     SPI_CHECK((trans_desc->flags & SPI_TRANS_USE_TXDATA)==0 ||trans_desc->length <= 32, "txdata transfer > 32bytes", ESP_ERR_INVALID_ARG);
     SPI_CHECK(!((trans_desc->flags & (SPI_TRANS_MODE_DIO|SPI_TRANS_MODE_QIO)) && (handle->cfg.flags & SPI_DEVICE_3WIRE)), "incompatible iface params", ESP_ERR_INVALID_ARG);
     SPI_CHECK(!((trans_desc->flags & (SPI_TRANS_MODE_DIO|SPI_TRANS_MODE_QIO)) && (!(handle->cfg.flags & SPI_DEVICE_HALFDUPLEX))), "incompatible iface params", ESP_ERR_INVALID_ARG);
-    r=xQueueSend(handle->trans_queue, (void*)&trans_desc, ticks_to_wait);
+    return ESP_OK;
+}
+
+esp_err_t spi_device_queue_trans(spi_device_handle_t handle, spi_transaction_t *trans_desc,  TickType_t ticks_to_wait)
+{
+    return spi_device_queue_trans_batch(handle, trans_desc, 1, ticks_to_wait);
+}
+
+esp_err_t spi_device_queue_trans_batch(spi_device_handle_t handle, spi_transaction_t *trans_desc, int count, TickType_t ticks_to_wait)
+{
+    BaseType_t r;
+    esp_err_t ret;
+    spi_trans_priv_t trans_buf;
+    SPI_CHECK(handle!=NULL, "invalid dev handle", ESP_ERR_INVALID_ARG);
+    SPI_CHECK(count>0, "invalid batch size", ESP_ERR_INVALID_ARG);
+    for (int x=0; x<count; x++) {
+        ret=spi_check_trans(handle, &trans_desc[x]);
+        if (ret!=ESP_OK) return ret;
+    }
+    trans_buf.trans=trans_desc;
+    trans_buf.batch=count;
+    trans_buf.queued_at=spi_now_us();
+    r=xQueueSend(handle->trans_queue, (void*)&trans_buf, ticks_to_wait);
     if (!r) return ESP_ERR_TIMEOUT;
     esp_intr_enable(handle->host->intr);
     return ESP_OK;
@@ -731,3 +897,26 @@ esp_err_t spi_device_transmit(spi_device_handle_t handle, spi_transaction_t *tra
     return ESP_OK;
 }
 
+//Same, for a batch.
+esp_err_t spi_device_transmit_batch(spi_device_handle_t handle, spi_transaction_t *trans_desc, int count)
+{
+    esp_err_t ret;
+    spi_transaction_t *ret_trans;
+    ret=spi_device_queue_trans_batch(handle, trans_desc, count, portMAX_DELAY);
+    if (ret!=ESP_OK) return ret;
+    ret=spi_device_get_trans_result(handle, &ret_trans, portMAX_DELAY);
+    if (ret!=ESP_OK) return ret;
+    assert(ret_trans==trans_desc);
+    return ESP_OK;
+}
+
+esp_err_t spi_device_get_stats(spi_device_handle_t handle, spi_device_stats_t *stats, bool reset)
+{
+    SPI_CHECK(handle!=NULL, "invalid dev handle", ESP_ERR_INVALID_ARG);
+    SPI_CHECK(stats!=NULL, "invalid stats pointer", ESP_ERR_INVALID_ARG);
+    portENTER_CRITICAL(&spi_stats_spinlock);
+    *stats=handle->stats;
+    if (reset) memset(&handle->stats, 0, sizeof(spi_device_stats_t));
+    portEXIT_CRITICAL(&spi_stats_spinlock);
+    return ESP_OK;
+}
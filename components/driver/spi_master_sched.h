@@ -0,0 +1,57 @@
+// Copyright 2015-2017 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+/*
+ Transaction dispatch of the SPI master interrupt handler: which of the devices with queued transactions
+ gets the bus next. Kept free of any hardware or RTOS dependency so it can be inlined into the (IRAM)
+ interrupt handler and exercised on the host.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "driver/spi_master.h"
+
+typedef struct {
+    bool pending;               ///< device has a transaction waiting
+    uint8_t priority;           ///< spi_device_interface_config_t::priority
+    uint32_t queued_at;         ///< timestamp of the oldest waiting transaction
+    uint32_t deadline;          ///< latency allowed to that transaction, same unit as the timestamps
+} spi_sched_slot_t;
+
+/*
+ Pick the slot to send next, or -1 if none is pending. The highest priority always wins; between equal
+ priorities, 'policy' decides. 'last' is the slot sent last (-1 if none), 'now' the current timestamp.
+ Timestamps are free-running and may wrap around.
+*/
+static inline int spi_sched_pick(spi_sched_policy_t policy, const spi_sched_slot_t *slot, int n, int last, uint32_t now)
+{
+    int best=-1;
+    int32_t best_slack=0;
+    for (int k=0; k<n; k++) {
+        //Round-robin starts looking right after the slot that was sent last, the others at slot 0
+        int i=(policy==SPI_SCHED_ROUND_ROBIN && last>=0)?(last+1+k)%n:k;
+        if (!slot[i].pending) continue;
+        int32_t slack=(int32_t)(slot[i].queued_at+slot[i].deadline-now);
+        if (best==-1 || slot[i].priority>slot[best].priority) {
+            best=i;
+            best_slack=slack;
+        } else if (slot[i].priority==slot[best].priority && policy==SPI_SCHED_DEADLINE && slack<best_slack) {
+            best=i;
+            best_slack=slack;
+        }
+    }
+    return best;
+}
@@ -147,3 +147,85 @@ TEST_CASE("SPI Master test", "[spi][ignore]")
     ret=spi_bus_free(HSPI_HOST);
     TEST_ASSERT(ret==ESP_OK);
 }
+
+
+static int batch_pre_count;
+
+static void batch_pre_cb(spi_transaction_t *t)
+{
+    //Transactions of a batch are started in order
+    TEST_ASSERT((int)t->user==batch_pre_count);
+    batch_pre_count++;
+}
+
+TEST_CASE("SPI Master batch test", "[spi][ignore]")
+{
+    spi_bus_config_t buscfg={
+        .mosi_io_num=4,
+        .miso_io_num=16,
+        .sclk_io_num=25,
+        .quadwp_io_num=-1,
+        .quadhd_io_num=-1
+    };
+    spi_device_interface_config_t devcfg={
+        .clock_speed_hz=10000000,
+        .duty_cycle_pos=128,
+        .mode=0,
+        .spics_io_num=21,
+        .queue_size=2,
+        .pre_cb=batch_pre_cb,
+    };
+    esp_err_t ret;
+    spi_device_handle_t handle;
+    spi_transaction_t t[8], *rtrans;
+    char sendbuf[64], recvbuf[64];
+    spi_device_stats_t stats;
+    printf("THIS TEST NEEDS A JUMPER BETWEEN IO4 AND IO16\n");
+
+    ret=spi_bus_initialize(HSPI_HOST, &buscfg, 1);
+    TEST_ASSERT(ret==ESP_OK);
+    ret=spi_bus_add_device(HSPI_HOST, &devcfg, &handle);
+    TEST_ASSERT(ret==ESP_OK);
+
+    //Mix of short transfers waited for in the interrupt and longer ones that need an interrupt each
+    memset(t, 0, sizeof(t));
+    memset(recvbuf, 0, sizeof(recvbuf));
+    for (int x=0; x<64; x++) sendbuf[x]=x*7+1;
+    for (int x=0; x<8; x++) {
+        t[x].user=(void*)x;
+        if (x<6) {
+            t[x].length=8;
+            t[x].tx_buffer=&sendbuf[x];
+            t[x].rx_buffer=&recvbuf[x];
+        } else {
+            t[x].length=29*8;
+            t[x].tx_buffer=&sendbuf[6+(x-6)*29];
+            t[x].rx_buffer=&recvbuf[6+(x-6)*29];
+        }
+    }
+
+    ret=spi_device_get_stats(handle, &stats, true);
+    TEST_ASSERT(ret==ESP_OK);
+    batch_pre_count=0;
+    ret=spi_device_queue_trans_batch(handle, t, 8, portMAX_DELAY);
+    TEST_ASSERT(ret==ESP_OK);
+    ret=spi_device_get_trans_result(handle, &rtrans, portMAX_DELAY);
+    TEST_ASSERT(ret==ESP_OK);
+    TEST_ASSERT(rtrans==&t[0]);
+    TEST_ASSERT(batch_pre_count==8);
+    TEST_ASSERT_EQUAL_INT8_ARRAY(sendbuf, recvbuf, 64);
+
+    //The batch is counted per transaction, but queued once
+    ret=spi_device_get_stats(handle, &stats, false);
+    TEST_ASSERT(ret==ESP_OK);
+    TEST_ASSERT(stats.trans_count==8);
+    TEST_ASSERT(stats.max_queue_depth==1);
+
+    TEST_ASSERT(spi_device_transmit_batch(handle, t, 0)==ESP_ERR_INVALID_ARG);
+    TEST_ASSERT(spi_device_transmit_batch(handle, NULL, 1)==ESP_ERR_INVALID_ARG);
+
+    ret=spi_bus_remove_device(handle);
+    TEST_ASSERT(ret==ESP_OK);
+    ret=spi_bus_free(HSPI_HOST);
+    TEST_ASSERT(ret==ESP_OK);
+}
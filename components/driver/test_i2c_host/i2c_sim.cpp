@@ -0,0 +1,563 @@
+// Copyright 2015-2017 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "i2c_sim.h"
+#include "soc/soc.h"
+#include "soc/i2c_reg.h"
+#include "soc/i2c_struct.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "freertos/ringbuf.h"
+#include "esp_intr_alloc.h"
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <vector>
+#include <map>
+
+using namespace std;
+
+i2c_dev_t I2C0;
+i2c_dev_t I2C1;
+
+#define SIM_PORT_NUM    2
+#define SIM_FIFO_LEN    32
+#define SIM_REG_SPAN    0x180
+
+#define SIM_CMD_RSTART  0
+#define SIM_CMD_WRITE   1
+#define SIM_CMD_READ    2
+#define SIM_CMD_STOP    3
+#define SIM_CMD_END     4
+
+struct SimPort {
+    deque<uint8_t> tx;
+    deque<uint8_t> rx;
+    bool started;               /* ctr.trans_start was set, commands not yet run */
+    bool address_next;          /* the next byte written is a slave address */
+    bool reading;
+    I2CSimSlave* slave;         /* slave addressed in the current transaction */
+    intr_handler_t isr;
+    void* isr_arg;
+};
+
+struct sim_semaphore {
+    int count;
+};
+
+struct sim_queue {
+    size_t length;
+    size_t item_size;
+    deque<vector<uint8_t> > items;
+};
+
+static SimPort s_port[SIM_PORT_NUM];
+static map<uint8_t, I2CSimSlave*> s_slaves;
+static i2c_sim_stats_t s_stats;
+static TickType_t s_ticks;
+static bool s_in_isr;
+
+static i2c_dev_t* sim_dev(int port)
+{
+    return port ? &I2C1 : &I2C0;
+}
+
+static volatile uint32_t* sim_word(int port, uint32_t offset)
+{
+    return reinterpret_cast<volatile uint32_t*>(const_cast<void*>(
+                static_cast<volatile void*>(sim_dev(port)))) + offset / 4;
+}
+
+/* Store a register value, applying the side effects of the written bits */
+static void sim_store(int port, uint32_t offset, uint32_t value, uint32_t written)
+{
+    volatile uint32_t* word = sim_word(port, offset);
+    i2c_dev_t* dev = sim_dev(port);
+    if (offset == I2C_INT_CLR_REG(0) - REG_I2C_BASE(0)) {
+        dev->int_status.val &= ~written;
+        return;
+    }
+    *word = value;
+    if (offset == I2C_CTR_REG(0) - REG_I2C_BASE(0) && (written & I2C_TRANS_START_M)) {
+        s_port[port].started = true;
+        if (!s_in_isr) {
+            s_stats.task_starts++;
+        }
+    } else if (offset == I2C_FIFO_CONF_REG(0) - REG_I2C_BASE(0)) {
+        if (written & I2C_TX_FIFO_RST_M) {
+            s_port[port].tx.clear();
+        }
+        if (written & I2C_RX_FIFO_RST_M) {
+            s_port[port].rx.clear();
+        }
+    }
+}
+
+static bool sim_locate(uint32_t addr, int* port, uint32_t* offset)
+{
+    for (uint32_t i = 0; i < SIM_PORT_NUM; ++i) {
+        if (addr >= REG_I2C_BASE(i) && addr < REG_I2C_BASE(i) + SIM_REG_SPAN) {
+            *port = (int) i;
+            *offset = addr - REG_I2C_BASE(i);
+            return true;
+        }
+    }
+    s_stats.violations++;
+    return false;
+}
+
+uint32_t i2c_sim_reg_read(uint32_t addr)
+{
+    for (uint32_t i = 0; i < SIM_PORT_NUM; ++i) {
+        if (addr == I2C_DATA_APB_REG(i)) {
+            if (s_port[i].rx.empty()) {
+                s_stats.violations++;
+                return 0;
+            }
+            uint8_t data = s_port[i].rx.front();
+            s_port[i].rx.pop_front();
+            return data;
+        }
+    }
+    int port;
+    uint32_t offset;
+    if (!sim_locate(addr, &port, &offset)) {
+        return 0;
+    }
+    return *sim_word(port, offset);
+}
+
+void i2c_sim_reg_write(uint32_t addr, uint32_t value)
+{
+    for (uint32_t i = 0; i < SIM_PORT_NUM; ++i) {
+        if (addr == I2C_DATA_APB_REG(i)) {
+            if (s_port[i].tx.size() >= SIM_FIFO_LEN) {
+                s_stats.violations++;
+                return;
+            }
+            s_port[i].tx.push_back(value & 0xff);
+            return;
+        }
+    }
+    int port;
+    uint32_t offset;
+    if (sim_locate(addr, &port, &offset)) {
+        sim_store(port, offset, value, value);
+    }
+}
+
+void i2c_sim_field_write(volatile uint32_t* reg, unsigned shift, unsigned width, uint32_t value)
+{
+    uint32_t mask = i2c_sim_field_mask(width) << shift;
+    uint32_t written = (value << shift) & mask;
+    for (int i = 0; i < SIM_PORT_NUM; ++i) {
+        uintptr_t base = reinterpret_cast<uintptr_t>(sim_word(i, 0));
+        uintptr_t pos = reinterpret_cast<uintptr_t>(reg);
+        if (pos >= base && pos < base + SIM_REG_SPAN) {
+            sim_store(i, pos - base, (*reg & ~mask) | written, written);
+            return;
+        }
+    }
+    s_stats.violations++;
+}
+
+/* Execute the command registers up to END or STOP, then raise the interrupts */
+static void sim_run(int port)
+{
+    SimPort& p = s_port[port];
+    i2c_dev_t* dev = sim_dev(port);
+    uint32_t raised = 0;
+    p.started = false;
+    s_stats.transfers++;
+    for (int c = 0; c < 16 && raised == 0; ++c) {
+        uint32_t cmd = dev->command[c].val;
+        uint32_t byte_num = cmd & 0xff;
+        bool ack_en = (cmd >> 8) & 1;
+        uint32_t ack_exp = (cmd >> 9) & 1;
+        switch ((cmd >> 11) & 0x7) {
+        case SIM_CMD_RSTART:
+            p.address_next = true;
+            p.slave = NULL;
+            break;
+        case SIM_CMD_WRITE:
+            for (uint32_t n = 0; n < byte_num && raised == 0; ++n) {
+                if (p.tx.empty()) {
+                    s_stats.violations++;
+                    break;
+                }
+                uint8_t data = p.tx.front();
+                p.tx.pop_front();
+                s_stats.bus_bytes++;
+                bool ack;
+                if (p.address_next) {
+                    auto it = s_slaves.find(data >> 1);
+                    p.slave = it == s_slaves.end() ? NULL : it->second;
+                    p.reading = data & 1;
+                    p.address_next = false;
+                    if (p.slave) {
+                        p.slave->start(p.reading);
+                    }
+                    ack = p.slave != NULL;
+                    if (p.slave && p.slave->hold_scl()) {
+                        /* the controller only notices by its timeout interrupt, if that is enabled */
+                        raised = I2C_TIME_OUT_INT_ST_M;
+                        break;
+                    }
+                } else {
+                    ack = p.slave && !p.reading && p.slave->write(data);
+                }
+                if (ack_en && (ack ? 0 : 1) != ack_exp) {
+                    raised = I2C_ACK_ERR_INT_ST_M;
+                }
+            }
+            break;
+        case SIM_CMD_READ:
+            for (uint32_t n = 0; n < byte_num; ++n) {
+                if (p.rx.size() >= SIM_FIFO_LEN) {
+                    s_stats.violations++;
+                    break;
+                }
+                p.rx.push_back(p.slave && p.reading ? p.slave->read() : 0xff);
+                s_stats.bus_bytes++;
+            }
+            break;
+        case SIM_CMD_STOP:
+            p.slave = NULL;
+            raised = I2C_TRANS_COMPLETE_INT_ST_M | I2C_MASTER_TRAN_COMP_INT_ST_M;
+            break;
+        case SIM_CMD_END:
+            raised = I2C_END_DETECT_INT_ST_M;
+            break;
+        default:
+            s_stats.violations++;
+            return;
+        }
+    }
+    if (raised == 0) {
+        /* ran off the end of the command registers, the bus would hang */
+        s_stats.violations++;
+        return;
+    }
+    dev->int_status.val |= raised & dev->int_ena.val;
+    if (dev->int_status.val && p.isr) {
+        s_stats.interrupts++;
+        s_in_isr = true;
+        p.isr(p.isr_arg);
+        s_in_isr = false;
+    }
+}
+
+void i2c_sim_reset()
+{
+    for (int i = 0; i < SIM_PORT_NUM; ++i) {
+        SimPort& p = s_port[i];
+        p.tx.clear();
+        p.rx.clear();
+        p.started = false;
+        p.address_next = false;
+        p.slave = NULL;
+    }
+    s_slaves.clear();
+    s_stats = i2c_sim_stats_t();
+}
+
+void i2c_sim_module_reset(int port)
+{
+    SimPort& p = s_port[port];
+    p.tx.clear();
+    p.rx.clear();
+    p.started = false;
+    p.address_next = false;
+    p.slave = NULL;
+    memset(const_cast<void*>(static_cast<volatile void*>(sim_dev(port))), 0, sizeof(i2c_dev_t));
+    s_stats.resets++;
+}
+
+const i2c_sim_stats_t* i2c_sim_stats()
+{
+    return &s_stats;
+}
+
+void i2c_sim_attach(uint8_t addr, I2CSimSlave* slave)
+{
+    s_slaves[addr] = slave;
+}
+
+void i2c_sim_run()
+{
+    for (int port = 0; port < SIM_PORT_NUM; ++port) {
+        while (s_port[port].started) {
+            sim_run(port);
+        }
+    }
+}
+
+/* Kernel */
+
+/* Block the calling task until 'ready': the bus keeps running meanwhile. Without
+   a transfer in progress nothing else can happen, so the wait times out. */
+static bool sim_block(const function<bool()>& ready, TickType_t ticks_to_wait)
+{
+    while (!ready()) {
+        if (ticks_to_wait == 0) {
+            return false;
+        }
+        int port = 0;
+        while (port < SIM_PORT_NUM && !s_port[port].started) {
+            port++;
+        }
+        if (port == SIM_PORT_NUM) {
+            if (ticks_to_wait == portMAX_DELAY) {
+                s_stats.violations++;
+            } else {
+                s_ticks += ticks_to_wait;
+            }
+            return false;
+        }
+        sim_run(port);
+    }
+    return true;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary()
+{
+    sim_semaphore* sem = new sim_semaphore;
+    sem->count = 0;
+    return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex()
+{
+    sim_semaphore* sem = new sim_semaphore;
+    sem->count = 1;
+    return sem;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem)
+{
+    delete sem;
+}
+
+/* FromISR calls outside of the interrupt handler, or task calls inside it, are as bad as a
+   register access the hardware would not honour */
+static void sim_context(bool from_isr)
+{
+    if (from_isr != s_in_isr) {
+        s_stats.violations++;
+    }
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks_to_wait)
+{
+    sim_context(false);
+    if (!sim_block([sem]() { return sem->count > 0; }, ticks_to_wait)) {
+        return pdFALSE;
+    }
+    sem->count--;
+    return pdTRUE;
+}
+
+static BaseType_t sim_give(SemaphoreHandle_t sem)
+{
+    if (sem->count) {
+        return pdFALSE;
+    }
+    sem->count = 1;
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+    sim_context(false);
+    return sim_give(sem);
+}
+
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t sem, BaseType_t* higher_prio_task_woken)
+{
+    sim_context(true);
+    if (higher_prio_task_woken) {
+        *higher_prio_task_woken = pdTRUE;
+    }
+    return sim_give(sem);
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    sim_queue* queue = new sim_queue;
+    queue->length = length;
+    queue->item_size = item_size;
+    return queue;
+}
+
+void vQueueDelete(QueueHandle_t queue)
+{
+    delete queue;
+}
+
+static void sim_push(QueueHandle_t queue, const void* item)
+{
+    const uint8_t* data = static_cast<const uint8_t*>(item);
+    queue->items.push_back(vector<uint8_t>(data, data + queue->item_size));
+}
+
+static void sim_pop(QueueHandle_t queue, void* item)
+{
+    memcpy(item, queue->items.front().data(), queue->item_size);
+    queue->items.pop_front();
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t ticks_to_wait)
+{
+    sim_context(false);
+    if (!sim_block([queue]() { return queue->items.size() < queue->length; }, ticks_to_wait)) {
+        return pdFALSE;
+    }
+    sim_push(queue, item);
+    return pdTRUE;
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void* item, BaseType_t* higher_prio_task_woken)
+{
+    sim_context(true);
+    if (queue->items.size() >= queue->length) {
+        s_stats.violations++;
+        return pdFALSE;
+    }
+    sim_push(queue, item);
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t ticks_to_wait)
+{
+    sim_context(false);
+    if (!sim_block([queue]() { return !queue->items.empty(); }, ticks_to_wait)) {
+        return pdFALSE;
+    }
+    sim_pop(queue, item);
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceiveFromISR(QueueHandle_t queue, void* item, BaseType_t* higher_prio_task_woken)
+{
+    sim_context(true);
+    if (queue->items.empty()) {
+        return pdFALSE;
+    }
+    sim_pop(queue, item);
+    return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+    return queue->items.size();
+}
+
+TickType_t xTaskGetTickCount()
+{
+    return s_ticks;
+}
+
+TickType_t xTaskGetTickCountFromISR()
+{
+    sim_context(true);
+    return s_ticks;
+}
+
+RingbufHandle_t xRingbufferCreate(size_t buf_length, ringbuf_type_t type)
+{
+    return NULL;
+}
+
+void vRingbufferDelete(RingbufHandle_t ringbuf)
+{
+}
+
+BaseType_t xRingbufferSend(RingbufHandle_t ringbuf, void* data, size_t data_size, TickType_t ticks_to_wait)
+{
+    return pdFALSE;
+}
+
+BaseType_t xRingbufferSendFromISR(RingbufHandle_t ringbuf, void* data, size_t data_size, BaseType_t* higher_prio_task_woken)
+{
+    return pdFALSE;
+}
+
+void* xRingbufferReceiveUpTo(RingbufHandle_t ringbuf, size_t* item_size, TickType_t ticks_to_wait, size_t wanted_size)
+{
+    return NULL;
+}
+
+void* xRingbufferReceiveUpToFromISR(RingbufHandle_t ringbuf, size_t* item_size, size_t wanted_size)
+{
+    return NULL;
+}
+
+void vRingbufferReturnItem(RingbufHandle_t ringbuf, void* item)
+{
+}
+
+void vRingbufferReturnItemFromISR(RingbufHandle_t ringbuf, void* item, BaseType_t* higher_prio_task_woken)
+{
+}
+
+/* Interrupts */
+
+esp_err_t esp_intr_alloc(int source, int flags, intr_handler_t handler, void* arg, intr_handle_t* ret_handle)
+{
+    int port = source == ETS_I2C_EXT1_INTR_SOURCE ? 1 : 0;
+    s_port[port].isr = handler;
+    s_port[port].isr_arg = arg;
+    if (ret_handle) {
+        *ret_handle = reinterpret_cast<intr_handle_t>(&s_port[port]);
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_intr_free(intr_handle_t handle)
+{
+    SimPort* p = reinterpret_cast<SimPort*>(handle);
+    p->isr = NULL;
+    p->isr_arg = NULL;
+    return ESP_OK;
+}
+
+/* Heap calls of the driver, counted through the linker's --wrap */
+
+extern "C" {
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t n, size_t size);
+void __real_free(void* ptr);
+
+void* __wrap_malloc(size_t size)
+{
+    s_stats.mallocs++;
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t n, size_t size)
+{
+    s_stats.mallocs++;
+    return __real_calloc(n, size);
+}
+
+void __wrap_free(void* ptr)
+{
+    if (ptr) {
+        s_stats.frees++;
+    }
+    __real_free(ptr);
+}
+}
@@ -0,0 +1,118 @@
+// Copyright 2015-2017 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef I2C_SIM_H
+#define I2C_SIM_H
+
+/* Software model of the I2C controllers, the slaves on their bus and the
+   small part of the FreeRTOS kernel the driver waits on. A task blocking
+   on a semaphore runs the controller: it executes the command registers
+   against the attached slaves and calls the driver's interrupt handler,
+   until the semaphore is given. */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint32_t i2c_sim_reg_read(uint32_t addr);
+void i2c_sim_reg_write(uint32_t addr, uint32_t value);
+void i2c_sim_field_write(volatile uint32_t* reg, unsigned shift, unsigned width, uint32_t value);
+
+static inline uint32_t i2c_sim_field_mask(unsigned width)
+{
+    return width >= 32 ? 0xffffffff : (1u << width) - 1;
+}
+
+typedef struct {
+    size_t transfers;       /* transfers started with ctr.trans_start */
+    size_t task_starts;     /* of those, started by a task rather than chained by the interrupt handler */
+    size_t interrupts;      /* calls into the driver's interrupt handler */
+    size_t bus_bytes;       /* bytes clocked over the bus, addresses included */
+    size_t mallocs;         /* malloc and calloc calls */
+    size_t frees;           /* free calls */
+    size_t violations;      /* accesses the hardware would not honour, FreeRTOS calls from the wrong context */
+    size_t resets;          /* controllers taken through a module reset */
+} i2c_sim_stats_t;
+
+/* Detach all slaves and clear the controllers and the statistics */
+void i2c_sim_reset(void);
+const i2c_sim_stats_t* i2c_sim_stats(void);
+/* Let the bus run until all transfers in progress are done, as if the calling task slept */
+void i2c_sim_run(void);
+/* Module reset of a controller: its registers, FIFOs and transfer in progress are cleared */
+void i2c_sim_module_reset(int port);
+
+#ifdef __cplusplus
+}
+
+extern "C++" {
+
+/* A device on the simulated bus */
+class I2CSimSlave {
+public:
+    virtual ~I2CSimSlave() {}
+    /* Addressed after a (repeated) start condition */
+    virtual void start(bool read) = 0;
+    /* Byte written by the master, returns the acknowledge */
+    virtual bool write(uint8_t data) = 0;
+    /* Byte requested by the master */
+    virtual uint8_t read() = 0;
+    /* Keeps SCL low once addressed, as a hung slave does: the transfer never ends */
+    virtual bool hold_scl()
+    {
+        return false;
+    }
+};
+
+/* Register file with an auto-incrementing register pointer, the layout of most sensors */
+class I2CSimRegisterSlave : public I2CSimSlave {
+public:
+    uint8_t regs[256] = {};
+    uint8_t ptr = 0;
+    size_t reg_writes = 0;
+    size_t reg_reads = 0;
+
+    void start(bool read) override
+    {
+        m_pointer_next = !read;
+    }
+    bool write(uint8_t data) override
+    {
+        if (m_pointer_next) {
+            ptr = data;
+            m_pointer_next = false;
+        } else {
+            regs[ptr++] = data;
+            reg_writes++;
+        }
+        return true;
+    }
+    uint8_t read() override
+    {
+        reg_reads++;
+        return regs[ptr++];
+    }
+
+private:
+    bool m_pointer_next = false;
+};
+
+void i2c_sim_attach(uint8_t addr, I2CSimSlave* slave);
+
+}
+#endif
+
+#endif /* I2C_SIM_H */
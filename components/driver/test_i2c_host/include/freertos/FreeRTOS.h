@@ -0,0 +1,46 @@
+// Copyright 2015-2017 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef INC_FREERTOS_H
+#define INC_FREERTOS_H
+
+/* Host stand-in for the FreeRTOS types used by the I2C driver */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef int portMUX_TYPE;
+
+#define portBASE_TYPE               int
+#define portTickType                TickType_t
+#define pdFALSE                     ((BaseType_t) 0)
+#define pdTRUE                      ((BaseType_t) 1)
+#define pdPASS                      pdTRUE
+#define pdFAIL                      pdFALSE
+#define portMAX_DELAY               ((TickType_t) 0xffffffffUL)
+#define portTICK_PERIOD_MS          ((TickType_t) 1)
+#define portTICK_RATE_MS            portTICK_PERIOD_MS
+#define portMUX_INITIALIZER_UNLOCKED 0
+#define portENTER_CRITICAL(mux)     ((void) (mux))
+#define portEXIT_CRITICAL(mux)      ((void) (mux))
+#define portENTER_CRITICAL_ISR(mux) ((void) (mux))
+#define portEXIT_CRITICAL_ISR(mux)  ((void) (mux))
+#define portYIELD()                 ((void) 0)
+#define portYIELD_FROM_ISR()        ((void) 0)
+#define configASSERT(x)             assert(x)
+
+#endif /* INC_FREERTOS_H */
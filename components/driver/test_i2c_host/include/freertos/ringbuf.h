@@ -0,0 +1,45 @@
+// Copyright 2015-2017 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef FREERTOS_RINGBUF_H
+#define FREERTOS_RINGBUF_H
+
+#include "freertos/FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Slave mode is not simulated; ring buffers can never be created */
+typedef void* RingbufHandle_t;
+
+typedef enum {
+    RINGBUF_TYPE_NOSPLIT = 0,
+    RINGBUF_TYPE_ALLOWSPLIT,
+    RINGBUF_TYPE_BYTEBUF
+} ringbuf_type_t;
+
+RingbufHandle_t xRingbufferCreate(size_t buf_length, ringbuf_type_t type);
+void vRingbufferDelete(RingbufHandle_t ringbuf);
+BaseType_t xRingbufferSend(RingbufHandle_t ringbuf, void* data, size_t data_size, TickType_t ticks_to_wait);
+BaseType_t xRingbufferSendFromISR(RingbufHandle_t ringbuf, void* data, size_t data_size, BaseType_t* higher_prio_task_woken);
+void* xRingbufferReceiveUpTo(RingbufHandle_t ringbuf, size_t* item_size, TickType_t ticks_to_wait, size_t wanted_size);
+void* xRingbufferReceiveUpToFromISR(RingbufHandle_t ringbuf, size_t* item_size, size_t wanted_size);
+void vRingbufferReturnItem(RingbufHandle_t ringbuf, void* item);
+void vRingbufferReturnItemFromISR(RingbufHandle_t ringbuf, void* item, BaseType_t* higher_prio_task_woken);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FREERTOS_RINGBUF_H */
@@ -0,0 +1,31 @@
+// Copyright 2015-2017 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include_next "soc/i2c_reg.h"
+
+#ifndef I2C_REG_HOST_H
+#define I2C_REG_HOST_H
+
+/* Route raw register accesses of the driver to the simulated peripheral */
+#include "i2c_sim.h"
+
+#undef READ_PERI_REG
+#undef WRITE_PERI_REG
+#undef SET_PERI_REG_MASK
+#undef CLEAR_PERI_REG_MASK
+#define READ_PERI_REG(addr)              i2c_sim_reg_read(addr)
+#define WRITE_PERI_REG(addr, val)        i2c_sim_reg_write((addr), (val))
+#define SET_PERI_REG_MASK(reg, mask)     i2c_sim_reg_write((reg), i2c_sim_reg_read(reg) | (mask))
+#define CLEAR_PERI_REG_MASK(reg, mask)   i2c_sim_reg_write((reg), i2c_sim_reg_read(reg) & ~(mask))
+
+#endif /* I2C_REG_HOST_H */
@@ -0,0 +1,234 @@
+// Copyright 2015-2017 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef _SOC_I2C_STRUCT_H_
+#define _SOC_I2C_STRUCT_H_
+
+/* Host replacement for the I2C register block. The layout matches the
+   hardware, but every register the driver writes with side effects
+   (interrupt clear, transfer start, FIFO reset) is made of field proxies
+   that report the write to the simulated peripheral in i2c_sim.cpp. */
+
+#include <stdint.h>
+#include "i2c_sim.h"
+
+extern "C++" {
+
+template<unsigned SHIFT, unsigned WIDTH>
+struct i2c_sim_field_t {
+    uint32_t raw;
+
+    void operator=(uint32_t value) volatile
+    {
+        i2c_sim_field_write(&raw, SHIFT, WIDTH, value);
+    }
+    operator uint32_t() const volatile
+    {
+        return (raw >> SHIFT) & i2c_sim_field_mask(WIDTH);
+    }
+};
+
+}
+
+#define I2C_SIM_FIELD(name, shift, width)   i2c_sim_field_t<shift, width> name
+
+typedef volatile struct i2c_dev_s {
+    union {
+        struct {
+            uint32_t period:     14;
+            uint32_t reserved14: 18;
+        };
+        uint32_t val;
+    } scl_low_period;
+    union {
+        I2C_SIM_FIELD(sda_force_out, 0, 1);
+        I2C_SIM_FIELD(scl_force_out, 1, 1);
+        I2C_SIM_FIELD(sample_scl_level, 2, 1);
+        I2C_SIM_FIELD(ms_mode, 4, 1);
+        I2C_SIM_FIELD(trans_start, 5, 1);
+        I2C_SIM_FIELD(tx_lsb_first, 6, 1);
+        I2C_SIM_FIELD(rx_lsb_first, 7, 1);
+        I2C_SIM_FIELD(clk_en, 8, 1);
+        I2C_SIM_FIELD(val, 0, 32);
+    } ctr;
+    union {
+        struct {
+            uint32_t ack_rec:             1;
+            uint32_t slave_rw:            1;
+            uint32_t time_out:            1;
+            uint32_t arb_lost:            1;
+            uint32_t bus_busy:            1;
+            uint32_t slave_addressed:     1;
+            uint32_t byte_trans:          1;
+            uint32_t reserved7:           1;
+            uint32_t rx_fifo_cnt:         6;
+            uint32_t reserved14:          4;
+            uint32_t tx_fifo_cnt:         6;
+            uint32_t scl_main_state_last: 3;
+            uint32_t reserved27:          1;
+            uint32_t scl_state_last:      3;
+            uint32_t reserved31:          1;
+        };
+        uint32_t val;
+    } status_reg;
+    union {
+        struct {
+            uint32_t tout:       20;
+            uint32_t reserved20: 12;
+        };
+        uint32_t val;
+    } timeout;
+    union {
+        struct {
+            uint32_t addr:       15;
+            uint32_t reserved15: 16;
+            uint32_t en_10bit:    1;
+        };
+        uint32_t val;
+    } slave_addr;
+    uint32_t fifo_st;
+    union {
+        I2C_SIM_FIELD(rx_fifo_full_thrhd, 0, 5);
+        I2C_SIM_FIELD(tx_fifo_empty_thrhd, 5, 5);
+        I2C_SIM_FIELD(nonfifo_en, 10, 1);
+        I2C_SIM_FIELD(fifo_addr_cfg_en, 11, 1);
+        I2C_SIM_FIELD(rx_fifo_rst, 12, 1);
+        I2C_SIM_FIELD(tx_fifo_rst, 13, 1);
+        I2C_SIM_FIELD(nonfifo_rx_thres, 14, 6);
+        I2C_SIM_FIELD(nonfifo_tx_thres, 20, 6);
+        I2C_SIM_FIELD(val, 0, 32);
+    } fifo_conf;
+    union {
+        struct {
+            uint8_t data;
+            uint8_t reserved[3];
+        };
+        uint32_t val;
+    } fifo_data;
+    uint32_t int_raw;
+    union {
+        I2C_SIM_FIELD(rx_fifo_full, 0, 1);
+        I2C_SIM_FIELD(tx_fifo_empty, 1, 1);
+        I2C_SIM_FIELD(rx_fifo_ovf, 2, 1);
+        I2C_SIM_FIELD(end_detect, 3, 1);
+        I2C_SIM_FIELD(slave_tran_comp, 4, 1);
+        I2C_SIM_FIELD(arbitration_lost, 5, 1);
+        I2C_SIM_FIELD(master_tran_comp, 6, 1);
+        I2C_SIM_FIELD(trans_complete, 7, 1);
+        I2C_SIM_FIELD(time_out, 8, 1);
+        I2C_SIM_FIELD(trans_start, 9, 1);
+        I2C_SIM_FIELD(ack_err, 10, 1);
+        I2C_SIM_FIELD(rx_rec_full, 11, 1);
+        I2C_SIM_FIELD(tx_send_empty, 12, 1);
+        I2C_SIM_FIELD(val, 0, 32);
+    } int_clr;
+    union {
+        struct {
+            uint32_t rx_fifo_full:     1;
+            uint32_t tx_fifo_empty:    1;
+            uint32_t rx_fifo_ovf:      1;
+            uint32_t end_detect:       1;
+            uint32_t slave_tran_comp:  1;
+            uint32_t arbitration_lost: 1;
+            uint32_t master_tran_comp: 1;
+            uint32_t trans_complete:   1;
+            uint32_t time_out:         1;
+            uint32_t trans_start:      1;
+            uint32_t ack_err:          1;
+            uint32_t rx_rec_full:      1;
+            uint32_t tx_send_empty:    1;
+            uint32_t reserved13:      19;
+        };
+        uint32_t val;
+    } int_ena;
+    union {
+        uint32_t val;
+    } int_status;
+    union {
+        struct {
+            uint32_t time:       10;
+            uint32_t reserved10: 22;
+        };
+        uint32_t val;
+    } sda_hold;
+    union {
+        struct {
+            uint32_t time:       10;
+            uint32_t reserved10: 22;
+        };
+        uint32_t val;
+    } sda_sample;
+    union {
+        struct {
+            uint32_t period:     14;
+            uint32_t reserved14: 18;
+        };
+        uint32_t val;
+    } scl_high_period;
+    uint32_t reserved_3c;
+    union {
+        struct {
+            uint32_t time:       10;
+            uint32_t reserved10: 22;
+        };
+        uint32_t val;
+    } scl_start_hold;
+    union {
+        struct {
+            uint32_t time:       10;
+            uint32_t reserved10: 22;
+        };
+        uint32_t val;
+    } scl_rstart_setup;
+    union {
+        struct {
+            uint32_t time:       14;
+            uint32_t reserved14: 18;
+        };
+        uint32_t val;
+    } scl_stop_hold;
+    union {
+        struct {
+            uint32_t time:       10;
+            uint32_t reserved10: 22;
+        };
+        uint32_t val;
+    } scl_stop_setup;
+    union {
+        uint32_t val;
+    } scl_filter_cfg;
+    union {
+        uint32_t val;
+    } sda_filter_cfg;
+    union {
+        struct {
+            uint32_t byte_num:    8;
+            uint32_t ack_en:      1;
+            uint32_t ack_exp:     1;
+            uint32_t ack_val:     1;
+            uint32_t op_code:     3;
+            uint32_t reserved14: 17;
+            uint32_t done:        1;
+        };
+        uint32_t val;
+    } command[16];
+    uint32_t reserved_98[24];
+    uint32_t date;
+    uint32_t reserved_fc;
+    uint32_t ram_data[32];
+} i2c_dev_t;
+
+extern i2c_dev_t I2C0;
+extern i2c_dev_t I2C1;
+
+#endif /* _SOC_I2C_STRUCT_H_ */
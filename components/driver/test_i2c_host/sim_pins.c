@@ -0,0 +1,56 @@
+// Copyright 2015-2017 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/* Clock and pin setup of the driver has no effect on the simulated bus,
+   apart from the module reset that clears a controller */
+
+#include "driver/gpio.h"
+#include "driver/periph_ctrl.h"
+#include "i2c_sim.h"
+
+const uint32_t GPIO_PIN_MUX_REG[GPIO_PIN_COUNT] = { 0 };
+
+void periph_module_enable(periph_module_t periph)
+{
+}
+
+void periph_module_disable(periph_module_t periph)
+{
+    if (periph == PERIPH_I2C0_MODULE || periph == PERIPH_I2C1_MODULE) {
+        i2c_sim_module_reset(periph == PERIPH_I2C1_MODULE);
+    }
+}
+
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level)
+{
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_direction(gpio_num_t gpio_num, gpio_mode_t mode)
+{
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_pull_mode(gpio_num_t gpio_num, gpio_pull_mode_t pull)
+{
+    return ESP_OK;
+}
+
+void gpio_matrix_in(uint32_t gpio, uint32_t signal_idx, bool inv)
+{
+}
+
+void gpio_matrix_out(uint32_t gpio, uint32_t signal_idx, bool out_inv, bool oen_inv)
+{
+}
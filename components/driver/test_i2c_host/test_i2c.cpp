@@ -0,0 +1,522 @@
+// Copyright 2015-2017 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "catch.hpp"
+#include "i2c_sim.h"
+#include "driver/i2c.h"
+#include "soc/i2c_struct.h"
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+#define SENSOR_ADDR  0x19
+#define SENSOR_OUT   0x28
+
+/* A master port with a register-file sensor on its bus */
+struct I2CBus {
+    I2CSimRegisterSlave sensor;
+
+    I2CBus()
+    {
+        i2c_sim_reset();
+        i2c_sim_attach(SENSOR_ADDR, &sensor);
+        for (int i = 0; i < 256; ++i) {
+            sensor.regs[i] = i * 7 + 3;
+        }
+        REQUIRE(i2c_driver_install(I2C_NUM_0, I2C_MODE_MASTER, 0, 0, 0) == ESP_OK);
+    }
+    ~I2CBus()
+    {
+        i2c_driver_delete(I2C_NUM_0);
+    }
+    const i2c_sim_stats_t& stats() const
+    {
+        return *i2c_sim_stats();
+    }
+};
+
+/* The way task code builds a register read today: a fresh heap link per transaction */
+static esp_err_t readRegisterHeap(uint8_t addr, uint8_t reg, uint8_t* data, size_t len)
+{
+    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+    i2c_master_start(cmd);
+    i2c_master_write_byte(cmd, (addr << 1) | I2C_MASTER_WRITE, true);
+    i2c_master_write_byte(cmd, reg, true);
+    i2c_master_start(cmd);
+    i2c_master_write_byte(cmd, (addr << 1) | I2C_MASTER_READ, true);
+    if (len > 1) {
+        i2c_master_read(cmd, data, len - 1, 0);
+    }
+    i2c_master_read_byte(cmd, data + len - 1, 1);
+    i2c_master_stop(cmd);
+    esp_err_t ret = i2c_master_cmd_begin(I2C_NUM_0, cmd, 1000 / portTICK_RATE_MS);
+    i2c_cmd_link_delete(cmd);
+    return ret;
+}
+
+TEST_CASE("register read template can be sent again and again", "[i2c][static]")
+{
+    I2CBus bus;
+    uint8_t buffer[I2C_CMD_LINK_STATIC_SIZE(I2C_READ_REG_CMD_NUM)];
+    uint8_t data[6];
+    i2c_cmd_handle_t cmd = i2c_cmd_link_create_static(buffer, sizeof(buffer));
+    REQUIRE(cmd != NULL);
+    REQUIRE(i2c_master_read_reg(cmd, SENSOR_ADDR, SENSOR_OUT, data, sizeof(data)) == ESP_OK);
+
+    for (int round = 0; round < 100; ++round) {
+        for (int i = 0; i < 6; ++i) {
+            bus.sensor.regs[SENSOR_OUT + i] = round * 11 + i;
+        }
+        memset(data, 0, sizeof(data));
+        REQUIRE(i2c_master_cmd_begin(I2C_NUM_0, cmd, 1000 / portTICK_RATE_MS) == ESP_OK);
+        for (int i = 0; i < 6; ++i) {
+            CHECK(data[i] == uint8_t(round * 11 + i));
+        }
+    }
+    CHECK(bus.sensor.reg_reads == 600);
+    CHECK(bus.stats().violations == 0);
+    i2c_cmd_link_delete_static(cmd);
+}
+
+TEST_CASE("static command links do not touch the heap", "[i2c][static]")
+{
+    I2CBus bus;
+    uint8_t heapData[6], staticData[6];
+
+    size_t mallocs = bus.stats().mallocs;
+    REQUIRE(readRegisterHeap(SENSOR_ADDR, SENSOR_OUT, heapData, sizeof(heapData)) == ESP_OK);
+    size_t heapMallocs = bus.stats().mallocs - mallocs;
+
+    mallocs = bus.stats().mallocs;
+    size_t frees = bus.stats().frees;
+    uint8_t buffer[I2C_CMD_LINK_STATIC_SIZE(I2C_READ_REG_CMD_NUM)];
+    i2c_cmd_handle_t cmd = i2c_cmd_link_create_static(buffer, sizeof(buffer));
+    REQUIRE(i2c_master_read_reg(cmd, SENSOR_ADDR, SENSOR_OUT, staticData, sizeof(staticData)) == ESP_OK);
+    REQUIRE(i2c_master_cmd_begin(I2C_NUM_0, cmd, 1000 / portTICK_RATE_MS) == ESP_OK);
+    i2c_cmd_link_delete(cmd);
+
+    CHECK(heapMallocs == 1 + I2C_READ_REG_CMD_NUM);
+    CHECK(bus.stats().mallocs == mallocs);
+    CHECK(bus.stats().frees == frees);
+    CHECK(memcmp(heapData, staticData, sizeof(heapData)) == 0);
+    CHECK(bus.stats().violations == 0);
+}
+
+TEST_CASE("long transfers through a static link span several FIFO fills", "[i2c][static]")
+{
+    I2CBus bus;
+    vector<uint8_t> out(200), in(200);
+    for (size_t i = 0; i < out.size(); ++i) {
+        out[i] = i ^ 0x5a;
+    }
+
+    uint8_t buffer[I2C_CMD_LINK_STATIC_SIZE(8)];
+    i2c_cmd_handle_t cmd = i2c_cmd_link_create_static(buffer, sizeof(buffer));
+    REQUIRE(i2c_master_start(cmd) == ESP_OK);
+    REQUIRE(i2c_master_write_byte(cmd, (SENSOR_ADDR << 1) | I2C_MASTER_WRITE, true) == ESP_OK);
+    REQUIRE(i2c_master_write_byte(cmd, 0x10, true) == ESP_OK);
+    REQUIRE(i2c_master_write(cmd, out.data(), out.size(), true) == ESP_OK);
+    REQUIRE(i2c_master_stop(cmd) == ESP_OK);
+    REQUIRE(i2c_master_cmd_begin(I2C_NUM_0, cmd, 1000 / portTICK_RATE_MS) == ESP_OK);
+    CHECK(memcmp(bus.sensor.regs + 0x10, out.data(), out.size()) == 0);
+
+    /* the same buffer holds the read back once the write link is released */
+    i2c_cmd_link_delete_static(cmd);
+    cmd = i2c_cmd_link_create_static(buffer, sizeof(buffer));
+    REQUIRE(i2c_master_read_reg(cmd, SENSOR_ADDR, 0x10, in.data(), in.size()) == ESP_OK);
+    REQUIRE(i2c_master_cmd_begin(I2C_NUM_0, cmd, 1000 / portTICK_RATE_MS) == ESP_OK);
+    CHECK(in == out);
+
+    /* and again, the link still describes the whole transfer */
+    fill(in.begin(), in.end(), 0);
+    REQUIRE(i2c_master_cmd_begin(I2C_NUM_0, cmd, 1000 / portTICK_RATE_MS) == ESP_OK);
+    CHECK(in == out);
+    CHECK(bus.stats().violations == 0);
+    i2c_cmd_link_delete_static(cmd);
+}
+
+TEST_CASE("static link buffer size is checked", "[i2c][static]")
+{
+    I2CBus bus;
+    uint8_t data[4];
+    alignas(void*) uint8_t buffer[I2C_CMD_LINK_STATIC_SIZE(I2C_READ_REG_CMD_NUM) + sizeof(void*)];
+
+    CHECK(i2c_cmd_link_create_static(NULL, sizeof(buffer)) == NULL);
+    CHECK(i2c_cmd_link_create_static(buffer, I2C_CMD_LINK_ITEM_SIZE) == NULL);
+
+    /* any alignment of the buffer holds the commands it was sized for */
+    for (size_t offset = 0; offset < sizeof(void*); ++offset) {
+        i2c_cmd_handle_t cmd = i2c_cmd_link_create_static(buffer + offset, I2C_CMD_LINK_STATIC_SIZE(I2C_READ_REG_CMD_NUM));
+        REQUIRE(cmd != NULL);
+        CHECK(i2c_master_read_reg(cmd, SENSOR_ADDR, SENSOR_OUT, data, sizeof(data)) == ESP_OK);
+        CHECK(i2c_master_cmd_begin(I2C_NUM_0, cmd, 1000 / portTICK_RATE_MS) == ESP_OK);
+        i2c_cmd_link_delete_static(cmd);
+    }
+
+    /* a full link refuses further commands but still sends the ones it holds */
+    i2c_cmd_handle_t cmd = i2c_cmd_link_create_static(buffer, I2C_CMD_LINK_STATIC_SIZE(3));
+    REQUIRE(cmd != NULL);
+    CHECK(i2c_master_start(cmd) == ESP_OK);
+    CHECK(i2c_master_write_byte(cmd, (SENSOR_ADDR << 1) | I2C_MASTER_WRITE, true) == ESP_OK);
+    int queued = 2;
+    esp_err_t ret;
+    while ((ret = i2c_master_write_byte(cmd, 0x42, true)) == ESP_OK) {
+        queued++;
+    }
+    CHECK(ret == ESP_ERR_NO_MEM);
+    CHECK(queued >= 3);
+    CHECK(i2c_master_stop(cmd) == ESP_ERR_NO_MEM);
+    CHECK(i2c_master_cmd_begin(I2C_NUM_0, cmd, 1000 / portTICK_RATE_MS) == ESP_OK);
+    CHECK(bus.sensor.reg_writes == size_t(queued - 3));
+    i2c_cmd_link_delete_static(cmd);
+
+    cmd = i2c_cmd_link_create_static(buffer, I2C_CMD_LINK_STATIC_SIZE(2));
+    CHECK(i2c_master_read_reg(cmd, SENSOR_ADDR, SENSOR_OUT, data, sizeof(data)) == ESP_ERR_NO_MEM);
+    CHECK(i2c_master_read_reg(cmd, SENSOR_ADDR, SENSOR_OUT, data, 0) == ESP_ERR_INVALID_ARG);
+    i2c_cmd_link_delete_static(cmd);
+}
+
+TEST_CASE("a link is reusable after the slave does not acknowledge", "[i2c][static]")
+{
+    I2CBus bus;
+    uint8_t good[3], bad[3];
+    uint8_t goodBuffer[I2C_CMD_LINK_STATIC_SIZE(I2C_READ_REG_CMD_NUM)];
+    uint8_t badBuffer[I2C_CMD_LINK_STATIC_SIZE(I2C_READ_REG_CMD_NUM)];
+    i2c_cmd_handle_t goodCmd = i2c_cmd_link_create_static(goodBuffer, sizeof(goodBuffer));
+    i2c_cmd_handle_t badCmd = i2c_cmd_link_create_static(badBuffer, sizeof(badBuffer));
+    REQUIRE(i2c_master_read_reg(goodCmd, SENSOR_ADDR, SENSOR_OUT, good, sizeof(good)) == ESP_OK);
+    REQUIRE(i2c_master_read_reg(badCmd, SENSOR_ADDR + 1, SENSOR_OUT, bad, sizeof(bad)) == ESP_OK);
+
+    for (int round = 0; round < 3; ++round) {
+        CHECK(i2c_master_cmd_begin(I2C_NUM_0, badCmd, 1000 / portTICK_RATE_MS) == ESP_FAIL);
+        memset(good, 0, sizeof(good));
+        CHECK(i2c_master_cmd_begin(I2C_NUM_0, goodCmd, 1000 / portTICK_RATE_MS) == ESP_OK);
+        CHECK(good[0] == bus.sensor.regs[SENSOR_OUT]);
+        CHECK(good[2] == bus.sensor.regs[SENSOR_OUT + 2]);
+    }
+    CHECK(bus.stats().violations == 0);
+}
+
+/* A register read prepared once and queued as often as needed */
+struct QueuedRead {
+    uint8_t buffer[I2C_CMD_LINK_STATIC_SIZE(I2C_READ_REG_CMD_NUM)];
+    uint8_t data[6];
+    uint8_t reg;
+    i2c_trans_t trans;
+
+    QueuedRead(uint8_t addr, uint8_t reg, i2c_trans_cb_t done_cb = NULL) : reg(reg)
+    {
+        memset(&trans, 0, sizeof(trans));
+        trans.cmd = i2c_cmd_link_create_static(buffer, sizeof(buffer));
+        trans.done_cb = done_cb;
+        trans.user = this;
+        REQUIRE(i2c_master_read_reg(trans.cmd, addr, reg, data, sizeof(data)) == ESP_OK);
+    }
+    ~QueuedRead()
+    {
+        i2c_cmd_link_delete_static(trans.cmd);
+    }
+};
+
+TEST_CASE("queued transactions complete in order", "[i2c][queue]")
+{
+    I2CBus bus;
+    REQUIRE(i2c_master_queue_init(I2C_NUM_0, 4) == ESP_OK);
+    QueuedRead r0(SENSOR_ADDR, 0x00), r1(SENSOR_ADDR, 0x10), r2(SENSOR_ADDR, 0x20), r3(SENSOR_ADDR, 0x30);
+    QueuedRead* reads[] = { &r0, &r1, &r2, &r3 };
+
+    size_t starts = bus.stats().task_starts;
+    for (QueuedRead* r : reads) {
+        REQUIRE(i2c_master_queue_trans(I2C_NUM_0, &r->trans, 0) == ESP_OK);
+    }
+    for (QueuedRead* r : reads) {
+        i2c_trans_t* done = NULL;
+        REQUIRE(i2c_master_get_trans_result(I2C_NUM_0, &done, 1000 / portTICK_RATE_MS) == ESP_OK);
+        CHECK(done == &r->trans);
+        CHECK(done->result == ESP_OK);
+        CHECK(memcmp(r->data, bus.sensor.regs + r->reg, sizeof(r->data)) == 0);
+    }
+    /* one start by the task, the interrupt handler chained the other three */
+    CHECK(bus.stats().task_starts - starts == 1);
+    i2c_trans_t* none;
+    CHECK(i2c_master_get_trans_result(I2C_NUM_0, &none, 1) == ESP_ERR_TIMEOUT);
+    CHECK(bus.stats().violations == 0);
+}
+
+static void countDone(i2c_trans_t* trans)
+{
+    (*static_cast<int*>(trans->user))++;
+}
+
+TEST_CASE("completion callbacks run instead of the result queue", "[i2c][queue]")
+{
+    I2CBus bus;
+    REQUIRE(i2c_master_queue_init(I2C_NUM_0, 2) == ESP_OK);
+    int done = 0;
+    QueuedRead good(SENSOR_ADDR, SENSOR_OUT, countDone), bad(SENSOR_ADDR + 1, SENSOR_OUT);
+    good.trans.user = &done;
+
+    for (int round = 0; round < 10; ++round) {
+        REQUIRE(i2c_master_queue_trans(I2C_NUM_0, &good.trans, 0) == ESP_OK);
+        REQUIRE(i2c_master_queue_trans(I2C_NUM_0, &bad.trans, 0) == ESP_OK);
+        i2c_sim_run();
+        CHECK(done == round + 1);
+        CHECK(good.trans.result == ESP_OK);
+
+        /* a missing acknowledge fails that transaction only */
+        i2c_trans_t* result = NULL;
+        REQUIRE(i2c_master_get_trans_result(I2C_NUM_0, &result, 0) == ESP_OK);
+        CHECK(result == &bad.trans);
+        CHECK(result->result == ESP_FAIL);
+    }
+    CHECK(memcmp(good.data, bus.sensor.regs + SENSOR_OUT, sizeof(good.data)) == 0);
+    CHECK(bus.stats().violations == 0);
+}
+
+TEST_CASE("i2c_master_cmd_begin takes turns with queued transactions", "[i2c][queue]")
+{
+    I2CBus bus;
+    REQUIRE(i2c_master_queue_init(I2C_NUM_0, 4) == ESP_OK);
+    QueuedRead r0(SENSOR_ADDR, 0x00), r1(SENSOR_ADDR, 0x10), r2(SENSOR_ADDR, 0x20);
+    QueuedRead sync(SENSOR_ADDR, SENSOR_OUT);
+
+    REQUIRE(i2c_master_queue_trans(I2C_NUM_0, &r0.trans, 0) == ESP_OK);
+    REQUIRE(i2c_master_queue_trans(I2C_NUM_0, &r1.trans, 0) == ESP_OK);
+    REQUIRE(i2c_master_queue_trans(I2C_NUM_0, &r2.trans, 0) == ESP_OK);
+
+    /* the synchronous read goes after the transaction on the bus, ahead of the queued ones */
+    size_t reads = bus.sensor.reg_reads;
+    REQUIRE(i2c_master_cmd_begin(I2C_NUM_0, sync.trans.cmd, 1000 / portTICK_RATE_MS) == ESP_OK);
+    CHECK(bus.sensor.reg_reads - reads == 12);
+    CHECK(memcmp(sync.data, bus.sensor.regs + SENSOR_OUT, sizeof(sync.data)) == 0);
+
+    /* and the queue carries on afterwards */
+    i2c_trans_t* done[3];
+    for (int i = 0; i < 3; ++i) {
+        REQUIRE(i2c_master_get_trans_result(I2C_NUM_0, &done[i], 1000 / portTICK_RATE_MS) == ESP_OK);
+        CHECK(done[i]->result == ESP_OK);
+    }
+    CHECK(done[0] == &r0.trans);
+    CHECK(done[1] == &r1.trans);
+    CHECK(done[2] == &r2.trans);
+    CHECK(memcmp(r2.data, bus.sensor.regs + 0x20, sizeof(r2.data)) == 0);
+    CHECK(bus.stats().violations == 0);
+}
+
+TEST_CASE("transaction queue arguments are checked", "[i2c][queue]")
+{
+    I2CBus bus;
+    QueuedRead r0(SENSOR_ADDR, SENSOR_OUT);
+    i2c_trans_t* result;
+    CHECK(i2c_master_queue_trans(I2C_NUM_0, &r0.trans, 0) == ESP_ERR_INVALID_STATE);
+    CHECK(i2c_master_get_trans_result(I2C_NUM_0, &result, 0) == ESP_ERR_INVALID_STATE);
+    CHECK(i2c_master_queue_init(I2C_NUM_0, 0) == ESP_ERR_INVALID_ARG);
+    CHECK(i2c_master_queue_init(I2C_NUM_1, 4) == ESP_ERR_INVALID_STATE);
+    REQUIRE(i2c_master_queue_init(I2C_NUM_0, 1) == ESP_OK);
+    CHECK(i2c_master_queue_init(I2C_NUM_0, 1) == ESP_ERR_INVALID_STATE);
+    CHECK(i2c_master_queue_trans(I2C_NUM_0, NULL, 0) == ESP_ERR_INVALID_ARG);
+
+    /* one transaction on the bus, one waiting: the next one does not fit */
+    QueuedRead r1(SENSOR_ADDR, SENSOR_OUT), r2(SENSOR_ADDR, SENSOR_OUT);
+    REQUIRE(i2c_master_queue_trans(I2C_NUM_0, &r0.trans, 0) == ESP_OK);
+    REQUIRE(i2c_master_queue_trans(I2C_NUM_0, &r1.trans, 0) == ESP_OK);
+    CHECK(bus.stats().task_starts == 1);
+    /* waiting for room lets the bus make progress */
+    CHECK(i2c_master_queue_trans(I2C_NUM_0, &r2.trans, 1000 / portTICK_RATE_MS) == ESP_OK);
+    for (int i = 0; i < 3; ++i) {
+        REQUIRE(i2c_master_get_trans_result(I2C_NUM_0, &result, 1000 / portTICK_RATE_MS) == ESP_OK);
+    }
+    CHECK(result == &r2.trans);
+    CHECK(bus.stats().violations == 0);
+}
+
+/* A slave that keeps SCL low once addressed */
+struct HungSlave : public I2CSimSlave {
+    bool silent;    /* the controller's timeout interrupt never comes either */
+
+    HungSlave(bool silent = false) : silent(silent) {}
+    void start(bool read) override
+    {
+        if (silent) {
+            I2C0.int_ena.time_out = 0;
+        }
+    }
+    bool write(uint8_t data) override
+    {
+        return true;
+    }
+    uint8_t read() override
+    {
+        return 0xff;
+    }
+    bool hold_scl() override
+    {
+        return true;
+    }
+};
+
+TEST_CASE("a slave holding SCL fails its transaction only", "[i2c][queue]")
+{
+    I2CBus bus;
+    HungSlave hung;
+    i2c_sim_attach(SENSOR_ADDR + 2, &hung);
+    REQUIRE(i2c_master_queue_init(I2C_NUM_0, 4) == ESP_OK);
+    QueuedRead r0(SENSOR_ADDR, 0x00), stuck(SENSOR_ADDR + 2, SENSOR_OUT), r1(SENSOR_ADDR, 0x10);
+
+    REQUIRE(i2c_master_queue_trans(I2C_NUM_0, &r0.trans, 0) == ESP_OK);
+    REQUIRE(i2c_master_queue_trans(I2C_NUM_0, &stuck.trans, 0) == ESP_OK);
+    REQUIRE(i2c_master_queue_trans(I2C_NUM_0, &r1.trans, 0) == ESP_OK);
+    i2c_trans_t* done[3];
+    for (int i = 0; i < 3; ++i) {
+        REQUIRE(i2c_master_get_trans_result(I2C_NUM_0, &done[i], 1000 / portTICK_RATE_MS) == ESP_OK);
+    }
+    CHECK(done[0]->result == ESP_OK);
+    CHECK(done[1] == &stuck.trans);
+    CHECK(done[1]->result == ESP_ERR_TIMEOUT);
+    CHECK(done[2] == &r1.trans);
+    CHECK(done[2]->result == ESP_OK);
+    CHECK(memcmp(r1.data, bus.sensor.regs + 0x10, sizeof(r1.data)) == 0);
+    CHECK(bus.stats().resets == 1);
+
+    /* the same for i2c_master_cmd_begin() */
+    CHECK(i2c_master_cmd_begin(I2C_NUM_0, stuck.trans.cmd, 1000 / portTICK_RATE_MS) == ESP_ERR_TIMEOUT);
+    CHECK(i2c_master_cmd_begin(I2C_NUM_0, r0.trans.cmd, 1000 / portTICK_RATE_MS) == ESP_OK);
+    CHECK(bus.stats().resets == 2);
+    CHECK(bus.stats().violations == 0);
+}
+
+TEST_CASE("a transaction stalled without any interrupt fails at its deadline", "[i2c][queue]")
+{
+    I2CBus bus;
+    HungSlave hung(true);
+    i2c_sim_attach(SENSOR_ADDR + 2, &hung);
+    REQUIRE(i2c_master_queue_init(I2C_NUM_0, 4) == ESP_OK);
+    QueuedRead stuck(SENSOR_ADDR + 2, SENSOR_OUT), r0(SENSOR_ADDR, 0x00), sync(SENSOR_ADDR, SENSOR_OUT);
+    stuck.trans.timeout = 5;
+
+    TickType_t start = xTaskGetTickCount();
+    REQUIRE(i2c_master_queue_trans(I2C_NUM_0, &stuck.trans, 0) == ESP_OK);
+    REQUIRE(i2c_master_queue_trans(I2C_NUM_0, &r0.trans, 0) == ESP_OK);
+    i2c_trans_t* result = NULL;
+    REQUIRE(i2c_master_get_trans_result(I2C_NUM_0, &result, 1000 / portTICK_RATE_MS) == ESP_OK);
+    CHECK(result == &stuck.trans);
+    CHECK(result->result == ESP_ERR_TIMEOUT);
+    CHECK(xTaskGetTickCount() - start == 5);
+    /* the next one was chained after the reset, and runs once the task waits */
+    REQUIRE(i2c_master_get_trans_result(I2C_NUM_0, &result, 1000 / portTICK_RATE_MS) == ESP_OK);
+    CHECK(result == &r0.trans);
+    CHECK(result->result == ESP_OK);
+
+    /* a synchronous command waiting for the bus fails the stalled transaction too */
+    start = xTaskGetTickCount();
+    REQUIRE(i2c_master_queue_trans(I2C_NUM_0, &stuck.trans, 0) == ESP_OK);
+    CHECK(i2c_master_cmd_begin(I2C_NUM_0, sync.trans.cmd, 1000 / portTICK_RATE_MS) == ESP_OK);
+    CHECK(xTaskGetTickCount() - start == 5);
+    CHECK(memcmp(sync.data, bus.sensor.regs + SENSOR_OUT, sizeof(sync.data)) == 0);
+    REQUIRE(i2c_master_get_trans_result(I2C_NUM_0, &result, 0) == ESP_OK);
+    CHECK(result->result == ESP_ERR_TIMEOUT);
+
+    /* a shorter wait than the deadline times out, and leaves the transaction to a later one */
+    REQUIRE(i2c_master_queue_trans(I2C_NUM_0, &stuck.trans, 0) == ESP_OK);
+    CHECK(i2c_master_get_trans_result(I2C_NUM_0, &result, 2) == ESP_ERR_TIMEOUT);
+    REQUIRE(i2c_master_get_trans_result(I2C_NUM_0, &result, portMAX_DELAY) == ESP_OK);
+    CHECK(result->result == ESP_ERR_TIMEOUT);
+    CHECK(bus.stats().resets == 3);
+    CHECK(bus.stats().violations == 0);
+}
+
+template<typename F>
+static double timeUs(int iterations, F fn)
+{
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        fn();
+    }
+    auto end = chrono::steady_clock::now();
+    return chrono::duration<double, micro>(end - start).count() / iterations;
+}
+
+TEST_CASE("accelerometer sample read benchmark", "[i2c][bench]")
+{
+    const int iterations = 20000;
+    I2CBus bus;
+    uint8_t data[6];
+    size_t ok = 0;
+
+    size_t mallocs = bus.stats().mallocs;
+    double heapUs = timeUs(iterations, [&]() {
+        ok += readRegisterHeap(SENSOR_ADDR, SENSOR_OUT, data, sizeof(data)) == ESP_OK;
+    });
+    double heapMallocs = double(bus.stats().mallocs - mallocs) / iterations;
+
+    uint8_t buffer[I2C_CMD_LINK_STATIC_SIZE(I2C_READ_REG_CMD_NUM)];
+    i2c_cmd_handle_t cmd = i2c_cmd_link_create_static(buffer, sizeof(buffer));
+    i2c_master_read_reg(cmd, SENSOR_ADDR, SENSOR_OUT, data, sizeof(data));
+    mallocs = bus.stats().mallocs;
+    double staticUs = timeUs(iterations, [&]() {
+        ok += i2c_master_cmd_begin(I2C_NUM_0, cmd, 1000 / portTICK_RATE_MS) == ESP_OK;
+    });
+    double staticMallocs = double(bus.stats().mallocs - mallocs) / iterations;
+
+    CHECK(ok == 2 * iterations);
+    CHECK(staticMallocs == 0);
+    cout << "6-byte register read, " << iterations << " transactions on the simulated bus" << endl;
+    cout << "  heap command link per read:  " << heapUs << " us, " << heapMallocs << " mallocs" << endl;
+    cout << "  static register read template: " << staticUs << " us, " << staticMallocs << " mallocs" << endl;
+}
+
+TEST_CASE("queued versus synchronous sample read benchmark", "[i2c][bench]")
+{
+    const int iterations = 20000;
+    const int depth = 8;
+    I2CBus bus;
+    REQUIRE(i2c_master_queue_init(I2C_NUM_0, depth) == ESP_OK);
+    vector<QueuedRead*> reads;
+    for (int i = 0; i < depth; ++i) {
+        reads.push_back(new QueuedRead(SENSOR_ADDR, SENSOR_OUT));
+    }
+    size_t ok = 0;
+
+    size_t starts = bus.stats().task_starts;
+    double syncUs = timeUs(iterations, [&]() {
+        ok += i2c_master_cmd_begin(I2C_NUM_0, reads[0]->trans.cmd, 1000 / portTICK_RATE_MS) == ESP_OK;
+    });
+    double syncStarts = double(bus.stats().task_starts - starts) / iterations;
+
+    /* keep the queue full: each result handed back is queued again */
+    starts = bus.stats().task_starts;
+    for (QueuedRead* r : reads) {
+        i2c_master_queue_trans(I2C_NUM_0, &r->trans, 0);
+    }
+    double queuedUs = timeUs(iterations, [&]() {
+        i2c_trans_t* done;
+        i2c_master_get_trans_result(I2C_NUM_0, &done, 1000 / portTICK_RATE_MS);
+        ok += done->result == ESP_OK;
+        i2c_master_queue_trans(I2C_NUM_0, done, 0);
+    });
+    double queuedStarts = double(bus.stats().task_starts - starts) / iterations;
+    i2c_sim_run();
+
+    CHECK(ok == 2 * iterations);
+    CHECK(queuedStarts < syncStarts);
+    CHECK(bus.stats().violations == 0);
+    cout << "6-byte register read, " << iterations << " transactions, " << depth << " queued" << endl;
+    cout << "  i2c_master_cmd_begin:   " << syncUs << " us, " << syncStarts << " task-started transfers per read" << endl;
+    cout << "  i2c_master_queue_trans: " << queuedUs << " us, " << queuedStarts << " task-started transfers per read" << endl;
+    for (QueuedRead* r : reads) {
+        delete r;
+    }
+}
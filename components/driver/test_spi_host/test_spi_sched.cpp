@@ -0,0 +1,260 @@
+// Copyright 2015-2017 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "catch.hpp"
+#include "spi_master_sched.h"
+#include <algorithm>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+#define NO_CS 3
+
+TEST_CASE("an empty bus has nothing to pick", "[spi][sched]")
+{
+    spi_sched_slot_t slot[NO_CS] = {};
+    CHECK(spi_sched_pick(SPI_SCHED_LOW_CS_FIRST, slot, NO_CS, -1, 0) == -1);
+    CHECK(spi_sched_pick(SPI_SCHED_ROUND_ROBIN, slot, NO_CS, 1, 0) == -1);
+    CHECK(spi_sched_pick(SPI_SCHED_DEADLINE, slot, NO_CS, 2, 0) == -1);
+}
+
+TEST_CASE("priority wins over every policy", "[spi][sched]")
+{
+    spi_sched_slot_t slot[NO_CS] = {};
+    slot[0] = { true, 0, 0, 10 };
+    slot[1] = { true, 0, 0, 10 };
+    slot[2] = { true, 1, 100, 1000 };
+    for (int last = -1; last < NO_CS; ++last) {
+        CHECK(spi_sched_pick(SPI_SCHED_LOW_CS_FIRST, slot, NO_CS, last, 50) == 2);
+        CHECK(spi_sched_pick(SPI_SCHED_ROUND_ROBIN, slot, NO_CS, last, 50) == 2);
+        CHECK(spi_sched_pick(SPI_SCHED_DEADLINE, slot, NO_CS, last, 50) == 2);
+    }
+}
+
+TEST_CASE("low-cs-first keeps the old behaviour", "[spi][sched]")
+{
+    spi_sched_slot_t slot[NO_CS] = {};
+    slot[1] = { true, 0, 0, 0 };
+    slot[2] = { true, 0, 0, 0 };
+    CHECK(spi_sched_pick(SPI_SCHED_LOW_CS_FIRST, slot, NO_CS, 1, 0) == 1);
+    slot[0].pending = true;
+    CHECK(spi_sched_pick(SPI_SCHED_LOW_CS_FIRST, slot, NO_CS, 0, 0) == 0);
+}
+
+TEST_CASE("round-robin continues after the device sent last", "[spi][sched]")
+{
+    spi_sched_slot_t slot[NO_CS] = {};
+    for (auto& s : slot) {
+        s.pending = true;
+    }
+    CHECK(spi_sched_pick(SPI_SCHED_ROUND_ROBIN, slot, NO_CS, -1, 0) == 0);
+    CHECK(spi_sched_pick(SPI_SCHED_ROUND_ROBIN, slot, NO_CS, 0, 0) == 1);
+    CHECK(spi_sched_pick(SPI_SCHED_ROUND_ROBIN, slot, NO_CS, 1, 0) == 2);
+    CHECK(spi_sched_pick(SPI_SCHED_ROUND_ROBIN, slot, NO_CS, 2, 0) == 0);
+    slot[0].pending = false;
+    CHECK(spi_sched_pick(SPI_SCHED_ROUND_ROBIN, slot, NO_CS, 2, 0) == 1);
+    CHECK(spi_sched_pick(SPI_SCHED_ROUND_ROBIN, slot, NO_CS, 1, 0) == 2);
+}
+
+TEST_CASE("deadline picks the least slack across counter wrap-around", "[spi][sched]")
+{
+    spi_sched_slot_t slot[NO_CS] = {};
+    /* due at 0xfffffff0 + 0x100 = 0xf0 (wrapped) */
+    slot[0] = { true, 0, 0xfffffff0u, 0x100 };
+    /* due at 0x80 + 0x100 = 0x180 */
+    slot[1] = { true, 0, 0x80, 0x100 };
+    CHECK(spi_sched_pick(SPI_SCHED_DEADLINE, slot, NO_CS, 0, 0x90) == 0);
+    /* both late, the one furthest past its deadline goes first */
+    CHECK(spi_sched_pick(SPI_SCHED_DEADLINE, slot, NO_CS, 0, 0x1000) == 0);
+    slot[0].deadline = 0x1000;
+    CHECK(spi_sched_pick(SPI_SCHED_DEADLINE, slot, NO_CS, 0, 0x90) == 1);
+}
+
+/*
+ Bus simulation: synthetic devices queue transactions with a fixed period (0 keeps the queue full) and
+ occupy the bus for a fixed time each. Like the interrupt handler, the dispatcher only looks at the oldest
+ transaction of every device and a transfer is never interrupted. Times are in us.
+*/
+struct SimDevice {
+    const char* name;
+    uint8_t priority;
+    uint32_t deadline;
+    uint32_t period;
+    uint32_t duration;
+    size_t queue_size;
+
+    deque<uint32_t> queue;
+    uint32_t next_arrival;
+    size_t sent;
+    size_t dropped;
+    size_t misses;
+    uint64_t total_latency;
+    uint32_t max_latency;
+    uint64_t bus_time;
+
+    SimDevice(const char* name, uint8_t priority, uint32_t deadline, uint32_t period, uint32_t duration)
+        : name(name), priority(priority), deadline(deadline), period(period), duration(duration), queue_size(3),
+          next_arrival(0), sent(0), dropped(0), misses(0), total_latency(0), max_latency(0), bus_time(0)
+    {
+    }
+};
+
+static void simulate(spi_sched_policy_t policy, vector<SimDevice>& devs, uint32_t start, uint32_t runtime)
+{
+    uint32_t now = start;
+    int last = -1;
+    for (auto& d : devs) {
+        d.next_arrival = start;
+    }
+    while (now - start < runtime) {
+        spi_sched_slot_t slot[NO_CS] = {};
+        uint32_t idle_until = start + runtime;
+        for (size_t i = 0; i < devs.size(); ++i) {
+            SimDevice& d = devs[i];
+            if (d.period == 0) {
+                while (d.queue.size() < d.queue_size) {
+                    d.queue.push_back(now);
+                }
+            } else {
+                while (int32_t(now - d.next_arrival) >= 0) {
+                    if (d.queue.size() < d.queue_size) {
+                        d.queue.push_back(d.next_arrival);
+                    } else {
+                        d.dropped++;
+                    }
+                    d.next_arrival += d.period;
+                }
+                if (int32_t(d.next_arrival - idle_until) < 0) {
+                    idle_until = d.next_arrival;
+                }
+            }
+            if (!d.queue.empty()) {
+                slot[i] = { true, d.priority, d.queue.front(), d.deadline ? d.deadline : 1u << 30 };
+            }
+        }
+        int i = spi_sched_pick(policy, slot, devs.size(), last, now);
+        if (i < 0) {
+            now = idle_until;
+            continue;
+        }
+        SimDevice& d = devs[i];
+        uint32_t waited = now - d.queue.front();
+        d.queue.pop_front();
+        d.sent++;
+        d.total_latency += waited;
+        d.max_latency = max(d.max_latency, waited);
+        if (d.deadline && waited > d.deadline) {
+            d.misses++;
+        }
+        d.bus_time += d.duration;
+        now += d.duration;
+        last = i;
+    }
+}
+
+/* A display refreshed as fast as the bus allows on CS0, an accelerometer read every ms on CS1 and a flash
+   log page written every 5 ms on CS2. Full frame of the 128x64 OLED at 10 MHz: 1 KB in about 820 us. */
+static vector<SimDevice> pingzeeBus(bool prioritized)
+{
+    vector<SimDevice> devs;
+    devs.push_back(SimDevice("oled", 0, 0, 0, 820));
+    devs.push_back(SimDevice("accel", prioritized ? 2 : 0, 2000, 1000, 20));
+    devs.push_back(SimDevice("flash", prioritized ? 1 : 0, 10000, 5000, 260));
+    return devs;
+}
+
+const uint32_t simTime = 2000000;
+
+TEST_CASE("low-cs-first starves the devices behind a busy display", "[spi][sched]")
+{
+    vector<SimDevice> devs = pingzeeBus(false);
+    simulate(SPI_SCHED_LOW_CS_FIRST, devs, 0, simTime);
+    CHECK(devs[0].sent > 2000);
+    CHECK(devs[1].sent == 0);
+    CHECK(devs[2].sent == 0);
+    CHECK(devs[1].dropped > 1900);
+}
+
+TEST_CASE("round-robin serves every device", "[spi][sched]")
+{
+    vector<SimDevice> devs = pingzeeBus(false);
+    simulate(SPI_SCHED_ROUND_ROBIN, devs, 0, simTime);
+    CHECK(devs[1].dropped == 0);
+    CHECK(devs[2].dropped == 0);
+    /* at most one transaction of each other device goes first */
+    CHECK(devs[1].max_latency <= 820 + 260);
+    CHECK(devs[2].max_latency <= 820 + 20);
+    CHECK(devs[0].bus_time > simTime * 8 / 10);
+}
+
+TEST_CASE("priorities bound the latency to one transfer on the bus", "[spi][sched]")
+{
+    vector<SimDevice> devs = pingzeeBus(true);
+    simulate(SPI_SCHED_LOW_CS_FIRST, devs, 0, simTime);
+    CHECK(devs[1].max_latency <= 820);
+    CHECK(devs[2].max_latency <= 820 + 20);
+    CHECK(devs[1].misses == 0);
+    CHECK(devs[2].misses == 0);
+    CHECK(devs[0].bus_time > simTime * 8 / 10);
+}
+
+TEST_CASE("deadline scheduling meets the deadlines", "[spi][sched]")
+{
+    vector<SimDevice> devs = pingzeeBus(false);
+    simulate(SPI_SCHED_DEADLINE, devs, 0, simTime);
+    CHECK(devs[1].sent >= simTime / 1000 - 1);
+    CHECK(devs[1].misses == 0);
+    CHECK(devs[2].misses == 0);
+    CHECK(devs[0].bus_time > simTime * 8 / 10);
+
+    /* the same run with the timestamps wrapping around half-way */
+    vector<SimDevice> wrapped = pingzeeBus(false);
+    simulate(SPI_SCHED_DEADLINE, wrapped, 0u - simTime / 2, simTime);
+    for (size_t i = 0; i < devs.size(); ++i) {
+        CHECK(wrapped[i].sent == devs[i].sent);
+        CHECK(wrapped[i].max_latency == devs[i].max_latency);
+    }
+}
+
+TEST_CASE("SPI dispatcher starvation and throughput", "[spi][bench]")
+{
+    struct {
+        const char* name;
+        spi_sched_policy_t policy;
+        bool prioritized;
+    } runs[] = {
+        { "low-cs-first", SPI_SCHED_LOW_CS_FIRST, false },
+        { "round-robin", SPI_SCHED_ROUND_ROBIN, false },
+        { "deadline", SPI_SCHED_DEADLINE, false },
+        { "priorities", SPI_SCHED_LOW_CS_FIRST, true },
+    };
+    cout << "Simulated " << simTime / 1000 << " ms: oled saturating CS0, accel every 1 ms on CS1, flash every 5 ms on CS2" << endl;
+    for (auto& run : runs) {
+        vector<SimDevice> devs = pingzeeBus(run.prioritized);
+        simulate(run.policy, devs, 0, simTime);
+        cout << "  " << run.name << endl;
+        for (auto& d : devs) {
+            cout << "    " << left << setw(6) << d.name << right
+                 << setw(6) << d.sent * 1000000ull / simTime << " trans/s"
+                 << setw(6) << d.bus_time * 100 / simTime << "% bus"
+                 << setw(8) << (d.sent ? d.total_latency / d.sent : 0) << " us avg"
+                 << setw(8) << d.max_latency << " us max"
+                 << setw(6) << d.misses << " late"
+                 << setw(6) << d.dropped << " dropped" << endl;
+        }
+        CHECK(devs[0].sent > 0);
+    }
+}
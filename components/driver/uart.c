@@ -67,8 +67,9 @@ typedef struct {
     int rx_cur_remain;                  /*!< Data number that waiting to be read out in ring buffer item*/
     uint8_t* rx_ptr;                    /*!< pointer to the current data in ring buffer*/
     uint8_t* rx_head_ptr;               /*!< pointer to the head of RX item*/
-    uint8_t rx_data_buf[UART_FIFO_LEN]; /*!< Data buffer to stash FIFO data*/
+    uint8_t rx_data_buf[UART_FIFO_LEN]; /*!< Data buffer to stash FIFO data that did not fit in the ring buffer*/
     uint8_t rx_stash_len;               /*!< stashed data length.(When using flow control, after reading out FIFO data, if we fail to push to buffer, we can just stash them.) */
+    bool rx_peeked;                     /*!< a slice handed out by uart_read_bytes_peek is waiting for uart_read_bytes_release*/
     //tx parameters
     SemaphoreHandle_t tx_fifo_sem;      /*!< UART TX FIFO semaphore*/
     SemaphoreHandle_t tx_mux;           /*!< UART TX mutex*/
@@ -604,33 +605,47 @@ static void uart_rx_intr_handler_default(void *param)
         }
         else if((uart_intr_status & UART_RXFIFO_TOUT_INT_ST_M) || (uart_intr_status & UART_RXFIFO_FULL_INT_ST_M)) {
             if(p_uart->rx_buffer_full_flg == false) {
-                //Get the buffer from the FIFO
                 rx_fifo_len = uart_reg->status.rxfifo_cnt;
-                p_uart->rx_stash_len = rx_fifo_len;
-                //We have to read out all data in RX FIFO to clear the interrupt signal
-                while(buf_idx < rx_fifo_len) {
-                    p_uart->rx_data_buf[buf_idx++] = uart_reg->fifo.rw_byte;
+                //Move the FIFO straight into ring buffer storage; a wrap around the end takes a second pass.
+                int rx_copied = 0;
+                while(rx_copied < rx_fifo_len) {
+                    size_t space;
+                    uint8_t* dst = (uint8_t*) xRingbufferWriteAcquireFromISR(p_uart->rx_ring_buf, &space);
+                    if(dst == NULL) {
+                        break;
+                    }
+                    int copy_len = rx_fifo_len - rx_copied;
+                    if((size_t) copy_len > space) {
+                        copy_len = space;
+                    }
+                    for(buf_idx = 0; buf_idx < copy_len; buf_idx++) {
+                        dst[buf_idx] = uart_reg->fifo.rw_byte;
+                    }
+                    vRingbufferWriteCommitFromISR(p_uart->rx_ring_buf, copy_len, &HPTaskAwoken);
+                    rx_copied += copy_len;
+                }
+                //We have to read out all data in RX FIFO to clear the interrupt signal,
+                //what did not fit in the ring buffer is stashed and sent next time.
+                //Mainly for applications that uses flow control or small ring buffer.
+                p_uart->rx_stash_len = rx_fifo_len - rx_copied;
+                for(buf_idx = 0; buf_idx < p_uart->rx_stash_len; buf_idx++) {
+                    p_uart->rx_data_buf[buf_idx] = uart_reg->fifo.rw_byte;
                 }
                 //After Copying the Data From FIFO ,Clear intr_status
                 UART_ENTER_CRITICAL_ISR(&uart_spinlock[uart_num]);
                 uart_reg->int_clr.rxfifo_tout = 1;
                 uart_reg->int_clr.rxfifo_full = 1;
-                UART_EXIT_CRITICAL_ISR(&uart_spinlock[uart_num]);
-                uart_event.type = UART_DATA;
-                uart_event.size = rx_fifo_len;
-                //If we fail to push data to ring buffer, we will have to stash the data, and send next time.
-                //Mainly for applications that uses flow control or small ring buffer.
-                if(pdFALSE == xRingbufferSendFromISR(p_uart->rx_ring_buf, p_uart->rx_data_buf, p_uart->rx_stash_len, &HPTaskAwoken)) {
-                    UART_ENTER_CRITICAL_ISR(&uart_spinlock[uart_num]);
+                p_uart->rx_buffered_len += rx_copied;
+                if(p_uart->rx_stash_len) {
                     uart_reg->int_ena.rxfifo_full = 0;
                     uart_reg->int_ena.rxfifo_tout = 0;
-                    UART_EXIT_CRITICAL_ISR(&uart_spinlock[uart_num]);
+                }
+                UART_EXIT_CRITICAL_ISR(&uart_spinlock[uart_num]);
+                uart_event.size = rx_fifo_len;
+                if(p_uart->rx_stash_len) {
                     p_uart->rx_buffer_full_flg = true;
                     uart_event.type = UART_BUFFER_FULL;
                 } else {
-                    UART_ENTER_CRITICAL_ISR(&uart_spinlock[uart_num]);
-                    p_uart->rx_buffered_len += p_uart->rx_stash_len;
-                    UART_EXIT_CRITICAL_ISR(&uart_spinlock[uart_num]);
                     uart_event.type = UART_DATA;
                 }
                 if(HPTaskAwoken == pdTRUE) {
@@ -850,6 +865,25 @@ int uart_write_bytes_with_break(uart_port_t uart_num, const char* src, size_t si
     return uart_tx_all(uart_num, src, size, 1, brk_len);
 }
 
+//Give the current RX item back to the ring buffer, then push the data stashed by the ISR, if any.
+//Call with rx_mux taken.
+static void uart_rx_item_done(uart_obj_t* p_uart)
+{
+    vRingbufferReturnItem(p_uart->rx_ring_buf, p_uart->rx_head_ptr);
+    p_uart->rx_head_ptr = NULL;
+    p_uart->rx_ptr = NULL;
+    if(p_uart->rx_buffer_full_flg) {
+        BaseType_t res = xRingbufferSend(p_uart->rx_ring_buf, p_uart->rx_data_buf, p_uart->rx_stash_len, 1);
+        if(res == pdTRUE) {
+            UART_ENTER_CRITICAL(&uart_spinlock[p_uart->uart_num]);
+            p_uart->rx_buffered_len += p_uart->rx_stash_len;
+            UART_EXIT_CRITICAL(&uart_spinlock[p_uart->uart_num]);
+            p_uart->rx_buffer_full_flg = false;
+            uart_enable_rx_intr(p_uart->uart_num);
+        }
+    }
+}
+
 int uart_read_bytes(uart_port_t uart_num, uint8_t* buf, uint32_t length, TickType_t ticks_to_wait)
 {
     UART_CHECK((uart_num < UART_NUM_MAX), "uart_num error", (-1));
@@ -888,19 +922,7 @@ int uart_read_bytes(uart_port_t uart_num, uint8_t* buf, uint32_t length, TickTyp
         copy_len += len_tmp;
         length -= len_tmp;
         if(p_uart_obj[uart_num]->rx_cur_remain == 0) {
-            vRingbufferReturnItem(p_uart_obj[uart_num]->rx_ring_buf, p_uart_obj[uart_num]->rx_head_ptr);
-            p_uart_obj[uart_num]->rx_head_ptr = NULL;
-            p_uart_obj[uart_num]->rx_ptr = NULL;
-            if(p_uart_obj[uart_num]->rx_buffer_full_flg) {
-                BaseType_t res = xRingbufferSend(p_uart_obj[uart_num]->rx_ring_buf, p_uart_obj[uart_num]->rx_data_buf, p_uart_obj[uart_num]->rx_stash_len, 1);
-                if(res == pdTRUE) {
-                    UART_ENTER_CRITICAL(&uart_spinlock[uart_num]);
-                    p_uart_obj[uart_num]->rx_buffered_len += p_uart_obj[uart_num]->rx_stash_len;
-                    UART_EXIT_CRITICAL(&uart_spinlock[uart_num]);
-                    p_uart_obj[uart_num]->rx_buffer_full_flg = false;
-                    uart_enable_rx_intr(p_uart_obj[uart_num]->uart_num);
-                }
-            }
+            uart_rx_item_done(p_uart_obj[uart_num]);
         }
     }
     xSemaphoreGive(p_uart_obj[uart_num]->rx_mux);
@@ -910,6 +932,54 @@ int uart_read_bytes(uart_port_t uart_num, uint8_t* buf, uint32_t length, TickTyp
     return copy_len;
 }
 
+int uart_read_bytes_peek(uart_port_t uart_num, const uint8_t** data, TickType_t ticks_to_wait)
+{
+    UART_CHECK((uart_num < UART_NUM_MAX), "uart_num error", (-1));
+    UART_CHECK((data), "uart data null", (-1));
+    UART_CHECK((p_uart_obj[uart_num]), "uart driver error", (-1));
+    uart_obj_t* p_uart = p_uart_obj[uart_num];
+    size_t size;
+
+    if(xSemaphoreTake(p_uart->rx_mux, (portTickType)ticks_to_wait) != pdTRUE) {
+        return -1;
+    }
+    if(p_uart->rx_cur_remain == 0) {
+        uint8_t* item = (uint8_t*) xRingbufferReceive(p_uart->rx_ring_buf, &size, (portTickType) ticks_to_wait);
+        if(item == NULL) {
+            xSemaphoreGive(p_uart->rx_mux);
+            return 0;
+        }
+        p_uart->rx_head_ptr = item;
+        p_uart->rx_ptr = item;
+        p_uart->rx_cur_remain = size;
+    }
+    //rx_mux stays taken until uart_read_bytes_release
+    p_uart->rx_peeked = true;
+    *data = p_uart->rx_ptr;
+    return p_uart->rx_cur_remain;
+}
+
+esp_err_t uart_read_bytes_release(uart_port_t uart_num, size_t length)
+{
+    UART_CHECK((uart_num < UART_NUM_MAX), "uart_num error", ESP_FAIL);
+    UART_CHECK((p_uart_obj[uart_num]), "uart driver error", ESP_FAIL);
+    uart_obj_t* p_uart = p_uart_obj[uart_num];
+    UART_CHECK((p_uart->rx_peeked), "no slice to release", ESP_FAIL);
+    UART_CHECK((length <= p_uart->rx_cur_remain), "release length error", ESP_FAIL);
+
+    p_uart->rx_ptr += length;
+    p_uart->rx_cur_remain -= length;
+    if(p_uart->rx_cur_remain == 0) {
+        uart_rx_item_done(p_uart);
+    }
+    p_uart->rx_peeked = false;
+    xSemaphoreGive(p_uart->rx_mux);
+    UART_ENTER_CRITICAL(&uart_spinlock[uart_num]);
+    p_uart->rx_buffered_len -= length;
+    UART_EXIT_CRITICAL(&uart_spinlock[uart_num]);
+    return ESP_OK;
+}
+
 esp_err_t uart_get_buffered_data_len(uart_port_t uart_num, size_t* size)
 {
     UART_CHECK((uart_num < UART_NUM_MAX), "uart_num error", ESP_FAIL);
@@ -1004,6 +1074,7 @@ esp_err_t uart_driver_install(uart_port_t uart_num, int rx_buffer_size, int tx_b
         p_uart_obj[uart_num]->rx_ptr = NULL;
         p_uart_obj[uart_num]->rx_cur_remain = 0;
         p_uart_obj[uart_num]->rx_head_ptr = NULL;
+        p_uart_obj[uart_num]->rx_peeked = false;
         p_uart_obj[uart_num]->rx_ring_buf = xRingbufferCreate(rx_buffer_size, RINGBUF_TYPE_BYTEBUF);
         if(tx_buffer_size > 0) {
             p_uart_obj[uart_num]->tx_ring_buf = xRingbufferCreate(tx_buffer_size, RINGBUF_TYPE_NOSPLIT);
@@ -29,14 +29,22 @@
 #include "hwcrypto/aes.h"
 #include "rom/aes.h"
 #include "soc/dport_reg.h"
+#include "soc/hwcrypto_reg.h"
 #include <sys/lock.h>
 
 static _lock_t aes_lock;
 
+/* Nesting depth of esp_aes_acquire_hardware(), protected by aes_lock */
+static unsigned aes_lock_depth;
+
 void esp_aes_acquire_hardware( void )
 {
     /* newlib locks lazy initialize on ESP-IDF */
-    _lock_acquire(&aes_lock);
+    _lock_acquire_recursive(&aes_lock);
+    if (aes_lock_depth++ > 0) {
+        /* Already enabled by an outer caller holding the unit */
+        return;
+    }
     /* Enable AES hardware */
     REG_SET_BIT(DPORT_PERI_CLK_EN_REG, DPORT_PERI_EN_AES);
     /* Clear reset on digital signature & secure boot units,
@@ -49,12 +57,14 @@ void esp_aes_acquire_hardware( void )
 
 void esp_aes_release_hardware( void )
 {
-    /* Disable AES hardware */
-    REG_SET_BIT(DPORT_PERI_RST_EN_REG, DPORT_PERI_EN_AES);
-    /* Don't return other units to reset, as this pulls
-       reset on RSA & SHA units, respectively. */
-    REG_CLR_BIT(DPORT_PERI_CLK_EN_REG, DPORT_PERI_EN_AES);
-    _lock_release(&aes_lock);
+    if (--aes_lock_depth == 0) {
+        /* Disable AES hardware */
+        REG_SET_BIT(DPORT_PERI_RST_EN_REG, DPORT_PERI_EN_AES);
+        /* Don't return other units to reset, as this pulls
+           reset on RSA & SHA units, respectively. */
+        REG_CLR_BIT(DPORT_PERI_CLK_EN_REG, DPORT_PERI_EN_AES);
+    }
+    _lock_release_recursive(&aes_lock);
 }
 
 void esp_aes_init( esp_aes_context *ctx )
@@ -131,14 +141,73 @@ int esp_aes_setkey_dec( esp_aes_context *ctx, const unsigned char *key,
  */
 static inline int esp_aes_setkey_hardware( esp_aes_context *ctx, int mode)
 {
-    if ( mode == ESP_AES_ENCRYPT ) {
-        ets_aes_setkey_enc(ctx->enc.key, ctx->enc.aesbits);
-    } else {
-        ets_aes_setkey_dec(ctx->dec.key, ctx->dec.aesbits);
+    const KEY_CTX *key = ( mode == ESP_AES_ENCRYPT ) ? &ctx->enc : &ctx->dec;
+    uint32_t key_words[8];
+    unsigned i;
+
+    /* AES128/192/256 keys are 4/6/8 words long */
+    memcpy(key_words, key->key, sizeof(key_words));
+    for ( i = 0; i < 4 + 2 * key->aesbits; i++ ) {
+        REG_WRITE(AES_KEY_BASE + i * 4, key_words[i]);
     }
+    REG_WRITE(AES_MODE_REG, key->aesbits | ( mode == ESP_AES_ENCRYPT ? 0 : AES_MODE_DECRYPT ));
     return 0;
 }
 
+/*
+ * The engine works in place on the AES_TEXT registers: a block is
+ * started by loading its input and finished by waiting for idle and
+ * reading the result back. The chained modes below split the two so
+ * that the CPU prepares the next block and stores the previous result
+ * while the engine is busy.
+ *
+ * Only call when protected by esp_aes_acquire_hardware().
+ */
+static inline void esp_aes_block_start( const uint32_t input[4] )
+{
+    REG_WRITE(AES_TEXT_BASE, input[0]);
+    REG_WRITE(AES_TEXT_BASE + 4, input[1]);
+    REG_WRITE(AES_TEXT_BASE + 8, input[2]);
+    REG_WRITE(AES_TEXT_BASE + 12, input[3]);
+    REG_WRITE(AES_START_REG, 1);
+}
+
+static inline void esp_aes_block_finish( uint32_t output[4] )
+{
+    while (REG_READ(AES_IDLE_REG) != 1) {
+    }
+    output[0] = REG_READ(AES_TEXT_BASE);
+    output[1] = REG_READ(AES_TEXT_BASE + 4);
+    output[2] = REG_READ(AES_TEXT_BASE + 8);
+    output[3] = REG_READ(AES_TEXT_BASE + 12);
+}
+
+/*
+ * Single block with the key already loaded. Buffers may be unaligned
+ * and may overlap.
+ */
+static void esp_aes_block( const unsigned char input[16], unsigned char output[16] )
+{
+    uint32_t block[4];
+
+    memcpy(block, input, 16);
+    esp_aes_block_start(block);
+    esp_aes_block_finish(block);
+    memcpy(output, block, 16);
+}
+
+/* Big-endian increment of the 128-bit CTR block */
+static inline void esp_aes_ctr_increment( unsigned char nonce_counter[16] )
+{
+    int i;
+
+    for ( i = 16; i > 0; i-- ) {
+        if ( ++nonce_counter[i - 1] != 0 ) {
+            break;
+        }
+    }
+}
+
 /*
  * AES-ECB block encryption
  */
@@ -148,7 +217,7 @@ void esp_aes_encrypt( esp_aes_context *ctx,
 {
     esp_aes_acquire_hardware();
     esp_aes_setkey_hardware(ctx, ESP_AES_ENCRYPT);
-    ets_aes_crypt(input, output);
+    esp_aes_block(input, output);
     esp_aes_release_hardware();
 }
 
@@ -162,7 +231,7 @@ void esp_aes_decrypt( esp_aes_context *ctx,
 {
     esp_aes_acquire_hardware();
     esp_aes_setkey_hardware(ctx, ESP_AES_DECRYPT);
-    ets_aes_crypt(input, output);
+    esp_aes_block(input, output);
     esp_aes_release_hardware();
 }
 
@@ -177,7 +246,7 @@ int esp_aes_crypt_ecb( esp_aes_context *ctx,
 {
     esp_aes_acquire_hardware();
     esp_aes_setkey_hardware(ctx, mode);
-    ets_aes_crypt(input, output);
+    esp_aes_block(input, output);
     esp_aes_release_hardware();
     return 0;
 }
@@ -194,45 +263,76 @@ int esp_aes_crypt_cbc( esp_aes_context *ctx,
                        unsigned char *output )
 {
     int i;
-    unsigned char temp[16];
+    uint32_t chain[4], block[4], next[4], result[4];
 
     if ( length % 16 ) {
         return ( ERR_ESP_AES_INVALID_INPUT_LENGTH );
     }
+    if ( length == 0 ) {
+        return 0;
+    }
 
     esp_aes_acquire_hardware();
     esp_aes_setkey_hardware(ctx, mode);
+    memcpy( chain, iv, 16 );
 
     if ( mode == ESP_AES_DECRYPT ) {
-        while ( length > 0 ) {
-            memcpy( temp, input, 16 );
-            ets_aes_crypt(input, output);
-
-            for ( i = 0; i < 16; i++ ) {
-                output[i] = (unsigned char)( output[i] ^ iv[i] );
+        /* Blocks are independent: block n+1 is started before block n
+           is XORed with its IV and stored */
+        memcpy( block, input, 16 );
+        esp_aes_block_start( block );
+        for ( ;; ) {
+            input  += 16;
+            length -= 16;
+            if ( length > 0 ) {
+                /* Read ahead before output overwrites an in-place buffer */
+                memcpy( next, input, 16 );
             }
 
-            memcpy( iv, temp, 16 );
+            esp_aes_block_finish( result );
+            if ( length > 0 ) {
+                esp_aes_block_start( next );
+            }
 
-            input  += 16;
+            for ( i = 0; i < 4; i++ ) {
+                result[i] ^= chain[i];
+            }
+            memcpy( output, result, 16 );
+            memcpy( chain, block, 16 );
             output += 16;
-            length -= 16;
+
+            if ( length == 0 ) {
+                break;
+            }
+            memcpy( block, next, 16 );
         }
     } else {
-        while ( length > 0 ) {
-            for ( i = 0; i < 16; i++ ) {
-                output[i] = (unsigned char)( input[i] ^ iv[i] );
+        /* Each block needs the previous ciphertext, so only the load of
+           the next plaintext overlaps with the engine */
+        memcpy( block, input, 16 );
+        for ( ;; ) {
+            for ( i = 0; i < 4; i++ ) {
+                block[i] ^= chain[i];
             }
-
-            ets_aes_crypt(output, output);
-            memcpy( iv, output, 16 );
+            esp_aes_block_start( block );
 
             input  += 16;
-            output += 16;
             length -= 16;
+            if ( length > 0 ) {
+                memcpy( block, input, 16 );
+            }
+
+            esp_aes_block_finish( chain );
+            memcpy( output, chain, 16 );
+            output += 16;
+
+            if ( length == 0 ) {
+                break;
+            }
         }
     }
 
+    memcpy( iv, chain, 16 );
     esp_aes_release_hardware();
 
     return 0;
@@ -258,7 +358,7 @@ int esp_aes_crypt_cfb128( esp_aes_context *ctx,
     if ( mode == ESP_AES_DECRYPT ) {
         while ( length-- ) {
             if ( n == 0 ) {
-                ets_aes_crypt(iv, iv );
+                esp_aes_block(iv, iv);
             }
 
             c = *input++;
@@ -270,7 +370,7 @@ int esp_aes_crypt_cfb128( esp_aes_context *ctx,
     } else {
         while ( length-- ) {
             if ( n == 0 ) {
-                ets_aes_crypt(iv, iv );
+                esp_aes_block(iv, iv);
             }
 
             iv[n] = *output++ = (unsigned char)( iv[n] ^ *input++ );
@@ -304,7 +404,7 @@ int esp_aes_crypt_cfb8( esp_aes_context *ctx,
 
     while ( length-- ) {
         memcpy( ov, iv, 16 );
-        ets_aes_crypt(iv, iv);
+        esp_aes_block(iv, iv);
 
         if ( mode == ESP_AES_DECRYPT ) {
             ov[16] = *input;
@@ -335,28 +435,54 @@ int esp_aes_crypt_ctr( esp_aes_context *ctx,
                        const unsigned char *input,
                        unsigned char *output )
 {
-    int c, i;
+    size_t i, use;
     size_t n = *nc_off;
+    uint32_t counter[4], stream[4];
+
+    /* Finish the key stream left over from a previous call */
+    while ( n != 0 && length > 0 ) {
+        *output++ = (unsigned char)( *input++ ^ stream_block[n] );
+        n = ( n + 1 ) & 0x0F;
+        length--;
+    }
+    if ( length == 0 ) {
+        *nc_off = n;
+        return 0;
+    }
 
     esp_aes_acquire_hardware();
     esp_aes_setkey_hardware(ctx, ESP_AES_ENCRYPT);
 
-    while ( length-- ) {
-        if ( n == 0 ) {
-            ets_aes_crypt(nonce_counter, stream_block);
+    /* Counter blocks are independent: block n+1 is started before the
+       key stream of block n is applied */
+    memcpy( counter, nonce_counter, 16 );
+    esp_aes_block_start( counter );
+    esp_aes_ctr_increment( nonce_counter );
+    for ( ;; ) {
+        use = length < 16 ? length : 16;
+        length -= use;
+        if ( length > 0 ) {
+            memcpy( counter, nonce_counter, 16 );
+        }
 
-            for ( i = 16; i > 0; i-- )
-                if ( ++nonce_counter[i - 1] != 0 ) {
-                    break;
-                }
+        esp_aes_block_finish( stream );
+        if ( length > 0 ) {
+            esp_aes_block_start( counter );
+            esp_aes_ctr_increment( nonce_counter );
         }
-        c = *input++;
-        *output++ = (unsigned char)( c ^ stream_block[n] );
 
-        n = ( n + 1 ) & 0x0F;
-    }
+        memcpy( stream_block, stream, 16 );
+        for ( i = 0; i < use; i++ ) {
+            output[i] = (unsigned char)( input[i] ^ stream_block[i] );
+        }
+        input  += use;
+        output += use;
 
-    *nc_off = n;
+        if ( length == 0 ) {
+            break;
+        }
+    }
+    *nc_off = use & 0x0F;
 
     esp_aes_release_hardware();
 
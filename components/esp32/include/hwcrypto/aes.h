@@ -67,6 +67,11 @@ typedef struct {
  * esp_aes_xxx API calls automatically manage locking & unlocking of
  * hardware, this function is only needed if you want to call
  * ets_aes_xxx functions directly.
+ *
+ * Calls may be nested. Holding the unit around a sequence of
+ * esp_aes_xxx calls (for example all the cipher operations of one
+ * TLS record) keeps it enabled and owned by the caller between them;
+ * the unit is only disabled by the outermost esp_aes_release_hardware().
  */
 void esp_aes_acquire_hardware( void );
 
@@ -147,6 +152,10 @@ int esp_aes_crypt_ecb( esp_aes_context *ctx, int mode, const unsigned char input
  * \param input    buffer holding the input data
  * \param output   buffer holding the output data
  *
+ * \note           The key is loaded once per call and, when decrypting,
+ *                 each block is processed by the hardware while the
+ *                 previous one is being stored.
+ *
  * \return         0 if successful, or ERR_AES_INVALID_INPUT_LENGTH
  */
 int esp_aes_crypt_cbc( esp_aes_context *ctx,
@@ -241,6 +250,10 @@ int esp_aes_crypt_cfb8( esp_aes_context *ctx,
  * \param input         The input data stream
  * \param output        The output data stream
  *
+ * \note           The key is loaded once per call and each counter block
+ *                 is processed by the hardware while the key stream of
+ *                 the previous one is being applied.
+ *
  * \return         0 if successful
  */
 int esp_aes_crypt_ctr( esp_aes_context *ctx,
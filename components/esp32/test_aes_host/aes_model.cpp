@@ -0,0 +1,188 @@
+// Copyright 2015-2017 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "soc/dport_reg.h"
+#include "soc/hwcrypto_reg.h"
+#include "sys/lock.h"
+#include "aes_model.h"
+#include "mbedtls/aes.h"
+#include <cstring>
+
+namespace {
+
+struct AesModel {
+    aes_model_stats_t stats;
+    unsigned latency;
+    unsigned busy;
+    int lock_depth;
+    uint32_t clk_en;
+    uint32_t rst_en;
+    uint32_t key[8];
+    uint32_t mode;
+    uint32_t text[4];
+
+    bool powered() const
+    {
+        return (clk_en & DPORT_PERI_EN_AES) && !(rst_en & DPORT_PERI_EN_AES);
+    }
+
+    void set_dport(uint32_t& reg, uint32_t value)
+    {
+        bool was_powered = powered();
+        reg = value;
+        if (!was_powered && powered()) {
+            ++stats.power_ups;
+        }
+        if (rst_en & DPORT_PERI_EN_AES) {
+            /* Reset loses key, mode and text */
+            memset(key, 0, sizeof(key));
+            memset(text, 0, sizeof(text));
+            mode = 0;
+            busy = 0;
+        }
+    }
+
+    /* Runs the block on START; the result is visible once the engine is idle */
+    void run()
+    {
+        mbedtls_aes_context ctx;
+        unsigned char block[16];
+        unsigned bits = 128 + 64 * (mode & 3);
+
+        if ((mode & 3) == 3) {
+            ++stats.violations;
+            return;
+        }
+        mbedtls_aes_init(&ctx);
+        if (mode & AES_MODE_DECRYPT) {
+            mbedtls_aes_setkey_dec(&ctx, reinterpret_cast<unsigned char*>(key), bits);
+        } else {
+            mbedtls_aes_setkey_enc(&ctx, reinterpret_cast<unsigned char*>(key), bits);
+        }
+        memcpy(block, text, 16);
+        mbedtls_aes_crypt_ecb(&ctx, (mode & AES_MODE_DECRYPT) ? MBEDTLS_AES_DECRYPT : MBEDTLS_AES_ENCRYPT, block, block);
+        memcpy(text, block, 16);
+        mbedtls_aes_free(&ctx);
+        busy = latency;
+    }
+
+    /* AES registers need the lock held and the unit clocked and out of reset */
+    bool check_access()
+    {
+        if (lock_depth <= 0 || !powered()) {
+            ++stats.violations;
+            return false;
+        }
+        return true;
+    }
+
+    void write(uint32_t addr, uint32_t value)
+    {
+        ++stats.reg_accesses;
+        if (addr == DPORT_PERI_CLK_EN_REG) {
+            set_dport(clk_en, value);
+            return;
+        }
+        if (addr == DPORT_PERI_RST_EN_REG) {
+            set_dport(rst_en, value);
+            return;
+        }
+        if (!check_access()) {
+            return;
+        }
+        if (busy) {
+            /* The engine computes in place; nothing may change under it */
+            ++stats.violations;
+            return;
+        }
+        if (addr >= AES_KEY_BASE && addr < AES_KEY_BASE + sizeof(key)) {
+            key[(addr - AES_KEY_BASE) / 4] = value;
+        } else if (addr >= AES_TEXT_BASE && addr < AES_TEXT_BASE + sizeof(text)) {
+            text[(addr - AES_TEXT_BASE) / 4] = value;
+        } else if (addr == AES_MODE_REG) {
+            mode = value;
+            ++stats.key_loads;
+        } else if (addr == AES_START_REG && value == 1) {
+            ++stats.blocks;
+            run();
+        } else {
+            ++stats.violations;
+        }
+    }
+
+    uint32_t read(uint32_t addr)
+    {
+        ++stats.reg_accesses;
+        if (addr == DPORT_PERI_CLK_EN_REG) {
+            return clk_en;
+        }
+        if (addr == DPORT_PERI_RST_EN_REG) {
+            return rst_en;
+        }
+        if (!check_access()) {
+            return 0;
+        }
+        if (addr == AES_IDLE_REG) {
+            if (busy) {
+                --busy;
+                ++stats.busy_polls;
+                return 0;
+            }
+            return 1;
+        }
+        if (addr >= AES_TEXT_BASE && addr < AES_TEXT_BASE + sizeof(text) && !busy) {
+            return text[(addr - AES_TEXT_BASE) / 4];
+        }
+        ++stats.violations;
+        return 0;
+    }
+};
+
+AesModel s_model;
+
+} // namespace
+
+extern "C" uint32_t aes_model_read(uint32_t addr)
+{
+    return s_model.read(addr);
+}
+
+extern "C" void aes_model_write(uint32_t addr, uint32_t value)
+{
+    s_model.write(addr, value);
+}
+
+extern "C" void aes_model_reset(unsigned latency)
+{
+    memset(&s_model, 0, sizeof(s_model));
+    s_model.latency = latency;
+    s_model.rst_en = DPORT_PERI_EN_AES | DPORT_PERI_EN_DIGITAL_SIGNATURE | DPORT_PERI_EN_SECUREBOOT;
+}
+
+extern "C" const aes_model_stats_t *aes_model_stats(void)
+{
+    return &s_model.stats;
+}
+
+extern "C" void _lock_acquire_recursive(_lock_t *lock)
+{
+    ++s_model.lock_depth;
+    ++s_model.stats.lock_acquires;
+}
+
+extern "C" void _lock_release_recursive(_lock_t *lock)
+{
+    if (--s_model.lock_depth < 0) {
+        ++s_model.stats.violations;
+    }
+}
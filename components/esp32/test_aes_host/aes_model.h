@@ -0,0 +1,57 @@
+// Copyright 2015-2017 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef AES_MODEL_H
+#define AES_MODEL_H
+
+/* Software model of the AES peripheral and the DPORT clock/reset bits.
+   Register accesses from the driver are routed here instead of to memory. */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint32_t aes_model_read(uint32_t addr);
+void aes_model_write(uint32_t addr, uint32_t value);
+
+typedef struct {
+    size_t blocks;          /* AES_START_REG writes */
+    size_t key_loads;       /* AES_MODE_REG writes */
+    size_t power_ups;       /* clock enabled with the unit out of reset */
+    size_t lock_acquires;   /* _lock_acquire_recursive calls */
+    size_t busy_polls;      /* AES_IDLE_REG reads returning 0 */
+    size_t reg_accesses;    /* all register reads and writes */
+    size_t violations;      /* accesses the hardware would not honour */
+} aes_model_stats_t;
+
+/* Reset the model; each block keeps the engine busy for 'latency' polls */
+void aes_model_reset(unsigned latency);
+const aes_model_stats_t *aes_model_stats(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#undef REG_WRITE
+#undef REG_READ
+#undef REG_SET_BIT
+#undef REG_CLR_BIT
+#define REG_WRITE(_r, _v)    aes_model_write((_r), (_v))
+#define REG_READ(_r)         aes_model_read(_r)
+#define REG_SET_BIT(_r, _b)  aes_model_write((_r), aes_model_read(_r) | (_b))
+#define REG_CLR_BIT(_r, _b)  aes_model_write((_r), aes_model_read(_r) & ~(_b))
+
+#endif /* AES_MODEL_H */
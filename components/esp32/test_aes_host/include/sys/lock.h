@@ -0,0 +1,33 @@
+// Copyright 2015-2017 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef _HOST_SYS_LOCK_H_
+#define _HOST_SYS_LOCK_H_
+
+/* The subset of the ESP-IDF newlib lock API used by hwcrypto/aes.c,
+   implemented by the AES model */
+
+typedef int _lock_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void _lock_acquire_recursive(_lock_t *lock);
+void _lock_release_recursive(_lock_t *lock);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _HOST_SYS_LOCK_H_ */
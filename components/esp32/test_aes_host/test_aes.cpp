@@ -0,0 +1,287 @@
+// Copyright 2015-2017 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "catch.hpp"
+#include "soc/hwcrypto_reg.h"
+#include "aes_model.h"
+#include "hwcrypto/aes.h"
+#include "mbedtls/aes.h"
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using namespace std;
+
+typedef vector<unsigned char> Bytes;
+
+static Bytes randomBytes(mt19937& gen, size_t len)
+{
+    Bytes result(len);
+    for (auto& b : result) {
+        b = gen() & 0xff;
+    }
+    return result;
+}
+
+/* Hardware context through the driver and software reference context for the same key */
+struct KeyPair {
+    esp_aes_context hw;
+    mbedtls_aes_context enc;
+    mbedtls_aes_context dec;
+
+    KeyPair(const Bytes& key)
+    {
+        unsigned bits = key.size() * 8;
+        esp_aes_init(&hw);
+        REQUIRE(esp_aes_setkey_enc(&hw, key.data(), bits) == 0);
+        REQUIRE(esp_aes_setkey_dec(&hw, key.data(), bits) == 0);
+        mbedtls_aes_init(&enc);
+        mbedtls_aes_init(&dec);
+        REQUIRE(mbedtls_aes_setkey_enc(&enc, key.data(), bits) == 0);
+        REQUIRE(mbedtls_aes_setkey_dec(&dec, key.data(), bits) == 0);
+    }
+    ~KeyPair()
+    {
+        esp_aes_free(&hw);
+        mbedtls_aes_free(&enc);
+        mbedtls_aes_free(&dec);
+    }
+};
+
+static const size_t s_key_sizes[] = { 16, 24, 32 };
+
+TEST_CASE("ECB blocks match software AES for all key sizes", "[aes]")
+{
+    mt19937 gen(1);
+    aes_model_reset(3);
+    for (size_t keySize : s_key_sizes) {
+        KeyPair keys(randomBytes(gen, keySize));
+        for (int i = 0; i < 16; ++i) {
+            Bytes in = randomBytes(gen, 16), hw(16), sw(16);
+            CHECK(esp_aes_crypt_ecb(&keys.hw, ESP_AES_ENCRYPT, in.data(), hw.data()) == 0);
+            mbedtls_aes_crypt_ecb(&keys.enc, MBEDTLS_AES_ENCRYPT, in.data(), sw.data());
+            CHECK(hw == sw);
+            esp_aes_decrypt(&keys.hw, hw.data(), hw.data());
+            CHECK(hw == in);
+        }
+    }
+    CHECK(aes_model_stats()->violations == 0);
+}
+
+TEST_CASE("CBC matches software AES, in place and unaligned", "[aes][cbc]")
+{
+    mt19937 gen(2);
+    aes_model_reset(3);
+    for (size_t keySize : s_key_sizes) {
+        KeyPair keys(randomBytes(gen, keySize));
+        for (size_t len : { 16, 32, 48, 1024, 16384 }) {
+            for (size_t offset : { 0, 1, 3 }) {
+                Bytes plain = randomBytes(gen, len);
+                Bytes iv = randomBytes(gen, 16);
+                Bytes swIv = iv, hwIv = iv;
+                Bytes sw(len), buf(len + offset);
+
+                mbedtls_aes_crypt_cbc(&keys.enc, MBEDTLS_AES_ENCRYPT, len, swIv.data(), plain.data(), sw.data());
+                memcpy(buf.data() + offset, plain.data(), len);
+                CHECK(esp_aes_crypt_cbc(&keys.hw, ESP_AES_ENCRYPT, len, hwIv.data(), buf.data() + offset, buf.data() + offset) == 0);
+                CHECK(Bytes(buf.begin() + offset, buf.end()) == sw);
+                CHECK(hwIv == swIv);
+
+                hwIv = iv;
+                CHECK(esp_aes_crypt_cbc(&keys.hw, ESP_AES_DECRYPT, len, hwIv.data(), buf.data() + offset, buf.data() + offset) == 0);
+                CHECK(Bytes(buf.begin() + offset, buf.end()) == plain);
+                CHECK(hwIv == swIv);
+
+                Bytes out(len);
+                hwIv = iv;
+                CHECK(esp_aes_crypt_cbc(&keys.hw, ESP_AES_DECRYPT, len, hwIv.data(), sw.data(), out.data()) == 0);
+                CHECK(out == plain);
+            }
+        }
+    }
+    CHECK(aes_model_stats()->violations == 0);
+}
+
+TEST_CASE("CBC can be streamed and rejects partial blocks", "[aes][cbc]")
+{
+    mt19937 gen(3);
+    aes_model_reset(2);
+    KeyPair keys(randomBytes(gen, 32));
+    Bytes plain = randomBytes(gen, 4096);
+    Bytes iv = randomBytes(gen, 16);
+    Bytes whole(plain.size()), pieces(plain.size());
+    Bytes wholeIv = iv, piecesIv = iv;
+
+    REQUIRE(esp_aes_crypt_cbc(&keys.hw, ESP_AES_ENCRYPT, plain.size(), wholeIv.data(), plain.data(), whole.data()) == 0);
+    for (size_t pos = 0; pos < plain.size();) {
+        size_t len = min<size_t>(16 * (1 + gen() % 20), plain.size() - pos);
+        REQUIRE(esp_aes_crypt_cbc(&keys.hw, ESP_AES_ENCRYPT, len, piecesIv.data(), &plain[pos], &pieces[pos]) == 0);
+        pos += len;
+    }
+    CHECK(pieces == whole);
+    CHECK(piecesIv == wholeIv);
+
+    size_t blocks = aes_model_stats()->blocks;
+    CHECK(esp_aes_crypt_cbc(&keys.hw, ESP_AES_ENCRYPT, 17, piecesIv.data(), &plain[0], &pieces[0]) == ERR_ESP_AES_INVALID_INPUT_LENGTH);
+    CHECK(esp_aes_crypt_cbc(&keys.hw, ESP_AES_DECRYPT, 0, piecesIv.data(), &plain[0], &pieces[0]) == 0);
+    CHECK(piecesIv == wholeIv);
+    CHECK(aes_model_stats()->blocks == blocks);
+    CHECK(aes_model_stats()->violations == 0);
+}
+
+TEST_CASE("CTR matches software AES across arbitrary splits", "[aes][ctr]")
+{
+    mt19937 gen(4);
+    aes_model_reset(3);
+    for (size_t keySize : s_key_sizes) {
+        KeyPair keys(randomBytes(gen, keySize));
+        for (int round = 0; round < 20; ++round) {
+            Bytes nonce = randomBytes(gen, 16);
+            if (round == 0) {
+                /* Counter wraps around the full 128 bits */
+                memset(&nonce[4], 0xff, 12);
+            }
+            Bytes swNonce = nonce, hwNonce = nonce;
+            Bytes swStream(16), hwStream(16);
+            size_t swOff = 0, hwOff = 0;
+            Bytes input = randomBytes(gen, 1 + gen() % 3000);
+            Bytes sw(input.size()), hw(input.size());
+
+            for (size_t pos = 0; pos < input.size();) {
+                size_t len = min<size_t>(gen() % 100, input.size() - pos);
+                mbedtls_aes_crypt_ctr(&keys.enc, len, &swOff, swNonce.data(), swStream.data(), &input[pos], &sw[pos]);
+                CHECK(esp_aes_crypt_ctr(&keys.hw, len, &hwOff, hwNonce.data(), hwStream.data(), &input[pos], &hw[pos]) == 0);
+                REQUIRE(hwOff == swOff);
+                REQUIRE(hwNonce == swNonce);
+                if (hwOff) {
+                    REQUIRE(hwStream == swStream);
+                }
+                pos += len;
+            }
+            CHECK(hw == sw);
+
+            /* In place */
+            hwNonce = nonce;
+            hwOff = 0;
+            CHECK(esp_aes_crypt_ctr(&keys.hw, hw.size(), &hwOff, hwNonce.data(), hwStream.data(), hw.data(), hw.data()) == 0);
+            CHECK(hw == input);
+        }
+    }
+    CHECK(aes_model_stats()->violations == 0);
+}
+
+TEST_CASE("CFB modes match software AES", "[aes][cfb]")
+{
+    mt19937 gen(5);
+    aes_model_reset(1);
+    KeyPair keys(randomBytes(gen, 16));
+    Bytes input = randomBytes(gen, 333);
+    for (int mode : { ESP_AES_ENCRYPT, ESP_AES_DECRYPT }) {
+        Bytes iv = randomBytes(gen, 16);
+        Bytes swIv = iv, hwIv = iv, sw(input.size()), hw(input.size());
+        size_t swOff = 5, hwOff = 5;
+        mbedtls_aes_crypt_cfb128(&keys.enc, mode, input.size(), &swOff, swIv.data(), input.data(), sw.data());
+        CHECK(esp_aes_crypt_cfb128(&keys.hw, mode, input.size(), &hwOff, hwIv.data(), input.data(), hw.data()) == 0);
+        CHECK(hw == sw);
+        CHECK(hwIv == swIv);
+        CHECK(hwOff == swOff);
+
+        swIv = hwIv = iv;
+        mbedtls_aes_crypt_cfb8(&keys.enc, mode, input.size(), swIv.data(), input.data(), sw.data());
+        CHECK(esp_aes_crypt_cfb8(&keys.hw, mode, input.size(), hwIv.data(), input.data(), hw.data()) == 0);
+        CHECK(hw == sw);
+        CHECK(hwIv == swIv);
+    }
+    CHECK(aes_model_stats()->violations == 0);
+}
+
+TEST_CASE("hardware ownership can span a whole record", "[aes]")
+{
+    mt19937 gen(6);
+    aes_model_reset(3);
+    KeyPair keys(randomBytes(gen, 16));
+    Bytes data = randomBytes(gen, 1024), iv = randomBytes(gen, 16), tag(16);
+
+    esp_aes_acquire_hardware();
+    esp_aes_acquire_hardware();
+    CHECK(esp_aes_crypt_cbc(&keys.hw, ESP_AES_ENCRYPT, 512, iv.data(), data.data(), data.data()) == 0);
+    CHECK(esp_aes_crypt_cbc(&keys.hw, ESP_AES_ENCRYPT, 512, iv.data(), &data[512], &data[512]) == 0);
+    esp_aes_encrypt(&keys.hw, iv.data(), tag.data());
+    esp_aes_release_hardware();
+    CHECK(aes_model_read(AES_IDLE_REG) == 1);
+    esp_aes_release_hardware();
+
+    CHECK(aes_model_stats()->power_ups == 1);
+    CHECK(aes_model_stats()->violations == 0);
+    /* The unit is in reset again once the outermost owner lets go */
+    aes_model_read(AES_IDLE_REG);
+    CHECK(aes_model_stats()->violations == 1);
+}
+
+TEST_CASE("16 KB record: per-block calls versus bulk CBC/CTR", "[aes][bench]")
+{
+    mt19937 gen(7);
+    const size_t len = 16384, blocks = len / 16;
+    KeyPair keys(randomBytes(gen, 16));
+    Bytes data = randomBytes(gen, len), iv = randomBytes(gen, 16), out(len), ref(len);
+    Bytes stream(16);
+    size_t off = 0;
+
+    /* One esp_aes_encrypt per block, as a generic CBC layer over the block API would do */
+    aes_model_reset(8);
+    Bytes chain = iv;
+    for (size_t i = 0; i < len; i += 16) {
+        for (int j = 0; j < 16; ++j) {
+            chain[j] ^= data[i + j];
+        }
+        esp_aes_encrypt(&keys.hw, chain.data(), chain.data());
+        memcpy(&ref[i], chain.data(), 16);
+    }
+    aes_model_stats_t perBlock = *aes_model_stats();
+
+    aes_model_reset(8);
+    Bytes bulkIv = iv;
+    REQUIRE(esp_aes_crypt_cbc(&keys.hw, ESP_AES_ENCRYPT, len, bulkIv.data(), data.data(), out.data()) == 0);
+    aes_model_stats_t cbcEnc = *aes_model_stats();
+    CHECK(out == ref);
+
+    aes_model_reset(8);
+    bulkIv = iv;
+    REQUIRE(esp_aes_crypt_cbc(&keys.hw, ESP_AES_DECRYPT, len, bulkIv.data(), out.data(), out.data()) == 0);
+    aes_model_stats_t cbcDec = *aes_model_stats();
+    CHECK(out == data);
+
+    aes_model_reset(8);
+    Bytes nonce = iv;
+    REQUIRE(esp_aes_crypt_ctr(&keys.hw, len, &off, nonce.data(), stream.data(), data.data(), out.data()) == 0);
+    aes_model_stats_t ctr = *aes_model_stats();
+
+    for (auto* s : { &perBlock, &cbcEnc, &cbcDec, &ctr }) {
+        CHECK(s->blocks == blocks);
+        CHECK(s->violations == 0);
+    }
+    CHECK(cbcEnc.key_loads == 1);
+    CHECK(cbcEnc.lock_acquires == 1);
+    CHECK(ctr.key_loads == 1);
+
+    auto report = [&](const char* name, const aes_model_stats_t& s) {
+        cout << "  " << name << s.key_loads << " key loads, " << s.power_ups << " power-ups, "
+             << (double) s.reg_accesses / blocks << " register accesses/block" << endl;
+    };
+    cout << "16 KB record, " << blocks << " blocks:" << endl;
+    report("esp_aes_encrypt per block: ", perBlock);
+    report("esp_aes_crypt_cbc encrypt: ", cbcEnc);
+    report("esp_aes_crypt_cbc decrypt: ", cbcDec);
+    report("esp_aes_crypt_ctr:         ", ctr);
+}
@@ -107,6 +107,38 @@ BaseType_t xRingbufferSend(RingbufHandle_t ringbuf, void *data, size_t data_size
  */
 BaseType_t xRingbufferSendFromISR(RingbufHandle_t ringbuf, void *data, size_t data_size, BaseType_t *higher_prio_task_awoken);
 
+/**
+ * @brief  Get the free space at the write position of a ByteBuf type of ring buffer, to be filled in
+ *         place and published with vRingbufferWriteCommitFromISR. Call this from an ISR.
+ *
+ * The space returned is contiguous: when the free space wraps around the end of the storage, only the part
+ * up to the end is returned, and the rest is available after the commit. Nothing is reserved, so no other
+ * write to the ring buffer, in place or with xRingbufferSend/xRingbufferSendFromISR, may run between the
+ * acquire and its commit. Other writers are fine at any other time; the UART driver, for example, sends with
+ * xRingbufferSend only while its RX interrupt, which writes in place, is disabled.
+ *
+ * @param  ringbuf - Ring buffer to write into
+ * @param  space - Pointer to a variable to which the number of bytes available at the returned address is written
+ *
+ * @return Pointer to ring buffer storage, or NULL if the ring buffer is full.
+ */
+void *xRingbufferWriteAcquireFromISR(RingbufHandle_t ringbuf, size_t *space);
+
+
+/**
+ * @brief  Publish bytes written in place at the address returned by xRingbufferWriteAcquireFromISR.
+ *         Call this from an ISR.
+ *
+ * @param  ringbuf - Ring buffer written into
+ * @param  len - Number of bytes written, at most the space returned by xRingbufferWriteAcquireFromISR
+ * @param  higher_prio_task_awoken - Value pointed to will be set to pdTRUE if the commit woke up a higher
+ *                                     priority task.
+ *
+ * @return void
+ */
+void vRingbufferWriteCommitFromISR(RingbufHandle_t ringbuf, size_t len, BaseType_t *higher_prio_task_awoken);
+
+
 /**
  * @brief  Retrieve an item from the ring buffer
  *
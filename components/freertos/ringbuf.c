@@ -540,6 +540,40 @@ BaseType_t xRingbufferSendFromISR(RingbufHandle_t ringbuf, void *data, size_t da
 }
 
 
+void *xRingbufferWriteAcquireFromISR(RingbufHandle_t ringbuf, size_t *space)
+{
+    ringbuf_t *rb=(ringbuf_t *)ringbuf;
+    size_t free_len, rem_len;
+    configASSERT(rb);
+    configASSERT(rb->flags & flag_bytebuf);
+    portENTER_CRITICAL_ISR(&rb->mux);
+    free_len=ringbufferFreeMem(rb);
+    //Only hand out what is contiguous; the part at the start of the buffer comes after the commit.
+    rem_len=(rb->data + rb->size) - rb->write_ptr;
+    *space=(free_len < rem_len) ? free_len : rem_len;
+    portEXIT_CRITICAL_ISR(&rb->mux);
+    return (*space != 0) ? rb->write_ptr : NULL;
+}
+
+
+void vRingbufferWriteCommitFromISR(RingbufHandle_t ringbuf, size_t len, BaseType_t *higher_prio_task_awoken)
+{
+    ringbuf_t *rb=(ringbuf_t *)ringbuf;
+    configASSERT(rb);
+    if (len == 0) return;
+    portENTER_CRITICAL_ISR(&rb->mux);
+    configASSERT(len <= ringbufferFreeMem(rb));
+    configASSERT(len <= (rb->data + rb->size) - rb->write_ptr);
+    rb->write_ptr+=len;
+    //The buffer will wrap around if we're at the end.
+    if ((rb->data+rb->size)==rb->write_ptr) {
+        rb->write_ptr=rb->data;
+    }
+    portEXIT_CRITICAL_ISR(&rb->mux);
+    xSemaphoreGiveFromISR(rb->items_buffered_sem, higher_prio_task_awoken);
+}
+
+
 static void *xRingbufferReceiveGeneric(RingbufHandle_t ringbuf, size_t *item_size, TickType_t ticks_to_wait, size_t wanted_size) 
 {
     ringbuf_t *rb=(ringbuf_t *)ringbuf;
@@ -195,3 +195,52 @@ TEST_CASE("FreeRTOS ringbuffer test, w/ splitting items", "[freertos][ignore]")
     testRingbuffer(1);
 }
 
+
+TEST_CASE("FreeRTOS ringbuffer, bytebuf written in place", "[freertos]")
+{
+    RingbufHandle_t rb = xRingbufferCreate(64, RINGBUF_TYPE_BYTEBUF);
+    BaseType_t woken = pdFALSE;
+    size_t space, size;
+    uint8_t *dst, *item;
+
+    TEST_ASSERT_NOT_NULL(rb);
+    dst = xRingbufferWriteAcquireFromISR(rb, &space);
+    TEST_ASSERT_NOT_NULL(dst);
+    TEST_ASSERT_EQUAL(63, space);   //One byte always stays free
+    memset(dst, 'a', 40);
+    vRingbufferWriteCommitFromISR(rb, 40, &woken);
+    item = xRingbufferReceive(rb, &size, 0);
+    TEST_ASSERT_EQUAL_PTR(dst, item);
+    TEST_ASSERT_EQUAL(40, size);
+    vRingbufferReturnItem(rb, item);
+
+    //The free space now wraps around: first the part up to the end, then the start
+    dst = xRingbufferWriteAcquireFromISR(rb, &space);
+    TEST_ASSERT_EQUAL(24, space);
+    memset(dst, 'b', space);
+    vRingbufferWriteCommitFromISR(rb, space, &woken);
+    dst = xRingbufferWriteAcquireFromISR(rb, &space);
+    TEST_ASSERT_EQUAL(39, space);
+    memset(dst, 'c', 10);
+    vRingbufferWriteCommitFromISR(rb, 10, &woken);
+
+    item = xRingbufferReceive(rb, &size, 0);
+    TEST_ASSERT_EQUAL(24, size);
+    TEST_ASSERT_EQUAL('b', item[23]);
+    vRingbufferReturnItem(rb, item);
+    item = xRingbufferReceive(rb, &size, 0);
+    TEST_ASSERT_EQUAL(10, size);
+    TEST_ASSERT_EQUAL('c', item[0]);
+    vRingbufferReturnItem(rb, item);
+
+    //Fill up, in two slices as the free space wraps again
+    size = 0;
+    while ((dst = xRingbufferWriteAcquireFromISR(rb, &space)) != NULL) {
+        vRingbufferWriteCommitFromISR(rb, space, &woken);
+        size += space;
+    }
+    TEST_ASSERT_EQUAL(63, size);
+    TEST_ASSERT_NULL(xRingbufferWriteAcquireFromISR(rb, &space));
+    TEST_ASSERT_EQUAL(0, space);
+    vRingbufferDelete(rb);
+}
@@ -85,6 +85,9 @@ typedef struct {
 	unsigned int pos; /* offset in the JSON string */
 	unsigned int toknext; /* next token to allocate */
 	int toksuper; /* superior token node, e.g parent object or array */
+	unsigned int base; /* stream offset of the chunk being fed (jsmn_parse_chunk) */
+	int tokstart; /* stream offset of an unfinished string or primitive */
+	int state; /* scanner state inside that string or primitive */
 } jsmn_parser;
 
 /**
@@ -99,6 +102,27 @@ void jsmn_init(jsmn_parser *parser);
 int jsmn_parse(jsmn_parser *parser, const char *js, size_t len,
 		jsmntok_t *tokens, unsigned int num_tokens);
 
+/**
+ * Incremental variant of jsmn_parse for a document that arrives in pieces, e.g. TLS records.
+ * Feed consecutive chunks to the same parser; a chunk need not be kept once it has been
+ * fed. Token offsets count from the start of the whole stream, and strings or primitives
+ * split across chunks are completed when their end arrives. Feed a zero-length chunk to
+ * signal end of input (needed only for a bare top-level primitive).
+ *
+ * Returns the number of tokens once the document is complete, JSMN_ERROR_PART while more
+ * input is expected, or JSMN_ERROR_INVAL. On JSMN_ERROR_NOMEM, copy the tokens into a
+ * larger array and feed the same chunk again: the bytes already consumed are skipped.
+ * tokens must not be NULL.
+ */
+int jsmn_parse_chunk(jsmn_parser *parser, const char *chunk, size_t len,
+		jsmntok_t *tokens, unsigned int num_tokens);
+
+/**
+ * Returns the offset of the first '"', '\\' or NUL in js[0..len), or len if there is none.
+ * Uses SSE2 or NEON where available and a word-at-a-time scan otherwise.
+ */
+size_t jsmn_scan_string(const char *js, size_t len);
+
 #ifdef __cplusplus
 }
 #endif
@@ -29,6 +29,28 @@
  */
 
 #include "jsmn.h"
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SSE2__) && !defined(JSMN_SCAN_WORDWISE)
+#include <emmintrin.h>
+#define JSMN_SCAN_SSE2
+#elif defined(__ARM_NEON) && !defined(JSMN_SCAN_WORDWISE)
+#include <arm_neon.h>
+#define JSMN_SCAN_NEON
+#endif
+
+/* Scanner states of jsmn_parse_chunk inside an unfinished string or primitive */
+enum {
+	JSMN_STATE_NONE = 0,
+	JSMN_STATE_STRING,
+	JSMN_STATE_STRING_ESCAPE,
+	JSMN_STATE_STRING_HEX1,
+	JSMN_STATE_STRING_HEX2,
+	JSMN_STATE_STRING_HEX3,
+	JSMN_STATE_STRING_HEX4,
+	JSMN_STATE_PRIMITIVE
+};
 
 /**
  * Allocates a fresh unused token from the token pull.
@@ -59,6 +81,117 @@ static void jsmn_fill_token(jsmntok_t *token, jsmntype_t type,
 	token->size = 0;
 }
 
+/**
+ * Opens an object or array token at stream offset pos.
+ */
+static int jsmn_open(jsmn_parser *parser, char c, int pos,
+		jsmntok_t *tokens, size_t num_tokens) {
+	jsmntok_t *token;
+	token = jsmn_alloc_token(parser, tokens, num_tokens);
+	if (token == NULL)
+		return JSMN_ERROR_NOMEM;
+	if (parser->toksuper != -1) {
+		tokens[parser->toksuper].size++;
+#ifdef JSMN_PARENT_LINKS
+		token->parent = parser->toksuper;
+#endif
+	}
+	token->type = (c == '{' ? JSMN_OBJECT : JSMN_ARRAY);
+	token->start = pos;
+	parser->toksuper = parser->toknext - 1;
+	return 0;
+}
+
+/**
+ * Closes the innermost open object or array with the bracket at stream offset pos.
+ */
+static int jsmn_close(jsmn_parser *parser, char c, int pos,
+		jsmntok_t *tokens) {
+	jsmntok_t *token;
+	jsmntype_t type;
+	type = (c == '}' ? JSMN_OBJECT : JSMN_ARRAY);
+#ifdef JSMN_PARENT_LINKS
+	if (parser->toknext < 1) {
+		return JSMN_ERROR_INVAL;
+	}
+	token = &tokens[parser->toknext - 1];
+	for (;;) {
+		if (token->start != -1 && token->end == -1) {
+			if (token->type != type) {
+				return JSMN_ERROR_INVAL;
+			}
+			token->end = pos + 1;
+			parser->toksuper = token->parent;
+			break;
+		}
+		if (token->parent == -1) {
+			break;
+		}
+		token = &tokens[token->parent];
+	}
+#else
+	int i;
+	for (i = parser->toknext - 1; i >= 0; i--) {
+		token = &tokens[i];
+		if (token->start != -1 && token->end == -1) {
+			if (token->type != type) {
+				return JSMN_ERROR_INVAL;
+			}
+			parser->toksuper = -1;
+			token->end = pos + 1;
+			break;
+		}
+	}
+	/* Error if unmatched closing bracket */
+	if (i == -1) return JSMN_ERROR_INVAL;
+	for (; i >= 0; i--) {
+		token = &tokens[i];
+		if (token->start != -1 && token->end == -1) {
+			parser->toksuper = i;
+			break;
+		}
+	}
+#endif
+	return 0;
+}
+
+/**
+ * After a value separator, makes the enclosing object or array the superior token again.
+ */
+static void jsmn_comma(jsmn_parser *parser, jsmntok_t *tokens) {
+	if (parser->toksuper != -1 &&
+			tokens[parser->toksuper].type != JSMN_ARRAY &&
+			tokens[parser->toksuper].type != JSMN_OBJECT) {
+#ifdef JSMN_PARENT_LINKS
+		parser->toksuper = tokens[parser->toksuper].parent;
+#else
+		int i;
+		for (i = parser->toknext - 1; i >= 0; i--) {
+			if (tokens[i].type == JSMN_ARRAY || tokens[i].type == JSMN_OBJECT) {
+				if (tokens[i].start != -1 && tokens[i].end == -1) {
+					parser->toksuper = i;
+					break;
+				}
+			}
+		}
+#endif
+	}
+}
+
+#ifdef JSMN_STRICT
+/**
+ * In strict mode primitives must not be keys of an object.
+ */
+static int jsmn_primitive_is_key(jsmn_parser *parser, jsmntok_t *tokens) {
+	jsmntok_t *t;
+	if (parser->toksuper == -1) {
+		return 0;
+	}
+	t = &tokens[parser->toksuper];
+	return t->type == JSMN_OBJECT || (t->type == JSMN_STRING && t->size != 0);
+}
+#endif
+
 /**
  * Fills next available token with JSON primitive.
  */
@@ -182,12 +315,10 @@ int jsmn_parse(jsmn_parser *parser, const char *js, size_t len,
 		jsmntok_t *tokens, unsigned int num_tokens) {
 	int r;
 	int i;
-	jsmntok_t *token;
 	int count = parser->toknext;
 
 	for (; parser->pos < len && js[parser->pos] != '\0'; parser->pos++) {
 		char c;
-		jsmntype_t type;
 
 		c = js[parser->pos];
 		switch (c) {
@@ -196,64 +327,14 @@ int jsmn_parse(jsmn_parser *parser, const char *js, size_t len,
 				if (tokens == NULL) {
 					break;
 				}
-				token = jsmn_alloc_token(parser, tokens, num_tokens);
-				if (token == NULL)
-					return JSMN_ERROR_NOMEM;
-				if (parser->toksuper != -1) {
-					tokens[parser->toksuper].size++;
-#ifdef JSMN_PARENT_LINKS
-					token->parent = parser->toksuper;
-#endif
-				}
-				token->type = (c == '{' ? JSMN_OBJECT : JSMN_ARRAY);
-				token->start = parser->pos;
-				parser->toksuper = parser->toknext - 1;
+				r = jsmn_open(parser, c, parser->pos, tokens, num_tokens);
+				if (r < 0) return r;
 				break;
 			case '}': case ']':
 				if (tokens == NULL)
 					break;
-				type = (c == '}' ? JSMN_OBJECT : JSMN_ARRAY);
-#ifdef JSMN_PARENT_LINKS
-				if (parser->toknext < 1) {
-					return JSMN_ERROR_INVAL;
-				}
-				token = &tokens[parser->toknext - 1];
-				for (;;) {
-					if (token->start != -1 && token->end == -1) {
-						if (token->type != type) {
-							return JSMN_ERROR_INVAL;
-						}
-						token->end = parser->pos + 1;
-						parser->toksuper = token->parent;
-						break;
-					}
-					if (token->parent == -1) {
-						break;
-					}
-					token = &tokens[token->parent];
-				}
-#else
-				for (i = parser->toknext - 1; i >= 0; i--) {
-					token = &tokens[i];
-					if (token->start != -1 && token->end == -1) {
-						if (token->type != type) {
-							return JSMN_ERROR_INVAL;
-						}
-						parser->toksuper = -1;
-						token->end = parser->pos + 1;
-						break;
-					}
-				}
-				/* Error if unmatched closing bracket */
-				if (i == -1) return JSMN_ERROR_INVAL;
-				for (; i >= 0; i--) {
-					token = &tokens[i];
-					if (token->start != -1 && token->end == -1) {
-						parser->toksuper = i;
-						break;
-					}
-				}
-#endif
+				r = jsmn_close(parser, c, parser->pos, tokens);
+				if (r < 0) return r;
 				break;
 			case '\"':
 				r = jsmn_parse_string(parser, js, len, tokens, num_tokens);
@@ -268,22 +349,8 @@ int jsmn_parse(jsmn_parser *parser, const char *js, size_t len,
 				parser->toksuper = parser->toknext - 1;
 				break;
 			case ',':
-				if (tokens != NULL && parser->toksuper != -1 &&
-						tokens[parser->toksuper].type != JSMN_ARRAY &&
-						tokens[parser->toksuper].type != JSMN_OBJECT) {
-#ifdef JSMN_PARENT_LINKS
-					parser->toksuper = tokens[parser->toksuper].parent;
-#else
-					for (i = parser->toknext - 1; i >= 0; i--) {
-						if (tokens[i].type == JSMN_ARRAY || tokens[i].type == JSMN_OBJECT) {
-							if (tokens[i].start != -1 && tokens[i].end == -1) {
-								parser->toksuper = i;
-								break;
-							}
-						}
-					}
-#endif
-				}
+				if (tokens != NULL)
+					jsmn_comma(parser, tokens);
 				break;
 #ifdef JSMN_STRICT
 			/* In strict mode primitives are: numbers and booleans */
@@ -291,12 +358,8 @@ int jsmn_parse(jsmn_parser *parser, const char *js, size_t len,
 			case '5': case '6': case '7' : case '8': case '9':
 			case 't': case 'f': case 'n' :
 				/* And they must not be keys of the object */
-				if (tokens != NULL && parser->toksuper != -1) {
-					jsmntok_t *t = &tokens[parser->toksuper];
-					if (t->type == JSMN_OBJECT ||
-							(t->type == JSMN_STRING && t->size != 0)) {
-						return JSMN_ERROR_INVAL;
-					}
+				if (tokens != NULL && jsmn_primitive_is_key(parser, tokens)) {
+					return JSMN_ERROR_INVAL;
 				}
 #else
 			/* In non-strict mode every unquoted value is a primitive */
@@ -329,6 +392,245 @@ int jsmn_parse(jsmn_parser *parser, const char *js, size_t len,
 	return count;
 }
 
+#define JSMN_ONES		((uintptr_t)-1 / 0xff)
+#define JSMN_HAS_ZERO(w)	(((w) - JSMN_ONES) & ~(w) & (JSMN_ONES * 0x80))
+
+/**
+ * Finds the first '"', '\\' or NUL in js[0..len), or returns len.
+ */
+size_t jsmn_scan_string(const char *js, size_t len) {
+	size_t i = 0;
+#if defined(JSMN_SCAN_SSE2)
+	const __m128i quote = _mm_set1_epi8('\"');
+	const __m128i backslash = _mm_set1_epi8('\\');
+	const __m128i zero = _mm_setzero_si128();
+	for (; i + 16 <= len; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(js + i));
+		int mask = _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(
+				_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)),
+				_mm_cmpeq_epi8(v, zero)));
+		if (mask != 0) {
+			return i + __builtin_ctz(mask);
+		}
+	}
+#elif defined(JSMN_SCAN_NEON)
+	const uint8x16_t quote = vdupq_n_u8('\"');
+	const uint8x16_t backslash = vdupq_n_u8('\\');
+	for (; i + 16 <= len; i += 16) {
+		uint8x16_t v = vld1q_u8((const uint8_t *)(js + i));
+		uint8x16_t hit = vorrq_u8(vorrq_u8(vceqq_u8(v, quote), vceqq_u8(v, backslash)),
+				vceqq_u8(v, vdupq_n_u8(0)));
+		uint64x2_t lanes = vreinterpretq_u64_u8(hit);
+		if ((vgetq_lane_u64(lanes, 0) | vgetq_lane_u64(lanes, 1)) != 0) {
+			break;
+		}
+	}
+#else
+	/* Word at a time: align, then test a machine word for any of the three bytes */
+	for (; i < len && ((uintptr_t)(js + i) & (sizeof(uintptr_t) - 1)) != 0; i++) {
+		if (js[i] == '\"' || js[i] == '\\' || js[i] == '\0') {
+			return i;
+		}
+	}
+	for (; i + sizeof(uintptr_t) <= len; i += sizeof(uintptr_t)) {
+		uintptr_t w = *(const uintptr_t *)(js + i);
+		if (JSMN_HAS_ZERO(w) || JSMN_HAS_ZERO(w ^ (JSMN_ONES * '\"')) ||
+				JSMN_HAS_ZERO(w ^ (JSMN_ONES * '\\'))) {
+			break;
+		}
+	}
+#endif
+	for (; i < len; i++) {
+		if (js[i] == '\"' || js[i] == '\\' || js[i] == '\0') {
+			break;
+		}
+	}
+	return i;
+}
+
+/**
+ * Completes the pending string or primitive token ending at stream offset end.
+ */
+static int jsmn_finish_token(jsmn_parser *parser, jsmntype_t type, int end,
+		jsmntok_t *tokens, size_t num_tokens) {
+	jsmntok_t *token;
+	token = jsmn_alloc_token(parser, tokens, num_tokens);
+	if (token == NULL) {
+		return JSMN_ERROR_NOMEM;
+	}
+	jsmn_fill_token(token, type, parser->tokstart, end);
+#ifdef JSMN_PARENT_LINKS
+	token->parent = parser->toksuper;
+#endif
+	if (parser->toksuper != -1) {
+		tokens[parser->toksuper].size++;
+	}
+	parser->state = JSMN_STATE_NONE;
+	parser->tokstart = -1;
+	return 0;
+}
+
+/**
+ * Result once the input fed so far has been consumed.
+ */
+static int jsmn_chunk_result(jsmn_parser *parser, jsmntok_t *tokens) {
+	int i;
+	if (parser->state != JSMN_STATE_NONE) {
+		return JSMN_ERROR_PART;
+	}
+	for (i = parser->toknext - 1; i >= 0; i--) {
+		/* Unmatched opened object or array */
+		if (tokens[i].start != -1 && tokens[i].end == -1) {
+			return JSMN_ERROR_PART;
+		}
+	}
+	return parser->toknext;
+}
+
+/**
+ * Feed the next chunk of a JSON document.
+ */
+int jsmn_parse_chunk(jsmn_parser *parser, const char *chunk, size_t len,
+		jsmntok_t *tokens, unsigned int num_tokens) {
+	size_t i;
+	int r;
+
+	if (tokens == NULL) {
+		return JSMN_ERROR_INVAL;
+	}
+
+	if (len == 0) {
+		/* End of input: a trailing top-level primitive is complete */
+		if (parser->state == JSMN_STATE_PRIMITIVE) {
+#ifdef JSMN_STRICT
+			return JSMN_ERROR_PART;
+#else
+			r = jsmn_finish_token(parser, JSMN_PRIMITIVE, parser->pos, tokens, num_tokens);
+			if (r < 0) return r;
+#endif
+		}
+		return jsmn_chunk_result(parser, tokens);
+	}
+
+	/* Bytes before parser->pos were consumed by an earlier call that ran out of tokens */
+	for (i = parser->pos - parser->base; i < len && chunk[i] != '\0'; i++) {
+		char c = chunk[i];
+		int pos = parser->base + i;
+
+		parser->pos = pos;
+		switch (parser->state) {
+			case JSMN_STATE_STRING:
+				i += jsmn_scan_string(chunk + i, len - i);
+				if (i == len || chunk[i] == '\0') {
+					goto consumed;
+				}
+				if (chunk[i] == '\\') {
+					parser->state = JSMN_STATE_STRING_ESCAPE;
+					continue;
+				}
+				parser->pos = parser->base + i;
+				r = jsmn_finish_token(parser, JSMN_STRING, parser->pos, tokens, num_tokens);
+				if (r < 0) return r;
+				continue;
+			case JSMN_STATE_STRING_ESCAPE:
+				switch (c) {
+					/* Allowed escaped symbols */
+					case '\"': case '/' : case '\\' : case 'b' :
+					case 'f' : case 'r' : case 'n'  : case 't' :
+						parser->state = JSMN_STATE_STRING;
+						continue;
+					/* Allows escaped symbol \uXXXX */
+					case 'u':
+						parser->state = JSMN_STATE_STRING_HEX1;
+						continue;
+					/* Unexpected symbol */
+					default:
+						return JSMN_ERROR_INVAL;
+				}
+			case JSMN_STATE_STRING_HEX1: case JSMN_STATE_STRING_HEX2:
+			case JSMN_STATE_STRING_HEX3: case JSMN_STATE_STRING_HEX4:
+				/* If it isn't a hex character we have an error */
+				if (!((c >= 48 && c <= 57) || /* 0-9 */
+							(c >= 65 && c <= 70) || /* A-F */
+							(c >= 97 && c <= 102))) { /* a-f */
+					return JSMN_ERROR_INVAL;
+				}
+				parser->state = (parser->state == JSMN_STATE_STRING_HEX4) ?
+					JSMN_STATE_STRING : parser->state + 1;
+				continue;
+			case JSMN_STATE_PRIMITIVE:
+				switch (c) {
+#ifndef JSMN_STRICT
+					case ':':
+#endif
+					case '\t' : case '\r' : case '\n' : case ' ' :
+					case ','  : case ']'  : case '}' :
+						r = jsmn_finish_token(parser, JSMN_PRIMITIVE, pos, tokens, num_tokens);
+						if (r < 0) return r;
+						break; /* the terminator is structural, handle it below */
+					default:
+						if (c < 32 || c >= 127) {
+							return JSMN_ERROR_INVAL;
+						}
+						continue;
+				}
+				break;
+		}
+
+		switch (c) {
+			case '{': case '[':
+				r = jsmn_open(parser, c, pos, tokens, num_tokens);
+				if (r < 0) return r;
+				break;
+			case '}': case ']':
+				r = jsmn_close(parser, c, pos, tokens);
+				if (r < 0) return r;
+				break;
+			case '\"':
+				parser->state = JSMN_STATE_STRING;
+				parser->tokstart = pos + 1;
+				break;
+			case '\t' : case '\r' : case '\n' : case ' ':
+				break;
+			case ':':
+				parser->toksuper = parser->toknext - 1;
+				break;
+			case ',':
+				jsmn_comma(parser, tokens);
+				break;
+#ifdef JSMN_STRICT
+			/* In strict mode primitives are: numbers and booleans */
+			case '-': case '0': case '1' : case '2': case '3' : case '4':
+			case '5': case '6': case '7' : case '8': case '9':
+			case 't': case 'f': case 'n' :
+				/* And they must not be keys of the object */
+				if (jsmn_primitive_is_key(parser, tokens)) {
+					return JSMN_ERROR_INVAL;
+				}
+#else
+			/* In non-strict mode every unquoted value is a primitive */
+			default:
+#endif
+				if (c < 32 || c >= 127) {
+					return JSMN_ERROR_INVAL;
+				}
+				parser->state = JSMN_STATE_PRIMITIVE;
+				parser->tokstart = pos;
+				break;
+#ifdef JSMN_STRICT
+			/* Unexpected char in strict mode */
+			default:
+				return JSMN_ERROR_INVAL;
+#endif
+		}
+	}
+
+consumed:
+	parser->base += len;
+	parser->pos = parser->base;
+	return jsmn_chunk_result(parser, tokens);
+}
+
 /**
  * Creates a new parser based over a given  buffer with an array of tokens
  * available.
@@ -337,5 +639,8 @@ void jsmn_init(jsmn_parser *parser) {
 	parser->pos = 0;
 	parser->toknext = 0;
 	parser->toksuper = -1;
+	parser->base = 0;
+	parser->tokstart = -1;
+	parser->state = JSMN_STATE_NONE;
 }
 
@@ -0,0 +1,320 @@
+// Copyright 2015-2017 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "catch.hpp"
+#include "jsmn.h"
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+struct ParseResult {
+    int ret;
+    vector<jsmntok_t> tokens;
+};
+
+static bool sameTokens(const ParseResult& a, const ParseResult& b)
+{
+    if (a.ret != b.ret) {
+        return false;
+    }
+    for (int i = 0; i < a.ret; ++i) {
+        const jsmntok_t& x = a.tokens[i];
+        const jsmntok_t& y = b.tokens[i];
+        if (x.type != y.type || x.start != y.start || x.end != y.end || x.size != y.size) {
+            return false;
+        }
+#ifdef JSMN_PARENT_LINKS
+        if (x.parent != y.parent) {
+            return false;
+        }
+#endif
+    }
+    return true;
+}
+
+static ParseResult parseWhole(const string& doc)
+{
+    ParseResult result;
+    jsmn_parser parser;
+    jsmn_init(&parser);
+    result.tokens.resize(doc.size() + 1);
+    result.ret = jsmn_parse(&parser, doc.c_str(), doc.size(), result.tokens.data(), result.tokens.size());
+    return result;
+}
+
+/* Feeds doc in pieces of the given sizes (cycled), starting with few tokens and growing on NOMEM. */
+static ParseResult parseChunked(const string& doc, const vector<size_t>& sizes, size_t initialTokens = 1,
+                                size_t* nomemCount = NULL)
+{
+    ParseResult result;
+    jsmn_parser parser;
+    jsmn_init(&parser);
+    result.tokens.resize(initialTokens);
+    result.ret = JSMN_ERROR_PART;
+    size_t offset = 0;
+    size_t next = 0;
+    while (offset < doc.size()) {
+        size_t len = min(sizes[next++ % sizes.size()], doc.size() - offset);
+        /* Each record lives only for the duration of the call, like a TLS read buffer */
+        vector<char> record(doc.begin() + offset, doc.begin() + offset + len);
+        while ((result.ret = jsmn_parse_chunk(&parser, record.data(), len, result.tokens.data(),
+                                              result.tokens.size())) == JSMN_ERROR_NOMEM) {
+            result.tokens.resize(result.tokens.size() * 2);
+            if (nomemCount) {
+                ++*nomemCount;
+            }
+        }
+        if (result.ret == JSMN_ERROR_INVAL) {
+            return result;
+        }
+        offset += len;
+    }
+    while ((result.ret = jsmn_parse_chunk(&parser, NULL, 0, result.tokens.data(), result.tokens.size())) ==
+            JSMN_ERROR_NOMEM) {
+        result.tokens.resize(result.tokens.size() * 2);
+    }
+    return result;
+}
+
+static const char* s_corpus[] = {
+    "{}",
+    "[]",
+    "{\"a\":1}",
+    "{\"a\":\"b\",\"c\":[1,2,{\"d\":null}],\"e\":true,\"f\":false}",
+    "  [ 1 , -2.5e3 , \"x\\\"y\" , [ ] , { } ]  ",
+    "{\"esc\":\"\\\\\\/\\b\\f\\n\\r\\t\\u00e9\\uD83D\\uDE00\"}",
+    "[[[[[[[[1]]]]]]]]",
+    "\"top level string\"",
+    "12345",
+    "true",
+    "{\"a\":1,\"b\":2,}",
+    "[1,2",
+    "{\"a\":\"unterminated",
+    "{\"a\":\"bad escape \\q\"}",
+    "{\"a\":\"bad hex \\u12G4\"}",
+    "{\"a\":\"short hex \\u12",
+    "{\"a\":\"trailing backslash\\",
+    "[1,2]]",
+    "{\"a\":[1,2}",
+    "[\x01]",
+    "{\"key\" 1}",
+    "{1:2}",
+    "[tru, nul, fals]",
+    "{\"a\":{\"b\":{\"c\":[\"d\",\"e\",{\"f\":\"g\"}]}},\"h\":\"i\"}",
+};
+
+static string randomString(mt19937& rng)
+{
+    static const char* pieces[] = { "a", "Z", " ", "\\\"", "\\\\", "\\n", "\\u00fc", "\\uABCD", "long text ", "/" };
+    string s = "\"";
+    int n = rng() % 40;
+    for (int i = 0; i < n; ++i) {
+        s += pieces[rng() % 10];
+    }
+    return s + "\"";
+}
+
+static string randomValue(mt19937& rng, int depth)
+{
+    int kind = rng() % (depth > 4 ? 4 : 6);
+    switch (kind) {
+    case 0: return to_string((int) rng() % 100000 - 50000);
+    case 1: return randomString(rng);
+    case 2: return rng() % 2 ? "true" : "null";
+    case 3: return "-" + to_string(rng() % 1000) + ".25e-" + to_string(rng() % 9);
+    case 4: {
+        string s = "[";
+        int n = rng() % 8;
+        for (int i = 0; i < n; ++i) {
+            s += (i ? "," : "") + randomValue(rng, depth + 1);
+        }
+        return s + (rng() % 2 ? " ]" : "]");
+    }
+    default: {
+        string s = "{";
+        int n = rng() % 8;
+        for (int i = 0; i < n; ++i) {
+            s += (i ? ", " : "") + randomString(rng) + ":" + randomValue(rng, depth + 1);
+        }
+        return s + "}";
+    }
+    }
+}
+
+static string randomDocument(mt19937& rng)
+{
+    string s = "{";
+    for (int i = 0; i < 20; ++i) {
+        s += (i ? "," : "") + randomString(rng) + ":" + randomValue(rng, 1);
+    }
+    return s + "}";
+}
+
+TEST_CASE("chunked parse matches jsmn_parse on the corpus", "[jsmn]")
+{
+    const vector<vector<size_t>> splits = { { 1 }, { 2 }, { 3 }, { 7 }, { 1, 5, 2 }, { 1500 } };
+    for (const char* doc : s_corpus) {
+        ParseResult whole = parseWhole(doc);
+        for (auto& sizes : splits) {
+            ParseResult chunked = parseChunked(doc, sizes, 64);
+            INFO("document: " << doc << ", first chunk size " << sizes[0]);
+            CHECK(sameTokens(whole, chunked));
+        }
+    }
+}
+
+TEST_CASE("chunked parse matches jsmn_parse on random documents", "[jsmn]")
+{
+    mt19937 rng(42);
+    for (int n = 0; n < 300; ++n) {
+        string doc = randomDocument(rng);
+        /* Some documents are cut short or get a byte flipped, to compare error paths too */
+        if (n % 3 == 1) {
+            doc.resize(rng() % doc.size());
+        } else if (n % 3 == 2) {
+            doc[rng() % doc.size()] = "{}[]\",:\\ x"[rng() % 10];
+        }
+        ParseResult whole = parseWhole(doc);
+        vector<size_t> sizes = { 1 + rng() % 5, 1 + rng() % 100, 1 + rng() % 2000 };
+        ParseResult chunked = parseChunked(doc, sizes);
+        INFO("document: " << doc);
+        REQUIRE(sameTokens(whole, chunked));
+    }
+}
+
+TEST_CASE("chunked parse resumes after running out of tokens", "[jsmn]")
+{
+    mt19937 rng(7);
+    string doc = randomDocument(rng);
+    size_t nomem = 0;
+    ParseResult whole = parseWhole(doc);
+    ParseResult chunked = parseChunked(doc, { 1460 }, 1, &nomem);
+    REQUIRE(whole.ret > 16);
+    CHECK(nomem > 3);
+    CHECK(sameTokens(whole, chunked));
+}
+
+TEST_CASE("chunked parse reports progress while input is pending", "[jsmn]")
+{
+    jsmntok_t tokens[8];
+    jsmn_parser parser;
+    jsmn_init(&parser);
+    CHECK(jsmn_parse_chunk(&parser, "{\"na", 4, tokens, 8) == JSMN_ERROR_PART);
+    CHECK(jsmn_parse_chunk(&parser, "me\":\"pi", 7, tokens, 8) == JSMN_ERROR_PART);
+    CHECK(jsmn_parse_chunk(&parser, "ngzee\"}", 7, tokens, 8) == 3);
+    CHECK(tokens[1].start == 2);
+    CHECK(tokens[1].end == 6);
+    CHECK(tokens[2].start == 9);
+    CHECK(tokens[2].end == 16);
+    CHECK(tokens[0].end == 18);
+    CHECK(jsmn_parse_chunk(&parser, "x", 1, NULL, 0) == JSMN_ERROR_INVAL);
+
+    jsmn_init(&parser);
+    CHECK(jsmn_parse_chunk(&parser, "[12", 3, tokens, 8) == JSMN_ERROR_PART);
+    CHECK(jsmn_parse_chunk(&parser, "34]", 3, tokens, 8) == 2);
+    CHECK(tokens[1].start == 1);
+    CHECK(tokens[1].end == 5);
+}
+
+static size_t scanReference(const char* js, size_t len)
+{
+    size_t i = 0;
+    while (i < len && js[i] != '"' && js[i] != '\\' && js[i] != '\0') {
+        ++i;
+    }
+    return i;
+}
+
+TEST_CASE("string scanner finds the first special byte at any alignment", "[jsmn][scan]")
+{
+    mt19937 rng(1);
+    vector<char> buf(256 + 16);
+    for (int n = 0; n < 2000; ++n) {
+        for (auto& c : buf) {
+            c = 'a' + rng() % 26;
+        }
+        size_t offset = rng() % 16;
+        size_t len = rng() % 200;
+        int specials = rng() % 3;
+        for (int i = 0; i < specials; ++i) {
+            buf[offset + rng() % (len + 1)] = "\"\\\0"[rng() % 3];
+        }
+        buf[offset + len + rng() % 8] = '"'; /* bytes past len must be ignored */
+        REQUIRE(jsmn_scan_string(&buf[offset], len) == scanReference(&buf[offset], len));
+    }
+    CHECK(jsmn_scan_string("", 0) == 0);
+    CHECK(jsmn_scan_string("\xff\x80\x22", 3) == 2);
+}
+
+template<typename F>
+static double throughputMBps(size_t bytes, int iterations, F fn)
+{
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        fn();
+    }
+    double us = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+    return bytes * (double) iterations / us;
+}
+
+TEST_CASE("chunked parse and scanner benchmark", "[jsmn][bench]")
+{
+    mt19937 rng(3);
+    string doc = "[";
+    while (doc.size() < 64 * 1024) {
+        doc += (doc.size() > 1 ? "," : "") + randomDocument(rng);
+    }
+    doc += "]";
+    const int iterations = 50;
+    vector<jsmntok_t> tokens(doc.size());
+    int expected = parseWhole(doc).ret;
+    REQUIRE(expected > 0);
+
+    double whole = throughputMBps(doc.size(), iterations, [&]() {
+        jsmn_parser parser;
+        jsmn_init(&parser);
+        REQUIRE(jsmn_parse(&parser, doc.c_str(), doc.size(), tokens.data(), tokens.size()) == expected);
+    });
+    double chunked = throughputMBps(doc.size(), iterations, [&]() {
+        jsmn_parser parser;
+        jsmn_init(&parser);
+        int r = JSMN_ERROR_PART;
+        for (size_t offset = 0; offset < doc.size(); offset += 1460) {
+            r = jsmn_parse_chunk(&parser, doc.c_str() + offset, min<size_t>(1460, doc.size() - offset),
+                                 tokens.data(), tokens.size());
+        }
+        REQUIRE(r == expected);
+    });
+
+    string text(64 * 1024, 'x');
+    size_t sink = 0;
+    double scanRef = throughputMBps(text.size(), iterations * 10, [&]() {
+        sink += scanReference(text.c_str(), text.size());
+        asm volatile("" : : "r"(sink) : "memory");
+    });
+    double scan = throughputMBps(text.size(), iterations * 10, [&]() {
+        sink += jsmn_scan_string(text.c_str(), text.size());
+        asm volatile("" : : "r"(sink) : "memory");
+    });
+
+    cout << "jsmn on " << doc.size() << " bytes, " << expected << " tokens:" << endl;
+    cout << "  jsmn_parse (whole buffer):      " << whole << " MB/s" << endl;
+    cout << "  jsmn_parse_chunk (1460 B recs): " << chunked << " MB/s" << endl;
+    cout << "  string scan bytewise:           " << scanRef << " MB/s" << endl;
+    cout << "  jsmn_scan_string:               " << scan << " MB/s" << endl;
+}
@@ -54,6 +54,17 @@ typedef struct cJSON {
 	char *string;				/* The item's name string, if this item is the child of, or is in the list of subitems of an object. */
 } cJSON;
 
+/* Lookup index over the children of one array/object, kept in caller-provided slots. Rebuild it after modifying the array/object. */
+typedef struct cJSON_Index {
+	cJSON *object;				/* The indexed array/object. */
+	cJSON **slots;				/* Hash table (objects) or child vector (arrays). */
+	int size;					/* Number of slots. */
+	int count;					/* Number of children indexed. */
+} cJSON_Index;
+
+/* A comfortable slot count for indexing an object or array with n children. */
+#define cJSON_IndexSlots(n)		(2*(n)+1)
+
 typedef struct cJSON_Hooks {
       void *(*malloc_fn)(size_t sz);
       void (*free_fn)(void *ptr);
@@ -71,6 +82,12 @@ extern char  *cJSON_Print(cJSON *item);
 extern char  *cJSON_PrintUnformatted(cJSON *item);
 /* Render a cJSON entity to text using a buffered strategy. prebuffer is a guess at the final size. guessing well reduces reallocation. fmt=0 gives unformatted, =1 gives formatted */
 extern char *cJSON_PrintBuffered(cJSON *item,int prebuffer,int fmt);
+/* Receives each filled chunk of streamed output. Return 0 to abort printing. */
+typedef int (*cJSON_WriteFn)(void *ctx,const char *data,size_t len);
+/* Render a cJSON entity to text without building it in memory: output is staged in chunk (chunk_size bytes, no heap is used)
+and passed to write each time it fills, plus once at the end. Produces the same bytes as cJSON_Print (fmt=1) or
+cJSON_PrintUnformatted (fmt=0), minus the terminating NUL. Returns 1 on success, 0 if write failed. */
+extern int    cJSON_PrintStream(cJSON *item,int fmt,char *chunk,size_t chunk_size,cJSON_WriteFn write,void *ctx);
 /* Delete a cJSON entity and all subentities. */
 extern void   cJSON_Delete(cJSON *c);
 
@@ -81,6 +98,13 @@ extern cJSON *cJSON_GetArrayItem(cJSON *array,int item);
 /* Get item "string" from object. Case insensitive. */
 extern cJSON *cJSON_GetObjectItem(cJSON *object,const char *string);
 
+/* Build an index over array/object using size slots. Objects need more slots than children, arrays at least as many. Returns 1 on success, 0 if slots are too few. */
+extern int    cJSON_IndexBuild(cJSON_Index *index,cJSON *object,cJSON **slots,int size);
+/* Hashed equivalent of cJSON_GetObjectItem. Case insensitive. */
+extern cJSON *cJSON_IndexGetObjectItem(const cJSON_Index *index,const char *string);
+/* Constant-time equivalent of cJSON_GetArrayItem for an indexed array. */
+extern cJSON *cJSON_IndexGetArrayItem(const cJSON_Index *index,int item);
+
 /* For analysing failed parses. This returns a pointer to the parse error. You'll probably need to look a few chars back to make sense of it. Defined when cJSON_Parse() returns 0. 0 when cJSON_Parse() succeeds. */
 extern const char *cJSON_GetErrorPtr(void);
 	
@@ -129,6 +153,12 @@ The item->next and ->prev pointers are always zero on return from Duplicate. */
 /* ParseWithOpts allows you to require (and check) that the JSON is null terminated, and to retrieve the pointer to the final byte parsed. */
 extern cJSON *cJSON_ParseWithOpts(const char *value,const char **return_parse_end,int require_null_terminated);
 
+/* Parse value in place without touching the heap: strings are unescaped into value itself and nodes are taken from the
+nodes arena (max_nodes entries, one per JSON value). The result borrows both buffers, so never cJSON_Delete it; just
+drop the arena and the text together. Returns 0 if the text is malformed or the arena is too small; used_nodes, if not
+NULL, receives the number of arena entries consumed. Not reentrant, like cJSON_Parse. */
+extern cJSON *cJSON_ParseInSitu(char *value,cJSON *nodes,int max_nodes,int *used_nodes);
+
 extern void cJSON_Minify(char *json);
 
 /* Macros for creating things quickly. */
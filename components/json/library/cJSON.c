@@ -77,6 +77,20 @@ static cJSON *cJSON_New_Item(void)
 	return node;
 }
 
+/* In-situ parsing: nodes come from the caller's arena and strings are unescaped in place.
+   Passed down the parser, so parses on other tasks keep using the heap. */
+typedef struct {cJSON *nodes;int size,used;} parse_arena;
+
+static cJSON *parse_new_item(parse_arena *arena)
+{
+	cJSON *node;
+	if (!arena) return cJSON_New_Item();
+	if (arena->used>=arena->size) return 0;	/* arena exhausted */
+	node=&arena->nodes[arena->used++];
+	memset(node,0,sizeof(cJSON));
+	return node;
+}
+
 /* Delete a cJSON structure. */
 void cJSON_Delete(cJSON *c)
 {
@@ -143,34 +157,34 @@ static int update(printbuffer *p)
 	return p->offset+strlen(str);
 }
 
+/* How many bytes format_number needs for this item. */
+static int number_size(cJSON *item)
+{
+	double d=item->valuedouble;
+	if (d==0) return 2;	/* special case for 0. */
+	if (fabs(((double)item->valueint)-d)<=DBL_EPSILON && d<=INT_MAX && d>=INT_MIN) return 21;	/* 2^64+1 can be represented in 21 chars. */
+	return 64;	/* This is a nice tradeoff. */
+}
+
+/* Format the number nicely from the given item into str, which holds number_size(item) bytes. */
+static void format_number(cJSON *item,char *str)
+{
+	double d=item->valuedouble;
+	if (d==0)	strcpy(str,"0");
+	else if (fabs(((double)item->valueint)-d)<=DBL_EPSILON && d<=INT_MAX && d>=INT_MIN)	sprintf(str,"%d",item->valueint);
+	else if (fabs(floor(d)-d)<=DBL_EPSILON && fabs(d)<1.0e60)	sprintf(str,"%.0f",d);
+	else if (fabs(d)<1.0e-6 || fabs(d)>1.0e9)					sprintf(str,"%e",d);
+	else														sprintf(str,"%f",d);
+}
+
 /* Render the number nicely from the given item into a string. */
 static char *print_number(cJSON *item,printbuffer *p)
 {
 	char *str=0;
-	double d=item->valuedouble;
-	if (d==0)
-	{
-		if (p)	str=ensure(p,2);
-		else	str=(char*)cJSON_malloc(2);	/* special case for 0. */
-		if (str) strcpy(str,"0");
-	}
-	else if (fabs(((double)item->valueint)-d)<=DBL_EPSILON && d<=INT_MAX && d>=INT_MIN)
-	{
-		if (p)	str=ensure(p,21);
-		else	str=(char*)cJSON_malloc(21);	/* 2^64+1 can be represented in 21 chars. */
-		if (str)	sprintf(str,"%d",item->valueint);
-	}
-	else
-	{
-		if (p)	str=ensure(p,64);
-		else	str=(char*)cJSON_malloc(64);	/* This is a nice tradeoff. */
-		if (str)
-		{
-			if (fabs(floor(d)-d)<=DBL_EPSILON && fabs(d)<1.0e60)sprintf(str,"%.0f",d);
-			else if (fabs(d)<1.0e-6 || fabs(d)>1.0e9)			sprintf(str,"%e",d);
-			else												sprintf(str,"%f",d);
-		}
-	}
+	int size=number_size(item);
+	if (p)	str=ensure(p,size);
+	else	str=(char*)cJSON_malloc(size);
+	if (str) format_number(item,str);
 	return str;
 }
 
@@ -189,14 +203,15 @@ static unsigned parse_hex4(const char *str)
 
 /* Parse the input text into an unescaped cstring, and populate item. */
 static const unsigned char firstByteMark[7] = { 0x00, 0x00, 0xC0, 0xE0, 0xF0, 0xF8, 0xFC };
-static const char *parse_string(cJSON *item,const char *str)
+static const char *parse_string(cJSON *item,const char *str,parse_arena *arena)
 {
 	const char *ptr=str+1;char *ptr2;char *out;int len=0;unsigned uc,uc2;
 	if (*str!='\"') {ep=str;return 0;}	/* not a string! */
 	
 	while (*ptr!='\"' && *ptr && ++len) if (*ptr++ == '\\') ptr++;	/* Skip escaped quotes. */
 	
-	out=(char*)cJSON_malloc(len+1);	/* This is how long we need for the string, roughly. */
+	if (arena) out=(char*)str+1;	/* Unescaping never grows the string, so write over the source. */
+	else out=(char*)cJSON_malloc(len+1);	/* This is how long we need for the string, roughly. */
 	if (!out) return 0;
 	
 	ptr=str+1;ptr2=out;
@@ -241,8 +256,8 @@ static const char *parse_string(cJSON *item,const char *str)
 			ptr++;
 		}
 	}
-	*ptr2=0;
 	if (*ptr=='\"') ptr++;
+	*ptr2=0;	/* In-situ, this may land on the closing quote, so terminate only after stepping over it. */
 	item->valuestring=out;
 	item->type=cJSON_String;
 	return ptr;
@@ -309,35 +324,52 @@ static char *print_string_ptr(const char *str,printbuffer *p)
 static char *print_string(cJSON *item,printbuffer *p)	{return print_string_ptr(item->valuestring,p);}
 
 /* Predeclare these prototypes. */
-static const char *parse_value(cJSON *item,const char *value);
+static const char *parse_value(cJSON *item,const char *value,parse_arena *arena);
 static char *print_value(cJSON *item,int depth,int fmt,printbuffer *p);
-static const char *parse_array(cJSON *item,const char *value);
+static const char *parse_array(cJSON *item,const char *value,parse_arena *arena);
 static char *print_array(cJSON *item,int depth,int fmt,printbuffer *p);
-static const char *parse_object(cJSON *item,const char *value);
+static const char *parse_object(cJSON *item,const char *value,parse_arena *arena);
 static char *print_object(cJSON *item,int depth,int fmt,printbuffer *p);
 
 /* Utility to jump whitespace and cr/lf */
 static const char *skip(const char *in) {while (in && *in && (unsigned char)*in<=32) in++; return in;}
 
+/* Release a partial parse result; arena nodes belong to the caller and are simply abandoned. */
+static void parse_fail(cJSON *c,parse_arena *arena) {if (!arena) cJSON_Delete(c);}
+
 /* Parse an object - create a new root, and populate. */
-cJSON *cJSON_ParseWithOpts(const char *value,const char **return_parse_end,int require_null_terminated)
+static cJSON *parse_root(const char *value,const char **return_parse_end,int require_null_terminated,parse_arena *arena)
 {
 	const char *end=0;
-	cJSON *c=cJSON_New_Item();
+	cJSON *c=parse_new_item(arena);
 	ep=0;
 	if (!c) return 0;       /* memory fail */
 
-	end=parse_value(c,skip(value));
-	if (!end)	{cJSON_Delete(c);return 0;}	/* parse failure. ep is set. */
+	end=parse_value(c,skip(value),arena);
+	if (!end)	{parse_fail(c,arena);return 0;}	/* parse failure. ep is set. */
 
 	/* if we require null-terminated JSON without appended garbage, skip and then check for a null terminator */
-	if (require_null_terminated) {end=skip(end);if (*end) {cJSON_Delete(c);ep=end;return 0;}}
+	if (require_null_terminated) {end=skip(end);if (*end) {parse_fail(c,arena);ep=end;return 0;}}
 	if (return_parse_end) *return_parse_end=end;
 	return c;
 }
+cJSON *cJSON_ParseWithOpts(const char *value,const char **return_parse_end,int require_null_terminated)
+{
+	return parse_root(value,return_parse_end,require_null_terminated,0);
+}
 /* Default options for cJSON_Parse */
 cJSON *cJSON_Parse(const char *value) {return cJSON_ParseWithOpts(value,0,0);}
 
+cJSON *cJSON_ParseInSitu(char *value,cJSON *nodes,int max_nodes,int *used_nodes)
+{
+	parse_arena arena;cJSON *c;
+	if (!value || !nodes || max_nodes<=0) return 0;
+	arena.nodes=nodes;arena.size=max_nodes;arena.used=0;
+	c=parse_root(value,0,1,&arena);
+	if (used_nodes) *used_nodes=arena.used;
+	return c;
+}
+
 /* Render a cJSON item/entity/structure to text. */
 char *cJSON_Print(cJSON *item)				{return print_value(item,0,1,0);}
 char *cJSON_PrintUnformatted(cJSON *item)	{return print_value(item,0,0,0);}
@@ -353,17 +385,126 @@ char *cJSON_PrintBuffered(cJSON *item,int prebuffer,int fmt)
 }
 
 
+/* Streaming output: text is staged in the caller's chunk and handed to write() whenever it fills up. */
+typedef struct {char *chunk; size_t size; size_t used; cJSON_WriteFn write; void *ctx; int fail; } printstream;
+
+static void stream_flush(printstream *s)
+{
+	if (!s->fail && s->used && !s->write(s->ctx,s->chunk,s->used)) s->fail=1;
+	s->used=0;
+}
+
+static void stream_putc(printstream *s,char c)
+{
+	if (s->used==s->size) stream_flush(s);
+	s->chunk[s->used++]=c;
+}
+
+static void stream_puts(printstream *s,const char *str,size_t len)
+{
+	size_t n;
+	while (len && !s->fail)
+	{
+		if (s->used==s->size) stream_flush(s);
+		n=s->size-s->used;if (n>len) n=len;
+		memcpy(s->chunk+s->used,str,n);
+		s->used+=n;str+=n;len-=n;
+	}
+}
+
+static void stream_tabs(printstream *s,int n)	{while (n-->0) stream_putc(s,'\t');}
+
+/* Streaming counterpart of print_string_ptr; must produce identical text. */
+static void stream_string_ptr(printstream *s,const char *str)
+{
+	const char *run;unsigned char token;char esc[8];
+	stream_putc(s,'\"');
+	if (str) while (*str && !s->fail)
+	{
+		for (run=str;(unsigned char)*str>31 && *str!='\"' && *str!='\\';str++);	/* Copy unescaped runs in one go. */
+		stream_puts(s,run,str-run);
+		if (!*str) break;
+		switch (token=*str++)
+		{
+			case '\\':	stream_puts(s,"\\\\",2);	break;
+			case '\"':	stream_puts(s,"\\\"",2);	break;
+			case '\b':	stream_puts(s,"\\b",2);	break;
+			case '\f':	stream_puts(s,"\\f",2);	break;
+			case '\n':	stream_puts(s,"\\n",2);	break;
+			case '\r':	stream_puts(s,"\\r",2);	break;
+			case '\t':	stream_puts(s,"\\t",2);	break;
+			default: sprintf(esc,"\\u%04x",token);stream_puts(s,esc,6);	break;	/* escape and print */
+		}
+	}
+	stream_putc(s,'\"');
+}
+
+/* Streaming counterpart of print_value; must produce identical text. */
+static void stream_value(printstream *s,cJSON *item,int depth,int fmt)
+{
+	char num[64];cJSON *child;
+	if (s->fail) return;
+	switch ((item->type)&255)
+	{
+		case cJSON_NULL:	stream_puts(s,"null",4);	break;
+		case cJSON_False:	stream_puts(s,"false",5);	break;
+		case cJSON_True:	stream_puts(s,"true",4);	break;
+		case cJSON_Number:	format_number(item,num);stream_puts(s,num,strlen(num));	break;
+		case cJSON_String:	stream_string_ptr(s,item->valuestring);	break;
+		case cJSON_Array:
+			stream_putc(s,'[');
+			for (child=item->child;child && !s->fail;child=child->next)
+			{
+				stream_value(s,child,depth+1,fmt);
+				if (child->next) {stream_putc(s,',');if (fmt) stream_putc(s,' ');}
+			}
+			stream_putc(s,']');
+			break;
+		case cJSON_Object:
+			stream_putc(s,'{');
+			if (fmt) stream_putc(s,'\n');
+			if (!item->child)	/* print_object indents an empty object one level less */
+			{
+				if (fmt) stream_tabs(s,depth-1);
+				stream_putc(s,'}');
+				break;
+			}
+			for (child=item->child;child && !s->fail;child=child->next)
+			{
+				if (fmt) stream_tabs(s,depth+1);
+				stream_string_ptr(s,child->string);
+				stream_putc(s,':');if (fmt) stream_putc(s,'\t');
+				stream_value(s,child,depth+1,fmt);
+				if (child->next) stream_putc(s,',');
+				if (fmt) stream_putc(s,'\n');
+			}
+			if (fmt) stream_tabs(s,depth);
+			stream_putc(s,'}');
+			break;
+	}
+}
+
+int cJSON_PrintStream(cJSON *item,int fmt,char *chunk,size_t chunk_size,cJSON_WriteFn write,void *ctx)
+{
+	printstream s;
+	if (!item || !chunk || !chunk_size || !write) return 0;
+	s.chunk=chunk;s.size=chunk_size;s.used=0;s.write=write;s.ctx=ctx;s.fail=0;
+	stream_value(&s,item,0,fmt);
+	stream_flush(&s);
+	return !s.fail;
+}
+
 /* Parser core - when encountering text, process appropriately. */
-static const char *parse_value(cJSON *item,const char *value)
+static const char *parse_value(cJSON *item,const char *value,parse_arena *arena)
 {
 	if (!value)						return 0;	/* Fail on null. */
 	if (!strncmp(value,"null",4))	{ item->type=cJSON_NULL;  return value+4; }
 	if (!strncmp(value,"false",5))	{ item->type=cJSON_False; return value+5; }
 	if (!strncmp(value,"true",4))	{ item->type=cJSON_True; item->valueint=1;	return value+4; }
-	if (*value=='\"')				{ return parse_string(item,value); }
+	if (*value=='\"')				{ return parse_string(item,value,arena); }
 	if (*value=='-' || (*value>='0' && *value<='9'))	{ return parse_number(item,value); }
-	if (*value=='[')				{ return parse_array(item,value); }
-	if (*value=='{')				{ return parse_object(item,value); }
+	if (*value=='[')				{ return parse_array(item,value,arena); }
+	if (*value=='{')				{ return parse_object(item,value,arena); }
 
 	ep=value;return 0;	/* failure. */
 }
@@ -403,7 +544,7 @@ static char *print_value(cJSON *item,int depth,int fmt,printbuffer *p)
 }
 
 /* Build an array from input text. */
-static const char *parse_array(cJSON *item,const char *value)
+static const char *parse_array(cJSON *item,const char *value,parse_arena *arena)
 {
 	cJSON *child;
 	if (*value!='[')	{ep=value;return 0;}	/* not an array! */
@@ -412,17 +553,17 @@ static const char *parse_array(cJSON *item,const char *value)
 	value=skip(value+1);
 	if (*value==']') return value+1;	/* empty array. */
 
-	item->child=child=cJSON_New_Item();
+	item->child=child=parse_new_item(arena);
 	if (!item->child) return 0;		 /* memory fail */
-	value=skip(parse_value(child,skip(value)));	/* skip any spacing, get the value. */
+	value=skip(parse_value(child,skip(value),arena));	/* skip any spacing, get the value. */
 	if (!value) return 0;
 
 	while (*value==',')
 	{
 		cJSON *new_item;
-		if (!(new_item=cJSON_New_Item())) return 0; 	/* memory fail */
+		if (!(new_item=parse_new_item(arena))) return 0; 	/* memory fail */
 		child->next=new_item;new_item->prev=child;child=new_item;
-		value=skip(parse_value(child,skip(value+1)));
+		value=skip(parse_value(child,skip(value+1),arena));
 		if (!value) return 0;	/* memory fail */
 	}
 
@@ -511,7 +652,7 @@ static char *print_array(cJSON *item,int depth,int fmt,printbuffer *p)
 }
 
 /* Build an object from the text. */
-static const char *parse_object(cJSON *item,const char *value)
+static const char *parse_object(cJSON *item,const char *value,parse_arena *arena)
 {
 	cJSON *child;
 	if (*value!='{')	{ep=value;return 0;}	/* not an object! */
@@ -520,25 +661,25 @@ static const char *parse_object(cJSON *item,const char *value)
 	value=skip(value+1);
 	if (*value=='}') return value+1;	/* empty array. */
 	
-	item->child=child=cJSON_New_Item();
+	item->child=child=parse_new_item(arena);
 	if (!item->child) return 0;
-	value=skip(parse_string(child,skip(value)));
+	value=skip(parse_string(child,skip(value),arena));
 	if (!value) return 0;
 	child->string=child->valuestring;child->valuestring=0;
 	if (*value!=':') {ep=value;return 0;}	/* fail! */
-	value=skip(parse_value(child,skip(value+1)));	/* skip any spacing, get the value. */
+	value=skip(parse_value(child,skip(value+1),arena));	/* skip any spacing, get the value. */
 	if (!value) return 0;
 	
 	while (*value==',')
 	{
 		cJSON *new_item;
-		if (!(new_item=cJSON_New_Item()))	return 0; /* memory fail */
+		if (!(new_item=parse_new_item(arena)))	return 0; /* memory fail */
 		child->next=new_item;new_item->prev=child;child=new_item;
-		value=skip(parse_string(child,skip(value+1)));
+		value=skip(parse_string(child,skip(value+1),arena));
 		if (!value) return 0;
 		child->string=child->valuestring;child->valuestring=0;
 		if (*value!=':') {ep=value;return 0;}	/* fail! */
-		value=skip(parse_value(child,skip(value+1)));	/* skip any spacing, get the value. */
+		value=skip(parse_value(child,skip(value+1),arena));	/* skip any spacing, get the value. */
 		if (!value) return 0;
 	}
 	
@@ -662,6 +803,53 @@ int    cJSON_GetArraySize(cJSON *array)							{cJSON *c=array->child;int i=0;whi
 cJSON *cJSON_GetArrayItem(cJSON *array,int item)				{cJSON *c=array->child;  while (c && item>0) item--,c=c->next; return c;}
 cJSON *cJSON_GetObjectItem(cJSON *object,const char *string)	{cJSON *c=object->child; while (c && cJSON_strcasecmp(c->string,string)) c=c->next; return c;}
 
+/* Case-insensitive FNV-1a, so indexed lookups agree with cJSON_GetObjectItem. */
+static unsigned cJSON_hash(const char *str)
+{
+	unsigned h=2166136261u;
+	while (*str) h=(h^(unsigned char)tolower(*(const unsigned char *)str++))*16777619u;
+	return h;
+}
+
+int cJSON_IndexBuild(cJSON_Index *index,cJSON *object,cJSON **slots,int size)
+{
+	cJSON *c;int i,count=0;unsigned h;
+	if (!index || !object || !slots) return 0;
+	for (c=object->child;c;c=c->next) count++;
+	if ((object->type&255)==cJSON_Object ? size<=count : size<count) return 0;	/* objects need a free slot to end probing */
+	memset(slots,0,size*sizeof(cJSON*));
+	index->object=object;index->slots=slots;index->size=size;index->count=count;
+	if ((object->type&255)!=cJSON_Object)
+	{
+		for (c=object->child,i=0;c;c=c->next) slots[i++]=c;
+		return 1;
+	}
+	for (c=object->child;c;c=c->next)
+	{
+		if (!c->string) continue;
+		for (h=cJSON_hash(c->string)%size;slots[h];h=(h+1)%size)
+			if (!cJSON_strcasecmp(slots[h]->string,c->string)) break;	/* keep the first duplicate, like a linear walk */
+		if (!slots[h]) slots[h]=c;
+	}
+	return 1;
+}
+
+cJSON *cJSON_IndexGetObjectItem(const cJSON_Index *index,const char *string)
+{
+	unsigned h;
+	if (!index || !string || (index->object->type&255)!=cJSON_Object) return 0;
+	for (h=cJSON_hash(string)%index->size;index->slots[h];h=(h+1)%index->size)
+		if (!cJSON_strcasecmp(index->slots[h]->string,string)) return index->slots[h];
+	return 0;
+}
+
+cJSON *cJSON_IndexGetArrayItem(const cJSON_Index *index,int item)
+{
+	if (!index || item<0 || item>=index->count) return 0;
+	if ((index->object->type&255)==cJSON_Object) return cJSON_GetArrayItem(index->object,item);
+	return index->slots[item];
+}
+
 /* Utility for array list handling. */
 static void suffix_object(cJSON *prev,cJSON *item) {prev->next=item;item->prev=prev;}
 /* Utility for handling references. */
@@ -0,0 +1,311 @@
+// Copyright 2015-2017 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "catch.hpp"
+#include "cJSON.h"
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+static size_t s_mallocs;
+
+static void* counting_malloc(size_t sz)
+{
+    ++s_mallocs;
+    return malloc(sz);
+}
+
+static void counting_free(void* ptr)
+{
+    free(ptr);
+}
+
+struct MallocCounter {
+    MallocCounter()
+    {
+        cJSON_Hooks hooks = { counting_malloc, counting_free };
+        cJSON_InitHooks(&hooks);
+        s_mallocs = 0;
+    }
+    ~MallocCounter()
+    {
+        cJSON_InitHooks(NULL);
+    }
+    size_t count() const
+    {
+        return s_mallocs;
+    }
+};
+
+/* Shape of an AWS IoT device shadow: state.reported/desired plus per-field metadata timestamps. */
+static string makeShadow(int fields)
+{
+    stringstream s;
+    s << "{\"state\":{\"reported\":{";
+    for (int i = 0; i < fields; ++i) {
+        s << (i ? "," : "") << "\"sensor_" << i << "\":";
+        switch (i % 4) {
+        case 0: s << i * 3; break;
+        case 1: s << "\"value \\\"" << i << "\\\" \\u00e9\""; break;
+        case 2: s << (i % 8 ? "true" : "false"); break;
+        case 3: s << "[" << i << ",-" << i << ".5,null]"; break;
+        }
+    }
+    s << "},\"desired\":{\"period\":60,\"led\":\"on\"}},\"metadata\":{\"reported\":{";
+    for (int i = 0; i < fields; ++i) {
+        s << (i ? "," : "") << "\"sensor_" << i << "\":{\"timestamp\":" << 1490000000 + i << "}";
+    }
+    s << "}},\"version\":1742,\"timestamp\":1490001234}";
+    return s.str();
+}
+
+static string printUnformatted(cJSON* item)
+{
+    char* text = cJSON_PrintUnformatted(item);
+    string result(text ? text : "");
+    free(text);
+    return result;
+}
+
+TEST_CASE("in-situ parse produces the same tree as cJSON_Parse", "[json][insitu]")
+{
+    string doc = makeShadow(200);
+    cJSON* heap = cJSON_Parse(doc.c_str());
+    REQUIRE(heap);
+
+    vector<char> text(doc.begin(), doc.end());
+    text.push_back(0);
+    vector<cJSON> arena(2048);
+    int used = 0;
+    cJSON* insitu = cJSON_ParseInSitu(text.data(), arena.data(), arena.size(), &used);
+    REQUIRE(insitu);
+    CHECK(used > 600);
+    CHECK(used < 2048);
+    CHECK(printUnformatted(insitu) == printUnformatted(heap));
+
+    cJSON_Delete(heap);
+}
+
+TEST_CASE("in-situ parse does not allocate", "[json][insitu]")
+{
+    string doc = makeShadow(200);
+    vector<char> text(doc.begin(), doc.end());
+    text.push_back(0);
+    vector<cJSON> arena(2048);
+
+    MallocCounter counter;
+    cJSON* root = cJSON_ParseInSitu(text.data(), arena.data(), arena.size(), NULL);
+    REQUIRE(root);
+    CHECK(counter.count() == 0);
+    CHECK(cJSON_GetObjectItem(root, "version")->valueint == 1742);
+}
+
+TEST_CASE("in-situ parse unescapes strings in place", "[json][insitu]")
+{
+    char text[] = "{\"a\\tb\":\"q\\\"x\\\\\",\"e\":\"\",\"u\":\"\\u00e9\\ud83d\\ude00\"}";
+    cJSON arena[8];
+    cJSON* root = cJSON_ParseInSitu(text, arena, 8, NULL);
+    REQUIRE(root);
+    cJSON* ab = cJSON_GetObjectItem(root, "a\tb");
+    REQUIRE(ab);
+    CHECK(string(ab->valuestring) == "q\"x\\");
+    CHECK(ab->valuestring >= text);
+    CHECK(ab->valuestring < text + sizeof(text));
+    CHECK(string(cJSON_GetObjectItem(root, "e")->valuestring) == "");
+    CHECK(string(cJSON_GetObjectItem(root, "u")->valuestring) == "\xc3\xa9\xf0\x9f\x98\x80");
+}
+
+TEST_CASE("in-situ parse fails cleanly", "[json][insitu]")
+{
+    cJSON arena[4];
+    int used = 0;
+
+    char small[] = "[1,2,3,4,5]";
+    CHECK(cJSON_ParseInSitu(small, arena, 4, &used) == NULL);
+    CHECK(used == 4);
+
+    char broken[] = "{\"a\":1,}";
+    CHECK(cJSON_ParseInSitu(broken, arena, 4, NULL) == NULL);
+    CHECK(cJSON_GetErrorPtr() != NULL);
+
+    char trailing[] = "{} x";
+    CHECK(cJSON_ParseInSitu(trailing, arena, 4, NULL) == NULL);
+
+    /* Ordinary parsing is unaffected afterwards */
+    cJSON* heap = cJSON_Parse("[1,2,3,4,5]");
+    REQUIRE(heap);
+    CHECK(cJSON_GetArraySize(heap) == 5);
+    cJSON_Delete(heap);
+}
+
+/* Every node of a tree, depth first */
+static void collectNodes(cJSON* item, vector<cJSON*>& out)
+{
+    for (; item; item = item->next) {
+        out.push_back(item);
+        collectNodes(item->child, out);
+    }
+}
+
+TEST_CASE("in-situ parse on one task leaves heap parses on another alone", "[json][insitu]")
+{
+    const string doc = makeShadow(20);
+    const int rounds = 2000;
+    vector<cJSON> arena(256);
+    bool insitu_ok = true, heap_ok = true;
+
+    std::thread insitu([&]() {
+        for (int n = 0; n < rounds; ++n) {
+            vector<char> text(doc.begin(), doc.end());
+            text.push_back(0);
+            cJSON* root = cJSON_ParseInSitu(text.data(), arena.data(), arena.size(), NULL);
+            insitu_ok = insitu_ok && root && cJSON_GetObjectItem(root, "version")->valueint == 1742;
+        }
+    });
+    std::thread heap([&]() {
+        for (int n = 0; n < rounds; ++n) {
+            cJSON* root = cJSON_Parse(doc.c_str());
+            vector<cJSON*> nodes;
+            collectNodes(root, nodes);
+            for (cJSON* c : nodes) {
+                // A node taken from the other task's arena, or a string written into its buffer
+                heap_ok = heap_ok && (c < arena.data() || c >= arena.data() + arena.size());
+            }
+            heap_ok = heap_ok && root && cJSON_GetObjectItem(root, "version")->valueint == 1742;
+            cJSON_Delete(root);
+        }
+    });
+    insitu.join();
+    heap.join();
+    CHECK(insitu_ok);
+    CHECK(heap_ok);
+}
+
+TEST_CASE("object index agrees with cJSON_GetObjectItem", "[json][index]")
+{
+    string doc = makeShadow(200);
+    cJSON* root = cJSON_Parse(doc.c_str());
+    REQUIRE(root);
+    cJSON* reported = cJSON_GetObjectItem(cJSON_GetObjectItem(root, "state"), "reported");
+    REQUIRE(reported);
+    int n = cJSON_GetArraySize(reported);
+
+    vector<cJSON*> slots(cJSON_IndexSlots(n));
+    cJSON_Index index;
+    REQUIRE(cJSON_IndexBuild(&index, reported, slots.data(), slots.size()));
+    CHECK(index.count == n);
+    for (int i = 0; i < n; ++i) {
+        string key = "sensor_" + to_string(i);
+        CHECK(cJSON_IndexGetObjectItem(&index, key.c_str()) == cJSON_GetObjectItem(reported, key.c_str()));
+    }
+    CHECK(cJSON_IndexGetObjectItem(&index, "SENSOR_7") == cJSON_GetObjectItem(reported, "sensor_7"));
+    CHECK(cJSON_IndexGetObjectItem(&index, "sensor_200") == NULL);
+    CHECK(cJSON_IndexGetObjectItem(&index, "") == NULL);
+
+    CHECK_FALSE(cJSON_IndexBuild(&index, reported, slots.data(), n));
+    cJSON_Delete(root);
+}
+
+TEST_CASE("object index keeps the first of duplicate keys", "[json][index]")
+{
+    cJSON* root = cJSON_Parse("{\"k\":1,\"K\":2,\"x\":3}");
+    REQUIRE(root);
+    cJSON* slots[4];
+    cJSON_Index index;
+    REQUIRE(cJSON_IndexBuild(&index, root, slots, 4));
+    CHECK(cJSON_IndexGetObjectItem(&index, "K")->valueint == 1);
+    CHECK(cJSON_IndexGetArrayItem(&index, 2)->valueint == 3);
+    cJSON_Delete(root);
+}
+
+TEST_CASE("array index gives direct element access", "[json][index]")
+{
+    cJSON* root = cJSON_Parse("[10,11,12,13,14,15]");
+    REQUIRE(root);
+    cJSON* slots[6];
+    cJSON_Index index;
+    REQUIRE(cJSON_IndexBuild(&index, root, slots, 6));
+    for (int i = 0; i < 6; ++i) {
+        CHECK(cJSON_IndexGetArrayItem(&index, i) == cJSON_GetArrayItem(root, i));
+    }
+    CHECK(cJSON_IndexGetArrayItem(&index, 6) == NULL);
+    CHECK(cJSON_IndexGetArrayItem(&index, -1) == NULL);
+    CHECK(cJSON_IndexGetObjectItem(&index, "0") == NULL);
+    CHECK_FALSE(cJSON_IndexBuild(&index, root, slots, 5));
+    cJSON_Delete(root);
+}
+
+template<typename F>
+static double timeUs(int iterations, F fn)
+{
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        fn();
+    }
+    auto end = chrono::steady_clock::now();
+    return chrono::duration<double, micro>(end - start).count() / iterations;
+}
+
+TEST_CASE("shadow document parse and lookup benchmark", "[json][bench]")
+{
+    const int fields = 200;
+    const int iterations = 200;
+    string doc = makeShadow(fields);
+    vector<string> keys;
+    for (int i = 0; i < fields; ++i) {
+        keys.push_back("sensor_" + to_string(i));
+    }
+    vector<char> text(doc.size() + 1);
+    vector<cJSON> arena(2048);
+    vector<cJSON*> slots(cJSON_IndexSlots(fields));
+    size_t found = 0;
+
+    size_t heapMallocs;
+    {
+        MallocCounter counter;
+        cJSON_Delete(cJSON_Parse(doc.c_str()));
+        heapMallocs = counter.count();
+    }
+
+    double heapUs = timeUs(iterations, [&]() {
+        cJSON* root = cJSON_Parse(doc.c_str());
+        cJSON* reported = cJSON_GetObjectItem(cJSON_GetObjectItem(root, "state"), "reported");
+        for (auto& key : keys) {
+            found += cJSON_GetObjectItem(reported, key.c_str()) != NULL;
+        }
+        cJSON_Delete(root);
+    });
+
+    double insituUs = timeUs(iterations, [&]() {
+        memcpy(text.data(), doc.c_str(), doc.size() + 1);
+        cJSON* root = cJSON_ParseInSitu(text.data(), arena.data(), arena.size(), NULL);
+        cJSON* reported = cJSON_GetObjectItem(cJSON_GetObjectItem(root, "state"), "reported");
+        cJSON_Index index;
+        cJSON_IndexBuild(&index, reported, slots.data(), slots.size());
+        for (auto& key : keys) {
+            found += cJSON_IndexGetObjectItem(&index, key.c_str()) != NULL;
+        }
+    });
+
+    CHECK(found == 2 * iterations * keys.size());
+    cout << "Shadow document: " << doc.size() << " bytes, " << fields << " reported fields" << endl;
+    cout << "  cJSON_Parse + linear lookup:  " << heapUs << " us, " << heapMallocs << " mallocs" << endl;
+    cout << "  in-situ parse + hashed lookup: " << insituUs << " us, 0 mallocs" << endl;
+}
@@ -0,0 +1,199 @@
+// Copyright 2015-2017 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "catch.hpp"
+#include "cJSON.h"
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/* Heap accounting through cJSON hooks; each block carries its size in front. */
+static size_t s_heap_used;
+static size_t s_heap_peak;
+
+static void* tracking_malloc(size_t sz)
+{
+    size_t* block = static_cast<size_t*>(malloc(sz + sizeof(size_t)));
+    if (!block) {
+        return NULL;
+    }
+    *block = sz;
+    s_heap_used += sz;
+    if (s_heap_used > s_heap_peak) {
+        s_heap_peak = s_heap_used;
+    }
+    return block + 1;
+}
+
+static void tracking_free(void* ptr)
+{
+    if (!ptr) {
+        return;
+    }
+    size_t* block = static_cast<size_t*>(ptr) - 1;
+    s_heap_used -= *block;
+    free(block);
+}
+
+struct HeapTracker {
+    HeapTracker()
+    {
+        cJSON_Hooks hooks = { tracking_malloc, tracking_free };
+        cJSON_InitHooks(&hooks);
+    }
+    ~HeapTracker()
+    {
+        cJSON_InitHooks(NULL);
+    }
+    void reset()
+    {
+        s_heap_peak = s_heap_used;
+    }
+    size_t peak() const
+    {
+        return s_heap_peak - s_heap_used;
+    }
+};
+
+struct StringSink {
+    string text;
+    size_t writes = 0;
+    size_t largestWrite = 0;
+    size_t failAfter = 0;
+
+    static int write(void* ctx, const char* data, size_t len)
+    {
+        StringSink* self = static_cast<StringSink*>(ctx);
+        if (self->failAfter && self->writes == self->failAfter) {
+            return 0;
+        }
+        self->writes++;
+        self->largestWrite = max(self->largestWrite, len);
+        self->text.append(data, len);
+        return 1;
+    }
+};
+
+static string takeString(char* text, void (*free_fn)(void*) = free)
+{
+    string result(text ? text : "");
+    free_fn(text);
+    return result;
+}
+
+/* A telemetry report of roughly 30 KB: nested objects, arrays, escapes and all number shapes. */
+static cJSON* makeTelemetry()
+{
+    cJSON* root = cJSON_CreateObject();
+    cJSON_AddStringToObject(root, "device", "pingzee-\"01\"\t\\\x01");
+    cJSON_AddNumberToObject(root, "uptime", 123456789);
+    cJSON_AddItemToObject(root, "empty", cJSON_CreateObject());
+    cJSON_AddItemToObject(root, "none", cJSON_CreateArray());
+    cJSON* samples = cJSON_CreateArray();
+    cJSON_AddItemToObject(root, "samples", samples);
+    for (int i = 0; i < 300; ++i) {
+        cJSON* s = cJSON_CreateObject();
+        cJSON_AddNumberToObject(s, "t", 1490000000 + i);
+        cJSON_AddNumberToObject(s, "x", i * 0.015625 - 2);
+        cJSON_AddNumberToObject(s, "y", -i * 1.0e-7);
+        cJSON_AddNumberToObject(s, "z", i * 3.0e10);
+        cJSON_AddBoolToObject(s, "motion", i % 3 == 0);
+        cJSON_AddItemToObject(s, "meta", i % 50 ? cJSON_CreateNull() : cJSON_CreateObject());
+        int raw[] = { i, -i, i * 7 };
+        cJSON_AddItemToObject(s, "raw", cJSON_CreateIntArray(raw, 3));
+        cJSON_AddItemToArray(samples, s);
+    }
+    return root;
+}
+
+TEST_CASE("streamed output matches cJSON_Print byte for byte", "[json][print]")
+{
+    cJSON* root = makeTelemetry();
+    string unformatted = takeString(cJSON_PrintUnformatted(root));
+    string formatted = takeString(cJSON_Print(root));
+    REQUIRE(unformatted.size() > 20000);
+
+    for (size_t chunkSize : { 1, 2, 7, 64, 1460, 65536 }) {
+        vector<char> chunk(chunkSize);
+        StringSink plain, pretty;
+        CHECK(cJSON_PrintStream(root, 0, chunk.data(), chunk.size(), StringSink::write, &plain));
+        CHECK(cJSON_PrintStream(root, 1, chunk.data(), chunk.size(), StringSink::write, &pretty));
+        CHECK(plain.text == unformatted);
+        CHECK(pretty.text == formatted);
+        CHECK(plain.largestWrite <= chunkSize);
+    }
+    cJSON_Delete(root);
+}
+
+TEST_CASE("streamed output matches for scalar and empty roots", "[json][print]")
+{
+    const char* docs[] = { "{}", "[]", "0", "-1.5", "\"\"", "null", "true", "[{},[],{\"a\":{}}]" };
+    char chunk[3];
+    for (const char* doc : docs) {
+        cJSON* root = cJSON_Parse(doc);
+        REQUIRE(root);
+        for (int fmt = 0; fmt < 2; ++fmt) {
+            StringSink sink;
+            CHECK(cJSON_PrintStream(root, fmt, chunk, sizeof(chunk), StringSink::write, &sink));
+            CHECK(sink.text == takeString(fmt ? cJSON_Print(root) : cJSON_PrintUnformatted(root)));
+        }
+        cJSON_Delete(root);
+    }
+}
+
+TEST_CASE("streaming stops when the writer fails", "[json][print]")
+{
+    cJSON* root = makeTelemetry();
+    char chunk[128];
+    StringSink sink;
+    sink.failAfter = 3;
+    CHECK_FALSE(cJSON_PrintStream(root, 0, chunk, sizeof(chunk), StringSink::write, &sink));
+    CHECK(sink.writes == 3);
+    CHECK_FALSE(cJSON_PrintStream(root, 0, chunk, 0, StringSink::write, &sink));
+    CHECK_FALSE(cJSON_PrintStream(NULL, 0, chunk, sizeof(chunk), StringSink::write, &sink));
+    cJSON_Delete(root);
+}
+
+TEST_CASE("streaming printer does not touch the heap", "[json][print][bench]")
+{
+    HeapTracker heap;
+    cJSON* root = makeTelemetry();
+
+    heap.reset();
+    string unformatted = takeString(cJSON_PrintUnformatted(root), tracking_free);
+    size_t printPeak = heap.peak();
+
+    heap.reset();
+    string buffered = takeString(cJSON_PrintBuffered(root, 256, 0), tracking_free);
+    size_t bufferedPeak = heap.peak();
+
+    char chunk[512];
+    StringSink sink;
+    heap.reset();
+    REQUIRE(cJSON_PrintStream(root, 0, chunk, sizeof(chunk), StringSink::write, &sink));
+    size_t streamPeak = heap.peak();
+
+    CHECK(buffered == unformatted);
+    CHECK(sink.text == unformatted);
+    CHECK(streamPeak == 0);
+    cout << "Telemetry report: " << unformatted.size() << " bytes" << endl;
+    cout << "  cJSON_PrintUnformatted peak heap: " << printPeak << " bytes" << endl;
+    cout << "  cJSON_PrintBuffered peak heap:    " << bufferedPeak << " bytes" << endl;
+    cout << "  cJSON_PrintStream peak heap:      " << streamPeak << " bytes (+" << sizeof(chunk) << " byte chunk), "
+         << sink.writes << " writes" << endl;
+    cJSON_Delete(root);
+}
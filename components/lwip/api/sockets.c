@@ -1158,6 +1158,118 @@ lwip_recv(int s, void *mem, size_t len, int flags)
   return lwip_recvfrom(s, mem, len, flags, NULL, NULL);
 }
 
+#if ESP_SOCKET_ZEROCOPY
+/* Free the first 'offset' bytes of a chain, read by lwip_recvfrom() before */
+static struct pbuf *
+pbuf_skip_read(struct pbuf *p, u16_t offset)
+{
+  struct pbuf *q;
+
+  while (offset >= p->len) {
+    q = p->next;
+    offset -= p->len;
+    /* the reference of the chain link now belongs to us */
+    p->next = NULL;
+    pbuf_free(p);
+    p = q;
+  }
+  if (offset > 0) {
+    pbuf_header(p, -(s16_t)offset);
+  }
+  return p;
+}
+
+int
+lwip_recvfrom_pbuf(int s, struct pbuf **p, int flags,
+              struct sockaddr *from, socklen_t *fromlen)
+{
+  struct lwip_sock *sock;
+  void             *buf;
+  struct pbuf      *q;
+  u16_t            port;
+  ip_addr_t        tmpaddr;
+  ip_addr_t        *fromaddr;
+  union sockaddr_aligned saddr;
+  err_t            err;
+
+  LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_recvfrom_pbuf(%d, 0x%x, ..)\n", s, flags));
+  *p = NULL;
+  sock = get_socket(s);
+  if (!sock) {
+    return -1;
+  }
+  if (flags & MSG_PEEK) {
+    sock_set_errno(sock, EOPNOTSUPP);
+    return -1;
+  }
+
+  /* Data left by lwip_recvfrom() comes first */
+  if (sock->lastdata) {
+    buf = sock->lastdata;
+  } else {
+    if (((flags & MSG_DONTWAIT) || netconn_is_nonblocking(sock->conn)) &&
+        (sock->rcvevent <= 0)) {
+      LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_recvfrom_pbuf(%d): returning EWOULDBLOCK\n", s));
+      sock_set_errno(sock, EWOULDBLOCK);
+      return -1;
+    }
+    if (NETCONNTYPE_GROUP(netconn_type(sock->conn)) == NETCONN_TCP) {
+      err = netconn_recv_tcp_pbuf(sock->conn, (struct pbuf **)&buf);
+    } else {
+      err = netconn_recv(sock->conn, (struct netbuf **)&buf);
+    }
+    if (err != ERR_OK) {
+      LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_recvfrom_pbuf(%d): error is \"%s\"!\n",
+        s, lwip_strerr(err)));
+      sock_set_errno(sock, err_to_errno(err));
+      return (err == ERR_CLSD ? 0 : -1);
+    }
+    LWIP_ASSERT("buf != NULL", buf != NULL);
+  }
+
+  if (NETCONNTYPE_GROUP(netconn_type(sock->conn)) == NETCONN_TCP) {
+    fromaddr = &tmpaddr;
+    netconn_getaddr(sock->conn, fromaddr, &port, 0);
+    q = pbuf_skip_read((struct pbuf *)buf, sock->lastoffset);
+    netconn_recved(sock->conn, (u32_t)q->tot_len);
+  } else {
+    port = netbuf_fromport((struct netbuf *)buf);
+    ip_addr_copy(tmpaddr, *netbuf_fromaddr((struct netbuf *)buf));
+    fromaddr = &tmpaddr;
+    q = ((struct netbuf *)buf)->p;
+    ((struct netbuf *)buf)->p = NULL;
+    netbuf_delete((struct netbuf *)buf);
+  }
+  sock->lastdata = NULL;
+  sock->lastoffset = 0;
+
+  if (from && fromlen) {
+    IPADDR_PORT_TO_SOCKADDR(&saddr, fromaddr, port);
+    if (*fromlen > saddr.sa.sa_len) {
+      *fromlen = saddr.sa.sa_len;
+    }
+    MEMCPY(from, &saddr, *fromlen);
+#if ESP_LWIP
+  } else if (NETCONNTYPE_GROUP(netconn_type(sock->conn)) == NETCONN_UDP) {
+    /* as lwip_recvfrom() does: lwip_send() answers the sender */
+    sock->conn->pcb.udp->remote_ip.u_addr.ip4.addr = fromaddr->u_addr.ip4.addr;
+    sock->conn->pcb.udp->remote_port = port;
+#endif
+  }
+
+  LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_recvfrom_pbuf(%d): %p len=%"U16_F"\n", s, (void *)q, q->tot_len));
+  sock_set_errno(sock, 0);
+  *p = q;
+  return q->tot_len;
+}
+
+int
+lwip_recv_pbuf(int s, struct pbuf **p, int flags)
+{
+  return lwip_recvfrom_pbuf(s, p, flags, NULL, NULL);
+}
+#endif /* ESP_SOCKET_ZEROCOPY */
+
 int
 lwip_send(int s, const void *data, size_t size, int flags)
 {
@@ -1284,15 +1396,25 @@ lwip_sendmsg(int s, const struct msghdr *msg, int flags)
   else {
     /* flatten the IO vectors */
     size_t offset = 0;
+#if LWIP_CHECKSUM_ON_COPY
+    /* sum each vector while copying it; one that starts at an odd offset
+       is summed byte-swapped, as the stream sees its bytes the other way */
+    u32_t acc = 0;
+    u16_t chksum;
     for (i = 0; i < msg->msg_iovlen; i++) {
-      MEMCPY(&((u8_t*)chain_buf->p->payload)[offset], msg->msg_iov[i].iov_base, msg->msg_iov[i].iov_len);
+      chksum = LWIP_CHKSUM_COPY(&((u8_t*)chain_buf->p->payload)[offset], msg->msg_iov[i].iov_base, msg->msg_iov[i].iov_len);
+      if (offset & 1) {
+        chksum = SWAP_BYTES_IN_WORD(chksum);
+      }
+      acc = FOLD_U32T(acc + chksum);
       offset += msg->msg_iov[i].iov_len;
     }
-#if LWIP_CHECKSUM_ON_COPY
-    {
-      /* This can be improved by using LWIP_CHKSUM_COPY() and aggregating the checksum for each IO vector */
-      u16_t chksum = ~inet_chksum_pbuf(chain_buf->p);
-      netbuf_set_chksum(chain_buf, chksum);
+    acc = FOLD_U32T(acc);
+    netbuf_set_chksum(chain_buf, (u16_t)acc);
+#else /* LWIP_CHECKSUM_ON_COPY */
+    for (i = 0; i < msg->msg_iovlen; i++) {
+      MEMCPY(&((u8_t*)chain_buf->p->payload)[offset], msg->msg_iov[i].iov_base, msg->msg_iov[i].iov_len);
+      offset += msg->msg_iov[i].iov_len;
     }
 #endif /* LWIP_CHECKSUM_ON_COPY */
     err = ERR_OK;
@@ -1451,6 +1573,93 @@ lwip_sendto(int s, const void *data, size_t size, int flags,
   return (err == ERR_OK ? short_size : -1);
 }
 
+#if ESP_SOCKET_ZEROCOPY
+static void
+lwip_send_ref_free(struct pbuf *p)
+{
+  struct lwip_send_ref *ref = (struct lwip_send_ref *)p;
+
+  ref->done(ref, ref->done_arg);
+}
+
+int
+lwip_sendto_ref(int s, void *buf, size_t size, int flags,
+       const struct sockaddr *to, socklen_t tolen,
+       lwip_send_ref_done_fn done, void *arg)
+{
+  struct lwip_sock *sock;
+  struct lwip_send_ref *ref = (struct lwip_send_ref *)buf;
+  const u16_t headers = LWIP_SEND_REF_HEADROOM - LWIP_MEM_ALIGN_SIZE(sizeof(struct lwip_send_ref));
+  u16_t remote_port;
+  struct netbuf nb;
+  err_t err;
+  int ret;
+
+  sock = get_socket(s);
+  if (!sock) {
+    done(buf, arg);
+    return -1;
+  }
+
+  if (NETCONNTYPE_GROUP(netconn_type(sock->conn)) == NETCONN_TCP) {
+    /* The segments keep the data until it is acknowledged, each in one
+       pbuf for LWIP_NETIF_TX_SINGLE_PBUF: it is copied as for lwip_send() */
+    ret = lwip_send(s, (u8_t *)buf + LWIP_SEND_REF_HEADROOM, size, flags);
+    done(buf, arg);
+    return ret;
+  }
+
+  LWIP_ASSERT("lwip_sendto_ref: unaligned buffer", buf == LWIP_MEM_ALIGN(buf));
+  if (((to != NULL) && !SOCK_ADDR_TYPE_MATCH(to, sock)) || (size > 0xffff - headers)) {
+    done(buf, arg);
+    sock_set_errno(sock, err_to_errno(ERR_VAL));
+    return -1;
+  }
+  LWIP_ERROR("lwip_sendto_ref: invalid address", (((to == NULL) && (tolen == 0)) ||
+             (IS_SOCK_ADDR_LEN_VALID(tolen) &&
+             IS_SOCK_ADDR_TYPE_VALID(to) && IS_SOCK_ADDR_ALIGNED(to))),
+             done(buf, arg); sock_set_errno(sock, err_to_errno(ERR_ARG)); return -1;);
+  LWIP_UNUSED_ARG(tolen);
+
+  memset(&nb, 0, sizeof(nb));
+  if (to) {
+    SOCKADDR_TO_IPADDR_PORT(to, &nb.addr, remote_port);
+  } else {
+    /* any: netconn_send() goes to the remote address of the pcb */
+    remote_port = 0;
+    ip_addr_set_any(NETCONNTYPE_ISIPV6(netconn_type(sock->conn)), &nb.addr);
+  }
+  netbuf_fromport(&nb) = remote_port;
+
+  /* The headers are prepended in place, in front of the payload */
+  ref->pc.custom_free_function = lwip_send_ref_free;
+  ref->done = done;
+  ref->done_arg = arg;
+  nb.p = nb.ptr = pbuf_alloced_custom(PBUF_TRANSPORT, (u16_t)size, PBUF_RAM, &ref->pc,
+    (u8_t *)buf + LWIP_MEM_ALIGN_SIZE(sizeof(struct lwip_send_ref)), (u16_t)(headers + size));
+  LWIP_ASSERT("payload at LWIP_SEND_REF_HEADROOM",
+    nb.p->payload == (u8_t *)buf + LWIP_SEND_REF_HEADROOM);
+
+  LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_sendto_ref(%d, buf=%p, size=%"SZT_F", flags=0x%x)\n",
+              s, buf, size, flags));
+  DBG_PERF_PATH_SET(DBG_PERF_DIR_TX, DBG_PERF_POINT_SOC_OUT);
+  err = netconn_send(sock->conn, &nb);
+
+  /* done() runs once the stack (an ARP queue, say) drops its references too */
+  netbuf_free(&nb);
+
+  sock_set_errno(sock, err_to_errno(err));
+  return (err == ERR_OK ? (int)size : -1);
+}
+
+int
+lwip_send_ref(int s, void *buf, size_t size, int flags,
+       lwip_send_ref_done_fn done, void *arg)
+{
+  return lwip_sendto_ref(s, buf, size, flags, NULL, 0, done, arg);
+}
+#endif /* ESP_SOCKET_ZEROCOPY */
+
 int
 lwip_socket(int domain, int type, int protocol)
 {
@@ -3137,6 +3346,56 @@ lwip_write_r(int s, const void *data, size_t size)
   return lwip_send_r(s, data, size, 0);
 }
 
+#if ESP_SOCKET_ZEROCOPY
+static int
+lwip_sendto_ref_locked(int s, void *buf, size_t size, int flags,
+       const struct sockaddr *to, socklen_t tolen,
+       lwip_send_ref_done_fn done, void *arg, int *passed)
+{
+  LWIP_API_LOCK();
+  *passed = 1;
+  __ret = lwip_sendto_ref(s, buf, size, flags, to, tolen, done, arg);
+  LWIP_API_UNLOCK();
+}
+
+int
+lwip_sendto_ref_r(int s, void *buf, size_t size, int flags,
+       const struct sockaddr *to, socklen_t tolen,
+       lwip_send_ref_done_fn done, void *arg)
+{
+  int passed = 0;
+  int ret = lwip_sendto_ref_locked(s, buf, size, flags, to, tolen, done, arg, &passed);
+
+  /* LWIP_API_LOCK() turned away a closed socket: the buffer still goes back */
+  if (!passed) {
+    done(buf, arg);
+  }
+  return ret;
+}
+
+int
+lwip_send_ref_r(int s, void *buf, size_t size, int flags,
+       lwip_send_ref_done_fn done, void *arg)
+{
+  return lwip_sendto_ref_r(s, buf, size, flags, NULL, 0, done, arg);
+}
+
+int
+lwip_recvfrom_pbuf_r(int s, struct pbuf **p, int flags,
+              struct sockaddr *from, socklen_t *fromlen)
+{
+  LWIP_API_LOCK();
+  __ret = lwip_recvfrom_pbuf(s, p, flags, from, fromlen);
+  LWIP_API_UNLOCK();
+}
+
+int
+lwip_recv_pbuf_r(int s, struct pbuf **p, int flags)
+{
+  return lwip_recvfrom_pbuf_r(s, p, flags, NULL, NULL);
+}
+#endif /* ESP_SOCKET_ZEROCOPY */
+
 int
 lwip_writev_r(int s, const struct iovec *iov, int iovcnt)
 {
@@ -53,7 +53,7 @@
  * #define LWIP_CHKSUM <your_checksum_routine>
  *
  * Or you can select from the implementations below by defining
- * LWIP_CHKSUM_ALGORITHM to 1, 2 or 3.
+ * LWIP_CHKSUM_ALGORITHM to 1, 2, 3 or 4.
  */
 
 #ifndef LWIP_CHKSUM
@@ -258,6 +258,92 @@ lwip_standard_chksum(const void *dataptr, int len)
 }
 #endif
 
+#if (LWIP_CHKSUM_ALGORITHM == 4) || (LWIP_CHKSUM_COPY_ALGORITHM == 2)
+/** Fold a 64-bit sum of native-order 16- and 32-bit words to 16 bits:
+ * 2^16 is 1 modulo 0xffff, so the four 16-bit parts just add up. */
+static u32_t
+lwip_chksum_fold64(uint64_t sum)
+{
+  u32_t acc;
+
+  acc = (u32_t)(sum & 0xffffUL) + (u32_t)((sum >> 16) & 0xffffUL) +
+        (u32_t)((sum >> 32) & 0xffffUL) + (u32_t)(sum >> 48);
+  acc = FOLD_U32T(acc);
+  acc = FOLD_U32T(acc);
+  return acc;
+}
+#endif
+
+#if (LWIP_CHKSUM_ALGORITHM == 4) /* Alternative version #4 */
+/**
+ * Version #3 without the carry checks, for 32-bit CPUs: aligned 32-bit
+ * words are added into a 64-bit accumulator, 16 bytes per iteration, and
+ * the carries are folded in once at the end. Half the loads of version #2.
+ *
+ * @param dataptr points to start of data to be summed at any boundary
+ * @param len length of data to be summed
+ * @return host order (!) lwip checksum (non-inverted Internet sum)
+ */
+u16_t
+lwip_standard_chksum(const void *dataptr, int len)
+{
+  const u8_t *pb = (const u8_t *)dataptr;
+  const u32_t *pl;
+  u16_t t = 0;
+  uint64_t sum = 0;
+  u32_t acc;
+  /* starts at odd byte address? */
+  int odd = ((mem_ptr_t)pb & 1);
+
+  if (odd && len > 0) {
+    ((u8_t *)&t)[1] = *pb++;
+    len--;
+  }
+
+  /* Get aligned to u32_t */
+  if (((mem_ptr_t)pb & 2) && len > 1) {
+    sum += *(const u16_t *)(const void *)pb;
+    pb += 2;
+    len -= 2;
+  }
+
+  pl = (const u32_t *)(const void *)pb;
+  while (len > 15) {
+    sum += pl[0];
+    sum += pl[1];
+    sum += pl[2];
+    sum += pl[3];
+    pl += 4;
+    len -= 16;
+  }
+  while (len > 3) {
+    sum += *pl++;
+    len -= 4;
+  }
+
+  pb = (const u8_t *)pl;
+  if (len > 1) {
+    sum += *(const u16_t *)(const void *)pb;
+    pb += 2;
+    len -= 2;
+  }
+
+  /* dangling tail byte remaining? */
+  if (len > 0) {
+    ((u8_t *)&t)[0] = *pb;
+  }
+
+  sum += t;
+  acc = lwip_chksum_fold64(sum);
+
+  if (odd) {
+    acc = SWAP_BYTES_IN_WORD(acc);
+  }
+
+  return (u16_t)acc;
+}
+#endif
+
 /** Parts of the pseudo checksum which are common to IPv4 and IPv6 */
 static u16_t
 inet_cksum_pseudo_base(struct pbuf *p, u8_t proto, u16_t proto_len, u32_t acc)
@@ -610,3 +696,105 @@ lwip_chksum_copy(void *dst, const void *src, u16_t len)
   return LWIP_CHKSUM(dst, len);
 }
 #endif /* (LWIP_CHKSUM_COPY_ALGORITHM == 1) */
+
+#if (LWIP_CHKSUM_COPY_ALGORITHM == 2) /* Version #2 */
+/** Copy and sum in one pass, reading every byte once. 32-bit words are
+ * copied and summed when source and destination can be aligned together,
+ * 16-bit words when they are two bytes apart; the odd case falls back to
+ * version #1.
+ */
+u16_t
+lwip_chksum_copy(void *dst, const void *src, u16_t len)
+{
+  u8_t *db = (u8_t *)dst;
+  const u8_t *sb = (const u8_t *)src;
+  mem_ptr_t skew = ((mem_ptr_t)db ^ (mem_ptr_t)sb) & 3;
+  u16_t t = 0;
+  uint64_t sum = 0;
+  u32_t acc, w;
+  int n = len;
+  /* starts at odd byte address? */
+  int odd = ((mem_ptr_t)db & 1);
+
+  if (skew & 1) {
+    MEMCPY(dst, src, len);
+    return LWIP_CHKSUM(dst, len);
+  }
+
+  if (odd && n > 0) {
+    ((u8_t *)&t)[1] = *db++ = *sb++;
+    n--;
+  }
+
+  if (skew == 0) {
+    u32_t *dl;
+    const u32_t *sl;
+
+    if (((mem_ptr_t)db & 2) && n > 1) {
+      w = *(const u16_t *)(const void *)sb;
+      *(u16_t *)(void *)db = (u16_t)w;
+      sum += w;
+      db += 2;
+      sb += 2;
+      n -= 2;
+    }
+    dl = (u32_t *)(void *)db;
+    sl = (const u32_t *)(const void *)sb;
+    while (n > 15) {
+      w = sl[0]; dl[0] = w; sum += w;
+      w = sl[1]; dl[1] = w; sum += w;
+      w = sl[2]; dl[2] = w; sum += w;
+      w = sl[3]; dl[3] = w; sum += w;
+      dl += 4;
+      sl += 4;
+      n -= 16;
+    }
+    while (n > 3) {
+      w = *sl++;
+      *dl++ = w;
+      sum += w;
+      n -= 4;
+    }
+    db = (u8_t *)dl;
+    sb = (const u8_t *)sl;
+  } else {
+    u16_t *ds = (u16_t *)(void *)db;
+    const u16_t *ss = (const u16_t *)(const void *)sb;
+
+    while (n > 7) {
+      w = ss[0]; ds[0] = (u16_t)w; sum += w;
+      w = ss[1]; ds[1] = (u16_t)w; sum += w;
+      w = ss[2]; ds[2] = (u16_t)w; sum += w;
+      w = ss[3]; ds[3] = (u16_t)w; sum += w;
+      ds += 4;
+      ss += 4;
+      n -= 8;
+    }
+    db = (u8_t *)ds;
+    sb = (const u8_t *)ss;
+  }
+
+  while (n > 1) {
+    w = *(const u16_t *)(const void *)sb;
+    *(u16_t *)(void *)db = (u16_t)w;
+    sum += w;
+    db += 2;
+    sb += 2;
+    n -= 2;
+  }
+
+  /* dangling tail byte remaining? */
+  if (n > 0) {
+    ((u8_t *)&t)[0] = *db = *sb;
+  }
+
+  sum += t;
+  acc = lwip_chksum_fold64(sum);
+
+  if (odd) {
+    acc = SWAP_BYTES_IN_WORD(acc);
+  }
+
+  return (u16_t)acc;
+}
+#endif /* (LWIP_CHKSUM_COPY_ALGORITHM == 2) */
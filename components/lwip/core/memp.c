@@ -430,3 +430,161 @@ memp_free(memp_t type, void *mem)
 }
 
 #endif /* MEMP_MEM_MALLOC */
+
+#if ESP_MEMP_FIXED_POOLS
+/** A pool in front of the heap for one memp type */
+struct memp_fixed {
+  memp_t type;
+  u16_t num;
+  /** num elements of memp_pools[type]->size bytes, allocated by memp_init() */
+  u8_t *base;
+  /** Free elements of the pool */
+  struct memp *tab;
+  struct memp_fixed_stats stats;
+};
+
+static struct memp_fixed memp_fixed_pools[] = {
+  { MEMP_PBUF,      ESP_MEMP_NUM_PBUF },
+  { MEMP_PBUF_POOL, ESP_MEMP_NUM_PBUF_POOL },
+#if LWIP_TCP
+  { MEMP_TCP_SEG,   ESP_MEMP_NUM_TCP_SEG },
+#endif /* LWIP_TCP */
+#if LWIP_NETCONN || LWIP_SOCKET
+  { MEMP_NETBUF,    ESP_MEMP_NUM_NETBUF },
+  { MEMP_NETCONN,   ESP_MEMP_NUM_NETCONN },
+#endif /* LWIP_NETCONN || LWIP_SOCKET */
+};
+
+static struct memp_fixed *
+memp_fixed_get(memp_t type)
+{
+  u16_t i;
+
+  for (i = 0; i < LWIP_ARRAYSIZE(memp_fixed_pools); i++) {
+    if (memp_fixed_pools[i].type == type) {
+      return &memp_fixed_pools[i];
+    }
+  }
+  return NULL;
+}
+
+/**
+ * Allocate the pools, each in one block of the heap.
+ * A pool that does not fit is left empty: its type is taken from the heap.
+ */
+void
+memp_init(void)
+{
+  struct memp_fixed *pool;
+  struct memp *memp;
+  u16_t i, j, size;
+
+  for (i = 0; i < LWIP_ARRAYSIZE(memp_fixed_pools); i++) {
+    pool = &memp_fixed_pools[i];
+    size = memp_pools[pool->type]->size;
+    pool->tab = NULL;
+    pool->base = (pool->num > 0) ? (u8_t *)mem_malloc((mem_size_t)(pool->num * size)) : NULL;
+    if (pool->base == NULL) {
+      if (pool->num > 0) {
+        LWIP_DEBUGF(MEMP_DEBUG | LWIP_DBG_LEVEL_SERIOUS, ("memp_init: no room for %"U16_F" elements of pool %"U16_F"\n",
+          pool->num, (u16_t)pool->type));
+      }
+      pool->num = 0;
+    }
+    for (j = 0; j < pool->num; j++) {
+      memp = (struct memp *)(void *)(pool->base + j * size);
+      memp->next = pool->tab;
+      pool->tab = memp;
+    }
+    memset(&pool->stats, 0, sizeof(pool->stats));
+    pool->stats.num = pool->num;
+  }
+}
+
+/**
+ * Get an element of the given type: from its pool, or from the heap if the
+ * type has no pool or the pool is empty.
+ *
+ * @param type the memp type to allocate
+ * @return a pointer to the allocated memory or a NULL pointer on error
+ */
+void *
+memp_malloc(memp_t type)
+{
+  struct memp_fixed *pool = memp_fixed_get(type);
+  struct memp *memp = NULL;
+  void *mem;
+  SYS_ARCH_DECL_PROTECT(old_level);
+
+  ESP_CNT_MEM_MALLOC_INC(type);
+  if (pool != NULL) {
+    SYS_ARCH_PROTECT(old_level);
+    memp = pool->tab;
+    if (memp != NULL) {
+      pool->tab = memp->next;
+      if (++pool->stats.used > pool->stats.max) {
+        pool->stats.max = pool->stats.used;
+      }
+    } else {
+      pool->stats.fallbacks++;
+    }
+    SYS_ARCH_UNPROTECT(old_level);
+    if (memp != NULL) {
+      return memp;
+    }
+  }
+
+  mem = mem_malloc(memp_pools[type]->size);
+  if ((mem == NULL) && (pool != NULL)) {
+    SYS_ARCH_PROTECT(old_level);
+    pool->stats.err++;
+    SYS_ARCH_UNPROTECT(old_level);
+  }
+  return mem;
+}
+
+/**
+ * Put an element back into the pool it was taken from, or free it to the heap.
+ *
+ * @param type the memp type of mem
+ * @param mem the element to free
+ */
+void
+memp_free(memp_t type, void *mem)
+{
+  struct memp_fixed *pool = memp_fixed_get(type);
+  struct memp *memp;
+  SYS_ARCH_DECL_PROTECT(old_level);
+
+  ESP_CNT_MEM_FREE_INC(type);
+  if ((pool != NULL) && ((u8_t *)mem >= pool->base) &&
+      ((u8_t *)mem < pool->base + pool->num * memp_pools[type]->size)) {
+    memp = (struct memp *)mem;
+    SYS_ARCH_PROTECT(old_level);
+    memp->next = pool->tab;
+    pool->tab = memp;
+    pool->stats.used--;
+    SYS_ARCH_UNPROTECT(old_level);
+    return;
+  }
+  mem_free(mem);
+}
+
+/**
+ * Read the use of the pool of a memp type; all zero if the type has none.
+ */
+void
+memp_fixed_stats_get(memp_t type, struct memp_fixed_stats *stats)
+{
+  struct memp_fixed *pool = memp_fixed_get(type);
+  SYS_ARCH_DECL_PROTECT(old_level);
+
+  if (pool == NULL) {
+    memset(stats, 0, sizeof(*stats));
+    return;
+  }
+  SYS_ARCH_PROTECT(old_level);
+  *stats = pool->stats;
+  SYS_ARCH_UNPROTECT(old_level);
+}
+#endif /* ESP_MEMP_FIXED_POOLS */
@@ -418,6 +418,10 @@ pbuf_alloced_custom(pbuf_layer l, u16_t length, pbuf_type type, struct pbuf_cust
   p->pbuf.len = p->pbuf.tot_len = length;
   p->pbuf.type = type;
   p->pbuf.ref = 1;
+#if ESP_LWIP
+  p->pbuf.l2_owner = NULL;
+  p->pbuf.l2_buf = NULL;
+#endif
   return &p->pbuf;
 }
 #endif /* LWIP_SUPPORT_CUSTOM_PBUF */
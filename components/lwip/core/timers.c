@@ -49,6 +49,7 @@
 #include "lwip/def.h"
 #include "lwip/memp.h"
 #include "lwip/priv/tcpip_priv.h"
+#include "lwip/tcpip.h"
 
 #include "lwip/ip_frag.h"
 #include "netif/etharp.h"
@@ -68,6 +69,36 @@ static struct sys_timeo *next_timeout;
 static u32_t timeouts_last_time;
 #endif /* NO_SYS */
 
+#if LWIP_TCPIP_CORE_LOCKING
+/** The tcpip thread waits for its mbox with the core unlocked, while other
+ * threads add timeouts: since when it waits, and whether it does */
+static u32_t timeouts_wait_start;
+static u8_t timeouts_waiting;
+
+/**
+ * Take the time waited so far off the first timeout, which the times of the
+ * others are relative to. Called with the core locked.
+ */
+static void
+sys_timeouts_charge_wait(void)
+{
+  u32_t now = sys_now();
+  u32_t waited = now - timeouts_wait_start;
+
+  timeouts_wait_start = now;
+  if (next_timeout != NULL) {
+    next_timeout->time = (waited < next_timeout->time) ? (next_timeout->time - waited) : 0;
+  }
+}
+
+/** Posted to the tcpip thread to make it wait again, for a new first timeout */
+static void
+sys_timeouts_wakeup(void *arg)
+{
+  LWIP_UNUSED_ARG(arg);
+}
+#endif /* LWIP_TCPIP_CORE_LOCKING */
+
 #if LWIP_TCP
 /** global variable that shows if the tcp timer is currently scheduled or not */
 static int tcpip_tcp_timer_active;
@@ -363,6 +394,11 @@ sys_timeout(u32_t msecs, sys_timeout_handler handler, void *arg)
     diff = now - timeouts_last_time;
   }
 #endif
+#if LWIP_TCPIP_CORE_LOCKING
+  if (timeouts_waiting) {
+    sys_timeouts_charge_wait();
+  }
+#endif /* LWIP_TCPIP_CORE_LOCKING */
 
   timeout->next = NULL;
   timeout->h = handler;
@@ -386,10 +422,7 @@ sys_timeout(u32_t msecs, sys_timeout_handler handler, void *arg)
 
   if (next_timeout == NULL) {
     next_timeout = timeout;
-    return;
-  }
-
-  if (next_timeout->time > msecs) {
+  } else if (next_timeout->time > msecs) {
     next_timeout->time -= msecs;
     timeout->next = next_timeout;
     next_timeout = timeout;
@@ -406,6 +439,13 @@ sys_timeout(u32_t msecs, sys_timeout_handler handler, void *arg)
       }
     }
   }
+
+#if LWIP_TCPIP_CORE_LOCKING
+  if (timeouts_waiting && (next_timeout == timeout)) {
+    /* Added by another thread: the tcpip thread waits for a later timeout */
+    tcpip_callback_with_block(sys_timeouts_wakeup, NULL, 0);
+  }
+#endif /* LWIP_TCPIP_CORE_LOCKING */
 }
 
 /**
@@ -542,6 +582,48 @@ sys_timeouts_mbox_fetch(sys_mbox_t *mbox, void **msg)
   struct sys_timeo *tmptimeout;
   sys_timeout_handler handler;
   void *arg;
+#if LWIP_TCPIP_CORE_LOCKING
+  u32_t wait;
+
+  /* Other threads change the timeouts too, holding the core lock: the list is
+     read under the lock, and the time waited is charged to it before the
+     lock is released again */
+ again:
+  LOCK_TCPIP_CORE();
+  if ((next_timeout != NULL) && (next_timeout->time == 0)) {
+    tmptimeout = next_timeout;
+    next_timeout = tmptimeout->next;
+    handler = tmptimeout->h;
+    arg = tmptimeout->arg;
+#if LWIP_DEBUG_TIMERNAMES
+    if (handler != NULL) {
+      LWIP_DEBUGF(TIMERS_DEBUG, ("stmf calling h=%s arg=%p\n",
+        tmptimeout->handler_name, arg));
+    }
+#endif /* LWIP_DEBUG_TIMERNAMES */
+    memp_free(MEMP_SYS_TIMEOUT, tmptimeout);
+    if (handler != NULL) {
+      handler(arg);
+    }
+    UNLOCK_TCPIP_CORE();
+    LWIP_TCPIP_THREAD_ALIVE();
+    goto again;
+  }
+  wait = (next_timeout != NULL) ? next_timeout->time : 0;
+  timeouts_wait_start = sys_now();
+  timeouts_waiting = 1;
+  UNLOCK_TCPIP_CORE();
+
+  time_needed = sys_arch_mbox_fetch(mbox, msg, wait);
+
+  LOCK_TCPIP_CORE();
+  sys_timeouts_charge_wait();
+  timeouts_waiting = 0;
+  UNLOCK_TCPIP_CORE();
+  if (time_needed == SYS_ARCH_TIMEOUT) {
+    goto again;
+  }
+#else /* LWIP_TCPIP_CORE_LOCKING */
 
  again:
   if (!next_timeout) {
@@ -590,6 +672,7 @@ sys_timeouts_mbox_fetch(sys_mbox_t *mbox, void **msg)
       }
     }
   }
+#endif /* LWIP_TCPIP_CORE_LOCKING */
 }
 
 #endif /* NO_SYS */
@@ -21,5 +21,6 @@ void dbg_lwip_udp_pcb_show(void);
 void dbg_lwip_tcp_rxtx_show(void);
 void dbg_lwip_udp_rxtx_show(void);
 void dbg_lwip_mem_cnt_show(void);
+void dbg_lwip_fixed_pools_show(void);
 
 #endif
@@ -70,6 +70,26 @@ extern const struct memp_desc* const memp_pools[MEMP_MAX];
 
 #include "lwip/mem.h"
 
+#if ESP_MEMP_FIXED_POOLS
+/** Use of the preallocated pool of a memp type, see ESP_MEMP_FIXED_POOLS */
+struct memp_fixed_stats {
+  /** Elements in the pool, 0 if the type is taken from the heap only */
+  u16_t num;
+  /** Elements of the pool in use */
+  u16_t used;
+  /** Most elements of the pool in use at once */
+  u16_t max;
+  /** Allocations taken from the heap because the pool was empty */
+  u32_t fallbacks;
+  /** Allocations that failed, on the heap too */
+  u32_t err;
+};
+
+void  memp_init(void);
+void *memp_malloc(memp_t type);
+void  memp_free(memp_t type, void *mem);
+void  memp_fixed_stats_get(memp_t type, struct memp_fixed_stats *stats);
+#else /* ESP_MEMP_FIXED_POOLS */
 #define memp_init()
 #if ESP_STATS_MEM
 static inline void* memp_malloc(int type)
@@ -90,6 +110,7 @@ static inline void memp_free(int type, void *mem)
 #define memp_malloc(type)     mem_malloc(memp_pools[type]->size)
 #define memp_free(type, mem)  mem_free(mem)
 #endif
+#endif /* ESP_MEMP_FIXED_POOLS */
 
 #define LWIP_MEMPOOL_DECLARE(name,num,size,desc) \
   const struct memp_desc memp_ ## name = { \
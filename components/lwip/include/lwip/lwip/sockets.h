@@ -43,6 +43,8 @@
 #include "lwip/ip_addr.h"
 #include "lwip/err.h"
 #include "lwip/inet.h"
+#include "lwip/mem.h"
+#include "lwip/pbuf.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -506,6 +508,42 @@ int lwip_select(int maxfdp1, fd_set *readset, fd_set *writeset, fd_set *exceptse
 int lwip_ioctl(int s, long cmd, void *argp);
 int lwip_fcntl(int s, int cmd, int val);
 
+#if ESP_SOCKET_ZEROCOPY
+/** Called once the stack is done with a buffer given to lwip_sendto_ref(),
+ * from the calling task or from the tcpip thread */
+typedef void (*lwip_send_ref_done_fn)(void *buf, void *arg);
+
+/** The start of a buffer given to lwip_sendto_ref(): the pbuf that carries
+ * the payload is built in place there */
+struct lwip_send_ref {
+  struct pbuf_custom pc;
+  lwip_send_ref_done_fn done;
+  void *done_arg;
+};
+
+/** Room lwip_sendto_ref() needs in front of the payload: the pbuf and the
+ * headers the stack prepends to the payload */
+#define LWIP_SEND_REF_HEADROOM  (LWIP_MEM_ALIGN_SIZE(sizeof(struct lwip_send_ref)) + \
+  LWIP_MEM_ALIGN_SIZE(PBUF_LINK_ENCAPSULATION_HLEN + PBUF_LINK_HLEN + PBUF_IP_HLEN + PBUF_TRANSPORT_HLEN))
+
+/** Send 'size' bytes at buf + LWIP_SEND_REF_HEADROOM without copying them.
+ * 'buf' is MEM_ALIGNMENT aligned and belongs to the stack until done(buf, arg)
+ * is called, exactly once, also when -1 is returned. Datagrams go out from the
+ * buffer itself; a TCP stream keeps its data for retransmission in segments,
+ * so it is copied and done() is called before the function returns. */
+int lwip_sendto_ref(int s, void *buf, size_t size, int flags,
+    const struct sockaddr *to, socklen_t tolen, lwip_send_ref_done_fn done, void *arg);
+int lwip_send_ref(int s, void *buf, size_t size, int flags, lwip_send_ref_done_fn done, void *arg);
+
+/** Receive the next pbuf chain instead of copying it: a datagram, or the
+ * stream data at hand. The caller releases *p with pbuf_free(); until then it
+ * may hold a receive buffer of the driver (ESP_L2_TO_L3_COPY 0).
+ * Returns the length of *p, 0 at the end of a stream, or -1 and errno. */
+int lwip_recvfrom_pbuf(int s, struct pbuf **p, int flags,
+    struct sockaddr *from, socklen_t *fromlen);
+int lwip_recv_pbuf(int s, struct pbuf **p, int flags);
+#endif /* ESP_SOCKET_ZEROCOPY */
+
 #if LWIP_COMPAT_SOCKETS
 #if LWIP_COMPAT_SOCKETS != 2
 
@@ -536,6 +574,14 @@ int lwip_select(int maxfdp1, fd_set *readset, fd_set *writeset, fd_set *exceptse
                 struct timeval *timeout);
 int lwip_ioctl_r(int s, long cmd, void *argp);
 int lwip_fcntl_r(int s, int cmd, int val);
+#if ESP_SOCKET_ZEROCOPY
+int lwip_sendto_ref_r(int s, void *buf, size_t size, int flags,
+    const struct sockaddr *to, socklen_t tolen, lwip_send_ref_done_fn done, void *arg);
+int lwip_send_ref_r(int s, void *buf, size_t size, int flags, lwip_send_ref_done_fn done, void *arg);
+int lwip_recvfrom_pbuf_r(int s, struct pbuf **p, int flags,
+    struct sockaddr *from, socklen_t *fromlen);
+int lwip_recv_pbuf_r(int s, struct pbuf **p, int flags);
+#endif /* ESP_SOCKET_ZEROCOPY */
 
 #define accept(s,addr,addrlen)                    lwip_accept_r(s,addr,addrlen)
 #define bind(s,name,namelen)                      lwip_bind_r(s,name,namelen)
@@ -555,6 +601,12 @@ int lwip_fcntl_r(int s, int cmd, int val);
 #define socket(domain,type,protocol)              lwip_socket(domain,type,protocol)
 #define select(maxfdp1,readset,writeset,exceptset,timeout)     lwip_select(maxfdp1,readset,writeset,exceptset,timeout)
 #define ioctlsocket(s,cmd,argp)                   lwip_ioctl_r(s,cmd,argp)
+#if ESP_SOCKET_ZEROCOPY
+#define sendto_ref(s,buf,size,flags,to,tolen,done,arg) lwip_sendto_ref_r(s,buf,size,flags,to,tolen,done,arg)
+#define send_ref(s,buf,size,flags,done,arg)       lwip_send_ref_r(s,buf,size,flags,done,arg)
+#define recvfrom_pbuf(s,p,flags,from,fromlen)     lwip_recvfrom_pbuf_r(s,p,flags,from,fromlen)
+#define recv_pbuf(s,p,flags)                      lwip_recv_pbuf_r(s,p,flags)
+#endif /* ESP_SOCKET_ZEROCOPY */
 
 #if LWIP_POSIX_SOCKETS_IO_NAMES
 #define read(s,mem,len)                           lwip_read_r(s,mem,len)
@@ -585,6 +637,12 @@ int lwip_fcntl_r(int s, int cmd, int val);
 #define socket(domain,type,protocol)              lwip_socket(domain,type,protocol)
 #define select(maxfdp1,readset,writeset,exceptset,timeout)     lwip_select(maxfdp1,readset,writeset,exceptset,timeout)
 #define ioctlsocket(s,cmd,argp)                   lwip_ioctl(s,cmd,argp)
+#if ESP_SOCKET_ZEROCOPY
+#define sendto_ref(s,buf,size,flags,to,tolen,done,arg) lwip_sendto_ref(s,buf,size,flags,to,tolen,done,arg)
+#define send_ref(s,buf,size,flags,done,arg)       lwip_send_ref(s,buf,size,flags,done,arg)
+#define recvfrom_pbuf(s,p,flags,from,fromlen)     lwip_recvfrom_pbuf(s,p,flags,from,fromlen)
+#define recv_pbuf(s,p,flags)                      lwip_recv_pbuf(s,p,flags)
+#endif /* ESP_SOCKET_ZEROCOPY */
 
 #if LWIP_POSIX_SOCKETS_IO_NAMES
 #define read(s,mem,len)                           lwip_read(s,mem,len)
@@ -74,6 +74,13 @@ sys_sem_t* sys_thread_sem_init(void);
 void sys_thread_sem_deinit(void);
 sys_sem_t* sys_thread_sem_get(void);
 
+#if LWIP_TCPIP_CORE_LOCKING
+void sys_lock_tcpip_core(void);
+void sys_unlock_tcpip_core(void);
+#define LOCK_TCPIP_CORE()     sys_lock_tcpip_core()
+#define UNLOCK_TCPIP_CORE()   sys_unlock_tcpip_core()
+#endif
+
 #ifdef __cplusplus
 }
 #endif
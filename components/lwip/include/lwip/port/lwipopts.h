@@ -57,7 +57,9 @@
  * MEMCPY: override this if you have a faster implementation at hand than the
  * one included in your C library
  */
+#ifndef MEMCPY
 #define MEMCPY(dst,src,len)             memcpy(dst,src,len)
+#endif
 
 /**
  * SMEMCPY: override this with care! Some compilers (e.g. gcc) can inline a
@@ -84,7 +86,9 @@
 * Especially useful with MEM_LIBC_MALLOC but handle with care regarding execution
 * speed and usage from interrupts!
 */
+#ifndef MEMP_MEM_MALLOC
 #define MEMP_MEM_MALLOC                 1
+#endif
 
 /**
  * MEM_ALIGNMENT: should be set to the alignment of the CPU
@@ -402,7 +406,9 @@
  * NETCONN_TCP. The queue size value itself is platform-dependent, but is passed
  * to sys_mbox_new() when the recvmbox is created.
  */
+#ifndef DEFAULT_TCP_RECVMBOX_SIZE
 #define DEFAULT_TCP_RECVMBOX_SIZE       6
+#endif
 
 /**
  * DEFAULT_ACCEPTMBOX_SIZE: The mailbox size for the incoming connections.
@@ -438,10 +444,13 @@
    ----------------------------------------------
 */
 /**
- * LWIP_TCPIP_CORE_LOCKING: (EXPERIMENTAL!)
- * Don't use it if you're not an active lwIP project member
+ * LWIP_TCPIP_CORE_LOCKING: netconn and socket calls run in the calling task,
+ * holding the tcpip core lock (a priority-inheriting mutex, see sys_arch.c),
+ * instead of being posted to the tcpip thread and waited for.
  */
-#define LWIP_TCPIP_CORE_LOCKING         0
+#ifndef LWIP_TCPIP_CORE_LOCKING
+#define LWIP_TCPIP_CORE_LOCKING         CONFIG_LWIP_TCPIP_CORE_LOCKING
+#endif
 
 /*
    ------------------------------------
@@ -605,10 +614,40 @@
 #define ESP_STATS_DROP                  0
 #define ESP_STATS_TCP                   0
 #define ESP_DHCP_TIMER                  1
+#define ESP_SOCKET_ZEROCOPY             1
 #define ESP_LWIP_LOGI(...)              ESP_LOGI("lwip", __VA_ARGS__)
 
+/*
+ * ESP_MEMP_FIXED_POOLS: with MEMP_MEM_MALLOC, take the memp types below from
+ * pools preallocated by memp_init() first, and from the heap only when their
+ * pool is empty. A type with 0 elements stays on the heap.
+ * Received pbufs are PBUF_POOL copies with ESP_L2_TO_L3_COPY, and PBUF_REF
+ * headers in the driver's buffer without.
+ */
+#ifndef ESP_MEMP_FIXED_POOLS
+#define ESP_MEMP_FIXED_POOLS            (MEMP_MEM_MALLOC && CONFIG_LWIP_FIXED_POOLS)
+#endif
+#if ESP_L2_TO_L3_COPY
+#define ESP_MEMP_NUM_PBUF_POOL          CONFIG_LWIP_POOL_RX_PBUFS
+#define ESP_MEMP_NUM_PBUF               0
+#else
+#define ESP_MEMP_NUM_PBUF_POOL          0
+#define ESP_MEMP_NUM_PBUF               CONFIG_LWIP_POOL_RX_PBUFS
+#endif
+#define ESP_MEMP_NUM_TCP_SEG            CONFIG_LWIP_POOL_TCP_SEGS
+#define ESP_MEMP_NUM_NETBUF             CONFIG_LWIP_POOL_NETBUFS
+#define ESP_MEMP_NUM_NETCONN            CONFIG_LWIP_POOL_NETCONNS
+
+/* lwip_sendto_ref() builds a custom pbuf in the caller's buffer */
+#define LWIP_SUPPORT_CUSTOM_PBUF        ESP_SOCKET_ZEROCOPY
+
+/* Overridable from the command line, for the benchmarks in test_lwip_host */
+#ifndef TCP_WND_DEFAULT
 #define TCP_WND_DEFAULT                 (4*TCP_MSS)
+#endif
+#ifndef TCP_SND_BUF_DEFAULT
 #define TCP_SND_BUF_DEFAULT             (2*TCP_MSS)
+#endif
 
 #if ESP_PERF
 #define DBG_PERF_PATH_SET(dir, point)
@@ -646,9 +685,26 @@ enum {
 #define LWIP_DEBUG                      LWIP_DBG_OFF
 #define TCP_DEBUG                       LWIP_DBG_OFF
 
+#ifndef CHECKSUM_CHECK_UDP
 #define CHECKSUM_CHECK_UDP              0
+#endif
 #define CHECKSUM_CHECK_IP               0
 
+/**
+ * LWIP_CHKSUM_ALGORITHM 4: sum 32-bit words, 16 bytes per loop.
+ * LWIP_CHECKSUM_ON_COPY: TCP and UDP sends sum the payload while copying it
+ * into the pbuf, in one pass with LWIP_CHKSUM_COPY_ALGORITHM 2.
+ */
+#ifndef LWIP_CHKSUM_ALGORITHM
+#define LWIP_CHKSUM_ALGORITHM           4
+#endif
+#ifndef LWIP_CHECKSUM_ON_COPY
+#define LWIP_CHECKSUM_ON_COPY           1
+#endif
+#ifndef LWIP_CHKSUM_COPY_ALGORITHM
+#define LWIP_CHKSUM_COPY_ALGORITHM      2
+#endif
+
 #define LWIP_NETCONN_FULLDUPLEX         1
 #define LWIP_NETCONN_SEM_PER_THREAD     1
 
@@ -211,3 +211,24 @@ void dbg_lwip_cnt_show(void)
 
 #endif
 
+#if ESP_MEMP_FIXED_POOLS
+void dbg_lwip_fixed_pools_show(void)
+{
+    static const struct { memp_t type; const char *name; } pools[] = {
+        { MEMP_PBUF, "pbuf" },
+        { MEMP_PBUF_POOL, "pbuf_pool" },
+        { MEMP_TCP_SEG, "tcp_seg" },
+        { MEMP_NETBUF, "netbuf" },
+        { MEMP_NETCONN, "netconn" },
+    };
+    struct memp_fixed_stats stats;
+    unsigned int i;
+
+    ESP_LWIP_LOGI("-----lwip preallocated pools-----");
+    ESP_LWIP_LOGI("%10s %5s %5s %5s %9s %5s", "pool", "num", "used", "max", "fallbacks", "err");
+    for (i = 0; i < sizeof(pools) / sizeof(pools[0]); i++) {
+        memp_fixed_stats_get(pools[i].type, &stats);
+        ESP_LWIP_LOGI("%10s %5u %5u %5u %9u %5u", pools[i].name, stats.num, stats.used, stats.max, stats.fallbacks, stats.err);
+    }
+}
+#endif
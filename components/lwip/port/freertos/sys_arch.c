@@ -38,6 +38,7 @@
 #include "lwip/mem.h"
 #include "arch/sys_arch.h"
 #include "lwip/stats.h"
+#include "lwip/priv/tcpip_priv.h"
 #include "esp_log.h"
 
 /* This is the number of threads that can be started with sys_thread_new() */
@@ -48,6 +49,9 @@ static sys_mutex_t g_lwip_protect_mutex = NULL;
 
 #if !LWIP_COMPAT_MUTEX
 /** Create a new mutex
+ * FreeRTOS mutexes inherit priority: a low priority task holding one runs at
+ * the priority of the highest task waiting for it. lock_tcpip_core relies on
+ * that, since every task calling into the stack takes it.
  * @param mutex pointer to the mutex to create
  * @return a new mutex */
 err_t
@@ -425,6 +429,37 @@ sys_thread_new(const char *name, lwip_thread_fn thread, void *arg, int stacksize
   }
 }
 
+#if LWIP_TCPIP_CORE_LOCKING
+/* Task holding lock_tcpip_core, NULL if none */
+static volatile sys_thread_t s_tcpip_core_owner = NULL;
+
+/*-----------------------------------------------------------------------------------*/
+/*
+ * Lock the stack for the calling task. The mutex is not recursive, so taking
+ * it again from inside the stack (a socket call from a netif callback, say)
+ * would wait forever: stop there instead.
+ */
+void
+sys_lock_tcpip_core(void)
+{
+  sys_thread_t self = xTaskGetCurrentTaskHandle();
+
+  if (s_tcpip_core_owner == self) {
+    ESP_LOGE(TAG, "tcpip core locked twice by %s\n", pcTaskGetTaskName(self));
+    sys_arch_assert(__FILE__, __LINE__);
+  }
+  sys_mutex_lock(&lock_tcpip_core);
+  s_tcpip_core_owner = self;
+}
+
+void
+sys_unlock_tcpip_core(void)
+{
+  s_tcpip_core_owner = NULL;
+  sys_mutex_unlock(&lock_tcpip_core);
+}
+#endif /* LWIP_TCPIP_CORE_LOCKING */
+
 /*-----------------------------------------------------------------------------------*/
 // Initialize sys arch
 void
@@ -148,14 +148,19 @@ wlanif_input(struct netif *netif, void *buffer, u16_t len, void* eb)
     goto _exit;
 
 #if (ESP_L2_TO_L3_COPY == 1)
+#if ESP_MEMP_FIXED_POOLS && ESP_MEMP_NUM_PBUF_POOL
+  /* From the preallocated pool; a chain if the frame does not fit in one */
+  p = pbuf_alloc(PBUF_RAW, len, PBUF_POOL);
+#else
   p = pbuf_alloc(PBUF_RAW, len, PBUF_RAM);
+#endif
   if (p == NULL) {
     ESP_STATS_DROP_INC(esp.wlanif_input_pbuf_fail);
     esp_wifi_internal_free_rx_buffer(eb);
     return;
   }
   p->l2_owner = NULL;
-  memcpy(p->payload, buffer, len);
+  pbuf_take(p, buffer, len);
   esp_wifi_internal_free_rx_buffer(eb);
 #else
   p = pbuf_alloc(PBUF_RAW, len, PBUF_REF);
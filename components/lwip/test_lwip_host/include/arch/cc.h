@@ -0,0 +1,55 @@
+/*
+ * Host (Linux) version of include/lwip/port/arch/cc.h: the same types and
+ * options, with the byte order taken from the C library.
+ */
+#ifndef __ARCH_CC_H__
+#define __ARCH_CC_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <errno.h>
+#include <endian.h>
+
+#include "arch/sys_arch.h"
+
+typedef uint8_t  u8_t;
+typedef int8_t   s8_t;
+typedef uint16_t u16_t;
+typedef int16_t  s16_t;
+typedef uint32_t u32_t;
+typedef int32_t  s32_t;
+
+typedef unsigned long   mem_ptr_t;
+typedef int sys_prot_t;
+
+#define S16_F "d"
+#define U16_F "d"
+#define X16_F "x"
+
+#define S32_F "d"
+#define U32_F "d"
+#define X32_F "x"
+
+#define PACK_STRUCT_FIELD(x) x
+#define PACK_STRUCT_STRUCT __attribute__((packed))
+#define PACK_STRUCT_BEGIN
+#define PACK_STRUCT_END
+
+#include <stdio.h>
+
+#define LWIP_PLATFORM_DIAG(x)   do {printf x;} while(0)
+#define LWIP_PLATFORM_ASSERT(x) do {printf(x); sys_arch_assert(__FILE__, __LINE__);} while(0)
+
+#define LWIP_NOASSERT
+
+/* MEMCPY() of the build, see the Makefile */
+void *perf_memcpy(void *dst, const void *src, size_t len);
+
+/* Both ends of the pipeif link belong to one stack: send from the end that
+   owns the source address, see pipeif.h */
+struct ip4_addr;
+struct netif;
+struct netif *pipeif_route_src(const struct ip4_addr *dest, const struct ip4_addr *src);
+#define LWIP_HOOK_IP4_ROUTE_SRC(dest, src) pipeif_route_src(dest, src)
+
+#endif /* __ARCH_CC_H__ */
@@ -0,0 +1,57 @@
+/*
+ * Host (Linux) port of the lwIP operating system abstraction: the same
+ * interface as the FreeRTOS port in include/lwip/port/arch/sys_arch.h,
+ * built on pthreads.
+ */
+
+#ifndef __SYS_ARCH_H__
+#define __SYS_ARCH_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+typedef struct sys_sem_s *sys_sem_t;
+typedef pthread_mutex_t *sys_mutex_t;
+typedef struct sys_thread_s *sys_thread_t;
+
+typedef struct sys_mbox_s *sys_mbox_t;
+
+
+#define LWIP_COMPAT_MUTEX 0
+
+#if !LWIP_COMPAT_MUTEX
+#define sys_mutex_valid( x ) ( ( ( *x ) == NULL) ? 0 : 1 )
+#define sys_mutex_set_invalid( x ) ( ( *x ) = NULL )
+#endif
+
+#define sys_mbox_valid( x ) ( ( ( *x ) == NULL) ? 0 : 1 )
+#define sys_mbox_set_invalid( x ) ( ( *x ) = NULL )
+
+#define sys_sem_valid( x ) ( ( ( *x ) == NULL) ? 0 : 1 )
+#define sys_sem_set_invalid( x ) ( ( *x ) = NULL )
+
+void sys_arch_assert(const char *file, int line);
+uint32_t system_get_time(void);
+void sys_delay_ms(uint32_t ms);
+sys_sem_t* sys_thread_sem_init(void);
+void sys_thread_sem_deinit(void);
+sys_sem_t* sys_thread_sem_get(void);
+
+#if LWIP_TCPIP_CORE_LOCKING
+void sys_lock_tcpip_core(void);
+void sys_unlock_tcpip_core(void);
+#define LOCK_TCPIP_CORE()     sys_lock_tcpip_core()
+#define UNLOCK_TCPIP_CORE()   sys_unlock_tcpip_core()
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SYS_ARCH_H__ */
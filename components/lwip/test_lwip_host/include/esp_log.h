@@ -0,0 +1,9 @@
+/* Host stand-in for esp_log.h */
+#pragma once
+#include <stdio.h>
+
+#define ESP_LOGE(tag, format, ...)      fprintf(stderr, "E %s: " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...)      fprintf(stderr, "W %s: " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...)      do { } while (0)
+#define ESP_LOGD(tag, format, ...)      do { } while (0)
+#define ESP_LOGV(tag, format, ...)      do { } while (0)
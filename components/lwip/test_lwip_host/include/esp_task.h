@@ -0,0 +1,5 @@
+/* Host stand-in for esp_task.h: lwipopts.h takes the tcpip thread settings from here */
+#pragma once
+
+#define ESP_TASK_TCPIP_PRIO             0
+#define ESP_TASK_TCPIP_STACK            0
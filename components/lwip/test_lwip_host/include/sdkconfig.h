@@ -0,0 +1,20 @@
+/* Kconfig defaults of the lwip component, for the host build */
+#pragma once
+
+#define CONFIG_LWIP_MAX_SOCKETS                 10
+#define CONFIG_LWIP_THREAD_LOCAL_STORAGE_INDEX  0
+#define CONFIG_LWIP_SO_REUSE                    0
+#define CONFIG_LWIP_SO_RCVBUF                   0
+#define CONFIG_LWIP_DHCP_MAX_NTP_SERVERS        1
+#define CONFIG_LWIP_IP_FRAG                     0
+#define CONFIG_LWIP_IP_REASSEMBLY               0
+#define CONFIG_TCP_MAXRTX                       12
+#define CONFIG_TCP_SYNMAXRTX                    6
+#define CONFIG_LWIP_TCPIP_CORE_LOCKING          1
+#define CONFIG_LWIP_DHCP_DOES_ARP_CHECK         1
+#define CONFIG_L2_TO_L3_COPY                    0
+#define CONFIG_LWIP_FIXED_POOLS                 1
+#define CONFIG_LWIP_POOL_RX_PBUFS               16
+#define CONFIG_LWIP_POOL_TCP_SEGS               32
+#define CONFIG_LWIP_POOL_NETBUFS                16
+#define CONFIG_LWIP_POOL_NETCONNS               10
@@ -0,0 +1,93 @@
+/*
+ * Host versions of examples/performance/tcp_perf and udp_perf: the server and
+ * the client both run in this process, on the two ends of a pipeif link.
+ */
+
+#ifndef __LWIP_HOST_PERF_H__
+#define __LWIP_HOST_PERF_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PERF_SERVER_IP      "10.0.0.2"
+#define PERF_CLIENT_IP      "10.0.0.1"
+
+/* Allocations during a run, counted by wrapping pbuf_alloc() and malloc() */
+typedef struct {
+    uint32_t pbuf_ram;
+    uint32_t pbuf_pool;
+    uint32_t pbuf_ref;          /* PBUF_REF and PBUF_ROM */
+    uint32_t heap;              /* malloc() calls, including one per packet for the pipeif "driver" */
+} perf_allocs_t;
+
+typedef struct {
+    uint64_t bytes;             /* received by the server */
+    uint32_t corrupt;           /* received bytes that differ from what was sent */
+    double seconds;
+    uint32_t packets;           /* sent on the link, both directions */
+    uint32_t dropped;           /* dropped by the link, or on input with the tcpip mailbox full */
+    perf_allocs_t allocs;
+    uint64_t copied;            /* payload bytes copied by lwIP: MEMCPY() and the checksum on copy */
+    uint64_t ctxsw;             /* context switches of the process, voluntary and involuntary */
+    /* latency of the client's send() or of a request/response exchange */
+    uint32_t latency_count;
+    uint32_t latency_us[5];     /* below 10us, 100us, 1ms, 10ms, above */
+    uint32_t latency_max_us;
+    double latency_mean_us;
+} perf_result_t;
+
+/* Start the tcpip thread and the link on first use; 0 on success */
+int perf_stack_start(void);
+
+/* Drop every Nth packet the link carries, 0 for a perfect link */
+void perf_link_drop_every(uint32_t n);
+
+/* Microseconds until a sys_timeout() of 'ms' added from the calling thread
+   fires; UINT32_MAX if it did not within a second after it was due */
+uint32_t perf_timeout_us(uint32_t ms);
+
+/* The lwipopts.h settings the stack was built with */
+const char *perf_build_options(void);
+
+/* How the server reads */
+typedef enum {
+    PERF_RECV_COPY,             /* recv() into its buffer */
+    PERF_RECV_PBUF,             /* lwip_recv_pbuf() */
+    PERF_RECV_MIXED,            /* a short recv(), then lwip_recv_pbuf() for the rest */
+} perf_recv_t;
+
+/* The client sends 'total' bytes in send() calls of 'pkt_size' bytes to the server */
+int tcp_perf_run(uint32_t total, int pkt_size, perf_result_t *result);
+int tcp_perf_run_recv(uint32_t total, int pkt_size, perf_recv_t recv_mode, perf_result_t *result);
+
+/* The client sends 'count' datagrams of 'pkt_size' bytes, as fast as it can */
+int udp_perf_run(uint32_t count, int pkt_size, perf_result_t *result);
+
+/* The same with lwip_sendto_ref() from buffers of the client and
+   lwip_recv_pbuf(); -1 if a buffer did not come back exactly once */
+int udp_perf_run_zerocopy(uint32_t count, int pkt_size, perf_result_t *result);
+
+/* 'count' request/response exchanges of 'pkt_size' bytes with an echo server */
+int udp_perf_echo(uint32_t count, int pkt_size, perf_result_t *result);
+
+/* 'count' getsockopt() calls: a socket call that sends nothing */
+int udp_perf_getsockopt(uint32_t count, perf_result_t *result);
+
+/* One datagram sent with sendmsg(), from 'count' vectors of 'lens' bytes;
+   0 if it arrived intact */
+int udp_perf_sendmsg(const uint32_t *lens, int count);
+
+/* Used by the runs: clear 'result' and start counting, stop counting */
+void perf_begin(perf_result_t *result);
+void perf_end(perf_result_t *result);
+uint64_t perf_now_us(void);
+void perf_latency(perf_result_t *result, uint64_t us);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LWIP_HOST_PERF_H__ */
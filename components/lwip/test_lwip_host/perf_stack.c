@@ -0,0 +1,290 @@
+/*
+ * The stack the benchmarks run on: lwIP with its tcpip thread, and a pipeif
+ * link between the client and the server address.
+ */
+
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/resource.h>
+
+#include "lwip/opt.h"
+#include "lwip/tcpip.h"
+#include "lwip/timers.h"
+#include "lwip/priv/tcpip_priv.h"
+#include "lwip/pbuf.h"
+#include "lwip/ip_addr.h"
+#include "pipeif.h"
+#include "perf.h"
+
+static struct netif client_netif, server_netif;
+static struct pipeif client_pipe, server_pipe;
+static perf_allocs_t allocs;
+static uint64_t copied;
+static __thread int in_chksum_copy;
+
+static pthread_mutex_t start_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t start_cond = PTHREAD_COND_INITIALIZER;
+static int started;
+
+struct pbuf *__real_pbuf_alloc(pbuf_layer layer, u16_t length, pbuf_type type);
+void *__real_malloc(size_t size);
+
+struct pbuf *
+__wrap_pbuf_alloc(pbuf_layer layer, u16_t length, pbuf_type type)
+{
+  switch (type) {
+  case PBUF_RAM:
+    __sync_fetch_and_add(&allocs.pbuf_ram, 1);
+    break;
+  case PBUF_POOL:
+    __sync_fetch_and_add(&allocs.pbuf_pool, 1);
+    break;
+  default:
+    __sync_fetch_and_add(&allocs.pbuf_ref, 1);
+    break;
+  }
+  return __real_pbuf_alloc(layer, length, type);
+}
+
+/* With MEM_LIBC_MALLOC, the heap of lwIP is malloc() */
+void *
+__wrap_malloc(size_t size)
+{
+  __sync_fetch_and_add(&allocs.heap, 1);
+  return __real_malloc(size);
+}
+
+/* MEMCPY() of lwIP, see arch/cc.h */
+void *
+perf_memcpy(void *dst, const void *src, size_t len)
+{
+  if (!in_chksum_copy) {
+    __sync_fetch_and_add(&copied, len);
+  }
+  return memcpy(dst, src, len);
+}
+
+/* The checksum on copy, counted once if it falls back to MEMCPY() */
+u16_t __real_lwip_chksum_copy(void *dst, const void *src, u16_t len);
+
+u16_t
+__wrap_lwip_chksum_copy(void *dst, const void *src, u16_t len)
+{
+  u16_t chksum;
+
+  __sync_fetch_and_add(&copied, len);
+  in_chksum_copy = 1;
+  chksum = __real_lwip_chksum_copy(dst, src, len);
+  in_chksum_copy = 0;
+  return chksum;
+}
+
+/* Called by the coarse DHCP timer. The DHCP server of apps/ is built on
+   tcpip_adapter and is not part of the host build. */
+void
+dhcps_coarse_tmr(void)
+{
+}
+
+/* Voluntary and involuntary context switches of all threads so far */
+static uint64_t
+ctxsw_now(void)
+{
+  struct rusage usage;
+
+  getrusage(RUSAGE_SELF, &usage);
+  return (uint64_t)usage.ru_nvcsw + usage.ru_nivcsw;
+}
+
+static void
+add_netif(struct netif *netif, struct pipeif *pipe, const char *addr)
+{
+  ip4_addr_t ip, mask, gw;
+
+  ip4addr_aton(addr, &ip);
+  IP4_ADDR(&mask, 255, 255, 255, 0);
+  ip4_addr_set_zero(&gw);
+  netif_add(netif, &ip, &mask, &gw, pipe, pipeif_init, tcpip_input);
+  netif_set_up(netif);
+}
+
+static void
+tcpip_init_done(void *arg)
+{
+  add_netif(&server_netif, &server_pipe, PERF_SERVER_IP);
+  add_netif(&client_netif, &client_pipe, PERF_CLIENT_IP);
+  pipeif_connect(&client_netif, &server_netif);
+  netif_set_default(&client_netif);
+
+  pthread_mutex_lock(&start_lock);
+  started = 1;
+  pthread_cond_broadcast(&start_cond);
+  pthread_mutex_unlock(&start_lock);
+}
+
+int
+perf_stack_start(void)
+{
+  static int initialized;
+
+  if (!initialized) {
+    initialized = 1;
+    tcpip_init(tcpip_init_done, NULL);
+  }
+  pthread_mutex_lock(&start_lock);
+  while (!started) {
+    pthread_cond_wait(&start_cond, &start_lock);
+  }
+  pthread_mutex_unlock(&start_lock);
+  return 0;
+}
+
+void
+perf_link_drop_every(uint32_t n)
+{
+  client_pipe.drop_every = n;
+  server_pipe.drop_every = n;
+}
+
+struct timeout_wait {
+  u32_t ms;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  int fired;
+};
+
+static void
+timeout_fired(void *arg)
+{
+  struct timeout_wait *wait = (struct timeout_wait *)arg;
+
+  pthread_mutex_lock(&wait->lock);
+  wait->fired = 1;
+  pthread_cond_signal(&wait->cond);
+  pthread_mutex_unlock(&wait->lock);
+}
+
+#if !LWIP_TCPIP_CORE_LOCKING
+static void
+timeout_add(void *arg)
+{
+  struct timeout_wait *wait = (struct timeout_wait *)arg;
+
+  sys_timeout(wait->ms, timeout_fired, wait);
+}
+#endif
+
+uint32_t
+perf_timeout_us(uint32_t ms)
+{
+  /* Static: a timeout that fires after we gave up must not find a dead stack */
+  static struct timeout_wait wait = { 0, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0 };
+  struct timespec deadline;
+  uint64_t start;
+  int fired;
+
+  if (perf_stack_start() != 0) {
+    return UINT32_MAX;
+  }
+  pthread_mutex_lock(&wait.lock);
+  wait.ms = ms;
+  wait.fired = 0;
+  pthread_mutex_unlock(&wait.lock);
+
+  start = perf_now_us();
+#if LWIP_TCPIP_CORE_LOCKING
+  /* Added from this thread, while the tcpip thread waits */
+  LOCK_TCPIP_CORE();
+  sys_timeout(ms, timeout_fired, &wait);
+  UNLOCK_TCPIP_CORE();
+#else
+  tcpip_callback(timeout_add, &wait);
+#endif
+
+  /* sys_timeout() drops the timeout if MEMP_SYS_TIMEOUT is empty */
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  deadline.tv_sec += ms / 1000 + 1;
+  pthread_mutex_lock(&wait.lock);
+  while (!wait.fired) {
+    if (pthread_cond_timedwait(&wait.cond, &wait.lock, &deadline) != 0) {
+      break;
+    }
+  }
+  fired = wait.fired;
+  pthread_mutex_unlock(&wait.lock);
+  return fired ? (uint32_t)(perf_now_us() - start) : UINT32_MAX;
+}
+
+#define STR_(x) #x
+#define STR(x) STR_(x)
+
+const char *
+perf_build_options(void)
+{
+  return "TCP_WND_DEFAULT=" STR(TCP_WND_DEFAULT)
+         " TCP_SND_BUF_DEFAULT=" STR(TCP_SND_BUF_DEFAULT)
+         " DEFAULT_TCP_RECVMBOX_SIZE=" STR(DEFAULT_TCP_RECVMBOX_SIZE)
+         " MEMP_MEM_MALLOC=" STR(MEMP_MEM_MALLOC)
+         " ESP_L2_TO_L3_COPY=" STR(ESP_L2_TO_L3_COPY)
+         " LWIP_TCPIP_CORE_LOCKING=" STR(LWIP_TCPIP_CORE_LOCKING)
+         " ESP_MEMP_FIXED_POOLS=" STR(ESP_MEMP_FIXED_POOLS);
+}
+
+uint64_t
+perf_now_us(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+static uint32_t
+dropped(void)
+{
+  return client_pipe.dropped + client_pipe.rx_dropped +
+         server_pipe.dropped + server_pipe.rx_dropped;
+}
+
+static uint64_t begin_us, begin_ctxsw;
+static uint32_t begin_packets, begin_dropped;
+
+void
+perf_begin(perf_result_t *result)
+{
+  memset(result, 0, sizeof(*result));
+  memset(&allocs, 0, sizeof(allocs));
+  copied = 0;
+  begin_packets = client_pipe.tx_packets + server_pipe.tx_packets;
+  begin_dropped = dropped();
+  begin_ctxsw = ctxsw_now();
+  begin_us = perf_now_us();
+}
+
+void
+perf_end(perf_result_t *result)
+{
+  result->seconds = (perf_now_us() - begin_us) / 1e6;
+  result->packets = client_pipe.tx_packets + server_pipe.tx_packets - begin_packets;
+  result->dropped = dropped() - begin_dropped;
+  result->allocs = allocs;
+  result->copied = copied;
+  result->ctxsw = ctxsw_now() - begin_ctxsw;
+  if (result->latency_count) {
+    result->latency_mean_us /= result->latency_count;
+  }
+}
+
+void
+perf_latency(perf_result_t *result, uint64_t us)
+{
+  int bucket = us < 10 ? 0 : us < 100 ? 1 : us < 1000 ? 2 : us < 10000 ? 3 : 4;
+
+  result->latency_us[bucket]++;
+  result->latency_count++;
+  result->latency_mean_us += us;
+  if (us > result->latency_max_us) {
+    result->latency_max_us = us;
+  }
+}
@@ -0,0 +1,148 @@
+/*
+ * In-process point-to-point link for running lwIP on the host.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "lwip/opt.h"
+#include "lwip/def.h"
+#include "lwip/pbuf.h"
+#include "lwip/ip.h"
+#include "pipeif.h"
+
+/* The receiving half: what wlanif_input() does with a frame from the Wi-Fi driver */
+static void
+pipeif_input(struct netif *netif, void *buffer, u16_t len)
+{
+  struct pbuf *p;
+
+#if (ESP_L2_TO_L3_COPY == 1)
+#if ESP_MEMP_FIXED_POOLS && ESP_MEMP_NUM_PBUF_POOL
+  /* From the preallocated pool; a chain if the frame does not fit in one */
+  p = pbuf_alloc(PBUF_RAW, len, PBUF_POOL);
+#else
+  p = pbuf_alloc(PBUF_RAW, len, PBUF_RAM);
+#endif
+  if (p == NULL) {
+    free(buffer);
+    return;
+  }
+  p->l2_owner = NULL;
+  pbuf_take(p, buffer, len);
+  free(buffer);
+#else
+  p = pbuf_alloc(PBUF_RAW, len, PBUF_REF);
+  if (p == NULL) {
+    free(buffer);
+    return;
+  }
+  p->payload = buffer;
+  p->l2_owner = netif;
+  p->l2_buf = buffer;
+#endif
+
+  /* tcpip_input() fails with the tcpip mailbox full */
+  if (netif->input(p, netif) != ERR_OK) {
+    ((struct pipeif *)netif->state)->rx_dropped++;
+    pbuf_free(p);
+  }
+}
+
+static err_t
+low_level_output(struct netif *netif, struct pbuf *p)
+{
+  struct pipeif *pipe = (struct pipeif *)netif->state;
+  struct pbuf *q;
+  u16_t offset;
+  void *buffer;
+
+  if (pipe->peer == NULL) {
+    return ERR_IF;
+  }
+  if (p->next != NULL) {
+    pipe->tx_chained++;
+  }
+  pipe->tx_packets++;
+  pipe->tx_bytes += p->tot_len;
+  if (pipe->drop_every && pipe->tx_packets % pipe->drop_every == 0) {
+    pipe->dropped++;
+    return ERR_OK;
+  }
+
+  /* The peer's receive DMA: memcpy(), not a MEMCPY() of the stack */
+  buffer = malloc(p->tot_len);
+  if (buffer == NULL) {
+    return ERR_MEM;
+  }
+  for (q = p, offset = 0; q != NULL; offset += q->len, q = q->next) {
+    memcpy((u8_t *)buffer + offset, q->payload, q->len);
+  }
+  pipeif_input(pipe->peer, buffer, p->tot_len);
+  return ERR_OK;
+}
+
+static err_t
+pipeif_output(struct netif *netif, struct pbuf *p, const ip4_addr_t *ipaddr)
+{
+  return low_level_output(netif, p);
+}
+
+#if LWIP_IPV6
+static err_t
+pipeif_output_ip6(struct netif *netif, struct pbuf *p, const ip6_addr_t *ipaddr)
+{
+  return low_level_output(netif, p);
+}
+#endif
+
+err_t
+pipeif_init(struct netif *netif)
+{
+  LWIP_ASSERT("netif != NULL", (netif != NULL));
+
+#if LWIP_NETIF_HOSTNAME
+  netif->hostname = "pipe";
+#endif
+  netif->name[0] = 'p';
+  netif->name[1] = 'i';
+
+  netif->output = pipeif_output;
+#if LWIP_IPV6
+  netif->output_ip6 = pipeif_output_ip6;
+#endif
+  netif->linkoutput = low_level_output;
+
+  netif->mtu = 1500;
+  netif->flags = NETIF_FLAG_LINK_UP;
+#if !ESP_L2_TO_L3_COPY
+  netif->l2_buffer_free_notify = free;
+#endif
+
+  return ERR_OK;
+}
+
+void
+pipeif_connect(struct netif *a, struct netif *b)
+{
+  ((struct pipeif *)a->state)->peer = b;
+  ((struct pipeif *)b->state)->peer = a;
+}
+
+struct netif *
+pipeif_route_src(const ip4_addr_t *dest, const ip4_addr_t *src)
+{
+  struct netif *netif;
+
+  LWIP_UNUSED_ARG(dest);
+  if (ip4_addr_isany(src)) {
+    return NULL;
+  }
+  for (netif = netif_list; netif != NULL; netif = netif->next) {
+    if (netif->output == pipeif_output && netif_is_up(netif) &&
+        ip4_addr_cmp(src, netif_ip4_addr(netif))) {
+      return netif;
+    }
+  }
+  return NULL;
+}
@@ -0,0 +1,49 @@
+/*
+ * In-process link for running lwIP on the host: two point-to-point netifs
+ * joined back to back, each IP packet sent on one end is received on the
+ * other. Both ends belong to the one stack, which takes a packet arriving on
+ * either end for any of its addresses; a packet is sent from the end that
+ * owns its source address (LWIP_HOOK_IP4_ROUTE_SRC), as a bound UDP pcb may
+ * only send from its own netif. There is no ARP as it would answer for one
+ * end only.
+ *
+ * Receiving follows port/netif/wlanif.c: the packet is copied into a "driver"
+ * buffer, then handed to the stack as a PBUF_REF that gives the buffer back
+ * through l2_buffer_free_notify, or copied into a PBUF_RAM pbuf when
+ * ESP_L2_TO_L3_COPY is set.
+ */
+
+#ifndef _PIPE_LWIP_IF_H_
+#define _PIPE_LWIP_IF_H_
+
+#include "lwip/err.h"
+#include "lwip/netif.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct pipeif {
+  struct netif *peer;
+  u32_t tx_packets;
+  u32_t tx_bytes;
+  u32_t tx_chained;     /* packets that came as a pbuf chain and had to be flattened */
+  u32_t drop_every;     /* drop every Nth packet sent, 0 to drop none */
+  u32_t dropped;
+  u32_t rx_dropped;     /* received packets the stack did not take */
+};
+
+/* netif_add() init function, netif->state must point to a zeroed struct pipeif */
+err_t pipeif_init(struct netif *netif);
+
+/* Join two netifs set up by pipeif_init() */
+void pipeif_connect(struct netif *a, struct netif *b);
+
+/* LWIP_HOOK_IP4_ROUTE_SRC: the pipeif that owns 'src', NULL to route by 'dest' */
+struct netif *pipeif_route_src(const ip4_addr_t *dest, const ip4_addr_t *src);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _PIPE_LWIP_IF_H_ */
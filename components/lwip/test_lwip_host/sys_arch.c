@@ -0,0 +1,520 @@
+/*
+ * Host (Linux) port of the lwIP operating system abstraction.
+ *
+ * Mirrors port/freertos/sys_arch.c on pthreads: binary semaphores, mailboxes
+ * that wake their reader when they are freed, and a per thread semaphore for
+ * LWIP_NETCONN_SEM_PER_THREAD.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+
+#include "lwip/debug.h"
+#include "lwip/def.h"
+#include "lwip/sys.h"
+#include "lwip/mem.h"
+#include "arch/sys_arch.h"
+#include "lwip/priv/tcpip_priv.h"
+#include "esp_log.h"
+
+#define TAG "lwip_arch"
+
+struct sys_sem_s {
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  u8_t count;           /* 0 or 1, as a FreeRTOS binary semaphore */
+};
+
+struct sys_mbox_s {
+  pthread_mutex_t lock;
+  pthread_cond_t not_empty;
+  pthread_cond_t not_full;
+  void **msgs;
+  int size;
+  int head;
+  int count;
+  int readers;          /* threads blocked in sys_arch_mbox_fetch() */
+  u8_t alive;
+};
+
+struct sys_thread_s {
+  pthread_t thread;
+  lwip_thread_fn fn;
+  void *arg;
+};
+
+static pthread_mutex_t g_lwip_protect_mutex;
+static pthread_key_t g_thread_sem_key;
+static pthread_once_t g_thread_sem_once = PTHREAD_ONCE_INIT;
+static struct timespec g_start;
+
+/* Absolute CLOCK_MONOTONIC time 'ms' from now */
+static void
+deadline_after(struct timespec *ts, u32_t ms)
+{
+  clock_gettime(CLOCK_MONOTONIC, ts);
+  ts->tv_sec += ms / 1000;
+  ts->tv_nsec += (long)(ms % 1000) * 1000000;
+  if (ts->tv_nsec >= 1000000000) {
+    ts->tv_sec++;
+    ts->tv_nsec -= 1000000000;
+  }
+}
+
+static void
+cond_init(pthread_cond_t *cond)
+{
+  pthread_condattr_t attr;
+
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(cond, &attr);
+  pthread_condattr_destroy(&attr);
+}
+
+/* Milliseconds since 'start', at least 1 as the FreeRTOS port returns */
+static u32_t
+elapsed_since(u32_t start)
+{
+  u32_t elapsed = sys_now() - start;
+  return elapsed ? elapsed : 1;
+}
+
+#if !LWIP_COMPAT_MUTEX
+err_t
+sys_mutex_new(sys_mutex_t *pxMutex)
+{
+  pthread_mutexattr_t attr;
+
+  *pxMutex = malloc(sizeof(pthread_mutex_t));
+  if (*pxMutex == NULL) {
+    return ERR_MEM;
+  }
+  /* Priority inheritance, as FreeRTOS mutexes have */
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_INHERIT);
+  pthread_mutex_init(*pxMutex, &attr);
+  pthread_mutexattr_destroy(&attr);
+  return ERR_OK;
+}
+
+void
+sys_mutex_lock(sys_mutex_t *pxMutex)
+{
+  pthread_mutex_lock(*pxMutex);
+}
+
+err_t
+sys_mutex_trylock(sys_mutex_t *pxMutex)
+{
+  if (pthread_mutex_trylock(*pxMutex) == 0) return 0;
+  else return -1;
+}
+
+void
+sys_mutex_unlock(sys_mutex_t *pxMutex)
+{
+  pthread_mutex_unlock(*pxMutex);
+}
+
+void
+sys_mutex_free(sys_mutex_t *pxMutex)
+{
+  pthread_mutex_destroy(*pxMutex);
+  free(*pxMutex);
+}
+#endif
+
+/*-----------------------------------------------------------------------------------*/
+err_t
+sys_sem_new(sys_sem_t *sem, u8_t count)
+{
+  *sem = malloc(sizeof(struct sys_sem_s));
+  if (*sem == NULL) {
+    return ERR_MEM;
+  }
+  pthread_mutex_init(&(*sem)->lock, NULL);
+  cond_init(&(*sem)->cond);
+  (*sem)->count = count ? 1 : 0;
+  return ERR_OK;
+}
+
+void
+sys_sem_signal(sys_sem_t *sem)
+{
+  pthread_mutex_lock(&(*sem)->lock);
+  (*sem)->count = 1;
+  pthread_cond_signal(&(*sem)->cond);
+  pthread_mutex_unlock(&(*sem)->lock);
+}
+
+u32_t
+sys_arch_sem_wait(sys_sem_t *sem, u32_t timeout)
+{
+  u32_t start = sys_now();
+  struct timespec deadline;
+  int ret = 0;
+
+  if (timeout != 0) {
+    deadline_after(&deadline, timeout);
+  }
+
+  pthread_mutex_lock(&(*sem)->lock);
+  while ((*sem)->count == 0 && ret != ETIMEDOUT) {
+    if (timeout != 0) {
+      ret = pthread_cond_timedwait(&(*sem)->cond, &(*sem)->lock, &deadline);
+    } else {
+      pthread_cond_wait(&(*sem)->cond, &(*sem)->lock);
+    }
+  }
+  if ((*sem)->count == 0) {
+    pthread_mutex_unlock(&(*sem)->lock);
+    return SYS_ARCH_TIMEOUT;
+  }
+  (*sem)->count = 0;
+  pthread_mutex_unlock(&(*sem)->lock);
+
+  return elapsed_since(start);
+}
+
+void
+sys_sem_free(sys_sem_t *sem)
+{
+  pthread_cond_destroy(&(*sem)->cond);
+  pthread_mutex_destroy(&(*sem)->lock);
+  free(*sem);
+}
+
+/*-----------------------------------------------------------------------------------*/
+err_t
+sys_mbox_new(sys_mbox_t *mbox, int size)
+{
+  *mbox = malloc(sizeof(struct sys_mbox_s));
+  if (*mbox == NULL) {
+    return ERR_MEM;
+  }
+  (*mbox)->msgs = malloc(size * sizeof(void *));
+  if ((*mbox)->msgs == NULL) {
+    free(*mbox);
+    return ERR_MEM;
+  }
+  pthread_mutex_init(&(*mbox)->lock, NULL);
+  cond_init(&(*mbox)->not_empty);
+  cond_init(&(*mbox)->not_full);
+  (*mbox)->size = size;
+  (*mbox)->head = 0;
+  (*mbox)->count = 0;
+  (*mbox)->readers = 0;
+  (*mbox)->alive = true;
+  return ERR_OK;
+}
+
+/* Called with the mailbox locked and room for one message */
+static void
+mbox_put(struct sys_mbox_s *m, void *msg)
+{
+  m->msgs[(m->head + m->count) % m->size] = msg;
+  m->count++;
+  pthread_cond_signal(&m->not_empty);
+}
+
+void
+sys_mbox_post(sys_mbox_t *mbox, void *msg)
+{
+  struct sys_mbox_s *m = *mbox;
+
+  pthread_mutex_lock(&m->lock);
+  while (m->count == m->size) {
+    pthread_cond_wait(&m->not_full, &m->lock);
+  }
+  mbox_put(m, msg);
+  pthread_mutex_unlock(&m->lock);
+}
+
+err_t
+sys_mbox_trypost(sys_mbox_t *mbox, void *msg)
+{
+  struct sys_mbox_s *m = *mbox;
+  err_t xReturn = ERR_MEM;
+
+  pthread_mutex_lock(&m->lock);
+  if (m->count < m->size) {
+    mbox_put(m, msg);
+    xReturn = ERR_OK;
+  }
+  pthread_mutex_unlock(&m->lock);
+
+  return xReturn;
+}
+
+u32_t
+sys_arch_mbox_fetch(sys_mbox_t *mbox, void **msg, u32_t timeout)
+{
+  struct sys_mbox_s *m = *mbox;
+  u32_t start = sys_now();
+  struct timespec deadline;
+  void *dummyptr;
+  int ret = 0;
+
+  if (msg == NULL) {
+    msg = &dummyptr;
+  }
+  if (m == NULL) {
+    *msg = NULL;
+    return -1;
+  }
+  if (timeout != 0) {
+    deadline_after(&deadline, timeout);
+  }
+
+  pthread_mutex_lock(&m->lock);
+  m->readers++;
+  while (m->count == 0 && m->alive && ret != ETIMEDOUT) {
+    if (timeout != 0) {
+      ret = pthread_cond_timedwait(&m->not_empty, &m->lock, &deadline);
+    } else {
+      pthread_cond_wait(&m->not_empty, &m->lock);
+    }
+  }
+  m->readers--;
+
+  if (m->count == 0) {
+    *msg = NULL;
+    if (m->alive) {
+      pthread_mutex_unlock(&m->lock);
+      return SYS_ARCH_TIMEOUT;
+    }
+    /* sys_mbox_free() waits for the last reader to leave */
+    pthread_cond_broadcast(&m->not_full);
+    pthread_mutex_unlock(&m->lock);
+    return elapsed_since(start);
+  }
+  *msg = m->msgs[m->head];
+  m->head = (m->head + 1) % m->size;
+  m->count--;
+  pthread_cond_signal(&m->not_full);
+  pthread_mutex_unlock(&m->lock);
+
+  return elapsed_since(start);
+}
+
+u32_t
+sys_arch_mbox_tryfetch(sys_mbox_t *mbox, void **msg)
+{
+  struct sys_mbox_s *m = *mbox;
+  void *pvDummy;
+  u32_t ulReturn = SYS_MBOX_EMPTY;
+
+  if (msg == NULL) {
+    msg = &pvDummy;
+  }
+
+  pthread_mutex_lock(&m->lock);
+  if (m->count > 0) {
+    *msg = m->msgs[m->head];
+    m->head = (m->head + 1) % m->size;
+    m->count--;
+    pthread_cond_signal(&m->not_full);
+    ulReturn = ERR_OK;
+  }
+  pthread_mutex_unlock(&m->lock);
+
+  return ulReturn;
+}
+
+/*
+  Wakes a reader still blocked on the mailbox, as the FreeRTOS port does by
+  posting NULL, and waits for it to leave before freeing.
+*/
+void
+sys_mbox_free(sys_mbox_t *mbox)
+{
+  struct sys_mbox_s *m = *mbox;
+
+  pthread_mutex_lock(&m->lock);
+  m->alive = false;
+  pthread_cond_broadcast(&m->not_empty);
+  while (m->readers > 0) {
+    pthread_cond_wait(&m->not_full, &m->lock);
+  }
+  pthread_mutex_unlock(&m->lock);
+
+  pthread_cond_destroy(&m->not_empty);
+  pthread_cond_destroy(&m->not_full);
+  pthread_mutex_destroy(&m->lock);
+  free(m->msgs);
+  free(m);
+  *mbox = NULL;
+}
+
+/*-----------------------------------------------------------------------------------*/
+static void *
+thread_start(void *arg)
+{
+  struct sys_thread_s *t = arg;
+
+  t->fn(t->arg);
+  return NULL;
+}
+
+/* Stack size and priority are FreeRTOS settings and are ignored */
+sys_thread_t
+sys_thread_new(const char *name, lwip_thread_fn thread, void *arg, int stacksize, int prio)
+{
+  struct sys_thread_s *t = malloc(sizeof(struct sys_thread_s));
+
+  if (t == NULL) {
+    return NULL;
+  }
+  t->fn = thread;
+  t->arg = arg;
+  if (pthread_create(&t->thread, NULL, thread_start, t) != 0) {
+    free(t);
+    return NULL;
+  }
+  pthread_detach(t->thread);
+  return t;
+}
+
+#if LWIP_TCPIP_CORE_LOCKING
+/* Whether the calling thread holds lock_tcpip_core */
+static __thread u8_t g_tcpip_core_held;
+
+void
+sys_lock_tcpip_core(void)
+{
+  if (g_tcpip_core_held) {
+    ESP_LOGE(TAG, "tcpip core locked twice by the same thread\n");
+    sys_arch_assert(__FILE__, __LINE__);
+  }
+  sys_mutex_lock(&lock_tcpip_core);
+  g_tcpip_core_held = 1;
+}
+
+void
+sys_unlock_tcpip_core(void)
+{
+  g_tcpip_core_held = 0;
+  sys_mutex_unlock(&lock_tcpip_core);
+}
+#endif /* LWIP_TCPIP_CORE_LOCKING */
+
+/*-----------------------------------------------------------------------------------*/
+void
+sys_init(void)
+{
+  pthread_mutexattr_t attr;
+
+  clock_gettime(CLOCK_MONOTONIC, &g_start);
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutex_init(&g_lwip_protect_mutex, &attr);
+  pthread_mutexattr_destroy(&attr);
+}
+
+uint32_t
+system_get_time(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint32_t)((now.tv_sec - g_start.tv_sec) * 1000000 + (now.tv_nsec - g_start.tv_nsec) / 1000);
+}
+
+u32_t
+sys_now(void)
+{
+  return system_get_time() / 1000;
+}
+
+sys_prot_t
+sys_arch_protect(void)
+{
+  pthread_mutex_lock(&g_lwip_protect_mutex);
+  return (sys_prot_t) 1;
+}
+
+void
+sys_arch_unprotect(sys_prot_t pval)
+{
+  pthread_mutex_unlock(&g_lwip_protect_mutex);
+}
+
+void
+sys_arch_assert(const char *file, int line)
+{
+  ESP_LOGE(TAG, "\nAssertion: %d in %s\n", line, file);
+  abort();
+}
+
+/*-----------------------------------------------------------------------------------*/
+static void
+sys_thread_tls_free(void *data)
+{
+  sys_sem_t *sem = (sys_sem_t *)data;
+
+  if (sem && *sem) {
+    sys_sem_free(sem);
+  }
+  free(sem);
+}
+
+static void
+sys_thread_key_init(void)
+{
+  pthread_key_create(&g_thread_sem_key, sys_thread_tls_free);
+}
+
+sys_sem_t*
+sys_thread_sem_get(void)
+{
+  sys_sem_t *sem;
+
+  pthread_once(&g_thread_sem_once, sys_thread_key_init);
+  sem = pthread_getspecific(g_thread_sem_key);
+  if (!sem) {
+    sem = sys_thread_sem_init();
+  }
+  return sem;
+}
+
+sys_sem_t*
+sys_thread_sem_init(void)
+{
+  sys_sem_t *sem = malloc(sizeof(sys_sem_t));
+
+  if (!sem) {
+    ESP_LOGE(TAG, "thread_sem_init: out of memory");
+    return 0;
+  }
+  if (sys_sem_new(sem, 0) != ERR_OK) {
+    free(sem);
+    ESP_LOGE(TAG, "thread_sem_init: out of memory");
+    return 0;
+  }
+
+  pthread_once(&g_thread_sem_once, sys_thread_key_init);
+  pthread_setspecific(g_thread_sem_key, sem);
+  return sem;
+}
+
+void
+sys_thread_sem_deinit(void)
+{
+  sys_sem_t *sem;
+
+  pthread_once(&g_thread_sem_once, sys_thread_key_init);
+  sem = pthread_getspecific(g_thread_sem_key);
+  sys_thread_tls_free(sem);
+  pthread_setspecific(g_thread_sem_key, NULL);
+}
+
+void
+sys_delay_ms(uint32_t ms)
+{
+  struct timespec ts = { ms / 1000, (long)(ms % 1000) * 1000000 };
+
+  nanosleep(&ts, NULL);
+}
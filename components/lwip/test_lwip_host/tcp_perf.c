@@ -0,0 +1,199 @@
+/*
+ * examples/performance/tcp_perf on the host: the client sends, the server
+ * receives and checks the data.
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "lwip/sockets.h"
+#include "perf.h"
+
+#define DEFAULT_PORT    4567
+
+/* Every run listens on a new port, clear of the connections of the one before */
+static u16_t port = DEFAULT_PORT;
+
+/* Byte 'offset' of the stream */
+static inline char
+pattern(uint64_t offset)
+{
+  return 'a' + offset % 26;
+}
+
+/* Short enough that the segment it reads from is left over */
+#define MIXED_RECV_LEN  100
+
+struct server {
+  int listen_socket;
+  perf_recv_t recv_mode;
+  perf_result_t *result;
+};
+
+static void
+check_data(struct server *server, const char *data, int len)
+{
+  int i;
+
+  for (i = 0; i < len; i++) {
+    if (data[i] != pattern(server->result->bytes + i)) {
+      server->result->corrupt++;
+    }
+  }
+  server->result->bytes += len;
+}
+
+static int
+recv_pbuf_data(struct server *server, int connect_socket)
+{
+  struct pbuf *p, *q;
+  int len;
+
+  len = lwip_recv_pbuf(connect_socket, &p, 0);
+  if (len <= 0) {
+    return len;
+  }
+  for (q = p; q != NULL; q = q->next) {
+    check_data(server, q->payload, q->len);
+  }
+  pbuf_free(p);
+  return len;
+}
+
+static void *
+recv_data(void *arg)
+{
+  struct server *server = arg;
+  struct sockaddr_in client_addr;
+  socklen_t socklen = sizeof(client_addr);
+  char databuff[TCP_MSS * 2];
+  int connect_socket, len;
+
+  connect_socket = accept(server->listen_socket, (struct sockaddr *)&client_addr, &socklen);
+  if (connect_socket < 0) {
+    return NULL;
+  }
+  do {
+    switch (server->recv_mode) {
+    case PERF_RECV_PBUF:
+      len = recv_pbuf_data(server, connect_socket);
+      break;
+    case PERF_RECV_MIXED:
+      len = recv(connect_socket, databuff, MIXED_RECV_LEN, 0);
+      if (len > 0) {
+        check_data(server, databuff, len);
+        len = recv_pbuf_data(server, connect_socket);
+      }
+      break;
+    default:
+      len = recv(connect_socket, databuff, sizeof(databuff), 0);
+      if (len > 0) {
+        check_data(server, databuff, len);
+      }
+      break;
+    }
+  } while (len > 0);
+  close(connect_socket);
+  return NULL;
+}
+
+static int
+create_tcp_server(void)
+{
+  struct sockaddr_in server_addr;
+  int server_socket = socket(AF_INET, SOCK_STREAM, 0);
+
+  if (server_socket < 0) {
+    return -1;
+  }
+  memset(&server_addr, 0, sizeof(server_addr));
+  server_addr.sin_family = AF_INET;
+  server_addr.sin_port = htons(++port);
+  server_addr.sin_addr.s_addr = inet_addr(PERF_SERVER_IP);
+  if (bind(server_socket, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0 ||
+      listen(server_socket, 5) < 0) {
+    close(server_socket);
+    return -1;
+  }
+  return server_socket;
+}
+
+static int
+create_tcp_client(void)
+{
+  struct sockaddr_in server_addr;
+  int connect_socket = socket(AF_INET, SOCK_STREAM, 0);
+
+  if (connect_socket < 0) {
+    return -1;
+  }
+  memset(&server_addr, 0, sizeof(server_addr));
+  server_addr.sin_family = AF_INET;
+  server_addr.sin_port = htons(port);
+  server_addr.sin_addr.s_addr = inet_addr(PERF_SERVER_IP);
+  if (connect(connect_socket, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
+    close(connect_socket);
+    return -1;
+  }
+  return connect_socket;
+}
+
+int
+tcp_perf_run(uint32_t total, int pkt_size, perf_result_t *result)
+{
+  return tcp_perf_run_recv(total, pkt_size, PERF_RECV_COPY, result);
+}
+
+int
+tcp_perf_run_recv(uint32_t total, int pkt_size, perf_recv_t recv_mode, perf_result_t *result)
+{
+  struct server server;
+  pthread_t thread;
+  char *databuff;
+  uint64_t sent = 0, start;
+  int connect_socket, len, i;
+
+  if (perf_stack_start() != 0) {
+    return -1;
+  }
+  server.listen_socket = create_tcp_server();
+  if (server.listen_socket < 0) {
+    return -1;
+  }
+  /* The pattern repeats every 26 bytes: send from a buffer 26 bytes longer */
+  databuff = malloc(pkt_size + 26);
+  for (i = 0; i < pkt_size + 26; i++) {
+    databuff[i] = pattern(i);
+  }
+
+  perf_begin(result);
+  server.recv_mode = recv_mode;
+  server.result = result;
+  pthread_create(&thread, NULL, recv_data, &server);
+
+  connect_socket = create_tcp_client();
+  if (connect_socket < 0) {
+    close(server.listen_socket);
+    pthread_join(thread, NULL);
+    free(databuff);
+    return -1;
+  }
+  while (sent < total) {
+    len = total - sent < (uint64_t)pkt_size ? (int)(total - sent) : pkt_size;
+    start = perf_now_us();
+    len = send(connect_socket, databuff + sent % 26, len, 0);
+    if (len <= 0) {
+      break;
+    }
+    perf_latency(result, perf_now_us() - start);
+    sent += len;
+  }
+  close(connect_socket);
+  pthread_join(thread, NULL);
+  perf_end(result);
+
+  close(server.listen_socket);
+  free(databuff);
+  return sent == total ? 0 : -1;
+}
@@ -0,0 +1,188 @@
+// Copyright 2015-2017 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "catch.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include "perf.h"
+#include "lwip/inet_chksum.h"
+#include "lwip/pbuf.h"
+
+extern "C" u16_t lwip_standard_chksum(const void *dataptr, int len);
+
+/* RFC 1071, a byte pair at a time: the sum as stored in memory, in host order */
+static u16_t ref_chksum(const u8_t* p, int len)
+{
+    u32_t acc = 0;
+    for (int i = 0; i + 1 < len; i += 2) {
+        acc += (p[i] << 8) | p[i + 1];
+    }
+    if (len & 1) {
+        acc += p[len - 1] << 8;
+    }
+    while (acc >> 16) {
+        acc = (acc >> 16) + (acc & 0xffff);
+    }
+    return htons((u16_t)acc);
+}
+
+/* Version #2 of inet_chksum.c, the one used before, to compare with */
+static u16_t alg2_chksum(const void* dataptr, int len)
+{
+    const u8_t* pb = (const u8_t*)dataptr;
+    const u16_t* ps;
+    u16_t t = 0;
+    u32_t sum = 0;
+    int odd = ((mem_ptr_t)pb & 1);
+
+    if (odd && len > 0) {
+        ((u8_t*)&t)[1] = *pb++;
+        len--;
+    }
+    ps = (const u16_t*)(const void*)pb;
+    while (len > 1) {
+        sum += *ps++;
+        len -= 2;
+    }
+    if (len > 0) {
+        ((u8_t*)&t)[0] = *(const u8_t*)ps;
+    }
+    sum += t;
+    sum = FOLD_U32T(sum);
+    sum = FOLD_U32T(sum);
+    if (odd) {
+        sum = SWAP_BYTES_IN_WORD(sum);
+    }
+    return (u16_t)sum;
+}
+
+static void fill_random(u8_t* buf, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        buf[i] = rand();
+    }
+}
+
+TEST_CASE("checksum matches RFC 1071 at every alignment", "[chksum]")
+{
+    static u8_t buf[2048 + 8];
+    srand(1);
+    for (int len = 0; len <= 2048; len += (len < 64 ? 1 : 37)) {
+        for (int offset = 0; offset < 8; offset++) {
+            fill_random(buf + offset, len);
+            REQUIRE(lwip_standard_chksum(buf + offset, len) == ref_chksum(buf + offset, len));
+        }
+    }
+
+    SECTION("all ones, where the carries pile up") {
+        memset(buf, 0xff, sizeof(buf));
+        for (int offset = 0; offset < 4; offset++) {
+            CHECK(lwip_standard_chksum(buf + offset, 2048) == ref_chksum(buf + offset, 2048));
+            CHECK(lwip_standard_chksum(buf + offset, 2047) == ref_chksum(buf + offset, 2047));
+        }
+    }
+}
+
+TEST_CASE("checksum on copy copies and sums at every alignment", "[chksum]")
+{
+    static u8_t src[2048 + 8], dst[2048 + 16];
+    srand(2);
+    for (int len = 0; len <= 2048; len += (len < 64 ? 1 : 41)) {
+        for (int so = 0; so < 4; so++) {
+            for (int d = 0; d < 4; d++) {
+                fill_random(src + so, len);
+                memset(dst, 0x5a, sizeof(dst));
+                u16_t sum = lwip_chksum_copy(dst + 4 + d, src + so, len);
+                REQUIRE(sum == ref_chksum(src + so, len));
+                REQUIRE(memcmp(dst + 4 + d, src + so, len) == 0);
+                /* nothing written around the destination */
+                int outside = 0;
+                for (size_t i = 0; i < sizeof(dst); i++) {
+                    if ((i < 4u + d || i >= 4u + d + len) && dst[i] != 0x5a) {
+                        outside++;
+                    }
+                }
+                REQUIRE(outside == 0);
+            }
+        }
+    }
+}
+
+TEST_CASE("checksum of a pbuf chain with odd lengths", "[chksum]")
+{
+    static u8_t data[1500];
+    const u16_t lens[] = { 1, 14, 3, 1000, 481, 1 };
+    struct pbuf* head = NULL;
+    u16_t total = 0;
+
+    srand(3);
+    fill_random(data, sizeof(data));
+    for (u16_t len : lens) {
+        struct pbuf* p = pbuf_alloc(PBUF_RAW, len, PBUF_RAM);
+        REQUIRE(p != NULL);
+        memcpy(p->payload, data + total, len);
+        total += len;
+        if (head) {
+            pbuf_cat(head, p);
+        } else {
+            head = p;
+        }
+    }
+    CHECK(inet_chksum_pbuf(head) == (u16_t)~ref_chksum(data, total));
+    pbuf_free(head);
+}
+
+TEST_CASE("UDP sendmsg sums its vectors on copy", "[chksum]")
+{
+    /* The host build checks the checksum of received UDP datagrams, a
+       wrong sum drops the datagram. Odd vectors shift the ones after them. */
+    const uint32_t lens[] = { 3, 300, 1, 7, 250 };
+    REQUIRE(udp_perf_sendmsg(lens, 5) == 0);
+}
+
+template<typename F>
+static double mbytes_per_s(F f, int len)
+{
+    const int rounds = 20000000 / (len + 64);
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; i++) {
+        f();
+    }
+    std::chrono::duration<double> secs = std::chrono::steady_clock::now() - start;
+    return (double)rounds * len / secs.count() / 1e6;
+}
+
+TEST_CASE("checksum throughput", "[chksum][bench]")
+{
+    static u8_t src[8192 + 8], dst[8192 + 8];
+    volatile u16_t sink = 0;
+    const int lens[] = { 64, 536, 1460, 8192 };
+
+    fill_random(src, sizeof(src));
+    printf("checksum, MB/s        version #2  LWIP_CHKSUM | MEMCPY + #2  LWIP_CHKSUM_COPY\n");
+    for (int len : lens) {
+        for (int offset = 0; offset < 4; offset++) {
+            const u8_t* s = src + offset;
+            double old_sum = mbytes_per_s([&] { sink = alg2_chksum(s, len); }, len);
+            double new_sum = mbytes_per_s([&] { sink = lwip_standard_chksum(s, len); }, len);
+            double old_copy = mbytes_per_s([&] { memcpy(dst, s, len); sink = alg2_chksum(dst, len); }, len);
+            double new_copy = mbytes_per_s([&] { sink = lwip_chksum_copy(dst + offset, s, len); }, len);
+            printf("%4d bytes at +%d   %11.0f %12.0f | %11.0f %17.0f\n",
+                   len, offset, old_sum, new_sum, old_copy, new_copy);
+        }
+    }
+    (void)sink;
+}
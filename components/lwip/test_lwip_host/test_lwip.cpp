@@ -0,0 +1,199 @@
+// Copyright 2015-2017 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "catch.hpp"
+#include "perf.h"
+#include <cstdio>
+#include <iostream>
+
+static void report(const char* name, const perf_result_t& r)
+{
+    double mb = r.bytes / 1e6;
+    printf("%-22s %8.1f Mbit/s %7u packets %5u dropped | per MB: %6.0f pbuf_ram %6.0f pbuf_ref %7.0f malloc"
+           " | latency: mean %7.1f us max %6u us (<10us %u, <100us %u, <1ms %u, <10ms %u, more %u)\n",
+           name, r.bytes * 8 / r.seconds / 1e6, r.packets, r.dropped,
+           r.allocs.pbuf_ram / mb, r.allocs.pbuf_ref / mb, r.allocs.heap / mb,
+           r.latency_mean_us, r.latency_max_us,
+           r.latency_us[0], r.latency_us[1], r.latency_us[2], r.latency_us[3], r.latency_us[4]);
+}
+
+TEST_CASE("a TCP stream crosses the pipe link intact", "[lwip]")
+{
+    perf_result_t r;
+    const uint32_t total = 1000000;
+    REQUIRE(tcp_perf_run(total, 1460, &r) == 0);
+    CHECK(r.bytes == total);
+    CHECK(r.corrupt == 0);
+    /* At least one segment per 1460 bytes, plus the ACKs */
+    CHECK(r.packets > total / 1460);
+    CHECK(r.dropped == 0);
+
+    SECTION("with sends not aligned to segments") {
+        REQUIRE(tcp_perf_run(total, 1000, &r) == 0);
+        CHECK(r.bytes == total);
+        CHECK(r.corrupt == 0);
+    }
+}
+
+TEST_CASE("lost packets are retransmitted", "[lwip]")
+{
+    perf_result_t r;
+    const uint32_t total = 100000;
+    perf_link_drop_every(37);
+    int ret = tcp_perf_run(total, 1460, &r);
+    perf_link_drop_every(0);
+    REQUIRE(ret == 0);
+    CHECK(r.dropped > 0);
+    CHECK(r.bytes == total);
+    CHECK(r.corrupt == 0);
+}
+
+TEST_CASE("UDP datagrams and echoes arrive intact", "[lwip]")
+{
+    perf_result_t r;
+    REQUIRE(udp_perf_echo(200, 1000, &r) == 0);
+    CHECK(r.bytes == 200 * 1000);
+    CHECK(r.corrupt == 0);
+
+    /* Sent in lockstep, nothing overflows the receive mailbox */
+    REQUIRE(udp_perf_run(1, 1472, &r) == 0);
+    CHECK(r.bytes == 1472);
+    CHECK(r.corrupt == 0);
+}
+
+TEST_CASE("zero-copy send and pbuf receive", "[lwip]")
+{
+    perf_result_t r;
+    const uint32_t total = 1000000;
+
+    /* One copy on each side: into the pbuf on send, out of it on receive */
+    REQUIRE(udp_perf_run(1, 1472, &r) == 0);
+    CHECK(r.copied >= 2 * 1472);
+
+    /* None: the headers go in front of the payload in the client's buffer.
+       Every buffer comes back, also those of datagrams the server's full
+       receive mailbox drops. */
+    REQUIRE(udp_perf_run_zerocopy(200, 1472, &r) == 0);
+    CHECK(r.bytes > 0);
+    CHECK(r.bytes % 1472 == 0);
+    CHECK(r.corrupt == 0);
+    CHECK(r.copied == 0);
+
+    /* A stream copies only on send */
+    REQUIRE(tcp_perf_run_recv(total, 1460, PERF_RECV_PBUF, &r) == 0);
+    CHECK(r.bytes == total);
+    CHECK(r.corrupt == 0);
+    CHECK(r.copied >= total);
+    CHECK(r.copied < total + 100);
+
+    SECTION("after a recv() that leaves part of a segment") {
+        REQUIRE(tcp_perf_run_recv(total, 1000, PERF_RECV_MIXED, &r) == 0);
+        CHECK(r.bytes == total);
+        CHECK(r.corrupt == 0);
+    }
+}
+
+TEST_CASE("timeouts added from another thread fire on time", "[lwip]")
+{
+    /* Under core locking the tcpip thread waits unlocked for its first timeout;
+       one added before it must wake it up, not wait for the next timer */
+    const uint32_t ms = 5;
+    uint64_t total = 0;
+    for (int i = 0; i < 20; i++) {
+        uint32_t us = perf_timeout_us(ms);
+        REQUIRE(us != UINT32_MAX);
+        CHECK(us >= (ms - 1) * 1000);
+        total += us;
+    }
+    CHECK(total / 20 < (ms + 15) * 1000);
+}
+
+TEST_CASE("TCP and UDP throughput", "[lwip][bench]")
+{
+    perf_result_t r;
+    std::cout << "lwIP on the pipe link, " << perf_build_options() << std::endl;
+
+    const int tcp_sizes[] = { 256, 1460, 8192 };
+    for (int size : tcp_sizes) {
+        REQUIRE(tcp_perf_run(10000000, size, &r) == 0);
+        CHECK(r.corrupt == 0);
+        char name[32];
+        snprintf(name, sizeof(name), "tcp send %d", size);
+        report(name, r);
+    }
+
+    const int udp_sizes[] = { 64, 512, 1472 };
+    for (int size : udp_sizes) {
+        udp_perf_run(20000, size, &r);
+        CHECK(r.corrupt == 0);
+        char name[32];
+        snprintf(name, sizeof(name), "udp send %d", size);
+        report(name, r);
+    }
+
+    for (int size : udp_sizes) {
+        udp_perf_run_zerocopy(20000, size, &r);
+        CHECK(r.corrupt == 0);
+        char name[32];
+        snprintf(name, sizeof(name), "udp send_ref %d", size);
+        report(name, r);
+    }
+
+    for (int size : udp_sizes) {
+        REQUIRE(udp_perf_echo(5000, size, &r) == 0);
+        CHECK(r.corrupt == 0);
+        char name[32];
+        snprintf(name, sizeof(name), "udp echo %d", size);
+        report(name, r);
+    }
+}
+
+TEST_CASE("bytes copied per payload byte", "[lwip][bench]")
+{
+    perf_result_t r;
+    std::cout << "lwIP payload copies, " << perf_build_options() << std::endl;
+
+    REQUIRE(tcp_perf_run_recv(1000000, 1460, PERF_RECV_COPY, &r) == 0);
+    printf("%-32s %5.2f\n", "tcp send + recv", (double)r.copied / r.bytes);
+    REQUIRE(tcp_perf_run_recv(1000000, 1460, PERF_RECV_PBUF, &r) == 0);
+    printf("%-32s %5.2f\n", "tcp send + lwip_recv_pbuf", (double)r.copied / r.bytes);
+
+    const int udp_sizes[] = { 64, 512, 1472 };
+    for (int size : udp_sizes) {
+        char name[48];
+        REQUIRE(udp_perf_echo(100, size, &r) == 0);
+        /* the echo server copies each datagram in and out again */
+        snprintf(name, sizeof(name), "udp sendto + recvfrom %d", size);
+        printf("%-32s %5.2f\n", name, (double)r.copied / r.bytes / 2);
+        udp_perf_run_zerocopy(100, size, &r);
+        snprintf(name, sizeof(name), "udp sendto_ref + recv_pbuf %d", size);
+        printf("%-32s %5.2f\n", name, (double)r.copied / r.bytes);
+    }
+}
+
+TEST_CASE("small-message send latency and context switches per call", "[lwip][bench]")
+{
+    perf_result_t r;
+    const uint32_t calls = 20000;
+    std::cout << "lwIP socket calls, " << perf_build_options() << std::endl;
+
+    REQUIRE(tcp_perf_run(calls * 16, 16, &r) == 0);
+    printf("%-32s mean %6.1f us %6.2f context switches\n", "tcp send 16",
+           r.latency_mean_us, (double)r.ctxsw / r.latency_count);
+    udp_perf_run(calls, 16, &r);
+    printf("%-32s mean %6.1f us %6.2f context switches\n", "udp sendto 16",
+           r.latency_mean_us, (double)r.ctxsw / r.latency_count);
+    REQUIRE(udp_perf_getsockopt(calls, &r) == 0);
+    printf("%-32s mean %6.1f us %6.2f context switches\n", "getsockopt",
+           r.latency_mean_us, (double)r.ctxsw / r.latency_count);
+}
@@ -0,0 +1,128 @@
+// Copyright 2015-2017 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "catch.hpp"
+#include <vector>
+#include "perf.h"
+#include "lwip/opt.h"
+#include "lwip/memp.h"
+
+#if ESP_MEMP_FIXED_POOLS
+
+static struct memp_fixed_stats pool_stats(memp_t type)
+{
+    struct memp_fixed_stats stats;
+    memp_fixed_stats_get(type, &stats);
+    return stats;
+}
+
+/* Take every element left in the pool of 'type' */
+static std::vector<void*> drain_pool(memp_t type)
+{
+    std::vector<void*> held;
+    while (pool_stats(type).used < pool_stats(type).num) {
+        void* mem = memp_malloc(type);
+        REQUIRE(mem != NULL);
+        held.push_back(mem);
+    }
+    return held;
+}
+
+static void release(memp_t type, std::vector<void*>& held)
+{
+    for (void* mem : held) {
+        memp_free(type, mem);
+    }
+    held.clear();
+}
+
+TEST_CASE("a memp type falls back to the heap when its pool is empty", "[lwip][memp]")
+{
+    /* no sockets are open between the tests, so no netconn is in use */
+    REQUIRE(perf_stack_start() == 0);
+    struct memp_fixed_stats before = pool_stats(MEMP_NETCONN);
+    REQUIRE(before.num == ESP_MEMP_NUM_NETCONN);
+    REQUIRE(before.used == 0);
+
+    std::vector<void*> held;
+    for (int i = 0; i < before.num + 4; i++) {
+        void* mem = memp_malloc(MEMP_NETCONN);
+        REQUIRE(mem != NULL);
+        held.push_back(mem);
+    }
+    struct memp_fixed_stats stats = pool_stats(MEMP_NETCONN);
+    CHECK(stats.used == stats.num);
+    CHECK(stats.max == stats.num);
+    CHECK(stats.fallbacks == before.fallbacks + 4);
+    CHECK(stats.err == 0);
+
+    release(MEMP_NETCONN, held);
+    stats = pool_stats(MEMP_NETCONN);
+    CHECK(stats.used == 0);
+    CHECK(stats.max == stats.num);
+
+    /* the pool serves again once elements are back */
+    void* mem = memp_malloc(MEMP_NETCONN);
+    REQUIRE(mem != NULL);
+    CHECK(pool_stats(MEMP_NETCONN).used == 1);
+    CHECK(pool_stats(MEMP_NETCONN).fallbacks == before.fallbacks + 4);
+    memp_free(MEMP_NETCONN, mem);
+    CHECK(pool_stats(MEMP_NETCONN).used == 0);
+}
+
+TEST_CASE("types without a pool come from the heap only", "[lwip][memp]")
+{
+    struct memp_fixed_stats stats = pool_stats(MEMP_UDP_PCB);
+    CHECK(stats.num == 0);
+    void* mem = memp_malloc(MEMP_UDP_PCB);
+    REQUIRE(mem != NULL);
+    memp_free(MEMP_UDP_PCB, mem);
+    stats = pool_stats(MEMP_UDP_PCB);
+    CHECK(stats.used == 0);
+    CHECK(stats.fallbacks == 0);
+}
+
+TEST_CASE("traffic flows with the pools exhausted", "[lwip][memp]")
+{
+    perf_result_t r;
+    REQUIRE(perf_stack_start() == 0);
+
+    /* received frames take their pbufs from the pool */
+    REQUIRE(tcp_perf_run(100000, 1460, &r) == 0);
+    CHECK(pool_stats(MEMP_PBUF).max > 0);
+    CHECK(pool_stats(MEMP_TCP_SEG).max > 0);
+
+    const memp_t types[] = { MEMP_PBUF, MEMP_TCP_SEG, MEMP_NETBUF, MEMP_NETCONN };
+    std::vector<void*> held[4];
+    struct memp_fixed_stats before[4];
+    for (int i = 0; i < 4; i++) {
+        held[i] = drain_pool(types[i]);
+        before[i] = pool_stats(types[i]);
+    }
+
+    REQUIRE(tcp_perf_run(1000000, 1460, &r) == 0);
+    CHECK(r.bytes == 1000000);
+    CHECK(r.corrupt == 0);
+    REQUIRE(udp_perf_echo(100, 512, &r) == 0);
+    CHECK(r.corrupt == 0);
+
+    for (int i = 0; i < 4; i++) {
+        struct memp_fixed_stats stats = pool_stats(types[i]);
+        CHECK(stats.fallbacks > before[i].fallbacks);
+        CHECK(stats.err == 0);
+        release(types[i], held[i]);
+    }
+}
+
+#endif /* ESP_MEMP_FIXED_POOLS */
@@ -0,0 +1,353 @@
+/*
+ * examples/performance/udp_perf on the host: the client sends, the server
+ * counts what arrives; and a request/response exchange for latency.
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "lwip/sockets.h"
+#include "perf.h"
+
+#define DEFAULT_PORT    4567
+#define PACK_BYTE_IS    97 //'a'
+
+/* The server gives up when nothing arrived for this long */
+#define RECV_TIMEOUT_MS 200
+
+static u16_t port = DEFAULT_PORT;
+
+struct server {
+  int socket;
+  uint32_t count;       /* datagrams to echo, 0 to only count them */
+  int zerocopy;         /* receive with lwip_recv_pbuf() */
+  perf_result_t *result;
+};
+
+/* Buffers of udp_perf_run_zerocopy() the stack gave back */
+static uint32_t buffers_done;
+
+static int
+create_udp_socket(const char *ip, u16_t port, int timeout_ms)
+{
+  struct sockaddr_in addr;
+  struct timeval tv = { timeout_ms / 1000, (timeout_ms % 1000) * 1000 };
+  int mysocket = socket(AF_INET, SOCK_DGRAM, 0);
+
+  if (mysocket < 0) {
+    return -1;
+  }
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = inet_addr(ip);
+  if (bind(mysocket, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+      setsockopt(mysocket, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0) {
+    close(mysocket);
+    return -1;
+  }
+  return mysocket;
+}
+
+static void
+server_addr(struct sockaddr_in *addr)
+{
+  memset(addr, 0, sizeof(*addr));
+  addr->sin_family = AF_INET;
+  addr->sin_port = htons(port);
+  addr->sin_addr.s_addr = inet_addr(PERF_SERVER_IP);
+}
+
+/* The first four bytes of a datagram carry the sequence number */
+static void
+check_data(struct server *server, const char *data, int len, int offset)
+{
+  int i;
+
+  for (i = offset < sizeof(uint32_t) ? sizeof(uint32_t) - offset : 0; i < len; i++) {
+    if (data[i] != PACK_BYTE_IS) {
+      server->result->corrupt++;
+    }
+  }
+}
+
+static int
+recv_pbuf_data(struct server *server)
+{
+  struct pbuf *p, *q;
+  int len, offset = 0;
+
+  len = lwip_recv_pbuf(server->socket, &p, 0);
+  if (len <= 0) {
+    return len;
+  }
+  for (q = p; q != NULL; offset += q->len, q = q->next) {
+    check_data(server, q->payload, q->len, offset);
+  }
+  pbuf_free(p);
+  server->result->bytes += len;
+  return len;
+}
+
+static void *
+recv_data(void *arg)
+{
+  struct server *server = arg;
+  struct sockaddr_in remote_addr;
+  socklen_t socklen;
+  char databuff[1500];
+  uint32_t echoed = 0;
+  int len;
+
+  while (server->zerocopy) {
+    if (recv_pbuf_data(server) <= 0) {
+      return NULL;
+    }
+  }
+  for (;;) {
+    socklen = sizeof(remote_addr);
+    len = recvfrom(server->socket, databuff, sizeof(databuff), 0, (struct sockaddr *)&remote_addr, &socklen);
+    if (len <= 0) {
+      break;
+    }
+    if (server->count) {
+      sendto(server->socket, databuff, len, 0, (struct sockaddr *)&remote_addr, socklen);
+      if (++echoed == server->count) {
+        break;
+      }
+      continue;
+    }
+    check_data(server, databuff, len, 0);
+    server->result->bytes += len;
+  }
+  return NULL;
+}
+
+static int
+start_server(struct server *server, uint32_t count, int zerocopy, perf_result_t *result, pthread_t *thread)
+{
+  if (perf_stack_start() != 0) {
+    return -1;
+  }
+  server->socket = create_udp_socket(PERF_SERVER_IP, ++port, RECV_TIMEOUT_MS);
+  if (server->socket < 0) {
+    return -1;
+  }
+  server->count = count;
+  server->zerocopy = zerocopy;
+  server->result = result;
+  perf_begin(result);
+  pthread_create(thread, NULL, recv_data, server);
+  return 0;
+}
+
+int
+udp_perf_run(uint32_t count, int pkt_size, perf_result_t *result)
+{
+  struct server server;
+  struct sockaddr_in remote_addr;
+  pthread_t thread;
+  char databuff[1500];
+  uint64_t start;
+  uint32_t i, sent = 0;
+  int mysocket;
+
+  if (pkt_size < (int)sizeof(uint32_t) || pkt_size > (int)sizeof(databuff) ||
+      start_server(&server, 0, 0, result, &thread) != 0) {
+    return -1;
+  }
+  mysocket = create_udp_socket(PERF_CLIENT_IP, 0, RECV_TIMEOUT_MS);
+  server_addr(&remote_addr);
+  memset(databuff, PACK_BYTE_IS, pkt_size);
+
+  for (i = 0; i < count && mysocket >= 0; i++) {
+    memcpy(databuff, &i, sizeof(i));
+    start = perf_now_us();
+    if (sendto(mysocket, databuff, pkt_size, 0, (struct sockaddr *)&remote_addr, sizeof(remote_addr)) == pkt_size) {
+      sent++;
+    }
+    perf_latency(result, perf_now_us() - start);
+  }
+  pthread_join(thread, NULL);
+  perf_end(result);
+  /* Not the time the server waited after the last datagram */
+  result->seconds -= RECV_TIMEOUT_MS / 1000.0;
+
+  if (mysocket >= 0) {
+    close(mysocket);
+  }
+  close(server.socket);
+  return sent == count ? 0 : -1;
+}
+
+static void
+buffer_done(void *buf, void *arg)
+{
+  __sync_fetch_and_add(&buffers_done, 1);
+  free(buf);
+}
+
+int
+udp_perf_run_zerocopy(uint32_t count, int pkt_size, perf_result_t *result)
+{
+  struct server server;
+  struct sockaddr_in remote_addr;
+  pthread_t thread;
+  char *buf;
+  uint64_t start;
+  uint32_t i, sent = 0;
+  int mysocket;
+
+  if (pkt_size < (int)sizeof(uint32_t) || pkt_size > 1472 ||
+      start_server(&server, 0, 1, result, &thread) != 0) {
+    return -1;
+  }
+  mysocket = create_udp_socket(PERF_CLIENT_IP, 0, RECV_TIMEOUT_MS);
+  server_addr(&remote_addr);
+  buffers_done = 0;
+
+  for (i = 0; i < count && mysocket >= 0; i++) {
+    /* What an application fills in place: the stack only adds its headers */
+    buf = malloc(LWIP_SEND_REF_HEADROOM + pkt_size);
+    memcpy(buf + LWIP_SEND_REF_HEADROOM, &i, sizeof(i));
+    memset(buf + LWIP_SEND_REF_HEADROOM + sizeof(i), PACK_BYTE_IS, pkt_size - sizeof(i));
+    start = perf_now_us();
+    if (lwip_sendto_ref(mysocket, buf, pkt_size, 0, (struct sockaddr *)&remote_addr, sizeof(remote_addr),
+                        buffer_done, NULL) == pkt_size) {
+      sent++;
+    }
+    perf_latency(result, perf_now_us() - start);
+  }
+  pthread_join(thread, NULL);
+  perf_end(result);
+  result->seconds -= RECV_TIMEOUT_MS / 1000.0;
+
+  if (mysocket >= 0) {
+    close(mysocket);
+  }
+  close(server.socket);
+  return (sent == count && buffers_done == count) ? 0 : -1;
+}
+
+int
+udp_perf_echo(uint32_t count, int pkt_size, perf_result_t *result)
+{
+  struct server server;
+  struct sockaddr_in remote_addr;
+  pthread_t thread;
+  char databuff[1500], reply[1500];
+  uint64_t start;
+  uint32_t i;
+  int mysocket, len;
+
+  if (pkt_size < (int)sizeof(uint32_t) || pkt_size > (int)sizeof(databuff) ||
+      start_server(&server, count, 0, result, &thread) != 0) {
+    return -1;
+  }
+  mysocket = create_udp_socket(PERF_CLIENT_IP, 0, RECV_TIMEOUT_MS);
+  server_addr(&remote_addr);
+  memset(databuff, PACK_BYTE_IS, pkt_size);
+
+  for (i = 0; i < count && mysocket >= 0; i++) {
+    memcpy(databuff, &i, sizeof(i));
+    start = perf_now_us();
+    sendto(mysocket, databuff, pkt_size, 0, (struct sockaddr *)&remote_addr, sizeof(remote_addr));
+    len = recvfrom(mysocket, reply, sizeof(reply), 0, NULL, NULL);
+    if (len <= 0) {
+      continue;
+    }
+    perf_latency(result, perf_now_us() - start);
+    if (len != pkt_size || memcmp(reply, databuff, len) != 0) {
+      result->corrupt++;
+    }
+    result->bytes += len;
+  }
+  pthread_join(thread, NULL);
+  perf_end(result);
+
+  if (mysocket >= 0) {
+    close(mysocket);
+  }
+  close(server.socket);
+  return result->latency_count == count ? 0 : -1;
+}
+
+int
+udp_perf_getsockopt(uint32_t count, perf_result_t *result)
+{
+  uint64_t start;
+  uint32_t i;
+  socklen_t len;
+  int mysocket, type, ret = 0;
+
+  if (perf_stack_start() != 0) {
+    return -1;
+  }
+  mysocket = create_udp_socket(PERF_CLIENT_IP, 0, RECV_TIMEOUT_MS);
+  if (mysocket < 0) {
+    return -1;
+  }
+  perf_begin(result);
+  for (i = 0; i < count; i++) {
+    len = sizeof(type);
+    start = perf_now_us();
+    if (getsockopt(mysocket, SOL_SOCKET, SO_TYPE, &type, &len) != 0 || type != SOCK_DGRAM) {
+      ret = -1;
+    }
+    perf_latency(result, perf_now_us() - start);
+  }
+  perf_end(result);
+  close(mysocket);
+  return ret;
+}
+
+int
+udp_perf_sendmsg(const uint32_t *lens, int count)
+{
+  struct sockaddr_in remote_addr;
+  struct iovec iov[8];
+  struct msghdr msg;
+  char databuff[1472], reply[1500];
+  uint32_t total = 0;
+  int rx_socket, tx_socket, i, ret = -1;
+
+  for (i = 0; i < count; i++) {
+    total += lens[i];
+  }
+  if (count > 8 || total > sizeof(databuff) || perf_stack_start() != 0) {
+    return -1;
+  }
+  rx_socket = create_udp_socket(PERF_SERVER_IP, ++port, RECV_TIMEOUT_MS);
+  tx_socket = create_udp_socket(PERF_CLIENT_IP, 0, RECV_TIMEOUT_MS);
+  server_addr(&remote_addr);
+
+  /* Bytes that differ pairwise, so a vector summed the wrong way round shows */
+  for (i = 0; i < total; i++) {
+    databuff[i] = i * 7 + 1;
+  }
+  total = 0;
+  for (i = 0; i < count; i++) {
+    iov[i].iov_base = databuff + total;
+    iov[i].iov_len = lens[i];
+    total += lens[i];
+  }
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_name = &remote_addr;
+  msg.msg_namelen = sizeof(remote_addr);
+  msg.msg_iov = iov;
+  msg.msg_iovlen = count;
+
+  if (rx_socket >= 0 && tx_socket >= 0 && sendmsg(tx_socket, &msg, 0) == total &&
+      recv(rx_socket, reply, sizeof(reply), 0) == total &&
+      memcmp(reply, databuff, total) == 0) {
+    ret = 0;
+  }
+  if (tx_socket >= 0) {
+    close(tx_socket);
+  }
+  if (rx_socket >= 0) {
+    close(rx_socket);
+  }
+  return ret;
+}
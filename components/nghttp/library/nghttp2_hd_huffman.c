@@ -30,6 +30,13 @@
 
 #include "nghttp2_hd.h"
 
+#include "sdkconfig.h"
+
+#if defined(CONFIG_NGHTTP2_HUFF_DECODE_BYTE_STATES) &&                          \
+    CONFIG_NGHTTP2_HUFF_DECODE_BYTE_STATES > 0
+#define NGHTTP2_HUFF_BYTE_STATES CONFIG_NGHTTP2_HUFF_DECODE_BYTE_STATES
+#endif
+
 /*
  * Encodes huffman code |sym| into |*dest_ptr|, whose least |rembits|
  * bits are not filled yet.  The |rembits| must be in range [1, 8],
@@ -161,9 +168,109 @@ int nghttp2_hd_huff_encode(nghttp2_bufs *bufs, const uint8_t *src,
   return 0;
 }
 
+#ifdef NGHTTP2_HUFF_BYTE_STATES
+/*
+ * Byte-wide decoding rows for the NGHTTP2_HUFF_BYTE_STATES states
+ * nearest the root, which are the ones a byte boundary usually falls
+ * on.  Each entry is the composition of the two nibble transitions of
+ * huff_decode_table for one input byte: bits 0-7 hold the next state,
+ * bits 8-10 the flags, bits 11-12 the number of symbols emitted (at
+ * most 2, since the shortest code is 5 bits) and bits 16-31 the
+ * symbols themselves.  The rows cost NGHTTP2_HUFF_BYTE_STATES KiB of
+ * RAM and are built on first use; other states fall back to the
+ * nibble table in flash.
+ */
+#define HUFF_BYTE_FLAGS_SHIFT 8
+#define HUFF_BYTE_NSYM_SHIFT 11
+#define HUFF_BYTE_SYM_SHIFT 16
+
+static uint32_t huff_byte_table[NGHTTP2_HUFF_BYTE_STATES][256];
+/* 1 + row in huff_byte_table for each state, or 0 if it has none */
+static uint8_t huff_byte_row[256];
+static volatile int huff_byte_table_ready;
+
+/*
+ * Builds huff_byte_table.  Concurrent callers write identical values,
+ * so no locking is needed; the table is used only once |ready| is
+ * set.
+ */
+static void huff_byte_table_init(void) {
+  uint8_t depth[256];
+  uint8_t seen[256];
+  uint8_t order[256];
+  size_t head, tail, i, row;
+  int b;
+
+  /* Breadth-first over the nibble automaton to find each state's
+     depth, i.e. how many bits of the current code it has consumed. */
+  memset(seen, 0, sizeof(seen));
+  memset(depth, 0, sizeof(depth));
+  order[0] = 0;
+  seen[0] = 1;
+  for (head = 0, tail = 1; head < tail; ++head) {
+    uint8_t state = order[head];
+    for (b = 0; b < 16; ++b) {
+      const nghttp2_huff_decode *t = &huff_decode_table[state][b];
+      int d = depth[state] + 4;
+      if (t->flags & NGHTTP2_HUFF_FAIL) {
+        continue;
+      }
+      if (t->flags & NGHTTP2_HUFF_SYM) {
+        d -= (int)huff_sym_table[t->sym].nbits;
+      }
+      if (!seen[t->state]) {
+        seen[t->state] = 1;
+        depth[t->state] = (uint8_t)d;
+        order[tail++] = t->state;
+      }
+    }
+  }
+
+  /* Give rows to the shallowest states first. */
+  memset(huff_byte_row, 0, sizeof(huff_byte_row));
+  row = 0;
+  for (b = 0; b < 32 && row < NGHTTP2_HUFF_BYTE_STATES; ++b) {
+    for (i = 0; i < tail && row < NGHTTP2_HUFF_BYTE_STATES; ++i) {
+      uint8_t state = order[i];
+      uint32_t *entries = huff_byte_table[row];
+      int byte;
+      if (depth[state] != b) {
+        continue;
+      }
+      for (byte = 0; byte < 256; ++byte) {
+        const nghttp2_huff_decode *hi = &huff_decode_table[state][byte >> 4];
+        const nghttp2_huff_decode *lo = &huff_decode_table[hi->state][byte & 0xf];
+        uint32_t nsym = 0, syms = 0;
+        if (hi->flags & NGHTTP2_HUFF_FAIL) {
+          entries[byte] = NGHTTP2_HUFF_FAIL << HUFF_BYTE_FLAGS_SHIFT;
+          continue;
+        }
+        if (hi->flags & NGHTTP2_HUFF_SYM) {
+          syms |= (uint32_t)hi->sym << (8 * nsym++);
+        }
+        if (lo->flags & NGHTTP2_HUFF_SYM) {
+          syms |= (uint32_t)lo->sym << (8 * nsym++);
+        }
+        entries[byte] = lo->state |
+                        (uint32_t)lo->flags << HUFF_BYTE_FLAGS_SHIFT |
+                        nsym << HUFF_BYTE_NSYM_SHIFT |
+                        syms << HUFF_BYTE_SYM_SHIFT;
+      }
+      huff_byte_row[state] = (uint8_t)(++row);
+    }
+  }
+  huff_byte_table_ready = 1;
+}
+#endif /* NGHTTP2_HUFF_BYTE_STATES */
+
 void nghttp2_hd_huff_decode_context_init(nghttp2_hd_huff_decode_context *ctx) {
   ctx->state = 0;
   ctx->accept = 1;
+#ifdef NGHTTP2_HUFF_BYTE_STATES
+  if (!huff_byte_table_ready) {
+    huff_byte_table_init();
+  }
+#endif
 }
 
 ssize_t nghttp2_hd_huff_decode(nghttp2_hd_huff_decode_context *ctx,
@@ -176,6 +283,26 @@ ssize_t nghttp2_hd_huff_decode(nghttp2_hd_huff_decode_context *ctx,
   for (i = 0; i < srclen; ++i) {
     const nghttp2_huff_decode *t;
 
+#ifdef NGHTTP2_HUFF_BYTE_STATES
+    if (huff_byte_row[ctx->state]) {
+      uint32_t e = huff_byte_table[huff_byte_row[ctx->state] - 1][src[i]];
+      uint32_t flags = (e >> HUFF_BYTE_FLAGS_SHIFT) & 0x7;
+      uint32_t nsym = (e >> HUFF_BYTE_NSYM_SHIFT) & 0x3;
+      if (flags & NGHTTP2_HUFF_FAIL) {
+        return NGHTTP2_ERR_HEADER_COMP;
+      }
+      if (nsym > 0) {
+        *buf->last++ = (uint8_t)(e >> HUFF_BYTE_SYM_SHIFT);
+      }
+      if (nsym > 1) {
+        *buf->last++ = (uint8_t)(e >> (HUFF_BYTE_SYM_SHIFT + 8));
+      }
+      ctx->state = (uint8_t)e;
+      ctx->accept = (flags & NGHTTP2_HUFF_ACCEPTED) != 0;
+      continue;
+    }
+#endif /* NGHTTP2_HUFF_BYTE_STATES */
+
     t = &huff_decode_table[ctx->state][src[i] >> 4];
     if (t->flags & NGHTTP2_HUFF_FAIL) {
       return NGHTTP2_ERR_HEADER_COMP;
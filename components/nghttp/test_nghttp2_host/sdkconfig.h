@@ -0,0 +1,4 @@
+/* Host build configuration; override CONFIG_NGHTTP2_HUFF_DECODE_BYTE_STATES from the Makefile */
+#ifndef CONFIG_NGHTTP2_HUFF_DECODE_BYTE_STATES
+#define CONFIG_NGHTTP2_HUFF_DECODE_BYTE_STATES 64
+#endif
@@ -16,6 +16,18 @@
 
 #include "soc.h"
 
+/* AES acceleration registers */
+#define AES_START_REG           ((DR_REG_AES_BASE) + 0x00)
+#define AES_IDLE_REG            ((DR_REG_AES_BASE) + 0x04)
+#define AES_MODE_REG            ((DR_REG_AES_BASE) + 0x08)
+#define AES_KEY_BASE            ((DR_REG_AES_BASE) + 0x10)
+#define AES_TEXT_BASE           ((DR_REG_AES_BASE) + 0x30)
+#define AES_ENDIAN_REG          ((DR_REG_AES_BASE) + 0x40)
+
+/* AES_MODE_REG holds the key length (0: 128, 1: 192, 2: 256 bits),
+   plus this bit for decryption */
+#define AES_MODE_DECRYPT        BIT(2)
+
 /* registers for RSA acceleration via Multiple Precision Integer ops */
 #define RSA_MEM_M_BLOCK_BASE          ((DR_REG_RSA_BASE)+0x000)
 /* RB & Z use the same memory block, depending on phase of operation */
@@ -0,0 +1,13 @@
+/* Host stand-in for esp_log.h */
+#pragma once
+#include <stdio.h>
+/* What the real header brings in through rom/ets_sys.h, and ulp.h relies on */
+#include <stdbool.h>
+#include <assert.h>
+#include "soc/soc.h"
+
+#define ESP_LOGE(tag, format, ...)      fprintf(stderr, "E %s: " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...)      fprintf(stderr, "W %s: " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...)      do { } while (0)
+#define ESP_LOGD(tag, format, ...)      do { } while (0)
+#define ESP_LOGV(tag, format, ...)      do { } while (0)
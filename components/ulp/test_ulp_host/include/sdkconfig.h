@@ -0,0 +1,5 @@
+/* Kconfig values of the ulp component, for the host build */
+#pragma once
+
+#define CONFIG_ULP_COPROC_ENABLED           1
+#define CONFIG_ULP_COPROC_RESERVE_MEM       1024
@@ -0,0 +1,202 @@
+// Copyright 2010-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <assert.h>
+#include "soc/soc.h"
+#include "soc/rtc_cntl_reg.h"
+#include "soc/rtc_io_reg.h"
+#include "esp32/ulp.h"
+#include "test_programs.h"
+
+#define FAR_BRANCH_GAP  130
+
+const int test_err_ulp_invalid_load_addr = ESP_ERR_ULP_INVALID_LOAD_ADDR;
+const int test_err_ulp_duplicate_label = ESP_ERR_ULP_DUPLICATE_LABEL;
+const int test_err_ulp_undefined_label = ESP_ERR_ULP_UNDEFINED_LABEL;
+const int test_err_ulp_branch_out_of_range = ESP_ERR_ULP_BRANCH_OUT_OF_RANGE;
+
+#define LOAD(...) do { \
+        const ulp_insn_t program[] = { __VA_ARGS__ }; \
+        *words = sizeof(program) / sizeof(ulp_insn_t); \
+        return ulp_process_macros_and_load(load_addr, program, words); \
+    } while (0)
+
+int test_prog_load(test_prog_t prog, uint32_t load_addr, size_t* words)
+{
+    switch (prog) {
+        case TEST_PROG_ADD:
+            LOAD(
+                I_MOVI(R3, 16),
+                I_LD(R0, R3, 0),
+                I_LD(R1, R3, 1),
+                I_ADDR(R2, R0, R1),
+                I_ST(R2, R3, 2),
+                I_HALT()
+            );
+        case TEST_PROG_BRANCH:
+            LOAD(
+                I_MOVI(R0, 34),     // r0 = dst
+                M_LABEL(1),
+                I_MOVI(R1, 32),
+                I_LD(R1, R1, 0),    // r1 = mem[32]
+                I_MOVI(R2, 33),
+                I_LD(R2, R2, 0),    // r2 = mem[33]
+                I_SUBR(R3, R1, R2), // r3 = r1 - r2
+                I_ST(R3, R0, 0),    // dst[0] = r3
+                I_ADDI(R0, R0, 1),
+                M_BL(1, 64),
+                I_HALT()
+            );
+        case TEST_PROG_FLAGS:
+            LOAD(
+                I_MOVI(R3, TEST_PROG_DATA),
+                I_MOVI(R2, 1),
+                // +0: 1 - 2 borrows
+                I_MOVI(R0, 1),
+                I_SUBI(R0, R0, 2),
+                M_BXF(1),
+                M_BX(2),
+                M_LABEL(1),
+                I_ST(R2, R3, 0),
+                M_LABEL(2),
+                // +1: 2 - 2 is zero
+                I_MOVI(R0, 2),
+                I_SUBI(R0, R0, 2),
+                M_BXZ(3),
+                M_BX(4),
+                M_LABEL(3),
+                I_ST(R2, R3, 1),
+                M_LABEL(4),
+                // +2: ... and doesn't borrow
+                I_MOVI(R0, 2),
+                I_SUBI(R0, R0, 2),
+                M_BXF(5),
+                M_BX(6),
+                M_LABEL(5),
+                I_ST(R2, R3, 2),
+                M_LABEL(6),
+                // +3: 0xffff + 1 carries
+                I_MOVI(R0, 0xffff),
+                I_ADDI(R0, R0, 1),
+                M_BXF(7),
+                M_BX(8),
+                M_LABEL(7),
+                I_ST(R2, R3, 3),
+                M_LABEL(8),
+                // +4: 0x8000 + 0x7fff doesn't
+                I_MOVI(R0, 0x8000),
+                I_ADDI(R0, R0, 0x7fff),
+                M_BXF(9),
+                M_BX(10),
+                M_LABEL(9),
+                I_ST(R2, R3, 4),
+                M_LABEL(10),
+                I_HALT()
+            );
+        case TEST_PROG_SHIFTS:
+            LOAD(
+                I_MOVI(R3, TEST_PROG_DATA),
+                I_MOVI(R0, 0x00f0),
+                I_LSHI(R1, R0, 4),
+                I_ST(R1, R3, 0),
+                I_RSHI(R1, R0, 4),
+                I_ST(R1, R3, 1),
+                I_ANDI(R1, R0, 0x3c),
+                I_ST(R1, R3, 2),
+                I_ORI(R1, R0, 0x0f),
+                I_ST(R1, R3, 3),
+                I_MOVI(R2, 8),
+                I_LSHR(R1, R0, R2),
+                I_ST(R1, R3, 4),
+                I_MOVI(R0, 0xabcd),
+                I_RSHR(R1, R0, R2),
+                I_ST(R1, R3, 5),
+                I_ANDR(R1, R0, R2),
+                I_ST(R1, R3, 6),
+                I_ORR(R1, R0, R2),
+                I_ST(R1, R3, 7),
+                I_MOVR(R1, R2),
+                I_ST(R1, R3, 8),
+                I_HALT()
+            );
+        case TEST_PROG_REG_IO:
+            LOAD(
+                I_MOVI(R3, TEST_PROG_DATA),
+                I_RD_REG(RTC_GPIO_IN_REG, RTC_GPIO_IN_NEXT_S + 6, RTC_GPIO_IN_NEXT_S + 6),
+                I_ST(R0, R3, 0),
+                I_WR_REG(RTC_IO_TOUCH_PAD0_REG, 1, 3, 5),
+                I_HALT()
+            );
+        case TEST_PROG_JUMP_REG:
+            LOAD(
+                I_MOVI(R3, TEST_PROG_DATA),
+                I_MOVI(R1, load_addr + 4),
+                I_BXR(R1),
+                I_HALT(),
+                I_MOVI(R0, 1),
+                I_ST(R0, R3, 0),
+                I_HALT()
+            );
+        case TEST_PROG_WAKE:
+            LOAD(
+                I_MOVI(R3, TEST_PROG_DATA),
+                I_LD(R0, R3, 0),
+                I_SUBI(R0, R0, 1),
+                I_ST(R0, R3, 0),
+                M_BXZ(1),
+                I_HALT(),
+                M_LABEL(1),
+                I_WAKE(),
+                I_END(),
+                I_HALT()
+            );
+        case TEST_PROG_LOOP:
+            LOAD(
+                M_LABEL(1),
+                I_DELAY(10),
+                M_BX(1)
+            );
+        case TEST_PROG_UNDEFINED_LABEL:
+            LOAD(
+                M_LABEL(1),
+                M_BX(2),
+                I_HALT()
+            );
+        case TEST_PROG_DUPLICATE_LABEL:
+            LOAD(
+                M_LABEL(1),
+                I_HALT(),
+                M_LABEL(1),
+                I_HALT()
+            );
+        case TEST_PROG_FAR_BRANCH: {
+            const ulp_insn_t branch[] = { M_BL(1, 1) };
+            const ulp_insn_t delay = I_DELAY(1);
+            const ulp_insn_t tail[] = { M_LABEL(1), I_HALT() };
+            ulp_insn_t program[2 + FAR_BRANCH_GAP + 2];
+            size_t n = 0;
+
+            program[n++] = branch[0];
+            program[n++] = branch[1];
+            while (n < 2 + FAR_BRANCH_GAP) {
+                program[n++] = delay;
+            }
+            program[n++] = tail[0];
+            program[n++] = tail[1];
+            *words = n;
+            return ulp_process_macros_and_load(load_addr, program, words);
+        }
+    }
+    return -1;
+}
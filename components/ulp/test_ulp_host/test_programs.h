@@ -0,0 +1,43 @@
+/*
+ * The programs under test. They are built in C: the instruction macros of
+ * esp32/ulp.h are not valid C++.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Where the programs other than add and branch keep their data, past their code */
+#define TEST_PROG_DATA  128
+
+typedef enum {
+    TEST_PROG_ADD,          /* "ulp add test" of components/ulp/test: mem[18] = mem[16] + mem[17] */
+    TEST_PROG_BRANCH,       /* "ulp branch test": mem[34..63] = mem[32] - mem[33] */
+    TEST_PROG_FLAGS,        /* one word per flag check at TEST_PROG_DATA.., 1 where the branch was taken */
+    TEST_PROG_SHIFTS,       /* the logic and shift operations, results at TEST_PROG_DATA.. */
+    TEST_PROG_REG_IO,       /* mem[TEST_PROG_DATA] = RTC GPIO 6 input, then sets RTC_IO_TOUCH_PAD0 bits [3:1] to 5 */
+    TEST_PROG_JUMP_REG,     /* BXR to the address in R1, mem[TEST_PROG_DATA] = 1 if it got there */
+    TEST_PROG_WAKE,         /* counts mem[TEST_PROG_DATA] down, wakes the SoC at 0 and stops the timer */
+    TEST_PROG_LOOP,         /* never halts */
+    TEST_PROG_UNDEFINED_LABEL,
+    TEST_PROG_DUPLICATE_LABEL,
+    TEST_PROG_FAR_BRANCH,   /* a relative branch over 130 instructions */
+} test_prog_t;
+
+/* ulp_process_macros_and_load() of the program; words gets its loaded size */
+int test_prog_load(test_prog_t prog, uint32_t load_addr, size_t* words);
+
+/* The ESP_ERR_ULP_* codes it can return */
+extern const int test_err_ulp_invalid_load_addr;
+extern const int test_err_ulp_duplicate_label;
+extern const int test_err_ulp_undefined_label;
+extern const int test_err_ulp_branch_out_of_range;
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,201 @@
+// Copyright 2010-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "catch.hpp"
+#include <vector>
+#include "soc/soc.h"
+#include "soc/rtc_io_reg.h"
+#include "ulp_sim.h"
+#include "test_programs.h"
+
+static const uint32_t MAX_STEPS = 10000;
+
+static uint32_t* load(test_prog_t prog, uint32_t load_addr = 0)
+{
+    uint32_t* mem = ulp_sim_rtc_slow_mem();
+    size_t words;
+
+    REQUIRE(mem != NULL);
+    REQUIRE(test_prog_load(prog, load_addr, &words) == 0);
+    return mem;
+}
+
+static ulp_sim_stop_t run(ulp_sim_t* sim, uint32_t* mem, uint32_t entry = 0)
+{
+    ulp_sim_init(sim, mem, ULP_SIM_RTC_SLOW_MEM_WORDS);
+    return ulp_sim_run(sim, entry, MAX_STEPS);
+}
+
+TEST_CASE("ulp add program", "[ulp]")
+{
+    uint32_t* mem = load(TEST_PROG_ADD);
+    ulp_sim_t sim;
+
+    mem[16] = 10;
+    mem[17] = 11;
+    CHECK(run(&sim, mem) == ULP_SIM_HALT);
+    CHECK((mem[18] & 0xffff) == 10 + 11);
+    // The upper half holds the PC of the ST
+    CHECK((mem[18] >> 21) == 4);
+    CHECK(sim.steps == 6);
+}
+
+TEST_CASE("ulp branch program", "[ulp]")
+{
+    uint32_t* mem = load(TEST_PROG_BRANCH);
+    ulp_sim_t sim;
+
+    mem[32] = 42;
+    mem[33] = 18;
+    CHECK(run(&sim, mem) == ULP_SIM_HALT);
+    for (int i = 34; i < 64; ++i) {
+        CHECK((mem[i] & 0xffff) == 42 - 18);
+    }
+    CHECK(mem[64] == 0);
+}
+
+TEST_CASE("ulp ALU flags", "[ulp]")
+{
+    uint32_t* mem = load(TEST_PROG_FLAGS);
+    ulp_sim_t sim;
+
+    CHECK(run(&sim, mem) == ULP_SIM_HALT);
+    CHECK((mem[TEST_PROG_DATA] & 0xffff) == 1);         // borrow
+    CHECK((mem[TEST_PROG_DATA + 1] & 0xffff) == 1);     // zero
+    CHECK(mem[TEST_PROG_DATA + 2] == 0);                // no borrow
+    CHECK((mem[TEST_PROG_DATA + 3] & 0xffff) == 1);     // carry
+    CHECK(mem[TEST_PROG_DATA + 4] == 0);                // no carry
+}
+
+TEST_CASE("ulp logic and shifts", "[ulp]")
+{
+    uint32_t* mem = load(TEST_PROG_SHIFTS);
+    ulp_sim_t sim;
+    const uint16_t expected[] = { 0x0f00, 0x000f, 0x0030, 0x00ff, 0xf000, 0x00ab, 0x0008, 0xabcd, 0x0008 };
+
+    CHECK(run(&sim, mem) == ULP_SIM_HALT);
+    for (size_t i = 0; i < sizeof(expected) / sizeof(expected[0]); ++i) {
+        CHECK((mem[TEST_PROG_DATA + i] & 0xffff) == expected[i]);
+    }
+}
+
+struct regs_t {
+    uint32_t gpio_in;
+    std::vector<uint32_t> writes;       // reg, low, high, val
+};
+
+static uint32_t read_reg(void* ctx, uint32_t reg)
+{
+    return reg == RTC_GPIO_IN_REG ? static_cast<regs_t*>(ctx)->gpio_in : 0;
+}
+
+static void write_reg(void* ctx, uint32_t reg, uint32_t low, uint32_t high, uint32_t val)
+{
+    std::vector<uint32_t>& w = static_cast<regs_t*>(ctx)->writes;
+    w.insert(w.end(), { reg, low, high, val });
+}
+
+TEST_CASE("ulp peripheral registers", "[ulp]")
+{
+    uint32_t* mem = load(TEST_PROG_REG_IO);
+    regs_t regs = { 0, {} };
+    ulp_sim_t sim;
+
+    for (int level = 0; level < 2; ++level) {
+        regs.gpio_in = (uint32_t) level << (RTC_GPIO_IN_NEXT_S + 6);
+        regs.writes.clear();
+        ulp_sim_init(&sim, mem, ULP_SIM_RTC_SLOW_MEM_WORDS);
+        sim.read_reg = read_reg;
+        sim.write_reg = write_reg;
+        sim.ctx = &regs;
+        CHECK(ulp_sim_run(&sim, 0, MAX_STEPS) == ULP_SIM_HALT);
+        CHECK((mem[TEST_PROG_DATA] & 0xffff) == (uint32_t) level);
+        CHECK(regs.writes == std::vector<uint32_t>({ RTC_IO_TOUCH_PAD0_REG, 1, 3, 5 }));
+        // Not the ULP timer
+        CHECK(sim.timer_en == 1);
+    }
+}
+
+TEST_CASE("ulp jump to a register, loaded past 0", "[ulp]")
+{
+    uint32_t* mem = load(TEST_PROG_JUMP_REG, 8);
+    ulp_sim_t sim;
+
+    CHECK(run(&sim, mem, 8) == ULP_SIM_HALT);
+    CHECK((mem[TEST_PROG_DATA] & 0xffff) == 1);
+}
+
+TEST_CASE("ulp wakes the SoC and stops its timer", "[ulp]")
+{
+    uint32_t* mem = load(TEST_PROG_WAKE);
+    ulp_sim_t sim;
+    int starts = 0;
+
+    mem[TEST_PROG_DATA] = 3;
+    ulp_sim_init(&sim, mem, ULP_SIM_RTC_SLOW_MEM_WORDS);
+    while (sim.timer_en && starts < 10) {
+        REQUIRE(ulp_sim_run(&sim, 0, MAX_STEPS) == ULP_SIM_HALT);
+        CHECK(sim.wakeups == (starts == 2 ? 1u : 0u));
+        ++starts;
+    }
+    CHECK(starts == 3);
+    CHECK(sim.timer_en == 0);
+    CHECK((mem[TEST_PROG_DATA] & 0xffff) == 0);
+}
+
+TEST_CASE("ulp program that never halts", "[ulp]")
+{
+    uint32_t* mem = load(TEST_PROG_LOOP);
+    ulp_sim_t sim;
+
+    ulp_sim_init(&sim, mem, ULP_SIM_RTC_SLOW_MEM_WORDS);
+    CHECK(ulp_sim_run(&sim, 0, 100) == ULP_SIM_STEP_LIMIT);
+    CHECK(sim.steps == 100);
+    CHECK(sim.delay_cycles == 50 * 10);
+}
+
+TEST_CASE("ulp instructions and addresses the simulator rejects", "[ulp]")
+{
+    uint32_t* mem = ulp_sim_rtc_slow_mem();
+    ulp_sim_t sim;
+
+    REQUIRE(mem != NULL);
+    mem[0] = 5u << 28;                  // OPCODE_ADC
+    CHECK(run(&sim, mem) == ULP_SIM_BAD_INSN);
+    mem[0] = 0xfu << 28;                // a macro token, not loaded
+    CHECK(run(&sim, mem) == ULP_SIM_BAD_INSN);
+    mem[0] = 0;                         // reserved opcode
+    CHECK(run(&sim, mem) == ULP_SIM_BAD_INSN);
+
+    // A memory smaller than the data words of the add program
+    mem = load(TEST_PROG_ADD);
+    ulp_sim_init(&sim, mem, 16);
+    CHECK(ulp_sim_run(&sim, 0, MAX_STEPS) == ULP_SIM_BAD_ADDR);
+    CHECK(sim.pc == 1);
+    // ... and one the program runs off
+    ulp_sim_init(&sim, mem, 3);
+    CHECK(ulp_sim_run(&sim, 0, MAX_STEPS) == ULP_SIM_BAD_ADDR);
+    CHECK(sim.pc == 1);
+}
+
+TEST_CASE("ulp loader errors", "[ulp]")
+{
+    size_t words;
+
+    REQUIRE(ulp_sim_rtc_slow_mem() != NULL);
+    CHECK(test_prog_load(TEST_PROG_UNDEFINED_LABEL, 0, &words) == test_err_ulp_undefined_label);
+    CHECK(test_prog_load(TEST_PROG_DUPLICATE_LABEL, 0, &words) == test_err_ulp_duplicate_label);
+    CHECK(test_prog_load(TEST_PROG_FAR_BRANCH, 0, &words) == test_err_ulp_branch_out_of_range);
+    CHECK(test_prog_load(TEST_PROG_ADD, 1024 / 4 + 1, &words) == test_err_ulp_invalid_load_addr);
+}
@@ -0,0 +1,219 @@
+// Copyright 2010-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string.h>
+#include <assert.h>
+#include <sys/mman.h>
+
+#include "soc/soc.h"
+#include "soc/rtc_cntl_reg.h"
+#include "esp32/ulp.h"
+#include "ulp_sim.h"
+
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE 0       /* older kernels: a plain hint, checked below */
+#endif
+
+#define RTC_SLOW_MEM_SIZE   8192
+
+/* RD_REG and WR_REG only carry bits [9:2] of the register address */
+static const uint32_t s_periph_base[] = {
+    [RD_REG_PERIPH_RTC_CNTL] = DR_REG_RTCCNTL_BASE,
+    [RD_REG_PERIPH_RTC_IO] = DR_REG_RTCIO_BASE,
+    [RD_REG_PERIPH_SENS] = DR_REG_SENS_BASE,
+};
+
+void ulp_sim_init(ulp_sim_t* sim, uint32_t* mem, size_t mem_words)
+{
+    memset(sim, 0, sizeof(*sim));
+    sim->mem = mem;
+    sim->mem_words = mem_words;
+    sim->timer_en = 1;
+}
+
+static void alu(ulp_sim_t* sim, uint32_t dreg, uint32_t sel, uint16_t a, uint16_t b)
+{
+    uint32_t res;
+
+    sim->ovf = 0;
+    switch (sel) {
+        case ALU_SEL_ADD:
+            res = (uint32_t) a + b;
+            sim->ovf = res > 0xffff;
+            break;
+        case ALU_SEL_SUB:
+            res = (uint32_t) a - b;
+            sim->ovf = a < b;
+            break;
+        case ALU_SEL_AND:
+            res = a & b;
+            break;
+        case ALU_SEL_OR:
+            res = a | b;
+            break;
+        case ALU_SEL_MOV:
+            res = b;
+            break;
+        case ALU_SEL_LSH:
+            res = b < 16 ? (uint32_t) a << b : 0;
+            break;
+        default:    /* ALU_SEL_RSH */
+            res = b < 16 ? a >> b : 0;
+            break;
+    }
+    sim->r[dreg] = (uint16_t) res;
+    sim->zero = sim->r[dreg] == 0;
+}
+
+static int reg_addr(uint32_t periph_sel, uint32_t addr, uint32_t* reg)
+{
+    if (periph_sel >= sizeof(s_periph_base) / sizeof(s_periph_base[0])) {
+        return 0;
+    }
+    *reg = s_periph_base[periph_sel] + addr * sizeof(uint32_t);
+    return 1;
+}
+
+ulp_sim_stop_t ulp_sim_run(ulp_sim_t* sim, uint32_t entry, uint32_t max_steps)
+{
+    sim->pc = entry;
+    for (uint32_t n = 0; n < max_steps; ++n) {
+        if (sim->pc >= sim->mem_words) {
+            return ULP_SIM_BAD_ADDR;
+        }
+        ulp_insn_t insn;
+        memcpy(&insn, &sim->mem[sim->pc], sizeof(insn));
+        uint32_t next = sim->pc + 1;
+        uint32_t addr, reg;
+
+        sim->steps++;
+        switch (insn.halt.opcode) {
+            case OPCODE_ALU:
+                if (insn.alu_reg.sel > ALU_SEL_RSH) {
+                    return ULP_SIM_BAD_INSN;
+                }
+                if (insn.alu_reg.sub_opcode == SUB_OPCODE_ALU_REG) {
+                    /* I_MOVR copies sreg, where I_MOVI copies the immediate */
+                    uint32_t treg = insn.alu_reg.sel == ALU_SEL_MOV ? insn.alu_reg.sreg : insn.alu_reg.treg;
+                    alu(sim, insn.alu_reg.dreg, insn.alu_reg.sel,
+                            sim->r[insn.alu_reg.sreg], sim->r[treg]);
+                } else if (insn.alu_imm.sub_opcode == SUB_OPCODE_ALU_IMM) {
+                    alu(sim, insn.alu_imm.dreg, insn.alu_imm.sel,
+                            sim->r[insn.alu_imm.sreg], insn.alu_imm.imm);
+                } else {
+                    return ULP_SIM_BAD_INSN;
+                }
+                break;
+            case OPCODE_LD:
+                addr = sim->r[insn.ld.sreg] + insn.ld.offset;
+                if (addr >= sim->mem_words) {
+                    return ULP_SIM_BAD_ADDR;
+                }
+                sim->r[insn.ld.dreg] = sim->mem[addr] & 0xffff;
+                break;
+            case OPCODE_ST:
+                addr = sim->r[insn.st.sreg] + insn.st.offset;
+                if (insn.st.sub_opcode != SUB_OPCODE_ST) {
+                    return ULP_SIM_BAD_INSN;
+                }
+                if (addr >= sim->mem_words) {
+                    return ULP_SIM_BAD_ADDR;
+                }
+                sim->mem[addr] = ((sim->pc & 0x7ff) << 21) | sim->r[insn.st.dreg];
+                break;
+            case OPCODE_BRANCH:
+                if (insn.b.sub_opcode == SUB_OPCODE_B) {
+                    int taken = insn.b.cmp == B_CMP_L ? sim->r[R0] < insn.b.imm : sim->r[R0] >= insn.b.imm;
+                    if (taken) {
+                        next = insn.b.sign ? sim->pc - insn.b.offset : sim->pc + insn.b.offset;
+                    }
+                } else if (insn.bx.sub_opcode == SUB_OPCODE_BX) {
+                    int taken = insn.bx.type == BX_JUMP_TYPE_DIRECT
+                            || (insn.bx.type == BX_JUMP_TYPE_ZERO && sim->zero)
+                            || (insn.bx.type == BX_JUMP_TYPE_OVF && sim->ovf);
+                    if (insn.bx.type > BX_JUMP_TYPE_OVF) {
+                        return ULP_SIM_BAD_INSN;
+                    }
+                    if (taken) {
+                        next = insn.bx.reg ? sim->r[insn.bx.dreg] & 0x7ff : insn.bx.addr;
+                    }
+                } else {
+                    return ULP_SIM_BAD_INSN;
+                }
+                break;
+            case OPCODE_RD_REG:
+                if (!reg_addr(insn.rd_reg.periph_sel, insn.rd_reg.addr, &reg)
+                        || insn.rd_reg.low > insn.rd_reg.high) {
+                    return ULP_SIM_BAD_INSN;
+                } else {
+                    uint32_t val = sim->read_reg ? sim->read_reg(sim->ctx, reg) : 0;
+                    uint32_t width = insn.rd_reg.high - insn.rd_reg.low + 1;
+                    val >>= insn.rd_reg.low;
+                    sim->r[R0] = (uint16_t) (width < 32 ? val & ((1u << width) - 1) : val);
+                }
+                break;
+            case OPCODE_WR_REG:
+                if (!reg_addr(insn.wr_reg.periph_sel, insn.wr_reg.addr, &reg)
+                        || insn.wr_reg.low > insn.wr_reg.high) {
+                    return ULP_SIM_BAD_INSN;
+                }
+                if (reg == RTC_CNTL_STATE0_REG && insn.wr_reg.low <= RTC_CNTL_ULP_CP_SLP_TIMER_EN_S
+                        && insn.wr_reg.high >= RTC_CNTL_ULP_CP_SLP_TIMER_EN_S) {
+                    sim->timer_en = (insn.wr_reg.data >> (RTC_CNTL_ULP_CP_SLP_TIMER_EN_S - insn.wr_reg.low)) & 1;
+                }
+                if (sim->write_reg) {
+                    sim->write_reg(sim->ctx, reg, insn.wr_reg.low, insn.wr_reg.high, insn.wr_reg.data);
+                }
+                break;
+            case OPCODE_END:
+                if (insn.end.sub_opcode == SUB_OPCODE_END) {
+                    sim->wakeups += insn.end.wakeup;
+                } else if (insn.sleep.sub_opcode == SUB_OPCODE_SLEEP) {
+                    sim->sleep_sel = insn.sleep.cycle_sel;
+                } else {
+                    return ULP_SIM_BAD_INSN;
+                }
+                break;
+            case OPCODE_DELAY:
+                sim->delay_cycles += insn.delay.cycles;
+                break;
+            case OPCODE_HALT:
+                return ULP_SIM_HALT;
+            default:
+                return ULP_SIM_BAD_INSN;
+        }
+        sim->pc = next;
+    }
+    return ULP_SIM_STEP_LIMIT;
+}
+
+uint32_t* ulp_sim_rtc_slow_mem(void)
+{
+    static void* s_mem;
+
+    if (s_mem == NULL) {
+        void* mem = mmap(RTC_SLOW_MEM, RTC_SLOW_MEM_SIZE, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+        if (mem == MAP_FAILED) {
+            return NULL;
+        }
+        if (mem != (void*) RTC_SLOW_MEM) {
+            munmap(mem, RTC_SLOW_MEM_SIZE);
+            return NULL;
+        }
+        s_mem = mem;
+    }
+    memset(s_mem, 0, RTC_SLOW_MEM_SIZE);
+    return s_mem;
+}
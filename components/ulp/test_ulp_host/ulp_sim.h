@@ -0,0 +1,77 @@
+// Copyright 2010-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * Host simulator of the ULP coprocessor, for programs built with the
+ * instruction macros of esp32/ulp.h and loaded by ulp_process_macros_and_load().
+ *
+ * It runs the instruction words out of a copy of RTC slow memory, one timer
+ * period per ulp_sim_run() call: from the entry point up to I_HALT. Peripheral
+ * registers are left to the caller, through read_reg/write_reg.
+ * I2C, ADC and TSENS are not modelled.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Why ulp_sim_run() returned */
+typedef enum {
+    ULP_SIM_HALT = 0,           /* I_HALT reached */
+    ULP_SIM_STEP_LIMIT,         /* max_steps instructions run without a halt */
+    ULP_SIM_BAD_INSN,           /* an instruction the simulator doesn't model, or a macro token */
+    ULP_SIM_BAD_ADDR,           /* PC, LD or ST outside the simulated memory */
+} ulp_sim_stop_t;
+
+typedef struct {
+    uint32_t* mem;              /* RTC slow memory, instruction and data words */
+    size_t mem_words;
+    uint16_t r[4];              /* R0..R3 */
+    uint32_t pc;                /* in words */
+    int zero;                   /* last ALU result was zero */
+    int ovf;                    /* last ALU operation carried (ADD) or borrowed (SUB) */
+    int timer_en;               /* RTC_CNTL_ULP_CP_SLP_TIMER_EN: 1 as after ulp_run(), cleared by I_END() */
+    uint32_t sleep_sel;         /* SENS_ULP_CP_SLEEP_CYCx_REG picked by I_SLEEP_CYCLE_SEL() */
+    uint32_t wakeups;           /* I_WAKE() executed */
+    uint32_t steps;             /* instructions executed, over all runs */
+    uint32_t delay_cycles;      /* cycles spent in I_DELAY(), over all runs */
+    /* Peripheral registers, by SoC address; reads of a NULL read_reg give 0 */
+    uint32_t (*read_reg)(void* ctx, uint32_t reg);
+    void (*write_reg)(void* ctx, uint32_t reg, uint32_t low_bit, uint32_t high_bit, uint32_t val);
+    void* ctx;
+} ulp_sim_t;
+
+/* Clear the registers and flags; mem is not touched */
+void ulp_sim_init(ulp_sim_t* sim, uint32_t* mem, size_t mem_words);
+
+/* One start of the program by the ULP timer: run from entry until I_HALT */
+ulp_sim_stop_t ulp_sim_run(ulp_sim_t* sim, uint32_t entry, uint32_t max_steps);
+
+/*
+ * Map RTC_SLOW_MEM (8 KB at 0x50000000) into the process, so that
+ * ulp_process_macros_and_load() runs unchanged. The memory is zeroed on each
+ * call; returns NULL if the address range is taken.
+ */
+uint32_t* ulp_sim_rtc_slow_mem(void);
+
+#define ULP_SIM_RTC_SLOW_MEM_WORDS  (8192 / sizeof(uint32_t))
+
+#ifdef __cplusplus
+}
+#endif
@@ -18,8 +18,11 @@
 #include "esp_log.h"
 #include "driver/rtc_io.h"
 #include "soc/rtc_cntl_reg.h"
+#include "soc/sens_reg.h"
+#include "esp32/ulp.h"
 #include "FreeRTOS_CLI.h"
 #include "app.h"
+#include "ulp_watch.h"
 
 
 #define AppQUEUE_LENGTH	3
@@ -28,155 +31,138 @@ static const char *APP_TAG = "App";
 
 static AppState_t  sAppState;
 
-xQueueHandle xAppInQueue = NULL;      // Make it avaliable for the ISR handlers ..
-xQueueHandle xAppOutQueue = NULL;
-static xSemaphoreHandle xAppMutex = NULL;
-static pAppMessage master_pAppMsg = NULL;   // current transaction ..
+static esp_err_t prvAppHandle(msgbus_actor_t *actor, msgbus_msg_t *bus);
+static void prvAppSignal(msgbus_actor_t *actor, uint32_t bits);
+static void prvAppInit(msgbus_actor_t *actor);
+
+static msgbus_actor_t xAppActor = {
+	.name = "APP",
+	.queue_len = AppQUEUE_LENGTH,
+	.init = prvAppInit,
+	.handle = prvAppHandle,
+	.signal = prvAppSignal,
+	.idle_ms = MSGBUS_WAIT_FOREVER,
+};
 
 static RTC_DATA_ATTR struct timeval sleep_enter_time;
+static RTC_DATA_ATTR uint8_t rtc_block[RTC_STATE_BLOCK_SIZE];
+static rtc_state_t sRtcState;
+
+static const wake_plan_config_t wake_config = {
+	.sensor_ms = CONFIG_PINGZEE_WAKE_SENSOR_MS,
+	.listen_ms = APP_WAKE_PERIOD * 1000,
+	.heartbeat = CONFIG_PINGZEE_WAKE_HEARTBEAT,
+};
+#if CONFIG_PINGZEE_ULP_WATCH
+static const ulp_watch_config_t ulp_watch_config = {
+	.edges = CONFIG_PINGZEE_ULP_EDGES,
+	.active = CONFIG_PINGZEE_ULP_ACTIVE_MS / CONFIG_PINGZEE_ULP_POLL_MS,
+	.polls = (CONFIG_PINGZEE_ULP_BUDGET_S * 1000 / CONFIG_PINGZEE_ULP_POLL_MS > 0xFFFF) ?
+			0xFFFF : CONFIG_PINGZEE_ULP_BUDGET_S * 1000 / CONFIG_PINGZEE_ULP_POLL_MS,
+};
+static ulp_watch_result_t sUlpWatch;	// of the watch that ended this deep sleep
+#endif
+static AppRadioStart_t xAppStartBT = NULL;
+static AppRadioStart_t xAppStartWiFi = NULL;
+static AppTimer_t xAppWindowTimer;		// the sensor and the listen window
 
-static void prvAppTask( void *pvParameters );
 static void vAppMainLoopStart(pAppMessage pAppMsg);
+static void vAppWakeDo(uint32_t actions);
+static void vAppWindowArm(uint32_t ms);
 static void vAppDeepSleep(pAppMessage pAppMsg); 
-static void prvAppTimerExpieredTask( void *pvParameters );
+static void prvAppWindowExpired(pAppTimer timer);
+#if CONFIG_PINGZEE_ULP_WATCH
+static void vAppUlpQuietWakes(void);
+#endif
 
 
 /*-----------------------------------------------------------*/
 
 void vAppStart( uint16_t usStackSize, portBASE_TYPE uxPriority )
 {
-	/* Create the queues used by application  tasks and interrupts */
-	xAppInQueue = xQueueCreate( AppQUEUE_LENGTH, sizeof(AppMessage_t) );
-	xAppOutQueue = xQueueCreate( 1, sizeof(AppMessage_t) );
+	sAppState.what_happen = WAKE_NOTHING;
 
-	/* If the queue could not be created then don't create any tasks that might
-	attempt to use the queue. */
-	if( xAppInQueue != NULL && xAppOutQueue != NULL)
+	xAppActor.stack_size = usStackSize;
+	xAppActor.priority = uxPriority;
+	if (msgbus_actor_start(&xAppActor) != ESP_OK)
 	{
-	
-		/* Create the semaphore used to access the SPI transmission. */
-		xAppMutex = xSemaphoreCreateMutex();
-		configASSERT( xAppMutex );
-		
-		sAppState.what_happen = WAKE_NOTHING;
-
-
-		/* Create that task that handles the I2C Master itself. */
-		xTaskCreate(prvAppTask,					/* The task that implements the application. */
-					(const char *const) "APP",		/* Text name assigned to the task.  This is just to assist debugging.  The kernel does not use this name itself. */
-					usStackSize,					/* The size of the stack allocated to the task. */
-					NULL,						/* The parameter is not used, so NULL is passed. */
-					uxPriority,					/* The priority allocated to the task. */
-					NULL );						/* A handle is not required, so just pass NULL. */
-
+		VApplicationGeneralFault;
 	}
 }
 
 
 
 /*-----------------------------------------------------------*/
-static void prvAppTask( void *pvParameters )
+static void prvAppInit(msgbus_actor_t *actor)
 {
-	AppMessage_t _AppMsg;   // current transaction ..
-	( void ) pvParameters;
-
-		master_pAppMsg = &_AppMsg;
-
-		while(!isI2C0Ready()) {
-			vTaskDelay(100);
-		}
-
-		while(1)
-		{	
-			if( xQueueReceive( xAppInQueue, master_pAppMsg, portMAX_DELAY) == pdPASS)
-			{
-				if (master_pAppMsg ->cmd) {
-					switch (master_pAppMsg ->cmd)
-					{
-					case APPMSG_GET_STACK_ROOM:
-							master_pAppMsg->d.v= uxTaskGetStackHighWaterMark(NULL);
-						break;
-					case APPMSG_LIS3DH_INTR:
-						//Got interrupt from the accelerometer ..
-							if (master_pAppMsg->d.v == LIS3DH_GPIO_INT_PIN1)	
-								Lis3dhIntr1Clean();
-							else
-							if (master_pAppMsg->d.v == LIS3DH_GPIO_INT_PIN2)	
-								Lis3dhIntr2Clean();
-						break;
-					case APPMSG_MAIN_LOOP_START:
-						sAppState.what_happen = WAKE_NOTHING;
-						vAppMainLoopStart(master_pAppMsg);
-						break;
-					case APPMSG_MAIN_LOOP_STOP:
-						sAppState.what_happen = WAKE_MANUALLY_STOPED;
-						break;
-					case APPMSG_DEEP_SLEEP:
-						vAppDeepSleep(master_pAppMsg);
-						break;
-					}
-					if (master_pAppMsg->app__doneCallback != NULL)
-						master_pAppMsg->app__doneCallback(master_pAppMsg);
-				}
-			}
-		}
-}
+	( void ) actor;
 
-portBASE_TYPE AppMsgPut(pAppMessage msg)
-{
-	if(xQueueSend(xAppInQueue, msg, ( portTickType ) 10) != pdPASS)
-		{
-			VApplicationGeneralFault;
-		}
-	return pdPASS;
+	while(!isI2C0Ready()) {
+		vTaskDelay(100);
+	}
+	AppTimerInit(&xAppWindowTimer, prvAppWindowExpired, NULL, NULL);
 }
 
-/*-----------------------------------------------------------*/
-portBASE_TYPE  AppOnDone(void *pvParameters)
+static esp_err_t prvAppHandle(msgbus_actor_t *actor, msgbus_msg_t *bus)
 {
-	pAppMessage msg = (pAppMessage)pvParameters;
+	pAppMessage master_pAppMsg = (pAppMessage)bus;   // current transaction ..
+	( void ) actor;
 
-	if(xQueueSend(xAppOutQueue, msg, ( portTickType ) (10 /portTICK_RATE_MS)) != pdPASS)
+	switch (master_pAppMsg ->cmd)
 	{
-		VApplicationGeneralFault;
+	case APPMSG_GET_STACK_ROOM:
+			master_pAppMsg->d.v= uxTaskGetStackHighWaterMark(NULL);
+		break;
+	case APPMSG_MAIN_LOOP_START:
+		sAppState.what_happen = WAKE_NOTHING;
+		vAppMainLoopStart(master_pAppMsg);
+		break;
+	case APPMSG_MAIN_LOOP_STOP:
+		sAppState.what_happen = WAKE_MANUALLY_STOPED;
+		vAppWakeDo(wake_plan_step(&sAppState.wake, WAKE_EV_STAY));
+		break;
+	case APPMSG_DEEP_SLEEP:
+		vAppDeepSleep(master_pAppMsg);
+		break;
+	default:
+		return ESP_ERR_NOT_SUPPORTED;
 	}
-		
-	return pdPASS;
-}	
-portBASE_TYPE AppMsgGet(pAppMessage msg)
-{
-	return xQueueReceive(xAppOutQueue, msg, portMAX_DELAY);
+	return ESP_OK;
 }
 
-portBASE_TYPE AppTake(void *pvParameters)
+/*
+ * Interrupts from the accelerometer and the wake events; a wake event raised
+ * again before this ran counts once.
+ */
+static void prvAppSignal(msgbus_actor_t *actor, uint32_t bits)
 {
-	( void ) pvParameters;
-	if (xAppMutex == NULL)  return pdFAIL;
-
-        // Obtain the semaphore - don't block even if the semaphore is not
-        // available during a time more then a reasonable.
-	if( xSemaphoreTake( xAppMutex, (portMAX_DELAY -10) )  != pdPASS )
-	{
-		// Never return from  ..
-		{
-			VApplicationGeneralFault;
-		}
+	wake_event_t ev;
+	( void ) actor;
+
+	//Got interrupt from the accelerometer ..
+	if (bits & APPSIG_LIS3DH_INTR1)
+		Lis3dhIntr1Clean();
+	if (bits & APPSIG_LIS3DH_INTR2)
+		Lis3dhIntr2Clean();
+	for (ev = WAKE_EV_WINDOW_QUIET; ev <= WAKE_EV_STAY; ev++) {
+		if (bits & APPSIG_WAKE_EVENT(ev))
+			vAppWakeDo(wake_plan_step(&sAppState.wake, ev));
 	}
-	return pdPASS;
 }
-portBASE_TYPE AppGive(void *pvParameters)
+
+esp_err_t AppMsgCall(pAppMessage msg)
 {
-	( void ) pvParameters;
-	if (xAppMutex == NULL)  return pdFAIL;
+	return msgbus_call(&xAppActor, &msg->bus);
+}
 
-	if( xSemaphoreGive( xAppMutex ) != pdPASS )
-	{
-		// Never return from  ..
-		{
-			VApplicationGeneralFault;
-		}
-	}
-	return pdPASS;
+void vAppSignal(uint32_t bits)
+{
+	msgbus_signal(&xAppActor, bits);
+}
+
+void vAppSignalFromISR(uint32_t bits)
+{
+	msgbus_signal_from_isr(&xAppActor, bits);
 }
 
 /*-----------------------------------------------------------*/
@@ -208,6 +194,17 @@ pAppState psAppGetStatus(void)
     	return &sAppState;
 }
 
+void vAppSetRadios(AppRadioStart_t bt_start, AppRadioStart_t wifi_start)
+{
+	xAppStartBT = bt_start;
+	xAppStartWiFi = wifi_start;
+}
+
+void vAppWakeEvent(wake_event_t event)
+{
+	vAppSignal(APPSIG_WAKE_EVENT(event));
+}
+
 void vAppSetCurrentTime(void) 
 {
     	gettimeofday(&sleep_enter_time, NULL);
@@ -234,99 +231,157 @@ void vAppWakeup(pAppState  st)
             printf("Wake up from timer. Time spent in deep sleep: %dms\n", sleep_time_ms);
             break;
         }
+#if CONFIG_PINGZEE_ULP_WATCH
+        case ESP_DEEP_SLEEP_WAKEUP_ULP: {
+            ulp_watch_read(&sUlpWatch);
+            rtc_gpio_deinit(LIS3DH_GPIO_INT_PIN1);
+            printf("Wake up from ULP, reason %d: %d polls, %d edges, %d active. Time spent in deep sleep: %dms\n",
+                    sUlpWatch.reason, sUlpWatch.polls, sUlpWatch.edges, sUlpWatch.active, sleep_time_ms);
+            break;
+        }
+#endif
         case ESP_DEEP_SLEEP_WAKEUP_UNDEFINED:
         default:
             printf("Not a deep sleep reset\n");
     }
-	
-}
 
+	esp_err_t err = rtc_state_load(&sRtcState, rtc_block, sizeof(rtc_block));
+	if (err != ESP_OK) {
+		ESP_LOGI(APP_TAG, "RTC state dropped (0x%x)\n", err);
+	}
+	//The devices may have lost power with us, find them again
+	if (st->wakeup_reason == ESP_DEEP_SLEEP_WAKEUP_UNDEFINED) {
+		sRtcState.present = 0;
+	}
+	sRtcState.wakes++;
+}
 
-static void vAppMainLoopStart(pAppMessage pAppMsg)
+rtc_state_t *psAppGetRtcState(void)
 {
-	AppTimerCntl_t msg;
-
-	msg.timer_idx = 0;     // Use TIMER_GROUP_0, TIMER_0
-	msg.app_msg.cmd = APPMSG_TIMER_INIT;
-	msg.app_msg.d.v = getAppTimerVal4Secs(APP_WAKE_PERIOD);
-	msg.app_msg.app__doneCallback = AppTimerOnDone;
-	msg.apptimer__doneCallback = NULL;    // Use default handler for the "timer expiered" event..
-
-	AppTimersTake(NULL);
+	return &sRtcState;
+}
 
-	AppTimerMsgPut(&msg);
 
-	while (AppTimerMsgGet(&msg) != pdFAIL) {
-		break;
+/*
+ * Sensors come first on every wake; the wake plan decides from the wake
+ * reason, the RTC state and what the sensors saw whether the radios come up
+ * at all.
+ */
+static void vAppMainLoopStart(pAppMessage pAppMsg)
+{
+	wake_cause_t cause;
+	uint32_t actions;
+
+	switch (sAppState.wakeup_reason) {
+		case ESP_DEEP_SLEEP_WAKEUP_TIMER:	cause = WAKE_CAUSE_TIMER; break;
+		case ESP_DEEP_SLEEP_WAKEUP_EXT1:	cause = WAKE_CAUSE_MOTION; break;
+#if CONFIG_PINGZEE_ULP_WATCH
+		case ESP_DEEP_SLEEP_WAKEUP_ULP:
+			cause = sUlpWatch.reason == ULP_WATCH_BUDGET ? WAKE_CAUSE_TIMER : WAKE_CAUSE_MOTION;
+			vAppUlpQuietWakes();
+			break;
+#endif
+		default:							cause = WAKE_CAUSE_POWER_ON; break;
 	}
-	AppTimersGive(NULL);
-
-	xTaskCreate(prvAppTimerExpieredTask,	/* The task that implements the application. */
-				(const char *const) "ATi",		/* Text name assigned to the task.  This is just to assist debugging.  The kernel does not use this name itself. */
-				2048,						/* The size of the stack allocated to the task. */
-				NULL,						/* The parameter is not used, so NULL is passed. */
-				12,							/* The priority allocated to the task. */
-				NULL );						/* A handle is not required, so just pass NULL. */
-
-
-	msg.app_msg.cmd = APPMSG_TIMER_START;
+	actions = wake_plan_begin(&sAppState.wake, &wake_config, &sRtcState.wake, cause);
+	ESP_LOGI(APP_TAG, "Wake tier %d, %d quiet wakes before\n", sAppState.wake.tier, sRtcState.wake.quiet_wakes);
+	vAppWakeDo(actions);
+}
 
-	AppTimersTake(NULL);
+#if CONFIG_PINGZEE_ULP_WATCH
+/*
+ * The timer wakes the ULP watch stood in for count as quiet ones, so BT still
+ * comes up every heartbeat quiet periods; the wake that ended the watch is
+ * counted by the wake plan.
+ */
+static void vAppUlpQuietWakes(void)
+{
+	uint32_t periods = (uint32_t)sUlpWatch.polls * CONFIG_PINGZEE_ULP_POLL_MS / (APP_DEEP_SLEEP_PERIOD * 1000);
+	uint32_t quiet;
 
-	AppTimerMsgPut(&msg);
+	if (sRtcState.wake.magic != WAKE_RTC_MAGIC || periods == 0)
+		return;
+	quiet = sRtcState.wake.quiet_wakes + periods - 1;
+	sRtcState.wake.quiet_wakes = quiet > 0xFFFF ? 0xFFFF : quiet;
+}
 
-	while (AppTimerMsgGet(&msg) != pdFAIL) {
-		break;
+/*
+ * Hand the accelerometer pin to the ULP for the deep sleep; it wakes the CPUs
+ * on motion, or once the time budget runs out.
+ */
+static esp_err_t xAppUlpWatchStart(void)
+{
+	const gpio_num_t pin = LIS3DH_GPIO_INT_PIN1;
+	esp_err_t err;
+
+	if ((err = ulp_watch_load(rtc_gpio_desc[pin].rtc_num)) != ESP_OK)
+		return err;
+	rtc_gpio_init(pin);
+	rtc_gpio_set_direction(pin, RTC_GPIO_MODE_INPUT_ONLY);
+	rtc_gpio_pulldown_dis(pin);
+	rtc_gpio_pullup_dis(pin);
+	esp_deep_sleep_pd_config(ESP_PD_DOMAIN_RTC_PERIPH, ESP_PD_OPTION_ON);
+	REG_WRITE(SENS_ULP_CP_SLEEP_CYC0_REG, RTC_CNTL_SLOWCLK_FREQ / 1000 * CONFIG_PINGZEE_ULP_POLL_MS);
+	ulp_watch_arm(&ulp_watch_config);
+	if ((err = esp_deep_sleep_enable_ulp_wakeup()) != ESP_OK || (err = ulp_run(ULP_WATCH_ENTRY)) != ESP_OK) {
+		rtc_gpio_deinit(pin);
+		return err;
 	}
-	AppTimersGive(NULL);
-
+	return ESP_OK;
 }
+#endif
 
-static void prvAppTimerExpieredTask( void *pvParameters )
+static void vAppWakeDo(uint32_t actions)
 {
-	AppTimerCntl_t msg;
 	AppMessage_t dmsg;
-//	uint64_t  val;
-
-	while(1) {
-		if (AppTimer0MsgGetTimeout(&msg, (200 / portTICK_PERIOD_MS)) == pdTRUE) 
-		{
-			ESP_LOGI(APP_TAG, "%s: got interrupt from timer ..\r\n", __func__);
-			msg.timer_idx = 0;     // Use TIMER_GROUP_0, TIMER_0
-			msg.app_msg.cmd = APPMSG_TIMER_STOP;
-			msg.app_msg.d.v = getAppTimerVal4Secs(APP_WAKE_PERIOD);
-			msg.app_msg.app__doneCallback = AppTimerOnDone;
-			msg.apptimer__doneCallback = NULL;    // Use default handler for the "timer expiered" event..
-
-			AppTimersTake(NULL);
-
-			AppTimerMsgPut(&msg);
-
-			while (AppTimerMsgGet(&msg) != pdFAIL) {
-				break;
-			}
-			AppTimersGive(NULL);
-
-			if (sAppState.what_happen == WAKE_NOTHING) 
-			{
-				// Nothing happen during the "wake" period, going to sleep again.. 
-				dmsg.cmd = APPMSG_DEEP_SLEEP;
-				dmsg.app__doneCallback = NULL;
-				dmsg.d.v = APP_DEEP_SLEEP_PERIOD;
-				AppMsgPut(&dmsg);
-			}
-			vTaskDelete(NULL);
-		}
-//		getAppTimerVal(0, &val);
-//		printf("%s: h=%d, l=%d\r\n", __func__, (uint32_t)(val >> 32), (uint32_t)val&0xffffffff);
+
+	// A radio nobody can start counts as up, so the wake still ends
+	if (actions & WAKE_DO_START_BT) {
+		if (xAppStartBT != NULL)
+			xAppStartBT();
+		else
+			vAppWakeEvent(WAKE_EV_BT_UP);
+	}
+	if (actions & WAKE_DO_START_WIFI) {
+		if (xAppStartWiFi != NULL)
+			xAppStartWiFi();
+		else
+			vAppWakeEvent(WAKE_EV_WIFI_UP);
+	}
+	if (actions & WAKE_DO_WINDOW) {
+		// Each window only judges what happens in it
+		sAppState.what_happen = WAKE_NOTHING;
+		vAppWindowArm(sAppState.wake.window_ms);
+	}
+	if (actions & WAKE_DO_SLEEP) {
+		dmsg.cmd = APPMSG_DEEP_SLEEP;
+		dmsg.d.v = APP_DEEP_SLEEP_PERIOD;
+		vAppDeepSleep(&dmsg);
 	}
-	
 }
 
+/*
+ * One timer serves the sensor and the listen window; arming it again before
+ * it expired moves it.
+ */
+static void vAppWindowArm(uint32_t ms)
+{
+	AppTimerStart(&xAppWindowTimer, ms, 0);
+}
 
-static void vAppDeepSleep(pAppMessage pAppMsg) 
+/* In the Timers task */
+static void prvAppWindowExpired(pAppTimer timer)
 {
+	( void ) timer;
 
+	ESP_LOGI(APP_TAG, "%s: window over ..\r\n", __func__);
+	vAppWakeEvent(sAppState.what_happen == WAKE_NOTHING ? WAKE_EV_WINDOW_QUIET : WAKE_EV_WINDOW_BUSY);
+}
+
+
+/* The wakeups of a deep sleep without the ULP watch */
+static void vAppTimerExt1Wakeup(pAppMessage pAppMsg)
+{
     	ESP_LOGI(APP_TAG, "Enabling timer wakeup, %ds\n", pAppMsg->d.v);
     	esp_deep_sleep_enable_timer_wakeup(pAppMsg->d.v * 1000000);
 
@@ -337,9 +392,28 @@ static void vAppDeepSleep(pAppMessage pAppMsg)
 
 	ESP_LOGI(APP_TAG, "Enabling EXT1 wakeup on pins GPIO%d\n", ext_wakeup_pin_1);
 	esp_deep_sleep_enable_ext1_wakeup(ext_wakeup_pin_1_mask /*| ext_wakeup_pin_2_mask */, ESP_EXT1_WAKEUP_ANY_HIGH);
+}
+
+static void vAppDeepSleep(pAppMessage pAppMsg) 
+{
+#if CONFIG_PINGZEE_ULP_WATCH
+	esp_err_t err = xAppUlpWatchStart();
+
+	if (err == ESP_OK) {
+		ESP_LOGI(APP_TAG, "ULP watches GPIO%d, CPU wakeup at the latest in %ds\n", LIS3DH_GPIO_INT_PIN1,
+				ulp_watch_config.polls * CONFIG_PINGZEE_ULP_POLL_MS / 1000);
+	} else {
+		ESP_LOGW(APP_TAG, "ULP watch not started (0x%x), timer and EXT1 wakeup\n", err);
+		vAppTimerExt1Wakeup(pAppMsg);
+	}
+#else
+	vAppTimerExt1Wakeup(pAppMsg);
+#endif
 
     	ESP_LOGI(APP_TAG, "Entering deep sleep\n");
 	vAppSetCurrentTime();
+	rtc_state_motion_commit(&sRtcState);
+	rtc_state_save(&sRtcState, rtc_block, sizeof(rtc_block));
 	
     	esp_deep_sleep_start();
 
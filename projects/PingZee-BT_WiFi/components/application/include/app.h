@@ -11,8 +11,14 @@
 #include <time.h>
 #include <sys/time.h>
 #include "driver/spi_master.h"
+#include "lis3dh_fifo.h"
+#include "lis3dh_motion.h"
 #include "esp_deep_sleep.h"
 #include "board.h"
+#include "wake_plan.h"
+#include "rtc_state.h"
+#include "msgbus.h"
+#include "timer_wheel.h"
 
 #ifndef MAIN_APP_H_
 #define MAIN_APP_H_
@@ -31,6 +37,7 @@ typedef enum {
     WAKE_NOTHING			= 0, /*!<Nothing happen durint the "wake" state*/
     WAKE_BT_RESPONDED		= 1, /*!<BT has a respond for advertising*/
     WAKE_MANUALLY_STOPED	= 2, /*!<Going to debugging mode, without deep sleep*/
+    WAKE_MOTION			= 3, /*!<The accelerometer saw the board move*/
     WAKE_MAX,
 } at_wake_end_t;
 
@@ -42,8 +49,12 @@ typedef struct {
 	esp_deep_sleep_wakeup_cause_t		wakeup_reason;
 	char 							*tz;					// TimeZone, setups from Konfig	
 	at_wake_end_t					what_happen; 
+	wake_plan_t						wake;				// what this wake brings up, see wake_plan.h
 } AppState_t, *pAppState;
 
+// Starts one radio without waiting for it; reports WAKE_EV_BT_UP/WAKE_EV_WIFI_UP when done
+typedef void (*AppRadioStart_t)(void);
+
 #if (CONFIG_APPLICATION_DEBUG)
 void vApplicationGeneralFault( const char *function_name, int line);
 #define  VApplicationGeneralFault	vApplicationGeneralFault(__FUNCTION__, __LINE__)
@@ -55,6 +66,11 @@ void vApplicationGeneralFault(void);
 void vAppSetCurrentTime(void); 
 void vAppWakeup(pAppState  st);
 pAppState psAppGetStatus(void);
+rtc_state_t *psAppGetRtcState(void);
+void vAppSetRadios(AppRadioStart_t bt_start, AppRadioStart_t wifi_start);
+void vAppWakeEvent(wake_event_t event);
+void vAppSignal(uint32_t bits);
+void vAppSignalFromISR(uint32_t bits);
 
 
 #define APPMSG_NOP						(0x00)
@@ -65,32 +81,32 @@ pAppState psAppGetStatus(void);
 #define APPMSG_OLED_SHOW				(0x05)
 #define APPMSG_LIS3DH_CHECK_PRESENT	(0x06)
 #define APPMSG_LIS3DH_SETUP			(0x07)
-#define APPMSG_LIS3DH_INTR				(0x08)
-#define APPMSG_TIMER_INIT				(0x09)
-#define APPMSG_TIMER_INTR				(0x0A)
 #define APPMSG_TIMER_START			(0x0B)
 #define APPMSG_TIMER_STOP				(0x0C)
 #define APPMSG_MAIN_LOOP_START		(0x0D)
 #define APPMSG_MAIN_LOOP_STOP		(0x0E)
 #define APPMSG_DEEP_SLEEP				(0x0F)
 
+//! \name Signals of the application actor, raised without a message
+//@{
+#define APPSIG_LIS3DH_INTR1			(0x0001)
+#define APPSIG_LIS3DH_INTR2			(0x0002)
+#define APPSIG_WAKE_EVENT(ev)			(0x0100 << (ev))		// wake_event_t
+//@}
+
+// Every request is handed to the task that owns the hardware by pointer, see msgbus.h
 typedef struct {
+	msgbus_msg_t		bus;		// first member
 	uint8_t	cmd;
 	union {
 		uint32_t	v;
 		uint8_t	param[4];
 		void *	ptr;
 	} d;
-	portBASE_TYPE (*app__doneCallback)(void *);
 } AppMessage_t, *pAppMessage;
 
-extern xQueueHandle xAppInQueue;
 void vAppStart( uint16_t usStackSize, portBASE_TYPE uxPriority );
-portBASE_TYPE AppMsgPut(pAppMessage msg);
-portBASE_TYPE  AppOnDone(void *pvParameters);
-portBASE_TYPE AppMsgGet(pAppMessage msg);
-portBASE_TYPE AppTake(void *pvParameters);
-portBASE_TYPE AppGive(void *pvParameters);
+esp_err_t AppMsgCall(pAppMessage msg);
 
 
 //****************************************************************************//
@@ -142,15 +158,13 @@ typedef struct {
 	AppMessage_t		app_msg;
 	spi_device_handle_t spi_dev;
 	spi_transaction_t	trans;
-	portBASE_TYPE (*spi__doneCallback)(void *);
+	spi_transaction_t	*batch;			// when batch_count != 0, sent back to back instead of trans
+	int				batch_count;
+	transaction_cb_t	pre_cb;			// APPMSG_SPI_ADD_DEVICE: pre-transfer callback of the device
 } SPIMessage_t, *pSPIMessage;
 
 portBASE_TYPE isSPIReady(void);
-portBASE_TYPE SPIMsgPut(pSPIMessage msg);
-portBASE_TYPE SPIMsgGet(pSPIMessage msg);
-portBASE_TYPE  SPIOnDone(void *pvParameters);
-portBASE_TYPE SPITake(void *pvParameters);
-portBASE_TYPE SPIGive(void *pvParameters);
+esp_err_t SPIMsgCall(pSPIMessage msg);
 
 void vSPIMasterStart( uint16_t usStackSize, UBaseType_t uxPriority);
 
@@ -166,14 +180,11 @@ typedef struct {
 	unsigned char x;
 	unsigned char y;
 	unsigned short strLen;
-	unsigned char *str;
-	portBASE_TYPE (*oled__doneCallback)(void *);
+	unsigned char *str;				// APPMSG_OLED_CLEAN: NULL for the whole panel
 } OledMessage_t, *pOledMessage;
 
-portBASE_TYPE OledMsgPut(pOledMessage msg);
+esp_err_t OledMsgCall(pOledMessage msg);
 portBASE_TYPE isOledReady(void) ;
-portBASE_TYPE  OledOnDone(void *pvParameters);
-portBASE_TYPE OledMsgGet(pOledMessage msg);
 
 void vOledClean(void);
 void vOledStart( uint16_t usStackSize, portBASE_TYPE uxPriority );
@@ -190,14 +201,22 @@ void vOledWriteRaw(unsigned char y, unsigned char x, unsigned char *str, unsigne
 typedef struct {
 	AppMessage_t		app_msg;
 	float				accl;
-	portBASE_TYPE (*lis3dh__doneCallback)(void *);
 } Lis3dhMessage_t, *pLis3dhMessage;
 
+// Samples drained from the FIFO at one watermark, oldest first
+typedef struct {
+	uint32_t			seq;		// batch counter; a gap means batches were dropped
+	uint8_t			count;		// valid entries of sample[]
+	uint8_t			overrun;	// the FIFO was full, samples before these may be lost
+	lis3dh_features_t	features;	// of sample[], in mg
+	lis3dh_sample_t	sample[LIS3DH_FIFO_DEPTH];
+} Lis3dhBatch_t, *pLis3dhBatch;
+
 void vLis3dhStart( uint16_t usStackSize, portBASE_TYPE uxPriority );
-portBASE_TYPE Lis3dhMsgPut(pLis3dhMessage msg);
+esp_err_t Lis3dhMsgCall(pLis3dhMessage msg);
 portBASE_TYPE isLis3dhPresents(void);
-portBASE_TYPE  Lis3dhOnDone(void *pvParameters);
-portBASE_TYPE Lis3dhMsgGet(pLis3dhMessage msg);
+pLis3dhBatch Lis3dhBatchReceive(TickType_t ticks_to_wait);
+void Lis3dhBatchReturn(pLis3dhBatch batch);
 void Lis3dhIntr1Clean(void);
 void Lis3dhIntr2Clean(void);
 
@@ -208,28 +227,28 @@ void Lis3dhIntr2Clean(void);
 //****************************************************************************//
 
 
+typedef struct AppTimer AppTimer_t, *pAppTimer;
+
+// Any number of them run on one hardware timer, in the Timers task, see app_timers.c
+struct AppTimer {
+	timer_wheel_timer_t	wheel;		// owned by app_timers.c
+	void (*callback)(pAppTimer timer);	// run by the Timers task at expiry, NULL to send the timer to 'queue'
+	xQueueHandle		queue;		// of pAppTimer items
+	void				*arg;		// for the callback
+	uint32_t			expired;	// expiries so far
+	uint32_t			dropped;	// expiries the full queue refused
+};
+
 typedef struct {
-	AppMessage_t		app_msg;
-	int				timer_idx;
-	portBASE_TYPE (*apptimer__doneCallback)(void *);
+	AppMessage_t		app_msg;	// APPMSG_TIMER_START: d.v is the delay in ms; APPMSG_TIMER_STOP: d.v is set to 1 if the timer was armed
+	pAppTimer			timer;
+	uint32_t			period_ms;	// APPMSG_TIMER_START: 0 for a one-shot timer
 } AppTimerCntl_t, *pAppTimerCntl;
 
-portBASE_TYPE AppTimerMsgPut(pAppTimerCntl msg);
-portBASE_TYPE  AppTimerOnDone(void *pvParameters);
-portBASE_TYPE AppTimerMsgGet(pAppTimerCntl msg);
-portBASE_TYPE  AppTimer0OnDone(void *pvParameters);
-portBASE_TYPE AppTimer0MsgGet(pAppTimerCntl msg);
-portBASE_TYPE AppTimer0MsgGetTimeout(pAppTimerCntl msg, TickType_t delay);
-portBASE_TYPE  AppTimer1OnDone(void *pvParameters);
-portBASE_TYPE AppTimer1MsgGet(pAppTimerCntl msg);
-portBASE_TYPE  AppTimer2OnDone(void *pvParameters);
-portBASE_TYPE AppTimer2MsgGet(pAppTimerCntl msg);
-portBASE_TYPE  AppTimer3OnDone(void *pvParameters);
-portBASE_TYPE AppTimer3MsgGet(pAppTimerCntl msg);
-portBASE_TYPE AppTimersTake(void *pvParameters);
-portBASE_TYPE AppTimersGive(void *pvParameters);
-int getAppTimerVal4Secs(int secs);
-void getAppTimerVal(int timer_idx, uint64_t* timer_val);
+esp_err_t AppTimerMsgCall(pAppTimerCntl msg);
+void AppTimerInit(pAppTimer timer, void (*callback)(pAppTimer timer), xQueueHandle queue, void *arg);
+esp_err_t AppTimerStart(pAppTimer timer, uint32_t ms, uint32_t period_ms);
+esp_err_t AppTimerStop(pAppTimer timer);
 void vAppTimersStart( uint16_t usStackSize, portBASE_TYPE uxPriority );
 
 
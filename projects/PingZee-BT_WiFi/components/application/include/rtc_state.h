@@ -0,0 +1,131 @@
+/*
+ * rtc_state.h
+ *
+ * \brief Application state kept in RTC slow memory across deep sleep.
+ *
+ *  The state lives in RAM while the board is awake and is written to a byte
+ *  block in RTC memory just before deep sleep. The block has a fixed little
+ *  endian layout behind a header with magic, version, payload length and a
+ *  CRC-32 of the payload, so neither a power loss nor a firmware with another
+ *  layout is mistaken for valid state: such a block is dropped and the state
+ *  starts afresh.
+ *
+ *  What it holds:
+ *   - which devices were found, so they are not probed again every wake
+ *   - the LIS3DH settings last written to the chip, which keeps them through
+ *     the deep sleep of the ESP32
+ *   - a ring of per-wake motion summaries
+ *   - the wake plan state, see wake_plan.h
+ *
+ *  Kept free of any hardware or RTOS dependency.
+ */
+
+#ifndef COMPONENTS_APPLICATION_INCLUDE_RTC_STATE_H_
+#define COMPONENTS_APPLICATION_INCLUDE_RTC_STATE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "lis3dh.h"
+#include "lis3dh_motion.h"
+#include "wake_plan.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RTC_STATE_MAGIC				0x545A5A50	// "PZZT"
+#define RTC_STATE_VERSION			1
+#define RTC_STATE_BLOCK_SIZE		128			// bytes of RTC memory set aside
+#define RTC_STATE_MOTION_RING		8			// wakes of motion history
+
+//! \name rtc_state_t::present
+//@{
+#define RTC_PRESENT_LIS3DH			0x01	// WHO_AM_I answered
+#define RTC_PRESENT_LIS3DH_SET		0x02	// rtc_state_t::lis3dh is what the chip holds
+//@}
+
+//! Motion seen during one wake
+typedef struct {
+	uint16_t wake;			// rtc_state_t::wakes of that wake, low 16 bits
+	uint16_t mag_rms;		// largest lis3dh_features_t::mag_rms, mg
+	uint8_t batches;		// FIFO batches
+	uint8_t active;			// batches that showed motion
+	uint8_t steps;			// saturates at 255
+	uint8_t taps;			// saturates at 255
+} rtc_motion_t;
+
+typedef struct {
+	uint32_t wakes;			// since the state was created
+	uint8_t present;		// RTC_PRESENT_*
+	lis3dh_settings lis3dh;	// valid with RTC_PRESENT_LIS3DH_SET
+	uint8_t lis3dh_ctrl_reg1;	// as written, read back to see that the chip kept it
+	wake_rtc_t wake;
+	uint8_t motion_head;	// next slot of motion[]
+	uint8_t motion_count;
+	rtc_motion_t motion[RTC_STATE_MOTION_RING];
+	rtc_motion_t current;	// this wake, not saved until rtc_state_motion_commit()
+} rtc_state_t;
+
+/**
+ * \brief Fresh state: nothing known, no history
+ */
+void rtc_state_init(rtc_state_t *st);
+
+/**
+ * \brief Read the state from an RTC memory block
+ *
+ * On any error 'st' is left as rtc_state_init() makes it.
+ *
+ * \retval ESP_OK                 valid state
+ * \retval ESP_ERR_NOT_FOUND      no magic, e.g. after power on
+ * \retval ESP_ERR_NOT_SUPPORTED  written by a firmware with another layout
+ * \retval ESP_ERR_INVALID_SIZE   'len' too short, or the length field is wrong
+ * \retval ESP_ERR_INVALID_CRC    corrupted
+ */
+esp_err_t rtc_state_load(rtc_state_t *st, const uint8_t *block, size_t len);
+
+/**
+ * \brief Write the state to an RTC memory block
+ *
+ * rtc_state_t::current is not written.
+ *
+ * \retval bytes written, 0 if 'len' is too short
+ */
+size_t rtc_state_save(const rtc_state_t *st, uint8_t *block, size_t len);
+
+/**
+ * \brief Count one FIFO batch into the motion summary of this wake
+ */
+void rtc_state_motion_add(rtc_state_t *st, const lis3dh_features_t *f);
+
+/**
+ * \brief Move the summary of this wake to the ring, if it saw any batch
+ */
+void rtc_state_motion_commit(rtc_state_t *st);
+
+/**
+ * \brief Get a summary from the ring
+ *
+ * \param age  0 for the newest
+ * \retval 1 if there is one that old, else 0
+ */
+int rtc_state_motion_get(const rtc_state_t *st, int age, rtc_motion_t *m);
+
+/**
+ * \brief Whether two settings write the same registers
+ */
+int rtc_state_lis3dh_same(const lis3dh_settings *a, const lis3dh_settings *b);
+
+/**
+ * \brief CRC-32 (IEEE 802.3), 0xCBF43926 for "123456789"
+ *
+ * \param crc  0, or the result of the previous call for a running CRC
+ */
+uint32_t rtc_state_crc32(uint32_t crc, const uint8_t *buf, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* COMPONENTS_APPLICATION_INCLUDE_RTC_STATE_H_ */
@@ -0,0 +1,111 @@
+/*
+ * timer_wheel.h
+ *
+ * \brief Hierarchical timing wheel: any number of one-shot and periodic timers on one clock.
+ *
+ *  Time is counted in ticks; app_timers.c makes one tick a millisecond of the
+ *  one hardware timer it keeps running. The wheel has TIMER_WHEEL_LEVELS levels
+ *  of TIMER_WHEEL_SLOTS slots each; a timer sits in the lowest level whose
+ *  slots still reach its expiry, and is moved down a level ("cascaded") when
+ *  the clock gets to the slot it is in. Every delay of 32 bits fits.
+ *
+ *  timer_wheel_start() and timer_wheel_stop() are O(1) and don't allocate:
+ *  the caller owns the timer_wheel_timer_t, which links itself into a slot.
+ *  timer_wheel_next() is O(1) as well, a bitmap of the busy slots per level
+ *  gives the next tick where anything happens, so the clock does not have to
+ *  interrupt on every tick.
+ *
+ *  Not thread safe, every call of one wheel has to come from the same task.
+ *  Kept free of any hardware or RTOS dependency.
+ */
+
+#ifndef COMPONENTS_APPLICATION_INCLUDE_TIMER_WHEEL_H_
+#define COMPONENTS_APPLICATION_INCLUDE_TIMER_WHEEL_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TIMER_WHEEL_BITS			6
+#define TIMER_WHEEL_SLOTS			(1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_LEVELS			6		// 36 bits of delay
+#define TIMER_WHEEL_NEVER			UINT64_MAX
+
+typedef struct timer_wheel_timer timer_wheel_timer_t;
+
+//! Runs from timer_wheel_advance(); it may start or stop any timer, itself included
+typedef void (*timer_wheel_cb_t)(timer_wheel_timer_t *timer, void *arg);
+
+struct timer_wheel_timer {
+	timer_wheel_timer_t *next;
+	timer_wheel_timer_t **pprev;	// NULL when not armed
+	uint64_t expires;				// tick
+	uint32_t period;				// ticks, 0 for a one-shot timer
+	uint8_t level, slot;			// where it is linked
+	timer_wheel_cb_t cb;
+	void *arg;
+};
+
+typedef struct {
+	uint64_t now;					// last tick processed
+	uint32_t count;					// armed timers
+	uint64_t pending[TIMER_WHEEL_LEVELS];	// bit per slot that is not empty
+	timer_wheel_timer_t *slot[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+} timer_wheel_t;
+
+/**
+ * \brief Empty wheel, with the clock at 'now'
+ */
+void timer_wheel_init(timer_wheel_t *wheel, uint64_t now);
+
+/**
+ * \brief Prepare a timer before its first start
+ */
+void timer_wheel_timer_init(timer_wheel_timer_t *timer, timer_wheel_cb_t cb, void *arg);
+
+/**
+ * \brief Arm 'timer' to expire 'delay' ticks from now, then every 'period' ticks if it is not 0
+ *
+ *  A timer that is armed already is moved. A delay of 0 is taken as 1: the
+ *  timer expires at the next tick, never in the call.
+ */
+void timer_wheel_start(timer_wheel_t *wheel, timer_wheel_timer_t *timer, uint32_t delay, uint32_t period);
+
+/**
+ * \brief Disarm 'timer'
+ *
+ * \retval true if it was armed
+ */
+bool timer_wheel_stop(timer_wheel_t *wheel, timer_wheel_timer_t *timer);
+
+static inline bool timer_wheel_armed(const timer_wheel_timer_t *timer)
+{
+	return timer->pprev != NULL;
+}
+
+/**
+ * \brief First tick after timer_wheel_t::now where a timer expires or has to be cascaded
+ *
+ *  Never later than the first expiry, so the clock can sleep until then.
+ *
+ * \retval the tick, or TIMER_WHEEL_NEVER if no timer is armed
+ */
+uint64_t timer_wheel_next(const timer_wheel_t *wheel);
+
+/**
+ * \brief Move the clock to 'now' and run the callbacks of the timers that expired, in order
+ *
+ *  A clock that did not move is left alone.
+ *
+ * \retval callbacks run
+ */
+uint32_t timer_wheel_advance(timer_wheel_t *wheel, uint64_t now);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* COMPONENTS_APPLICATION_INCLUDE_TIMER_WHEEL_H_ */
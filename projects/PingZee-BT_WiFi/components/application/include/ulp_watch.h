@@ -0,0 +1,98 @@
+/*
+ * ulp_watch.h
+ *
+ * \brief ULP coprocessor program that watches the accelerometer pin in deep sleep.
+ *
+ *  The ULP timer starts the program every poll period. Each run reads the
+ *  LIS3DH INT1 pin from the RTC GPIO input register and counts, in RTC slow
+ *  memory:
+ *   - polls, since the watch was armed
+ *   - edges, polls that saw the pin go high
+ *   - active polls, that saw the pin high
+ *  The CPUs are only woken once one of these reaches its limit; the program
+ *  records which one did and stops the ULP timer. Short bumps under the limits
+ *  and quiet poll periods cost no CPU wake; the poll limit is the time budget
+ *  that replaces the deep sleep timer.
+ *
+ *  INT1 is left unlatched for this, see lis3dh.c: the ULP cannot clear it by
+ *  reading INT1_SRC, so it latches the edges itself.
+ *
+ *  The data words are at the start of RTC slow memory, the program right
+ *  after them. Nothing here touches a peripheral: app.c powers the pin and
+ *  starts the ULP, test_wake_host runs the program in the ULP simulator.
+ */
+
+#ifndef COMPONENTS_APPLICATION_INCLUDE_ULP_WATCH_H_
+#define COMPONENTS_APPLICATION_INCLUDE_ULP_WATCH_H_
+
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//! \name Data words, offsets in RTC slow memory; the ULP only keeps their low 16 bits
+//@{
+#define ULP_WATCH_LEVEL				0	// pin level at the last poll
+#define ULP_WATCH_POLLS				1
+#define ULP_WATCH_EDGES				2
+#define ULP_WATCH_ACTIVE			3
+#define ULP_WATCH_REASON			4	// ulp_watch_reason_t
+#define ULP_WATCH_EDGE_LIMIT		5
+#define ULP_WATCH_ACTIVE_LIMIT		6
+#define ULP_WATCH_POLL_LIMIT		7
+#define ULP_WATCH_DATA_WORDS		8
+//@}
+
+#define ULP_WATCH_ENTRY				ULP_WATCH_DATA_WORDS	// load address and entry point of the program, in words
+
+//! Why the ULP woke the CPUs
+typedef enum {
+	ULP_WATCH_NONE = 0,			// it didn't, or the watch was not armed
+	ULP_WATCH_EDGES_HIT,
+	ULP_WATCH_ACTIVE_HIT,
+	ULP_WATCH_BUDGET,			// the poll limit ran out
+} ulp_watch_reason_t;
+
+//! Limits of one watch; a limit of 0 is never reached
+typedef struct {
+	uint16_t edges;
+	uint16_t active;			// polls with the pin high
+	uint16_t polls;
+} ulp_watch_config_t;
+
+typedef struct {
+	ulp_watch_reason_t reason;
+	uint16_t polls;
+	uint16_t edges;
+	uint16_t active;
+} ulp_watch_result_t;
+
+/**
+ * \brief Build the program for RTC GPIO 'rtc_gpio_num' and load it at ULP_WATCH_ENTRY
+ *
+ * \retval ESP_OK or the error of ulp_process_macros_and_load()
+ */
+esp_err_t ulp_watch_load(uint32_t rtc_gpio_num);
+
+/**
+ * \brief Clear the counters and set the limits, before the ULP is started
+ */
+void ulp_watch_arm(const ulp_watch_config_t *config);
+
+/**
+ * \brief What the watch counted, and why it ended
+ */
+void ulp_watch_read(ulp_watch_result_t *result);
+
+/**
+ * \brief Polls of 'poll_ms' that cover 'ms', rounded up and held to the 16 bits of a limit
+ */
+uint16_t ulp_watch_polls(uint32_t ms, uint32_t poll_ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* COMPONENTS_APPLICATION_INCLUDE_ULP_WATCH_H_ */
@@ -0,0 +1,131 @@
+/*
+ * wake_plan.h
+ *
+ * \brief Decides how much of the board one deep sleep wake brings up.
+ *
+ *  Every wake starts with a short sensor window; the radios are only brought
+ *  up when the wake reason or what the sensors saw calls for them:
+ *
+ *   - power on, or the accelerometer pin (EXT1): Wi-Fi and BT, started right
+ *     away in parallel with the sensor window
+ *   - timer: sensors only, back to sleep after the window if nothing moved.
+ *     Every 'heartbeat' quiet timer wakes BT comes up anyway, so a phone can
+ *     still reach the board. Motion seen in the window starts Wi-Fi and BT.
+ *
+ *  Once every radio that was started is up, a listen window follows; the
+ *  board sleeps again if nothing happened in it, as before. A phone that
+ *  connects keeps the board up and gets Wi-Fi started.
+ *
+ *  The caller reports what happens with wake_plan_step() and carries out the
+ *  WAKE_DO_* actions it returns. The state that has to survive deep sleep is
+ *  in wake_rtc_t, kept by the caller in RTC memory.
+ *
+ *  Kept free of any hardware or RTOS dependency.
+ */
+
+#ifndef COMPONENTS_APPLICATION_INCLUDE_WAKE_PLAN_H_
+#define COMPONENTS_APPLICATION_INCLUDE_WAKE_PLAN_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define WAKE_RTC_MAGIC				0x57414B45
+
+typedef enum {
+	WAKE_CAUSE_POWER_ON = 0,	// reset or anything that is not a deep sleep wake
+	WAKE_CAUSE_TIMER,
+	WAKE_CAUSE_MOTION,			// EXT1, the accelerometer interrupt pin
+	WAKE_CAUSE_MAX,
+} wake_cause_t;
+
+//! Radios brought up, in increasing cost
+typedef enum {
+	WAKE_TIER_SENSORS = 0,
+	WAKE_TIER_BT,
+	WAKE_TIER_FULL,				// BT and Wi-Fi
+	WAKE_TIER_MAX,
+} wake_tier_t;
+
+typedef enum {
+	WAKE_STATE_SENSING = 0,		// sensor window armed
+	WAKE_STATE_RADIOS,			// sensor window over, radios still coming up
+	WAKE_STATE_LISTENING,		// listen window armed
+	WAKE_STATE_AWAKE,			// stays up, no more windows
+	WAKE_STATE_SLEEP,
+} wake_state_t;
+
+typedef enum {
+	WAKE_EV_WINDOW_QUIET = 0,	// the armed window ran out, nothing happened in it
+	WAKE_EV_WINDOW_BUSY,		// the armed window ran out, something happened in it
+	WAKE_EV_BT_UP,				// also reported if the bring-up failed
+	WAKE_EV_WIFI_UP,			// also reported if the bring-up failed
+	WAKE_EV_PEER,				// a phone connected, stays up like WAKE_EV_STAY
+	WAKE_EV_STAY,				// stop the sleep cycle
+} wake_event_t;
+
+//! \name Actions returned by wake_plan_begin() and wake_plan_step()
+//@{
+#define WAKE_DO_START_BT			0x01
+#define WAKE_DO_START_WIFI			0x02
+#define WAKE_DO_WINDOW				0x04	// (re)arm the window timer with wake_plan_t::window_ms
+#define WAKE_DO_SLEEP				0x08
+//@}
+
+//! \name Radio bits of wake_plan_t::started and wake_plan_t::up
+//@{
+#define WAKE_RADIO_BT				0x01
+#define WAKE_RADIO_WIFI				0x02
+//@}
+
+typedef struct {
+	uint32_t sensor_ms;			// sensor window
+	uint32_t listen_ms;			// listen window once the radios are up
+	uint16_t heartbeat;			// BT comes up every this many quiet timer wakes, 0 never
+} wake_plan_config_t;
+
+//! Kept across deep sleep, valid while magic is WAKE_RTC_MAGIC
+typedef struct {
+	uint32_t magic;
+	uint16_t quiet_wakes;		// timer wakes in a row that left the radios off
+	uint16_t reserved;
+	uint32_t wakes[WAKE_TIER_MAX];	// wakes that ended at each tier
+} wake_rtc_t;
+
+typedef struct {
+	wake_plan_config_t config;
+	wake_rtc_t *rtc;
+	wake_cause_t cause;
+	wake_tier_t tier;
+	wake_state_t state;
+	uint8_t started;			// WAKE_RADIO_* bits asked for
+	uint8_t up;					// WAKE_RADIO_* bits reported up
+	uint32_t window_ms;			// for WAKE_DO_WINDOW
+} wake_plan_t;
+
+/**
+ * \brief Choose the tier of a wake and start its sensor window
+ *
+ * 'rtc' is reset first if it does not hold valid state.
+ *
+ * \retval WAKE_DO_* actions: WAKE_DO_WINDOW, plus the radios to start now
+ */
+uint32_t wake_plan_begin(wake_plan_t *plan, const wake_plan_config_t *config, wake_rtc_t *rtc, wake_cause_t cause);
+
+/**
+ * \brief Advance the plan by one event
+ *
+ * Events that do not apply to the current state are ignored. The actions
+ * that end the wake also update the RTC state.
+ *
+ * \retval WAKE_DO_* actions, 0 for none
+ */
+uint32_t wake_plan_step(wake_plan_t *plan, wake_event_t event);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* COMPONENTS_APPLICATION_INCLUDE_WAKE_PLAN_H_ */
@@ -0,0 +1,244 @@
+/*
+ * rtc_state.c
+ *
+ * \brief Application state kept in RTC slow memory across deep sleep.
+ *
+ */
+
+#include <string.h>
+#include "rtc_state.h"
+
+/* magic, version, payload length, CRC of the payload */
+#define RTC_STATE_HEADER_SIZE		12
+#define RTC_STATE_SETTINGS_SIZE		12
+#define RTC_STATE_MOTION_SIZE		8
+#define RTC_STATE_PAYLOAD_SIZE		(4 + 1 + RTC_STATE_SETTINGS_SIZE + 1 \
+									+ 4 + 2 + 4 * WAKE_TIER_MAX \
+									+ 2 + RTC_STATE_MOTION_SIZE * RTC_STATE_MOTION_RING)
+
+#if RTC_STATE_HEADER_SIZE + RTC_STATE_PAYLOAD_SIZE > RTC_STATE_BLOCK_SIZE
+#error "RTC state does not fit in RTC_STATE_BLOCK_SIZE"
+#endif
+
+/* Little endian field access, moving the cursor along */
+static inline void put8(uint8_t **p, uint8_t v)
+{
+	*(*p)++ = v;
+}
+
+static inline void put16(uint8_t **p, uint16_t v)
+{
+	put8(p, v & 0xFF);
+	put8(p, v >> 8);
+}
+
+static inline void put32(uint8_t **p, uint32_t v)
+{
+	put16(p, v & 0xFFFF);
+	put16(p, v >> 16);
+}
+
+static inline uint8_t get8(const uint8_t **p)
+{
+	return *(*p)++;
+}
+
+static inline uint16_t get16(const uint8_t **p)
+{
+	uint16_t v = get8(p);
+	return v | (get8(p) << 8);
+}
+
+static inline uint32_t get32(const uint8_t **p)
+{
+	uint32_t v = get16(p);
+	return v | ((uint32_t)get16(p) << 16);
+}
+
+uint32_t rtc_state_crc32(uint32_t crc, const uint8_t *buf, size_t len)
+{
+	int bit;
+
+	crc = ~crc;
+	while (len--) {
+		crc ^= *buf++;
+		for (bit = 0; bit < 8; bit++) {
+			crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+		}
+	}
+	return ~crc;
+}
+
+void rtc_state_init(rtc_state_t *st)
+{
+	memset(st, 0, sizeof(*st));
+}
+
+size_t rtc_state_save(const rtc_state_t *st, uint8_t *block, size_t len)
+{
+	uint8_t *p = block + RTC_STATE_HEADER_SIZE, *payload = p;
+	int i;
+
+	if (len < RTC_STATE_HEADER_SIZE + RTC_STATE_PAYLOAD_SIZE) {
+		return 0;
+	}
+
+	put32(&p, st->wakes);
+	put8(&p, st->present);
+	put8(&p, st->lis3dh.adcEnabled);
+	put8(&p, st->lis3dh.tempEnabled);
+	put16(&p, st->lis3dh.accelSampleRate);
+	put8(&p, st->lis3dh.accelRange);
+	put8(&p, st->lis3dh.xAccelEnabled);
+	put8(&p, st->lis3dh.yAccelEnabled);
+	put8(&p, st->lis3dh.zAccelEnabled);
+	put8(&p, st->lis3dh.fifoEnabled);
+	put8(&p, st->lis3dh.fifoMode);
+	put8(&p, st->lis3dh.fifoThreshold);
+	put8(&p, 0);
+	put8(&p, st->lis3dh_ctrl_reg1);
+	put32(&p, st->wake.magic);
+	put16(&p, st->wake.quiet_wakes);
+	for (i = 0; i < WAKE_TIER_MAX; i++) {
+		put32(&p, st->wake.wakes[i]);
+	}
+	put8(&p, st->motion_head);
+	put8(&p, st->motion_count);
+	for (i = 0; i < RTC_STATE_MOTION_RING; i++) {
+		const rtc_motion_t *m = &st->motion[i];
+		put16(&p, m->wake);
+		put16(&p, m->mag_rms);
+		put8(&p, m->batches);
+		put8(&p, m->active);
+		put8(&p, m->steps);
+		put8(&p, m->taps);
+	}
+
+	p = block;
+	put32(&p, RTC_STATE_MAGIC);
+	put16(&p, RTC_STATE_VERSION);
+	put16(&p, RTC_STATE_PAYLOAD_SIZE);
+	put32(&p, rtc_state_crc32(0, payload, RTC_STATE_PAYLOAD_SIZE));
+	return RTC_STATE_HEADER_SIZE + RTC_STATE_PAYLOAD_SIZE;
+}
+
+esp_err_t rtc_state_load(rtc_state_t *st, const uint8_t *block, size_t len)
+{
+	const uint8_t *p = block, *payload = block + RTC_STATE_HEADER_SIZE;
+	uint16_t version, length;
+	uint32_t crc;
+	int i;
+
+	rtc_state_init(st);
+	if (len < RTC_STATE_HEADER_SIZE) {
+		return ESP_ERR_INVALID_SIZE;
+	}
+	if (get32(&p) != RTC_STATE_MAGIC) {
+		return ESP_ERR_NOT_FOUND;
+	}
+	version = get16(&p);
+	length = get16(&p);
+	crc = get32(&p);
+	if (version != RTC_STATE_VERSION) {
+		return ESP_ERR_NOT_SUPPORTED;
+	}
+	if (length != RTC_STATE_PAYLOAD_SIZE || len < RTC_STATE_HEADER_SIZE + length) {
+		return ESP_ERR_INVALID_SIZE;
+	}
+	if (rtc_state_crc32(0, payload, length) != crc) {
+		return ESP_ERR_INVALID_CRC;
+	}
+
+	st->wakes = get32(&p);
+	st->present = get8(&p);
+	st->lis3dh.adcEnabled = get8(&p);
+	st->lis3dh.tempEnabled = get8(&p);
+	st->lis3dh.accelSampleRate = get16(&p);
+	st->lis3dh.accelRange = get8(&p);
+	st->lis3dh.xAccelEnabled = get8(&p);
+	st->lis3dh.yAccelEnabled = get8(&p);
+	st->lis3dh.zAccelEnabled = get8(&p);
+	st->lis3dh.fifoEnabled = get8(&p);
+	st->lis3dh.fifoMode = get8(&p);
+	st->lis3dh.fifoThreshold = get8(&p);
+	get8(&p);
+	st->lis3dh_ctrl_reg1 = get8(&p);
+	st->wake.magic = get32(&p);
+	st->wake.quiet_wakes = get16(&p);
+	for (i = 0; i < WAKE_TIER_MAX; i++) {
+		st->wake.wakes[i] = get32(&p);
+	}
+	st->motion_head = get8(&p);
+	st->motion_count = get8(&p);
+	for (i = 0; i < RTC_STATE_MOTION_RING; i++) {
+		rtc_motion_t *m = &st->motion[i];
+		m->wake = get16(&p);
+		m->mag_rms = get16(&p);
+		m->batches = get8(&p);
+		m->active = get8(&p);
+		m->steps = get8(&p);
+		m->taps = get8(&p);
+	}
+
+	//A CRC match on values that cannot have been written is still no state
+	if (st->motion_head >= RTC_STATE_MOTION_RING || st->motion_count > RTC_STATE_MOTION_RING) {
+		rtc_state_init(st);
+		return ESP_ERR_INVALID_CRC;
+	}
+	return ESP_OK;
+}
+
+static inline uint8_t sat_add8(uint8_t a, uint32_t b)
+{
+	return (a + b > 0xFF) ? 0xFF : a + b;
+}
+
+void rtc_state_motion_add(rtc_state_t *st, const lis3dh_features_t *f)
+{
+	rtc_motion_t *m = &st->current;
+
+	m->batches = sat_add8(m->batches, 1);
+	m->active = sat_add8(m->active, f->active ? 1 : 0);
+	m->steps = sat_add8(m->steps, f->steps);
+	m->taps = sat_add8(m->taps, f->taps);
+	if (f->mag_rms > m->mag_rms) {
+		m->mag_rms = f->mag_rms;
+	}
+}
+
+void rtc_state_motion_commit(rtc_state_t *st)
+{
+	if (st->current.batches == 0) {
+		return;
+	}
+	st->current.wake = (uint16_t)st->wakes;
+	st->motion[st->motion_head] = st->current;
+	st->motion_head = (st->motion_head + 1) % RTC_STATE_MOTION_RING;
+	if (st->motion_count < RTC_STATE_MOTION_RING) {
+		st->motion_count++;
+	}
+	memset(&st->current, 0, sizeof(st->current));
+}
+
+int rtc_state_motion_get(const rtc_state_t *st, int age, rtc_motion_t *m)
+{
+	if (age < 0 || age >= st->motion_count) {
+		return 0;
+	}
+	*m = st->motion[(st->motion_head + RTC_STATE_MOTION_RING - 1 - age) % RTC_STATE_MOTION_RING];
+	return 1;
+}
+
+int rtc_state_lis3dh_same(const lis3dh_settings *a, const lis3dh_settings *b)
+{
+	return a->adcEnabled == b->adcEnabled
+		&& a->tempEnabled == b->tempEnabled
+		&& a->accelSampleRate == b->accelSampleRate
+		&& a->accelRange == b->accelRange
+		&& a->xAccelEnabled == b->xAccelEnabled
+		&& a->yAccelEnabled == b->yAccelEnabled
+		&& a->zAccelEnabled == b->zAccelEnabled
+		&& a->fifoEnabled == b->fifoEnabled
+		&& a->fifoMode == b->fifoMode
+		&& a->fifoThreshold == b->fifoThreshold;
+}
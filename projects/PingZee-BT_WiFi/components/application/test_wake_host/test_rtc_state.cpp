@@ -0,0 +1,243 @@
+// Copyright 2015-2017 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "catch.hpp"
+#include "rtc_state.h"
+#include <cstring>
+#include <vector>
+
+static lis3dh_settings settings_of(uint16_t odr, uint8_t range, uint8_t fifo_mode)
+{
+    lis3dh_settings s;
+    memset(&s, 0, sizeof(s));
+    s.accelSampleRate = odr;
+    s.accelRange = range;
+    s.xAccelEnabled = s.yAccelEnabled = s.zAccelEnabled = 1;
+    s.fifoEnabled = fifo_mode != 0;
+    s.fifoMode = fifo_mode;
+    s.fifoThreshold = 20;
+    return s;
+}
+
+static lis3dh_features_t batch(uint16_t mag_rms, uint8_t steps, uint8_t taps, bool active)
+{
+    lis3dh_features_t f;
+    memset(&f, 0, sizeof(f));
+    f.mag_rms = mag_rms;
+    f.steps = steps;
+    f.taps = taps;
+    f.active = active;
+    return f;
+}
+
+/* A state with something in every field */
+static rtc_state_t busy_state()
+{
+    rtc_state_t st;
+    rtc_state_init(&st);
+    st.wakes = 0x12345678;
+    st.present = RTC_PRESENT_LIS3DH | RTC_PRESENT_LIS3DH_SET;
+    st.lis3dh = settings_of(400, 8, 2);
+    st.lis3dh.adcEnabled = 1;
+    st.lis3dh_ctrl_reg1 = 0x7F;
+    st.wake.magic = WAKE_RTC_MAGIC;
+    st.wake.quiet_wakes = 9;
+    for (int i = 0; i < WAKE_TIER_MAX; ++i) {
+        st.wake.wakes[i] = 1000 * (i + 1);
+    }
+    for (int w = 0; w < RTC_STATE_MOTION_RING + 3; ++w) {
+        lis3dh_features_t f = batch(100 + w, w, 1, w & 1);
+        rtc_state_motion_add(&st, &f);
+        st.wakes++;
+        rtc_state_motion_commit(&st);
+    }
+    return st;
+}
+
+static void check_same(const rtc_state_t& a, const rtc_state_t& b)
+{
+    CHECK(a.wakes == b.wakes);
+    CHECK(a.present == b.present);
+    CHECK(rtc_state_lis3dh_same(&a.lis3dh, &b.lis3dh));
+    CHECK(a.lis3dh_ctrl_reg1 == b.lis3dh_ctrl_reg1);
+    CHECK(memcmp(&a.wake, &b.wake, sizeof(a.wake)) == 0);
+    CHECK(a.motion_head == b.motion_head);
+    CHECK(a.motion_count == b.motion_count);
+    CHECK(memcmp(a.motion, b.motion, sizeof(a.motion)) == 0);
+}
+
+static bool is_fresh(const rtc_state_t& st)
+{
+    rtc_state_t fresh;
+    rtc_state_init(&fresh);
+    return memcmp(&st, &fresh, sizeof(st)) == 0;
+}
+
+TEST_CASE("CRC-32 check value", "[rtc]")
+{
+    const uint8_t check[] = "123456789";
+    CHECK(rtc_state_crc32(0, check, 9) == 0xCBF43926);
+    /* Running CRC over two parts */
+    CHECK(rtc_state_crc32(rtc_state_crc32(0, check, 4), check + 4, 5) == 0xCBF43926);
+}
+
+TEST_CASE("state survives a save and load", "[rtc]")
+{
+    rtc_state_t st = busy_state(), back;
+    uint8_t block[RTC_STATE_BLOCK_SIZE];
+
+    size_t n = rtc_state_save(&st, block, sizeof(block));
+    REQUIRE(n > 0);
+    REQUIRE(n <= sizeof(block));
+    REQUIRE(rtc_state_load(&back, block, sizeof(block)) == ESP_OK);
+    check_same(st, back);
+
+    /* The summary of the running wake stays behind */
+    lis3dh_features_t f = batch(5, 1, 1, true);
+    rtc_state_motion_add(&st, &f);
+    REQUIRE(rtc_state_save(&st, block, sizeof(block)) == n);
+    REQUIRE(rtc_state_load(&back, block, sizeof(block)) == ESP_OK);
+    CHECK(back.current.batches == 0);
+}
+
+TEST_CASE("the block layout is fixed", "[rtc]")
+{
+    rtc_state_t st;
+    uint8_t block[RTC_STATE_BLOCK_SIZE];
+
+    rtc_state_init(&st);
+    st.wakes = 0x01020304;
+    st.lis3dh.accelSampleRate = 0x0190;
+    REQUIRE(rtc_state_save(&st, block, sizeof(block)) == 114);
+
+    /* Header: magic, version, length, CRC, little endian */
+    const uint8_t header[] = { 'P', 'Z', 'Z', 'T', RTC_STATE_VERSION, 0, 102, 0 };
+    CHECK(memcmp(block, header, sizeof(header)) == 0);
+    uint32_t crc = block[8] | block[9] << 8 | block[10] << 16 | (uint32_t)block[11] << 24;
+    CHECK(crc == rtc_state_crc32(0, block + 12, 102));
+    /* wakes, present, then the settings */
+    const uint8_t payload[] = { 0x04, 0x03, 0x02, 0x01, 0x00, 0x00, 0x00, 0x90, 0x01 };
+    CHECK(memcmp(block + 12, payload, sizeof(payload)) == 0);
+}
+
+TEST_CASE("damaged blocks give a fresh state", "[rtc]")
+{
+    rtc_state_t st = busy_state(), back;
+    uint8_t block[RTC_STATE_BLOCK_SIZE];
+    size_t n = rtc_state_save(&st, block, sizeof(block));
+
+    SECTION("RTC memory after power on") {
+        std::vector<uint8_t> zero(sizeof(block), 0), ones(sizeof(block), 0xFF);
+        CHECK(rtc_state_load(&back, zero.data(), zero.size()) == ESP_ERR_NOT_FOUND);
+        CHECK(is_fresh(back));
+        CHECK(rtc_state_load(&back, ones.data(), ones.size()) == ESP_ERR_NOT_FOUND);
+        CHECK(is_fresh(back));
+    }
+    SECTION("any single bit flipped") {
+        for (size_t byte = 0; byte < n; ++byte) {
+            for (int bit = 0; bit < 8; ++bit) {
+                uint8_t copy[RTC_STATE_BLOCK_SIZE];
+                memcpy(copy, block, sizeof(copy));
+                copy[byte] ^= 1 << bit;
+                esp_err_t err = rtc_state_load(&back, copy, sizeof(copy));
+                CHECK(err != ESP_OK);
+                if (byte >= 12) {
+                    CHECK(err == ESP_ERR_INVALID_CRC);
+                }
+                CHECK(is_fresh(back));
+            }
+        }
+    }
+    SECTION("another layout version") {
+        block[4] = RTC_STATE_VERSION + 1;
+        CHECK(rtc_state_load(&back, block, sizeof(block)) == ESP_ERR_NOT_SUPPORTED);
+        CHECK(is_fresh(back));
+    }
+    SECTION("block or length field too short") {
+        CHECK(rtc_state_load(&back, block, n - 1) == ESP_ERR_INVALID_SIZE);
+        CHECK(rtc_state_load(&back, block, 4) == ESP_ERR_INVALID_SIZE);
+        block[6] = 50;
+        CHECK(rtc_state_load(&back, block, sizeof(block)) == ESP_ERR_INVALID_SIZE);
+        CHECK(is_fresh(back));
+        CHECK(rtc_state_save(&st, block, n - 1) == 0);
+    }
+    SECTION("a valid CRC over impossible values") {
+        block[12 + 18 + 18] = RTC_STATE_MOTION_RING;    // motion_head
+        uint32_t crc = rtc_state_crc32(0, block + 12, n - 12);
+        for (int i = 0; i < 4; ++i) {
+            block[8 + i] = crc >> (8 * i);
+        }
+        CHECK(rtc_state_load(&back, block, sizeof(block)) == ESP_ERR_INVALID_CRC);
+        CHECK(is_fresh(back));
+    }
+}
+
+TEST_CASE("the motion ring keeps the newest wakes", "[rtc]")
+{
+    rtc_state_t st;
+    rtc_motion_t m;
+
+    rtc_state_init(&st);
+    CHECK(rtc_state_motion_get(&st, 0, &m) == 0);
+
+    /* A wake without batches leaves no entry */
+    st.wakes = 1;
+    rtc_state_motion_commit(&st);
+    CHECK(st.motion_count == 0);
+
+    for (int w = 1; w <= 20; ++w) {
+        st.wakes = w;
+        lis3dh_features_t quiet = batch(10, 0, 0, false), moving = batch(300 + w, 200, 3, true);
+        rtc_state_motion_add(&st, &quiet);
+        rtc_state_motion_add(&st, &moving);
+        rtc_state_motion_add(&st, &moving);
+        rtc_state_motion_commit(&st);
+    }
+    CHECK(st.motion_count == RTC_STATE_MOTION_RING);
+    for (int age = 0; age < RTC_STATE_MOTION_RING; ++age) {
+        REQUIRE(rtc_state_motion_get(&st, age, &m) == 1);
+        CHECK(m.wake == 20 - age);
+        CHECK(m.batches == 3);
+        CHECK(m.active == 2);
+        CHECK(m.steps == 255);      // 400, saturated
+        CHECK(m.taps == 6);
+        CHECK(m.mag_rms == 300 + 20 - age);
+    }
+    CHECK(rtc_state_motion_get(&st, RTC_STATE_MOTION_RING, &m) == 0);
+    CHECK(rtc_state_motion_get(&st, -1, &m) == 0);
+}
+
+TEST_CASE("settings compare field by field", "[rtc]")
+{
+    lis3dh_settings a = settings_of(50, 2, 0), b;
+
+    /* Whatever the padding holds */
+    memset(&b, 0xA5, sizeof(b));
+    b.adcEnabled = a.adcEnabled;
+    b.tempEnabled = a.tempEnabled;
+    b.accelSampleRate = a.accelSampleRate;
+    b.accelRange = a.accelRange;
+    b.xAccelEnabled = a.xAccelEnabled;
+    b.yAccelEnabled = a.yAccelEnabled;
+    b.zAccelEnabled = a.zAccelEnabled;
+    b.fifoEnabled = a.fifoEnabled;
+    b.fifoMode = a.fifoMode;
+    b.fifoThreshold = a.fifoThreshold;
+    CHECK(rtc_state_lis3dh_same(&a, &b));
+
+    b.fifoThreshold++;
+    CHECK(!rtc_state_lis3dh_same(&a, &b));
+    b = a;
+    b.accelSampleRate = 100;
+    CHECK(!rtc_state_lis3dh_same(&a, &b));
+}
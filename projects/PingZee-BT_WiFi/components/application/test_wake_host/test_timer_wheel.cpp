@@ -0,0 +1,389 @@
+// Copyright 2015-2017 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "catch.hpp"
+#include "timer_wheel.h"
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using std::cout;
+using std::endl;
+
+/* A wheel on a simulated clock; every timer records the ticks it expired at */
+struct Clock {
+    timer_wheel_t wheel;
+    uint32_t wakes = 0;         // times the clock had to interrupt
+
+    explicit Clock(uint64_t now = 0)
+    {
+        timer_wheel_init(&wheel, now);
+    }
+
+    /* Tick by tick, as a clock interrupting every tick would */
+    void step_to(uint64_t now)
+    {
+        while (wheel.now < now) {
+            timer_wheel_advance(&wheel, wheel.now + 1);
+        }
+    }
+
+    /* From one timer_wheel_next() to the other, as app_timers.c programs the alarm */
+    void sleep_to(uint64_t now)
+    {
+        while (wheel.now < now) {
+            uint64_t next = timer_wheel_next(&wheel);
+            if (next > now) {
+                next = now;
+            } else {
+                wakes++;
+            }
+            timer_wheel_advance(&wheel, next);
+        }
+    }
+};
+
+struct Timer {
+    timer_wheel_timer_t t;
+    Clock* clock;
+    std::vector<uint64_t> fired;
+    std::function<void(Timer&)> then;
+
+    explicit Timer(Clock& c) : clock(&c)
+    {
+        timer_wheel_timer_init(&t, expired, this);
+    }
+
+    static void expired(timer_wheel_timer_t*, void* arg)
+    {
+        Timer* self = static_cast<Timer*>(arg);
+        self->fired.push_back(self->clock->wheel.now);
+        if (self->then) {
+            self->then(*self);
+        }
+    }
+
+    void start(uint32_t delay, uint32_t period = 0)
+    {
+        timer_wheel_start(&clock->wheel, &t, delay, period);
+    }
+};
+
+TEST_CASE("timer wheel one-shot timer expires once, at its delay", "[timer_wheel]")
+{
+    Clock c(1000);
+    Timer a(c), b(c);
+
+    a.start(5);
+    b.start(0);
+    CHECK(timer_wheel_armed(&a.t));
+    CHECK(c.wheel.count == 2);
+    c.step_to(1100);
+    CHECK(a.fired == std::vector<uint64_t>{1005});
+    CHECK(b.fired == std::vector<uint64_t>{1001});
+    CHECK_FALSE(timer_wheel_armed(&a.t));
+    CHECK(c.wheel.count == 0);
+}
+
+TEST_CASE("timer wheel periodic timer keeps its period", "[timer_wheel]")
+{
+    Clock ticks, jumps;
+    Timer a(ticks), b(jumps);
+
+    a.start(3, 7);
+    b.start(3, 7);
+    ticks.step_to(40);
+    jumps.sleep_to(40);
+    CHECK(a.fired == std::vector<uint64_t>({3, 10, 17, 24, 31, 38}));
+    CHECK(b.fired == a.fired);
+    CHECK(timer_wheel_armed(&a.t));
+
+    // One jump over several periods runs every one of them, in order
+    Clock late;
+    Timer c(late);
+    c.start(100, 100);
+    CHECK(timer_wheel_advance(&late.wheel, 450) == 4);
+    CHECK(c.fired == std::vector<uint64_t>({100, 200, 300, 400}));
+}
+
+TEST_CASE("timer wheel stop and restart", "[timer_wheel]")
+{
+    Clock c;
+    Timer a(c), b(c);
+
+    a.start(10);
+    b.start(10, 10);
+    c.step_to(5);
+    CHECK(timer_wheel_stop(&c.wheel, &a.t));
+    CHECK_FALSE(timer_wheel_stop(&c.wheel, &a.t));
+    CHECK(c.wheel.count == 1);
+
+    // Started again before it expires: moved, not armed twice
+    b.start(20);
+    b.start(30);
+    CHECK(c.wheel.count == 1);
+    c.step_to(100);
+    CHECK(a.fired.empty());
+    CHECK(b.fired == std::vector<uint64_t>{35});
+    CHECK(c.wheel.count == 0);
+    CHECK(timer_wheel_next(&c.wheel) == TIMER_WHEEL_NEVER);
+}
+
+TEST_CASE("timer wheel callbacks start and stop timers", "[timer_wheel]")
+{
+    Clock c;
+    Timer self(c);
+
+    // Restarts itself with a growing delay, as a retry would
+    self.then = [](Timer& t) {
+        if (t.fired.size() < 4) {
+            t.start(10 << t.fired.size());
+        }
+    };
+    self.start(10);
+    c.sleep_to(1000);
+    CHECK(self.fired == std::vector<uint64_t>({10, 30, 70, 150}));
+
+    // Stops a timer due in the same tick, and stops a periodic timer: itself
+    Clock d;
+    Timer first(d), second(d), periodic(d);
+    first.then = [&](Timer&) { timer_wheel_stop(&d.wheel, &second.t); };
+    periodic.then = [&](Timer& t) {
+        if (t.fired.size() == 2) {
+            timer_wheel_stop(&d.wheel, &t.t);
+        }
+    };
+    // Linked last, run first
+    second.start(50);
+    first.start(50);
+    periodic.start(5, 5);
+    d.sleep_to(1000);
+    CHECK(first.fired == std::vector<uint64_t>{50});
+    CHECK(second.fired.empty());
+    CHECK(periodic.fired == std::vector<uint64_t>({5, 10}));
+    CHECK(d.wheel.count == 0);
+}
+
+TEST_CASE("timer wheel long delays cascade down to the tick", "[timer_wheel]")
+{
+    std::mt19937 rng(50);
+    // Across every level, and from a clock that is not aligned to any of them
+    Clock c(0x123456789ULL);
+    std::vector<Timer*> timers;
+    std::vector<uint64_t> due;
+    const uint32_t delays[] = { 1, 63, 64, 65, 4095, 4096, 4097, 262144, 16777215, 16777216, 0x40000000, 0xffffffff };
+
+    for (uint32_t delay : delays) {
+        timers.push_back(new Timer(c));
+        timers.back()->start(delay);
+        due.push_back(c.wheel.now + delay);
+    }
+    for (int n = 0; n < 2000; ++n) {
+        uint32_t delay = rng() >> (rng() % 32);
+        timers.push_back(new Timer(c));
+        timers.back()->start(delay);
+        due.push_back(c.wheel.now + (delay ? delay : 1));
+    }
+    uint64_t end = c.wheel.now + 0x100000000ULL;
+    c.sleep_to(end);
+
+    for (size_t n = 0; n < timers.size(); ++n) {
+        INFO("timer " << n << " due " << due[n]);
+        REQUIRE(timers[n]->fired.size() == 1);
+        CHECK(timers[n]->fired[0] == due[n]);
+        delete timers[n];
+    }
+    CHECK(c.wheel.count == 0);
+}
+
+TEST_CASE("timer wheel next event, and the clock wakes it saves", "[timer_wheel]")
+{
+    Clock c(10);
+    Timer a(c), b(c);
+
+    CHECK(timer_wheel_next(&c.wheel) == TIMER_WHEEL_NEVER);
+    a.start(20);
+    CHECK(timer_wheel_next(&c.wheel) == 30);
+    b.start(5);
+    CHECK(timer_wheel_next(&c.wheel) == 15);
+    timer_wheel_stop(&c.wheel, &b.t);
+    CHECK(timer_wheel_next(&c.wheel) == 30);
+
+    // Past the first level the next event may be a cascade, never later than the expiry
+    a.start(100000);
+    uint64_t next = timer_wheel_next(&c.wheel);
+    CHECK(next > c.wheel.now);
+    CHECK(next <= 100010);
+
+    // An hour away: one wake per level at most, not one per tick
+    c.wakes = 0;
+    c.sleep_to(200000);
+    CHECK(a.fired == std::vector<uint64_t>{100010});
+    CHECK(c.wakes <= TIMER_WHEEL_LEVELS);
+
+    // A clock that goes back is left alone
+    CHECK(timer_wheel_advance(&c.wheel, 100) == 0);
+    CHECK(c.wheel.now == 200000);
+}
+
+/* The usual alternative: one list of the armed timers, kept sorted by expiry */
+struct SortedList {
+    struct Node {
+        Node* prev;
+        Node* next;
+        uint64_t expires;
+        bool armed;
+    };
+    Node head;
+    uint64_t now = 0;
+
+    SortedList()
+    {
+        head.prev = head.next = &head;
+    }
+
+    void stop(Node* n)
+    {
+        if (n->armed) {
+            n->prev->next = n->next;
+            n->next->prev = n->prev;
+            n->armed = false;
+        }
+    }
+
+    void start(Node* n, uint32_t delay)
+    {
+        stop(n);
+        n->expires = now + delay;
+        Node* at = head.next;
+        while (at != &head && at->expires <= n->expires) {
+            at = at->next;
+        }
+        n->next = at;
+        n->prev = at->prev;
+        at->prev->next = n;
+        at->prev = n;
+        n->armed = true;
+    }
+
+    template <typename F> void advance(uint64_t to, F expired)
+    {
+        now = to;
+        while (head.next != &head && head.next->expires <= now) {
+            Node* n = head.next;
+            stop(n);
+            expired(n);
+        }
+    }
+};
+
+static const uint32_t BENCH_MAX_DELAY = 30000;
+
+/* Delay an expired timer is started again with: of the timer and the tick, whatever order the timers of a tick run in */
+static uint32_t bench_redelay(size_t timer, uint64_t tick)
+{
+    return 1 + (timer * 7919 + tick * 104729) % BENCH_MAX_DELAY;
+}
+
+TEST_CASE("timer wheel with 10k active timers, against a sorted list", "[timer_wheel][bench]")
+{
+    using clock = std::chrono::steady_clock;
+    const size_t TIMERS = 10000;
+    const uint32_t TICKS = 20000;
+    const size_t RESTARTS = 20;         // per tick, timeouts pushed back by traffic
+
+    // Same delays for both, drawn up front
+    std::mt19937 rng(10000);
+    std::vector<uint32_t> delays(TIMERS + TICKS * RESTARTS);
+    for (uint32_t& d : delays) {
+        d = 1 + rng() % BENCH_MAX_DELAY;
+    }
+    std::vector<uint32_t> picks(TICKS * RESTARTS);
+    for (uint32_t& p : picks) {
+        p = rng() % TIMERS;
+    }
+
+    // Wheel
+    Clock c;
+    std::vector<timer_wheel_timer_t> wheel_timers(TIMERS);
+    struct Ctx { timer_wheel_t* wheel; timer_wheel_timer_t* first; uint32_t fired; } ctx = { &c.wheel, &wheel_timers[0], 0 };
+    size_t d = 0;
+    auto w0 = clock::now();
+    for (timer_wheel_timer_t& t : wheel_timers) {
+        timer_wheel_timer_init(&t, [](timer_wheel_timer_t* t, void* arg) {
+            Ctx* ctx = static_cast<Ctx*>(arg);
+            ctx->fired++;
+            timer_wheel_start(ctx->wheel, t, bench_redelay(t - ctx->first, ctx->wheel->now), 0);
+        }, &ctx);
+        timer_wheel_start(&c.wheel, &t, delays[d++], 0);
+    }
+    auto w1 = clock::now();
+    size_t p = 0;
+    double wheel_restart = 0, wheel_advance = 0;
+    for (uint32_t tick = 1; tick <= TICKS; ++tick) {
+        auto t0 = clock::now();
+        for (size_t r = 0; r < RESTARTS; ++r) {
+            timer_wheel_start(&c.wheel, &wheel_timers[picks[p++]], delays[d++], 0);
+        }
+        auto t1 = clock::now();
+        timer_wheel_advance(&c.wheel, tick);
+        auto t2 = clock::now();
+        wheel_restart += std::chrono::duration<double, std::nano>(t1 - t0).count();
+        wheel_advance += std::chrono::duration<double, std::nano>(t2 - t1).count();
+    }
+    CHECK(c.wheel.count == TIMERS);
+
+    // Sorted list, same work
+    SortedList list;
+    std::vector<SortedList::Node> list_timers(TIMERS);
+    uint32_t list_fired = 0;
+    d = 0;
+    auto l0 = clock::now();
+    for (SortedList::Node& n : list_timers) {
+        n.armed = false;
+        list.start(&n, delays[d++]);
+    }
+    auto l1 = clock::now();
+    p = 0;
+    double list_restart = 0, list_advance = 0;
+    for (uint32_t tick = 1; tick <= TICKS; ++tick) {
+        auto t0 = clock::now();
+        for (size_t r = 0; r < RESTARTS; ++r) {
+            list.start(&list_timers[picks[p++]], delays[d++]);
+        }
+        auto t1 = clock::now();
+        list.advance(tick, [&](SortedList::Node* n) {
+            list_fired++;
+            list.start(n, bench_redelay(n - &list_timers[0], list.now));
+        });
+        auto t2 = clock::now();
+        list_restart += std::chrono::duration<double, std::nano>(t1 - t0).count();
+        list_advance += std::chrono::duration<double, std::nano>(t2 - t1).count();
+    }
+    // Same delays, same clock: the same expiries
+    CHECK(ctx.fired == list_fired);
+
+    const double restarts = TICKS * RESTARTS;
+    cout << TIMERS << " active timers, " << TICKS << " ticks, " << RESTARTS << " restarts per tick, "
+         << ctx.fired << " expiries, each restarted" << endl;
+    cout << std::fixed << std::setprecision(1);
+    cout << "  start, ns:   wheel " << std::chrono::duration<double, std::nano>(w1 - w0).count() / TIMERS
+         << ", sorted list " << std::chrono::duration<double, std::nano>(l1 - l0).count() / TIMERS << endl;
+    cout << "  restart, ns: wheel " << wheel_restart / restarts << ", sorted list " << list_restart / restarts << endl;
+    cout << "  tick, ns:    wheel " << wheel_advance / TICKS << ", sorted list " << list_advance / TICKS
+         << " (expiries and their restarts)" << endl;
+    CHECK(wheel_restart < list_restart);
+}
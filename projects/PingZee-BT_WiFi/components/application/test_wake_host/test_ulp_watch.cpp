@@ -0,0 +1,214 @@
+// Copyright 2015-2017 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "catch.hpp"
+#include "ulp_watch.h"
+#include "ulp_sim.h"
+#include "soc/soc.h"
+#include "soc/rtc_io_reg.h"
+#include <functional>
+#include <iomanip>
+#include <iostream>
+
+using std::cout;
+using std::endl;
+
+static const uint32_t LIS3DH_RTC_GPIO = 6;     // GPIO25
+static const uint32_t POLL_MS = 20;
+
+/* The ULP, started by its timer with INT1 at the level pin(poll) */
+struct Watch {
+    ulp_sim_t sim;
+    std::function<bool(uint32_t)> pin;
+    uint32_t poll = 0;          // since the start of the simulation, over re-arms
+    uint32_t max_steps = 0;     // of one run
+
+    Watch(const ulp_watch_config_t& config, std::function<bool(uint32_t)> pin_level) : pin(pin_level)
+    {
+        uint32_t* mem = ulp_sim_rtc_slow_mem();
+        REQUIRE(mem != NULL);
+        REQUIRE(ulp_watch_load(LIS3DH_RTC_GPIO) == ESP_OK);
+        ulp_sim_init(&sim, mem, ULP_SIM_RTC_SLOW_MEM_WORDS);
+        sim.read_reg = read_reg;
+        sim.ctx = this;
+        ulp_watch_arm(&config);
+    }
+
+    static uint32_t read_reg(void* ctx, uint32_t reg)
+    {
+        Watch* w = static_cast<Watch*>(ctx);
+        return reg == RTC_GPIO_IN_REG && w->pin(w->poll) ? 1u << (RTC_GPIO_IN_NEXT_S + LIS3DH_RTC_GPIO) : 0;
+    }
+
+    /* Runs until the ULP wakes the CPUs, at most 'polls' times */
+    ulp_watch_result_t run(uint32_t polls)
+    {
+        ulp_watch_result_t result;
+        for (uint32_t n = 0; n < polls && sim.timer_en; ++n, ++poll) {
+            uint32_t steps = sim.steps;
+            REQUIRE(ulp_sim_run(&sim, ULP_WATCH_ENTRY, 1000) == ULP_SIM_HALT);
+            max_steps = std::max(max_steps, sim.steps - steps);
+        }
+        ulp_watch_read(&result);
+        return result;
+    }
+
+    /* What the CPUs do before they sleep again */
+    void rearm(const ulp_watch_config_t& config)
+    {
+        ulp_watch_arm(&config);
+        sim.timer_en = 1;
+    }
+};
+
+TEST_CASE("ulp watch polls a quiet pin until the budget runs out", "[ulp_watch]")
+{
+    const ulp_watch_config_t config = { 3, 50, 100 };
+    Watch w(config, [](uint32_t) { return false; });
+
+    ulp_watch_result_t r = w.run(1000);
+    CHECK(r.reason == ULP_WATCH_BUDGET);
+    CHECK(r.polls == 100);
+    CHECK(r.edges == 0);
+    CHECK(r.active == 0);
+    CHECK(w.sim.wakeups == 1);
+    CHECK(w.sim.timer_en == 0);
+}
+
+TEST_CASE("ulp watch wakes on the edge limit", "[ulp_watch]")
+{
+    const ulp_watch_config_t config = { 3, 50, 1000 };
+    // One poll high every 10, from poll 5
+    Watch w(config, [](uint32_t poll) { return poll % 10 == 5; });
+
+    ulp_watch_result_t r = w.run(1000);
+    CHECK(r.reason == ULP_WATCH_EDGES_HIT);
+    CHECK(r.edges == 3);
+    CHECK(r.active == 3);
+    CHECK(r.polls == 26);
+    CHECK(w.sim.wakeups == 1);
+}
+
+TEST_CASE("ulp watch counts a held pin as one edge", "[ulp_watch]")
+{
+    const ulp_watch_config_t config = { 3, 50, 1000 };
+    Watch w(config, [](uint32_t poll) { return poll >= 10; });
+
+    ulp_watch_result_t r = w.run(1000);
+    CHECK(r.reason == ULP_WATCH_ACTIVE_HIT);
+    CHECK(r.edges == 1);
+    CHECK(r.active == 50);
+    CHECK(r.polls == 60);
+}
+
+TEST_CASE("ulp watch limits of 0 are never reached", "[ulp_watch]")
+{
+    const ulp_watch_config_t config = { 0, 0, 200 };
+    Watch w(config, [](uint32_t poll) { return poll % 4 == 0; });
+
+    ulp_watch_result_t r = w.run(1000);
+    CHECK(r.reason == ULP_WATCH_BUDGET);
+    CHECK(r.edges == 50);
+    CHECK(r.active == 50);
+
+    // No limit at all: the ULP never wakes the CPUs
+    const ulp_watch_config_t none = { 0, 0, 0 };
+    w.rearm(none);
+    r = w.run(5000);
+    CHECK(r.reason == ULP_WATCH_NONE);
+    CHECK(r.polls == 5000);
+    CHECK(w.sim.wakeups == 1);
+}
+
+TEST_CASE("ulp watch does nothing more once it woke the CPUs", "[ulp_watch]")
+{
+    const ulp_watch_config_t config = { 1, 0, 1000 };
+    Watch w(config, [](uint32_t poll) { return poll % 2 == 1; });
+
+    ulp_watch_result_t r = w.run(1000);
+    REQUIRE(r.reason == ULP_WATCH_EDGES_HIT);
+    REQUIRE(r.polls == 2);
+
+    // Started again anyway, as the timer would before I_END
+    w.sim.timer_en = 1;
+    r = w.run(10);
+    CHECK(r.reason == ULP_WATCH_EDGES_HIT);
+    CHECK(r.polls == 2);
+    CHECK(r.edges == 1);
+    CHECK(w.sim.wakeups == 1);
+
+    // ... until it is armed again
+    w.rearm(config);
+    r = w.run(1000);
+    CHECK(r.reason == ULP_WATCH_EDGES_HIT);
+    CHECK(w.sim.wakeups == 2);
+}
+
+TEST_CASE("ulp watch poll limits", "[ulp_watch]")
+{
+    CHECK(ulp_watch_polls(600000, 20) == 30000);
+    CHECK(ulp_watch_polls(1001, 20) == 51);
+    CHECK(ulp_watch_polls(0, 20) == 0);
+    CHECK(ulp_watch_polls(3600000, 20) == 0xffff);
+    CHECK(ulp_watch_polls(1000, 0) == 0);
+}
+
+TEST_CASE("CPU wakes of an hour, ULP watch against timer and EXT1", "[ulp_watch][bench]")
+{
+    const uint32_t hour = ulp_watch_polls(3600 * 1000, POLL_MS);
+    const ulp_watch_config_t config = { 3, ulp_watch_polls(1000, POLL_MS), ulp_watch_polls(600 * 1000, POLL_MS) };
+    // A bump every 7 minutes, and a 30 s walk at the half hour: INT1 up for 2 polls of every 25
+    const uint32_t bump = ulp_watch_polls(7 * 60 * 1000, POLL_MS);
+    const uint32_t walk_from = hour / 2, walk_to = walk_from + ulp_watch_polls(30 * 1000, POLL_MS);
+    auto pin = [=](uint32_t poll) {
+        if (poll >= walk_from && poll < walk_to) {
+            return (poll - walk_from) % 25 < 2;
+        }
+        return poll % bump == bump - 1;
+    };
+    // A motion wake brings up the radios and listens, about 3 s, see test_wake_plan.cpp; the ULP is stopped meanwhile
+    const uint32_t awake = ulp_watch_polls(3000, POLL_MS);
+    Watch w(config, pin);
+    uint32_t wakes[ULP_WATCH_BUDGET + 1] = {};
+
+    while (w.poll < hour) {
+        ulp_watch_result_t r = w.run(hour - w.poll);
+        if (r.reason != ULP_WATCH_NONE) {
+            wakes[r.reason]++;
+            if (r.reason != ULP_WATCH_BUDGET) {
+                w.poll += awake;
+            }
+            w.rearm(config);
+        }
+    }
+
+    // Before: a timer wake every 60 s, and each rise of INT1 woke the CPUs by EXT1, unless they were up
+    uint32_t old_timer = 3600 / 60, old_ext1 = 0;
+    for (uint32_t poll = 1, up_until = 0; poll < hour; ++poll) {
+        if (pin(poll) && !pin(poll - 1) && poll >= up_until) {
+            old_ext1++;
+            up_until = poll + awake;
+        }
+    }
+    uint32_t ulp_wakes = wakes[ULP_WATCH_EDGES_HIT] + wakes[ULP_WATCH_ACTIVE_HIT] + wakes[ULP_WATCH_BUDGET];
+
+    cout << "ULP watch, " << POLL_MS << " ms polls, wake at " << config.edges << " edges, "
+         << config.active << " active polls or " << config.polls << " polls" << endl;
+    cout << "  ULP instructions per poll, at most: " << w.max_steps
+         << ", mean: " << std::fixed << std::setprecision(1) << (double)w.sim.steps / w.poll << endl;
+    cout << "  CPU wakes in an hour: " << ulp_wakes << " (" << wakes[ULP_WATCH_EDGES_HIT] << " edges, "
+         << wakes[ULP_WATCH_ACTIVE_HIT] << " active, " << wakes[ULP_WATCH_BUDGET] << " budget)"
+         << ", was " << old_timer + old_ext1 << " (" << old_timer << " timer, " << old_ext1 << " EXT1)" << endl;
+    CHECK(wakes[ULP_WATCH_EDGES_HIT] + wakes[ULP_WATCH_ACTIVE_HIT] >= 1);
+    CHECK(ulp_wakes < (old_timer + old_ext1) / 4);
+}
@@ -0,0 +1,358 @@
+// Copyright 2015-2017 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "catch.hpp"
+#include "wake_plan.h"
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <map>
+
+using std::cout;
+using std::endl;
+
+static const wake_plan_config_t config = { 200, 2000, 10 };
+
+/* Bring-up costs of one wake, in ms. Rough figures for an ESP32 at 160 MHz;
+   only the relation between the old and the new sequence matters here. */
+struct Costs {
+    uint32_t boot = 300;    // ROM, bootloader, image load, tasks started
+    uint32_t nvs = 40;      // nvs_flash_init
+    uint32_t wifi = 250;    // tcpip_adapter_init .. esp_wifi_start
+    uint32_t bt = 650;      // controller, bluedroid, BLUFI profile
+};
+
+/* Assumed supply current in mA */
+static const double cpu_ma = 40, radio_ma = 130, sleep_ma = 0.15;
+
+struct Wake {
+    wake_tier_t tier;
+    uint32_t awake_ms;      // reset to deep sleep
+    uint32_t radio_ms;      // first radio started to deep sleep
+};
+
+/* Runs one wake through the plan the way app.c drives it: the radios start
+   on their own tasks after a shared nvs_flash_init in the app task, and a
+   single timer serves both windows. 'motion' is what the sensor window sees;
+   the listen window is always quiet. */
+static Wake simulate(wake_rtc_t& rtc, wake_cause_t cause, bool motion, const Costs& c = Costs())
+{
+    wake_plan_t plan;
+    std::multimap<uint32_t, wake_event_t> pending;
+    const uint32_t none = UINT32_MAX;
+    uint32_t t = c.boot, window_at = none, radio_at = none;
+    wake_event_t window_event = WAKE_EV_WINDOW_QUIET;
+    bool nvs = false;
+
+    uint32_t actions = wake_plan_begin(&plan, &config, &rtc, cause);
+    for (;;) {
+        if (actions & (WAKE_DO_START_BT | WAKE_DO_START_WIFI)) {
+            if (!nvs) {
+                t += c.nvs;
+                nvs = true;
+                radio_at = t;
+            }
+            if (actions & WAKE_DO_START_BT) {
+                pending.insert(std::make_pair(t + c.bt, WAKE_EV_BT_UP));
+            }
+            if (actions & WAKE_DO_START_WIFI) {
+                pending.insert(std::make_pair(t + c.wifi, WAKE_EV_WIFI_UP));
+            }
+        }
+        if (actions & WAKE_DO_WINDOW) {
+            window_at = t + plan.window_ms;
+            bool busy = plan.state == WAKE_STATE_SENSING && motion;
+            window_event = busy ? WAKE_EV_WINDOW_BUSY : WAKE_EV_WINDOW_QUIET;
+        }
+        if (actions & WAKE_DO_SLEEP) {
+            break;
+        }
+        REQUIRE(plan.state != WAKE_STATE_AWAKE);
+        wake_event_t ev;
+        if (!pending.empty() && pending.begin()->first <= window_at) {
+            t = pending.begin()->first;
+            ev = pending.begin()->second;
+            pending.erase(pending.begin());
+        } else {
+            REQUIRE(window_at != none);
+            t = window_at;
+            ev = window_event;
+            window_at = none;
+        }
+        actions = wake_plan_step(&plan, ev);
+    }
+    Wake w = { plan.tier, t, radio_at == none ? 0 : t - radio_at };
+    return w;
+}
+
+/* What app_main did before: everything up on every wake, the window after BT */
+static Wake simulate_old(const Costs& c = Costs())
+{
+    Wake w = { WAKE_TIER_FULL, c.boot + c.nvs + c.wifi + c.bt + config.listen_ms, c.wifi + c.bt + config.listen_ms };
+    return w;
+}
+
+static double mean_ma(const Wake& w)
+{
+    double charge = (w.awake_ms - w.radio_ms) * cpu_ma + w.radio_ms * radio_ma + 60000 * sleep_ma;
+    return charge / (60000 + w.awake_ms);
+}
+
+TEST_CASE("the wake cause picks the radios", "[wake]")
+{
+    wake_rtc_t rtc = {};
+    wake_plan_t plan;
+
+    CHECK(wake_plan_begin(&plan, &config, &rtc, WAKE_CAUSE_POWER_ON) == (WAKE_DO_START_BT | WAKE_DO_START_WIFI | WAKE_DO_WINDOW));
+    CHECK(plan.tier == WAKE_TIER_FULL);
+    CHECK(plan.window_ms == config.sensor_ms);
+
+    CHECK(wake_plan_begin(&plan, &config, &rtc, WAKE_CAUSE_MOTION) == (WAKE_DO_START_BT | WAKE_DO_START_WIFI | WAKE_DO_WINDOW));
+    CHECK(plan.tier == WAKE_TIER_FULL);
+
+    CHECK(wake_plan_begin(&plan, &config, &rtc, WAKE_CAUSE_TIMER) == WAKE_DO_WINDOW);
+    CHECK(plan.tier == WAKE_TIER_SENSORS);
+    CHECK(plan.state == WAKE_STATE_SENSING);
+    CHECK(plan.window_ms == config.sensor_ms);
+}
+
+TEST_CASE("a quiet timer wake sleeps after the sensor window", "[wake]")
+{
+    wake_rtc_t rtc = {};
+    wake_plan_t plan;
+
+    wake_plan_begin(&plan, &config, &rtc, WAKE_CAUSE_TIMER);
+    CHECK(wake_plan_step(&plan, WAKE_EV_WINDOW_QUIET) == WAKE_DO_SLEEP);
+    CHECK(plan.state == WAKE_STATE_SLEEP);
+    CHECK(plan.started == 0);
+    CHECK(rtc.quiet_wakes == 1);
+    CHECK(rtc.wakes[WAKE_TIER_SENSORS] == 1);
+
+    /* Nothing moves it once it is done */
+    CHECK(wake_plan_step(&plan, WAKE_EV_PEER) == 0);
+    CHECK(wake_plan_step(&plan, WAKE_EV_WINDOW_BUSY) == 0);
+    CHECK(plan.state == WAKE_STATE_SLEEP);
+}
+
+TEST_CASE("BT comes up on every heartbeat timer wake", "[wake]")
+{
+    wake_rtc_t rtc = {};
+    wake_plan_t plan;
+
+    for (int i = 1; i <= 3 * config.heartbeat; ++i) {
+        uint32_t actions = wake_plan_begin(&plan, &config, &rtc, WAKE_CAUSE_TIMER);
+        if (i % config.heartbeat == 0) {
+            CHECK(plan.tier == WAKE_TIER_BT);
+            CHECK(actions == (WAKE_DO_START_BT | WAKE_DO_WINDOW));
+            CHECK(wake_plan_step(&plan, WAKE_EV_WINDOW_QUIET) == 0);
+            CHECK(wake_plan_step(&plan, WAKE_EV_BT_UP) == WAKE_DO_WINDOW);
+            CHECK(plan.window_ms == config.listen_ms);
+            CHECK(wake_plan_step(&plan, WAKE_EV_WINDOW_QUIET) == WAKE_DO_SLEEP);
+            CHECK(rtc.quiet_wakes == 0);
+        } else {
+            CHECK(plan.tier == WAKE_TIER_SENSORS);
+            CHECK(actions == WAKE_DO_WINDOW);
+            CHECK(wake_plan_step(&plan, WAKE_EV_WINDOW_QUIET) == WAKE_DO_SLEEP);
+        }
+    }
+    CHECK(rtc.wakes[WAKE_TIER_BT] == 3);
+    CHECK(rtc.wakes[WAKE_TIER_SENSORS] == 3 * (config.heartbeat - 1));
+
+    /* Without a heartbeat timer wakes never bring up a radio */
+    wake_plan_config_t never = config;
+    never.heartbeat = 0;
+    memset(&rtc, 0, sizeof(rtc));
+    for (int i = 0; i < 100; ++i) {
+        CHECK(wake_plan_begin(&plan, &never, &rtc, WAKE_CAUSE_TIMER) == WAKE_DO_WINDOW);
+        wake_plan_step(&plan, WAKE_EV_WINDOW_QUIET);
+    }
+    CHECK(rtc.quiet_wakes == 100);
+}
+
+TEST_CASE("motion in the sensor window brings up both radios", "[wake]")
+{
+    wake_rtc_t rtc = {};
+    wake_plan_t plan;
+
+    rtc.magic = WAKE_RTC_MAGIC;
+    rtc.quiet_wakes = 5;
+    wake_plan_begin(&plan, &config, &rtc, WAKE_CAUSE_TIMER);
+    CHECK(wake_plan_step(&plan, WAKE_EV_WINDOW_BUSY) == (WAKE_DO_START_BT | WAKE_DO_START_WIFI));
+    CHECK(plan.tier == WAKE_TIER_FULL);
+    CHECK(plan.state == WAKE_STATE_RADIOS);
+
+    /* The listen window waits for the last radio */
+    CHECK(wake_plan_step(&plan, WAKE_EV_WIFI_UP) == 0);
+    CHECK(plan.state == WAKE_STATE_RADIOS);
+    CHECK(wake_plan_step(&plan, WAKE_EV_BT_UP) == WAKE_DO_WINDOW);
+    CHECK(plan.state == WAKE_STATE_LISTENING);
+    CHECK(plan.window_ms == config.listen_ms);
+
+    CHECK(wake_plan_step(&plan, WAKE_EV_WINDOW_QUIET) == WAKE_DO_SLEEP);
+    CHECK(rtc.quiet_wakes == 0);
+    CHECK(rtc.wakes[WAKE_TIER_FULL] == 1);
+}
+
+TEST_CASE("radios that are up before the sensor window ends listen at once", "[wake]")
+{
+    wake_rtc_t rtc = {};
+    wake_plan_t plan;
+
+    wake_plan_begin(&plan, &config, &rtc, WAKE_CAUSE_MOTION);
+    CHECK(wake_plan_step(&plan, WAKE_EV_BT_UP) == 0);
+    CHECK(wake_plan_step(&plan, WAKE_EV_WIFI_UP) == 0);
+    CHECK(plan.state == WAKE_STATE_SENSING);
+    CHECK(wake_plan_step(&plan, WAKE_EV_WINDOW_QUIET) == WAKE_DO_WINDOW);
+    CHECK(plan.state == WAKE_STATE_LISTENING);
+}
+
+TEST_CASE("activity in the listen window keeps the board up", "[wake]")
+{
+    wake_rtc_t rtc = {};
+    wake_plan_t plan;
+
+    wake_plan_begin(&plan, &config, &rtc, WAKE_CAUSE_POWER_ON);
+    wake_plan_step(&plan, WAKE_EV_BT_UP);
+    wake_plan_step(&plan, WAKE_EV_WIFI_UP);
+    CHECK(wake_plan_step(&plan, WAKE_EV_WINDOW_QUIET) == WAKE_DO_WINDOW);
+    CHECK(wake_plan_step(&plan, WAKE_EV_WINDOW_BUSY) == 0);
+    CHECK(plan.state == WAKE_STATE_AWAKE);
+    CHECK(wake_plan_step(&plan, WAKE_EV_WINDOW_QUIET) == 0);
+    CHECK(plan.state == WAKE_STATE_AWAKE);
+
+    /* And so does a stop from the console, in any state */
+    wake_plan_begin(&plan, &config, &rtc, WAKE_CAUSE_TIMER);
+    CHECK(wake_plan_step(&plan, WAKE_EV_STAY) == 0);
+    CHECK(wake_plan_step(&plan, WAKE_EV_WINDOW_QUIET) == 0);
+    CHECK(plan.state == WAKE_STATE_AWAKE);
+}
+
+TEST_CASE("a phone connecting keeps the board up and gets Wi-Fi", "[wake]")
+{
+    wake_rtc_t rtc = {};
+    wake_plan_t plan;
+
+    rtc.magic = WAKE_RTC_MAGIC;
+    rtc.quiet_wakes = config.heartbeat - 1;
+    CHECK(wake_plan_begin(&plan, &config, &rtc, WAKE_CAUSE_TIMER) == (WAKE_DO_START_BT | WAKE_DO_WINDOW));
+    wake_plan_step(&plan, WAKE_EV_BT_UP);
+    CHECK(wake_plan_step(&plan, WAKE_EV_WINDOW_QUIET) == WAKE_DO_WINDOW);
+    CHECK(wake_plan_step(&plan, WAKE_EV_PEER) == WAKE_DO_START_WIFI);
+    CHECK(plan.tier == WAKE_TIER_FULL);
+    CHECK(plan.state == WAKE_STATE_AWAKE);
+
+    /* The listen window armed before does not end the wake */
+    CHECK(wake_plan_step(&plan, WAKE_EV_WINDOW_QUIET) == 0);
+    CHECK(wake_plan_step(&plan, WAKE_EV_WIFI_UP) == 0);
+    CHECK(plan.state == WAKE_STATE_AWAKE);
+    CHECK(plan.up == (WAKE_RADIO_BT | WAKE_RADIO_WIFI));
+
+    /* Nor does it matter how the board came to stay up */
+    rtc.quiet_wakes = 0;
+    wake_plan_begin(&plan, &config, &rtc, WAKE_CAUSE_TIMER);
+    wake_plan_step(&plan, WAKE_EV_STAY);
+    CHECK(wake_plan_step(&plan, WAKE_EV_PEER) == (WAKE_DO_START_BT | WAKE_DO_START_WIFI));
+    CHECK(wake_plan_step(&plan, WAKE_EV_PEER) == 0);
+}
+
+TEST_CASE("RTC state is only kept if it is valid", "[wake]")
+{
+    wake_rtc_t rtc;
+    wake_plan_t plan;
+
+    memset(&rtc, 0xA5, sizeof(rtc));
+    wake_plan_begin(&plan, &config, &rtc, WAKE_CAUSE_POWER_ON);
+    CHECK(rtc.magic == WAKE_RTC_MAGIC);
+    CHECK(rtc.quiet_wakes == 0);
+    for (int i = 0; i < WAKE_TIER_MAX; ++i) {
+        CHECK(rtc.wakes[i] == 0);
+    }
+
+    rtc.quiet_wakes = 7;
+    rtc.wakes[WAKE_TIER_SENSORS] = 42;
+    wake_plan_begin(&plan, &config, &rtc, WAKE_CAUSE_TIMER);
+    CHECK(rtc.quiet_wakes == 7);
+    CHECK(rtc.wakes[WAKE_TIER_SENSORS] == 42);
+}
+
+TEST_CASE("simulated wakes end in deep sleep", "[wake]")
+{
+    wake_rtc_t rtc = {};
+    Costs c;
+
+    Wake quiet = simulate(rtc, WAKE_CAUSE_TIMER, false);
+    CHECK(quiet.tier == WAKE_TIER_SENSORS);
+    CHECK(quiet.awake_ms == c.boot + config.sensor_ms);
+    CHECK(quiet.radio_ms == 0);
+
+    /* BT and Wi-Fi come up side by side, behind the sensor window */
+    Wake pin = simulate(rtc, WAKE_CAUSE_MOTION, false);
+    CHECK(pin.tier == WAKE_TIER_FULL);
+    CHECK(pin.awake_ms == c.boot + c.nvs + std::max(c.bt, c.wifi) + config.listen_ms);
+
+    Wake moved = simulate(rtc, WAKE_CAUSE_TIMER, true);
+    CHECK(moved.tier == WAKE_TIER_FULL);
+    CHECK(moved.awake_ms == c.boot + config.sensor_ms + c.nvs + std::max(c.bt, c.wifi) + config.listen_ms);
+
+    CHECK(pin.awake_ms < simulate_old().awake_ms);
+}
+
+TEST_CASE("awake time per wake cause", "[wake][bench]")
+{
+    struct Scenario {
+        const char* name;
+        wake_cause_t cause;
+        bool motion;
+        uint16_t quiet_wakes;
+    };
+    const Scenario scenarios[] = {
+        { "power on", WAKE_CAUSE_POWER_ON, false, 0 },
+        { "motion pin", WAKE_CAUSE_MOTION, false, 0 },
+        { "timer, quiet", WAKE_CAUSE_TIMER, false, 0 },
+        { "timer, heartbeat", WAKE_CAUSE_TIMER, false, (uint16_t)(config.heartbeat - 1) },
+        { "timer, motion", WAKE_CAUSE_TIMER, true, 0 },
+    };
+    static const char* const tiers[] = { "sensors", "BT", "BT+Wi-Fi" };
+    Wake old = simulate_old();
+
+    cout << "Wake pipeline, sensor window " << config.sensor_ms << " ms, listen window " << config.listen_ms
+         << " ms, heartbeat every " << config.heartbeat << " timer wakes" << endl;
+    cout << std::setw(18) << "wake" << std::setw(10) << "tier" << std::setw(10) << "awake ms"
+         << std::setw(10) << "radio ms" << std::setw(10) << "was ms" << std::setw(10) << "mean mA" << std::setw(10) << "was mA" << endl;
+    for (const Scenario& s : scenarios) {
+        wake_rtc_t rtc = {};
+        rtc.magic = WAKE_RTC_MAGIC;
+        rtc.quiet_wakes = s.quiet_wakes;
+        Wake w = simulate(rtc, s.cause, s.motion);
+        cout << std::setw(18) << s.name << std::setw(10) << tiers[w.tier] << std::setw(10) << w.awake_ms
+             << std::setw(10) << w.radio_ms << std::setw(10) << old.awake_ms
+             << std::setw(10) << std::fixed << std::setprecision(2) << mean_ma(w) << std::setw(10) << mean_ma(old) << endl;
+        CHECK(w.awake_ms < old.awake_ms);
+    }
+
+    /* A day of 60 s sleep cycles, the board moved on one timer wake in 30 */
+    const int cycles = 24 * 60;
+    wake_rtc_t rtc = {};
+    double awake = 0, radio = 0, charge = 0, period = 0;
+    for (int i = 0; i < cycles; ++i) {
+        Wake w = simulate(rtc, i == 0 ? WAKE_CAUSE_POWER_ON : WAKE_CAUSE_TIMER, i % 30 == 17);
+        awake += w.awake_ms;
+        radio += w.radio_ms;
+        charge += mean_ma(w) * (60000 + w.awake_ms);
+        period += 60000 + w.awake_ms;
+    }
+    cout << cycles << " cycles: " << std::setprecision(0) << awake / cycles << " ms awake per cycle ("
+         << radio / cycles << " ms radios on), was " << old.awake_ms << " ms; "
+         << std::setprecision(2) << charge / period << " mA mean, was " << mean_ma(old) << " mA" << endl;
+    CHECK(awake / cycles < old.awake_ms / 4);
+}
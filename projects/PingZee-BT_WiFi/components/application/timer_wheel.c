@@ -0,0 +1,188 @@
+/*
+ * timer_wheel.c
+ *
+ * \brief Hierarchical timing wheel: any number of one-shot and periodic timers on one clock.
+ *
+ */
+
+#include <stddef.h>
+#include "timer_wheel.h"
+
+#define TIMER_WHEEL_MASK			(TIMER_WHEEL_SLOTS - 1)
+#define TIMER_WHEEL_DETACHED		TIMER_WHEEL_LEVELS		// level of the timers timer_wheel_tick() is about to run
+
+/* Level and slot for 'timer', with the clock at 'ref' */
+static void timer_wheel_link(timer_wheel_t *wheel, timer_wheel_timer_t *timer, uint64_t ref)
+{
+	uint64_t delta = timer->expires - ref;
+	timer_wheel_timer_t **head;
+	uint8_t level = 0;
+
+	while (level < TIMER_WHEEL_LEVELS - 1 && delta >> (TIMER_WHEEL_BITS * (level + 1))) {
+		level++;
+	}
+	timer->level = level;
+	timer->slot = (timer->expires >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK;
+
+	head = &wheel->slot[level][timer->slot];
+	timer->next = *head;
+	if (*head != NULL) {
+		(*head)->pprev = &timer->next;
+	}
+	*head = timer;
+	timer->pprev = head;
+	wheel->pending[level] |= 1ULL << timer->slot;
+}
+
+static void timer_wheel_unlink(timer_wheel_t *wheel, timer_wheel_timer_t *timer)
+{
+	*timer->pprev = timer->next;
+	if (timer->next != NULL) {
+		timer->next->pprev = timer->pprev;
+	}
+	if (timer->level != TIMER_WHEEL_DETACHED && wheel->slot[timer->level][timer->slot] == NULL) {
+		wheel->pending[timer->level] &= ~(1ULL << timer->slot);
+	}
+	timer->next = NULL;
+	timer->pprev = NULL;
+}
+
+/* Take the whole list of a slot out of the wheel */
+static timer_wheel_timer_t *timer_wheel_take(timer_wheel_t *wheel, uint8_t level, uint8_t slot)
+{
+	timer_wheel_timer_t *list = wheel->slot[level][slot];
+
+	wheel->slot[level][slot] = NULL;
+	wheel->pending[level] &= ~(1ULL << slot);
+	return list;
+}
+
+/* Cascade and expire what is due at 'tick'; every tick before it had nothing to do */
+static uint32_t timer_wheel_tick(timer_wheel_t *wheel, uint64_t tick)
+{
+	timer_wheel_timer_t *list, *timer, *next;
+	uint32_t fired = 0;
+	int level;
+
+	// Top down, a timer cascaded from a level may go on down from the next one in this tick
+	for (level = TIMER_WHEEL_LEVELS - 1; level > 0; level--) {
+		if (tick & ((1ULL << (TIMER_WHEEL_BITS * level)) - 1)) {
+			continue;
+		}
+		for (timer = timer_wheel_take(wheel, level, (tick >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK); timer != NULL; timer = next) {
+			next = timer->next;
+			timer_wheel_link(wheel, timer, tick);
+		}
+	}
+
+	// Callbacks may stop and start any timer, so the due ones are run from a list of their own
+	list = timer_wheel_take(wheel, 0, tick & TIMER_WHEEL_MASK);
+	if (list != NULL) {
+		list->pprev = &list;
+	}
+	for (timer = list; timer != NULL; timer = timer->next) {
+		timer->level = TIMER_WHEEL_DETACHED;
+	}
+	wheel->now = tick;
+
+	while ((timer = list) != NULL) {
+		timer_wheel_unlink(wheel, timer);
+		if (timer->period) {
+			timer->expires += timer->period;
+			timer_wheel_link(wheel, timer, tick);
+		} else {
+			wheel->count--;
+		}
+		timer->cb(timer, timer->arg);
+		fired++;
+	}
+	return fired;
+}
+
+void timer_wheel_init(timer_wheel_t *wheel, uint64_t now)
+{
+	int level, slot;
+
+	wheel->now = now;
+	wheel->count = 0;
+	for (level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+		wheel->pending[level] = 0;
+		for (slot = 0; slot < TIMER_WHEEL_SLOTS; slot++) {
+			wheel->slot[level][slot] = NULL;
+		}
+	}
+}
+
+void timer_wheel_timer_init(timer_wheel_timer_t *timer, timer_wheel_cb_t cb, void *arg)
+{
+	timer->next = NULL;
+	timer->pprev = NULL;
+	timer->expires = 0;
+	timer->period = 0;
+	timer->level = 0;
+	timer->slot = 0;
+	timer->cb = cb;
+	timer->arg = arg;
+}
+
+void timer_wheel_start(timer_wheel_t *wheel, timer_wheel_timer_t *timer, uint32_t delay, uint32_t period)
+{
+	if (timer_wheel_armed(timer)) {
+		timer_wheel_unlink(wheel, timer);
+	} else {
+		wheel->count++;
+	}
+	timer->expires = wheel->now + (delay ? delay : 1);
+	timer->period = period;
+	timer_wheel_link(wheel, timer, wheel->now);
+}
+
+bool timer_wheel_stop(timer_wheel_t *wheel, timer_wheel_timer_t *timer)
+{
+	if (!timer_wheel_armed(timer)) {
+		return false;
+	}
+	timer_wheel_unlink(wheel, timer);
+	wheel->count--;
+	return true;
+}
+
+uint64_t timer_wheel_next(const timer_wheel_t *wheel)
+{
+	uint64_t next = TIMER_WHEEL_NEVER, block, busy, tick;
+	unsigned int level, first;
+
+	for (level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+		if (wheel->pending[level] == 0) {
+			continue;
+		}
+		// The slots of a level come up one block of its ticks after the other, from the block after now on
+		block = (wheel->now >> (TIMER_WHEEL_BITS * level)) + 1;
+		first = block & TIMER_WHEEL_MASK;
+		busy = wheel->pending[level];
+		if (first) {
+			busy = (busy >> first) | (busy << (TIMER_WHEEL_SLOTS - first));
+		}
+		tick = (block + __builtin_ctzll(busy)) << (TIMER_WHEEL_BITS * level);
+		if (tick < next) {
+			next = tick;
+		}
+	}
+	return next;
+}
+
+uint32_t timer_wheel_advance(timer_wheel_t *wheel, uint64_t now)
+{
+	uint32_t fired = 0;
+	uint64_t next;
+
+	while (wheel->now < now) {
+		next = timer_wheel_next(wheel);
+		if (next > now) {
+			wheel->now = now;
+			break;
+		}
+		fired += timer_wheel_tick(wheel, next);
+	}
+	return fired;
+}
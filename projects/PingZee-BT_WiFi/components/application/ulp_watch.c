@@ -0,0 +1,115 @@
+/*
+ * ulp_watch.c
+ *
+ * \brief ULP coprocessor program that watches the accelerometer pin in deep sleep.
+ *
+ */
+
+#include <assert.h>
+#include "soc/soc.h"
+#include "soc/rtc_cntl_reg.h"
+#include "soc/rtc_io_reg.h"
+#include "esp32/ulp.h"
+#include "ulp_watch.h"
+
+//! \name Labels of the program
+//@{
+#define LBL_CHECK_ACTIVE			1
+#define LBL_CHECK_POLLS				2
+#define LBL_CHECK_DONE				3
+#define LBL_COUNTED					4
+#define LBL_WAKE					5
+#define LBL_DONE					6
+//@}
+
+/*
+ * Wake with 'reason' if the count at data word 'count' reached its 'limit'.
+ * count - limit borrows while the count is below the limit; a limit of 0 is skipped.
+ */
+#define ULP_WATCH_CHECK(count, limit, reason, next) \
+	I_LD(R0, R3, count), \
+	I_LD(R1, R3, limit), \
+	I_ADDI(R1, R1, 0), \
+	M_BXZ(next), \
+	I_SUBR(R0, R0, R1), \
+	M_BXF(next), \
+	I_MOVI(R0, reason), \
+	M_BX(LBL_WAKE), \
+	M_LABEL(next)
+
+esp_err_t ulp_watch_load(uint32_t rtc_gpio_num)
+{
+	const uint32_t bit = RTC_GPIO_IN_NEXT_S + rtc_gpio_num;
+	const ulp_insn_t program[] = {
+		I_MOVI(R3, 0),						// data words
+		// Already woke the CPUs: nothing more until the watch is armed again
+		I_LD(R0, R3, ULP_WATCH_REASON),
+		M_BGE(LBL_DONE, 1),
+		I_LD(R1, R3, ULP_WATCH_POLLS),
+		I_ADDI(R1, R1, 1),
+		I_ST(R1, R3, ULP_WATCH_POLLS),
+		// R2: level at the last poll, R0: level now
+		I_LD(R2, R3, ULP_WATCH_LEVEL),
+		I_RD_REG(RTC_GPIO_IN_REG, bit, bit),
+		I_ST(R0, R3, ULP_WATCH_LEVEL),
+		M_BL(LBL_COUNTED, 1),
+		I_LD(R1, R3, ULP_WATCH_ACTIVE),
+		I_ADDI(R1, R1, 1),
+		I_ST(R1, R3, ULP_WATCH_ACTIVE),
+		I_MOVR(R0, R2),
+		M_BGE(LBL_COUNTED, 1),
+		I_LD(R1, R3, ULP_WATCH_EDGES),
+		I_ADDI(R1, R1, 1),
+		I_ST(R1, R3, ULP_WATCH_EDGES),
+		M_LABEL(LBL_COUNTED),
+		ULP_WATCH_CHECK(ULP_WATCH_EDGES, ULP_WATCH_EDGE_LIMIT, ULP_WATCH_EDGES_HIT, LBL_CHECK_ACTIVE),
+		ULP_WATCH_CHECK(ULP_WATCH_ACTIVE, ULP_WATCH_ACTIVE_LIMIT, ULP_WATCH_ACTIVE_HIT, LBL_CHECK_POLLS),
+		ULP_WATCH_CHECK(ULP_WATCH_POLLS, ULP_WATCH_POLL_LIMIT, ULP_WATCH_BUDGET, LBL_CHECK_DONE),
+		I_HALT(),
+		M_LABEL(LBL_WAKE),
+		I_ST(R0, R3, ULP_WATCH_REASON),
+		I_WAKE(),
+		I_END(),							// the CPUs start the timer again with the next watch
+		M_LABEL(LBL_DONE),
+		I_HALT(),
+	};
+	size_t size = sizeof(program) / sizeof(ulp_insn_t);
+
+	return ulp_process_macros_and_load(ULP_WATCH_ENTRY, program, &size);
+}
+
+void ulp_watch_arm(const ulp_watch_config_t *config)
+{
+	uint32_t *data = RTC_SLOW_MEM;
+
+	data[ULP_WATCH_LEVEL] = 0;
+	data[ULP_WATCH_POLLS] = 0;
+	data[ULP_WATCH_EDGES] = 0;
+	data[ULP_WATCH_ACTIVE] = 0;
+	data[ULP_WATCH_REASON] = ULP_WATCH_NONE;
+	data[ULP_WATCH_EDGE_LIMIT] = config->edges;
+	data[ULP_WATCH_ACTIVE_LIMIT] = config->active;
+	data[ULP_WATCH_POLL_LIMIT] = config->polls;
+}
+
+void ulp_watch_read(ulp_watch_result_t *result)
+{
+	const uint32_t *data = RTC_SLOW_MEM;
+	uint16_t reason = data[ULP_WATCH_REASON] & 0xffff;
+
+	result->reason = reason <= ULP_WATCH_BUDGET ? (ulp_watch_reason_t)reason : ULP_WATCH_NONE;
+	result->polls = data[ULP_WATCH_POLLS] & 0xffff;
+	result->edges = data[ULP_WATCH_EDGES] & 0xffff;
+	result->active = data[ULP_WATCH_ACTIVE] & 0xffff;
+}
+
+uint16_t ulp_watch_polls(uint32_t ms, uint32_t poll_ms)
+{
+	uint32_t polls;
+
+	if (poll_ms == 0) {
+		return 0;
+	}
+	polls = ms / poll_ms + (ms % poll_ms != 0);
+	return polls > 0xffff ? 0xffff : (uint16_t)polls;
+}
@@ -0,0 +1,119 @@
+/*
+ * wake_plan.c
+ *
+ * \brief Decides how much of the board one deep sleep wake brings up.
+ *
+ */
+
+#include <string.h>
+#include "wake_plan.h"
+
+/* Start the radios of the current tier that are not started yet */
+static uint32_t wake_plan_radios(wake_plan_t *plan)
+{
+	uint8_t want = 0, start;
+	uint32_t actions = 0;
+
+	if (plan->tier >= WAKE_TIER_BT)		want |= WAKE_RADIO_BT;
+	if (plan->tier >= WAKE_TIER_FULL)	want |= WAKE_RADIO_WIFI;
+	start = want & ~plan->started;
+	plan->started |= start;
+	if (start & WAKE_RADIO_BT)		actions |= WAKE_DO_START_BT;
+	if (start & WAKE_RADIO_WIFI)	actions |= WAKE_DO_START_WIFI;
+	return actions;
+}
+
+/* The listen window only starts once every started radio is up */
+static uint32_t wake_plan_listen(wake_plan_t *plan)
+{
+	if ((plan->up & plan->started) != plan->started) {
+		plan->state = WAKE_STATE_RADIOS;
+		return 0;
+	}
+	plan->state = WAKE_STATE_LISTENING;
+	plan->window_ms = plan->config.listen_ms;
+	return WAKE_DO_WINDOW;
+}
+
+static uint32_t wake_plan_sleep(wake_plan_t *plan)
+{
+	plan->state = WAKE_STATE_SLEEP;
+	plan->rtc->wakes[plan->tier]++;
+	if (plan->cause == WAKE_CAUSE_TIMER && plan->started == 0) {
+		plan->rtc->quiet_wakes++;
+	} else {
+		plan->rtc->quiet_wakes = 0;
+	}
+	return WAKE_DO_SLEEP;
+}
+
+uint32_t wake_plan_begin(wake_plan_t *plan, const wake_plan_config_t *config, wake_rtc_t *rtc, wake_cause_t cause)
+{
+	if (rtc->magic != WAKE_RTC_MAGIC) {
+		memset(rtc, 0, sizeof(*rtc));
+		rtc->magic = WAKE_RTC_MAGIC;
+	}
+	memset(plan, 0, sizeof(*plan));
+	plan->config = *config;
+	plan->rtc = rtc;
+	plan->cause = cause;
+
+	if (cause != WAKE_CAUSE_TIMER) {
+		plan->tier = WAKE_TIER_FULL;
+	} else if (config->heartbeat && rtc->quiet_wakes + 1 >= config->heartbeat) {
+		plan->tier = WAKE_TIER_BT;
+	} else {
+		plan->tier = WAKE_TIER_SENSORS;
+	}
+
+	plan->state = WAKE_STATE_SENSING;
+	plan->window_ms = config->sensor_ms;
+	return wake_plan_radios(plan) | WAKE_DO_WINDOW;
+}
+
+uint32_t wake_plan_step(wake_plan_t *plan, wake_event_t event)
+{
+	uint32_t actions = 0;
+
+	if (plan->state == WAKE_STATE_SLEEP) {
+		return 0;
+	}
+
+	switch (event) {
+	case WAKE_EV_WINDOW_QUIET:
+	case WAKE_EV_WINDOW_BUSY:
+		if (plan->state == WAKE_STATE_SENSING) {
+			if (event == WAKE_EV_WINDOW_BUSY) {
+				plan->tier = WAKE_TIER_FULL;
+				actions = wake_plan_radios(plan);
+			}
+			if (plan->tier == WAKE_TIER_SENSORS) {
+				return wake_plan_sleep(plan);
+			}
+			return actions | wake_plan_listen(plan);
+		}
+		if (plan->state == WAKE_STATE_LISTENING) {
+			if (event == WAKE_EV_WINDOW_QUIET) {
+				return wake_plan_sleep(plan);
+			}
+			plan->state = WAKE_STATE_AWAKE;
+		}
+		break;
+	case WAKE_EV_BT_UP:
+	case WAKE_EV_WIFI_UP:
+		plan->up |= (event == WAKE_EV_BT_UP) ? WAKE_RADIO_BT : WAKE_RADIO_WIFI;
+		if (plan->state == WAKE_STATE_RADIOS) {
+			return wake_plan_listen(plan);
+		}
+		break;
+	case WAKE_EV_PEER:
+		//The phone will want Wi-Fi, if only to provision it, and stays in charge
+		plan->tier = WAKE_TIER_FULL;
+		plan->state = WAKE_STATE_AWAKE;
+		return wake_plan_radios(plan);
+	case WAKE_EV_STAY:
+		plan->state = WAKE_STATE_AWAKE;
+		break;
+	}
+	return actions;
+}
@@ -0,0 +1,99 @@
+/*
+ * lis3dh_fifo.h
+ *
+ * \brief LIS3DH hardware FIFO: setup and burst draining.
+ *
+ *  The FIFO holds up to 32 X/Y/Z samples. When it is enabled, the address of
+ *  an auto-increment read wraps from OUT_Z_H back to OUT_X_L, so everything
+ *  it holds comes out with a single register region read.
+ *
+ *  Register access goes through the functions given in lis3dh_bus_t, so the
+ *  code here does not depend on the I2C task and runs against a register
+ *  model on the host.
+ */
+
+#ifndef COMPONENTS_BUS_I2C_INCLUDE_LIS3DH_FIFO_H_
+#define COMPONENTS_BUS_I2C_INCLUDE_LIS3DH_FIFO_H_
+
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LIS3DH_FIFO_DEPTH			32
+
+//! \name FIFO_CTRL_REG FM[1:0], lis3dh_settings::fifoMode
+//@{
+#define LIS3DH_FIFO_MODE_BYPASS		0x00
+#define LIS3DH_FIFO_MODE_FIFO		0x01	// stops collecting when full
+#define LIS3DH_FIFO_MODE_STREAM		0x02	// keeps the newest 32 samples
+#define LIS3DH_FIFO_MODE_TRIGGER	0x03
+//@}
+
+//! \name Register bits used for the FIFO
+//@{
+#define LIS3DH_CTRL_REG3_I1_WTM		0x04	// watermark interrupt on INT1
+#define LIS3DH_CTRL_REG5_FIFO_EN	0x40
+#define LIS3DH_FIFO_SRC_WTM			0x80
+#define LIS3DH_FIFO_SRC_OVRN		0x40	// FIFO full; FSS no longer counts
+#define LIS3DH_FIFO_SRC_EMPTY		0x20
+#define LIS3DH_FIFO_SRC_FSS_MASK	0x1F
+//@}
+
+/*
+ * One sample as found in the output registers: left-justified two's
+ * complement, so each axis is a Q15 fraction of the full scale
+ * (lis3dh_settings::accelRange g).
+ */
+typedef struct {
+	int16_t x;
+	int16_t y;
+	int16_t z;
+} lis3dh_sample_t;
+
+typedef struct {
+	//! Read 'length' registers from 'offset' on, with auto-increment
+	esp_err_t (*read)(uint8_t *outputPointer, uint8_t offset, uint8_t length);
+	//! Write one register
+	esp_err_t (*write)(uint8_t offset, uint8_t dataToWrite);
+} lis3dh_bus_t;
+
+typedef struct {
+	const lis3dh_bus_t *bus;
+	uint32_t drains;		// lis3dh_fifo_drain() calls that read samples
+	uint32_t samples;		// samples read
+	uint32_t overruns;		// drains that found the FIFO full, older samples may be lost
+} lis3dh_fifo_t;
+
+/**
+ * \brief Empty the FIFO and start collecting in 'mode'
+ *
+ * The FIFO is reset through bypass mode first. The watermark interrupt is
+ * routed to INT1; the other INT1 sources in CTRL_REG3 are kept.
+ *
+ * \param watermark FIFO level (0 to 31) that raises the watermark interrupt
+ */
+esp_err_t lis3dh_fifo_start(lis3dh_fifo_t *fifo, uint8_t mode, uint8_t watermark);
+
+/**
+ * \brief Return to bypass mode and remove the watermark interrupt from INT1
+ */
+esp_err_t lis3dh_fifo_stop(lis3dh_fifo_t *fifo);
+
+/**
+ * \brief Read every sample in the FIFO, oldest first
+ *
+ * Costs two register reads: FIFO_SRC_REG, then one burst of all samples.
+ *
+ * \param samples room for LIS3DH_FIFO_DEPTH samples
+ * \retval number of samples read, or -1 if the bus failed
+ */
+int lis3dh_fifo_drain(lis3dh_fifo_t *fifo, lis3dh_sample_t *samples);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* COMPONENTS_BUS_I2C_INCLUDE_LIS3DH_FIFO_H_ */
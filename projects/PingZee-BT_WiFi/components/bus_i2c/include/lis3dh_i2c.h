@@ -0,0 +1,32 @@
+/*
+ * lis3dh_i2c.h
+ *
+ * \brief LIS3DH register access through the I2C0 task.
+ *
+ *  Each call takes the bus, runs one message and gives the bus back. A
+ *  message the I2C task reports as failed (no ACK, a hung bus, no result in
+ *  time) comes back as ESP_FAIL; the output buffer is then left unspecified.
+ */
+
+#ifndef COMPONENTS_BUS_I2C_INCLUDE_LIS3DH_I2C_H_
+#define COMPONENTS_BUS_I2C_INCLUDE_LIS3DH_I2C_H_
+
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//! Read one register
+esp_err_t Lis3dh_readRegister(uint8_t *outputPointer, uint8_t offset);
+//! Write one register
+esp_err_t Lis3dh_writeRegister(uint8_t offset, uint8_t dataToWrite);
+//! Read 'length' registers from 'offset' on, with auto-increment; fits lis3dh_bus_t::read
+esp_err_t Lis3dh_readRegisterRegion(uint8_t *outputPointer, uint8_t offset, uint8_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* COMPONENTS_BUS_I2C_INCLUDE_LIS3DH_I2C_H_ */
@@ -0,0 +1,101 @@
+/*
+ * lis3dh_motion.h
+ *
+ * \brief Fixed-point conversion of LIS3DH samples and motion features.
+ *
+ *  Works on whole FIFO batches with integer arithmetic only: the raw samples
+ *  are scaled to milli-g with a Q16 factor, then reduced to a few features
+ *  (magnitude, per-axis min/max/mean/RMS, steps and taps) that are enough to
+ *  decide whether the board was moved, without any float work.
+ *
+ *  Kept free of any hardware or RTOS dependency.
+ */
+
+#ifndef COMPONENTS_BUS_I2C_INCLUDE_LIS3DH_MOTION_H_
+#define COMPONENTS_BUS_I2C_INCLUDE_LIS3DH_MOTION_H_
+
+#include <stdint.h>
+#include "lis3dh_fifo.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LIS3DH_MOTION_1G_MG			1000
+
+typedef struct {
+	int16_t min[3];			// X/Y/Z, mg
+	int16_t max[3];
+	int16_t mean[3];
+	uint16_t rms[3];		// RMS about the mean, mg
+	uint16_t mag_min;		// |a|, mg
+	uint16_t mag_max;
+	uint16_t mag_mean;
+	uint16_t mag_rms;		// RMS of |a| about its mean, mg
+	uint8_t steps;			// steps detected in the batch
+	uint8_t taps;			// taps detected in the batch
+	uint8_t active;			// the batch shows motion
+} lis3dh_features_t;
+
+typedef struct {
+	int32_t scale;			// mg per LSB, Q16
+	//! \name Detection thresholds, set by lis3dh_motion_init()
+	//@{
+	uint16_t step_mg;		// |a| above 1 g that counts as a step peak
+	uint16_t step_gap;		// minimum samples between two steps
+	uint16_t tap_mg;		// |a| change between two samples that counts as a tap
+	uint16_t tap_gap;		// minimum samples between two taps
+	uint16_t active_mg;		// lis3dh_features_t::mag_rms that counts as motion
+	//@}
+	//! \name Detector state, carried from one batch to the next
+	//@{
+	uint16_t last_mag;
+	uint8_t step_armed;		// |a| went back below 1 g since the last step
+	uint32_t since_step;
+	uint32_t since_tap;
+	uint32_t steps;			// totals since lis3dh_motion_init()
+	uint32_t taps;
+	//@}
+} lis3dh_motion_t;
+
+/**
+ * \brief LSB per g of the left-justified output at a full scale of 'range' g
+ *
+ * \retval 0 if 'range' is not one of 2, 4, 8, 16
+ */
+uint16_t lis3dh_lsb_per_g(uint8_t range);
+
+/**
+ * \brief Q16 factor from raw output to mg, for lis3dh_to_mg()
+ */
+int32_t lis3dh_mg_scale(uint8_t range);
+
+/**
+ * \brief Convert 'n' raw axis values to mg, rounded to nearest
+ *
+ * Takes a flat array, so a batch of samples converts with n = 3 * count.
+ * 'dst' may equal 'src'.
+ */
+void lis3dh_to_mg(int16_t *dst, const int16_t *src, int n, int32_t scale);
+
+/**
+ * \brief Set the default thresholds and reset the detectors
+ *
+ * \param range full scale, g
+ * \param odr   output data rate, Hz
+ */
+void lis3dh_motion_init(lis3dh_motion_t *m, uint8_t range, uint16_t odr);
+
+/**
+ * \brief Compute the features of 'count' samples, already converted to mg
+ *
+ * Steps and taps are tracked across calls, so a peak split between two
+ * batches is counted once.
+ */
+void lis3dh_motion_feed(lis3dh_motion_t *m, const lis3dh_sample_t *mg, int count, lis3dh_features_t *f);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* COMPONENTS_BUS_I2C_INCLUDE_LIS3DH_MOTION_H_ */
@@ -8,8 +8,11 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stddef.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/ringbuf.h"
 #include "esp_system.h"
 #include "esp_log.h"
 #include "soc/gpio_struct.h"
@@ -17,6 +20,10 @@
 #include "app.h"
 #include "board.h"
 #include "lis3dh.h"
+#include "lis3dh_fifo.h"
+#include "lis3dh_i2c.h"
+#include "lis3dh_motion.h"
+#include "rtc_state.h"
 
 static const char *TAG = "lis3dh";
 
@@ -26,22 +33,23 @@ static const char *TAG = "lis3dh";
 #define LIS3DH_INIT					(0x02)
 #define LIS3DH_OFF					(0x80)
 #define ESP_INTR_FLAG_DEFAULT		0
+#define lis3dhBATCH_RING_SIZE		( 4 * (sizeof(Lis3dhBatch_t) + 8) )
+#define LIS3DH_SIG_FIFO			(0x0001)	// FIFO watermark interrupt
 
 
-static xQueueHandle xLis3dhInQueue = NULL;
-static xQueueHandle xLis3dhOutQueue = NULL;
-static xSemaphoreHandle xLis3dhMutex = NULL;
-
-static pLis3dhMessage master_pLis3dhMsg = NULL;   // current transaction ..
 static uint8_t ucLis3dhStatus = LIS3DH_NOT_PRESENT;
 static lis3dh_settings lis3dh_default_settings;
+static lis3dh_settings lis3dh_rtc_settings;		// as kept in RTC memory from an earlier wake
 static pLis3dh_settings current_settings = NULL;
 static uint8_t polling_state = 0x00;
-
-static void prvLis3dhTask( void *pvParameters );
-static esp_err_t  Lis3dh_readRegister(uint8_t* outputPointer, uint8_t offset);
-static esp_err_t  Lis3dh_writeRegister(uint8_t offset, uint8_t dataToWrite);
-static esp_err_t  Lis3dh_readRegisterRegion(uint8_t *outputPointer , uint8_t offset, uint8_t length);
+static RingbufHandle_t xLis3dhBatchRing = NULL;
+static uint8_t ucLis3dhFifoOn = 0;
+static uint32_t ulLis3dhBatchSeq = 0;
+
+static void prvLis3dhInit(msgbus_actor_t *actor);
+static esp_err_t prvLis3dhHandle(msgbus_actor_t *actor, msgbus_msg_t *bus);
+static void prvLis3dhSignal(msgbus_actor_t *actor, uint32_t bits);
+static void prvLis3dhIdle(msgbus_actor_t *actor);
 static esp_err_t  Lis3dh_readRegisterInt16( int16_t* outputPointer, uint8_t offset );
 static void Lis3dh_setup_default(void);
 static void Lis3dh_applySettings( pLis3dh_settings settings);
@@ -56,6 +64,29 @@ static float Lis3dh_readFloatAccelX( void );
 static float Lis3dh_readFloatAccelY( void );
 static float Lis3dh_readFloatAccelZ( void );
 static void IRAM_ATTR lis3dh_gpio_isr_handler(void* arg);
+static uint8_t Lis3dh_isSetUp(pLis3dh_settings settings);
+static void Lis3dh_fifoSetup(pLis3dh_settings settings, uint8_t chip_ready);
+static void Lis3dh_fifoService(void);
+
+static const lis3dh_bus_t lis3dh_bus = {
+	.read = Lis3dh_readRegisterRegion,
+	.write = Lis3dh_writeRegister,
+};
+static lis3dh_fifo_t lis3dh_fifo = {
+	.bus = &lis3dh_bus,
+};
+static lis3dh_motion_t lis3dh_motion;
+
+// idle_ms drains the FIFO anyway if no watermark interrupt came
+static msgbus_actor_t xLis3dhActor = {
+	.name = "LIS3DH",
+	.queue_len = lis3dhQUEUE_LENGTH,
+	.init = prvLis3dhInit,
+	.handle = prvLis3dhHandle,
+	.signal = prvLis3dhSignal,
+	.idle = prvLis3dhIdle,
+	.idle_ms = MSGBUS_WAIT_FOREVER,
+};
 
 
 
@@ -63,263 +94,168 @@ static void IRAM_ATTR lis3dh_gpio_isr_handler(void* arg);
 
 void vLis3dhStart( uint16_t usStackSize, portBASE_TYPE uxPriority )
 {
-	/* Create the queues used by tasks and interrupts to send/receive SPI data. */
-	xLis3dhInQueue = xQueueCreate( lis3dhQUEUE_LENGTH, sizeof(Lis3dhMessage_t) );
-	xLis3dhOutQueue = xQueueCreate( 1, sizeof(Lis3dhMessage_t) );
+	/* FIFO batches, as many as the ring buffer can hold */
+	xLis3dhBatchRing = xRingbufferCreate( lis3dhBATCH_RING_SIZE, RINGBUF_TYPE_NOSPLIT );
 
-	/* If the queue could not be created then don't create any tasks that might
-	attempt to use the queue. */
-	if( xLis3dhInQueue != NULL && xLis3dhOutQueue != NULL)
+	if( xLis3dhBatchRing != NULL)
 	{
-	
-		/* Create the semaphore used to access the SPI transmission. */
-		xLis3dhMutex = xSemaphoreCreateMutex();
-		configASSERT( xLis3dhMutex );
-
-		/* Create that task that handles the I2C Master itself. */
-		xTaskCreate(prvLis3dhTask,	/* The task that implements the command console. */
-					(const char *const) "LIS3DH",	/* Text name assigned to the task.  This is just to assist debugging.  The kernel does not use this name itself. */
-					usStackSize,					/* The size of the stack allocated to the task. */
-					NULL,						/* The parameter is not used, so NULL is passed. */
-					uxPriority,					/* The priority allocated to the task. */
-					NULL );						/* A handle is not required, so just pass NULL. */
-
+		/* Create that task that handles the accelerometer itself. */
+		xLis3dhActor.stack_size = usStackSize;
+		xLis3dhActor.priority = uxPriority;
+		if (msgbus_actor_start(&xLis3dhActor) != ESP_OK)
+		{
+			VApplicationGeneralFault;
+		}
 	}
 }
 
 /*-----------------------------------------------------------*/
-static void prvLis3dhTask( void *pvParameters )
+static void prvLis3dhInit(msgbus_actor_t *actor)
 {
-	Lis3dhMessage_t _Lis3dhMsg;   // current transaction ..
-	( void ) pvParameters;
-	pLis3dh_settings settings;
+	( void ) actor;
 
-		master_pLis3dhMsg = &_Lis3dhMsg;
+	while(!isI2C0Ready()) {
+		vTaskDelay(100);
+	}
 
-		while(!isI2C0Ready()) {
-			vTaskDelay(100);
-		}
+//	Lis3dh_gpio_cfg();
+	Lis3dh_setup_default();
+	current_settings = &lis3dh_default_settings;
+
+	// Set up on an earlier wake: the chip kept its registers through deep sleep
+	if ((psAppGetRtcState()->present & RTC_PRESENT_LIS3DH) && Lis3dh_isSetUp(&psAppGetRtcState()->lis3dh)) {
+		lis3dh_rtc_settings = psAppGetRtcState()->lis3dh;
+		current_settings = &lis3dh_rtc_settings;
+		ucLis3dhStatus = LIS3DH_PRESENT;
+		Lis3dh_fifoSetup(current_settings, 1);
+	}
+}
+
+static esp_err_t prvLis3dhHandle(msgbus_actor_t *actor, msgbus_msg_t *bus)
+{
+	pLis3dhMessage master_pLis3dhMsg = (pLis3dhMessage)bus;   // current transaction ..
+	pLis3dh_settings settings;
+	( void ) actor;
 
-//		Lis3dh_gpio_cfg();
-		Lis3dh_setup_default();
-		current_settings = &lis3dh_default_settings;
-		
-		while(1)
-		{	
-			if( xQueueReceive( xLis3dhInQueue, master_pLis3dhMsg, portMAX_DELAY) == pdPASS)
-			{
-				if (master_pLis3dhMsg ->app_msg.cmd) {
-					switch (master_pLis3dhMsg ->app_msg.cmd)
-					{
-					case APPMSG_GET_STACK_ROOM:
-							master_pLis3dhMsg->app_msg.d.v= uxTaskGetStackHighWaterMark(NULL);
-							if (master_pLis3dhMsg->app_msg.app__doneCallback != NULL)
-								master_pLis3dhMsg->app_msg.app__doneCallback(master_pLis3dhMsg);
-						break;
-					case APPMSG_LIS3DH_CHECK_PRESENT: 
-						if (isI2C0Ready()) {		
-						//Check the ID register to determine if the operation was a success.
-							uint8_t readCheck;
-							master_pLis3dhMsg->app_msg.d.param[0] = LIS3DH_NOT_PRESENT;
-							Lis3dh_readRegister(&readCheck, LIS3DH_WHO_AM_I);
-							if( readCheck == 0x33 )
-							{
-								ucLis3dhStatus = LIS3DH_PRESENT;
-								master_pLis3dhMsg->app_msg.d.param[0] = LIS3DH_PRESENT;
-								
-							}
-						}else{
-							// [ADK] Temporary, until we will have ALL tasks implemented
-							VApplicationGeneralFault;
-						}
-						
-						break;
-					case APPMSG_LIS3DH_SETUP:
-						if (ucLis3dhStatus == LIS3DH_PRESENT ) {
-
-
-							settings = (pLis3dh_settings)master_pLis3dhMsg->app_msg.d.ptr;
-							if (settings == NULL) 
-								Lis3dh_applySettings(&lis3dh_default_settings);
-							else	{							
-								Lis3dh_applySettings(settings);
-								current_settings = settings;
-							}
-							Lis3dh_config_Intterupts();
-
-//							Lis3dh_config_lpwMode();  // Test settings for now ..
-
- 						}
-						break;	
-					}
-				}else{
-					if (polling_state == 0x00) {
-						master_pLis3dhMsg->accl = Lis3dh_readFloatAccelX();
-						polling_state = 0x01;
-					}else
-					if (polling_state == 0x01) {
-						master_pLis3dhMsg->accl = Lis3dh_readFloatAccelY();
-						polling_state = 0x02;
-					}else
-					if (polling_state == 0x02) {
-						master_pLis3dhMsg->accl = Lis3dh_readFloatAccelZ();
-						polling_state = 0x00;
-					}
+	if (master_pLis3dhMsg ->app_msg.cmd) {
+		switch (master_pLis3dhMsg ->app_msg.cmd)
+		{
+		case APPMSG_GET_STACK_ROOM:
+				master_pLis3dhMsg->app_msg.d.v= uxTaskGetStackHighWaterMark(NULL);
+			break;
+		case APPMSG_LIS3DH_CHECK_PRESENT: 
+			if (psAppGetRtcState()->present & RTC_PRESENT_LIS3DH) {
+				// Found on an earlier wake
+				ucLis3dhStatus = LIS3DH_PRESENT;
+				master_pLis3dhMsg->app_msg.d.param[0] = LIS3DH_PRESENT;
+			}else
+			if (isI2C0Ready()) {		
+			//Check the ID register to determine if the operation was a success.
+				uint8_t readCheck;
+				master_pLis3dhMsg->app_msg.d.param[0] = LIS3DH_NOT_PRESENT;
+				Lis3dh_readRegister(&readCheck, LIS3DH_WHO_AM_I);
+				if( readCheck == 0x33 )
+				{
+					ucLis3dhStatus = LIS3DH_PRESENT;
+					master_pLis3dhMsg->app_msg.d.param[0] = LIS3DH_PRESENT;
+					psAppGetRtcState()->present |= RTC_PRESENT_LIS3DH;
 				}
+			}else{
+				// [ADK] Temporary, until we will have ALL tasks implemented
+				VApplicationGeneralFault;
 			}
-			if (master_pLis3dhMsg->lis3dh__doneCallback)
-				master_pLis3dhMsg->lis3dh__doneCallback((void *)master_pLis3dhMsg);
 			
-		}
-}
+			break;
+		case APPMSG_LIS3DH_SETUP:
+			if (ucLis3dhStatus == LIS3DH_PRESENT ) {
+
+
+				uint8_t chip_ready;
+
+				settings = (pLis3dh_settings)master_pLis3dhMsg->app_msg.d.ptr;
+				if (settings != NULL) 
+					current_settings = settings;
+				else
+					settings = &lis3dh_default_settings;
+				// Nothing to write if the chip holds these from an earlier wake
+				chip_ready = Lis3dh_isSetUp(settings);
+				if (!chip_ready) {
+					psAppGetRtcState()->present &= ~RTC_PRESENT_LIS3DH_SET;
+					Lis3dh_applySettings(settings);
+					Lis3dh_config_Intterupts();
+					psAppGetRtcState()->lis3dh = *settings;
+					psAppGetRtcState()->present |= RTC_PRESENT_LIS3DH_SET;
+				}
+				Lis3dh_fifoSetup(settings, chip_ready);
 
-/*-----------------------------------------------------------*/
+//				Lis3dh_config_lpwMode();  // Test settings for now ..
 
-portBASE_TYPE Lis3dhMsgPut(pLis3dhMessage msg)
-{
-	if(xQueueSend(xLis3dhInQueue, msg, ( portTickType ) 10) != pdPASS)
-		{
-			VApplicationGeneralFault;
+			}else{
+				return ESP_ERR_INVALID_STATE;
+			}
+			break;	
+		default:
+			return ESP_ERR_NOT_SUPPORTED;
 		}
-	return pdPASS;
+	}else{
+		if (polling_state == 0x00) {
+			master_pLis3dhMsg->accl = Lis3dh_readFloatAccelX();
+			polling_state = 0x01;
+		}else
+		if (polling_state == 0x01) {
+			master_pLis3dhMsg->accl = Lis3dh_readFloatAccelY();
+			polling_state = 0x02;
+		}else
+		if (polling_state == 0x02) {
+			master_pLis3dhMsg->accl = Lis3dh_readFloatAccelZ();
+			polling_state = 0x00;
+		}
+	}
+	return ESP_OK;
 }
 
-portBASE_TYPE isLis3dhPresents(void) 
+static void prvLis3dhSignal(msgbus_actor_t *actor, uint32_t bits)
 {
-	if (ucLis3dhStatus == LIS3DH_PRESENT)  return pdTRUE;
-	return pdFALSE;
+	( void ) actor;
+	if (bits & LIS3DH_SIG_FIFO) {
+		Lis3dh_fifoService();
+	}
 }
 
-/*-----------------------------------------------------------*/
-portBASE_TYPE  Lis3dhOnDone(void *pvParameters)
-{
-	pLis3dhMessage msg = (pLis3dhMessage)pvParameters;
-
-	if(xQueueSend(xLis3dhOutQueue, msg, ( portTickType ) (10 /portTICK_RATE_MS)) != pdPASS)
-	{
-		VApplicationGeneralFault;
-	}
-		
-	return pdPASS;
-}	
-portBASE_TYPE Lis3dhMsgGet(pLis3dhMessage msg)
+static void prvLis3dhIdle(msgbus_actor_t *actor)
 {
-	return xQueueReceive(xLis3dhOutQueue, msg, portMAX_DELAY);
+	( void ) actor;
+	// No watermark interrupt in the time the FIFO takes to fill up
+	Lis3dh_fifoService();
 }
 
 /*-----------------------------------------------------------*/
 
-
-//****************************************************************************//
-//
-//  ReadRegister
-//
-//  Parameters:
-//    *outputPointer -- Pass &variable (address of) to save read data to
-//    offset -- register to read
-//
-//****************************************************************************//
-static esp_err_t  Lis3dh_readRegister(uint8_t* outputPointer, uint8_t offset) 
+esp_err_t Lis3dhMsgCall(pLis3dhMessage msg)
 {
-	I2CMessage_t msg;
-	uint8_t  addr[2], value;
-
-	I2C0Take(NULL);
-	addr[0] = offset;
-		
-	msg.tx.length = 1;
-	msg.tx.chip = LIS3DH_I2C_ADDR;
-	msg.tx.buffer = &addr[0];
-	msg.rx.length = 1;
-	msg.rx.chip = LIS3DH_I2C_ADDR;
-	msg.rx.buffer = &value;
-	msg.tx_wait_time = 0;
-	msg.i2c__doneCallback = I2C0OnDone;
-
-	I2C0MsgPut(&msg);
-	while (I2C0MsgGet(&msg) != pdFAIL) {
-		break;
-	}
-	I2C0Give(NULL);
-
-//	printf("value 0x%02x\r\n", value);
-	*outputPointer = value;
-	return ESP_OK;	
-
+	return msgbus_call(&xLis3dhActor, &msg->app_msg.bus);
 }
 
-//****************************************************************************//
-//
-//  writeRegister
-//
-//  Parameters:
-//    offset -- register to write
-//    dataToWrite -- 8 bit data to write to register
-//
-//****************************************************************************//
-static esp_err_t  Lis3dh_writeRegister(uint8_t offset, uint8_t dataToWrite)
+portBASE_TYPE isLis3dhPresents(void) 
 {
-	I2CMessage_t msg;
-	uint8_t  addr[2];
-
-	I2C0Take(NULL);
-	addr[0] = offset;
-	addr[1] = dataToWrite;
-
-	msg.tx.length = 2;
-	msg.tx.chip = LIS3DH_I2C_ADDR;
-	msg.tx.buffer = &addr;
-	msg.rx.length = 0;
-	msg.rx.chip = LIS3DH_I2C_ADDR;
-	msg.rx.buffer = NULL;
-	msg.i2c__doneCallback = I2C0OnDone;
-	I2C0MsgPut(&msg);
-	while (I2C0MsgGet(&msg) != pdFAIL) {
-		break;
-	}
-	I2C0Give(NULL);
-	return ESP_OK;	
+	if (ucLis3dhStatus == LIS3DH_PRESENT)  return pdTRUE;
+	return pdFALSE;
 }
 
-//****************************************************************************//
-//
-//  ReadRegisterRegion
-//
-//  Parameters:
-//    *outputPointer -- Pass &variable (base address of) to save read data to
-//    offset -- register to read
-//    length -- number of bytes to read
-//
-//  Note:  Does not know if the target memory space is an array or not, or
-//    if there is the array is big enough.  if the variable passed is only
-//    two bytes long and 3 bytes are requested, this will over-write some
-//    other memory!
-//
-//****************************************************************************//
-static esp_err_t  Lis3dh_readRegisterRegion(uint8_t *outputPointer , uint8_t offset, uint8_t length)
+pLis3dhBatch Lis3dhBatchReceive(TickType_t ticks_to_wait)
 {
-	I2CMessage_t msg;
-	uint8_t  addr[2];
-
-	I2C0Take(NULL);
-	addr[0] = offset | 0x80;  //turn auto-increment bit on, bit 7 for I2C
-	msg.tx.length = 1;
-	msg.tx.chip = LIS3DH_I2C_ADDR;
-	msg.tx.buffer = &addr[0];
-	msg.rx.length = length;
-	msg.rx.chip = LIS3DH_I2C_ADDR;
-	msg.rx.buffer = outputPointer;
-	msg.tx_wait_time = 0;
-	msg.i2c__doneCallback = I2C0OnDone;
-	I2C0MsgPut(&msg);
-	while (I2C0MsgGet(&msg) != pdFAIL) {
-		break;
-	}
-	I2C0Give(NULL);
-	return ESP_OK;	
+	size_t size;
+	return (pLis3dhBatch)xRingbufferReceive(xLis3dhBatchRing, &size, ticks_to_wait);
+}
 
+void Lis3dhBatchReturn(pLis3dhBatch batch)
+{
+	vRingbufferReturnItem(xLis3dhBatchRing, batch);
 }
 
+/*-----------------------------------------------------------*/
+
+
 //****************************************************************************//
 //
 //  readRegisterInt16
@@ -430,6 +366,7 @@ static void Lis3dh_applySettings( pLis3dh_settings settings)
 	ESP_LOGI(TAG, "LIS3DH_CTRL_REG1(0x%02x) := 0x%02x\r\n", LIS3DH_CTRL_REG1, dataToWrite);
 #endif
 	Lis3dh_writeRegister(LIS3DH_CTRL_REG1, dataToWrite);
+	psAppGetRtcState()->lis3dh_ctrl_reg1 = dataToWrite;
 
 	//Build CTRL_REG4
 	dataToWrite = 0; //Start Fresh!
@@ -572,7 +509,11 @@ static void Lis3dh_config_Intterupts(void)
   //Int1 latch interrupt and 4D on  int1 (preserve fifo en)
   Lis3dh_readRegister(&dataToWrite, LIS3DH_CTRL_REG5);
   dataToWrite &= 0xF3; //Clear bits of interest
+#ifndef CONFIG_PINGZEE_ULP_WATCH
   dataToWrite |= 0x08; //Latch interrupt (Cleared by reading int1_src)
+#else
+  //Not latched: in deep sleep the ULP watches the pin level and can't read int1_src, see ulp_watch.h
+#endif
   //dataToWrite |= 0x04; //Pipe 4D detection from 6D recognition to int1?
 #ifdef CONFIG_LIS3DH_VERBOSE_DEBUG
 	ESP_LOGI(TAG, "LIS3DH_CTRL_REG5(0x%02x) := 0x%02x\r\n", LIS3DH_CTRL_REG5, dataToWrite);
@@ -962,26 +903,102 @@ static float Lis3dh_readFloatAccelZ( void )
 
 static float Lis3dh_calcAccel( int16_t input )
 {
-	float output;
-	switch(current_settings->accelRange)
-	{
-		case 2:
-		output = (float)input / 15987;
-		break;
-		case 4:
-		output = (float)input / 7840;
-		break;
-		case 8:
-		output = (float)input / 3883;
-		break;
-		case 16:
-		output = (float)input / 1280;
-		break;
-		default:
-		output = 0;
-		break;
+	uint16_t lsb_per_g = lis3dh_lsb_per_g(current_settings->accelRange);
+
+	return lsb_per_g ? (float)input / lsb_per_g : 0;
+}
+
+//****************************************************************************//
+//
+//  FIFO streaming section
+//
+//****************************************************************************//
+
+/*
+ * Whether the chip holds 'settings' as written on this or an earlier wake.
+ * Costs one register read, which also catches a chip that lost power. When
+ * that read fails nothing is known about the chip: the caller sets it up
+ * in full again.
+ */
+static uint8_t Lis3dh_isSetUp(pLis3dh_settings settings)
+{
+	rtc_state_t *rtc = psAppGetRtcState();
+	uint8_t reg1 = 0;
+
+	if (!(rtc->present & RTC_PRESENT_LIS3DH_SET) || !rtc_state_lis3dh_same(settings, &rtc->lis3dh)) {
+		return 0;
 	}
-	return output;
+	if (Lis3dh_readRegister(&reg1, LIS3DH_CTRL_REG1) != ESP_OK || reg1 != rtc->lis3dh_ctrl_reg1) {
+		rtc->present &= ~RTC_PRESENT_LIS3DH_SET;
+		return 0;
+	}
+	return 1;
+}
+
+/*
+ * With 'chip_ready' the FIFO already runs as 'settings' ask; it is left
+ * alone, so the samples it collected during deep sleep are kept.
+ */
+static void Lis3dh_fifoSetup(pLis3dh_settings settings, uint8_t chip_ready)
+{
+	static uint8_t gpio_ready = 0;
+
+	if (!settings->fifoEnabled || settings->fifoMode == LIS3DH_FIFO_MODE_BYPASS) {
+		if (ucLis3dhFifoOn) {
+			ucLis3dhFifoOn = 0;
+			xLis3dhActor.idle_ms = MSGBUS_WAIT_FOREVER;
+			lis3dh_fifo_stop(&lis3dh_fifo);
+		}
+		return;
+	}
+#ifdef CONFIG_LIS3DH_VERBOSE_DEBUG
+	ESP_LOGI(TAG, "FIFO mode %d, watermark %d\r\n", settings->fifoMode, settings->fifoThreshold);
+#endif
+	if (!chip_ready) {
+		lis3dh_fifo_start(&lis3dh_fifo, settings->fifoMode, settings->fifoThreshold);
+	}
+	// Half the time the FIFO takes to fill up, so a lost interrupt costs no samples
+	xLis3dhActor.idle_ms = (LIS3DH_FIFO_DEPTH * 1000 / 2) / (settings->accelSampleRate ? settings->accelSampleRate : 1) + 1;
+	lis3dh_motion_init(&lis3dh_motion, settings->accelRange, settings->accelSampleRate);
+	ucLis3dhFifoOn = 1;
+	if (!gpio_ready) {
+		Lis3dh_gpio_cfg();
+		gpio_ready = 1;
+	}
+}
+
+/*
+ * Move everything the FIFO holds to the batch ring buffer, with one burst
+ * read. Batches that find the ring buffer full are dropped; the gap shows
+ * in Lis3dhBatch_t::seq.
+ *
+ * The motion features are computed here, so a batch that shows motion keeps
+ * the board awake even if nobody reads the ring buffer.
+ */
+static void Lis3dh_fifoService(void)
+{
+	static Lis3dhBatch_t batch;	// off the task stack
+	static lis3dh_sample_t mg[LIS3DH_FIFO_DEPTH];
+	uint32_t overruns = lis3dh_fifo.overruns;
+	int count;
+
+	if (!ucLis3dhFifoOn) {
+		return;
+	}
+	count = lis3dh_fifo_drain(&lis3dh_fifo, batch.sample);
+	if (count <= 0) {
+		return;
+	}
+	batch.seq = ulLis3dhBatchSeq++;
+	batch.count = count;
+	batch.overrun = (lis3dh_fifo.overruns != overruns);
+	lis3dh_to_mg((int16_t *)mg, (const int16_t *)batch.sample, count * 3, lis3dh_motion.scale);
+	lis3dh_motion_feed(&lis3dh_motion, mg, count, &batch.features);
+	rtc_state_motion_add(psAppGetRtcState(), &batch.features);
+	if (batch.features.active && psAppGetStatus()->what_happen == WAKE_NOTHING) {
+		psAppGetStatus()->what_happen = WAKE_MOTION;
+	}
+	xRingbufferSend(xLis3dhBatchRing, &batch, offsetof(Lis3dhBatch_t, sample) + count * sizeof(lis3dh_sample_t), 0);
 }
 
 //****************************************************************************//
@@ -992,22 +1009,12 @@ static float Lis3dh_calcAccel( int16_t input )
 
 static void IRAM_ATTR lis3dh_gpio_isr_handler(void* arg)
 {
-//     portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
-    AppMessage_t ISRMsg;   // Wakeup the app ..
-	if (xAppInQueue != NULL) {
-//		gpio_intr_disable(LIS3DH_GPIO_INT_PIN);
-		ISRMsg.cmd = APPMSG_LIS3DH_INTR;
-		ISRMsg.d.v = (uint32_t) arg;
-		ISRMsg.app__doneCallback = NULL;
-    		xQueueSendFromISR(xAppInQueue, &ISRMsg,  NULL /*&xHigherPriorityTaskWoken*/);
+	// Wakeup the app ..
+	vAppSignalFromISR((uint32_t)arg == LIS3DH_GPIO_INT_PIN1 ? APPSIG_LIS3DH_INTR1 : APPSIG_LIS3DH_INTR2);
+	if (ucLis3dhFifoOn && (uint32_t)arg == LIS3DH_GPIO_INT_PIN1) {
+		// FIFO watermark, drained by the LIS3DH task
+		msgbus_signal_from_isr(&xLis3dhActor, LIS3DH_SIG_FIFO);
 	}
-#if 0	
-	/* THIS MUST BE THE LAST THING DONE IN THE ISR. */	
-	if( xHigherPriorityTaskWoken )
-	{
-		taskYIELD();
-	}
-#endif
 }
 
 static void Lis3dh_gpio_cfg(void)
@@ -0,0 +1,92 @@
+/*
+ * lis3dh_fifo.c
+ *
+ * \brief LIS3DH hardware FIFO: setup and burst draining.
+ *
+ */
+
+#include <stddef.h>
+#include "lis3dh_fifo.h"
+#include "lis3dh.h"
+
+static esp_err_t lis3dh_fifo_update(lis3dh_fifo_t *fifo, uint8_t offset, uint8_t clear, uint8_t set)
+{
+	uint8_t value;
+	esp_err_t ret = fifo->bus->read(&value, offset, 1);
+
+	if (ret != ESP_OK) {
+		return ret;
+	}
+	return fifo->bus->write(offset, (value & ~clear) | set);
+}
+
+esp_err_t lis3dh_fifo_start(lis3dh_fifo_t *fifo, uint8_t mode, uint8_t watermark)
+{
+	esp_err_t ret;
+
+	fifo->drains = 0;
+	fifo->samples = 0;
+	fifo->overruns = 0;
+	//Going through bypass mode empties the FIFO
+	ret = fifo->bus->write(LIS3DH_FIFO_CTRL_REG, LIS3DH_FIFO_MODE_BYPASS << 6);
+	if (ret == ESP_OK) {
+		ret = lis3dh_fifo_update(fifo, LIS3DH_CTRL_REG5, 0, LIS3DH_CTRL_REG5_FIFO_EN);
+	}
+	if (ret == ESP_OK) {
+		ret = fifo->bus->write(LIS3DH_FIFO_CTRL_REG, ((mode & 0x03) << 6) | (watermark & LIS3DH_FIFO_SRC_FSS_MASK));
+	}
+	if (ret == ESP_OK) {
+		ret = lis3dh_fifo_update(fifo, LIS3DH_CTRL_REG3, 0, LIS3DH_CTRL_REG3_I1_WTM);
+	}
+	return ret;
+}
+
+esp_err_t lis3dh_fifo_stop(lis3dh_fifo_t *fifo)
+{
+	esp_err_t ret;
+
+	ret = lis3dh_fifo_update(fifo, LIS3DH_CTRL_REG3, LIS3DH_CTRL_REG3_I1_WTM, 0);
+	if (ret == ESP_OK) {
+		ret = fifo->bus->write(LIS3DH_FIFO_CTRL_REG, LIS3DH_FIFO_MODE_BYPASS << 6);
+	}
+	if (ret == ESP_OK) {
+		ret = lis3dh_fifo_update(fifo, LIS3DH_CTRL_REG5, LIS3DH_CTRL_REG5_FIFO_EN, 0);
+	}
+	return ret;
+}
+
+int lis3dh_fifo_drain(lis3dh_fifo_t *fifo, lis3dh_sample_t *samples)
+{
+	uint8_t src;
+	uint8_t *raw = (uint8_t *)samples;
+	int count, i;
+
+	if (fifo->bus->read(&src, LIS3DH_FIFO_SRC_REG, 1) != ESP_OK) {
+		return -1;
+	}
+	if (src & LIS3DH_FIFO_SRC_OVRN) {
+		count = LIS3DH_FIFO_DEPTH;
+		fifo->overruns++;
+	} else if (src & LIS3DH_FIFO_SRC_EMPTY) {
+		return 0;
+	} else {
+		count = src & LIS3DH_FIFO_SRC_FSS_MASK;
+	}
+	if (count == 0) {
+		return 0;
+	}
+
+	//The read address wraps from OUT_Z_H to OUT_X_L, popping one sample per six bytes
+	if (fifo->bus->read(raw, LIS3DH_OUT_X_L, count * sizeof(lis3dh_sample_t)) != ESP_OK) {
+		return -1;
+	}
+	//The registers are little endian; assemble in place so this holds on any host
+	for (i = 0; i < count; i++, raw += 6) {
+		samples[i].x = (int16_t)(raw[0] | (raw[1] << 8));
+		samples[i].y = (int16_t)(raw[2] | (raw[3] << 8));
+		samples[i].z = (int16_t)(raw[4] | (raw[5] << 8));
+	}
+	fifo->drains++;
+	fifo->samples += count;
+	return count;
+}
@@ -0,0 +1,99 @@
+/*
+ * lis3dh_i2c.c
+ *
+ * \brief LIS3DH register access through the I2C0 task.
+ *
+ */
+
+#include <stddef.h>
+#include "freertos/FreeRTOS.h"
+#include "app.h"
+#include "board.h"
+#include "lis3dh_i2c.h"
+
+static esp_err_t Lis3dh_transfer(pI2CMessage msg)
+{
+	portBASE_TYPE ret;
+
+	msg->tx.chip = LIS3DH_I2C_ADDR;
+	msg->rx.chip = LIS3DH_I2C_ADDR;
+	msg->tx_wait_time = 0;
+	msg->i2c__doneCallback = I2C0OnDone;
+
+	I2C0Take(NULL);
+	I2C0MsgPut(msg);
+	ret = I2C0MsgGet(msg);
+	I2C0Give(NULL);
+	return ret == pdFAIL ? ESP_FAIL : ESP_OK;
+}
+
+//****************************************************************************//
+//
+//  ReadRegister
+//
+//  Parameters:
+//    *outputPointer -- Pass &variable (address of) to save read data to
+//    offset -- register to read
+//
+//****************************************************************************//
+esp_err_t Lis3dh_readRegister(uint8_t *outputPointer, uint8_t offset)
+{
+	I2CMessage_t msg;
+	uint8_t addr = offset;
+
+	msg.tx.length = 1;
+	msg.tx.buffer = &addr;
+	msg.rx.length = 1;
+	msg.rx.buffer = outputPointer;
+	return Lis3dh_transfer(&msg);
+}
+
+//****************************************************************************//
+//
+//  writeRegister
+//
+//  Parameters:
+//    offset -- register to write
+//    dataToWrite -- 8 bit data to write to register
+//
+//****************************************************************************//
+esp_err_t Lis3dh_writeRegister(uint8_t offset, uint8_t dataToWrite)
+{
+	I2CMessage_t msg;
+	uint8_t addr[2];
+
+	addr[0] = offset;
+	addr[1] = dataToWrite;
+	msg.tx.length = 2;
+	msg.tx.buffer = addr;
+	msg.rx.length = 0;
+	msg.rx.buffer = NULL;
+	return Lis3dh_transfer(&msg);
+}
+
+//****************************************************************************//
+//
+//  ReadRegisterRegion
+//
+//  Parameters:
+//    *outputPointer -- Pass &variable (base address of) to save read data to
+//    offset -- register to read
+//    length -- number of bytes to read
+//
+//  Note:  Does not know if the target memory space is an array or not, or
+//    if there is the array is big enough.  if the variable passed is only
+//    two bytes long and 3 bytes are requested, this will over-write some
+//    other memory!
+//
+//****************************************************************************//
+esp_err_t Lis3dh_readRegisterRegion(uint8_t *outputPointer, uint8_t offset, uint8_t length)
+{
+	I2CMessage_t msg;
+	uint8_t addr = offset | 0x80;	//turn auto-increment bit on, bit 7 for I2C
+
+	msg.tx.length = 1;
+	msg.tx.buffer = &addr;
+	msg.rx.length = length;
+	msg.rx.buffer = outputPointer;
+	return Lis3dh_transfer(&msg);
+}
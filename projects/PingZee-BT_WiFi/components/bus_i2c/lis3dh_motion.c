@@ -0,0 +1,170 @@
+/*
+ * lis3dh_motion.c
+ *
+ * \brief Fixed-point conversion of LIS3DH samples and motion features.
+ *
+ */
+
+#include <string.h>
+#include "lis3dh_motion.h"
+
+//! \name Default detector settings
+//@{
+#define LIS3DH_MOTION_STEP_MG		250
+#define LIS3DH_MOTION_STEP_MS		250		// faster than 4 steps/s is not walking
+#define LIS3DH_MOTION_TAP_MG		1200
+#define LIS3DH_MOTION_TAP_MS		100
+#define LIS3DH_MOTION_ACTIVE_MG		50
+//@}
+
+uint16_t lis3dh_lsb_per_g(uint8_t range)
+{
+	// Same sensitivities Lis3dh_calcAccel() always used
+	switch (range) {
+	case 2:		return 15987;
+	case 4:		return 7840;
+	case 8:		return 3883;
+	case 16:	return 1280;
+	default:	return 0;
+	}
+}
+
+int32_t lis3dh_mg_scale(uint8_t range)
+{
+	uint32_t lsb = lis3dh_lsb_per_g(range);
+
+	if (lsb == 0) {
+		return 0;
+	}
+	return (int32_t)((((uint32_t)LIS3DH_MOTION_1G_MG << 16) + lsb / 2) / lsb);
+}
+
+void lis3dh_to_mg(int16_t *dst, const int16_t *src, int n, int32_t scale)
+{
+	int i = 0;
+
+	// Four independent products per pass keep the multiplier busy
+	for (; i + 4 <= n; i += 4) {
+		int32_t a = src[i] * scale;
+		int32_t b = src[i + 1] * scale;
+		int32_t c = src[i + 2] * scale;
+		int32_t d = src[i + 3] * scale;
+		dst[i] = (int16_t)((a + 0x8000) >> 16);
+		dst[i + 1] = (int16_t)((b + 0x8000) >> 16);
+		dst[i + 2] = (int16_t)((c + 0x8000) >> 16);
+		dst[i + 3] = (int16_t)((d + 0x8000) >> 16);
+	}
+	for (; i < n; i++) {
+		dst[i] = (int16_t)((src[i] * scale + 0x8000) >> 16);
+	}
+}
+
+static uint16_t lis3dh_isqrt(uint32_t v)
+{
+	uint32_t root = 0, bit = 1UL << 30;
+
+	while (bit > v) {
+		bit >>= 2;
+	}
+	while (bit) {
+		if (v >= root + bit) {
+			v -= root + bit;
+			root = (root >> 1) + bit;
+		} else {
+			root >>= 1;
+		}
+		bit >>= 2;
+	}
+	return (uint16_t)root;
+}
+
+void lis3dh_motion_init(lis3dh_motion_t *m, uint8_t range, uint16_t odr)
+{
+	memset(m, 0, sizeof(*m));
+	if (odr == 0) {
+		odr = 1;
+	}
+	m->scale = lis3dh_mg_scale(range);
+	m->step_mg = LIS3DH_MOTION_STEP_MG;
+	m->step_gap = (LIS3DH_MOTION_STEP_MS * odr + 999) / 1000;
+	m->tap_mg = LIS3DH_MOTION_TAP_MG;
+	m->tap_gap = (LIS3DH_MOTION_TAP_MS * odr + 999) / 1000;
+	m->active_mg = LIS3DH_MOTION_ACTIVE_MG;
+	m->last_mag = LIS3DH_MOTION_1G_MG;
+	m->step_armed = 1;
+	m->since_step = m->step_gap;
+	m->since_tap = m->tap_gap;
+}
+
+static uint16_t lis3dh_rms(int64_t sum, int64_t sum_sq, int n)
+{
+	// Variance from the running sums; clamped, as rounding can leave it slightly negative
+	int64_t var = (sum_sq * n - sum * sum) / ((int64_t)n * n);
+
+	return lis3dh_isqrt(var > 0 ? (uint32_t)var : 0);
+}
+
+void lis3dh_motion_feed(lis3dh_motion_t *m, const lis3dh_sample_t *mg, int count, lis3dh_features_t *f)
+{
+	int64_t sum[3] = {0, 0, 0}, sum_sq[3] = {0, 0, 0};
+	int64_t mag_sum = 0, mag_sum_sq = 0;
+	int i, axis;
+
+	memset(f, 0, sizeof(*f));
+	if (count <= 0) {
+		return;
+	}
+	for (axis = 0; axis < 3; axis++) {
+		f->min[axis] = INT16_MAX;
+		f->max[axis] = INT16_MIN;
+	}
+	f->mag_min = UINT16_MAX;
+
+	for (i = 0; i < count; i++) {
+		const int16_t v[3] = { mg[i].x, mg[i].y, mg[i].z };
+		uint32_t sq = 0;
+		uint16_t mag;
+
+		for (axis = 0; axis < 3; axis++) {
+			if (v[axis] < f->min[axis])	f->min[axis] = v[axis];
+			if (v[axis] > f->max[axis])	f->max[axis] = v[axis];
+			sum[axis] += v[axis];
+			sum_sq[axis] += (int32_t)v[axis] * v[axis];
+			sq += (uint32_t)((int32_t)v[axis] * v[axis]);
+		}
+		mag = lis3dh_isqrt(sq);
+		if (mag < f->mag_min)	f->mag_min = mag;
+		if (mag > f->mag_max)	f->mag_max = mag;
+		mag_sum += mag;
+		mag_sum_sq += (uint32_t)mag * mag;
+
+		// Tap: a jump of |a| far sharper than any step
+		m->since_tap++;
+		m->since_step++;
+		if ((mag > m->last_mag ? mag - m->last_mag : m->last_mag - mag) > m->tap_mg && m->since_tap >= m->tap_gap) {
+			m->since_tap = 0;
+			m->taps++;
+			if (f->taps < UINT8_MAX)	f->taps++;
+			m->step_armed = 0;	// the tap's peak is not a step
+		}
+		m->last_mag = mag;
+
+		// Step: |a| peaks above 1 g + step_mg, then drops back below 1 g
+		if (mag < LIS3DH_MOTION_1G_MG) {
+			m->step_armed = 1;
+		} else if (m->step_armed && mag > LIS3DH_MOTION_1G_MG + m->step_mg && m->since_step >= m->step_gap) {
+			m->step_armed = 0;
+			m->since_step = 0;
+			m->steps++;
+			if (f->steps < UINT8_MAX)	f->steps++;
+		}
+	}
+
+	for (axis = 0; axis < 3; axis++) {
+		f->mean[axis] = (int16_t)(sum[axis] / count);
+		f->rms[axis] = lis3dh_rms(sum[axis], sum_sq[axis], count);
+	}
+	f->mag_mean = (uint16_t)(mag_sum / count);
+	f->mag_rms = lis3dh_rms(mag_sum, mag_sum_sq, count);
+	f->active = f->mag_rms > m->active_mg || f->steps || f->taps;
+}
@@ -37,19 +37,24 @@ static const char *TAG = "I2C_master";
 #define READ_BIT   I2C_MASTER_READ  /*!< I2C master read */
 /** Delay between two continue I2C read or write operation in microsecond */
 #define I2C0_CONTINUE_RW_DELAY  50
+/** Longest transfer is I2C_MASTER_MAX_CHUNKS * 255 bytes */
+#define I2C_MASTER_MAX_CHUNKS   4
+#define I2C_MASTER_CMD_NUM      (6 + 2 * I2C_MASTER_MAX_CHUNKS)
+/** Longest a message may take on the bus, the driver fails it with ESP_ERR_TIMEOUT after that */
+#define I2C0_MSG_TIMEOUT_MS     1000
+/** Longest I2C0MsgGet() waits: the driver has failed a stalled message well before */
+#define I2C0_MSG_WAIT_MS        (2 * I2C0_MSG_TIMEOUT_MS)
 
 
 
 #define i2cQUEUE_LENGTH				( 2 )
 
-static xQueueHandle xI2C0MasterInQueue = NULL;
-static xQueueHandle xI2C0MasterOutQueue = NULL;
 static xSemaphoreHandle xI2C0Mutex = NULL;
 
-static void prvI2C0MasterTask( void *pvParameters );
-
-static pI2CMessage master_pI2CMsg = NULL;   // current transaction ..
 static unsigned char I2C0_init = 0;
+/* Command links are built here instead of on the heap; callers hold xI2C0Mutex while a message is on the bus */
+static uint8_t i2c_cmd_buffer[I2C_CMD_LINK_STATIC_SIZE(I2C_MASTER_CMD_NUM)];
+static i2c_trans_t i2c_trans;
 
 
 /**
@@ -70,138 +75,65 @@ static void i2c_master_init()
 }
 
 /**
- * @brief code to read esp-i2c
- *        We need to fill the buffer of esp slave device, then master can read them out.
+ * @brief build the command link of an I2C message
+ *        The write and the read are joined by a repeated start, so the ISR sends them back to back.
  *
- * _______________________________________________________________________________________
- * | start | slave_addr + rd_bit +ack | read n-1 bytes + ack | read 1 byte + nack | stop |
- * |-----|----------------------|-------------------|-----------------|----|
+ * ______________________________________________________________________________________________________________________________
+ * | start | slave_addr + wr_bit + ack | write n bytes + ack | start | slave_addr + rd_bit + ack | read n-1 bytes + ack | read 1 byte + nack | stop |
+ * |-----|-----------------------|------------------|-----|----------------------|-------------------|-----------------|----|
  *
  */
-static esp_err_t i2c_master_read_slave(i2c_port_t i2c_num, uint8_t addr,  uint8_t* data_rd, size_t size)
+static esp_err_t i2c_master_msg_link(i2c_cmd_handle_t cmd, pI2CMessage msg, bool wr, bool rd)
 {
-    if (size == 0) {
-        return ESP_OK;
+    esp_err_t ret = ESP_OK;
+    if (wr) {
+        ret = i2c_master_start(cmd);
+        if (ret == ESP_OK) {
+            ret = i2c_master_write_byte(cmd, ( msg->tx.chip << 1 ) | WRITE_BIT, ACK_CHECK_EN);
+        }
+        if (ret == ESP_OK) {
+            ret = i2c_master_write(cmd, (uint8_t *)msg->tx.buffer, msg->tx.length, ACK_CHECK_EN);
+        }
+    }
+    if (ret == ESP_OK && rd) {
+        uint8_t *data_rd = (uint8_t *)msg->rx.buffer;
+        ret = i2c_master_start(cmd);
+        if (ret == ESP_OK) {
+            ret = i2c_master_write_byte(cmd, ( msg->rx.chip << 1 ) | READ_BIT, ACK_CHECK_EN);
+        }
+        if (ret == ESP_OK && msg->rx.length > 1) {
+            ret = i2c_master_read(cmd, data_rd, msg->rx.length - 1, ACK_VAL);
+        }
+        if (ret == ESP_OK) {
+            ret = i2c_master_read_byte(cmd, data_rd + msg->rx.length - 1, NACK_VAL);
+        }
     }
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-    i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, ( addr << 1 ) | READ_BIT, ACK_CHECK_EN);
-    if (size > 1) {
-        i2c_master_read(cmd, data_rd, size - 1, ACK_VAL);
+    if (ret == ESP_OK) {
+        ret = i2c_master_stop(cmd);
     }
-    i2c_master_read_byte(cmd, data_rd + size - 1, NACK_VAL);
-    i2c_master_stop(cmd);
-    esp_err_t ret = i2c_master_cmd_begin(i2c_num, cmd, 1000 / portTICK_RATE_MS);
-    i2c_cmd_link_delete(cmd);
     return ret;
 }
 
-/**
- * @brief  code to write esp-i2c
- *        Master device write data to slave.
- *
- * ___________________________________________________________________
- * | start | slave_addr + wr_bit + ack | write n bytes + ack  | stop |
- * |-----|-----------------------|------------------|-----|
- *
- */
-static esp_err_t i2c_master_write_slave(i2c_port_t i2c_num, uint8_t addr, uint8_t* data_wr, size_t size)
-{
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-    i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, ( addr << 1 ) | WRITE_BIT, ACK_CHECK_EN);
-    i2c_master_write(cmd, data_wr, size, ACK_CHECK_EN);
-    i2c_master_stop(cmd);
-    esp_err_t ret = i2c_master_cmd_begin(i2c_num, cmd, 1000 / portTICK_RATE_MS);
-    i2c_cmd_link_delete(cmd);
-    return ret;
-}
 
 /*-----------------------------------------------------------*/
 
 void vI2C0MasterStart( uint16_t usStackSize, UBaseType_t uxPriority)
 {
+	/* The driver queues the transactions and chains them from its ISR, no task is needed. */
+	( void ) usStackSize;
+	( void ) uxPriority;
 	i2c_master_init();
 
-	/* Create the queues used by tasks and interrupts to send/receive SPI data. */
-	xI2C0MasterInQueue = xQueueCreate( i2cQUEUE_LENGTH, sizeof(I2CMessage_t) );
-	xI2C0MasterOutQueue = xQueueCreate( 1, sizeof(I2CMessage_t) );
-
-	/* If the queue could not be created then don't create any tasks that might
-	attempt to use the queue. */
-	if( xI2C0MasterInQueue != NULL && xI2C0MasterOutQueue != NULL)
+	if (i2c_master_queue_init(I2C_MASTER_NUM, i2cQUEUE_LENGTH) == ESP_OK)
 	{
-	
 		/* Create the semaphore used to access the I2C transmission. */
 		xI2C0Mutex = xSemaphoreCreateMutex();
 		configASSERT( xI2C0Mutex );
-		/* Create that task that handles the I2C Master itself. */
-		xTaskCreate(	prvI2C0MasterTask,			/* The task that implements the command console. */
-						(const char *const) "I2C0",		/* Text name assigned to the task.  This is just to assist debugging.  The kernel does not use this name itself. */
-						usStackSize,					/* The size of the stack allocated to the task. */
-						NULL,						/* The parameter is not used, so NULL is passed. */
-						uxPriority,					/* The priority allocated to the task. */
-						NULL );						/* A handle is not required, so just pass NULL. */
+		I2C0_init = 1;
 	}
 }
 
 
-/*-----------------------------------------------------------*/
-static void prvI2C0MasterTask( void *pvParameters )
-{
-	I2CMessage_t _I2CMsg;   // current transaction ..
-	( void ) pvParameters;
-	int ret;
-
-		master_pI2CMsg = &_I2CMsg;
-		while(1)
-		{
-			I2C0_init = 1;
-			if( xQueueReceive( xI2C0MasterInQueue, master_pI2CMsg, portMAX_DELAY) == pdPASS)
-			{
-				if (master_pI2CMsg->tx.length != 0) {
-					ret =  i2c_master_write_slave(	I2C_MASTER_NUM,						/* Controller */ 
-											master_pI2CMsg->tx.chip,					/* Slave address */
-											(uint8_t *)master_pI2CMsg->tx.buffer,		/* data buffer */
-											master_pI2CMsg->tx.length				/* data length */
-											);
-					if (ret != ESP_OK) {
-printf("ret = 0x%x\r\n", ret);					
-						VApplicationGeneralFault;
-					}
-					
-					if (master_pI2CMsg->rx.length != 0) {
-						/*
-						 * Delay between each write or read cycle between TWI Stop and TWI Start.
-						 */
-						if (master_pI2CMsg->tx_wait_time)
-							vTaskDelay(I2C0_CONTINUE_RW_DELAY/portTICK_RATE_MS);
-
-						ret = i2c_master_read_slave(I2C_MASTER_NUM,						/* Controller */ 
-													master_pI2CMsg->rx.chip,				/* Slave address */		
-													(uint8_t *)master_pI2CMsg->rx.buffer,	/* data buffer */
-													master_pI2CMsg->rx.length			/* data length */
-													);
-						if (ret != ESP_OK)
-							VApplicationGeneralFault;
-
-					}
-				}else
-					if (master_pI2CMsg->rx.length != 0) {
-						ret = i2c_master_read_slave(I2C_MASTER_NUM,						/* Controller */ 
-													master_pI2CMsg->rx.chip,				/* Slave address */		
-													(uint8_t *)master_pI2CMsg->rx.buffer,	/* data buffer */
-													master_pI2CMsg->rx.length			/* data length */
-													);
-					if (ret != ESP_OK)
-						VApplicationGeneralFault;
-			}
-			if (master_pI2CMsg->i2c__doneCallback != NULL)
-				master_pI2CMsg->i2c__doneCallback(master_pI2CMsg);
-			}
-		}
-}
-
 /*-----------------------------------------------------------*/
 portBASE_TYPE isI2C0Ready(void)
 {
@@ -210,28 +142,71 @@ portBASE_TYPE isI2C0Ready(void)
 }
 portBASE_TYPE I2C0MsgPut(pI2CMessage msg)
 {
-
-	if(xQueueSend(xI2C0MasterInQueue, msg, ( portTickType ) 10) != pdPASS)
-		{
-						VApplicationGeneralFault;
+	esp_err_t ret = ESP_OK;
+	bool wr = msg->tx.length != 0;
+	bool rd = msg->rx.length != 0;
+	i2c_cmd_handle_t cmd = i2c_cmd_link_create_static(i2c_cmd_buffer, sizeof(i2c_cmd_buffer));
+
+	if (wr && rd && msg->tx_wait_time) {
+		/*
+		 * Delay between each write or read cycle between TWI Stop and TWI Start.
+		 */
+		ret = i2c_master_msg_link(cmd, msg, true, false);
+		if (ret == ESP_OK) {
+			ret = i2c_master_cmd_begin(I2C_MASTER_NUM, cmd, 1000 / portTICK_RATE_MS);
 		}
+		vTaskDelay(I2C0_CONTINUE_RW_DELAY/portTICK_RATE_MS);
+		i2c_cmd_link_delete_static(cmd);
+		cmd = i2c_cmd_link_create_static(i2c_cmd_buffer, sizeof(i2c_cmd_buffer));
+		wr = false;
+	}
+	if (ret == ESP_OK) {
+		ret = i2c_master_msg_link(cmd, msg, wr, rd);
+	}
+	i2c_trans.cmd = cmd;
+	i2c_trans.done_cb = NULL;
+	i2c_trans.user = msg;
+	i2c_trans.timeout = I2C0_MSG_TIMEOUT_MS / portTICK_RATE_MS;
+	if (ret == ESP_OK) {
+		ret = i2c_master_queue_trans(I2C_MASTER_NUM, &i2c_trans, ( portTickType ) 10);
+	}
+	if (ret != ESP_OK)
+	{
+		ESP_LOGE(TAG, "cannot queue the message, error 0x%x", ret);
+		i2c_cmd_link_delete_static(cmd);
+						VApplicationGeneralFault;
+	}
 	return pdPASS;
 }
 
 portBASE_TYPE I2C0MsgGet(pI2CMessage msg)
 {
-	return xQueueReceive(xI2C0MasterOutQueue, msg, portMAX_DELAY);
+	i2c_trans_t *trans;
+
+	if (i2c_master_get_trans_result(I2C_MASTER_NUM, &trans, I2C0_MSG_WAIT_MS / portTICK_RATE_MS) != ESP_OK)
+	{
+		ESP_LOGE(TAG, "no result from the bus in %d ms", I2C0_MSG_WAIT_MS);
+		return pdFAIL;
+	}
+	i2c_cmd_link_delete_static(trans->cmd);
+	if (trans->result != ESP_OK)
+	{
+		/* a slave that did not ACK or held the bus; the driver reset the controller, the caller gives the bus back */
+		ESP_LOGE(TAG, "message failed, error 0x%x", trans->result);
+		return pdFAIL;
+	}
+	/* the driver read straight into the caller's buffers */
+	if (msg != trans->user)
+		memcpy(msg, trans->user, sizeof(I2CMessage_t));
+	if (msg->i2c__doneCallback != NULL)
+		msg->i2c__doneCallback(msg);
+	return pdPASS;
 }
 
 portBASE_TYPE  I2C0OnDone(void *pvParameters)
 {
-	pI2CMessage msg = (pI2CMessage)pvParameters;
-
-	if(xQueueSend(xI2C0MasterOutQueue, msg, ( portTickType ) (10 /portTICK_RATE_MS)) != pdPASS)
-	{
-						VApplicationGeneralFault;
-	}
-		
+	/* Completion is reported by the driver to I2C0MsgGet(), nothing left to do here */
+	( void ) pvParameters;
 	return pdPASS;
 }	
 portBASE_TYPE I2C0Take(void *pvParameters)
@@ -0,0 +1,34 @@
+/* Host stand-in for the I2C0 task interface of app.h, implemented by test_lis3dh_i2c.cpp */
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct i2c_packet {
+	uint8_t addr[3];
+	uint32_t addr_length;
+	void *buffer;
+	size_t  length;
+	uint8_t chip;
+} i2c_packet_t;
+
+typedef struct {
+	i2c_packet_t	tx;
+	i2c_packet_t	rx;
+	portTickType  tx_wait_time;
+	portBASE_TYPE (*i2c__doneCallback)(void *);
+} I2CMessage_t, *pI2CMessage;
+
+portBASE_TYPE I2C0MsgPut(pI2CMessage msg);
+portBASE_TYPE I2C0MsgGet(pI2CMessage msg);
+portBASE_TYPE  I2C0OnDone(void *pvParameters);
+portBASE_TYPE I2C0Take(void *pvParameters);
+portBASE_TYPE I2C0Give(void *pvParameters);
+
+#ifdef __cplusplus
+}
+#endif
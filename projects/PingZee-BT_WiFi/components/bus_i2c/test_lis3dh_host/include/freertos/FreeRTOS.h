@@ -0,0 +1,11 @@
+/* Host stand-in for the FreeRTOS definitions used by lis3dh_i2c.c */
+#pragma once
+#include <stdint.h>
+
+#define portBASE_TYPE   int
+typedef uint32_t portTickType;
+
+#define pdFALSE         0
+#define pdTRUE          1
+#define pdFAIL          pdFALSE
+#define pdPASS          pdTRUE
@@ -0,0 +1,138 @@
+// Copyright 2015-2017 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "lis3dh_model.h"
+#include "lis3dh.h"
+#include <cstring>
+
+Lis3dhModel::Lis3dhModel()
+{
+    memset(regs_, 0, sizeof(regs_));
+    regs_[LIS3DH_WHO_AM_I] = 0x33;
+    regs_[LIS3DH_CTRL_REG1] = 0x07;
+    current_ = lis3dh_sample_t();
+}
+
+bool Lis3dhModel::fifoOn() const
+{
+    return (regs_[LIS3DH_CTRL_REG5] & LIS3DH_CTRL_REG5_FIFO_EN) && mode() != LIS3DH_FIFO_MODE_BYPASS;
+}
+
+uint8_t Lis3dhModel::mode() const
+{
+    return regs_[LIS3DH_FIFO_CTRL_REG] >> 6;
+}
+
+uint8_t Lis3dhModel::fifoSrc() const
+{
+    uint8_t src = 0;
+    size_t n = fifo_.size();
+    if (n > (regs_[LIS3DH_FIFO_CTRL_REG] & LIS3DH_FIFO_SRC_FSS_MASK)) {
+        src |= LIS3DH_FIFO_SRC_WTM;
+    }
+    if (n == LIS3DH_FIFO_DEPTH) {
+        src |= LIS3DH_FIFO_SRC_OVRN | (LIS3DH_FIFO_DEPTH - 1);
+    } else {
+        src |= n;
+    }
+    if (n == 0) {
+        src |= LIS3DH_FIFO_SRC_EMPTY;
+    }
+    return src;
+}
+
+bool Lis3dhModel::int1() const
+{
+    return fifoOn() && (regs_[LIS3DH_CTRL_REG3] & LIS3DH_CTRL_REG3_I1_WTM) && (fifoSrc() & LIS3DH_FIFO_SRC_WTM);
+}
+
+void Lis3dhModel::sample(int16_t x, int16_t y, int16_t z)
+{
+    lis3dh_sample_t s = { x, y, z };
+    current_ = s;
+    if (!fifoOn()) {
+        return;
+    }
+    if (fifo_.size() == LIS3DH_FIFO_DEPTH) {
+        stats.lost++;
+        if (mode() != LIS3DH_FIFO_MODE_STREAM) {
+            return;
+        }
+        fifo_.pop_front();
+    }
+    fifo_.push_back(s);
+}
+
+uint8_t Lis3dhModel::readByte(uint8_t addr)
+{
+    if (addr >= LIS3DH_OUT_X_L && addr <= LIS3DH_OUT_Z_H) {
+        lis3dh_sample_t s = current_;
+        if (fifoOn()) {
+            s = fifo_.empty() ? lis3dh_sample_t() : fifo_.front();
+        }
+        const int16_t axis[3] = { s.x, s.y, s.z };
+        uint16_t v = axis[(addr - LIS3DH_OUT_X_L) / 2];
+        //Reading OUT_Z_H moves the FIFO on to the next sample
+        if (addr == LIS3DH_OUT_Z_H && fifoOn() && !fifo_.empty()) {
+            fifo_.pop_front();
+        }
+        return (addr & 1) ? v >> 8 : v & 0xFF;
+    }
+    if (addr == LIS3DH_FIFO_SRC_REG) {
+        return fifoSrc();
+    }
+    return regs_[addr];
+}
+
+void Lis3dhModel::read(uint8_t sub, uint8_t* data, size_t len)
+{
+    stats.reads++;
+    stats.busBytes += 3 + len;      /* address+W, sub-address, address+R, data */
+    if (failBus) {
+        return;
+    }
+    uint8_t addr = sub & 0x7F;
+    for (size_t i = 0; i < len; ++i) {
+        data[i] = readByte(addr);
+        if (!(sub & 0x80)) {
+            continue;
+        }
+        if (addr == LIS3DH_OUT_Z_H && (regs_[LIS3DH_CTRL_REG5] & LIS3DH_CTRL_REG5_FIFO_EN)) {
+            addr = LIS3DH_OUT_X_L;
+        } else {
+            addr = (addr + 1) & 0x7F;
+        }
+    }
+}
+
+void Lis3dhModel::write(uint8_t sub, const uint8_t* data, size_t len)
+{
+    stats.writes++;
+    stats.busBytes += 2 + len;
+    if (failBus) {
+        return;
+    }
+    uint8_t addr = sub & 0x7F;
+    for (size_t i = 0; i < len; ++i) {
+        if (addr != LIS3DH_WHO_AM_I && addr != LIS3DH_FIFO_SRC_REG) {
+            regs_[addr] = data[i];
+        }
+        //Bypass mode empties the FIFO
+        if (addr == LIS3DH_FIFO_CTRL_REG && mode() == LIS3DH_FIFO_MODE_BYPASS) {
+            fifo_.clear();
+        }
+        if (sub & 0x80) {
+            addr = (addr + 1) & 0x7F;
+        }
+    }
+}
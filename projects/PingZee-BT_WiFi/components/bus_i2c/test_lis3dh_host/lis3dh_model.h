@@ -0,0 +1,70 @@
+// Copyright 2015-2017 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef LIS3DH_MODEL_H
+#define LIS3DH_MODEL_H
+
+/* Register-level model of the LIS3DH as seen over I2C: the output registers,
+   the 32-sample FIFO in its four modes, FIFO_SRC_REG, the watermark output on
+   INT1 and the sub-address auto-increment, which wraps from OUT_Z_H back to
+   OUT_X_L while the FIFO is enabled. It also counts the traffic on the bus. */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <deque>
+#include "lis3dh_fifo.h"
+
+class Lis3dhModel {
+public:
+    struct Stats {
+        size_t reads = 0;           /* read transactions */
+        size_t writes = 0;          /* write transactions */
+        size_t busBytes = 0;        /* bytes on the bus, slave address bytes included */
+        size_t lost = 0;            /* samples overwritten or refused by a full FIFO */
+    };
+
+    Lis3dhModel();
+
+    /* One output data period: the sensor produces a new sample */
+    void sample(int16_t x, int16_t y, int16_t z);
+
+    /* I2C transactions; bit 7 of 'sub' selects auto-increment */
+    void read(uint8_t sub, uint8_t* data, size_t len);
+    void write(uint8_t sub, const uint8_t* data, size_t len);
+
+    /* Level of the INT1 pin */
+    bool int1() const;
+
+    uint8_t reg(uint8_t addr) const
+    {
+        return regs_[addr & 0x7F];
+    }
+    size_t level() const
+    {
+        return fifo_.size();
+    }
+    Stats stats;
+    bool failBus = false;           /* NACK every transaction */
+
+private:
+    bool fifoOn() const;
+    uint8_t mode() const;
+    uint8_t fifoSrc() const;
+    uint8_t readByte(uint8_t addr);
+
+    uint8_t regs_[0x40];
+    std::deque<lis3dh_sample_t> fifo_;
+    lis3dh_sample_t current_;       /* output registers in bypass mode */
+};
+
+#endif /* LIS3DH_MODEL_H */
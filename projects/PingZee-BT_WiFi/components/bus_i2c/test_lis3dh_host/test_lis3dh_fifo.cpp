@@ -0,0 +1,235 @@
+// Copyright 2015-2017 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "catch.hpp"
+#include "lis3dh_model.h"
+#include "lis3dh.h"
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+using std::cout;
+using std::endl;
+
+static Lis3dhModel* model;
+
+/* Same calling convention as Lis3dh_readRegisterRegion / Lis3dh_writeRegister */
+static esp_err_t model_read(uint8_t* out, uint8_t offset, uint8_t length)
+{
+    model->read(offset | 0x80, out, length);
+    return model->failBus ? ESP_FAIL : ESP_OK;
+}
+
+static esp_err_t model_write(uint8_t offset, uint8_t data)
+{
+    model->write(offset, &data, 1);
+    return model->failBus ? ESP_FAIL : ESP_OK;
+}
+
+static const lis3dh_bus_t model_bus = { model_read, model_write };
+
+static lis3dh_sample_t nth_sample(int n)
+{
+    lis3dh_sample_t s = { (int16_t)(n * 16), (int16_t)(-n * 16), (int16_t)(16384 + n) };
+    return s;
+}
+
+static void feed(Lis3dhModel& m, int first, int count)
+{
+    for (int i = first; i < first + count; ++i) {
+        lis3dh_sample_t s = nth_sample(i);
+        m.sample(s.x, s.y, s.z);
+    }
+}
+
+TEST_CASE("start and stop set up the FIFO registers", "[lis3dh]")
+{
+    Lis3dhModel m;
+    model = &m;
+    lis3dh_fifo_t fifo = { &model_bus };
+
+    uint8_t reg3 = 0x10;            /* another INT1 source that must be kept */
+    m.write(LIS3DH_CTRL_REG3, &reg3, 1);
+    REQUIRE(lis3dh_fifo_start(&fifo, LIS3DH_FIFO_MODE_STREAM, 24) == ESP_OK);
+    CHECK(m.reg(LIS3DH_FIFO_CTRL_REG) == ((LIS3DH_FIFO_MODE_STREAM << 6) | 24));
+    CHECK((m.reg(LIS3DH_CTRL_REG5) & LIS3DH_CTRL_REG5_FIFO_EN) != 0);
+    CHECK(m.reg(LIS3DH_CTRL_REG3) == (0x10 | LIS3DH_CTRL_REG3_I1_WTM));
+
+    REQUIRE(lis3dh_fifo_stop(&fifo) == ESP_OK);
+    CHECK(m.reg(LIS3DH_FIFO_CTRL_REG) == 0);
+    CHECK((m.reg(LIS3DH_CTRL_REG5) & LIS3DH_CTRL_REG5_FIFO_EN) == 0);
+    CHECK(m.reg(LIS3DH_CTRL_REG3) == 0x10);
+}
+
+TEST_CASE("drain reads all samples in order with two transactions", "[lis3dh]")
+{
+    Lis3dhModel m;
+    model = &m;
+    lis3dh_fifo_t fifo = { &model_bus };
+    lis3dh_sample_t out[LIS3DH_FIFO_DEPTH];
+
+    REQUIRE(lis3dh_fifo_start(&fifo, LIS3DH_FIFO_MODE_STREAM, 24) == ESP_OK);
+    CHECK(lis3dh_fifo_drain(&fifo, out) == 0);
+
+    feed(m, 0, 20);
+    size_t reads = m.stats.reads;
+    REQUIRE(lis3dh_fifo_drain(&fifo, out) == 20);
+    CHECK(m.stats.reads - reads == 2);
+    for (int i = 0; i < 20; ++i) {
+        lis3dh_sample_t s = nth_sample(i);
+        CHECK(out[i].x == s.x);
+        CHECK(out[i].y == s.y);
+        CHECK(out[i].z == s.z);
+    }
+    CHECK(m.level() == 0);
+    CHECK(fifo.drains == 1);
+    CHECK(fifo.samples == 20);
+    CHECK(fifo.overruns == 0);
+}
+
+TEST_CASE("a full FIFO is drained completely", "[lis3dh]")
+{
+    lis3dh_sample_t out[LIS3DH_FIFO_DEPTH];
+
+    SECTION("stream mode keeps the newest samples") {
+        Lis3dhModel m;
+        model = &m;
+        lis3dh_fifo_t fifo = { &model_bus };
+        REQUIRE(lis3dh_fifo_start(&fifo, LIS3DH_FIFO_MODE_STREAM, 24) == ESP_OK);
+        feed(m, 0, 40);
+        REQUIRE(lis3dh_fifo_drain(&fifo, out) == LIS3DH_FIFO_DEPTH);
+        CHECK(out[0].x == nth_sample(8).x);
+        CHECK(out[LIS3DH_FIFO_DEPTH - 1].x == nth_sample(39).x);
+        CHECK(fifo.overruns == 1);
+        CHECK(m.level() == 0);
+    }
+    SECTION("FIFO mode keeps the oldest samples") {
+        Lis3dhModel m;
+        model = &m;
+        lis3dh_fifo_t fifo = { &model_bus };
+        REQUIRE(lis3dh_fifo_start(&fifo, LIS3DH_FIFO_MODE_FIFO, 24) == ESP_OK);
+        feed(m, 0, 40);
+        REQUIRE(lis3dh_fifo_drain(&fifo, out) == LIS3DH_FIFO_DEPTH);
+        CHECK(out[0].x == nth_sample(0).x);
+        CHECK(out[LIS3DH_FIFO_DEPTH - 1].x == nth_sample(31).x);
+        CHECK(fifo.overruns == 1);
+    }
+}
+
+TEST_CASE("watermark driven draining loses no sample", "[lis3dh]")
+{
+    Lis3dhModel m;
+    model = &m;
+    lis3dh_fifo_t fifo = { &model_bus };
+    lis3dh_sample_t out[LIS3DH_FIFO_DEPTH];
+    std::vector<lis3dh_sample_t> got;
+
+    REQUIRE(lis3dh_fifo_start(&fifo, LIS3DH_FIFO_MODE_STREAM, 24) == ESP_OK);
+    /* 10 s at 50 Hz; the task services the FIFO on the rising edge of INT1 */
+    bool int1 = false;
+    for (int i = 0; i < 500; ++i) {
+        lis3dh_sample_t s = nth_sample(i);
+        m.sample(s.x, s.y, s.z);
+        if (m.int1() && !int1) {
+            int n = lis3dh_fifo_drain(&fifo, out);
+            REQUIRE(n > 24);
+            got.insert(got.end(), out, out + n);
+        }
+        int1 = m.int1();
+    }
+    int n = lis3dh_fifo_drain(&fifo, out);
+    got.insert(got.end(), out, out + n);
+
+    REQUIRE(got.size() == 500);
+    for (int i = 0; i < 500; ++i) {
+        CHECK(got[i].x == nth_sample(i).x);
+    }
+    CHECK(m.stats.lost == 0);
+    CHECK(fifo.overruns == 0);
+    CHECK(fifo.drains == 20);
+}
+
+TEST_CASE("drain reports bus errors", "[lis3dh]")
+{
+    Lis3dhModel m;
+    model = &m;
+    lis3dh_fifo_t fifo = { &model_bus };
+    lis3dh_sample_t out[LIS3DH_FIFO_DEPTH];
+
+    REQUIRE(lis3dh_fifo_start(&fifo, LIS3DH_FIFO_MODE_STREAM, 24) == ESP_OK);
+    feed(m, 0, 10);
+    m.failBus = true;
+    CHECK(lis3dh_fifo_drain(&fifo, out) == -1);
+    CHECK(lis3dh_fifo_start(&fifo, LIS3DH_FIFO_MODE_STREAM, 24) != ESP_OK);
+    CHECK(fifo.samples == 0);
+}
+
+/* Bus time at 400 kHz, 9 clocks per byte */
+static double bus_us(size_t bytes)
+{
+    return bytes * 9 / 0.4;
+}
+
+TEST_CASE("polling versus FIFO bursts", "[lis3dh][bench]")
+{
+    const int samples = 500;
+
+    /* Polling as readFloatAccelX/Y/Z do it: one two-byte read per axis */
+    Lis3dhModel poll;
+    model = &poll;
+    for (int i = 0; i < samples; ++i) {
+        lis3dh_sample_t s = nth_sample(i);
+        poll.sample(s.x, s.y, s.z);
+        uint8_t raw[2];
+        for (int axis = 0; axis < 3; ++axis) {
+            model_read(raw, LIS3DH_OUT_X_L + 2 * axis, 2);
+        }
+    }
+
+    cout << "LIS3DH, " << samples << " X/Y/Z samples" << endl;
+    cout << std::setw(12) << "watermark" << std::setw(14) << "transactions"
+         << std::setw(12) << "bytes" << std::setw(14) << "bus us/sample" << endl;
+    cout << std::setw(12) << "polled" << std::setw(14) << poll.stats.reads
+         << std::setw(12) << poll.stats.busBytes
+         << std::setw(14) << std::fixed << std::setprecision(1) << bus_us(poll.stats.busBytes) / samples << endl;
+
+    const uint8_t watermarks[] = { 1, 4, 8, 16, 24, 30 };
+    for (uint8_t wtm : watermarks) {
+        Lis3dhModel m;
+        model = &m;
+        lis3dh_fifo_t fifo = { &model_bus };
+        lis3dh_sample_t out[LIS3DH_FIFO_DEPTH];
+        REQUIRE(lis3dh_fifo_start(&fifo, LIS3DH_FIFO_MODE_STREAM, wtm) == ESP_OK);
+        Lis3dhModel::Stats setup = m.stats;
+        int got = 0;
+        bool int1 = false;
+        for (int i = 0; i < samples; ++i) {
+            lis3dh_sample_t s = nth_sample(i);
+            m.sample(s.x, s.y, s.z);
+            if (m.int1() && !int1) {
+                got += lis3dh_fifo_drain(&fifo, out);
+            }
+            int1 = m.int1();
+        }
+        got += lis3dh_fifo_drain(&fifo, out);
+        REQUIRE(got == samples);
+        size_t reads = m.stats.reads - setup.reads;
+        size_t bytes = m.stats.busBytes - setup.busBytes;
+        cout << std::setw(12) << (int)wtm << std::setw(14) << reads
+             << std::setw(12) << bytes
+             << std::setw(14) << bus_us(bytes) / samples << endl;
+        if (wtm >= 8) {
+            CHECK(bytes < poll.stats.busBytes / 2);
+        }
+    }
+}
@@ -0,0 +1,149 @@
+// Copyright 2015-2017 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <string.h>
+#include "catch.hpp"
+#include "lis3dh_model.h"
+#include "lis3dh.h"
+#include "lis3dh_i2c.h"
+#include "app.h"
+#include "board.h"
+
+/* The I2C0 task, run against the register model. A message can be made to
+   fail the way I2C0MsgGet() reports a NACK, a hung bus or a missing result. */
+static Lis3dhModel* model;
+static int taken;                   /* I2C0Take() calls not yet given back */
+static int failIn = -1;             /* messages until the next failure, -1 for none */
+static portBASE_TYPE result;
+
+extern "C" portBASE_TYPE I2C0Take(void* pvParameters)
+{
+    taken++;
+    return pdPASS;
+}
+
+extern "C" portBASE_TYPE I2C0Give(void* pvParameters)
+{
+    taken--;
+    return pdPASS;
+}
+
+extern "C" portBASE_TYPE I2C0OnDone(void* pvParameters)
+{
+    return pdPASS;
+}
+
+extern "C" portBASE_TYPE I2C0MsgPut(pI2CMessage msg)
+{
+    REQUIRE(taken == 1);
+    REQUIRE(msg->tx.chip == LIS3DH_I2C_ADDR);
+    REQUIRE(msg->tx.length >= 1);
+    if (failIn >= 0 && failIn-- == 0) {
+        /* nothing trustworthy lands in the buffer */
+        if (msg->rx.length) {
+            memset(msg->rx.buffer, 0xAA, msg->rx.length);
+        }
+        result = pdFAIL;
+        return pdPASS;
+    }
+    const uint8_t* tx = static_cast<const uint8_t*>(msg->tx.buffer);
+    if (msg->rx.length) {
+        model->read(tx[0], static_cast<uint8_t*>(msg->rx.buffer), msg->rx.length);
+    } else {
+        model->write(tx[0], tx + 1, msg->tx.length - 1);
+    }
+    result = pdPASS;
+    return pdPASS;
+}
+
+extern "C" portBASE_TYPE I2C0MsgGet(pI2CMessage msg)
+{
+    if (result == pdPASS && msg->i2c__doneCallback != NULL) {
+        msg->i2c__doneCallback(msg);
+    }
+    return result;
+}
+
+static const lis3dh_bus_t i2c_bus = { Lis3dh_readRegisterRegion, Lis3dh_writeRegister };
+
+static void feed(Lis3dhModel& m, int count)
+{
+    for (int i = 0; i < count; ++i) {
+        m.sample((int16_t)(i * 16), (int16_t)(-i * 16), (int16_t)(16384 + i));
+    }
+}
+
+TEST_CASE("registers go through the I2C task", "[lis3dh]")
+{
+    Lis3dhModel m;
+    model = &m;
+    failIn = -1;
+    uint8_t value = 0;
+
+    REQUIRE(Lis3dh_writeRegister(LIS3DH_CTRL_REG3, 0x10) == ESP_OK);
+    CHECK(m.reg(LIS3DH_CTRL_REG3) == 0x10);
+    REQUIRE(Lis3dh_readRegister(&value, LIS3DH_CTRL_REG3) == ESP_OK);
+    CHECK(value == 0x10);
+
+    lis3dh_fifo_t fifo = { &i2c_bus };
+    lis3dh_sample_t out[LIS3DH_FIFO_DEPTH];
+    REQUIRE(lis3dh_fifo_start(&fifo, LIS3DH_FIFO_MODE_STREAM, 24) == ESP_OK);
+    feed(m, 20);
+    REQUIRE(lis3dh_fifo_drain(&fifo, out) == 20);
+    CHECK(out[19].z == 16384 + 19);
+    CHECK(taken == 0);
+}
+
+TEST_CASE("drain reports a failed I2C message", "[lis3dh]")
+{
+    Lis3dhModel m;
+    model = &m;
+    failIn = -1;
+    lis3dh_fifo_t fifo = { &i2c_bus };
+    lis3dh_sample_t out[LIS3DH_FIFO_DEPTH];
+
+    REQUIRE(lis3dh_fifo_start(&fifo, LIS3DH_FIFO_MODE_STREAM, 24) == ESP_OK);
+    feed(m, 10);
+
+    SECTION("reading FIFO_SRC_REG fails") {
+        failIn = 0;
+        CHECK(lis3dh_fifo_drain(&fifo, out) == -1);
+    }
+    SECTION("the burst read fails") {
+        failIn = 1;
+        CHECK(lis3dh_fifo_drain(&fifo, out) == -1);
+    }
+    CHECK(fifo.drains == 0);
+    CHECK(fifo.samples == 0);
+    CHECK(taken == 0);
+
+    /* the bus recovers: the samples are still there */
+    CHECK(lis3dh_fifo_drain(&fifo, out) == 10);
+}
+
+TEST_CASE("register access reports a failed I2C message", "[lis3dh]")
+{
+    Lis3dhModel m;
+    model = &m;
+    lis3dh_fifo_t fifo = { &i2c_bus };
+    uint8_t value;
+
+    failIn = 0;
+    CHECK(Lis3dh_readRegister(&value, LIS3DH_WHO_AM_I) == ESP_FAIL);
+    failIn = 0;
+    CHECK(Lis3dh_writeRegister(LIS3DH_CTRL_REG1, 0x57) == ESP_FAIL);
+    CHECK(m.reg(LIS3DH_CTRL_REG1) != 0x57);
+    failIn = 0;
+    CHECK(lis3dh_fifo_start(&fifo, LIS3DH_FIFO_MODE_STREAM, 24) != ESP_OK);
+    CHECK(taken == 0);
+}
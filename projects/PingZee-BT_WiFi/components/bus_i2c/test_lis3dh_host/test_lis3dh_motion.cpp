@@ -0,0 +1,242 @@
+// Copyright 2015-2017 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "catch.hpp"
+#include "lis3dh_motion.h"
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+using std::cout;
+using std::endl;
+
+static const double pi = 3.14159265358979;
+
+/* Raw output for an acceleration in mg, as the sensor at 'range' g produces it */
+static int16_t raw_of(double mg, uint8_t range)
+{
+    double v = std::round(mg * lis3dh_lsb_per_g(range) / 1000.0);
+    return (int16_t)std::max(-32768.0, std::min(32767.0, v));
+}
+
+static lis3dh_sample_t mg_sample(double x, double y, double z)
+{
+    lis3dh_sample_t s = { (int16_t)std::lround(x), (int16_t)std::lround(y), (int16_t)std::lround(z) };
+    return s;
+}
+
+/* Feed 'in' to 'm' in batches of 'batch' samples; returns the summed steps and taps */
+static void feed_all(lis3dh_motion_t* m, const std::vector<lis3dh_sample_t>& in, int batch,
+                     int* steps, int* taps, int* active)
+{
+    lis3dh_features_t f;
+    *steps = *taps = *active = 0;
+    for (size_t i = 0; i < in.size(); i += batch) {
+        int n = (int)std::min<size_t>(batch, in.size() - i);
+        lis3dh_motion_feed(m, &in[i], n, &f);
+        *steps += f.steps;
+        *taps += f.taps;
+        *active += f.active;
+    }
+}
+
+/* Walking: |a| swings around 1 g twice a second */
+static std::vector<lis3dh_sample_t> walk(int odr, double seconds, double swing_mg)
+{
+    std::vector<lis3dh_sample_t> v;
+    for (int i = 0; i < odr * seconds; ++i) {
+        double t = (double)i / odr;
+        double a = 1000 + swing_mg * std::sin(2 * pi * 2 * t);
+        v.push_back(mg_sample(0.2 * a, 0.1 * a, std::sqrt(1 - 0.05) * a));
+    }
+    return v;
+}
+
+TEST_CASE("Q16 conversion matches the float conversion", "[lis3dh]")
+{
+    const uint8_t ranges[] = { 2, 4, 8, 16 };
+    for (uint8_t range : ranges) {
+        int32_t scale = lis3dh_mg_scale(range);
+        std::vector<int16_t> raw, mg(65536);
+        for (int v = -32768; v <= 32767; ++v) {
+            raw.push_back((int16_t)v);
+        }
+        lis3dh_to_mg(mg.data(), raw.data(), (int)raw.size(), scale);
+        int worst = 0;
+        for (size_t i = 0; i < raw.size(); ++i) {
+            double expected = raw[i] * 1000.0 / lis3dh_lsb_per_g(range);
+            worst = std::max(worst, (int)std::lround(std::fabs(mg[i] - expected) * 1000));
+        }
+        INFO("range " << (int)range << " g, worst error " << worst << " ug");
+        CHECK(worst <= 1000);
+    }
+    CHECK(lis3dh_mg_scale(3) == 0);
+
+    int16_t odd[5] = { raw_of(1000, 2), raw_of(-1000, 2), raw_of(500, 2), raw_of(0, 2), raw_of(-2000, 2) };
+    lis3dh_to_mg(odd, odd, 5, lis3dh_mg_scale(2));
+    CHECK(odd[0] == 1000);
+    CHECK(odd[1] == -1000);
+    CHECK(odd[2] == 500);
+    CHECK(odd[3] == 0);
+    CHECK(odd[4] == -2000);
+}
+
+TEST_CASE("features of a board at rest", "[lis3dh]")
+{
+    lis3dh_motion_t m;
+    lis3dh_motion_init(&m, 2, 50);
+    std::vector<lis3dh_sample_t> v(32, mg_sample(0, 0, 1000));
+    lis3dh_features_t f;
+    lis3dh_motion_feed(&m, v.data(), (int)v.size(), &f);
+
+    CHECK(f.mean[2] == 1000);
+    CHECK(f.min[2] == 1000);
+    CHECK(f.max[2] == 1000);
+    CHECK(f.rms[0] == 0);
+    CHECK(f.rms[2] == 0);
+    CHECK(f.mag_mean == 1000);
+    CHECK(f.mag_rms == 0);
+    CHECK(f.steps == 0);
+    CHECK(f.taps == 0);
+    CHECK(f.active == 0);
+
+    lis3dh_motion_feed(&m, v.data(), 0, &f);
+    CHECK(f.active == 0);
+}
+
+TEST_CASE("per axis statistics", "[lis3dh]")
+{
+    lis3dh_motion_t m;
+    lis3dh_motion_init(&m, 2, 50);
+    std::vector<lis3dh_sample_t> v;
+    for (int i = 0; i < 32; ++i) {
+        v.push_back(mg_sample((i & 1) ? 300 : 100, -50 - i, 1000));
+    }
+    lis3dh_features_t f;
+    lis3dh_motion_feed(&m, v.data(), (int)v.size(), &f);
+
+    CHECK(f.min[0] == 100);
+    CHECK(f.max[0] == 300);
+    CHECK(f.mean[0] == 200);
+    CHECK(f.rms[0] == 100);
+    CHECK(f.min[1] == -81);
+    CHECK(f.max[1] == -50);
+    CHECK(f.rms[1] == 9);           /* 0..31 has a standard deviation of 9.23 */
+    CHECK(f.mag_min >= 1000);
+    CHECK(f.mag_max == (uint16_t)std::sqrt(300 * 300 + 81 * 81 + 1000 * 1000));
+}
+
+TEST_CASE("steps are counted across batch boundaries", "[lis3dh]")
+{
+    std::vector<lis3dh_sample_t> v = walk(50, 10, 400);
+    const int batches[] = { 1, 7, 24, 32 };
+    for (int batch : batches) {
+        lis3dh_motion_t m;
+        lis3dh_motion_init(&m, 2, 50);
+        int steps, taps, active;
+        feed_all(&m, v, batch, &steps, &taps, &active);
+        INFO("batch " << batch);
+        CHECK(steps == 20);
+        CHECK(m.steps == 20);
+        CHECK(taps == 0);
+    }
+
+    /* A gentle sway is neither a step nor motion */
+    std::vector<lis3dh_sample_t> sway = walk(50, 10, 30);
+    lis3dh_motion_t m;
+    lis3dh_motion_init(&m, 2, 50);
+    int steps, taps, active;
+    feed_all(&m, sway, 25, &steps, &taps, &active);
+    CHECK(steps == 0);
+    CHECK(active == 0);
+}
+
+TEST_CASE("a tap is not a step", "[lis3dh]")
+{
+    lis3dh_motion_t m;
+    lis3dh_motion_init(&m, 16, 100);
+    std::vector<lis3dh_sample_t> v(100, mg_sample(0, 0, 1000));
+    v[40] = mg_sample(0, 0, 3500);
+    v[41] = mg_sample(0, 0, -800);
+    int steps, taps, active;
+    feed_all(&m, v, 32, &steps, &taps, &active);
+    CHECK(taps == 1);
+    CHECK(steps == 0);
+    CHECK(active == 1);
+}
+
+struct Timer {
+#if defined(__x86_64__) || defined(__i386__)
+    static const char* unit() { return "cycles"; }
+    static uint64_t now() { return __rdtsc(); }
+#else
+    static const char* unit() { return "ns"; }
+    static uint64_t now()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+#endif
+};
+
+static volatile float float_sink;
+
+TEST_CASE("conversion and features per sample", "[lis3dh][bench]")
+{
+    const int rounds = 20000;
+    std::vector<lis3dh_sample_t> walking = walk(50, 32.0 / 50, 400);
+    std::vector<lis3dh_sample_t> raw;
+    for (const lis3dh_sample_t& s : walking) {
+        lis3dh_sample_t r = { raw_of(s.x, 2), raw_of(s.y, 2), raw_of(s.z, 2) };
+        raw.push_back(r);
+    }
+    std::vector<lis3dh_sample_t> mg(raw.size());
+    const int n = (int)raw.size();
+    const uint16_t lsb = lis3dh_lsb_per_g(2);
+
+    uint64_t t0 = Timer::now();
+    for (int r = 0; r < rounds; ++r) {
+        float acc = 0;
+        /* What Lis3dh_calcAccel does, one axis value at a time */
+        for (int i = 0; i < n; ++i) {
+            acc += (float)raw[i].x / lsb + (float)raw[i].y / lsb + (float)raw[i].z / lsb;
+        }
+        float_sink = acc;
+    }
+    uint64_t t1 = Timer::now();
+    for (int r = 0; r < rounds; ++r) {
+        lis3dh_to_mg((int16_t*)mg.data(), (const int16_t*)raw.data(), n * 3, lis3dh_mg_scale(2));
+        float_sink = mg[r % n].x;
+    }
+    uint64_t t2 = Timer::now();
+    lis3dh_motion_t m;
+    lis3dh_motion_init(&m, 2, 50);
+    lis3dh_features_t f;
+    for (int r = 0; r < rounds; ++r) {
+        lis3dh_motion_feed(&m, mg.data(), n, &f);
+    }
+    uint64_t t3 = Timer::now();
+
+    double per = (double)rounds * n;
+    cout << "LIS3DH batch of " << n << " samples, " << Timer::unit() << " per X/Y/Z sample" << endl;
+    cout << std::fixed << std::setprecision(1);
+    cout << std::setw(28) << "float divide per axis" << std::setw(10) << (t1 - t0) / per << endl;
+    cout << std::setw(28) << "Q16 to mg, batch" << std::setw(10) << (t2 - t1) / per << endl;
+    cout << std::setw(28) << "features" << std::setw(10) << (t3 - t2) / per << endl;
+    CHECK(m.steps > 0);
+}
@@ -0,0 +1,97 @@
+/*
+ * oled_fb.h
+ *
+ *
+ * \brief RAM framebuffer for the SSD1306 OLED with dirty area tracking.
+ *
+ *  The buffer uses the page layout of the controller's display RAM: one byte
+ *  holds 8 vertical pixels, LSB on top. Drawing only touches RAM; a flush
+ *  hands the changed column span of each page to the display driver, so a
+ *  redraw that changes nothing sends nothing.
+ *
+ *  Kept free of any hardware or RTOS dependency.
+ */
+
+#ifndef COMPONENTS_BUS_SPI_INCLUDE_OLED_FB_H_
+#define COMPONENTS_BUS_SPI_INCLUDE_OLED_FB_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//! \name Panel geometry, as configured by ssd1306_init() (1/32 duty)
+//@{
+#define OLED_FB_WIDTH				128
+#define OLED_FB_PAGES				4
+#define OLED_FB_HEIGHT				(OLED_FB_PAGES * 8)
+//@}
+
+typedef struct {
+	uint8_t buf[OLED_FB_PAGES][OLED_FB_WIDTH];
+	uint8_t dirty_first[OLED_FB_PAGES];	// first changed column of the page
+	uint8_t dirty_last[OLED_FB_PAGES];	// last changed column, below dirty_first if the page is clean
+} oled_fb_t;
+
+/**
+ * \brief Send a span of one page to the display
+ *
+ * \param ctx   context passed to oled_fb_flush()
+ * \param page  page address
+ * \param col   first column
+ * \param data  column bytes, valid until the callback returns
+ * \param len   number of columns
+ */
+typedef void (*oled_fb_write_t)(void *ctx, uint8_t page, uint8_t col, const uint8_t *data, uint16_t len);
+
+/**
+ * \brief Blank the framebuffer and mark the whole panel for the next flush
+ */
+void oled_fb_clear(oled_fb_t *fb);
+
+/**
+ * \brief Copy column bytes into a page, clipped at the right edge
+ *
+ * \retval the column following the last one written
+ */
+uint16_t oled_fb_blit(oled_fb_t *fb, uint8_t page, uint16_t col, const uint8_t *data, uint16_t len);
+
+/**
+ * \brief Fill columns of a page with one byte pattern, clipped at the right edge
+ *
+ * \retval the column following the last one written
+ */
+uint16_t oled_fb_fill(oled_fb_t *fb, uint8_t page, uint16_t col, uint8_t pattern, uint16_t len);
+
+/**
+ * \brief Draw one character of font_table, followed by its spacing column
+ *
+ * Characters outside the font are skipped.
+ *
+ * \retval the column following the character
+ */
+uint16_t oled_fb_glyph(oled_fb_t *fb, uint8_t page, uint16_t col, char c);
+
+/**
+ * \brief Draw a string with oled_fb_glyph(), clipped at the right edge
+ *
+ * \retval the column following the text
+ */
+uint16_t oled_fb_text(oled_fb_t *fb, uint8_t page, uint16_t col, const char *string);
+
+/**
+ * \brief Send the changed part of every page and mark the panel clean
+ *
+ * Each page with changes costs one call of 'write' with the span from its
+ * first to its last changed column.
+ *
+ * \retval number of data bytes handed to 'write'
+ */
+uint32_t oled_fb_flush(oled_fb_t *fb, oled_fb_write_t write, void *ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* COMPONENTS_BUS_SPI_INCLUDE_OLED_FB_H_ */
@@ -73,9 +73,15 @@
 #define ssd1306_sel_data()       gpio_set_level(SSD1306_PIN_NUM_DC, 1)
 #define ssd1306_sel_cmd()        gpio_set_level(SSD1306_PIN_NUM_DC, 0)
 
+// D/C# level of a transfer in a batch, set by the pre-transfer callback from spi_transaction_t::user;
+// transfers with a NULL user leave the line as selected above
+#define SSD1306_TRANS_CMD        ((void *)1)
+#define SSD1306_TRANS_DATA       ((void *)2)
+
 
 void ssd1306_spi_write_single(uint8_t data);
 void ssd1306_spi_write(uint8_t *data, unsigned short len);
+void ssd1306_spi_write_batch(spi_transaction_t *trans, int count);
 
 static inline void ssd1306_select_device(void) 
 {
@@ -100,12 +106,10 @@ static inline void ssd1306_deselect_device(void)
  */
 static void ssd1306_write_command(uint8_t command)
 {
-	SPITake(NULL);
 	ssd1306_select_device();
 	ssd1306_sel_cmd();
 	ssd1306_spi_write_single(command);
 	ssd1306_deselect_device();
-	SPIGive(NULL);
 }
 
 /**
@@ -118,23 +122,19 @@ static void ssd1306_write_command(uint8_t command)
  */
 static /* inline */ void ssd1306_write_data(uint8_t data)
 {
-	SPITake(NULL);
 	ssd1306_select_device();
 	ssd1306_sel_data();
 	ssd1306_spi_write_single(data);
 	ssd1306_deselect_device();
-	SPIGive(NULL);
 
 }
 
 static /* inline */ void ssd1306_write(uint8_t *data, unsigned short len)
 {
-	SPITake(NULL);
 	ssd1306_select_device();
 	ssd1306_sel_data();
 	ssd1306_spi_write(data, len);
 	ssd1306_deselect_device();
-	SPIGive(NULL);
 
 }
 
@@ -306,11 +306,6 @@ static /* inline */ void ssd1306_clear(void)
 void ssd1306_init(void);
 //@}
 
-//! \name Write text routine
-//@{
-void ssd1306_write_text(const char *string);
-//@}
-
 /** @} */
 
 #endif /* COMPONENTS_BUS_SPI_INCLUDE_SSD1306_H_ */
@@ -0,0 +1,121 @@
+/*
+ * oled_fb.c
+ *
+ *
+ * \brief RAM framebuffer for the SSD1306 OLED with dirty area tracking.
+ *
+ */
+
+#include <string.h>
+#include "oled_fb.h"
+#include "font.h"
+
+/* Blank column drawn after every character */
+#define OLED_FB_GLYPH_SPACING		0x00
+
+static inline void oled_fb_mark(oled_fb_t *fb, uint8_t page, uint8_t first, uint8_t last)
+{
+	if (fb->dirty_first[page] > fb->dirty_last[page]) {
+		fb->dirty_first[page] = first;
+		fb->dirty_last[page] = last;
+		return;
+	}
+	if (first < fb->dirty_first[page])	fb->dirty_first[page] = first;
+	if (last > fb->dirty_last[page])	fb->dirty_last[page] = last;
+}
+
+static inline void oled_fb_clean(oled_fb_t *fb, uint8_t page)
+{
+	fb->dirty_first[page] = 1;
+	fb->dirty_last[page] = 0;
+}
+
+void oled_fb_clear(oled_fb_t *fb)
+{
+	uint8_t page;
+
+	memset(fb->buf, 0, sizeof(fb->buf));
+	for (page = 0; page < OLED_FB_PAGES; page++) {
+		fb->dirty_first[page] = 0;
+		fb->dirty_last[page] = OLED_FB_WIDTH - 1;
+	}
+}
+
+/*
+ * Write columns [col, col + len) of a page from 'data', or with 'pattern' if
+ * 'data' is NULL. Only the span that actually changes is marked dirty.
+ */
+static uint16_t oled_fb_put(oled_fb_t *fb, uint8_t page, uint16_t col, const uint8_t *data, uint8_t pattern, uint16_t len)
+{
+	uint8_t *dst;
+	int first = -1, last = -1;
+	uint16_t i;
+
+	if (page >= OLED_FB_PAGES || col >= OLED_FB_WIDTH) {
+		return col + len;
+	}
+	if (len > OLED_FB_WIDTH - col) {
+		len = OLED_FB_WIDTH - col;
+	}
+	dst = &fb->buf[page][col];
+	for (i = 0; i < len; i++) {
+		uint8_t v = data ? data[i] : pattern;
+		if (dst[i] != v) {
+			dst[i] = v;
+			if (first < 0)	first = i;
+			last = i;
+		}
+	}
+	if (first >= 0) {
+		oled_fb_mark(fb, page, col + first, col + last);
+	}
+	return col + len;
+}
+
+uint16_t oled_fb_blit(oled_fb_t *fb, uint8_t page, uint16_t col, const uint8_t *data, uint16_t len)
+{
+	return oled_fb_put(fb, page, col, data, 0, len);
+}
+
+uint16_t oled_fb_fill(oled_fb_t *fb, uint8_t page, uint16_t col, uint8_t pattern, uint16_t len)
+{
+	return oled_fb_put(fb, page, col, NULL, pattern, len);
+}
+
+uint16_t oled_fb_glyph(oled_fb_t *fb, uint8_t page, uint16_t col, char c)
+{
+	const uint8_t *char_ptr;
+
+	if (c < 32 || c >= 0x7F) {
+		return col;
+	}
+	char_ptr = font_table[c - 32];
+	col = oled_fb_put(fb, page, col, &char_ptr[1], 0, char_ptr[0]);
+	return oled_fb_put(fb, page, col, NULL, OLED_FB_GLYPH_SPACING, 1);
+}
+
+uint16_t oled_fb_text(oled_fb_t *fb, uint8_t page, uint16_t col, const char *string)
+{
+	while (*string != 0 && col < OLED_FB_WIDTH) {
+		col = oled_fb_glyph(fb, page, col, *string++);
+	}
+	return col;
+}
+
+uint32_t oled_fb_flush(oled_fb_t *fb, oled_fb_write_t write, void *ctx)
+{
+	uint32_t sent = 0;
+	uint8_t page;
+	uint16_t len;
+
+	for (page = 0; page < OLED_FB_PAGES; page++) {
+		if (fb->dirty_first[page] > fb->dirty_last[page]) {
+			continue;
+		}
+		len = fb->dirty_last[page] - fb->dirty_first[page] + 1;
+		write(ctx, page, fb->dirty_first[page], &fb->buf[page][fb->dirty_first[page]], len);
+		sent += len;
+		oled_fb_clean(fb, page);
+	}
+	return sent;
+}
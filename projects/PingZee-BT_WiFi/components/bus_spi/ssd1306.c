@@ -21,6 +21,7 @@
 #include "board.h"
 #include "ssd1306.h"
 #include "font.h"
+#include "oled_fb.h"
 
 static const char *TAG = "ssd1306";
 
@@ -32,13 +33,45 @@ static spi_device_handle_t ssd1306_dev = NULL;
 #define OLED_OFF					(0x80)
 
 
-static xQueueHandle xOledInQueue = NULL;
-static xQueueHandle xOledOutQueue = NULL;
-static xSemaphoreHandle xOledMutex = NULL;
-
-static pOledMessage master_pOledMsg = NULL;   // current transaction ..
 static uint8_t ucOledStatus = OLED_NOT_INIT;
-static void prvOledTask( void *pvParameters );
+static void prvOledInit(msgbus_actor_t *actor);
+static esp_err_t prvOledHandle(msgbus_actor_t *actor, msgbus_msg_t *bus);
+
+static msgbus_actor_t xOledActor = {
+	.name = "OLED",
+	.queue_len = oledQUEUE_LENGTH,
+	.init = prvOledInit,
+	.handle = prvOledHandle,
+	.idle_ms = MSGBUS_WAIT_FOREVER,
+};
+
+/* What the panel shows; drawing goes here and only the changes are sent */
+static oled_fb_t xOledFb;
+
+/**
+ * \internal
+ * \brief Drive D/C# for the transfer about to start
+ *
+ * Called by the SPI driver from its interrupt handler, so that command and
+ * data transfers can be queued together as one batch.
+ */
+static void ssd1306_spi_pre_transfer(spi_transaction_t *t)
+{
+	if (t->user != NULL) {
+		gpio_set_level(SSD1306_PIN_NUM_DC, t->user == SSD1306_TRANS_DATA);
+	}
+}
+
+/**
+ * \internal
+ * \brief Run a request on the SPI task, a failed transfer is fatal
+ */
+static void ssd1306_spi_call(pSPIMessage msg)
+{
+	if (SPIMsgCall(msg) != ESP_OK) {
+		VApplicationGeneralFault;
+	}
+}
 
 /**
  * \internal
@@ -50,55 +83,39 @@ static void prvOledTask( void *pvParameters );
 static void ssd1306_interface_init(void)
 {
 
-	SPIMessage_t msg; 
+	SPIMessage_t msg = { .app_msg.bus = MSGBUS_MSG_INIT };
 
 
 	msg.app_msg.cmd = APPMSG_SPI_ADD_DEVICE;
 	msg.app_msg.d.v = SSD1306_PIN_NUM_CS;
-	msg.app_msg.app__doneCallback = SPIOnDone;
-	SPITake(NULL);
-
-	SPIMsgPut(&msg);
-	while (SPIMsgGet(&msg) != pdFAIL) {
-		break;
-	}
+	msg.pre_cb = ssd1306_spi_pre_transfer;
+	ssd1306_spi_call(&msg);
 
 	ssd1306_dev = msg.spi_dev;
 
 ESP_LOGI(TAG, "device added, handle@0x%x\n", (uint32_t)ssd1306_dev);
-
-	SPIGive(NULL);
 }
 
 void ssd1306_spi_write_single(uint8_t data)
 {
-	SPIMessage_t  msg, rc;
+	SPIMessage_t  msg = { .app_msg.bus = MSGBUS_MSG_INIT };
 
-	msg.spi__doneCallback = SPIOnDone; // default ..
 	msg.spi_dev = ssd1306_dev;
        memset(&msg.trans, 0, sizeof(spi_transaction_t));
 	msg.trans.length = 8;
 	msg.trans.user = NULL;
 	msg.trans.flags=SPI_TRANS_USE_TXDATA;
 	msg.trans.tx_data[0] = data;
+	msg.batch_count = 0;
 	msg.app_msg.cmd = APPMSG_NOP;
 
-//	 spiTRFTake(NULL);
-	 while (SPIMsgPut(&msg) != pdFAIL) {
-	 	break;
-	 }
-	 
-	 while (SPIMsgGet(&rc) != pdFAIL) {
-		break;
-	 }
-//	 spiTRFGive(NULL);
+	ssd1306_spi_call(&msg);
 }
 
 void ssd1306_spi_write(uint8_t *data, unsigned short len)
 {
-	SPIMessage_t  msg, rc;
+	SPIMessage_t  msg = { .app_msg.bus = MSGBUS_MSG_INIT };
 
-	msg.spi__doneCallback = SPIOnDone; // default ..
 	msg.spi_dev = ssd1306_dev;
        memset(&msg.trans, 0, sizeof(spi_transaction_t));
 	msg.trans.length = (len*8);
@@ -107,17 +124,63 @@ void ssd1306_spi_write(uint8_t *data, unsigned short len)
 	msg.trans.flags= 0;
 	msg.trans.tx_buffer = data;
 	msg.trans.rx_buffer = NULL;
+	msg.batch_count = 0;
 	msg.app_msg.cmd = APPMSG_NOP;
 
-//	 spiTRFTake(NULL);
-	 while (SPIMsgPut(&msg) != pdFAIL) {
-	 	break;
-	 }
-	 
-	 while (SPIMsgGet(&rc) != pdFAIL) {
-		break;
-	 }
-//	 spiTRFGive(NULL);
+	ssd1306_spi_call(&msg);
+}
+
+/**
+ * \brief Send transfers to the OLED back to back
+ *
+ * The D/C# line of each transfer is taken from its user member
+ * (SSD1306_TRANS_CMD or SSD1306_TRANS_DATA).
+ */
+void ssd1306_spi_write_batch(spi_transaction_t *trans, int count)
+{
+	SPIMessage_t  msg = { .app_msg.bus = MSGBUS_MSG_INIT };
+
+	msg.spi_dev = ssd1306_dev;
+	msg.batch = trans;
+	msg.batch_count = count;
+	msg.app_msg.cmd = APPMSG_NOP;
+
+	ssd1306_spi_call(&msg);
+}
+
+/**
+ * \internal
+ * \brief Set the page and column address and write data there
+ *
+ * The address commands and the data go out as one batch instead of a message
+ * round trip through the SPI task per command byte.
+ */
+static void ssd1306_write_at(uint8_t page, uint8_t column, const uint8_t *data, unsigned short len)
+{
+	spi_transaction_t t[2];
+
+	memset(t, 0, sizeof(t));
+	t[0].length = 3*8;
+	t[0].flags = SPI_TRANS_USE_TXDATA;
+	t[0].tx_data[0] = SSD1306_CMD_SET_PAGE_START_ADDRESS(page & 0x0F);
+	t[0].tx_data[1] = SSD1306_CMD_SET_HIGH_COL((column & 0x7F) >> 4);
+	t[0].tx_data[2] = SSD1306_CMD_SET_LOW_COL(column & 0x0F);
+	t[0].user = SSD1306_TRANS_CMD;
+	t[1].length = len*8;
+	t[1].tx_buffer = data;
+	t[1].user = SSD1306_TRANS_DATA;
+
+	ssd1306_spi_write_batch(t, len ? 2 : 1);
+}
+
+/**
+ * \internal
+ * \brief oled_fb_flush() callback, one batch per changed page
+ */
+static void ssd1306_fb_write(void *ctx, uint8_t page, uint8_t col, const uint8_t *data, uint16_t len)
+{
+	( void ) ctx;
+	ssd1306_write_at(page, col, data, len);
 }
 
 /**
@@ -184,42 +247,13 @@ void ssd1306_init(void)
 	ssd1306_display_on();
 }
 
-static /* inline */ void ssd1306_clear(void)
-{
-	uint8_t page = 0;
-	uint8_t col = 0;
-	
-
-	for (page = 0; page < 4; ++page)
-	{
-		ssd1306_set_page_address(page);
-		ssd1306_set_column_address(0);
-		for (col = 0; col < 128; ++col)
-		{
-			ssd1306_write_data(0x00);
-		}
-	}
-}
-
 /**
- * \brief Display text on OLED screen.
- * \param string String to display.
+ * \brief Blank the display RAM
  */
-void ssd1306_write_text(const char *string)
+static void ssd1306_clear(void)
 {
-	uint8_t *char_ptr;
-	uint8_t i;
-
-	while (*string != 0) {
-		if (*string < 0x7F) {
-			char_ptr = (uint8_t *)font_table[*string - 32];
-			for (i = 1; i <= char_ptr[0]; i++) {
-				ssd1306_write_data(char_ptr[i]);
-			}
-			ssd1306_write_data(0x20);
-		}
-			string++;
-	}
+	oled_fb_clear(&xOledFb);
+	oled_fb_flush(&xOledFb, ssd1306_fb_write, NULL);
 }
 
 /**
@@ -236,99 +270,63 @@ void ssd1306_write_bytes(const uint8_t *bytes, unsigned short len)
 
 void vOledStart( uint16_t usStackSize, portBASE_TYPE uxPriority )
 {
-	/* Create the queues used by tasks and interrupts to send/receive SPI data. */
-	xOledInQueue = xQueueCreate( oledQUEUE_LENGTH, sizeof(OledMessage_t) );
-	xOledOutQueue = xQueueCreate( 2, sizeof(OledMessage_t) );
-
-	/* If the queue could not be created then don't create any tasks that might
-	attempt to use the queue. */
-	if( xOledInQueue != NULL && xOledOutQueue != NULL)
+	/* Create that task that handles the OLED itself. */
+	xOledActor.stack_size = usStackSize;
+	xOledActor.priority = uxPriority;
+	if (msgbus_actor_start(&xOledActor) != ESP_OK)
 	{
-	
-		/* Create the semaphore used to access the SPI transmission. */
-		xOledMutex = xSemaphoreCreateMutex();
-		configASSERT( xOledMutex );
-
-		/* Create that task that handles the I2C Master itself. */
-		xTaskCreate(prvOledTask,	/* The task that implements the command console. */
-					(const char *const) "OLED",		/* Text name assigned to the task.  This is just to assist debugging.  The kernel does not use this name itself. */
-					usStackSize,					/* The size of the stack allocated to the task. */
-					NULL,						/* The parameter is not used, so NULL is passed. */
-					uxPriority,					/* The priority allocated to the task. */
-					NULL );						/* A handle is not required, so just pass NULL. */
-
+		VApplicationGeneralFault;
 	}
 }
 
 /*-----------------------------------------------------------*/
-static void prvOledTask( void *pvParameters )
+static void prvOledInit(msgbus_actor_t *actor)
+{
+	( void ) actor;
+
+	vTaskDelay((portTickType)(250 / portTICK_RATE_MS));
+
+	while(!isSPIReady()) {
+		vTaskDelay(100);
+	}
+
+	vTaskDelay((portTickType)(250 / portTICK_RATE_MS));
+
+	ssd1306_init();
+	// The framebuffer has to match the panel
+	ssd1306_clear();
+	ucOledStatus = OLED_INIT;
+}
+
+static esp_err_t prvOledHandle(msgbus_actor_t *actor, msgbus_msg_t *bus)
 {
-	OledMessage_t _OledMsg;   // current transaction ..
-	( void ) pvParameters;
-
-		master_pOledMsg = &_OledMsg;
-		_OledMsg.app_msg.cmd = APPMSG_OLED_INIT;
-		master_pOledMsg->app_msg.app__doneCallback = NULL;
-		master_pOledMsg->oled__doneCallback = NULL;
-
-		vTaskDelay((portTickType)(250 / portTICK_RATE_MS));
-		
-		while(!isSPIReady()) {
-			vTaskDelay(100);
-		}
-
-		vTaskDelay((portTickType)(250 / portTICK_RATE_MS));
-		
-		OledMsgPut(master_pOledMsg);
-
-		vTaskDelay((portTickType)(250 / portTICK_RATE_MS));
-		
-		while(1)
-		{	
-			if( xQueueReceive( xOledInQueue, master_pOledMsg, portMAX_DELAY) == pdPASS)
-			{
-				switch (master_pOledMsg ->app_msg.cmd)
-				{
-					case APPMSG_GET_STACK_ROOM:
-							master_pOledMsg->app_msg.d.v= uxTaskGetStackHighWaterMark(NULL);
-							if (master_pOledMsg->app_msg.app__doneCallback != NULL)
-								master_pOledMsg->app_msg.app__doneCallback(master_pOledMsg);
-						break;
-					case APPMSG_OLED_INIT: 
-						if (isSPIReady()) {		
-							ssd1306_init();
-							ucOledStatus = OLED_INIT;
-						}else{
-							// [ADK] Temporary, until we will have ALL tasks implemented
-							VApplicationGeneralFault;
-						}
-						
-						// Might as well clear too
-						// ssd1306_clear();
-						
-						break;
-					case APPMSG_OLED_CLEAN: 
-						 vOledWriteRaw(master_pOledMsg->y, master_pOledMsg->x, master_pOledMsg->str, master_pOledMsg->strLen);
-						break;
-					case APPMSG_OLED_SHOW:
-						 vOledWrite(master_pOledMsg->y, master_pOledMsg->x, master_pOledMsg->str);
-						break;
-				}
-			}
-			if (master_pOledMsg->oled__doneCallback)
-				master_pOledMsg->oled__doneCallback((void *)master_pOledMsg);
-			
-		}
+	pOledMessage master_pOledMsg = (pOledMessage)bus;   // current transaction ..
+	( void ) actor;
+
+	switch (master_pOledMsg ->app_msg.cmd)
+	{
+		case APPMSG_GET_STACK_ROOM:
+				master_pOledMsg->app_msg.d.v= uxTaskGetStackHighWaterMark(NULL);
+			break;
+		case APPMSG_OLED_CLEAN:
+			if (master_pOledMsg->str == NULL)
+				ssd1306_clear();
+			else
+				vOledWriteRaw(master_pOledMsg->y, master_pOledMsg->x, master_pOledMsg->str, master_pOledMsg->strLen);
+			break;
+		case APPMSG_OLED_SHOW:
+				vOledWrite(master_pOledMsg->y, master_pOledMsg->x, master_pOledMsg->str);
+			break;
+		default:
+			return ESP_ERR_NOT_SUPPORTED;
+	}
+	return ESP_OK;
 }
 /*-----------------------------------------------------------*/
 
-portBASE_TYPE OledMsgPut(pOledMessage msg)
+esp_err_t OledMsgCall(pOledMessage msg)
 {
-	if(xQueueSend(xOledInQueue, msg, ( portTickType ) 10) != pdPASS)
-		{
-			VApplicationGeneralFault;
-		}
-	return pdPASS;
+	return msgbus_call(&xOledActor, &msg->app_msg.bus);
 }
 
 portBASE_TYPE isOledReady(void) 
@@ -337,60 +335,39 @@ portBASE_TYPE isOledReady(void)
 	return pdFALSE;
 }
 
-/*-----------------------------------------------------------*/
-portBASE_TYPE  OledOnDone(void *pvParameters)
-{
-	pOledMessage msg = (pOledMessage)pvParameters;
-
-	if(xQueueSend(xOledOutQueue, msg, ( portTickType ) (10 /portTICK_RATE_MS)) != pdPASS)
-	{
-		VApplicationGeneralFault;
-	}
-		
-	return pdPASS;
-}	
-portBASE_TYPE OledMsgGet(pOledMessage msg)
-{
-	return xQueueReceive(xOledOutQueue, msg, portMAX_DELAY);
-}
-
 /*-----------------------------------------------------------*/
 void vOledClean(void)
 {
-	OledMessage_t _OledMsg;   // current transaction ..
+	OledMessage_t _OledMsg = { .app_msg.bus = MSGBUS_MSG_INIT };
+
 	_OledMsg.app_msg.cmd = APPMSG_OLED_CLEAN;
-	OledMsgPut(&_OledMsg);
+	_OledMsg.str = NULL;
+	OledMsgCall(&_OledMsg);
 }
 
 
 void OledDisplay(unsigned char Row, unsigned char Col, unsigned char *Str)
 {
-	OledMessage_t _OledMsg;
+	OledMessage_t _OledMsg = { .app_msg.bus = MSGBUS_MSG_INIT };
 
 	_OledMsg.app_msg.cmd = APPMSG_OLED_SHOW;
 	_OledMsg.y = Row;
 	_OledMsg.x = Col;
 	_OledMsg.str = Str;
 	_OledMsg.strLen = strlen((const char *)Str);
-	_OledMsg.oled__doneCallback = OledOnDone;
 
-	OledMsgPut(&_OledMsg);
-	while(OledMsgGet(&_OledMsg) != pdFAIL) {break;}
+	OledMsgCall(&_OledMsg);
 }
 
 void vOledWrite(unsigned char y, unsigned char x, unsigned char *str)
 {
-	ssd1306_set_page_address(y);
-	ssd1306_set_column_address(x);
-	ssd1306_write_text((const char *)str);
+	oled_fb_text(&xOledFb, y, x, (const char *)str);
+	oled_fb_flush(&xOledFb, ssd1306_fb_write, NULL);
 }
 
 void vOledWriteRaw(unsigned char y, unsigned char x, unsigned char *str, unsigned short len)
 {
-	ssd1306_sel_cmd();
-	ssd1306_set_page_address(y);
-	ssd1306_set_column_address(x);
-	ssd1306_sel_data();	
-	ssd1306_write_bytes((const uint8_t *)str, len);
+	oled_fb_blit(&xOledFb, y, x, (const uint8_t *)str, len);
+	oled_fb_flush(&xOledFb, ssd1306_fb_write, NULL);
 }
 
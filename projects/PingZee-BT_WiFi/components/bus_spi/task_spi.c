@@ -27,13 +27,16 @@ static const char *TAG = "SPI_master";
 
 #define spiQUEUE_LENGTH				( 4 )
 
-static xQueueHandle xSPIMasterInQueue = NULL;
-static xQueueHandle xSPIMasterOutQueue = NULL;
-static xSemaphoreHandle xSPIMutex = NULL;
-
-static void prvSPIMasterTask( void *pvParameters );
-
-static pSPIMessage master_pSPIMsg = NULL;   // current transaction ..
+static void prvSPIMasterInit(msgbus_actor_t *actor);
+static esp_err_t prvSPIMasterHandle(msgbus_actor_t *actor, msgbus_msg_t *bus);
+
+static msgbus_actor_t xSPIActor = {
+	.name = "SPI",
+	.queue_len = spiQUEUE_LENGTH,
+	.init = prvSPIMasterInit,
+	.handle = prvSPIMasterHandle,
+	.idle_ms = MSGBUS_WAIT_FOREVER,
+};
 static unsigned char SPI_init = 0;
 
 
@@ -53,7 +56,7 @@ static void spi_init(void)
     configASSERT(ret==ESP_OK);
 }
 
-static void device_init(spi_device_handle_t *spi, int cs)
+static void device_init(spi_device_handle_t *spi, int cs, transaction_cb_t pre_cb)
 {
     esp_err_t ret;
     spi_device_interface_config_t devcfg={
@@ -61,7 +64,7 @@ static void device_init(spi_device_handle_t *spi, int cs)
         .mode=0,						//SPI mode 0
         .spics_io_num=cs,				//CS pin
         .queue_size=3,					//We want to be able to queue 3 transactions at a time
-        .pre_cb=NULL,					//Specify pre-transfer callback to handle D/C line (for example)
+        .pre_cb=pre_cb,					//Pre-transfer callback, handles the D/C line of the OLED
     };
     //Attach the device to the SPI bus
     ret=spi_bus_add_device(HSPI_HOST, &devcfg, spi);
@@ -71,72 +74,53 @@ static void device_init(spi_device_handle_t *spi, int cs)
 void vSPIMasterStart( uint16_t usStackSize, UBaseType_t uxPriority)
 {
 	spi_init();
-	/* Create the queues used by tasks and interrupts to send/receive SPI data. */
-	xSPIMasterInQueue = xQueueCreate( spiQUEUE_LENGTH, sizeof(SPIMessage_t) );
-	xSPIMasterOutQueue = xQueueCreate( 1, sizeof(SPIMessage_t) );
-
-	/* If the queue could not be created then don't create any tasks that might
-	attempt to use the queue. */
-	if( xSPIMasterInQueue != NULL && xSPIMasterOutQueue != NULL)
+	/* Create that task that handles the SPI Master itself. */
+	xSPIActor.stack_size = usStackSize;
+	xSPIActor.priority = uxPriority;
+	if (msgbus_actor_start(&xSPIActor) != ESP_OK)
 	{
-	
-		/* Create the semaphore used to access the SPI transmission. */
-		xSPIMutex = xSemaphoreCreateMutex();
-		configASSERT( xSPIMutex );
-		/* Create that task that handles the I2C Master itself. */
-		xTaskCreate(	prvSPIMasterTask,			/* The task that implements the command console. */
-						(const char *const) "SPI",		/* Text name assigned to the task.  This is just to assist debugging.  The kernel does not use this name itself. */
-						usStackSize,					/* The size of the stack allocated to the task. */
-						NULL,						/* The parameter is not used, so NULL is passed. */
-						uxPriority,					/* The priority allocated to the task. */
-						NULL );						/* A handle is not required, so just pass NULL. */
+		VApplicationGeneralFault;
 	}
-
 }
 
 
 /*-----------------------------------------------------------*/
-static void prvSPIMasterTask( void *pvParameters )
+static void prvSPIMasterInit(msgbus_actor_t *actor)
 {
-	SPIMessage_t _SPIMsg;   // current transaction ..
-	( void ) pvParameters;
-	esp_err_t  ret;
+	( void ) actor;
+	SPI_init = 1;
+}
+
+static esp_err_t prvSPIMasterHandle(msgbus_actor_t *actor, msgbus_msg_t *bus)
+{
+	pSPIMessage master_pSPIMsg = (pSPIMessage)bus;   // current transaction ..
+	( void ) actor;
+	esp_err_t  ret = ESP_OK;
 	spi_transaction_t *rtrans;
 
-		master_pSPIMsg = &_SPIMsg;
-		while(1)
-		{
-			SPI_init = 1;
-			if( xQueueReceive( xSPIMasterInQueue, master_pSPIMsg, portMAX_DELAY) == pdPASS)
-			{
-				if (master_pSPIMsg->app_msg.cmd)
-				{
-					switch (master_pSPIMsg->app_msg.cmd) {
-						case APPMSG_SPI_ADD_DEVICE:
-								device_init(&master_pSPIMsg->spi_dev, master_pSPIMsg->app_msg.d.v);
-							break;
-						case APPMSG_GET_STACK_ROOM:
-								master_pSPIMsg->app_msg.d.v= uxTaskGetStackHighWaterMark(NULL);
-							break;
-					}
-					if (master_pSPIMsg->app_msg.app__doneCallback != NULL)
-						master_pSPIMsg->app_msg.app__doneCallback(master_pSPIMsg);
-				}else{
-
-					ret=spi_device_queue_trans(master_pSPIMsg->spi_dev, &master_pSPIMsg->trans, portMAX_DELAY);
-					if (ret != ESP_OK) {
-						VApplicationGeneralFault;
-					}
-					ret=spi_device_get_trans_result(master_pSPIMsg->spi_dev, &rtrans, portMAX_DELAY);
-					if (ret != ESP_OK) {
-						VApplicationGeneralFault;
-					}
-
-					if (master_pSPIMsg->spi__doneCallback != NULL)
-					master_pSPIMsg->spi__doneCallback(master_pSPIMsg);
-				}
-			}
+	if (master_pSPIMsg->app_msg.cmd)
+	{
+		switch (master_pSPIMsg->app_msg.cmd) {
+			case APPMSG_SPI_ADD_DEVICE:
+					device_init(&master_pSPIMsg->spi_dev, master_pSPIMsg->app_msg.d.v, master_pSPIMsg->pre_cb);
+				break;
+			case APPMSG_GET_STACK_ROOM:
+					master_pSPIMsg->app_msg.d.v= uxTaskGetStackHighWaterMark(NULL);
+				break;
+			default:
+					ret = ESP_ERR_NOT_SUPPORTED;
+				break;
 		}
+	}else if (master_pSPIMsg->batch_count) {
+		// Command/data sequences go out back to back, one completion for all of them
+		ret=spi_device_transmit_batch(master_pSPIMsg->spi_dev, master_pSPIMsg->batch, master_pSPIMsg->batch_count);
+	}else{
+		ret=spi_device_queue_trans(master_pSPIMsg->spi_dev, &master_pSPIMsg->trans, portMAX_DELAY);
+		if (ret == ESP_OK) {
+			ret=spi_device_get_trans_result(master_pSPIMsg->spi_dev, &rtrans, portMAX_DELAY);
+		}
+	}
+	return ret;
 }
 
 /*-----------------------------------------------------------*/
@@ -145,61 +129,10 @@ portBASE_TYPE isSPIReady(void)
 	if (SPI_init) 	return pdTRUE;
 	return pdFALSE;
 }
-portBASE_TYPE SPIMsgPut(pSPIMessage msg)
-{
-
-	if(xQueueSend(xSPIMasterInQueue, msg, ( portTickType ) 10) != pdPASS)
-		{
-						VApplicationGeneralFault;
-		}
-	return pdPASS;
-}
-
-portBASE_TYPE SPIMsgGet(pSPIMessage msg)
-{
-	return xQueueReceive(xSPIMasterOutQueue, msg, portMAX_DELAY);
-}
-
-portBASE_TYPE  SPIOnDone(void *pvParameters)
-{
-	pSPIMessage msg = (pSPIMessage)pvParameters;
-
-	if(xQueueSend(xSPIMasterOutQueue, msg, ( portTickType ) (10 /portTICK_RATE_MS)) != pdPASS)
-	{
-			VApplicationGeneralFault;
-	}
-		
-	return pdPASS;
-}	
-portBASE_TYPE SPITake(void *pvParameters)
-{
-	( void ) pvParameters;
-	if (xSPIMutex == NULL)  return pdFAIL;
 
-        // Obtain the semaphore - don't block even if the semaphore is not
-        // available during a time more then a reasonable.
-	if( xSemaphoreTake( xSPIMutex, (portMAX_DELAY -10) )  != pdPASS )
-	{
-		// Never return from  ..
-		{
-			VApplicationGeneralFault;
-		}
-	}
-	return pdPASS;
-}
-portBASE_TYPE SPIGive(void *pvParameters)
+// Blocks until the SPI task has run the request; the result of the transfer comes back
+esp_err_t SPIMsgCall(pSPIMessage msg)
 {
-	( void ) pvParameters;
-	if (xSPIMutex == NULL)  return pdFAIL;
-
-	if( xSemaphoreGive( xSPIMutex ) != pdPASS )
-	{
-		// Never return from  ..
-		{
-			VApplicationGeneralFault;
-		}
-	}
-	return pdPASS;
+	return msgbus_call(&xSPIActor, &msg->app_msg.bus);
 }
 /*-----------------------------------------------------------*/
-
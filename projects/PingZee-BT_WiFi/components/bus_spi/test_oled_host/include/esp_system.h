@@ -0,0 +1,3 @@
+/* Host build stand-in: font.c only needs the fixed width integer types */
+#pragma once
+#include <stdint.h>
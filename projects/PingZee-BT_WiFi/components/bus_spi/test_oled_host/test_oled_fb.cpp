@@ -0,0 +1,259 @@
+// Copyright 2015-2017 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "catch.hpp"
+#include "oled_fb.h"
+#include "font.h"
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/* Display RAM of the controller, written through the flush callback the way ssd1306.c does it:
+   one batch of the three page/column address commands plus one data transfer per call. */
+struct Panel {
+    uint8_t ram[OLED_FB_PAGES][OLED_FB_WIDTH];
+    size_t writes = 0;
+    size_t dataBytes = 0;
+
+    Panel()
+    {
+        memset(ram, 0xA5, sizeof(ram));
+    }
+
+    static void write(void* ctx, uint8_t page, uint8_t col, const uint8_t* data, uint16_t len)
+    {
+        Panel* self = static_cast<Panel*>(ctx);
+        REQUIRE(page < OLED_FB_PAGES);
+        REQUIRE(col + len <= OLED_FB_WIDTH);
+        memcpy(&self->ram[page][col], data, len);
+        self->writes++;
+        self->dataBytes += len;
+    }
+
+    size_t spiBytes() const
+    {
+        return writes * 3 + dataBytes;
+    }
+
+    bool shows(const oled_fb_t& fb) const
+    {
+        return memcmp(ram, fb.buf, sizeof(ram)) == 0;
+    }
+};
+
+/* What the old ssd1306_write_text sent, one ssd1306_write_data per column; except that its spacing
+   column after each character was 0x20, a stray pixel in row 5, where the framebuffer leaves a blank. */
+static vector<uint8_t> textColumns(const char* str)
+{
+    vector<uint8_t> cols;
+    for (; *str; ++str) {
+        const uint8_t* glyph = font_table[*str - 32];
+        cols.insert(cols.end(), glyph + 1, glyph + 1 + glyph[0]);
+        cols.push_back(0x00);
+    }
+    return cols;
+}
+
+/* Binary PBM, one bit per pixel, rows top to bottom, 1 = lit */
+static string toPbm(const oled_fb_t& fb)
+{
+    string pbm = "P4\n" + to_string(OLED_FB_WIDTH) + " " + to_string(OLED_FB_HEIGHT) + "\n";
+    for (int y = 0; y < OLED_FB_HEIGHT; ++y) {
+        for (int x = 0; x < OLED_FB_WIDTH; x += 8) {
+            uint8_t bits = 0;
+            for (int b = 0; b < 8; ++b) {
+                if (fb.buf[y / 8][x + b] & (1 << (y % 8))) {
+                    bits |= 0x80 >> b;
+                }
+            }
+            pbm += static_cast<char>(bits);
+        }
+    }
+    return pbm;
+}
+
+static void dumpPbm(const oled_fb_t& fb, const char* path)
+{
+    ofstream(path, ios::binary) << toPbm(fb);
+}
+
+TEST_CASE("text renders the same columns as the per-byte writer", "[oled]")
+{
+    static oled_fb_t fb;
+    oled_fb_clear(&fb);
+    const char* text = "PingZee 12:34 {ok}";
+    vector<uint8_t> expect = textColumns(text);
+
+    CHECK(oled_fb_text(&fb, 2, 5, text) == 5 + expect.size());
+    CHECK(memcmp(&fb.buf[2][5], expect.data(), expect.size()) == 0);
+    for (int page = 0; page < OLED_FB_PAGES; ++page) {
+        for (int col = 0; col < OLED_FB_WIDTH; ++col) {
+            if (page != 2 || col < 5 || col >= 5 + (int)expect.size()) {
+                CHECK(fb.buf[page][col] == 0);
+            }
+        }
+    }
+}
+
+TEST_CASE("drawing is clipped at the panel edges", "[oled]")
+{
+    static oled_fb_t fb;
+    oled_fb_clear(&fb);
+    string longText(60, 'W');
+    CHECK(oled_fb_text(&fb, 0, 100, longText.c_str()) >= OLED_FB_WIDTH);
+    vector<uint8_t> expect = textColumns(longText.c_str());
+    CHECK(memcmp(&fb.buf[0][100], expect.data(), OLED_FB_WIDTH - 100) == 0);
+    CHECK(fb.buf[1][0] == 0);
+
+    uint8_t ones[16];
+    memset(ones, 0xFF, sizeof(ones));
+    CHECK(oled_fb_blit(&fb, 3, 120, ones, sizeof(ones)) == OLED_FB_WIDTH);
+    CHECK(fb.buf[3][127] == 0xFF);
+    CHECK(oled_fb_blit(&fb, OLED_FB_PAGES, 0, ones, sizeof(ones)) == sizeof(ones));
+    CHECK(oled_fb_text(&fb, 1, 10, "\x01\x7F") == 10);
+    CHECK(fb.buf[1][10] == 0);
+}
+
+TEST_CASE("flush sends only the changed span of each page", "[oled]")
+{
+    static oled_fb_t fb;
+    Panel panel;
+
+    oled_fb_clear(&fb);
+    CHECK(oled_fb_flush(&fb, Panel::write, &panel) == OLED_FB_PAGES * OLED_FB_WIDTH);
+    CHECK(panel.writes == OLED_FB_PAGES);
+    CHECK(panel.shows(fb));
+
+    panel = Panel();
+    memcpy(panel.ram, fb.buf, sizeof(panel.ram));
+    CHECK(oled_fb_flush(&fb, Panel::write, &panel) == 0);
+    CHECK(panel.writes == 0);
+
+    oled_fb_text(&fb, 1, 0, "Temp 21.5C");
+    size_t first = oled_fb_flush(&fb, Panel::write, &panel);
+    CHECK(panel.writes == 1);
+    CHECK(first == textColumns("Temp 21.5C").size() - 1);
+    CHECK(panel.shows(fb));
+
+    //Redrawing the same text changes nothing
+    oled_fb_text(&fb, 1, 0, "Temp 21.5C");
+    CHECK(oled_fb_flush(&fb, Panel::write, &panel) == 0);
+
+    //One digit changes: only its columns go out
+    panel.writes = 0;
+    oled_fb_text(&fb, 1, 0, "Temp 21.6C");
+    size_t digit = oled_fb_flush(&fb, Panel::write, &panel);
+    CHECK(panel.writes == 1);
+    CHECK(digit > 0);
+    CHECK(digit <= 6);
+    CHECK(panel.shows(fb));
+
+    //Changes on two pages give two spans, each covering both ends
+    panel.writes = 0;
+    oled_fb_fill(&fb, 0, 3, 0x81, 1);
+    oled_fb_fill(&fb, 0, 90, 0x81, 2);
+    oled_fb_fill(&fb, 3, 127, 0x81, 1);
+    CHECK(oled_fb_flush(&fb, Panel::write, &panel) == (90 + 2 - 3) + 1);
+    CHECK(panel.writes == 2);
+    CHECK(panel.shows(fb));
+}
+
+TEST_CASE("framebuffer dumps to PBM", "[oled]")
+{
+    static oled_fb_t fb;
+    oled_fb_clear(&fb);
+    oled_fb_fill(&fb, 0, 0, 0x01, 1);       //top left pixel
+    oled_fb_fill(&fb, 3, 127, 0x80, 1);     //bottom right pixel
+    oled_fb_text(&fb, 1, 2, "PingZee");
+    dumpPbm(fb, "oled_fb.pbm");
+
+    ifstream in("oled_fb.pbm", ios::binary);
+    string pbm((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+    string header = "P4\n128 32\n";
+    REQUIRE(pbm.size() == header.size() + OLED_FB_HEIGHT * OLED_FB_WIDTH / 8);
+    CHECK(pbm.compare(0, header.size(), header) == 0);
+    const uint8_t* rows = reinterpret_cast<const uint8_t*>(pbm.data() + header.size());
+    CHECK(rows[0] == 0x80);
+    CHECK(rows[OLED_FB_HEIGHT * OLED_FB_WIDTH / 8 - 1] == 0x01);
+    int lit = 0;
+    for (int i = 16 * 8; i < 16 * 16; ++i) {
+        lit += __builtin_popcount(rows[i]);
+    }
+    int expectLit = 0;
+    for (uint8_t col : textColumns("PingZee")) {
+        expectLit += __builtin_popcount(col);
+    }
+    CHECK(lit == expectLit);
+}
+
+/* A status screen refreshed once a second: a clock, an accelerometer readout and a fixed title */
+static void drawStatus(oled_fb_t* fb, int second, int x, int y, int z)
+{
+    char line[32];
+    oled_fb_text(fb, 0, 0, "PingZee BT/WiFi");
+    snprintf(line, sizeof(line), "12:%02d:%02d", second / 60 % 60, second % 60);
+    oled_fb_text(fb, 1, 0, line);
+    snprintf(line, sizeof(line), "x%+5d y%+5d", x, y);
+    oled_fb_text(fb, 2, 0, line);
+    snprintf(line, sizeof(line), "z%+5d", z);
+    oled_fb_text(fb, 3, 0, line);
+}
+
+TEST_CASE("SPI traffic per status screen update", "[oled][bench]")
+{
+    static oled_fb_t fb;
+    Panel panel;
+    oled_fb_clear(&fb);
+    oled_fb_flush(&fb, Panel::write, &panel);
+    drawStatus(&fb, 0, 0, 0, 1000);
+    oled_fb_flush(&fb, Panel::write, &panel);
+
+    //Per-byte path: every line sets the page and column (3 commands), then one message per column
+    size_t oldMessages = 0, oldBytes = 0;
+    size_t writes = 0, spiBytes = 0;
+    const int updates = 60;
+    for (int s = 1; s <= updates; ++s) {
+        int x = (s * 37) % 200 - 100, y = (s * 11) % 50, z = 1000 - s % 3;
+        char line[3][32];
+        snprintf(line[0], sizeof(line[0]), "12:%02d:%02d", s / 60 % 60, s % 60);
+        snprintf(line[1], sizeof(line[1]), "x%+5d y%+5d", x, y);
+        snprintf(line[2], sizeof(line[2]), "z%+5d", z);
+        size_t cols = textColumns("PingZee BT/WiFi").size();
+        for (auto& l : line) {
+            cols += textColumns(l).size();
+        }
+        oldMessages += 4 * 3 + cols;
+        oldBytes += 4 * 3 + cols;
+
+        panel.writes = panel.dataBytes = 0;
+        drawStatus(&fb, s, x, y, z);
+        oled_fb_flush(&fb, Panel::write, &panel);
+        CHECK(panel.shows(fb));
+        writes += panel.writes;
+        spiBytes += panel.spiBytes();
+    }
+    dumpPbm(fb, "oled_status.pbm");
+
+    cout << "Status screen, " << updates << " updates, per update:" << endl;
+    cout << "  per-byte writes:      " << setw(6) << fixed << setprecision(1) << (double)oldMessages / updates
+         << " SPI task messages, " << (double)oldBytes / updates << " bytes" << endl;
+    cout << "  framebuffer + flush:  " << setw(6) << (double)writes / updates << " SPI task messages, "
+         << (double)spiBytes / updates << " bytes" << endl;
+    CHECK(writes * 10 < oldMessages);
+    CHECK(spiBytes < oldBytes);
+}
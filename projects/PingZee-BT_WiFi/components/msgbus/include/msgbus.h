@@ -0,0 +1,164 @@
+/*
+ * msgbus.h
+ *
+ * \brief Actors with a task and a queue of message pointers.
+ *
+ *  Every subsystem that owns a piece of hardware runs as an actor: one task
+ *  that takes requests from its queue, one at a time, so nothing else needs
+ *  a lock to use the hardware.
+ *
+ *  A request is a struct of the caller with msgbus_msg_t as its first member;
+ *  it carries the arguments and gets the results written in place. Only its
+ *  address goes through the queue, nothing is copied. msgbus_call() blocks
+ *  the calling task until the actor is done, the reply is a notification to
+ *  that task: no reply queue, no mutex.
+ *
+ *  Interrupt handlers and tasks that must not block raise signal bits
+ *  instead, which need no message storage and coalesce until the actor
+ *  sees them.
+ *
+ *  Each actor keeps statistics: messages, queue depth, time waiting in the
+ *  queue and time in the handler.
+ *
+ *  The RTOS calls are behind msgbus_port.h: FreeRTOS for the target, the
+ *  host test brings a pthreads one.
+ */
+
+#ifndef COMPONENTS_MSGBUS_INCLUDE_MSGBUS_H_
+#define COMPONENTS_MSGBUS_INCLUDE_MSGBUS_H_
+
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MSGBUS_WAIT_FOREVER			0xFFFFFFFF
+
+typedef struct msgbus_msg msgbus_msg_t;
+typedef struct msgbus_actor msgbus_actor_t;
+
+//! Header of every request, its first member
+struct msgbus_msg {
+	volatile uint8_t queued;	// with the actor; the caller must not touch the request
+	esp_err_t result;			// what the handler returned
+	void *waiter;				// task blocked in msgbus_call(), NULL after msgbus_post()
+	void (*done)(msgbus_msg_t *msg);	// msgbus_post(): run by the actor after the handler
+	uint32_t posted_us;
+};
+
+//! Zeroed header, for requests handed to msgbus_post()
+#define MSGBUS_MSG_INIT				{ 0, ESP_OK, NULL, NULL, 0 }
+
+typedef struct {
+	uint32_t posted;			// messages queued
+	uint32_t handled;
+	uint32_t signals;			// times the signal handler ran
+	uint32_t refused;			// posts that found the queue full or the message queued
+	uint16_t depth;				// messages waiting now
+	uint16_t depth_max;
+	uint32_t wait_us_max;		// queued until the handler started
+	uint32_t service_us_max;	// in the handler
+	uint64_t service_us_total;
+	uint32_t stack_free;		// least stack left to the actor task, bytes
+} msgbus_stats_t;
+
+struct msgbus_actor {
+	const char *name;
+	uint16_t queue_len;
+	uint16_t stack_size;
+	uint32_t priority;
+	void *ctx;					// for the handlers
+
+	//! In the actor task before the first message, optional
+	void (*init)(msgbus_actor_t *actor);
+	//! One request; the return value goes to msgbus_msg_t::result
+	esp_err_t (*handle)(msgbus_actor_t *actor, msgbus_msg_t *msg);
+	//! Signal bits raised since the last call, optional
+	void (*signal)(msgbus_actor_t *actor, uint32_t bits);
+	//! Nothing arrived for idle_ms, optional
+	void (*idle)(msgbus_actor_t *actor);
+	volatile uint32_t idle_ms;	// MSGBUS_WAIT_FOREVER for no idle calls, may change at any time
+
+	//! \name Owned by msgbus.c
+	//@{
+	void *queue;
+	void *task;
+	volatile uint8_t ready;		// init done, taking messages
+	volatile uint32_t pending;	// signal bits not seen yet
+	msgbus_stats_t stats;
+	msgbus_actor_t *next;
+	//@}
+};
+
+/**
+ * \brief Create the queue and the task of an actor
+ *
+ * The fields above the msgbus.c ones must be set; the actor struct has to
+ * stay, it is linked into the list of actors.
+ */
+esp_err_t msgbus_actor_start(msgbus_actor_t *actor);
+
+/**
+ * \brief Whether the actor ran its init and takes messages
+ *
+ * Messages may be queued before, they wait for it.
+ */
+int msgbus_actor_ready(const msgbus_actor_t *actor);
+
+/**
+ * \brief Have the actor handle a request and wait until it did
+ *
+ * Waits for room in the queue. Must not be called by the actor itself.
+ *
+ * \retval what the handler returned
+ * \retval ESP_ERR_INVALID_STATE  the actor is not started, or this is its own task
+ */
+esp_err_t msgbus_call(msgbus_actor_t *actor, msgbus_msg_t *msg);
+
+/**
+ * \brief Queue a request without waiting for it
+ *
+ * The request must stay untouched while msgbus_msg_t::queued is set; 'done'
+ * is run by the actor when it is handled. The header has to start out as
+ * MSGBUS_MSG_INIT.
+ *
+ * \retval ESP_ERR_INVALID_STATE  still queued from an earlier post, or the actor is not started
+ * \retval ESP_ERR_NO_MEM         the queue is full
+ */
+esp_err_t msgbus_post(msgbus_actor_t *actor, msgbus_msg_t *msg);
+
+/**
+ * \brief Raise signal bits, from a task
+ */
+void msgbus_signal(msgbus_actor_t *actor, uint32_t bits);
+
+/**
+ * \brief Raise signal bits, from an interrupt handler
+ */
+void msgbus_signal_from_isr(msgbus_actor_t *actor, uint32_t bits);
+
+/**
+ * \brief Copy of the statistics of an actor
+ */
+void msgbus_stats_get(msgbus_actor_t *actor, msgbus_stats_t *stats);
+
+/**
+ * \brief Clear the statistics of an actor, keeping the live queue depth
+ */
+void msgbus_stats_reset(msgbus_actor_t *actor);
+
+/**
+ * \brief Walk the started actors
+ *
+ * \param prev  NULL for the first
+ * \retval the next actor, NULL after the last
+ */
+msgbus_actor_t *msgbus_actor_next(msgbus_actor_t *prev);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* COMPONENTS_MSGBUS_INCLUDE_MSGBUS_H_ */
@@ -0,0 +1,236 @@
+/*
+ * msgbus.c
+ *
+ * \brief Actors with a task and a queue of message pointers.
+ *
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include "msgbus.h"
+#include "msgbus_port.h"
+
+static msgbus_actor_t *actors = NULL;
+
+/* Interval between two readings of the port clock, across a wrap; one of more than half the range reads as 0 */
+static inline uint32_t msgbus_elapsed(uint32_t from, uint32_t to)
+{
+	uint32_t d = to - from;
+	return (d & 0x80000000) ? 0 : d;
+}
+
+static void msgbus_handle(msgbus_actor_t *actor, msgbus_msg_t *msg)
+{
+	uint32_t start = msgbus_port_now_us(), service;
+	uint32_t wait = msgbus_elapsed(msg->posted_us, start);
+	void *waiter = msg->waiter;
+	void (*done)(msgbus_msg_t *) = msg->done;
+	esp_err_t result;
+
+	result = actor->handle(actor, msg);
+	service = msgbus_elapsed(start, msgbus_port_now_us());
+
+	msgbus_port_lock();
+	actor->stats.handled++;
+	if (wait > actor->stats.wait_us_max)			actor->stats.wait_us_max = wait;
+	if (service > actor->stats.service_us_max)	actor->stats.service_us_max = service;
+	actor->stats.service_us_total += service;
+	msgbus_port_unlock();
+
+	//From here on the request belongs to its owner again and may be gone
+	msg->result = result;
+	__sync_synchronize();
+	msg->queued = 0;
+	if (waiter != NULL) {
+		msgbus_port_notify(waiter);
+	} else if (done != NULL) {
+		done(msg);
+	}
+}
+
+static void msgbus_task(void *arg)
+{
+	msgbus_actor_t *actor = (msgbus_actor_t *)arg;
+	void *item;
+	uint32_t bits, stack;
+
+	actor->task = msgbus_port_task_self();
+	if (actor->init != NULL) {
+		actor->init(actor);
+	}
+	actor->ready = 1;
+
+	for (;;) {
+		if (!msgbus_port_queue_receive(actor->queue, &item, actor->idle_ms)) {
+			if (actor->idle != NULL) {
+				actor->idle(actor);
+			}
+		} else if (item != NULL) {
+			msgbus_handle(actor, (msgbus_msg_t *)item);
+		}
+
+		//NULL items only wake the task up; a signal that found the queue full is seen here as well
+		msgbus_port_lock();
+		bits = actor->pending;
+		actor->pending = 0;
+		if (bits) {
+			actor->stats.signals++;
+		}
+		msgbus_port_unlock();
+		if (bits && actor->signal != NULL) {
+			actor->signal(actor, bits);
+		}
+
+		stack = msgbus_port_stack_free();
+		if (stack && (actor->stats.stack_free == 0 || stack < actor->stats.stack_free)) {
+			actor->stats.stack_free = stack;
+		}
+	}
+}
+
+esp_err_t msgbus_actor_start(msgbus_actor_t *actor)
+{
+	if (actor->queue != NULL) {
+		return ESP_ERR_INVALID_STATE;
+	}
+	actor->queue = msgbus_port_queue_create(actor->queue_len ? actor->queue_len : 1);
+	if (actor->queue == NULL) {
+		return ESP_ERR_NO_MEM;
+	}
+
+	msgbus_port_lock();
+	actor->next = NULL;
+	if (actors == NULL) {
+		actors = actor;
+	} else {
+		msgbus_actor_t *a = actors;
+		while (a->next != NULL) {
+			a = a->next;
+		}
+		a->next = actor;
+	}
+	msgbus_port_unlock();
+
+	if (msgbus_port_task_create(msgbus_task, actor->name, actor->stack_size, actor->priority, actor) == NULL) {
+		return ESP_ERR_NO_MEM;
+	}
+	return ESP_OK;
+}
+
+int msgbus_actor_ready(const msgbus_actor_t *actor)
+{
+	return actor->ready;
+}
+
+static void msgbus_posted(msgbus_actor_t *actor)
+{
+	uint32_t depth = msgbus_port_queue_waiting(actor->queue);
+
+	msgbus_port_lock();
+	actor->stats.posted++;
+	if (depth > actor->stats.depth_max) {
+		actor->stats.depth_max = depth;
+	}
+	msgbus_port_unlock();
+}
+
+esp_err_t msgbus_call(msgbus_actor_t *actor, msgbus_msg_t *msg)
+{
+	void *self = msgbus_port_task_self();
+
+	if (actor->queue == NULL || (actor->task != NULL && actor->task == self)) {
+		return ESP_ERR_INVALID_STATE;
+	}
+	msg->waiter = self;
+	msg->done = NULL;
+	msg->queued = 1;
+	msg->posted_us = msgbus_port_now_us();
+	msgbus_port_queue_send(actor->queue, msg);
+	msgbus_posted(actor);
+
+	//A wake left over from an earlier call is no reply
+	while (msg->queued) {
+		msgbus_port_notify_wait();
+	}
+	__sync_synchronize();
+	return msg->result;
+}
+
+esp_err_t msgbus_post(msgbus_actor_t *actor, msgbus_msg_t *msg)
+{
+	if (actor->queue == NULL) {
+		return ESP_ERR_INVALID_STATE;
+	}
+	msgbus_port_lock();
+	if (msg->queued) {
+		actor->stats.refused++;
+		msgbus_port_unlock();
+		return ESP_ERR_INVALID_STATE;
+	}
+	msg->queued = 1;
+	msgbus_port_unlock();
+
+	msg->waiter = NULL;
+	msg->posted_us = msgbus_port_now_us();
+	if (!msgbus_port_queue_try_send(actor->queue, msg)) {
+		msgbus_port_lock();
+		msg->queued = 0;
+		actor->stats.refused++;
+		msgbus_port_unlock();
+		return ESP_ERR_NO_MEM;
+	}
+	msgbus_posted(actor);
+	return ESP_OK;
+}
+
+void msgbus_signal(msgbus_actor_t *actor, uint32_t bits)
+{
+	uint32_t was;
+
+	msgbus_port_lock();
+	was = actor->pending;
+	actor->pending |= bits;
+	msgbus_port_unlock();
+	if (!was && actor->queue != NULL && !msgbus_port_queue_try_send(actor->queue, NULL)) {
+		msgbus_port_lock();
+		actor->stats.refused++;
+		msgbus_port_unlock();
+	}
+}
+
+void msgbus_signal_from_isr(msgbus_actor_t *actor, uint32_t bits)
+{
+	uint32_t was;
+
+	msgbus_port_lock_from_isr();
+	was = actor->pending;
+	actor->pending |= bits;
+	msgbus_port_unlock_from_isr();
+	if (!was && actor->queue != NULL && !msgbus_port_queue_send_from_isr(actor->queue, NULL)) {
+		msgbus_port_lock_from_isr();
+		actor->stats.refused++;
+		msgbus_port_unlock_from_isr();
+	}
+}
+
+void msgbus_stats_get(msgbus_actor_t *actor, msgbus_stats_t *stats)
+{
+	uint32_t depth = actor->queue != NULL ? msgbus_port_queue_waiting(actor->queue) : 0;
+
+	msgbus_port_lock();
+	*stats = actor->stats;
+	msgbus_port_unlock();
+	stats->depth = depth;
+}
+
+void msgbus_stats_reset(msgbus_actor_t *actor)
+{
+	msgbus_port_lock();
+	memset(&actor->stats, 0, sizeof(actor->stats));
+	msgbus_port_unlock();
+}
+
+msgbus_actor_t *msgbus_actor_next(msgbus_actor_t *prev)
+{
+	return prev == NULL ? actors : prev->next;
+}
@@ -0,0 +1,55 @@
+/*
+ * msgbus_port.h
+ *
+ * \brief What msgbus.c needs from the RTOS.
+ *
+ *  Queue items are pointers. Task handles are what the port likes, the bus
+ *  only compares and passes them on.
+ */
+
+#ifndef COMPONENTS_MSGBUS_MSGBUS_PORT_H_
+#define COMPONENTS_MSGBUS_MSGBUS_PORT_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void *msgbus_port_queue_create(uint32_t len);
+//! Blocks until there is room
+void msgbus_port_queue_send(void *queue, void *item);
+//! \retval 0 if the queue is full
+int msgbus_port_queue_try_send(void *queue, void *item);
+int msgbus_port_queue_send_from_isr(void *queue, void *item);
+//! \retval 0 if nothing came in 'timeout_ms' (MSGBUS_WAIT_FOREVER: never)
+int msgbus_port_queue_receive(void *queue, void **item, uint32_t timeout_ms);
+uint32_t msgbus_port_queue_waiting(void *queue);
+
+//! \retval the task, NULL if it could not be created
+void *msgbus_port_task_create(void (*fn)(void *), const char *name, uint32_t stack_size, uint32_t priority, void *arg);
+void *msgbus_port_task_self(void);
+//! Least stack left to the calling task, bytes; 0 if the port does not know
+uint32_t msgbus_port_stack_free(void);
+
+//! Wake 'task' from msgbus_port_notify_wait(); a wake with nobody waiting is kept
+void msgbus_port_notify(void *task);
+void msgbus_port_notify_wait(void);
+
+//! \name Short critical sections around the bus state, not nested
+//@{
+void msgbus_port_lock(void);
+void msgbus_port_unlock(void);
+void msgbus_port_lock_from_isr(void);
+void msgbus_port_unlock_from_isr(void);
+//@}
+
+//! Free running microseconds of one clock for every CPU and interrupt, the low
+//! 32 bits: it wraps after about 71 minutes, msgbus.c takes differences modulo 2^32
+uint32_t msgbus_port_now_us(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* COMPONENTS_MSGBUS_MSGBUS_PORT_H_ */
@@ -0,0 +1,153 @@
+/*
+ * msgbus_port_freertos.c
+ *
+ * \brief msgbus_port.h on FreeRTOS: queues, task notifications for the replies.
+ *
+ *  The clock is TIMER_GROUP_0/TIMER_1 counting microseconds, started with the
+ *  first actor: one 64-bit counter for both CPUs, where the CCOUNT of each CPU
+ *  would give intervals between two different counters and wrap in seconds.
+ */
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "driver/timer.h"
+#include "msgbus.h"
+#include "msgbus_port.h"
+
+#define MSGBUS_CLOCK_GROUP		TIMER_GROUP_0
+#define MSGBUS_CLOCK_IDX		TIMER_1
+#define MSGBUS_CLOCK_DIVIDER	(TIMER_BASE_CLK / 1000000)	// 1 MHz
+
+static portMUX_TYPE msgbus_mux = portMUX_INITIALIZER_UNLOCKED;
+static uint8_t msgbus_clock_started = 0;
+
+static TickType_t msgbus_ticks(uint32_t ms)
+{
+	if (ms == MSGBUS_WAIT_FOREVER) {
+		return portMAX_DELAY;
+	}
+	return (ms + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS;
+}
+
+static void msgbus_clock_start(void)
+{
+	timer_config_t config;
+	uint8_t started;
+
+	portENTER_CRITICAL(&msgbus_mux);
+	started = msgbus_clock_started;
+	msgbus_clock_started = 1;
+	portEXIT_CRITICAL(&msgbus_mux);
+	if (started) {
+		return;
+	}
+
+	config.alarm_en = TIMER_ALARM_DIS;
+	config.auto_reload = TIMER_AUTORELOAD_DIS;
+	config.counter_dir = TIMER_COUNT_UP;
+	config.divider = MSGBUS_CLOCK_DIVIDER;
+	config.intr_type = TIMER_INTR_LEVEL;
+	config.counter_en = TIMER_PAUSE;
+	ESP_ERROR_CHECK( timer_init(MSGBUS_CLOCK_GROUP, MSGBUS_CLOCK_IDX, &config));
+	timer_set_counter_value(MSGBUS_CLOCK_GROUP, MSGBUS_CLOCK_IDX, 0x00000000ULL);
+	timer_start(MSGBUS_CLOCK_GROUP, MSGBUS_CLOCK_IDX);
+}
+
+void *msgbus_port_queue_create(uint32_t len)
+{
+	// Every actor starts with its queue, before any message can reach it
+	msgbus_clock_start();
+	return xQueueCreate(len, sizeof(void *));
+}
+
+void msgbus_port_queue_send(void *queue, void *item)
+{
+	while (xQueueSend((QueueHandle_t)queue, &item, portMAX_DELAY) != pdPASS) {
+	}
+}
+
+int msgbus_port_queue_try_send(void *queue, void *item)
+{
+	return xQueueSend((QueueHandle_t)queue, &item, 0) == pdPASS;
+}
+
+int msgbus_port_queue_send_from_isr(void *queue, void *item)
+{
+	BaseType_t woken = pdFALSE;
+	int sent = xQueueSendFromISR((QueueHandle_t)queue, &item, &woken) == pdPASS;
+
+	if (woken) {
+		portYIELD_FROM_ISR();
+	}
+	return sent;
+}
+
+int msgbus_port_queue_receive(void *queue, void **item, uint32_t timeout_ms)
+{
+	return xQueueReceive((QueueHandle_t)queue, item, msgbus_ticks(timeout_ms)) == pdPASS;
+}
+
+uint32_t msgbus_port_queue_waiting(void *queue)
+{
+	return uxQueueMessagesWaiting((QueueHandle_t)queue);
+}
+
+void *msgbus_port_task_create(void (*fn)(void *), const char *name, uint32_t stack_size, uint32_t priority, void *arg)
+{
+	TaskHandle_t task = NULL;
+
+	if (xTaskCreate(fn, name, stack_size, arg, priority, &task) != pdPASS) {
+		return NULL;
+	}
+	return task;
+}
+
+void *msgbus_port_task_self(void)
+{
+	return xTaskGetCurrentTaskHandle();
+}
+
+uint32_t msgbus_port_stack_free(void)
+{
+	// StackType_t is a byte on the ESP32
+	return uxTaskGetStackHighWaterMark(NULL);
+}
+
+void msgbus_port_notify(void *task)
+{
+	xTaskNotifyGive((TaskHandle_t)task);
+}
+
+void msgbus_port_notify_wait(void)
+{
+	ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+}
+
+void msgbus_port_lock(void)
+{
+	portENTER_CRITICAL(&msgbus_mux);
+}
+
+void msgbus_port_unlock(void)
+{
+	portEXIT_CRITICAL(&msgbus_mux);
+}
+
+void msgbus_port_lock_from_isr(void)
+{
+	portENTER_CRITICAL_ISR(&msgbus_mux);
+}
+
+void msgbus_port_unlock_from_isr(void)
+{
+	portEXIT_CRITICAL_ISR(&msgbus_mux);
+}
+
+uint32_t msgbus_port_now_us(void)
+{
+	uint64_t us = 0;
+
+	timer_get_counter_value(MSGBUS_CLOCK_GROUP, MSGBUS_CLOCK_IDX, &us);
+	return (uint32_t)us;
+}
@@ -0,0 +1,234 @@
+/*
+ * msgbus_port_posix.c
+ *
+ * \brief msgbus_port.h on pthreads, for the host build.
+ *
+ *  Each thread gets a counting semaphore for its notifications on first use.
+ *  "Interrupt handlers" are plain threads here.
+ */
+
+#include <stdlib.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include "msgbus.h"
+#include "msgbus_port.h"
+
+typedef struct {
+	pthread_mutex_t lock;
+	pthread_cond_t changed;
+	uint32_t len, head, count;
+	void **items;
+} port_queue_t;
+
+typedef struct {
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t notified;
+	uint32_t notes;
+	void (*fn)(void *);
+	void *arg;
+} port_task_t;
+
+static pthread_mutex_t port_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread port_task_t *port_self;
+
+void *msgbus_port_queue_create(uint32_t len)
+{
+	port_queue_t *q = calloc(1, sizeof(*q));
+
+	if (q == NULL || (q->items = calloc(len, sizeof(void *))) == NULL) {
+		free(q);
+		return NULL;
+	}
+	q->len = len;
+	pthread_mutex_init(&q->lock, NULL);
+	pthread_cond_init(&q->changed, NULL);
+	return q;
+}
+
+static void port_queue_put(port_queue_t *q, void *item)
+{
+	q->items[(q->head + q->count++) % q->len] = item;
+	pthread_cond_broadcast(&q->changed);
+}
+
+void msgbus_port_queue_send(void *queue, void *item)
+{
+	port_queue_t *q = queue;
+
+	pthread_mutex_lock(&q->lock);
+	while (q->count == q->len) {
+		pthread_cond_wait(&q->changed, &q->lock);
+	}
+	port_queue_put(q, item);
+	pthread_mutex_unlock(&q->lock);
+}
+
+int msgbus_port_queue_try_send(void *queue, void *item)
+{
+	port_queue_t *q = queue;
+	int sent = 0;
+
+	pthread_mutex_lock(&q->lock);
+	if (q->count < q->len) {
+		port_queue_put(q, item);
+		sent = 1;
+	}
+	pthread_mutex_unlock(&q->lock);
+	return sent;
+}
+
+int msgbus_port_queue_send_from_isr(void *queue, void *item)
+{
+	return msgbus_port_queue_try_send(queue, item);
+}
+
+int msgbus_port_queue_receive(void *queue, void **item, uint32_t timeout_ms)
+{
+	port_queue_t *q = queue;
+	struct timespec until;
+	int got = 0;
+
+	if (timeout_ms != MSGBUS_WAIT_FOREVER) {
+		clock_gettime(CLOCK_REALTIME, &until);
+		until.tv_sec += timeout_ms / 1000;
+		until.tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+		if (until.tv_nsec >= 1000000000) {
+			until.tv_sec++;
+			until.tv_nsec -= 1000000000;
+		}
+	}
+	pthread_mutex_lock(&q->lock);
+	while (q->count == 0) {
+		if (timeout_ms == MSGBUS_WAIT_FOREVER) {
+			pthread_cond_wait(&q->changed, &q->lock);
+		} else if (pthread_cond_timedwait(&q->changed, &q->lock, &until) == ETIMEDOUT) {
+			break;
+		}
+	}
+	if (q->count) {
+		*item = q->items[q->head];
+		q->head = (q->head + 1) % q->len;
+		q->count--;
+		pthread_cond_broadcast(&q->changed);
+		got = 1;
+	}
+	pthread_mutex_unlock(&q->lock);
+	return got;
+}
+
+uint32_t msgbus_port_queue_waiting(void *queue)
+{
+	port_queue_t *q = queue;
+	uint32_t count;
+
+	pthread_mutex_lock(&q->lock);
+	count = q->count;
+	pthread_mutex_unlock(&q->lock);
+	return count;
+}
+
+static port_task_t *port_task_new(void)
+{
+	port_task_t *t = calloc(1, sizeof(*t));
+
+	if (t != NULL) {
+		pthread_mutex_init(&t->lock, NULL);
+		pthread_cond_init(&t->notified, NULL);
+	}
+	return t;
+}
+
+static void *port_task_main(void *arg)
+{
+	port_task_t *t = arg;
+
+	port_self = t;
+	t->fn(t->arg);
+	return NULL;
+}
+
+void *msgbus_port_task_create(void (*fn)(void *), const char *name, uint32_t stack_size, uint32_t priority, void *arg)
+{
+	port_task_t *t = port_task_new();
+
+	(void)name;
+	(void)stack_size;
+	(void)priority;
+	if (t == NULL) {
+		return NULL;
+	}
+	t->fn = fn;
+	t->arg = arg;
+	if (pthread_create(&t->thread, NULL, port_task_main, t) != 0) {
+		free(t);
+		return NULL;
+	}
+	pthread_detach(t->thread);
+	return t;
+}
+
+void *msgbus_port_task_self(void)
+{
+	// Threads not made by msgbus_port_task_create(), like main(), get one on first use
+	if (port_self == NULL) {
+		port_self = port_task_new();
+	}
+	return port_self;
+}
+
+uint32_t msgbus_port_stack_free(void)
+{
+	return 0;
+}
+
+void msgbus_port_notify(void *task)
+{
+	port_task_t *t = task;
+
+	pthread_mutex_lock(&t->lock);
+	t->notes++;
+	pthread_cond_signal(&t->notified);
+	pthread_mutex_unlock(&t->lock);
+}
+
+void msgbus_port_notify_wait(void)
+{
+	port_task_t *t = msgbus_port_task_self();
+
+	pthread_mutex_lock(&t->lock);
+	while (t->notes == 0) {
+		pthread_cond_wait(&t->notified, &t->lock);
+	}
+	t->notes = 0;
+	pthread_mutex_unlock(&t->lock);
+}
+
+void msgbus_port_lock(void)
+{
+	pthread_mutex_lock(&port_lock);
+}
+
+void msgbus_port_unlock(void)
+{
+	pthread_mutex_unlock(&port_lock);
+}
+
+void msgbus_port_lock_from_isr(void)
+{
+	pthread_mutex_lock(&port_lock);
+}
+
+void msgbus_port_unlock_from_isr(void)
+{
+	pthread_mutex_unlock(&port_lock);
+}
+
+uint32_t msgbus_port_now_us(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint32_t)(now.tv_sec * 1000000ULL + now.tv_nsec / 1000);
+}
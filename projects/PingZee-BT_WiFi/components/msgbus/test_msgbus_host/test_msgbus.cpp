@@ -0,0 +1,442 @@
+// Copyright 2015-2017 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "catch.hpp"
+#include "msgbus.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using std::cout;
+using std::endl;
+
+// A typed request: arguments in, results written back in place
+struct AddRequest {
+    msgbus_msg_t bus;
+    int a, b;
+    int sum;
+    const void* seen;   // the request as the handler got it
+};
+
+// Holds the actor in its handler until opened
+struct Gate {
+    std::mutex m;
+    std::condition_variable cv;
+    bool open = false;
+    bool entered = false;
+
+    void pass()
+    {
+        std::unique_lock<std::mutex> lock(m);
+        entered = true;
+        cv.notify_all();
+        cv.wait(lock, [this] { return open; });
+    }
+    void wait_entered()
+    {
+        std::unique_lock<std::mutex> lock(m);
+        cv.wait(lock, [this] { return entered; });
+    }
+    void release()
+    {
+        std::lock_guard<std::mutex> lock(m);
+        open = true;
+        cv.notify_all();
+    }
+};
+
+struct Counters {
+    std::atomic<int> inits{0};
+    std::atomic<int> idles{0};
+    std::atomic<uint32_t> signal_bits{0};
+    std::atomic<int> signal_calls{0};
+    int in_handler = 0;     // only touched by the actor
+    int overlaps = 0;
+    Gate* gate = nullptr;
+    msgbus_actor_t* self_call = nullptr;
+    esp_err_t self_call_result = ESP_OK;
+};
+
+static esp_err_t add_handle(msgbus_actor_t* actor, msgbus_msg_t* msg)
+{
+    Counters* c = static_cast<Counters*>(actor->ctx);
+    AddRequest* req = reinterpret_cast<AddRequest*>(msg);
+
+    if (c->in_handler++) {
+        c->overlaps++;
+    }
+    if (c->gate != nullptr) {
+        c->gate->pass();
+    }
+    if (c->self_call != nullptr) {
+        AddRequest inner = {};
+        c->self_call_result = msgbus_call(c->self_call, &inner.bus);
+        c->self_call = nullptr;
+    }
+    req->sum = req->a + req->b;
+    req->seen = req;
+    c->in_handler--;
+    return req->sum < 0 ? ESP_ERR_INVALID_ARG : ESP_OK;
+}
+
+static void count_init(msgbus_actor_t* actor)
+{
+    static_cast<Counters*>(actor->ctx)->inits++;
+}
+
+static void count_idle(msgbus_actor_t* actor)
+{
+    static_cast<Counters*>(actor->ctx)->idles++;
+}
+
+static void count_signal(msgbus_actor_t* actor, uint32_t bits)
+{
+    Counters* c = static_cast<Counters*>(actor->ctx);
+    c->signal_bits |= bits;
+    c->signal_calls++;
+}
+
+// A posted request with what its owner wants to hear when it is done
+struct PostedRequest {
+    AddRequest req;
+    std::atomic<int>* done;
+};
+
+static void count_done(msgbus_msg_t* msg)
+{
+    reinterpret_cast<PostedRequest*>(msg)->done->fetch_add(1);
+}
+
+// Actors are never torn down, each test starts its own
+static msgbus_actor_t* start_actor(Counters* c, uint16_t queue_len = 4)
+{
+    msgbus_actor_t* actor = new msgbus_actor_t();
+    actor->name = "test";
+    actor->queue_len = queue_len;
+    actor->stack_size = 2048;
+    actor->priority = 5;
+    actor->ctx = c;
+    actor->init = count_init;
+    actor->handle = add_handle;
+    actor->signal = count_signal;
+    actor->idle = count_idle;
+    actor->idle_ms = MSGBUS_WAIT_FOREVER;
+    REQUIRE(msgbus_actor_start(actor) == ESP_OK);
+    return actor;
+}
+
+template <typename Pred>
+static bool wait_for(Pred pred, int ms = 2000)
+{
+    for (int i = 0; i < ms; i++) {
+        if (pred()) {
+            return true;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return pred();
+}
+
+TEST_CASE("call hands the request over by pointer, results come back in place", "[msgbus]")
+{
+    Counters c;
+    msgbus_actor_t* actor = start_actor(&c);
+    AddRequest req = {};
+
+    req.a = 2;
+    req.b = 3;
+    CHECK(msgbus_call(actor, &req.bus) == ESP_OK);
+    CHECK(req.sum == 5);
+    CHECK(req.seen == &req);
+    CHECK(req.bus.queued == 0);
+    CHECK(c.inits == 1);
+    CHECK(msgbus_actor_ready(actor));
+
+    req.a = -7;
+    CHECK(msgbus_call(actor, &req.bus) == ESP_ERR_INVALID_ARG);
+    CHECK(req.sum == -4);
+}
+
+TEST_CASE("concurrent callers each get their own reply, one request at a time", "[msgbus]")
+{
+    Counters c;
+    msgbus_actor_t* actor = start_actor(&c, 2);
+    const int threads = 8, calls = 2000;
+    std::atomic<int> wrong{0};
+    std::vector<std::thread> callers;
+
+    for (int t = 0; t < threads; t++) {
+        callers.emplace_back([&, t] {
+            for (int i = 0; i < calls; i++) {
+                AddRequest req = {};
+                req.a = t * 100000;
+                req.b = i;
+                if (msgbus_call(actor, &req.bus) != ESP_OK || req.sum != t * 100000 + i || req.seen != &req) {
+                    wrong++;
+                }
+            }
+        });
+    }
+    for (auto& th : callers) {
+        th.join();
+    }
+    CHECK(wrong == 0);
+    CHECK(c.overlaps == 0);
+
+    msgbus_stats_t st;
+    msgbus_stats_get(actor, &st);
+    CHECK(st.posted == threads * calls);
+    CHECK(st.handled == threads * calls);
+    CHECK(st.depth == 0);
+    CHECK(st.depth_max >= 1);
+    CHECK(st.depth_max <= 2);
+    CHECK(st.refused == 0);
+}
+
+TEST_CASE("a request still queued cannot be posted again, a full queue refuses", "[msgbus]")
+{
+    Gate gate;
+    Counters c;
+    c.gate = &gate;
+    msgbus_actor_t* actor = start_actor(&c, 2);
+
+    std::atomic<int> done{0};
+    PostedRequest p[4];
+    for (int i = 0; i < 4; i++) {
+        p[i].req = AddRequest();
+        p[i].req.bus = MSGBUS_MSG_INIT;
+        p[i].req.bus.done = count_done;
+        p[i].req.a = i;
+        p[i].done = &done;
+    }
+
+    // p[0] is in the handler, p[1] and p[2] fill the queue
+    REQUIRE(msgbus_post(actor, &p[0].req.bus) == ESP_OK);
+    gate.wait_entered();
+    CHECK(msgbus_post(actor, &p[1].req.bus) == ESP_OK);
+    CHECK(msgbus_post(actor, &p[1].req.bus) == ESP_ERR_INVALID_STATE);
+    CHECK(msgbus_post(actor, &p[2].req.bus) == ESP_OK);
+    CHECK(msgbus_post(actor, &p[3].req.bus) == ESP_ERR_NO_MEM);
+    CHECK(p[3].req.bus.queued == 0);
+
+    msgbus_stats_t st;
+    msgbus_stats_get(actor, &st);
+    CHECK(st.depth == 2);
+    CHECK(st.refused == 2);
+
+    gate.release();
+    CHECK(wait_for([&] { return done == 3; }));
+    for (int i = 0; i < 3; i++) {
+        CHECK(p[i].req.bus.queued == 0);
+        CHECK(p[i].req.sum == i);
+    }
+    // Released, so it can go again
+    CHECK(msgbus_post(actor, &p[1].req.bus) == ESP_OK);
+    CHECK(wait_for([&] { return done == 4; }));
+}
+
+TEST_CASE("signals coalesce until the actor gets to them", "[msgbus]")
+{
+    Gate gate;
+    Counters c;
+    c.gate = &gate;
+    msgbus_actor_t* actor = start_actor(&c, 1);
+    AddRequest req = {};
+
+    REQUIRE(msgbus_post(actor, &req.bus) == ESP_OK);
+    gate.wait_entered();
+    // From a "task" and from an "interrupt handler", while the actor is busy
+    std::thread isr([&] {
+        for (int i = 0; i < 100; i++) {
+            msgbus_signal_from_isr(actor, 0x1);
+        }
+    });
+    for (int i = 0; i < 100; i++) {
+        msgbus_signal(actor, 0x4);
+    }
+    isr.join();
+    msgbus_signal(actor, 0x80000000);
+    CHECK(c.signal_calls == 0);
+
+    gate.release();
+    CHECK(wait_for([&] { return c.signal_bits == 0x80000005; }));
+    CHECK(c.signal_calls == 1);
+
+    // With the actor idle a signal alone wakes it up
+    msgbus_signal(actor, 0x2);
+    CHECK(wait_for([&] { return c.signal_calls == 2; }));
+    CHECK(c.signal_bits == 0x80000007);
+}
+
+TEST_CASE("idle runs when nothing comes in for idle_ms", "[msgbus]")
+{
+    Counters c;
+    msgbus_actor_t* actor = start_actor(&c);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    CHECK(c.idles == 0);
+
+    actor->idle_ms = 5;
+    msgbus_signal(actor, 1);    // to pick up the new timeout
+    CHECK(wait_for([&] { return c.idles >= 3; }));
+
+    actor->idle_ms = MSGBUS_WAIT_FOREVER;
+    AddRequest req = {};
+    msgbus_call(actor, &req.bus);
+    int idles = c.idles;
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    CHECK(c.idles == idles);
+}
+
+TEST_CASE("an actor calling itself is refused instead of deadlocking", "[msgbus]")
+{
+    Counters c;
+    msgbus_actor_t* actor = start_actor(&c);
+    AddRequest req = {};
+
+    c.self_call = actor;
+    CHECK(msgbus_call(actor, &req.bus) == ESP_OK);
+    CHECK(c.self_call_result == ESP_ERR_INVALID_STATE);
+
+    msgbus_actor_t never = {};
+    CHECK(msgbus_call(&never, &req.bus) == ESP_ERR_INVALID_STATE);
+    CHECK(msgbus_post(&never, &req.bus) == ESP_ERR_INVALID_STATE);
+}
+
+TEST_CASE("statistics: wait and service time, reset, the list of actors", "[msgbus]")
+{
+    Gate gate;
+    Counters c;
+    c.gate = &gate;
+    msgbus_actor_t* actor = start_actor(&c);
+    AddRequest req = {};
+
+    std::thread caller([&] { msgbus_call(actor, &req.bus); });
+    gate.wait_entered();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    gate.release();
+    caller.join();
+
+    msgbus_stats_t st;
+    msgbus_stats_get(actor, &st);
+    CHECK(st.handled == 1);
+    CHECK(st.service_us_max >= 20000);
+    CHECK(st.service_us_total >= st.service_us_max);
+    CHECK(st.wait_us_max < st.service_us_max);
+
+    msgbus_stats_reset(actor);
+    msgbus_stats_get(actor, &st);
+    CHECK(st.handled == 0);
+    CHECK(st.service_us_total == 0);
+
+    bool listed = false;
+    for (msgbus_actor_t* a = msgbus_actor_next(NULL); a != NULL; a = msgbus_actor_next(a)) {
+        listed |= (a == actor);
+    }
+    CHECK(listed);
+    CHECK(msgbus_actor_start(actor) == ESP_ERR_INVALID_STATE);
+}
+
+/*
+ * What the drivers did before: the request copied by value into the in-queue,
+ * out of it by the task, into the out-queue of depth 1 and out of it again,
+ * with a mutex around the pair.
+ */
+namespace {
+struct CopyQueue {
+    std::mutex m;
+    std::condition_variable cv;
+    std::vector<uint8_t> buf;
+    size_t item, len, head = 0, count = 0;
+    CopyQueue(size_t item, size_t len) : buf(item * len), item(item), len(len) {}
+    void send(const void* p)
+    {
+        std::unique_lock<std::mutex> lock(m);
+        cv.wait(lock, [this] { return count < len; });
+        memcpy(&buf[((head + count++) % len) * item], p, item);
+        cv.notify_all();
+    }
+    void receive(void* p)
+    {
+        std::unique_lock<std::mutex> lock(m);
+        cv.wait(lock, [this] { return count > 0; });
+        memcpy(p, &buf[head * item], item);
+        head = (head + 1) % len;
+        count--;
+        cv.notify_all();
+    }
+};
+
+// The size of SPIMessage_t on the ESP32
+struct OldMessage {
+    uint8_t cmd;
+    uint32_t d;
+    void* done;
+    void* dev;
+    uint8_t trans[28];
+    void* batch;
+    int batch_count;
+    void* pre_cb;
+    void* spi_done;
+};
+}
+
+TEST_CASE("call round trip against the copying queue pair", "[msgbus][bench]")
+{
+    const int calls = 20000;
+    using clock = std::chrono::steady_clock;
+
+    CopyQueue in(sizeof(OldMessage), 4), out(sizeof(OldMessage), 1);
+    std::mutex take;
+    std::thread server([&] {
+        OldMessage m;
+        for (int i = 0; i < calls; i++) {
+            in.receive(&m);
+            m.d++;
+            out.send(&m);
+        }
+    });
+    OldMessage m = {};
+    auto t0 = clock::now();
+    for (int i = 0; i < calls; i++) {
+        std::lock_guard<std::mutex> lock(take);
+        in.send(&m);
+        out.receive(&m);
+    }
+    double old_us = std::chrono::duration<double, std::micro>(clock::now() - t0).count() / calls;
+    server.join();
+    CHECK(m.d == (uint32_t)calls);
+
+    Counters c;
+    msgbus_actor_t* actor = start_actor(&c);
+    AddRequest req = {};
+    t0 = clock::now();
+    for (int i = 0; i < calls; i++) {
+        req.a = i;
+        msgbus_call(actor, &req.bus);
+    }
+    double bus_us = std::chrono::duration<double, std::micro>(clock::now() - t0).count() / calls;
+    CHECK(req.sum == calls - 1);
+
+    msgbus_stats_t st;
+    msgbus_stats_get(actor, &st);
+    cout << "Round trip of one request, " << calls << " calls on pthreads:" << endl;
+    cout << "  queue pair + mutex: " << old_us << " us, " << 4 * sizeof(OldMessage) << " bytes copied" << endl;
+    cout << "  msgbus_call:        " << bus_us << " us, " << sizeof(void*) << " byte pointer queued, "
+         << "handler " << (double)st.service_us_total / st.handled << " us mean" << endl;
+}
@@ -27,11 +27,13 @@
 /* Application related includes */
 #include "app.h"
 #include "board.h"
+#include "lis3dh.h"
 
 static const char *TAG = "CLI";
 
 /*-----------------------------------------------------------*/
-static portBASE_TYPE esp32_resurces_command(int8_t *pcWriteBuffer, 	size_t xWriteBufferLen, const int8_t *pcCommandString);
+static portBASE_TYPE esp32_resurces_command(const CLI_Writer_t *writer, const int8_t *pcCommandString);
+static portBASE_TYPE esp32_bus_command(const CLI_Writer_t *writer, const int8_t *pcCommandString);
 static portBASE_TYPE esp32_i2c_command(int8_t *pcWriteBuffer, 	size_t xWriteBufferLen, const int8_t *pcCommandString);
 #ifdef CONFIG_SSD1306_OLED
 static portBASE_TYPE oled_output_command(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
@@ -49,8 +51,18 @@ static const CLI_Command_Definition_t esp32_resurces_command_definition =
 {
 	(const int8_t *const) "res", /* The command string to type. */
 	(const int8_t *const) "res\tShow resources\r\n",
-	esp32_resurces_command, /* The function to run. */
-	0 /* No parameters are expected. */
+	NULL,
+	0, /* No parameters are expected. */
+	esp32_resurces_command /* Streams its output. */
+};
+
+static const CLI_Command_Definition_t esp32_bus_command_definition =
+{
+	(const int8_t *const) "bus", /* The command string to type. */
+	(const int8_t *const) "bus\t[reset]\tShow the message queues of the tasks\r\n",
+	NULL,
+	-1, /* The number of parameters is variable. */
+	esp32_bus_command /* Streams its output. */
 };
 
 static const CLI_Command_Definition_t esp32_deepsleep_command_definition =
@@ -58,7 +70,8 @@ static const CLI_Command_Definition_t esp32_deepsleep_command_definition =
 	(const int8_t *const) "deepsleep", /* The command string to type. */
 	(const int8_t *const) "deepsleep\tN\tDeep sleep for N seconds\r\n",
 	esp32_deepsleep_command, /* The function to run. */
-	1 /* One parameter are expected. */
+	1, /* One parameter are expected. */
+	NULL /* No streamed output. */
 };
 
 static const CLI_Command_Definition_t esp32_mainloop_command_definition =
@@ -66,7 +79,8 @@ static const CLI_Command_Definition_t esp32_mainloop_command_definition =
 	(const int8_t *const) "main", /* The command string to type. */
 	(const int8_t *const) "main\t{start|stop}\tControl for the Application Main Loop\r\n",
 	esp32_mainloop_command, /* The function to run. */
-	1 /* One parameter are expected. */
+	1, /* One parameter are expected. */
+	NULL /* No streamed output. */
 };
 
 static const CLI_Command_Definition_t esp32_i2c_command_definition =
@@ -74,7 +88,8 @@ static const CLI_Command_Definition_t esp32_i2c_command_definition =
 	(const int8_t *const) "i2c", /* The command string to type. */
 	(const int8_t *const) "i2c\tr|w <addr> <value>\tRead/Write EEPROM value from/to address\r\n",
 	esp32_i2c_command, /* The function to run. */
-	3 /* Three parameters are expected. */
+	3, /* Three parameters are expected. */
+	NULL /* No streamed output. */
 };
 
 #ifdef CONFIG_SSD1306_OLED
@@ -83,16 +98,18 @@ static const CLI_Command_Definition_t oled_output_command_definition =
 	(const int8_t *const) "oled", /* The command string to type. */
 	(const int8_t *const) "oled\t<line> <column> <string>  where: line {[0-3] |clean}, colum [0-128]\r\n",
 	oled_output_command, /* The function to run. */
-	3 /* Three parameters are expected. */
+	3, /* Three parameters are expected. */
+	NULL /* No streamed output. */
 };
 #endif // CONFIG_SSD1306_OLED
 #ifdef CONFIG_LIS3DH
 static const CLI_Command_Definition_t lis3dh_command_definition =
 {
 	(const int8_t *const) "lis3dh", /* The command string to type. */
-	(const int8_t *const) "lis3dh\t{init |poll} LIS3DH accelerometer\r\n",
+	(const int8_t *const) "lis3dh\t{init |poll |stream} LIS3DH accelerometer\r\n",
 	lis3dh_command, /* The function to run. */
-	1 /* One parameter are expected. */
+	1, /* One parameter are expected. */
+	NULL /* No streamed output. */
 };
 #endif // CONFIG_LIS3DH
 
@@ -103,6 +120,7 @@ void vRegisterCLICommands(void)
 {
 	/* Register all the command line commands defined immediately above. */
 	FreeRTOS_CLIRegisterCommand(&esp32_resurces_command_definition);
+	FreeRTOS_CLIRegisterCommand(&esp32_bus_command_definition);
 	FreeRTOS_CLIRegisterCommand(&esp32_deepsleep_command_definition);
 	FreeRTOS_CLIRegisterCommand(&esp32_mainloop_command_definition);
 	FreeRTOS_CLIRegisterCommand(&esp32_i2c_command_definition);
@@ -114,26 +132,41 @@ void vRegisterCLICommands(void)
 #endif // CONFIG_LIS3DH
 }
 
-static portBASE_TYPE esp32_resurces_command(int8_t *pcWriteBuffer, 	size_t xWriteBufferLen, const int8_t *pcCommandString)
+static portBASE_TYPE esp32_resurces_command(const CLI_Writer_t *writer, const int8_t *pcCommandString)
 {
-//	int8_t *parameter1_string;
-//	portBASE_TYPE parameter_string_length;
+	(void) pcCommandString;
 
-	
-	/* Remove compile time warnings about unused parameters, and check the
-	write buffer is not NULL.  NOTE - for simplicity, this example assumes the
-	write buffer length is adequate, so does not check for buffer overflows. */
-	(void) xWriteBufferLen;
-	configASSERT(pcWriteBuffer);
+	FreeRTOS_CLIPrintf(writer, "Tasks: %d\r\n", uxTaskGetNumberOfTasks());
+	FreeRTOS_CLIPrintf(writer, "RAM left %d\r\n", esp_get_free_heap_size());
+	FreeRTOS_CLIPrintf(writer, "CLI task stack: %d\r\n", uxTaskGetStackHighWaterMark(NULL));
+//	FreeRTOS_CLIPrintf(writer, "CLI task priority: %d", uxTaskPriorityGet(NULL));
 
-	printf("Tasks: %d\r\n", uxTaskGetNumberOfTasks());
-	printf("RAM left %d\r\n", esp_get_free_heap_size());
-	printf("CLI task stack: %d", uxTaskGetStackHighWaterMark(NULL));
-//	printf("CLI task priority: %d", uxTaskPriorityGet(NULL));
+	return pdFALSE;
+}
+
+static portBASE_TYPE esp32_bus_command(const CLI_Writer_t *writer, const int8_t *pcCommandString)
+{
+	const int8_t *parameter_string;
+	portBASE_TYPE parameter_string_length;
+	msgbus_actor_t *actor;
+	msgbus_stats_t st;
+	uint8_t reset;
+
+	parameter_string = FreeRTOS_CLIGetParameter(pcCommandString, 1, &parameter_string_length);
+	reset = (parameter_string != NULL && !strncmp((const char *)parameter_string, "reset", 5));
+
+	FreeRTOS_CLIPrintf(writer, "task      posted handled signals refused depth(max) wait max us service avg/max us stack\r\n");
+	for (actor = msgbus_actor_next(NULL); actor != NULL; actor = msgbus_actor_next(actor)) {
+		msgbus_stats_get(actor, &st);
+		FreeRTOS_CLIPrintf(writer, "%-8s %7u %7u %7u %7u %4u(%u) %11u %10u/%u %5u\r\n",
+				actor->name, st.posted, st.handled, st.signals, st.refused, st.depth, st.depth_max,
+				st.wait_us_max, st.handled ? (uint32_t)(st.service_us_total / st.handled) : 0,
+				st.service_us_max, st.stack_free);
+		if (reset) {
+			msgbus_stats_reset(actor);
+		}
+	}
 
-	*pcWriteBuffer = 0x00;
-	/* There is no more data to return after this single string, so return
-	pdFALSE. */
 	return pdFALSE;
 }
 
@@ -240,7 +273,7 @@ static portBASE_TYPE oled_output_command(int8_t *pcWriteBuffer,
 	portBASE_TYPE parameter_string_length;
 //	static const int8_t *failure_message = (int8_t *) "*** ERROR: Uncorrect parameter\r\n";
 	uint8_t page, column; 
-	OledMessage_t msg;
+	OledMessage_t msg = { .app_msg.bus = MSGBUS_MSG_INIT };
 
 	/* Remove compile time warnings about unused parameters, and check the
 	write buffer is not NULL.  NOTE - for simplicity, this example assumes the
@@ -268,11 +301,7 @@ static portBASE_TYPE oled_output_command(int8_t *pcWriteBuffer,
 			msg.x = 0;
 			msg.str = (unsigned char *)clbuff;
 			msg.strLen = 128;
-			msg.oled__doneCallback = OledOnDone;
-			OledMsgPut(&msg);
-			while(OledMsgGet(&msg) != pdFAIL) {
-				break;
-			}
+			OledMsgCall(&msg);
 		}
 		goto finish;
 	}else{
@@ -298,12 +327,7 @@ static portBASE_TYPE oled_output_command(int8_t *pcWriteBuffer,
 						msg.x = column;
 						msg.str = (unsigned char *)parameter3_string;
 						msg.strLen = parameter_string_length;
-						msg.oled__doneCallback = OledOnDone;
-						OledMsgPut(&msg);
-
-						while(OledMsgGet(&msg) != pdFAIL) {
-							break;
-						}
+						OledMsgCall(&msg);
 						goto finish;
 					}
 				}
@@ -324,7 +348,7 @@ static portBASE_TYPE lis3dh_command(int8_t *pcWriteBuffer, size_t xWriteBufferLe
 {
 	int8_t *parameter1_string;
 	portBASE_TYPE parameter_string_length;
-	Lis3dhMessage_t msg;
+	Lis3dhMessage_t msg = { .app_msg.bus = MSGBUS_MSG_INIT };
 
 	/* Remove compile time warnings about unused parameters, and check the
 	write buffer is not NULL.  NOTE - for simplicity, this example assumes the
@@ -343,20 +367,12 @@ static portBASE_TYPE lis3dh_command(int8_t *pcWriteBuffer, size_t xWriteBufferLe
 	if (!strncmp((const char *)parameter1_string, "init", 4) )
 	{
 		msg.app_msg.cmd = APPMSG_LIS3DH_CHECK_PRESENT;
-		msg.lis3dh__doneCallback = Lis3dhOnDone;
-		Lis3dhMsgPut(&msg);
-		while(Lis3dhMsgGet(&msg) != pdFAIL) {
-			break;
-		}				
+		Lis3dhMsgCall(&msg);
 		if (msg.app_msg.d.param[0] != 0x00) {
 
 			msg.app_msg.cmd = APPMSG_LIS3DH_SETUP;
 			msg.app_msg.d.ptr = NULL;   // Setup default
-			msg.lis3dh__doneCallback = Lis3dhOnDone;
-			Lis3dhMsgPut(&msg);
-			while(Lis3dhMsgGet(&msg) != pdFAIL) {
-				break;
-			}				
+			Lis3dhMsgCall(&msg);
 		}else{
 			strcpy((char * restrict)pcWriteBuffer, "No LIS3DH find. Abort\r\n");
 		}
@@ -366,30 +382,50 @@ static portBASE_TYPE lis3dh_command(int8_t *pcWriteBuffer, size_t xWriteBufferLe
 		while(1) {
 
 			msg.app_msg.cmd = APPMSG_NOP;
-			msg.lis3dh__doneCallback = Lis3dhOnDone;
-			Lis3dhMsgPut(&msg);
-			while(Lis3dhMsgGet(&msg) != pdFAIL) {
-				break;
-			}				
+			Lis3dhMsgCall(&msg);
 			printf("X=%f, ", msg.accl);			
 
 			msg.app_msg.cmd = APPMSG_NOP;
-			msg.lis3dh__doneCallback = Lis3dhOnDone;
-			Lis3dhMsgPut(&msg);
-			while(Lis3dhMsgGet(&msg) != pdFAIL) {
-				break;
-			}				
+			Lis3dhMsgCall(&msg);
 			printf("Y=%f, ", msg.accl);			
 			msg.app_msg.cmd = APPMSG_NOP;
-			msg.lis3dh__doneCallback = Lis3dhOnDone;
-			Lis3dhMsgPut(&msg);
-			while(Lis3dhMsgGet(&msg) != pdFAIL) {
-				break;
-			}				
+			Lis3dhMsgCall(&msg);
 			printf("Z=%f\r\n", msg.accl);			
 
 			vTaskDelay((portTickType)(1000 / portTICK_RATE_MS));
 		}
+	}else
+	if (!strncmp((const char *)parameter1_string, "stream", 6) )
+	{
+		static lis3dh_settings stream_settings = {
+			.accelSampleRate = 50,
+			.accelRange = 2,
+			.xAccelEnabled = 1,
+			.yAccelEnabled = 1,
+			.zAccelEnabled = 1,
+			.fifoEnabled = 1,
+			.fifoMode = LIS3DH_FIFO_MODE_STREAM,
+			.fifoThreshold = 24,
+		};
+		pLis3dhBatch batch;
+		lis3dh_features_t *f;
+
+		msg.app_msg.cmd = APPMSG_LIS3DH_SETUP;
+		msg.app_msg.d.ptr = &stream_settings;
+		Lis3dhMsgCall(&msg);
+		while(1) {
+			batch = Lis3dhBatchReceive((portTickType)(2000 / portTICK_RATE_MS));
+			if (batch == NULL) {
+				printf("No FIFO batch\r\n");
+				continue;
+			}
+			f = &batch->features;
+			printf("#%u: %d samples%s, mean X=%d, Y=%d, Z=%d mg, |a| %u..%u rms %u mg, steps %d, taps %d%s\r\n",
+					batch->seq, batch->count, batch->overrun ? " (overrun)" : "",
+					f->mean[0], f->mean[1], f->mean[2], f->mag_min, f->mag_max, f->mag_rms,
+					f->steps, f->taps, f->active ? ", moving" : "");
+			Lis3dhBatchReturn(batch);
+		}
 	}
 	else
 		strcpy((char * restrict)pcWriteBuffer, (const char *) failure_message);
@@ -446,7 +482,7 @@ static portBASE_TYPE esp32_mainloop_command(int8_t *pcWriteBuffer, 	size_t xWrit
 {
 	int8_t *parameter1_string;
 	portBASE_TYPE parameter_string_length;
-	AppMessage_t msg;   
+	AppMessage_t msg = { .bus = MSGBUS_MSG_INIT };
 
 	/* Remove compile time warnings about unused parameters, and check the
 	write buffer is not NULL.  NOTE - for simplicity, this example assumes the
@@ -465,22 +501,12 @@ static portBASE_TYPE esp32_mainloop_command(int8_t *pcWriteBuffer, 	size_t xWrit
 	if (!strncmp((const char *)parameter1_string, "start", 5)) {
 
 		msg.cmd = APPMSG_MAIN_LOOP_START;
-		msg.app__doneCallback = AppOnDone;
-		AppMsgPut(&msg);
-
-		while (AppMsgGet(&msg) != pdFAIL) {
-			break;
-		}
+		AppMsgCall(&msg);
 	}else
 	if (!strncmp((const char *)parameter1_string, "stop", 4)) {
 
 		msg.cmd = APPMSG_MAIN_LOOP_STOP;
-		msg.app__doneCallback = AppOnDone;
-		AppMsgPut(&msg);
-
-		while (AppMsgGet(&msg) != pdFAIL) {
-			break;
-		}
+		AppMsgCall(&msg);
 	}
 	return pdFALSE;
 
@@ -47,6 +47,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
 #include <ctype.h>
 
 /* FreeRTOS includes. */
@@ -57,40 +58,49 @@
 #include "FreeRTOS_CLI.h"
 //#include "app.h"
 
-typedef struct xCOMMAND_INPUT_LIST
-{
-	const CLI_Command_Definition_t *pxCommandLineDefinition;
-	struct xCOMMAND_INPUT_LIST *pxNext;
-} CLI_Definition_List_Item_t;
-
 /*
- * The callback function that is executed when "help" is entered.  This is the
+ * The callback functions that are executed when "help" is entered.  This is the
  * only default command that is always present.
  */
 static portBASE_TYPE prvHelpCommand( int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString );
+static portBASE_TYPE prvHelpStream( const CLI_Writer_t *pxWriter, const int8_t *pcCommandString );
 
 /*
  * Return the number of parameters that follow the command name.
  */
 static int8_t prvGetNumberOfParameters( const int8_t * pcCommandString );
 
-/* The definition of the "help" command.  This command is always at the front
-of the list of registered commands. */
+/*
+ * Find the registered command named by the first word of pcCommandInput, or
+ * the slot where it would be inserted.  Returns pdTRUE if it was found.
+ */
+static portBASE_TYPE prvFindCommand( const int8_t *pcCommandInput, size_t xInputLength, unsigned portBASE_TYPE *puxIndex );
+
+/*
+ * Look up the command of pcCommandInput and check its number of parameters.
+ * Writes the error message through pxWriter and returns NULL if that fails.
+ */
+static const CLI_Command_Definition_t *prvLookUpCommand( const int8_t *pcCommandInput, const CLI_Writer_t *pxWriter );
+
+/* The definition of the "help" command.  This command is always registered. */
 static const CLI_Command_Definition_t xHelpCommand =
 {
 	( const int8_t * const ) "help",
 	( const int8_t * const ) "\r\nhelp:\tLists all the registered commands\r\n",
 	prvHelpCommand,
-	0
+	0,
+	prvHelpStream
 };
 
-/* The definition of the list of commands.  Commands that are registered are
-added to this list. */
-static CLI_Definition_List_Item_t xRegisteredCommands =
+/* The registered commands, sorted by name. */
+static const CLI_Command_Definition_t *pxRegisteredCommands[ configCOMMAND_INT_MAX_COMMANDS ] =
 {
-	&xHelpCommand,	/* The first command in the list is always the help command, defined in this file. */
-	NULL			/* The next pointer is initialised to NULL, as there are no other registered commands yet. */
+	&xHelpCommand
 };
+static unsigned portBASE_TYPE uxRegisteredCommands = 1;
+
+static const char * const pcNotRecognised = "Command not recognised.  Enter \"help\" to view a list of available commands.\r\n\r\n";
+static const char * const pcIncorrectParameters = "Incorrect command parameter(s).  Enter \"help\" to view a list of available commands.\r\n\r\n";
 
 /* A buffer into which command outputs can be written is declared here, rather
 than in the command console implementation, to allow multiple command consoles
@@ -109,119 +119,172 @@ static portMUX_TYPE xCLIMutex = portMUX_INITIALIZER_UNLOCKED;
 
 portBASE_TYPE FreeRTOS_CLIRegisterCommand( const CLI_Command_Definition_t * const pxCommandToRegister )
 {
-static CLI_Definition_List_Item_t *pxLastCommandInList = &xRegisteredCommands;
-CLI_Definition_List_Item_t *pxNewListItem;
+unsigned portBASE_TYPE uxIndex;
+const int8_t *pcName;
 portBASE_TYPE xReturn = pdFAIL;
 
 	/* Check the parameter is not NULL. */
 	configASSERT( pxCommandToRegister );
+	configASSERT( pxCommandToRegister->pxCommandInterpreter || pxCommandToRegister->pxStreamInterpreter );
+	pcName = pxCommandToRegister->pcCommand;
 
-	/* Create a new list item that will reference the command being registered. */
-	pxNewListItem = ( CLI_Definition_List_Item_t * ) pvPortMalloc( sizeof( CLI_Definition_List_Item_t ) );
-	configASSERT( pxNewListItem );
-
-	if( pxNewListItem != NULL )
+	taskENTER_CRITICAL(&xCLIMutex);
 	{
-		taskENTER_CRITICAL(&xCLIMutex);
+		/* Keep the table sorted: move the commands after the new one up by
+		one slot. */
+		if( ( uxRegisteredCommands < configCOMMAND_INT_MAX_COMMANDS ) &&
+			( prvFindCommand( pcName, strlen( ( const char * ) pcName ), &uxIndex ) == pdFALSE ) )
 		{
-			/* Reference the command being registered from the newly created
-			list item. */
-			pxNewListItem->pxCommandLineDefinition = pxCommandToRegister;
+			memmove( &pxRegisteredCommands[ uxIndex + 1 ], &pxRegisteredCommands[ uxIndex ],
+					( uxRegisteredCommands - uxIndex ) * sizeof( pxRegisteredCommands[ 0 ] ) );
+			pxRegisteredCommands[ uxIndex ] = pxCommandToRegister;
+			uxRegisteredCommands++;
+			xReturn = pdPASS;
+		}
+	}
+	taskEXIT_CRITICAL(&xCLIMutex);
 
-			/* The new list item will get added to the end of the list, so
-			pxNext has nowhere to point. */
-			pxNewListItem->pxNext = NULL;
+	return xReturn;
+}
+/*-----------------------------------------------------------*/
 
-			/* Add the newly created list item to the end of the already existing
-			list. */
-			pxLastCommandInList->pxNext = pxNewListItem;
+/* Writer used when a streaming command runs through FreeRTOS_CLIProcessCommand():
+fills the caller's buffer and drops what does not fit. */
+typedef struct
+{
+	int8_t *pcBuffer;
+	size_t xLength;
+	size_t xUsed;
+} CLI_Buffer_Writer_t;
 
-			/* Set the end of list marker to the new list item. */
-			pxLastCommandInList = pxNewListItem;
-		}
-		taskEXIT_CRITICAL(&xCLIMutex);
+static void prvBufferWrite( void *pvContext, const char *pcData, size_t xDataLen )
+{
+CLI_Buffer_Writer_t *pxBuffer = ( CLI_Buffer_Writer_t * ) pvContext;
+size_t xRoom = pxBuffer->xLength - 1 - pxBuffer->xUsed;
 
-		xReturn = pdPASS;
+	if( xDataLen > xRoom )
+	{
+		xDataLen = xRoom;
 	}
-
-	return xReturn;
+	memcpy( pxBuffer->pcBuffer + pxBuffer->xUsed, pcData, xDataLen );
+	pxBuffer->xUsed += xDataLen;
+	pxBuffer->pcBuffer[ pxBuffer->xUsed ] = 0x00;
 }
 /*-----------------------------------------------------------*/
 
 portBASE_TYPE FreeRTOS_CLIProcessCommand( const int8_t * const pcCommandInput, int8_t * pcWriteBuffer, size_t xWriteBufferLen  )
 {
-static const CLI_Definition_List_Item_t *pxCommand = NULL;
+static const CLI_Command_Definition_t *pxCommand = NULL;
 portBASE_TYPE xReturn = pdTRUE;
-const int8_t *pcRegisteredCommandString;
-size_t xCommandStringLength;
+CLI_Buffer_Writer_t xBuffer = { pcWriteBuffer, xWriteBufferLen, 0 };
+CLI_Writer_t xWriter = { prvBufferWrite, &xBuffer };
 
 	/* Note:  This function is not re-entrant.  It must not be called from more
 	thank one task. */
 
 	if( pxCommand == NULL )
 	{
-		/* Search for the command string in the list of registered commands. */
-		for( pxCommand = &xRegisteredCommands; pxCommand != NULL; pxCommand = pxCommand->pxNext )
+		/* A new command: look it up.  The error messages, if any, go to
+		pcWriteBuffer. */
+		pcWriteBuffer[ 0 ] = 0x00;
+		pxCommand = prvLookUpCommand( pcCommandInput, &xWriter );
+		if( pxCommand == NULL )
 		{
-			pcRegisteredCommandString = pxCommand->pxCommandLineDefinition->pcCommand;
-			xCommandStringLength = strlen( ( const char * ) pcRegisteredCommandString );
-			
-//printf("[%s] <> [%s]\n", ( const char * ) pcCommandInput, ( const char * ) pcRegisteredCommandString);
-
-			/* To ensure the string lengths match exactly, so as not to pick up
-			a sub-string of a longer command, check the byte after the expected
-			end of the string is either the end of the string or a space before
-			a parameter. */
-			if( ( pcCommandInput[ xCommandStringLength ] == ' ' ) || ( pcCommandInput[ xCommandStringLength ] == 0x00 ) )
-			{
-				if( strncmp( ( const char * ) pcCommandInput, ( const char * ) pcRegisteredCommandString, xCommandStringLength ) == 0 )
-				{
-					/* The command has been found.  Check it has the expected
-					number of parameters.  If cExpectedNumberOfParameters is -1,
-					then there could be a variable number of parameters and no
-					check is made. */
-					if( pxCommand->pxCommandLineDefinition->cExpectedNumberOfParameters >= 0 )
-					{
-						if( prvGetNumberOfParameters( pcCommandInput ) != pxCommand->pxCommandLineDefinition->cExpectedNumberOfParameters )
-						{
-							xReturn = pdFALSE;
-						}
-					}
-
-					break;
-				}
-			}
+			return pdFALSE;
 		}
 	}
 
-	if( ( pxCommand != NULL ) && ( xReturn == pdFALSE ) )
+	if( pxCommand->pxCommandInterpreter != NULL )
+	{
+		/* Call the callback function that is registered to this command. */
+		xReturn = pxCommand->pxCommandInterpreter( pcWriteBuffer, xWriteBufferLen, pcCommandInput );
+	}
+	else
+	{
+		/* Streaming only command, as much of its output as fits. */
+		pxCommand->pxStreamInterpreter( &xWriter, pcCommandInput );
+		xReturn = pdFALSE;
+	}
+
+	/* If xReturn is pdFALSE, then no further strings will be returned
+	after this one, and	pxCommand can be reset to NULL ready to search
+	for the next entered command. */
+	if( xReturn == pdFALSE )
 	{
-		/* The command was found, but the number of parameters with the command
-		was incorrect. */
-		strncpy( ( char * ) pcWriteBuffer, "Incorrect command parameter(s).  Enter \"help\" to view a list of available commands.\r\n\r\n", xWriteBufferLen );
 		pxCommand = NULL;
 	}
-	else if( pxCommand != NULL )
+
+	return xReturn;
+}
+/*-----------------------------------------------------------*/
+
+portBASE_TYPE FreeRTOS_CLIProcessCommandStream( const int8_t * const pcCommandInput, const CLI_Writer_t *pxWriter )
+{
+const CLI_Command_Definition_t *pxCommand;
+portBASE_TYPE xMore;
+
+	pxCommand = prvLookUpCommand( pcCommandInput, pxWriter );
+	if( pxCommand == NULL )
 	{
-		/* Call the callback function that is registered to this command. */
-		xReturn = pxCommand->pxCommandLineDefinition->pxCommandInterpreter( pcWriteBuffer, xWriteBufferLen, pcCommandInput );
+		return pdFAIL;
+	}
 
-		/* If xReturn is pdFALSE, then no further strings will be returned
-		after this one, and	pxCommand can be reset to NULL ready to search
-		for the next entered command. */
-		if( xReturn == pdFALSE )
-		{
-			pxCommand = NULL;
-		}
+	if( pxCommand->pxStreamInterpreter != NULL )
+	{
+		pxCommand->pxStreamInterpreter( pxWriter, pcCommandInput );
 	}
 	else
 	{
-		/* pxCommand was NULL, the command was not found. */
-		strncpy( ( char * ) pcWriteBuffer, ( const char * const ) "Command not recognised.  Enter \"help\" to view a list of available commands.\r\n\r\n", xWriteBufferLen );
-		xReturn = pdFALSE;
+		/* Page through the output buffer. */
+		do
+		{
+			cOutputBuffer[ 0 ] = 0x00;
+			xMore = pxCommand->pxCommandInterpreter( cOutputBuffer, configCOMMAND_INT_MAX_OUTPUT_SIZE, pcCommandInput );
+			pxWriter->vWrite( pxWriter->pvContext, ( const char * ) cOutputBuffer, strlen( ( const char * ) cOutputBuffer ) );
+		} while( xMore != pdFALSE );
 	}
 
-	return xReturn;
+	return pdPASS;
+}
+/*-----------------------------------------------------------*/
+
+int FreeRTOS_CLIPrintf( const CLI_Writer_t *pxWriter, const char *pcFormat, ... )
+{
+char cLine[ 64 ];
+char *pcText = cLine;
+va_list xArgs;
+int iLength;
+
+	va_start( xArgs, pcFormat );
+	iLength = vsnprintf( cLine, sizeof( cLine ), pcFormat, xArgs );
+	va_end( xArgs );
+
+	if( iLength >= ( int ) sizeof( cLine ) )
+	{
+		/* Longer than the line buffer, format again into one that fits. */
+		pcText = ( char * ) pvPortMalloc( iLength + 1 );
+		if( pcText == NULL )
+		{
+			pcText = cLine;
+			iLength = sizeof( cLine ) - 1;
+		}
+		else
+		{
+			va_start( xArgs, pcFormat );
+			vsnprintf( pcText, iLength + 1, pcFormat, xArgs );
+			va_end( xArgs );
+		}
+	}
+
+	if( iLength > 0 )
+	{
+		pxWriter->vWrite( pxWriter->pvContext, pcText, iLength );
+	}
+	if( pcText != cLine )
+	{
+		vPortFree( pcText );
+	}
+	return iLength;
 }
 /*-----------------------------------------------------------*/
 
@@ -289,26 +352,21 @@ const int8_t *pcReturn = NULL;
 
 static portBASE_TYPE prvHelpCommand( int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString )
 {
-static const CLI_Definition_List_Item_t * pxCommand = NULL;
+static unsigned portBASE_TYPE uxNext = 0;
 signed portBASE_TYPE xReturn;
 
 	( void ) pcCommandString;
 
-	if( pxCommand == NULL )
-	{
-		/* Reset the pxCommand pointer back to the start of the list. */
-		pxCommand = &xRegisteredCommands;
-	}
-
-	/* Return the next command help string, before moving the pointer on to
-	the next command in the list. */
-	strncpy( ( char * ) pcWriteBuffer, ( const char * ) pxCommand->pxCommandLineDefinition->pcHelpString, xWriteBufferLen );
-	pxCommand = pxCommand->pxNext;
+	/* Return the next command help string, before moving on to the next
+	command in the table. */
+	strncpy( ( char * ) pcWriteBuffer, ( const char * ) pxRegisteredCommands[ uxNext ]->pcHelpString, xWriteBufferLen );
+	uxNext++;
 
-	if( pxCommand == NULL )
+	if( uxNext >= uxRegisteredCommands )
 	{
-		/* There are no more commands in the list, so there will be no more
+		/* There are no more commands in the table, so there will be no more
 		strings to return after this one and pdFALSE should be returned. */
+		uxNext = 0;
 		xReturn = pdFALSE;
 	}
 	else
@@ -320,6 +378,94 @@ signed portBASE_TYPE xReturn;
 }
 /*-----------------------------------------------------------*/
 
+static portBASE_TYPE prvHelpStream( const CLI_Writer_t *pxWriter, const int8_t *pcCommandString )
+{
+unsigned portBASE_TYPE uxIndex;
+const char *pcHelp;
+
+	( void ) pcCommandString;
+
+	for( uxIndex = 0; uxIndex < uxRegisteredCommands; uxIndex++ )
+	{
+		pcHelp = ( const char * ) pxRegisteredCommands[ uxIndex ]->pcHelpString;
+		pxWriter->vWrite( pxWriter->pvContext, pcHelp, strlen( pcHelp ) );
+	}
+
+	return pdFALSE;
+}
+/*-----------------------------------------------------------*/
+
+static portBASE_TYPE prvFindCommand( const int8_t *pcCommandInput, size_t xInputLength, unsigned portBASE_TYPE *puxIndex )
+{
+unsigned portBASE_TYPE uxLow = 0, uxHigh = uxRegisteredCommands, uxMiddle;
+size_t xWordLength = 0;
+const char *pcName;
+int iCompare;
+
+	/* The command is the first word of the input. */
+	while( ( xWordLength < xInputLength ) && ( pcCommandInput[ xWordLength ] != ' ' ) && ( pcCommandInput[ xWordLength ] != 0x00 ) )
+	{
+		xWordLength++;
+	}
+
+	while( uxLow < uxHigh )
+	{
+		uxMiddle = ( uxLow + uxHigh ) / 2;
+		pcName = ( const char * ) pxRegisteredCommands[ uxMiddle ]->pcCommand;
+		iCompare = strncmp( ( const char * ) pcCommandInput, pcName, xWordLength );
+		if( ( iCompare == 0 ) && ( pcName[ xWordLength ] != 0x00 ) )
+		{
+			/* The word is a prefix of the name, so it sorts first. */
+			iCompare = -1;
+		}
+
+		if( iCompare == 0 )
+		{
+			*puxIndex = uxMiddle;
+			return pdTRUE;
+		}
+		else if( iCompare < 0 )
+		{
+			uxHigh = uxMiddle;
+		}
+		else
+		{
+			uxLow = uxMiddle + 1;
+		}
+	}
+
+	*puxIndex = uxLow;
+	return pdFALSE;
+}
+/*-----------------------------------------------------------*/
+
+static const CLI_Command_Definition_t *prvLookUpCommand( const int8_t *pcCommandInput, const CLI_Writer_t *pxWriter )
+{
+const CLI_Command_Definition_t *pxCommand;
+unsigned portBASE_TYPE uxIndex;
+
+	if( prvFindCommand( pcCommandInput, strlen( ( const char * ) pcCommandInput ), &uxIndex ) == pdFALSE )
+	{
+		/* The command was not found. */
+		pxWriter->vWrite( pxWriter->pvContext, pcNotRecognised, strlen( pcNotRecognised ) );
+		return NULL;
+	}
+	pxCommand = pxRegisteredCommands[ uxIndex ];
+
+	/* The command has been found.  Check it has the expected number of
+	parameters.  If cExpectedNumberOfParameters is -1, then there could be a
+	variable number of parameters and no check is made. */
+	if( ( pxCommand->cExpectedNumberOfParameters >= 0 ) &&
+		( prvGetNumberOfParameters( pcCommandInput ) != pxCommand->cExpectedNumberOfParameters ) )
+	{
+		pxWriter->vWrite( pxWriter->pvContext, pcIncorrectParameters, strlen( pcIncorrectParameters ) );
+		return NULL;
+	}
+
+	return pxCommand;
+}
+/*-----------------------------------------------------------*/
+
 static int8_t prvGetNumberOfParameters( const int8_t * pcCommandString )
 {
 int8_t cParameters = 0;
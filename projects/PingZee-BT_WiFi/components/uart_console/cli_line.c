@@ -0,0 +1,58 @@
+/*
+ * cli_line.c
+ *
+ * \brief Line editor of the UART console.
+ *
+ */
+
+#include <string.h>
+#include "cli_line.h"
+
+void cli_line_init(cli_line_t *l, cli_line_echo_t echo, void *ctx)
+{
+	memset(l, 0, sizeof(*l));
+	l->echo = echo;
+	l->ctx = ctx;
+}
+
+size_t cli_line_feed(cli_line_t *l, const uint8_t *data, size_t len, const char **command)
+{
+	size_t i, echoed = 0;
+
+	*command = NULL;
+	for (i = 0; i < len; i++) {
+		char c = (char)data[i];
+
+		if (c == '\r') {
+			i++;
+			break;
+		}
+		if (c == '\n') {
+			/* Ignore the character. */
+		} else if (c == '\b') {
+			/* Erase the last character on the terminal, then in the line - if any. */
+			l->echo(l->ctx, (const char *)&data[echoed], i + 1 - echoed);
+			l->echo(l->ctx, " \b", 2);
+			echoed = i + 1;
+			if (l->len > 0) {
+				l->line[--l->len] = '\0';
+			}
+		} else if (l->len < CLI_LINE_MAX - 1) {
+			l->line[l->len++] = c;
+		}
+	}
+	// Echo everything used in one go
+	if (i > echoed) {
+		l->echo(l->ctx, (const char *)&data[echoed], i - echoed);
+	}
+	if (i > 0 && data[i - 1] == '\r') {
+		/* An empty line executes the last command again. */
+		if (l->len > 0) {
+			memcpy(l->last, l->line, l->len + 1);
+		}
+		memset(l->line, 0, sizeof(l->line));
+		l->len = 0;
+		*command = l->last;
+	}
+	return i;
+}
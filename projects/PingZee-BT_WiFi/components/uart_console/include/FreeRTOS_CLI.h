@@ -51,6 +51,19 @@ the pcWriteBuffer buffer, and pcCommandString is the entire string as input by
 the user (from which parameters can be extracted).*/
 typedef portBASE_TYPE (*pdCOMMAND_LINE_CALLBACK)( int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t * pcCommandString );
 
+/* Where streaming commands write their output.  vWrite is called with every
+piece of output as it is produced, so the output of a command is not limited
+by the size of any buffer. */
+typedef struct xCOMMAND_LINE_WRITER
+{
+	void ( *vWrite )( void *pvContext, const char *pcData, size_t xDataLen );
+	void *pvContext;
+} CLI_Writer_t;
+
+/* The prototype of streaming commands: they write all their output through
+pxWriter in one call.  The return value is ignored. */
+typedef portBASE_TYPE (*pdCOMMAND_LINE_STREAM_CALLBACK)( const CLI_Writer_t *pxWriter, const int8_t * pcCommandString );
+
 /* The structure that defines command line commands.  A command line command
 should be defined by declaring a const structure of this type. */
 typedef struct xCOMMAND_LINE_INPUT
@@ -59,6 +72,7 @@ typedef struct xCOMMAND_LINE_INPUT
 	const int8_t * const pcHelpString;			/* String that describes how to use the command.  Should start with the command itself, and end with "\r\n".  For example "help: Returns a list of all the commands\r\n". */
 	const pdCOMMAND_LINE_CALLBACK pxCommandInterpreter;	/* A pointer to the callback function that will return the output generated by the command. */
 	int8_t cExpectedNumberOfParameters;			/* Commands expect a fixed number of parameters, which may be zero. */
+	const pdCOMMAND_LINE_STREAM_CALLBACK pxStreamInterpreter;	/* Optional.  Used instead of pxCommandInterpreter by FreeRTOS_CLIProcessCommandStream(). */
 } CLI_Command_Definition_t;
 
 /* For backward compatibility. */
@@ -69,6 +83,10 @@ typedef struct xCOMMAND_LINE_INPUT
  * Registering a command adds the command to the list of commands that are
  * handled by the command interpreter.  Once a command has been registered it
  * can be executed from the command line.
+ *
+ * The commands are kept in a table sorted by name, so finding a command is a
+ * binary search.  Fails if the table is full (configCOMMAND_INT_MAX_COMMANDS)
+ * or a command of the same name is registered already.
  */
 portBASE_TYPE FreeRTOS_CLIRegisterCommand( const CLI_Command_Definition_t * const pxCommandToRegister );
 
@@ -85,6 +103,26 @@ portBASE_TYPE FreeRTOS_CLIRegisterCommand( const CLI_Command_Definition_t * cons
  */
 portBASE_TYPE FreeRTOS_CLIProcessCommand( const int8_t * const pcCommandInput, int8_t * pcWriteBuffer, size_t xWriteBufferLen  );
 
+/*
+ * Runs the command interpreter for the command string "pcCommandInput" and
+ * sends all its output to pxWriter, in one call.  Streaming commands write
+ * directly; other commands are called until they return pdFALSE, and every
+ * string they produce in the output buffer is passed on.
+ *
+ * A streaming command without pxCommandInterpreter can also be run with
+ * FreeRTOS_CLIProcessCommand(), but its output is cut to xWriteBufferLen.
+ *
+ * Returns pdPASS if the command was found and run.  Not reentrant, as
+ * FreeRTOS_CLIProcessCommand().
+ */
+portBASE_TYPE FreeRTOS_CLIProcessCommandStream( const int8_t * const pcCommandInput, const CLI_Writer_t *pxWriter );
+
+/*
+ * Formatted output for streaming commands.  Returns the number of characters
+ * written.
+ */
+int FreeRTOS_CLIPrintf( const CLI_Writer_t *pxWriter, const char *pcFormat, ... );
+
 /*-----------------------------------------------------------*/
 
 /*
@@ -106,5 +144,6 @@ int8_t *FreeRTOS_CLIGetOutputBuffer( void );
 const int8_t *FreeRTOS_CLIGetParameter( const int8_t *pcCommandString, unsigned portBASE_TYPE uxWantedParameter, portBASE_TYPE *pxParameterStringLength );
 
 #define configCOMMAND_INT_MAX_OUTPUT_SIZE   128
+#define configCOMMAND_INT_MAX_COMMANDS      24		/* "help" included */
 
 #endif /* COMPONENTS_UART_CONSOLE_INCLUDE_FREERTOS_CLI_H_ */
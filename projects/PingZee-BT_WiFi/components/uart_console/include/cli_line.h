@@ -0,0 +1,56 @@
+/*
+ * cli_line.h
+ *
+ * \brief Line editor of the UART console.
+ *
+ *  Collects received characters into a command line: echoes them, handles
+ *  backspace and ignores '\n'. A line ends with '\r'; an empty line repeats
+ *  the previous command. Works on whole chunks of input, so the console task
+ *  can hand it everything the UART received with one call.
+ *
+ *  Kept free of any hardware or RTOS dependency.
+ */
+
+#ifndef COMPONENTS_UART_CONSOLE_INCLUDE_CLI_LINE_H_
+#define COMPONENTS_UART_CONSOLE_INCLUDE_CLI_LINE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Longest command line, terminating zero included */
+#define CLI_LINE_MAX				50
+
+/**
+ * \brief Send echo output to the terminal
+ */
+typedef void (*cli_line_echo_t)(void *ctx, const char *data, size_t len);
+
+typedef struct {
+	char line[CLI_LINE_MAX];	// line being edited
+	char last[CLI_LINE_MAX];	// last command, what an empty line executes
+	uint8_t len;
+	cli_line_echo_t echo;
+	void *ctx;
+} cli_line_t;
+
+void cli_line_init(cli_line_t *l, cli_line_echo_t echo, void *ctx);
+
+/**
+ * \brief Edit the line with received characters
+ *
+ * Stops after the first '\r'. The command it completes is then returned in
+ * 'command', valid until the next call; NULL if the line is not complete yet.
+ *
+ * \retval number of bytes of 'data' used, the rest belongs to the next line
+ */
+size_t cli_line_feed(cli_line_t *l, const uint8_t *data, size_t len, const char **command);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* COMPONENTS_UART_CONSOLE_INCLUDE_CLI_LINE_H_ */
@@ -0,0 +1,21 @@
+/* Host stand-in for the FreeRTOS definitions used by FreeRTOS_CLI.c */
+#pragma once
+#include <stdint.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#define portBASE_TYPE   int
+typedef int BaseType_t;
+typedef int portMUX_TYPE;
+
+#define pdFALSE         0
+#define pdTRUE          1
+#define pdFAIL          pdFALSE
+#define pdPASS          pdTRUE
+
+#define portMUX_INITIALIZER_UNLOCKED    0
+#define configASSERT(x)                 assert(x)
+#define pvPortMalloc(size)              malloc(size)
+#define taskENTER_CRITICAL(mux)         (void)(mux)
+#define taskEXIT_CRITICAL(mux)          (void)(mux)
+#define vPortFree(ptr)                  free(ptr)
@@ -0,0 +1,2 @@
+/* Host stand-in, see FreeRTOS.h */
+#pragma once
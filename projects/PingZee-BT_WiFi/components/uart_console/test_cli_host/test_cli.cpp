@@ -0,0 +1,351 @@
+// Copyright 2015-2017 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "catch.hpp"
+#include "cli_line.h"
+#include "freertos/FreeRTOS.h"
+extern "C" {
+#include "FreeRTOS_CLI.h"
+}
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using std::string;
+
+static portBASE_TYPE echo_command(int8_t* out, size_t len, const int8_t* cmd)
+{
+    /* Everything after "echo " */
+    const char* args = strchr((const char*)cmd, ' ');
+    snprintf((char*)out, len, "[%s]\r\n", args ? args + 1 : "");
+    return pdFALSE;
+}
+
+static portBASE_TYPE count_command(int8_t* out, size_t len, const int8_t* cmd)
+{
+    static int n = 0;
+    snprintf((char*)out, len, "%d ", ++n);
+    if (n == 3) {
+        n = 0;
+        return pdFALSE;
+    }
+    return pdTRUE;
+}
+
+static portBASE_TYPE counter_command(int8_t* out, size_t len, const int8_t* cmd)
+{
+    snprintf((char*)out, len, "counter\r\n");
+    return pdFALSE;
+}
+
+/* "dump N": N numbered lines, written as they are produced */
+static portBASE_TYPE dump_command(const CLI_Writer_t* writer, const int8_t* cmd)
+{
+    portBASE_TYPE len;
+    int n = atoi((const char*)FreeRTOS_CLIGetParameter(cmd, 1, &len));
+    for (int i = 0; i < n; i++) {
+        FreeRTOS_CLIPrintf(writer, "line %03d\r\n", i);
+    }
+    return pdFALSE;
+}
+
+static const CLI_Command_Definition_t echo_def = {
+    (const int8_t* const)"echo", (const int8_t* const)"echo <text>\r\n", echo_command, -1
+};
+static const CLI_Command_Definition_t count_def = {
+    (const int8_t* const)"count", (const int8_t* const)"count\r\n", count_command, 0
+};
+static const CLI_Command_Definition_t counter_def = {
+    (const int8_t* const)"counter", (const int8_t* const)"counter\r\n", counter_command, 0
+};
+static const CLI_Command_Definition_t dump_def = {
+    (const int8_t* const)"dump", (const int8_t* const)"dump <n>\r\n", NULL, 1, dump_command
+};
+
+static void register_commands()
+{
+    static bool registered = false;
+    if (!registered) {
+        /* Not in order, the table sorts them */
+        REQUIRE(FreeRTOS_CLIRegisterCommand(&echo_def) == pdPASS);
+        REQUIRE(FreeRTOS_CLIRegisterCommand(&dump_def) == pdPASS);
+        REQUIRE(FreeRTOS_CLIRegisterCommand(&counter_def) == pdPASS);
+        REQUIRE(FreeRTOS_CLIRegisterCommand(&count_def) == pdPASS);
+        registered = true;
+    }
+}
+
+static void append(void* ctx, const char* data, size_t len)
+{
+    static_cast<string*>(ctx)->append(data, len);
+}
+
+/* Run 'command' with FreeRTOS_CLIProcessCommandStream() */
+static string run(const char* command, portBASE_TYPE* ret = NULL)
+{
+    string out;
+    CLI_Writer_t writer = { append, &out };
+    portBASE_TYPE r = FreeRTOS_CLIProcessCommandStream((const int8_t*)command, &writer);
+    if (ret) {
+        *ret = r;
+    }
+    return out;
+}
+
+/* What cli_task in uart_console.c does with received data, writing to a string instead of the UART */
+class Console {
+public:
+    Console()
+    {
+        register_commands();
+        cli_line_init(&line, echo, this);
+    }
+
+    /* One UART_DATA event: 'chunk' is what uart_read_bytes_peek hands out */
+    void receive(const string& chunk)
+    {
+        const uint8_t* data = (const uint8_t*)chunk.data();
+        size_t len = chunk.size();
+        while (len) {
+            const char* command;
+            size_t used = cli_line_feed(&line, data, len, &command);
+            REQUIRE(used > 0);
+            REQUIRE(used <= len);
+            data += used;
+            len -= used;
+            if (command) {
+                commands.push_back(command);
+                execute(command);
+            }
+        }
+    }
+
+    /* Send 'script' in chunks of 'size' bytes, 0 for all at once */
+    void type(const string& script, size_t size = 1)
+    {
+        if (size == 0) {
+            size = script.size();
+        }
+        for (size_t i = 0; i < script.size(); i += size) {
+            receive(script.substr(i, size));
+        }
+    }
+
+    string terminal;
+    std::vector<string> commands;
+    cli_line_t line;
+
+private:
+    static void echo(void* ctx, const char* data, size_t len)
+    {
+        static_cast<Console*>(ctx)->terminal.append(data, len);
+    }
+
+    void execute(const char* command)
+    {
+        terminal += "\r\n";
+        terminal += run(command);
+        terminal += "\r\n> ";
+    }
+};
+
+static const string script =
+    "echo hello world\r"
+    "ecx\bho fixed\r"
+    "\r"
+    "count\r\n"
+    "count 1\r"
+    "nosuch\r"
+    "help\r";
+
+TEST_CASE("scripted session", "[cli]")
+{
+    Console c;
+    c.type(script, 0);
+
+    std::vector<string> expected = { "echo hello world", "echo fixed", "echo fixed", "count", "count 1", "nosuch", "help" };
+    CHECK(c.commands == expected);
+    CHECK(c.terminal.find("echo hello world\r\r\n[hello world]\r\n\r\n> ") == 0);
+    CHECK(c.terminal.find("ecx\b \bho fixed\r") != string::npos);
+    CHECK(c.terminal.find("\r\r\n[fixed]\r\n\r\n> ") != string::npos);
+    CHECK(c.terminal.find("count\r\r\n1 2 3 \r\n> ") != string::npos);
+    CHECK(c.terminal.find("Incorrect command parameter(s)") != string::npos);
+    CHECK(c.terminal.find("Command not recognised") != string::npos);
+    CHECK(c.terminal.find("echo <text>\r\n") != string::npos);
+    CHECK(c.terminal.find("count\r\n") != string::npos);
+}
+
+TEST_CASE("the transcript does not depend on how the input is chunked", "[cli]")
+{
+    Console whole;
+    whole.type(script, 0);
+    const size_t sizes[] = { 1, 2, 3, 7, 16 };
+    for (size_t size : sizes) {
+        Console c;
+        c.type(script, size);
+        INFO("chunks of " << size);
+        CHECK(c.commands == whole.commands);
+        CHECK(c.terminal == whole.terminal);
+    }
+}
+
+TEST_CASE("line editing", "[cli]")
+{
+    Console c;
+
+    SECTION("backspace on an empty line") {
+        c.type("\b\becho x\r");
+        REQUIRE(c.commands.size() == 1);
+        CHECK(c.commands[0] == "echo x");
+    }
+    SECTION("an overlong line is cut") {
+        string longline = "echo " + string(100, 'a');
+        c.type(longline + "\r", 0);
+        REQUIRE(c.commands.size() == 1);
+        CHECK(c.commands[0].size() == CLI_LINE_MAX - 1);
+        CHECK(c.commands[0] == longline.substr(0, CLI_LINE_MAX - 1));
+        /* Every character is still echoed */
+        CHECK(c.terminal.find(longline + "\r") == 0);
+    }
+    SECTION("a partial line waits for the rest") {
+        c.type("echo par", 0);
+        CHECK(c.commands.empty());
+        CHECK(c.terminal == "echo par");
+        c.type("tial\r", 0);
+        REQUIRE(c.commands.size() == 1);
+        CHECK(c.commands[0] == "echo partial");
+    }
+}
+
+TEST_CASE("commands are found by their whole name", "[cli]")
+{
+    register_commands();
+
+    CHECK(run("count") == "1 2 3 ");
+    CHECK(run("counter") == "counter\r\n");
+    CHECK(run("echo") == "[]\r\n");
+    portBASE_TYPE ret;
+    CHECK(run("coun", &ret).find("Command not recognised") == 0);
+    CHECK(ret == pdFAIL);
+    CHECK(run("counters").find("Command not recognised") == 0);
+    CHECK(run("a").find("Command not recognised") == 0);
+    CHECK(run("zzz").find("Command not recognised") == 0);
+    CHECK(run("").find("Command not recognised") == 0);
+    CHECK(run("counter 1").find("Incorrect command parameter(s)") == 0);
+}
+
+TEST_CASE("help lists the commands in name order", "[cli]")
+{
+    register_commands();
+
+    string help = run("help");
+    const char* order[] = { "count\r\n", "counter\r\n", "dump <n>\r\n", "echo <text>\r\n", "\r\nhelp:" };
+    size_t pos = 0;
+    for (const char* h : order) {
+        INFO(h);
+        size_t at = help.find(h, pos);
+        REQUIRE(at != string::npos);
+        pos = at + 1;
+    }
+
+    /* Paged one command per call through the buffer interface */
+    int8_t out[configCOMMAND_INT_MAX_OUTPUT_SIZE];
+    string paged;
+    int calls = 0;
+    portBASE_TYPE more;
+    do {
+        more = FreeRTOS_CLIProcessCommand((const int8_t*)"help", out, sizeof(out));
+        paged += (const char*)out;
+        calls++;
+    } while (more != pdFALSE);
+    CHECK(paged == help);
+    CHECK(calls == 5);
+}
+
+TEST_CASE("streamed output is not limited by the output buffer", "[cli]")
+{
+    register_commands();
+
+    string out = run("dump 100");
+    REQUIRE(out.size() == 100 * 10);
+    CHECK(out.find("line 000\r\n") == 0);
+    CHECK(out.find("line 099\r\n") == 990);
+
+    /* Through the buffer interface, it is cut to fit */
+    int8_t buf[configCOMMAND_INT_MAX_OUTPUT_SIZE];
+    CHECK(FreeRTOS_CLIProcessCommand((const int8_t*)"dump 100", buf, sizeof(buf)) == pdFALSE);
+    CHECK(strlen((const char*)buf) == sizeof(buf) - 1);
+    CHECK(out.compare(0, sizeof(buf) - 1, (const char*)buf) == 0);
+
+    /* Lines longer than the formatting buffer of FreeRTOS_CLIPrintf */
+    string line(300, 'x');
+    string printed;
+    CLI_Writer_t writer = { append, &printed };
+    CHECK(FreeRTOS_CLIPrintf(&writer, "<%s>", line.c_str()) == 302);
+    CHECK(printed == "<" + line + ">");
+}
+
+static void discard(void* ctx, const char* data, size_t len)
+{
+    *static_cast<size_t*>(ctx) += len;
+}
+
+TEST_CASE("command lookup time", "[cli][bench]")
+{
+    register_commands();
+
+    const char* commands[] = { "count", "counter", "echo x", "dump 0", "nosuch" };
+    const int rounds = 200000;
+    size_t written = 0;
+    CLI_Writer_t writer = { discard, &written };
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; i++) {
+        FreeRTOS_CLIProcessCommandStream((const int8_t*)commands[i % 5], &writer);
+    }
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "command dispatch: " << (double)ns / rounds << " ns per command" << std::endl;
+    CHECK(written > 0);
+}
+
+/* Last: fills the table */
+TEST_CASE("registration fails for duplicates and when the table is full", "[cli]")
+{
+    register_commands();
+
+    static const CLI_Command_Definition_t echo_again = {
+        (const int8_t* const)"echo", (const int8_t* const)"echo again\r\n", echo_command, 0
+    };
+    CHECK(FreeRTOS_CLIRegisterCommand(&echo_def) == pdFAIL);
+    CHECK(FreeRTOS_CLIRegisterCommand(&echo_again) == pdFAIL);
+    CHECK(run("echo a b") == "[a b]\r\n");
+
+    /* "help" and the four above are registered */
+    static char names[configCOMMAND_INT_MAX_COMMANDS][8];
+    static std::vector<CLI_Command_Definition_t*> defs;
+    int added = 0;
+    for (int i = 0; i < configCOMMAND_INT_MAX_COMMANDS; i++) {
+        snprintf(names[i], sizeof(names[i]), "c%02d", (i * 7) % configCOMMAND_INT_MAX_COMMANDS);
+        defs.push_back(new CLI_Command_Definition_t{ (const int8_t*)names[i], (const int8_t*)"\r\n", counter_command, 0, NULL });
+        if (FreeRTOS_CLIRegisterCommand(defs.back()) == pdPASS) {
+            added++;
+        }
+    }
+    CHECK(added == configCOMMAND_INT_MAX_COMMANDS - 5);
+    CHECK(run("c00") == "counter\r\n");
+    CHECK(run("count") == "1 2 3 ");
+    CHECK(run("echo y") == "[y]\r\n");
+    CHECK(run("dump 1") == "line 000\r\n");
+}
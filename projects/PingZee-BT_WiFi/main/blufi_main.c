@@ -83,10 +83,14 @@ static wifi_config_t ap_config;
 /* FreeRTOS event group to signal when we are connected & ready to make a request */
 static EventGroupHandle_t wifi_event_group;
 
-/* The event group allows multiple bits for each event,
-   but we only care about one event - are we connected
-   to the AP with an IP? */
+/* The event group allows multiple bits for each event:
+   are we connected to the AP with an IP, and is Wi-Fi
+   initialised at all? */
 const int CONNECTED_BIT = BIT0;
+const int WIFI_READY_BIT = BIT1;
+
+/* How long a BLUFI request waits for Wi-Fi that is still coming up */
+#define WIFI_READY_WAIT_MS          3000
 
 /* store the station info for send back to phone */
 static bool gl_sta_connected = false;
@@ -151,7 +155,6 @@ static esp_err_t event_handler(void *ctx, system_event_t *event)
 static void initialise_wifi(void)
 {
     tcpip_adapter_init();
-    wifi_event_group = xEventGroupCreate();
     ESP_ERROR_CHECK( esp_event_loop_init(event_handler, NULL) );
     wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
     ESP_ERROR_CHECK( esp_wifi_init(&cfg) );
@@ -160,6 +163,13 @@ static void initialise_wifi(void)
     ESP_ERROR_CHECK( esp_wifi_start() );
 }
 
+static bool wifi_wait_ready(void)
+{
+    EventBits_t bits = xEventGroupWaitBits(wifi_event_group, WIFI_READY_BIT, pdFALSE, pdTRUE,
+                                           WIFI_READY_WAIT_MS / portTICK_PERIOD_MS);
+    return (bits & WIFI_READY_BIT) != 0;
+}
+
 static esp_blufi_callbacks_t blufi_callbacks = {
     .event_cb = blufi_event_callback,
     .negotiate_data_handler = blufi_dh_negotiate_data_handler,
@@ -172,6 +182,21 @@ static void blufi_event_callback(esp_blufi_cb_event_t event, esp_blufi_cb_param_
 {
     /* actually, should post to blufi_task handle the procedure,
      * now, as a demo, we do simplely */
+    switch (event) {
+    case ESP_BLUFI_EVENT_INIT_FINISH:
+    case ESP_BLUFI_EVENT_DEINIT_FINISH:
+    case ESP_BLUFI_EVENT_BLE_CONNECT:
+    case ESP_BLUFI_EVENT_BLE_DISCONNECT:
+        break;
+    default:
+        /* A wake may have brought up BT only; the connect started Wi-Fi */
+        if (!wifi_wait_ready()) {
+            BLUFI_ERROR("BLUFI event %d dropped, Wi-Fi is not up\n", event);
+            return;
+        }
+        break;
+    }
+
     switch (event) {
     case ESP_BLUFI_EVENT_INIT_FINISH:
         BLUFI_INFO("BLUFI init finish\n");
@@ -184,6 +209,8 @@ static void blufi_event_callback(esp_blufi_cb_event_t event, esp_blufi_cb_param_
         break;
     case ESP_BLUFI_EVENT_BLE_CONNECT:
         BLUFI_INFO("BLUFI ble connect\n");
+        psAppGetStatus()->what_happen = WAKE_BT_RESPONDED;
+        vAppWakeEvent(WAKE_EV_PEER);
         esp_ble_gap_stop_advertising();
         blufi_security_deinit();
         blufi_security_init();
@@ -314,56 +341,34 @@ static void gap_event_handler(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param
     }
 }
 
-void app_main()
+static esp_err_t initialise_bt(void)
 {
     esp_err_t ret;
-    AppMessage_t dmsg;
-
-	vAppWakeup(psAppGetStatus());
-
-	vAppStart( 2048, 12);
-#ifdef CONFIG_USE_SERIAL_CONSOLE
-	void uart_console_task(void);
-
-	uart_console_task();
-#endif
-	vI2C0MasterStart( 2048, 12);
-	vSPIMasterStart( 2048, 12);
-#ifdef CONFIG_SSD1306_OLED
-	vOledStart( 2048, 12);
-#endif // CONFIG_SSD1306_OLED
-#ifdef CONFIG_LIS3DH
-	vLis3dhStart(2048, 12);
-#endif	
-	vAppTimersStart(2048, 12);
-
-    nvs_flash_init();
-    initialise_wifi();
 
 // [ADK]     esp_bt_controller_init();
     esp_bt_controller_config_t bt_cfg = BT_CONTROLLER_INIT_CONFIG_DEFAULT();
     ret = esp_bt_controller_init(&bt_cfg);
     if (ret) {
         BLUFI_ERROR("%s initialize controller failed\n", __func__);
-        return;
+        return ret;
     }
 
     ret = esp_bt_controller_enable(ESP_BT_MODE_BTDM);
     if (ret) {
         BLUFI_ERROR("%s enable bt controller failed\n", __func__);
-        return;
+        return ret;
     }
 
     ret = esp_bluedroid_init();
     if (ret) {
         BLUFI_ERROR("%s init bluedroid failed\n", __func__);
-        return;
+        return ret;
     }
 
     ret = esp_bluedroid_enable();
     if (ret) {
         BLUFI_ERROR("%s init bluedroid failed\n", __func__);
-        return;
+        return ret;
     }
 
     BLUFI_INFO("BD ADDR: "ESP_BD_ADDR_STR"\n", ESP_BD_ADDR_HEX(esp_bt_dev_get_address()));
@@ -375,9 +380,91 @@ void app_main()
 
     esp_blufi_register_callbacks(&blufi_callbacks);
     esp_blufi_profile_init();
+    return ESP_OK;
+}
+
+/*
+ * BT and Wi-Fi come up on their own tasks, one per CPU, while the app task
+ * goes on with the sensor window. Each reports to the wake plan when done,
+ * failed or not, so the wake still ends.
+ */
+static void bt_up_task(void *pvParameters)
+{
+    initialise_bt();
+    vAppWakeEvent(WAKE_EV_BT_UP);
+    vTaskDelete(NULL);
+}
+
+static void wifi_up_task(void *pvParameters)
+{
+    initialise_wifi();
+    xEventGroupSetBits(wifi_event_group, WIFI_READY_BIT);
+    vAppWakeEvent(WAKE_EV_WIFI_UP);
+    vTaskDelete(NULL);
+}
+
+/* Both need NVS; called from the app task only, so no race */
+static void radios_nvs_init(void)
+{
+    static bool nvs_ready = false;
+
+    if (!nvs_ready) {
+        nvs_flash_init();
+        nvs_ready = true;
+    }
+}
+
+static void start_bt(void)
+{
+    static bool started = false;
+
+    if (started) {
+        return;
+    }
+    started = true;
+    radios_nvs_init();
+    xTaskCreatePinnedToCore(bt_up_task, "BTup", 4096, NULL, 5, NULL, 0);
+}
+
+static void start_wifi(void)
+{
+    static bool started = false;
+
+    if (started) {
+        return;
+    }
+    started = true;
+    radios_nvs_init();
+    xTaskCreatePinnedToCore(wifi_up_task, "WiFiup", 4096, NULL, 5, NULL, 1);
+}
+
+void app_main()
+{
+    AppMessage_t dmsg = { .bus = MSGBUS_MSG_INIT };
+
+	vAppWakeup(psAppGetStatus());
+    wifi_event_group = xEventGroupCreate();
+
+	vAppStart( 2048, 12);
+#ifdef CONFIG_USE_SERIAL_CONSOLE
+	void uart_console_task(void);
+
+	uart_console_task();
+#endif
+	vI2C0MasterStart( 2048, 12);
+	vSPIMasterStart( 2048, 12);
+#ifdef CONFIG_SSD1306_OLED
+	vOledStart( 2048, 12);
+#endif // CONFIG_SSD1306_OLED
+#ifdef CONFIG_LIS3DH
+	vLis3dhStart(2048, 12);
+#endif	
+	vAppTimersStart(2048, 12);
+
+    /* Radios are only brought up if the wake plan asks for them */
+    vAppSetRadios(start_bt, start_wifi);
 
     dmsg.cmd = APPMSG_MAIN_LOOP_START;
-    dmsg.app__doneCallback = NULL;
-   AppMsgPut(&dmsg);
+    AppMsgCall(&dmsg);
 	
 }